@@ -5,17 +5,18 @@
  * update p - TGV2_updateP_kernel()
  * update q - TGV2_updateQ_kernel()
  * update all u - TGV2_updateU_kernel()
- * update r - TGV2_updateR_kernel()
+ * update r - TGV2_updateR_kernel(), all views at once - TGV2_updateR_multiview_kernel()
  * calculate It:
  *      transform coordinates at u0- TGV2_transform_coordinates_kernel()
  *      interpolate - bilinear_interpolation_kernel() in kernels.cu
- *      subtract - subtract_kernel()
+ *      subtract - subtract(), element wise kernel of elementwise.h
  * calculate Iu:
  *      transform coordinates at u - TGV2_transform_coordinates_kernel()
  *      interpolate - bilinear_interpolation_kernel() in kernels.cu
  *      calculate coordinate derivatives at u0 - TGV2_calculate_coordinate_derivatives_kernel() (only needed once for each source view)
  *      calculate f(x,u) derivative - TGV2_calculate_derivativeF_kernel()
  *      calculate Iu - TGV2_calculate_Iu_kernel()
+ * calculate It and Iu of a view in one pass - TGV2_linearize_kernel(), rays Rrel * K^(-1) are precomputed once per view
  *
  * p, q and u1 are initialised to 0
  * u requires an initial solution
@@ -23,10 +24,15 @@
  * p and u1 are rank 2
  * q is rank 4
  * u and r are rank 1
+ *
+ * Packed variants (*_packed_kernel()) keep p as float2, q and tensor as float4
+ * and u1 together with u1bar as float4 (u1x, u1y, u1xbar, u1ybar)
  */
 
 #include <kernels.cu.h>
 #include <helper_structs.h>
+#include <cuda_exception.h>
+#include <elementwise.h>
 
 __global__ void TGV2_updateP_kernel(float * __restrict__ d_Px, float * __restrict__ d_Py,
                                     const float * d_u, const float * __restrict__ d_u1x, const float * __restrict__ d_u1y,
@@ -104,6 +110,34 @@ __global__ void TGV2_updateR_kernel(float * __restrict__ d_r, float * __restrict
     }
 }
 
+__global__ void TGV2_updateR_multiview_kernel(float * __restrict__ d_r, float * __restrict__ d_prodsum,
+                                              const float * __restrict__ d_u, const float * __restrict__ d_u0,
+                                              const float * __restrict__ d_It, const float * __restrict__ d_Iu, const int nimages,
+                                              const float sigma, const float lambda, const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int i = ind_y * width + ind_x;
+        const int layer = width * height;
+
+        const float du = d_u[i] - d_u0[i];
+        float prodsum = 0.f;
+
+        // same update as TGV2_updateR_kernel() for each view, sum is kept in a register
+        for (int j = 0, k = i; j < nimages; j++, k += layer){
+            const float Iu = d_Iu[k];
+            float r = d_r[k] + sigma * lambda * (d_It[k] + du * Iu);
+            r = r / fmaxf(1.f, fabs(r));
+            d_r[k] = r;
+            prodsum += r * Iu;
+        }
+
+        d_prodsum[i] = prodsum;
+    }
+}
+
 __global__ void TGV2_updateU_kernel(float * __restrict__ d_u, float * __restrict__ d_u1x, float * __restrict__ d_u1y,
                                     float * __restrict__ d_ubar, float * __restrict__ d_u1xbar, float * __restrict__ d_u1ybar,
                                     const float * d_Px, const float * d_Py, const float * d_Qx, const float * d_Qy,
@@ -178,18 +212,20 @@ __global__ void TGV2_transform_coordinates_kernel(float * __restrict__ d_x, floa
     }
 }
 
-__global__ void subtract_kernel(float * __restrict__ d_out, const float * __restrict__ d_in1, const float * __restrict__ d_in2,
-                                const int width, const int height)
+// Operations of element wise wrappers, see elementwise.h
+struct SubtractOp
 {
-    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
-    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+    static const int inputs = 2;
+    static const bool output = false;
+    __device__ inline float operator()(float, const float a, const float b) const { return a - b; }
+};
 
-    if ((ind_x < width) && (ind_y < height)) {
-        const int i = ind_y * width + ind_x;
-
-        d_out[i] = d_in1[i] - d_in2[i];
-    }
-}
+struct SparseWeightOp
+{
+    static const int inputs = 1;
+    static const bool output = false;
+    __device__ inline float operator()(float, const float ds, float) const { return ds > 0 ? 1.f : 0.f; }
+};
 
 __global__ void TGV2_calculate_coordinate_derivatives_kernel(float * __restrict__ d_dX, float * __restrict__ d_dY,
                                                              float * __restrict__ d_dZ,
@@ -254,6 +290,79 @@ __global__ void TGV2_calculate_Iu_kernel(float * __restrict__ d_Iu, const float
     }
 }
 
+// Source view samplers of TGV2_linearize_kernel(), same values as bilinear_interpolation() and
+// bilinear_interpolation_texture()
+struct TGV2LinearSampler
+{
+    const float * d_data;
+    int width, height;
+
+    __device__ inline float operator()(const float x, const float y) const
+    {
+        const int   ix = floor(x);
+        const float a  = x - ix;
+        const int   iy = floor(y);
+        const float b  = y - iy;
+
+        if ((ix < 0) || (iy < 0) || (iy+1 > height-1) || (ix+1 > width-1)) return 0.f;
+
+        const float r1 = a * d_data[iy*width+ix+1] + (1 - a) * d_data[iy*width+ix];
+        const float r2 = a * d_data[(iy+1)*width+ix+1] + (1 - a) * d_data[(iy+1)*width+ix];
+        return b * r2 + (1 - b) * r1;
+    }
+};
+
+struct TGV2TextureSampler
+{
+    cudaTextureObject_t tex;
+
+    // texel centers are at index + 0.5
+    __device__ inline float operator()(const float x, const float y) const { return tex2D<float>(tex, x + 0.5f, y + 0.5f); }
+};
+
+// Source view intensity at the pixel warped by depth u, KRinvK = K * Rrel * K^(-1) and Kt = K * trel are precomputed
+template<typename Sampler>
+__device__ inline float TGV2_warp(const Sampler & src, const Matrix3D & KRinvK, const float3 & Kt, const float u,
+                                  const int x, const int y)
+{
+    const float3 p = u * (KRinvK * make_float3(x + 1, y + 1, 1)) + Kt;
+    return src(p.x / p.z - 1, p.y / p.z - 1);
+}
+
+// One pass form of TGV2_transform_coordinates_kernel(), TGV2_calculate_coordinate_derivatives_kernel(),
+// TGV2_calculate_derivativeF_kernel(), interpolation, TGV2_calculate_Iu_kernel(), subtract_kernel() and resetting r.
+// Forward differences of the warped image warp the right and lower neighbours as well.
+template<typename Sampler>
+__global__ void TGV2_linearize_kernel(float * __restrict__ d_It, float * __restrict__ d_Iu, float * __restrict__ d_r,
+                                      const float * __restrict__ d_u0, const float * __restrict__ d_ref,
+                                      const Sampler src, const Matrix3D RinvK, const Matrix3D KRinvK,
+                                      const float3 trel, const float3 Kt, const float fx, const float fy,
+                                      const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int i = ind_y * width + ind_x;
+        const int xn = min(ind_x + 1, width - 1);
+        const int yn = min(ind_y + 1, height - 1);
+
+        // Coordinate derivatives are the pixel ray, 3D point in the source view frame is u0 * ray + trel
+        const float3 d = RinvK * make_float3(ind_x + 1, ind_y + 1, 1);
+        const float3 X = d_u0[i] * d + trel;
+        const float dfx = fx * (d.x * X.z - X.x * d.z) / (X.z * X.z);
+        const float dfy = fy * (d.y * X.z - X.y * d.z) / (X.z * X.z);
+
+        const float I = TGV2_warp(src, KRinvK, Kt, d_u0[i], ind_x, ind_y);
+        const float Ix = xn != ind_x ? TGV2_warp(src, KRinvK, Kt, d_u0[ind_y * width + xn], xn, ind_y) : I;
+        const float Iy = yn != ind_y ? TGV2_warp(src, KRinvK, Kt, d_u0[yn * width + ind_x], ind_x, yn) : I;
+
+        d_Iu[i] = (Ix - I) * dfx + (Iy - I) * dfy;
+        d_It[i] = I - d_ref[i];
+        d_r[i] = 0.f;
+    }
+}
+
 __global__ void Anisotropic_diffusion_tensor_kernel(float * __restrict__ d_T11, float * __restrict__ d_T12,
                                                     float * __restrict__ d_T21, float * __restrict__ d_T22,
                                                     const float * __restrict__ d_Img,
@@ -364,6 +473,128 @@ __global__ void TGV2_updateP_tensor_weighed_kernel(float * __restrict__ d_Px, fl
     }
 }
 
+__global__ void Anisotropic_diffusion_tensor_packed_kernel(float4 * __restrict__ d_T, const float * __restrict__ d_Img,
+                                                           const float beta, const float gamma, const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int i = ind_y * width + ind_x;
+        int xn = fminf(ind_x + 1, width -1);
+        int yn = fminf(ind_y + 1, height - 1);
+
+        // Calculate image gradient:
+        float x = d_Img[ind_y*width+xn] - d_Img[i];
+        float y = d_Img[yn*width+ind_x] - d_Img[i];
+
+        // normalize
+        float d = sqrt(x * x + y * y);
+        float k;
+
+        // Same tensor as Anisotropic_diffusion_tensor_kernel() stored as (T11, T12, T21, T22)
+        if (d > 0.f) {
+            x = x / d;
+            y = y / d;
+            k = expf(- beta * powf(d, gamma));
+            d_T[i] = make_float4(k * x * x + y * y, (k - 1) * x * y, (k - 1) * x * y, k * y * y + x * x);
+        }
+        else d_T[i] = make_float4(1.f, 0.f, 0.f, 1.f);
+    }
+}
+
+__global__ void TGV2_updateP_packed_kernel(float2 * __restrict__ d_P, const float4 * __restrict__ d_T,
+                                           const float * __restrict__ d_ubar, const float4 * __restrict__ d_u1,
+                                           const float alpha1, const float sigma, const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int i = ind_y * width + ind_x;
+
+        int xn = fminf(ind_x + 1, width - 1);
+        int yn = fminf(ind_y + 1, height - 1);
+
+        const float4 T = d_T[i];
+        const float4 u1 = d_u1[i];
+        const float2 p = d_P[i];
+        const float u = d_ubar[i];
+
+        // p(n+1) = project(p(n) + sigma*alpha1*T*(grad(ubar(n)) - u1bar(n)))
+        double x = d_ubar[ind_y * width + xn] - u - u1.z;
+        double y = d_ubar[yn * width + ind_x] - u - u1.w;
+        double dx = p.x + alpha1 * sigma * (T.x * x + T.y * y);
+        double dy = p.y + alpha1 * sigma * (T.z * x + T.w * y);
+        double d = fmaxf(1.f, sqrt(dx * dx + dy * dy));
+        d_P[i] = make_float2(dx / d, dy / d);
+    }
+}
+
+__global__ void TGV2_updateQ_packed_kernel(float4 * __restrict__ d_Q, const float4 * __restrict__ d_u1,
+                                           const float alpha0, const float sigma, const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int i = ind_y * width + ind_x;
+
+        int xn = fminf(ind_x + 1, width - 1);
+        int yn = fminf(ind_y + 1, height - 1);
+
+        const float4 u1 = d_u1[i], u1xn = d_u1[ind_y * width + xn], u1yn = d_u1[yn * width + ind_x];
+        const float4 q = d_Q[i];
+
+        // q(n+1) = project(q(n) + alpha0*sigma*grad(u1bar(n)))
+        float dx_u1x = u1xn.z - u1.z;
+        float dy_u1x = u1yn.z - u1.z;
+        float dx_u1y = u1xn.w - u1.w;
+        float dy_u1y = u1yn.w - u1.w;
+        double dx = q.x + alpha0 * sigma * dx_u1x;
+        double dy = q.y + alpha0 * sigma * dy_u1y;
+        double dz = q.z + alpha0 * sigma * (dy_u1x + dx_u1y)/2.0f;
+        double dw = q.w + alpha0 * sigma * (dy_u1x + dx_u1y)/2.0f;
+        double d = fmaxf(1.f, sqrt(dx * dx + dy * dy + dz * dz + dw * dw));
+        d_Q[i] = make_float4(dx / d, dy / d, dz / d, dw / d);
+    }
+}
+
+__global__ void TGV2_updateU_packed_kernel(float * __restrict__ d_u, float * __restrict__ d_ubar, float4 * __restrict__ d_u1,
+                                           const float4 * __restrict__ d_T, const float2 * __restrict__ d_P,
+                                           const float4 * __restrict__ d_Q, const float * __restrict__ d_prodsum,
+                                           const float alpha0, const float alpha1, const float tau, const float lambda,
+                                           const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int i = ind_y * width + ind_x;
+
+        int xp = fmaxf(ind_x - 1, 0.f);
+        int yp = fmaxf(ind_y - 1, 0.f);
+
+        const float uprev = d_u[i];
+        const float4 u1 = d_u1[i], T = d_T[i];
+        const float2 c_p = d_P[i], xp_p = d_P[ind_y*width+xp], yp_p = d_P[yp*width+ind_x];
+        const float4 c_q = d_Q[i], xp_q = d_Q[ind_y*width+xp], yp_q = d_Q[yp*width+ind_x];
+
+        // u(n+1) = u(n) - tau*(-alpha1*div(tensor*p(n+1)) + lambda*sum_over_i(Iui*ri(n+1)))
+        // u1(n+1)= u1(n)- tau*(-alpha1*tensor*p(n+1) - alpha0*div(q(n+1)))
+        float u = uprev - tau*(-alpha1 * (T.x * (c_p.x - xp_p.x) + T.y * (c_p.y - xp_p.y) +
+                                          T.z * (c_p.x - yp_p.x) + T.w * (c_p.y - yp_p.y)) + lambda*d_prodsum[i]);
+        float u1x = u1.x - tau*(-alpha1*(T.x*c_p.x+T.y*c_p.y) - alpha0*(c_q.x - xp_q.x + c_q.z - yp_q.z));
+        float u1y = u1.y - tau*(-alpha1*(T.z*c_p.x+T.w*c_p.y) - alpha0*(c_q.z - xp_q.z + c_q.y - yp_q.y));
+
+        // ubar(n+1) = 2 * u(n+1) - u(n)
+        // u1bar(n+1)= 2 * u1(n+1)- u1(n)
+        d_u[i] = u;
+        d_ubar[i] = 2 * u - uprev;
+        d_u1[i] = make_float4(u1x, u1y, 2 * u1x - u1.x, 2 * u1y - u1.y);
+    }
+}
+
 __global__ void TGV2_updateU_sparseDepth_kernel(float * __restrict__ d_u, float * __restrict__ d_u1x, float * __restrict__ d_u1y,
                                                 float * __restrict__ d_ubar, float * __restrict__ d_u1xbar, float * __restrict__ d_u1ybar,
                                                 const float * __restrict__ d_Px, const float * __restrict__ d_Py,
@@ -431,19 +662,6 @@ __global__ void TGV2_updateU_sparseDepthTensor_kernel(float * __restrict__ d_u,
     }
 }
 
-__global__ void calculateWeights_sparseDepth_kernel(float * __restrict__ d_w, const float * __restrict__ d_Ds, const int width, const int height)
-{
-    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
-    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
-
-    if ((ind_x < width) && (ind_y < height)) {
-        const int i = ind_y * width + ind_x;
-
-        if (d_Ds[i] > 0) d_w[i] = 1.f;
-        else d_w[i] = 0.f;
-    }
-}
-
 void TGV2_updateP(float * d_Px, float * d_Py, const float * d_u, const float * d_u1x, const float * d_u1y,
                   const float alpha1, const float sigma, const int width, const int height, dim3 blocks, dim3 threads)
 {
@@ -451,15 +669,25 @@ void TGV2_updateP(float * d_Px, float * d_Py, const float * d_u, const float * d
 }
 
 void TGV2_updateQ(float * d_Qx, float * d_Qy, float * d_Qz, float * d_Qw, const float * d_u1x, const float * d_u1y,
-                  const float alpha0, const float sigma, const int width, const int height, dim3 blocks, dim3 threads)
+                  const float alpha0, const float sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                  cudaStream_t stream)
 {
-    TGV2_updateQ_kernel<<<blocks, threads>>>(d_Qx, d_Qy, d_Qz, d_Qw, d_u1x, d_u1y, alpha0, sigma, width, height);
+    TGV2_updateQ_kernel<<<blocks, threads, 0, stream>>>(d_Qx, d_Qy, d_Qz, d_Qw, d_u1x, d_u1y, alpha0, sigma, width, height);
 }
 
 void TGV2_updateR(float * d_r, float * d_prodsum, const float * d_u, const float * d_u0, const float * d_It, const float * d_Iu,
-                  const float sigma, const float lambda, const int width, const int height, dim3 blocks, dim3 threads)
+                  const float sigma, const float lambda, const int width, const int height, dim3 blocks, dim3 threads,
+                  cudaStream_t stream)
+{
+    TGV2_updateR_kernel<<<blocks, threads, 0, stream>>>(d_r, d_prodsum, d_u, d_u0, d_It, d_Iu, sigma, lambda, width, height);
+}
+
+void TGV2_updateR_multiview(float * d_r, float * d_prodsum, const float * d_u, const float * d_u0, const float * d_It,
+                            const float * d_Iu, const int nimages, const float sigma, const float lambda,
+                            const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream)
 {
-    TGV2_updateR_kernel<<<blocks, threads>>>(d_r, d_prodsum, d_u, d_u0, d_It, d_Iu, sigma, lambda, width, height);
+    TGV2_updateR_multiview_kernel<<<blocks, threads, 0, stream>>>(d_r, d_prodsum, d_u, d_u0, d_It, d_Iu, nimages,
+                                                                  sigma, lambda, width, height);
 }
 
 void TGV2_updateU(float * d_u, float * d_u1x, float * d_u1y, float * d_ubar, float * d_u1xbar, float * d_u1ybar,
@@ -482,7 +710,7 @@ const int width, const int height, dim3 blocks, dim3 threads)
 
 void subtract(float * d_out, const float * d_in1, const float * d_in2, const int width, const int height, dim3 blocks, dim3 threads)
 {
-    subtract_kernel<<<blocks, threads>>>(d_out, d_in1, d_in2, width, height);
+    elementwise(d_out, d_in1, d_in2, SubtractOp(), width, height, threads);
 }
 
 void TGV2_calculate_coordinate_derivatives(float * d_dX, float * d_dY, float * d_dZ, const Matrix3D invK, const Matrix3D Rrel,
@@ -505,6 +733,28 @@ void TGV2_calculate_Iu(float * d_Iu, const float * d_I, const float * d_dfx, con
     TGV2_calculate_Iu_kernel<<<blocks, threads>>>(d_Iu, d_I, d_dfx, d_dfy, width, height);
 }
 
+TGV2ViewCache::TGV2ViewCache(const Matrix3D & K, const Matrix3D & invK, const Matrix3D & Rrel, const Vector3D & t)
+    : RinvK(Rrel * invK), KRinvK(K * (Rrel * invK)), trel(t), Kt(K * (float3)t), fx(K(0,0)), fy(K(1,1))
+{}
+
+void TGV2_linearize(float * d_It, float * d_Iu, float * d_r, const float * d_u0, const float * d_ref,
+                    const float * d_src, const int src_width, const int src_height, const TGV2ViewCache & view,
+                    const int width, const int height, dim3 blocks, dim3 threads)
+{
+    const TGV2LinearSampler src = {d_src, src_width, src_height};
+    TGV2_linearize_kernel<<<blocks, threads>>>(d_It, d_Iu, d_r, d_u0, d_ref, src, view.RinvK, view.KRinvK,
+                                               view.trel, view.Kt, view.fx, view.fy, width, height);
+}
+
+void TGV2_linearize_texture(float * d_It, float * d_Iu, float * d_r, const float * d_u0, const float * d_ref,
+                            const cudaTextureObject_t src, const TGV2ViewCache & view,
+                            const int width, const int height, dim3 blocks, dim3 threads)
+{
+    const TGV2TextureSampler sampler = {src};
+    TGV2_linearize_kernel<<<blocks, threads>>>(d_It, d_Iu, d_r, d_u0, d_ref, sampler, view.RinvK, view.KRinvK,
+                                               view.trel, view.Kt, view.fx, view.fy, width, height);
+}
+
 void Anisotropic_diffusion_tensor(float * d_T11, float * d_T12, float * d_T21, float * d_T22, const float * d_Img,
                                   const float beta, const float gamma, const int width, const int height,
                                   dim3 blocks, dim3 threads)
@@ -517,21 +767,57 @@ void TGV2_updateU_tensor_weighed(float * d_u, float * d_u1x, float * d_u1y, cons
                                  const float * d_Px, const float * d_Py, const float * d_Qx, const float * d_Qy,
                                  const float * d_Qz, const float * d_Qw, const float * d_prodsum,
                                  const float alpha0, const float alpha1, const float tau, const float lambda,
-                                 const int width, const int height, dim3 blocks, dim3 threads)
+                                 const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream)
 {
-    TGV2_updateU_tensor_weighed_kernel<<<blocks, threads>>>(d_u, d_u1x, d_u1y, d_T11, d_T12, d_T21, d_T22, d_ubar, d_u1xbar, d_u1ybar,
+    TGV2_updateU_tensor_weighed_kernel<<<blocks, threads, 0, stream>>>(d_u, d_u1x, d_u1y, d_T11, d_T12, d_T21, d_T22, d_ubar, d_u1xbar, d_u1ybar,
                                                             d_Px, d_Py, d_Qx, d_Qy, d_Qz, d_Qw, d_prodsum, alpha0, alpha1, tau, lambda,
                                                             width, height);
 }
 
 void TGV2_updateP_tensor_weighed(float * d_Px, float * d_Py, const float * d_T11, const float * d_T12, const float * d_T21, const float * d_T22,
                                  const float * d_u, const float * d_u1x, const float * d_u1y, const float alpha1,
-                                 const float sigma, const int width, const int height, dim3 blocks, dim3 threads)
+                                 const float sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                 cudaStream_t stream)
 {
-    TGV2_updateP_tensor_weighed_kernel<<<blocks, threads>>>(d_Px, d_Py, d_T11, d_T12, d_T21, d_T22, d_u, d_u1x, d_u1y, alpha1,
+    TGV2_updateP_tensor_weighed_kernel<<<blocks, threads, 0, stream>>>(d_Px, d_Py, d_T11, d_T12, d_T21, d_T22, d_u, d_u1x, d_u1y, alpha1,
                                                             sigma, width, height);
 }
 
+void Anisotropic_diffusion_tensor_packed(float4 * d_T, const float * d_Img, const float beta, const float gamma,
+                                         const int width, const int height, dim3 blocks, dim3 threads)
+{
+    Anisotropic_diffusion_tensor_packed_kernel<<<blocks, threads>>>(d_T, d_Img, beta, gamma, width, height);
+}
+
+void TGV2_updateP_packed(float2 * d_P, const float4 * d_T, const float * d_ubar, const float4 * d_u1,
+                         const float alpha1, const float sigma, const int width, const int height,
+                         dim3 blocks, dim3 threads, cudaStream_t stream)
+{
+    TGV2_updateP_packed_kernel<<<blocks, threads, 0, stream>>>(d_P, d_T, d_ubar, d_u1, alpha1, sigma, width, height);
+}
+
+void TGV2_updateQ_packed(float4 * d_Q, const float4 * d_u1, const float alpha0, const float sigma,
+                         const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream)
+{
+    TGV2_updateQ_packed_kernel<<<blocks, threads, 0, stream>>>(d_Q, d_u1, alpha0, sigma, width, height);
+}
+
+void TGV2_updateU_packed(float * d_u, float * d_ubar, float4 * d_u1, const float4 * d_T, const float2 * d_P,
+                         const float4 * d_Q, const float * d_prodsum, const float alpha0, const float alpha1,
+                         const float tau, const float lambda, const int width, const int height,
+                         dim3 blocks, dim3 threads, cudaStream_t stream)
+{
+    TGV2_updateU_packed_kernel<<<blocks, threads, 0, stream>>>(d_u, d_ubar, d_u1, d_T, d_P, d_Q, d_prodsum,
+                                                               alpha0, alpha1, tau, lambda, width, height);
+}
+
+int TGV2_updateU_packed_block_size()
+{
+    int grid = 0, block = 0;
+    CHECK_CUDA_ERRORS_AUTO(cudaOccupancyMaxPotentialBlockSize(&grid, &block, TGV2_updateU_packed_kernel));
+    return block;
+}
+
 void TGV2_updateU_sparseDepth(float * d_u, float * d_u1x, float * d_u1y,
                               float * d_ubar, float * d_u1xbar, float * d_u1ybar,
                               const float * d_Px, const float * d_Py,
@@ -563,5 +849,5 @@ void TGV2_updateU_sparseDepthTensor(float * d_u, float * d_u1x, float * d_u1y,
 
 void calculateWeights_sparseDepth(float * d_w, const float * d_Ds, const int width, const int height, dim3 blocks, dim3 threads)
 {
-    calculateWeights_sparseDepth_kernel<<<blocks, threads>>>(d_w, d_Ds, width, height);
+    elementwise(d_w, d_Ds, 0, SparseWeightOp(), width, height, threads);
 }
@@ -0,0 +1,248 @@
+// Headless planesweep of a range of dataset frames, results are streamed to depthmap files.
+//
+// Usage: plane_sweep_batch <config.ini>
+//
+// Config file is in INI format, all keys except dataset/dir and dataset/name are optional:
+//
+//  [dataset]
+//  dir = /data/living_room        ; directory of ICL-NUIM style images and camera files
+//  name = scene_00_               ; image file name before number
+//  digits = 4                     ; number of digits in image file names
+//  format = png                   ; image file extension
+//  first = 0                      ; first reference image number
+//  last = 100                     ; last reference image number
+//  step = 1                       ; step between reference images
+//
+//  [planesweep]
+//  images = 4                     ; reference and source images in the sweep window
+//  planes = 200
+//  winsize = 5
+//  znear = 0.1
+//  zfar = 1.0
+//  std = 0.0001
+//  ncc = 0.5                      ; similarity threshold of the selected cost
+//  cost = ncc                     ; ncc, sad or census
+//  rectified = off                ; off, auto or on, row shift sweep of views rectified to the reference
+//  integer = false                ; rectified sweep over integer disparities instead of planes
+//  temporal = false               ; warm start each frame from the depthmap of the previous one
+//  temporalband = 3               ; planes tested on each side of the predicted depth
+//  semiglobal = false             ; semi-global aggregation of the cost volume, also paths = 8, p1 = 8, p2 = 48
+//  search = sweep                 ; sweep or patchmatch
+//  iterations = 4                 ; PatchMatch iterations, also views = 2 best source views per pixel
+//  alternative = false            ; alternative relative matrix method
+//  verbose = false                ; print stage timings of every call
+//  autotune = false               ; tune kernel block dimensions per resolution, results are cached per device
+//  tunecache = launch_tuning.txt  ; tuner cache file
+//  memorylimit = 0                ; device memory in MB a call may plan with, smaller limits force strips
+//  mask =                         ; reference validity mask image, black pixels are not swept
+//  roi =                          ; x, y, width, height of the swept reference region
+//  jit = false                    ; NVRTC specialized sweep, TVL1 and fusion kernels, needs USE_NVRTC builds
+//  jitcache = jit_cache           ; directory of compiled kernels
+//
+//  [method]
+//  refine = tvl1                  ; none, tvl1 or tgv
+//
+//  [tvl1]
+//  niters = 100                   ; also lambda, tau, sigma, theta, beta, gamma, defaults as in the viewer
+//
+//  [tgv]
+//  niters = 30                    ; also warps, lambda, alpha0, alpha1, tau, sigma, beta, gamma
+//
+//  [output]
+//  dir = out                      ; created if missing
+//  format = float                 ; float or half
+//  compression = none             ; none, lz4 or zstd
+//  queue = 8                      ; maximum number of pending writes
+//  timing =                       ; CSV file of GPU stage timings of every frame, none if empty
+
+#include "planesweep.h"
+#include "reader.h"
+#include "image_loader.h"
+#include "dataset.h"
+#include "result_writer.h"
+#include "nvtx_range.h"
+#include "launch_tuner.h"
+#include "kernel_jit.h"
+#include <QCoreApplication>
+#include <QSettings>
+#include <QDir>
+#include <QVector>
+#include <QImage>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+
+int main(int argc, char * argv[])
+{
+    QCoreApplication app(argc, argv);
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <config.ini>\n";
+        return 1;
+    }
+
+    QSettings cfg(QString::fromLocal8Bit(argv[1]), QSettings::IniFormat);
+    if (cfg.status() != QSettings::NoError) {
+        std::cerr << "Could not read config file " << argv[1] << std::endl;
+        return 1;
+    }
+
+    Dataset data;
+    data.dir = cfg.value("dataset/dir").toString();
+    data.name = cfg.value("dataset/name").toString();
+    data.format = cfg.value("dataset/format", "png").toString();
+    data.digits = cfg.value("dataset/digits", 4).toInt();
+    const int first = cfg.value("dataset/first", 0).toInt();
+    const int last = cfg.value("dataset/last", first).toInt();
+    const int step = std::max(cfg.value("dataset/step", 1).toInt(), 1);
+    if (data.dir.isEmpty() || data.name.isEmpty()) {
+        std::cerr << "dataset/dir and dataset/name have to be set\n";
+        return 1;
+    }
+
+    PlaneSweep ps(argc, argv);
+    const int nimages = cfg.value("planesweep/images", DEFAULT_NUMBER_OF_IMAGES).toInt();
+    ps.setNumberofImages(nimages);
+    ps.setNumberofPlanes(cfg.value("planesweep/planes", DEFAULT_NUMBER_OF_PLANES).toInt());
+    ps.setWindowSize(cfg.value("planesweep/winsize", DEFAULT_WINDOW_SIZE).toInt());
+    ps.setZ(cfg.value("planesweep/znear", DEFAULT_Z_NEAR).toFloat(), cfg.value("planesweep/zfar", DEFAULT_Z_FAR).toFloat());
+    ps.setSTDthreshold(cfg.value("planesweep/std", DEFAULT_STD_THRESHOLD).toFloat());
+    ps.setNCCthreshold(cfg.value("planesweep/ncc", DEFAULT_NCC_THRESHOLD).toFloat());
+    ps.setAlternativeRelativeMatrixMethod(cfg.value("planesweep/alternative", false).toBool());
+
+    const QString cost = cfg.value("planesweep/cost", "ncc").toString().toLower();
+    if (cost == "sad") ps.setCostMetric(PlaneSweep::CostSAD);
+    else if (cost == "census") ps.setCostMetric(PlaneSweep::CostCensus);
+    else if (cost != "ncc") std::cerr << "Unknown cost " << cost.toStdString() << ", using ncc" << std::endl;
+    const QString rectified = cfg.value("planesweep/rectified", "off").toString().toLower();
+    ps.setRectifiedSweep((rectified == "on") ? PlaneSweep::RectifiedOn :
+                         ((rectified == "auto") ? PlaneSweep::RectifiedAuto : PlaneSweep::RectifiedOff),
+                         cfg.value("planesweep/integer", false).toBool());
+    ps.setTemporal(cfg.value("planesweep/temporal", false).toBool(),
+                   cfg.value("planesweep/temporalband", DEFAULT_TEMPORAL_BAND).toUInt());
+    ps.setSemiGlobal(cfg.value("planesweep/semiglobal", false).toBool(),
+                     cfg.value("planesweep/paths", DEFAULT_SGM_PATHS).toUInt(),
+                     cfg.value("planesweep/p1", DEFAULT_SGM_P1).toUInt(), cfg.value("planesweep/p2", DEFAULT_SGM_P2).toUInt());
+    ps.setSubPlane(cfg.value("planesweep/subplane", false).toBool());
+    ps.setInverseDepth(cfg.value("planesweep/inverse", false).toBool());
+    const bool patchmatch = cfg.value("planesweep/search", "sweep").toString().toLower() == "patchmatch";
+    ps.setPatchMatch(cfg.value("planesweep/iterations", DEFAULT_PATCHMATCH_ITERATIONS).toUInt(),
+                     cfg.value("planesweep/views", DEFAULT_PATCHMATCH_VIEWS).toUInt());
+    ps.setCpuFallback(true, cfg.value("planesweep/cputhreads", 0).toUInt());
+    ps.setVerbose(cfg.value("planesweep/verbose", false).toBool());
+    ps.setAutotune(cfg.value("planesweep/autotune", false).toBool());
+    if (cfg.contains("planesweep/tunecache"))
+        LaunchTuner::instance().setCacheFile(cfg.value("planesweep/tunecache").toString().toStdString());
+    ps.setMemoryLimit(size_t(cfg.value("planesweep/memorylimit", 0).toUInt()) << 20);
+    if (cfg.contains("planesweep/mask")) {
+        const QImage mask = QImage(cfg.value("planesweep/mask").toString()).convertToFormat(QImage::Format_Grayscale8);
+        if (mask.isNull()) std::cerr << "Could not read mask " << cfg.value("planesweep/mask").toString().toStdString() << std::endl;
+        else {
+            CamImage<uchar> m(mask.width(), mask.height());
+            for (int y = 0; y < mask.height(); y++) std::copy(mask.constScanLine(y), mask.constScanLine(y) + mask.width(),
+                                                              m.data() + y * mask.width());
+            ps.setMask(m);
+        }
+    }
+    const QStringList roi = cfg.value("planesweep/roi").toStringList();
+    if (roi.size() == 4) ps.setROI(roi[0].toInt(), roi[1].toInt(), roi[2].toInt(), roi[3].toInt());
+    KernelJit::instance().setEnabled(cfg.value("planesweep/jit", false).toBool());
+    if (KernelJit::instance().enabled() != cfg.value("planesweep/jit", false).toBool())
+        std::cerr << "Built without NVRTC, static kernels are used\n";
+    if (cfg.contains("planesweep/jitcache"))
+        KernelJit::instance().setCacheDir(cfg.value("planesweep/jitcache").toString().toStdString());
+
+    const QString refine = cfg.value("method/refine", "tvl1").toString().toLower();
+
+    QDir out(cfg.value("output/dir", ".").toString());
+    if (!out.exists() && !QDir().mkpath(out.path())) {
+        std::cerr << "Could not create output directory " << out.path().toStdString() << std::endl;
+        return 1;
+    }
+    const DepthFormat format = (cfg.value("output/format", "float").toString().toLower() == "half") ? DepthHalf : DepthFloat32;
+    const QString c = cfg.value("output/compression", "none").toString().toLower();
+    const DepthCompression compression = (c == "lz4") ? CompressLZ4 : ((c == "zstd") ? CompressZstd : CompressNone);
+    if (!ResultWriter::compressionSupported(compression))
+        std::cerr << "Compression " << c.toStdString() << " is not available, depthmaps are written uncompressed\n";
+    ResultWriter writer(cfg.value("output/queue", DEFAULT_WRITER_QUEUE).toUInt());
+
+    // Querying timings waits for the GPU work of each call, so timing adds a synchronization per call
+    const QString timingname = cfg.value("output/timing").toString();
+    std::ofstream timing;
+    if (!timingname.isEmpty()) {
+        timing.open(timingname.toLocal8Bit().constData());
+        if (!timing) std::cerr << "Could not open timing file " << timingname.toStdString() << std::endl;
+        else StageTimings::writeCSVHeader(timing);
+    }
+
+    int done = 0, failed = 0;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (int refn = first; refn <= last; refn += step) {
+        NVTX_FRAME(refn);
+        if (!data.loadWindow(ps, refn, nimages, step) || !(patchmatch ? ps.RunPatchMatch(argc, argv) : ps.RunAlgorithm(argc, argv))) {
+            std::cerr << "Frame " << refn << " skipped\n";
+            failed++;
+            continue;
+        }
+        const std::string label = std::to_string(refn);
+        if (timing.is_open()) ps.getTimings().writeCSV(timing, label);
+
+        // CPU fallback leaves its depthmaps on the host only
+        bool success = true;
+        const bool cpu = ps.getCpuActive();
+        const float * d_result = cpu ? 0 : ps.getDepthmapPtr();
+        if (refine == "tvl1") {
+            success = ps.CudaDenoise(argc, argv,
+                                     cfg.value("tvl1/niters", DEFAULT_TVL1_ITERATIONS).toUInt(),
+                                     cfg.value("tvl1/lambda", DEFAULT_TVL1_LAMBDA).toDouble(),
+                                     cfg.value("tvl1/tau", DEFAULT_TVL1_TAU).toDouble(),
+                                     cfg.value("tvl1/sigma", DEFAULT_TVL1_SIGMA).toDouble(),
+                                     cfg.value("tvl1/theta", DEFAULT_TVL1_THETA).toDouble(),
+                                     cfg.value("tvl1/beta", DEFAULT_TVL1_BETA).toDouble(),
+                                     cfg.value("tvl1/gamma", DEFAULT_TVL1_GAMMA).toDouble());
+            d_result = cpu ? 0 : ps.getDepthmapDenoisedPtr();
+        }
+        else if (refine == "tgv") {
+            success = ps.TGV(argc, argv,
+                             cfg.value("tgv/niters", DEFAULT_TGV_NITERS).toUInt(),
+                             cfg.value("tgv/warps", DEFAULT_TGV_NWARPS).toUInt(),
+                             cfg.value("tgv/lambda", DEFAULT_TGV_LAMBDA).toDouble(),
+                             cfg.value("tgv/alpha0", DEFAULT_TGV_ALPHA0).toDouble(),
+                             cfg.value("tgv/alpha1", DEFAULT_TGV_ALPHA1).toDouble(),
+                             cfg.value("tgv/tau", DEFAULT_TGV_TAU).toDouble(),
+                             cfg.value("tgv/sigma", DEFAULT_TGV_SIGMA).toDouble(),
+                             cfg.value("tgv/beta", DEFAULT_TGV_BETA).toDouble(),
+                             cfg.value("tgv/gamma", DEFAULT_TGV_GAMMA).toDouble());
+            d_result = 0; // TGV result is only kept on the host
+        }
+        if (!success) {
+            std::cerr << "Frame " << refn << " failed\n";
+            failed++;
+            continue;
+        }
+        if (timing.is_open() && ((refine == "tvl1") || (refine == "tgv"))) ps.getTimings().writeCSV(timing, label);
+
+        // Downloads go to pinned buffers and files are written by the writer thread, next frame starts right away
+        const std::string fname = out.filePath(QString("%1%2" DEPTH_FILE_EXTENSION).arg(data.name)
+                                               .arg(refn, data.digits, 10, QChar('0'))).toStdString();
+        if (d_result) {
+            ResultWriter::buffer_ptr depth = writer.acquire(ps.HostRef.width(), ps.HostRef.height());
+            depth->R = ps.HostRef.R;
+            depth->t = ps.HostRef.t;
+            ResultWriter::download(depth, d_result, 0);
+            writer.writeDepth(fname, depth, ResultWriter::buffer_ptr(), format, compression, 0);
+        }
+        else if (refine == "tgv") writer.writeDepth(fname, *ps.getDepthmapTGV(), format, compression);
+        else writer.writeDepth(fname, (refine == "tvl1") ? *ps.getDepthmapDenoised() : *ps.getDepthmap(), format, compression);
+        done++;
+    }
+    writer.flush();
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    const double seconds = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() / 1000.0;
+    std::cerr << done << " frames written, " << failed << " failed in " << seconds << "s";
+    if (done > 0) std::cerr << " (" << done / seconds << " frames/s)";
+    std::cerr << std::endl;
+    return (failed > 0) ? 2 : 0;
+}
@@ -0,0 +1,521 @@
+// Kernel and pipeline benchmarks, results are written as JSON so GPUs and commits can be compared.
+//
+// Usage: plane_sweep_bench [options]
+//
+//  -o <file>           output file, default plane_sweep_bench.json
+//  --quick             reduced parameter sweep, for smoke runs
+//  --repeat <n>        timed launches per kernel benchmark, default 20
+//  --filter <text>     only run benchmarks whose name contains text
+//  --tag <text>        label stored with the results, e.g. commit hash
+//  --no-pipeline       skip end-to-end benchmarks
+//  -device=<n>         CUDA device, as for the viewer
+//
+// Kernel benchmarks time repeated launches of a single wrapper with CUDA events, after one warm-up launch. Bytes are
+// the nominal bytes a kernel reads and writes, ignoring cache reuse, so GB/s is comparable between runs but is not a
+// measured DRAM throughput. Pipeline benchmarks run RunAlgorithm, CudaDenoise and TGV on the bundled PlaneSweep/im*.png
+// images and report wall time per call, including transfers, after one warm-up call that allocates the workspace.
+
+#include "planesweep.h"
+#include "reader.h"
+#include "image_loader.h"
+#include "image.h"
+#include "kernels.cu.h"
+#include "fusion.cu.h"
+#include "cuda_exception.h"
+#include <QImage>
+#include <QVector>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cuda_runtime_api.h>
+
+typedef std::vector<std::pair<std::string, double>> BenchParams;
+
+struct BenchResult
+{
+    std::string group, name;
+    BenchParams params;
+    double ms;          // per launch or per call
+    double bytes;       // nominal bytes moved per launch, 0 if not meaningful
+    double pixelplanes; // pixels times planes per launch, 0 if not a sweep
+    double voxels;      // voxels updated per launch, 0 if not fusion
+};
+
+class Bench
+{
+public:
+    Bench(int repeat, const std::string & filter) : repeat_(repeat), filter_(filter)
+    {
+        CHECK_CUDA_ERRORS_AUTO(cudaEventCreate(&start_));
+        CHECK_CUDA_ERRORS_AUTO(cudaEventCreate(&stop_));
+    }
+
+    ~Bench()
+    {
+        cudaEventDestroy(start_);
+        cudaEventDestroy(stop_);
+    }
+
+    bool enabled(const std::string & name) const { return filter_.empty() || (name.find(filter_) != std::string::npos); }
+
+    // Time repeated launches of a kernel wrapper on the default stream
+    template<typename F>
+    void kernel(const std::string & name, const BenchParams & params, double bytes, double pixelplanes, double voxels,
+                F launch)
+    {
+        if (!enabled(name)) return;
+        launch();
+        CHECK_CUDA_ERRORS_AUTO(cudaDeviceSynchronize());
+
+        CHECK_CUDA_ERRORS_AUTO(cudaEventRecord(start_, 0));
+        for (int i = 0; i < repeat_; i++) launch();
+        CHECK_CUDA_ERRORS_AUTO(cudaEventRecord(stop_, 0));
+        CHECK_CUDA_ERRORS_AUTO(cudaEventSynchronize(stop_));
+        CHECK_CUDA_ERRORS_AUTO(cudaGetLastError());
+
+        float ms = 0;
+        CHECK_CUDA_ERRORS_AUTO(cudaEventElapsedTime(&ms, start_, stop_));
+        add("kernel", name, params, ms / repeat_, bytes, pixelplanes, voxels);
+    }
+
+    // Time calls of a pipeline stage with wall clock, stage synchronizes itself
+    template<typename F>
+    bool pipeline(const std::string & name, const BenchParams & params, double pixelplanes, int calls, F run)
+    {
+        if (!enabled(name)) return true;
+        if (!run()) return false;
+        CHECK_CUDA_ERRORS_AUTO(cudaDeviceSynchronize());
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < calls; i++)
+            if (!run()) return false;
+        CHECK_CUDA_ERRORS_AUTO(cudaDeviceSynchronize());
+        auto t1 = std::chrono::high_resolution_clock::now();
+
+        const double ms = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() / 1000.0;
+        add("pipeline", name, params, ms / calls, 0, pixelplanes, 0);
+        return true;
+    }
+
+    void write(std::ostream & out, const std::string & tag) const;
+
+protected:
+    void add(const std::string & group, const std::string & name, const BenchParams & params, double ms, double bytes,
+             double pixelplanes, double voxels)
+    {
+        BenchResult r = {group, name, params, ms, bytes, pixelplanes, voxels};
+        results_.push_back(r);
+
+        std::cerr << std::left << std::setw(40) << name;
+        for (size_t i = 0; i < params.size(); i++) std::cerr << ' ' << params[i].first << '=' << params[i].second;
+        std::cerr << "  " << ms << " ms";
+        if (bytes > 0) std::cerr << ", " << bytes / ms / 1e6 << " GB/s";
+        if (pixelplanes > 0) std::cerr << ", " << pixelplanes / ms / 1e3 << " Mpix*planes/s";
+        if (voxels > 0) std::cerr << ", " << voxels / ms * 1e3 << " voxels/s";
+        std::cerr << std::endl;
+    }
+
+    int repeat_;
+    std::string filter_;
+    cudaEvent_t start_, stop_;
+    std::vector<BenchResult> results_;
+};
+
+static std::string jsonString(const std::string & s)
+{
+    std::string r = "\"";
+    for (size_t i = 0; i < s.size(); i++) {
+        if ((s[i] == '"') || (s[i] == '\\')) r += '\\';
+        r += s[i];
+    }
+    return r + '"';
+}
+
+void Bench::write(std::ostream & out, const std::string & tag) const
+{
+    int device = 0, runtime = 0, driver = 0;
+    cudaDeviceProp prop;
+    CHECK_CUDA_ERRORS_AUTO(cudaGetDevice(&device));
+    CHECK_CUDA_ERRORS_AUTO(cudaGetDeviceProperties(&prop, device));
+    cudaRuntimeGetVersion(&runtime);
+    cudaDriverGetVersion(&driver);
+
+    out << std::setprecision(6);
+    out << "{\n  \"tag\": " << jsonString(tag) << ",\n";
+    out << "  \"device\": {\"name\": " << jsonString(prop.name) << ", \"compute_capability\": \"" << prop.major << '.'
+        << prop.minor << "\", \"multiprocessors\": " << prop.multiProcessorCount
+        << ", \"memory_mb\": " << prop.totalGlobalMem / (1024 * 1024)
+        << ", \"peak_gbps\": " << 2.0 * prop.memoryClockRate * (prop.memoryBusWidth / 8) / 1e6
+        << ", \"runtime\": " << runtime << ", \"driver\": " << driver << "},\n";
+    out << "  \"results\": [";
+    for (size_t i = 0; i < results_.size(); i++) {
+        const BenchResult & r = results_[i];
+        out << (i ? ",\n" : "\n") << "    {\"group\": " << jsonString(r.group) << ", \"name\": " << jsonString(r.name)
+            << ", \"params\": {";
+        for (size_t j = 0; j < r.params.size(); j++)
+            out << (j ? ", " : "") << jsonString(r.params[j].first) << ": " << r.params[j].second;
+        out << "}, \"ms\": " << r.ms;
+        if (r.bytes > 0) out << ", \"gbps\": " << r.bytes / r.ms / 1e6;
+        if (r.pixelplanes > 0) out << ", \"mpix_planes_per_s\": " << r.pixelplanes / r.ms / 1e3;
+        if (r.voxels > 0) out << ", \"voxels_per_s\": " << r.voxels / r.ms * 1e3;
+        out << '}';
+    }
+    out << "\n  ]\n}\n";
+}
+
+// Image kernels at a single image size, buffers are unpadded like the planesweep workspace
+static void benchImageKernels(Bench & b, const int w, const int h, const std::vector<int> & winsizes,
+                              const std::vector<int> & planes)
+{
+    const double n = double(w) * h;
+    const dim3 threads(DEFAULT_BLOCK_XDIM, MAX_THREADS_PER_BLOCK / DEFAULT_BLOCK_XDIM);
+    const dim3 blocks((w + threads.x - 1) / threads.x, (h + threads.y - 1) / threads.y);
+    const dim3 hblocks((w / 2 + threads.x - 1) / threads.x, (h / 2 + threads.y - 1) / threads.y);
+    const BenchParams size = {{"width", w}, {"height", h}};
+
+    const int nbuf = 16;
+    std::vector<Image<float>> buf(nbuf);
+    for (int i = 0; i < nbuf; i++) {
+        buf[i].reset(w, h);
+        set_value(buf[i].data(), 0.5f + 0.01f * i, w, h, blocks, threads);
+    }
+    float * a[nbuf];
+    for (int i = 0; i < nbuf; i++) a[i] = buf[i].data();
+    Image<__half> half(w, h);
+    Image<unsigned char> uchar(w, h);
+    Image<float4> T(w, h);
+    convert_float_to_half(half.data(), a[0], w, h, blocks, threads);
+    quantize_float_to_uchar(uchar.data(), a[0], w, h, blocks, threads);
+    Image<unsigned long long> census(w, h), refcensus(w, h);
+    census_transform(refcensus.data(), a[1], w, h, blocks, threads);
+
+    // Homography of a slightly shifted fronto-parallel view, coordinates stay close to the image
+    const Matrix3D H(1.f, 0.001f, 2.f, -0.001f, 1.f, 0.5f, 0.f, 0.f, 1.f);
+    Image<Matrix3D> d_H(1, 1);
+    CHECK_CUDA_ERRORS_AUTO(cudaMemcpy(d_H.data(), &H, sizeof(Matrix3D), cudaMemcpyHostToDevice));
+    transform_indexes(a[14], a[15], H, w, h, blocks, threads);
+
+    b.kernel("set_value", size, 4 * n, 0, 0, [&]{ set_value(a[0], 1.f, w, h, blocks, threads); });
+    b.kernel("element_multiply", size, 12 * n, 0, 0, [&]{ element_multiply(a[2], a[0], a[1], w, h, blocks, threads); });
+    b.kernel("element_rdivide", size, 12 * n, 0, 0, [&]{ element_rdivide(a[2], a[0], a[1], w, h, blocks, threads); });
+    b.kernel("convert_float_to_half", size, 6 * n, 0, 0, [&]{ convert_float_to_half(half.data(), a[0], w, h, blocks, threads); });
+    b.kernel("convert_float_to_uchar", size, 5 * n, 0, 0,
+             [&]{ convert_float_to_uchar(uchar.data(), a[0], 0.f, 1.f, w, h, blocks, threads); });
+    b.kernel("convert_uchar_to_float", size, 5 * n, 0, 0,
+             [&]{ convert_uchar_to_float(a[2], uchar.data(), 1.f / 255, w, h, blocks, threads); });
+    b.kernel("transform_indexes", size, 8 * n, 0, 0, [&]{ transform_indexes(a[14], a[15], H, w, h, blocks, threads); });
+    b.kernel("bilinear_interpolation_float", size, 16 * n, 0, 0,
+             [&]{ bilinear_interpolation(a[2], a[0], a[14], a[15], w, h, w, h, blocks, threads); });
+    b.kernel("bilinear_interpolation_half", size, 14 * n, 0, 0,
+             [&]{ bilinear_interpolation(a[2], half.data(), a[14], a[15], w, h, w, h, blocks, threads); });
+    b.kernel("bilinear_interpolation_uchar", size, 13 * n, 0, 0,
+             [&]{ bilinear_interpolation(a[2], uchar.data(), a[14], a[15], w, h, w, h, blocks, threads); });
+    b.kernel("calculate_STD", size, 12 * n, 0, 0, [&]{ calculate_STD(a[4], a[2], a[3], w, h, blocks, threads); });
+    b.kernel("calcNCC", size, 24 * n, 0, 0,
+             [&]{ calcNCC(a[6], a[1], a[2], a[3], a[4], a[5], DEFAULT_STD_THRESHOLD, DEFAULT_STD_THRESHOLD, w, h,
+                          blocks, threads); });
+    b.kernel("update_arrays", size, 20 * n, 0, 0, [&]{ update_arrays(a[7], a[8], a[6], 0.5f, w, h, blocks, threads); });
+    b.kernel("sum_depthmap_NCC", size, 24 * n, 0, 0,
+             [&]{ sum_depthmap_NCC(a[9], a[10], a[7], a[8], DEFAULT_NCC_THRESHOLD, w, h, blocks, threads); });
+    b.kernel("census_transform", size, 12 * n, 0, 0,
+             [&]{ census_transform(census.data(), a[0], w, h, blocks, threads); });
+    b.kernel("downsample_half", size, 5 * n, 0, 0,
+             [&]{ downsample_half(a[2], a[0], w, h, w / 2, h / 2, hblocks, threads); });
+    b.kernel("upsample_double", size, 5 * n, 0, 0,
+             [&]{ upsample_double(a[2], a[0], w / 2, h / 2, w, h, blocks, threads); });
+
+    for (size_t i = 0; i < winsizes.size(); i++) {
+        const unsigned int ws = winsizes[i];
+        BenchParams p = size;
+        p.push_back(std::make_pair(std::string("winsize"), double(ws)));
+        b.kernel("windowed_mean_row", p, 8 * n, 0, 0,
+                 [&]{ windowed_mean_row(a[2], a[0], ws, false, w, h, blocks, threads); });
+        b.kernel("windowed_mean_column", p, 8 * n, 0, 0,
+                 [&]{ windowed_mean_column(a[2], a[0], ws, true, w, h, blocks, threads); });
+        b.kernel("windowed_mean_row_sliding", p, 8 * n, 0, 0,
+                 [&]{ windowed_mean_row_sliding(a[2], a[0], ws, false, w, h, blocks, threads); });
+        b.kernel("windowed_mean_column_sliding", p, 8 * n, 0, 0,
+                 [&]{ windowed_mean_column_sliding(a[2], a[0], ws, true, w, h, blocks, threads); });
+
+        // A full sweep over all planes for each source precision, bytes count ref, statistics and best depth per plane
+        for (size_t j = 0; j < planes.size(); j++) {
+            const int np = planes[j];
+            BenchParams pp = p;
+            pp.push_back(std::make_pair(std::string("planes"), double(np)));
+            b.kernel("planesweep_fused_NCC_float", pp, 32 * n * np, n * np, 0, [&]{
+                for (int k = 0; k < np; k++)
+                    planesweep_fused_NCC(a[7], a[8], a[0], a[1], a[2], a[3], d_H.data(), k, ws, DEFAULT_STD_THRESHOLD,
+                                         w, h, blocks, threads);
+            });
+            b.kernel("planesweep_fused_NCC_half", pp, 30 * n * np, n * np, 0, [&]{
+                for (int k = 0; k < np; k++)
+                    planesweep_fused_NCC(a[7], a[8], half.data(), a[1], a[2], a[3], d_H.data(), k, ws,
+                                         DEFAULT_STD_THRESHOLD, w, h, blocks, threads);
+            });
+            b.kernel("planesweep_fused_NCC_uchar", pp, 29 * n * np, n * np, 0, [&]{
+                for (int k = 0; k < np; k++)
+                    planesweep_fused_NCC(a[7], a[8], uchar.data(), a[1], a[2], a[3], d_H.data(), k, ws,
+                                         DEFAULT_STD_THRESHOLD, w, h, blocks, threads);
+            });
+            b.kernel("planesweep_fused_SAD", pp, 24 * n * np, n * np, 0, [&]{
+                for (int k = 0; k < np; k++)
+                    planesweep_fused_SAD(a[7], a[8], a[0], a[1], d_H.data(), k, ws, w, h, blocks, threads);
+            });
+            b.kernel("planesweep_fused_census", pp, 24 * n * np, n * np, 0, [&]{
+                for (int k = 0; k < np; k++)
+                    planesweep_fused_census(a[7], a[8], census.data(), refcensus.data(), d_H.data(), k, ws, w, h,
+                                            blocks, threads);
+            });
+        }
+    }
+
+    // TVL1 denoising, weights of the tensor weighed variants are the identity tensor
+    set_value(a[11], 1.f, w, h, blocks, threads);
+    set_value(a[12], 0.f, w, h, blocks, threads);
+    b.kernel("denoising_TVL1_calculateP", size, 20 * n, 0, 0,
+             [&]{ denoising_TVL1_calculateP(a[2], a[3], a[0], DEFAULT_TVL1_SIGMA, w, h, blocks, threads); });
+    b.kernel("denoising_TVL1_update", size, 24 * n, 0, 0,
+             [&]{ denoising_TVL1_update(a[0], a[4], a[2], a[3], a[1], DEFAULT_TVL1_TAU, DEFAULT_TVL1_THETA,
+                                        DEFAULT_TVL1_LAMBDA, DEFAULT_TVL1_SIGMA, w, h, blocks, threads); });
+    b.kernel("denoising_TVL1_calculateP_tensor_weighed", size, 36 * n, 0, 0,
+             [&]{ denoising_TVL1_calculateP_tensor_weighed(a[2], a[3], a[11], a[12], a[12], a[11], a[0],
+                                                           DEFAULT_TVL1_SIGMA, w, h, blocks, threads); });
+    b.kernel("denoising_TVL1_update_tensor_weighed", size, 40 * n, 0, 0,
+             [&]{ denoising_TVL1_update_tensor_weighed(a[0], a[4], a[2], a[3], a[1], a[11], a[12], a[12], a[11],
+                                                       DEFAULT_TVL1_TAU, DEFAULT_TVL1_THETA, DEFAULT_TVL1_LAMBDA,
+                                                       DEFAULT_TVL1_SIGMA, w, h, blocks, threads); });
+    const unsigned int fused = 4;
+    b.kernel("denoising_TVL1_fused", size, fused * 76 * n, 0, 0,
+             [&]{ denoising_TVL1_fused(a[5], a[6], a[7], a[8], a[0], a[4], a[2], a[3], a[1], a[11], a[12], a[12], a[11],
+                                       DEFAULT_TVL1_TAU, DEFAULT_TVL1_THETA, DEFAULT_TVL1_LAMBDA, DEFAULT_TVL1_SIGMA,
+                                       DEFAULT_TVL1_SIGMA, fused, w, h, blocks, threads); });
+
+    // TGV2 primal-dual updates
+    b.kernel("Anisotropic_diffusion_tensor", size, 20 * n, 0, 0,
+             [&]{ Anisotropic_diffusion_tensor(a[11], a[12], a[13], a[14], a[0], DEFAULT_TGV_BETA, DEFAULT_TGV_GAMMA,
+                                               w, h, blocks, threads); });
+    b.kernel("Anisotropic_diffusion_tensor_packed", size, 20 * n, 0, 0,
+             [&]{ Anisotropic_diffusion_tensor_packed(T.data(), a[0], DEFAULT_TGV_BETA, DEFAULT_TGV_GAMMA, w, h,
+                                                      blocks, threads); });
+    transform_indexes(a[14], a[15], H, w, h, blocks, threads);
+    b.kernel("TGV2_updateP", size, 28 * n, 0, 0,
+             [&]{ TGV2_updateP(a[2], a[3], a[0], a[4], a[5], DEFAULT_TGV_ALPHA1, DEFAULT_TGV_SIGMA, w, h, blocks, threads); });
+    b.kernel("TGV2_updateQ", size, 40 * n, 0, 0,
+             [&]{ TGV2_updateQ(a[6], a[7], a[8], a[9], a[4], a[5], DEFAULT_TGV_ALPHA0, DEFAULT_TGV_SIGMA, w, h,
+                               blocks, threads); });
+    b.kernel("TGV2_updateR", size, 24 * n, 0, 0,
+             [&]{ TGV2_updateR(a[10], a[11], a[0], a[1], a[12], a[13], DEFAULT_TGV_SIGMA, DEFAULT_TGV_LAMBDA, w, h,
+                               blocks, threads); });
+    b.kernel("TGV2_updateU", size, 64 * n, 0, 0,
+             [&]{ TGV2_updateU(a[0], a[4], a[5], a[1], a[12], a[13], a[2], a[3], a[6], a[7], a[8], a[9], a[11],
+                               DEFAULT_TGV_ALPHA0, DEFAULT_TGV_ALPHA1, DEFAULT_TGV_TAU, DEFAULT_TGV_LAMBDA, w, h,
+                               blocks, threads); });
+    b.kernel("TGV2_calculate_Iu", size, 16 * n, 0, 0,
+             [&]{ TGV2_calculate_Iu(a[10], a[0], a[14], a[15], w, h, blocks, threads); });
+}
+
+// Fusion kernels of a single bin count, recursion over bin counts mirrors the explicit instantiations
+template<unsigned char _bins>
+static void benchFusionKernels(Bench & b, const int3 size)
+{
+    const double n = double(size.x) * size.y * size.z;
+    const double vb = sizeof(fusionvoxel<_bins>);
+    const BenchParams p = {{"bins", _bins}, {"width", size.x}, {"height", size.y}, {"depth", size.z}};
+
+    fusionData<_bins> f(size.x, size.y, size.z);
+    f.setVolume(make_float3(-1.f, -1.f, 1.f), make_float3(1.f, 1.f, 3.f));
+    CHECK_CUDA_ERRORS_AUTO(cudaMemset(f.voxelPtr(), 0, f.sizeBytes()));
+
+    // Fronto-parallel depthmap through the middle of the volume, camera at the origin looking along z
+    const int w = 640, h = 480;
+    const dim3 ithreads(DEFAULT_BLOCK_XDIM, MAX_THREADS_PER_BLOCK / DEFAULT_BLOCK_XDIM);
+    Image<float> depth(w, h);
+    set_value(depth.data(), 2.f, w, h, dim3((w + ithreads.x - 1) / ithreads.x, (h + ithreads.y - 1) / ithreads.y), ithreads);
+    const Matrix3D K(525.f, 0.f, 320.f, 0.f, 525.f, 240.f, 0.f, 0.f, 1.f);
+    const Matrix3D R = Matrix3D::identityMatrix();
+    const Vector3D t(0.f, 0.f, 0.f);
+
+    const dim3 threads(DEFAULT_FUSION_THREADS_X, DEFAULT_FUSION_THREADS_Y,
+                       MAX_THREADS_PER_BLOCK / DEFAULT_FUSION_THREADS_X / DEFAULT_FUSION_THREADS_Y);
+    const dim3 blocks((size.x + threads.x - 1) / threads.x, (size.y + threads.y - 1) / threads.y,
+                      (size.z + threads.z - 1) / threads.z);
+
+    b.kernel("FusionUpdateHistogram", p, 2 * n * vb, 0, n,
+             [&]{ FusionUpdateHistogram(f, depth.data(), K, R, t, DEFAULT_FUSION_SD_THRESHOLD, w, h, blocks, threads); });
+    b.kernel("FusionUpdateU", p, n * (vb + 8), 0, n,
+             [&]{ FusionUpdateU(f, DEFAULT_FUSION_TAU, DEFAULT_FUSION_LAMBDA, blocks, threads); });
+    b.kernel("FusionUpdateP", p, n * 28, 0, n, [&]{ FusionUpdateP(f, DEFAULT_FUSION_SIGMA, blocks, threads); });
+    b.kernel("FusionUpdateUTiled", p, n * (vb + 8), 0, n,
+             [&]{ FusionUpdateUTiled(f, DEFAULT_FUSION_TAU, DEFAULT_FUSION_LAMBDA, threads); });
+    b.kernel("FusionUpdatePTiled", p, n * 28, 0, n, [&]{ FusionUpdatePTiled(f, DEFAULT_FUSION_SIGMA, threads); });
+    b.kernel("FusionUpdateIteration", p, n * (3 * vb + 36), 0, n,
+             [&]{ FusionUpdateIteration(f, depth.data(), K, R, t, DEFAULT_FUSION_SD_THRESHOLD, DEFAULT_FUSION_TAU,
+                                        DEFAULT_FUSION_LAMBDA, DEFAULT_FUSION_SIGMA, w, h, blocks, threads); });
+
+    // Solver iterations per launch, voxels count every iteration
+    const unsigned int iterations = 10;
+    Image<float> su(size.x, size.y * size.z);
+    Image<float3> sp(size.x, size.y * size.z);
+    b.kernel("FusionSolveFused", p, iterations * n * (vb + 36), 0, iterations * n,
+             [&]{ FusionSolveFused(f, su.data(), sp.data(), iterations, DEFAULT_FUSION_TAU, DEFAULT_FUSION_LAMBDA,
+                                   DEFAULT_FUSION_SIGMA, dim3(DEFAULT_FUSION_THREADS_X, DEFAULT_FUSION_THREADS_Y)); });
+
+    Image<float> sums(2, 1);
+    b.kernel("FusionResidual", p, n * vb, 0, n, [&]{ FusionResidual(f, sums.data(), blocks, threads); });
+}
+
+template<unsigned char _bins>
+static void benchFusion(Bench & b, const std::vector<int> & bins, const std::vector<int3> & sizes)
+{
+    if (std::find(bins.begin(), bins.end(), int(_bins)) != bins.end())
+        for (size_t i = 0; i < sizes.size(); i++) benchFusionKernels<_bins>(b, sizes[i]);
+    benchFusion<_bins + 1>(b, bins, sizes);
+}
+
+template<>
+void benchFusion<11>(Bench &, const std::vector<int> &, const std::vector<int3> &) {}
+
+// Bundled reference and source views, loaded like the viewer does
+static bool loadSource(PlaneSweep & ps)
+{
+    QImage ref;
+    QVector<QImage> src;
+    QVector<Matrix3D> Rsrc;
+    QVector<Vector3D> tsrc;
+    Matrix3D K;
+    Vector3D tref;
+    if (!Reader::Read_FromSource(ref, ps.HostRef.R, tref, src, Rsrc, tsrc, K)) return false;
+    ps.setK(K);
+
+    QString loc = QString(SOURCE_DIR) + "/PlaneSweep/im";
+    ImageLoader::Frame frame;
+    if (!ImageLoader::decode(loc + "0.png", frame)) return false;
+    ps.HostRef.reset(frame.width(), frame.height());
+    frame.copyGray(ps.HostRef.data());
+    ps.HostRef.t = tref;
+
+    ps.HostSrc.resize(src.size());
+    for (int i = 0; i < src.size(); i++) {
+        if (!ImageLoader::decode(loc + QString::number(i + 1) + ".png", frame)) return false;
+        ps.HostSrc[i].reset(frame.width(), frame.height());
+        frame.copyGray(ps.HostSrc[i].data());
+        ps.HostSrc[i].R = Rsrc[i];
+        ps.HostSrc[i].t = tsrc[i];
+    }
+    return true;
+}
+
+static bool benchPipeline(Bench & b, PlaneSweep & ps, int argc, char ** argv, bool quick)
+{
+    if (!loadSource(ps)) {
+        std::cerr << "Could not load " SOURCE_DIR "/PlaneSweep images, pipeline benchmarks skipped\n";
+        return false;
+    }
+    const double n = double(ps.HostRef.width()) * ps.HostRef.height();
+    const int calls = quick ? 2 : 5;
+    const std::vector<int> planes = quick ? std::vector<int>{DEFAULT_NUMBER_OF_PLANES} : std::vector<int>{100, 200, 400};
+    const std::vector<int> winsizes = quick ? std::vector<int>{DEFAULT_WINDOW_SIZE} : std::vector<int>{5, 9};
+    const std::vector<int> images = quick ? std::vector<int>{DEFAULT_NUMBER_OF_IMAGES} : std::vector<int>{4, 10};
+
+    // Stage settings are compared with the defaults of the viewer
+    struct Variant { const char * name; bool fused, sliding, multiview; };
+    const Variant variants[] = {{"RunAlgorithm", false, false, false}, {"RunAlgorithm_fused", true, false, false},
+                                {"RunAlgorithm_fused_sliding", true, true, false},
+                                {"RunAlgorithm_multiview", true, true, true}};
+
+    bool success = true;
+    for (const Variant & v : variants) {
+        ps.setFusedSweep(v.fused);
+        ps.setSlidingWindowMean(v.sliding);
+        ps.setMultiviewSweep(v.multiview);
+        for (int ni : images)
+            for (int ws : winsizes)
+                for (int np : planes) {
+                    ps.setNumberofImages(ni);
+                    ps.setWindowSize(ws);
+                    ps.setNumberofPlanes(np);
+                    const BenchParams p = {{"width", ps.HostRef.width()}, {"height", ps.HostRef.height()},
+                                           {"images", ni}, {"winsize", ws}, {"planes", np}};
+                    success &= b.pipeline(v.name, p, n * np * (ni - 1), calls, [&]{ return ps.RunAlgorithm(argc, argv); });
+                }
+    }
+
+    // Refinement of the default sweep
+    ps.setFusedSweep(true);
+    ps.setSlidingWindowMean(true);
+    ps.setMultiviewSweep(false);
+    ps.setNumberofImages(DEFAULT_NUMBER_OF_IMAGES);
+    ps.setWindowSize(DEFAULT_WINDOW_SIZE);
+    ps.setNumberofPlanes(DEFAULT_NUMBER_OF_PLANES);
+    if (!ps.RunAlgorithm(argc, argv)) return false;
+    const BenchParams size = {{"width", ps.HostRef.width()}, {"height", ps.HostRef.height()}};
+
+    BenchParams p = size;
+    p.push_back(std::make_pair(std::string("iterations"), double(DEFAULT_TVL1_ITERATIONS)));
+    success &= b.pipeline("CudaDenoise", p, 0, calls, [&]{ return ps.CudaDenoise(argc, argv); });
+
+    p = size;
+    p.push_back(std::make_pair(std::string("iterations"), double(DEFAULT_TGV_NITERS)));
+    p.push_back(std::make_pair(std::string("warps"), double(DEFAULT_TGV_NWARPS)));
+    success &= b.pipeline("TGV", p, 0, calls, [&]{ return ps.TGV(argc, argv); });
+    return success;
+}
+
+int main(int argc, char * argv[])
+{
+    std::string output = "plane_sweep_bench.json", filter, tag;
+    int repeat = 20;
+    bool quick = false, pipeline = true;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && (i + 1 < argc)) output = argv[++i];
+        else if (!strcmp(argv[i], "--quick")) quick = true;
+        else if (!strcmp(argv[i], "--repeat") && (i + 1 < argc)) repeat = std::max(atoi(argv[++i]), 1);
+        else if (!strcmp(argv[i], "--filter") && (i + 1 < argc)) filter = argv[++i];
+        else if (!strcmp(argv[i], "--tag") && (i + 1 < argc)) tag = argv[++i];
+        else if (!strcmp(argv[i], "--no-pipeline")) pipeline = false;
+        else if (strncmp(argv[i], "-device=", 8)) {
+            std::cerr << "Unknown option " << argv[i] << "\n";
+            return 1;
+        }
+    }
+
+    try {
+        // Selects and initializes the device used by all benchmarks
+        PlaneSweep ps(argc, argv);
+        Bench b(repeat, filter);
+
+        const std::vector<int2> sizes = quick ? std::vector<int2>{make_int2(640, 480)}
+                                              : std::vector<int2>{make_int2(320, 240), make_int2(640, 480),
+                                                                  make_int2(1280, 960), make_int2(1920, 1080)};
+        const std::vector<int> winsizes = quick ? std::vector<int>{5} : std::vector<int>{3, 5, 7, 9, 11};
+        const std::vector<int> planes = quick ? std::vector<int>{64} : std::vector<int>{32, 128, 256};
+        for (size_t i = 0; i < sizes.size(); i++) benchImageKernels(b, sizes[i].x, sizes[i].y, winsizes, planes);
+
+        const std::vector<int> bins = quick ? std::vector<int>{2, 8} : std::vector<int>{2, 3, 4, 5, 6, 7, 8, 9, 10};
+        const std::vector<int3> volumes = quick ? std::vector<int3>{make_int3(128, 128, 128)}
+                                                : std::vector<int3>{make_int3(128, 128, 128), make_int3(256, 256, 128)};
+        benchFusion<2>(b, bins, volumes);
+
+        bool success = !pipeline || benchPipeline(b, ps, argc, argv, quick);
+
+        std::ofstream out(output.c_str());
+        if (!out) {
+            std::cerr << "Could not write " << output << std::endl;
+            return 1;
+        }
+        b.write(out, tag);
+        std::cerr << "Results written to " << output << std::endl;
+        return success ? 0 : 2;
+    }
+    catch (const std::exception & e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+}
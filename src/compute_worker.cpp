@@ -0,0 +1,112 @@
+#include "compute_worker.h"
+#include <iostream>
+#include <exception>
+#include <cuda_runtime_api.h>
+
+ComputeWorker::ComputeWorker(QObject * parent)
+    : QObject(parent), cancel_(false), next_(1), current_(0), device_(-1), running_(false), stop_(false)
+{
+    // Jobs run on the device chosen by the creating thread
+    if (cudaGetDevice(&device_) != cudaSuccess) device_ = -1;
+    worker_ = std::thread(&ComputeWorker::work, this);
+}
+
+ComputeWorker::~ComputeWorker()
+{
+    cancel();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    queued_.notify_all();
+    worker_.join();
+}
+
+unsigned int ComputeWorker::submit(JobType type, job_type job, bool replace)
+{
+    Job j;
+    std::deque<Job> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (replace)
+            for (std::deque<Job>::iterator it = jobs_.begin(); it != jobs_.end();){
+                if (it->type != type) { ++it; continue; }
+                dropped.push_back(*it);
+                it = jobs_.erase(it);
+            }
+        j.id = next_++;
+        j.type = type;
+        j.run = job;
+        jobs_.push_back(j);
+    }
+    queued_.notify_one();
+    for (const Job & d : dropped) emit finished(d.id, d.type, false);
+    return j.id;
+}
+
+void ComputeWorker::cancel()
+{
+    std::deque<Job> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        dropped.swap(jobs_);
+        if (running_) cancel_ = true;
+    }
+    done_.notify_all();
+
+    // Owners of dropped jobs are told they failed, e.g. so multi step jobs do not wait for them forever
+    for (const Job & d : dropped) emit finished(d.id, d.type, false);
+}
+
+bool ComputeWorker::busy()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return running_ || !jobs_.empty();
+}
+
+void ComputeWorker::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]{ return jobs_.empty() && !running_; });
+}
+
+void ComputeWorker::reportProgress(int done, int total)
+{
+    emit progress(current_, done, total);
+}
+
+void ComputeWorker::work()
+{
+    if (device_ >= 0) cudaSetDevice(device_);
+
+    for (;;) {
+        Job j;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            queued_.wait(lock, [this]{ return stop_ || !jobs_.empty(); });
+            if (jobs_.empty()) return;
+            j = jobs_.front();
+            jobs_.pop_front();
+            running_ = true;
+            current_ = j.id;
+            cancel_ = false;
+        }
+
+        emit started(j.id, j.type);
+        bool success = false;
+        try {
+            success = j.run();
+        }
+        catch (const std::exception & e) {
+            std::cerr << "Exception caught in compute job: " << e.what() << std::endl;
+        }
+        j.run = job_type(); // release captured objects before reporting
+        emit finished(j.id, j.type, success);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        done_.notify_all();
+    }
+}
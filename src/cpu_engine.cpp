@@ -0,0 +1,292 @@
+#include "cpu_engine.h"
+#include "helper_structs.h"
+#include "defines.h"
+#include <algorithm>
+#include <cmath>
+
+// Mirror index at array borders, same as the windowed mean kernels
+static inline int mirror(int k, const int size)
+{
+    if (k < 0) k = -k;
+    if (k > size - 1) k = 2 * (size - 1) - k;
+    return std::min(std::max(k, 0), size - 1);
+}
+
+// Bilinear sample, 0 outside of the image as LinearMemorySampler
+static inline float sample(const float * data, const float x, const float y, const int width, const int height)
+{
+    const int   ix = (int)std::floor(x);
+    const float a  = x - ix;
+    const int   iy = (int)std::floor(y);
+    const float b  = y - iy;
+
+    if ((ix < 0) || (iy < 0) || (iy + 1 > height - 1) || (ix + 1 > width - 1)) return 0.f;
+
+    const float * r = data + iy * width + ix;
+    const float r1 = a * r[1] + (1 - a) * r[0];
+    const float r2 = a * r[width + 1] + (1 - a) * r[width];
+    return b * r2 + (1 - b) * r1;
+}
+
+CpuEngine::CpuEngine(unsigned int threads) : next_(0)
+{
+    if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned int i = 1; i < threads; i++) workers_.push_back(std::thread(&CpuEngine::work, this));
+}
+
+CpuEngine::~CpuEngine()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (size_t i = 0; i < workers_.size(); i++) workers_[i].join();
+}
+
+void CpuEngine::parallel(int count, const std::function<void(int)> & task)
+{
+    if (workers_.empty() || (count <= 1)) {
+        for (int i = 0; i < count; i++) task(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        count_ = count;
+        next_ = 0;
+        busy_ = (unsigned int)workers_.size();
+        generation_++;
+    }
+    wake_.notify_all();
+
+    // Calling thread takes tasks as well, then waits for all workers to leave this generation
+    for (int i; (i = next_++) < count; ) task(i);
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]{ return busy_ == 0; });
+    task_ = 0;
+}
+
+void CpuEngine::work()
+{
+    unsigned int seen = 0;
+    for (;;) {
+        const std::function<void(int)> * task;
+        int count;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&]{ return stop_ || (generation_ != seen); });
+            if (stop_) return;
+            seen = generation_;
+            task = task_;
+            count = count_;
+        }
+
+        for (int i; (i = next_++) < count; ) (*task)(i);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--busy_ == 0) done_.notify_one();
+    }
+}
+
+void CpuEngine::planesweep(float * depth, const float * ref, const std::vector<const float *> & src,
+                           const std::vector<Matrix3D> & H, const std::vector<float> & depths, const int width,
+                           const int height, const unsigned int winsize, const float stdthresh,
+                           const float nccthresh, const float zfar)
+{
+    const int n = winsize / 2, tw = 2 * n + 1;
+    const int nplanes = depths.size(), nimgs = src.size();
+    const float norm = 1.f / (float)(tw * tw);
+    const int tiles = (height + CPU_TILE_ROWS - 1) / CPU_TILE_ROWS;
+
+    // Mirrored columns of all windows, shifted by n so column x - n is at index x
+    std::vector<int> mx(width + 2 * n);
+    for (int x = 0; x < width + 2 * n; x++) mx[x] = mirror(x - n, width);
+
+    parallel(tiles, [&](int t){
+        const int y0 = t * CPU_TILE_ROWS, y1 = std::min(y0 + CPU_TILE_ROWS, height);
+        const int rows = y1 - y0, th = rows + 2 * n;
+
+        // Tile rows with halo: reference, warped source and their column sums
+        std::vector<float> r(th * width), wp(th * width), c1(width), c2(width), c3(width);
+        std::vector<float> wm(width), wsq(width), wprod(width);
+        std::vector<float> mean(rows * width), stdev(rows * width), best(rows * width), bestdepth(rows * width);
+        std::vector<float> sum(rows * width, 0.f), count(rows * width, 0.f);
+        std::vector<int> gy(th);
+        for (int ty = 0; ty < th; ty++) {
+            gy[ty] = mirror(y0 + ty - n, height);
+            std::copy(ref + gy[ty] * width, ref + (gy[ty] + 1) * width, r.begin() + ty * width);
+        }
+
+        // Reference windowed mean and STD, separable as the statistics kernels
+        for (int y = 0; y < rows; y++) {
+            std::fill(c1.begin(), c1.end(), 0.f);
+            std::fill(c2.begin(), c2.end(), 0.f);
+            for (int j = 0; j < tw; j++) {
+                const float * rr = &r[(y + j) * width];
+                for (int x = 0; x < width; x++) {
+                    c1[x] += rr[x];
+                    c2[x] += rr[x] * rr[x];
+                }
+            }
+            for (int x = 0; x < width; x++) {
+                float m = 0.f, s = 0.f;
+                for (int i = 0; i < tw; i++) {
+                    m += c1[mx[x + i]];
+                    s += c2[mx[x + i]];
+                }
+                m *= norm;
+                s *= norm;
+                const float var = s - m * m;
+                mean[y * width + x] = m;
+                stdev[y * width + x] = var > 0 ? std::sqrt(var) : 0.f;
+            }
+        }
+
+        for (int i = 0; i < nimgs; i++) {
+            std::fill(best.begin(), best.end(), 0.f);
+            std::fill(bestdepth.begin(), bestdepth.end(), 0.f);
+
+            for (int p = 0; p < nplanes; p++) {
+                const Matrix3D & h = H[i * nplanes + p];
+
+                // Warp tile and halo rows, sampled at the same mirrored pixels as the fused kernel tiles
+                for (int ty = 0; ty < th; ty++) {
+                    float * w = &wp[ty * width];
+                    for (int x = 0; x < width; x++) {
+                        float3 X = h * make_float3(x + 1, gy[ty] + 1, 1);
+                        X = X / X.z - 1;
+                        w[x] = sample(src[i], X.x, X.y, width, height);
+                    }
+                }
+
+                for (int y = 0; y < rows; y++) {
+                    std::fill(c1.begin(), c1.end(), 0.f);
+                    std::fill(c2.begin(), c2.end(), 0.f);
+                    std::fill(c3.begin(), c3.end(), 0.f);
+                    for (int j = 0; j < tw; j++) {
+                        const float * w = &wp[(y + j) * width];
+                        const float * rr = &r[(y + j) * width];
+                        for (int x = 0; x < width; x++) {
+                            c1[x] += w[x];
+                            c2[x] += w[x] * w[x];
+                            c3[x] += w[x] * rr[x];
+                        }
+                    }
+
+                    for (int x = 0; x < width; x++) {
+                        float m = 0.f, s = 0.f, pm = 0.f;
+                        for (int k = 0; k < tw; k++) {
+                            m += c1[mx[x + k]];
+                            s += c2[mx[x + k]];
+                            pm += c3[mx[x + k]];
+                        }
+                        wm[x] = m * norm;
+                        wsq[x] = s * norm;
+                        wprod[x] = pm * norm;
+                    }
+
+                    // NCC and best plane
+                    float * b = &best[y * width];
+                    float * d = &bestdepth[y * width];
+                    const float * rm = &mean[y * width];
+                    const float * rs = &stdev[y * width];
+                    for (int x = 0; x < width; x++) {
+                        const float var = wsq[x] - wm[x] * wm[x];
+                        const float sd = var > 0 ? std::sqrt(var) : 0.f;
+                        const bool valid = (rs[x] >= stdthresh) && (sd >= stdthresh);
+                        const float ncc = valid ? (wprod[x] - rm[x] * wm[x]) / (rs[x] * sd) : 0.f;
+                        const bool better = ncc > b[x];
+                        b[x] = better ? ncc : b[x];
+                        d[x] = better ? depths[p] : d[x];
+                    }
+                }
+            }
+
+            for (int k = 0; k < rows * width; k++) {
+                const bool pass = best[k] > nccthresh;
+                sum[k] += pass ? bestdepth[k] : 0.f;
+                count[k] += pass ? 1.f : 0.f;
+            }
+        }
+
+        for (int k = 0; k < rows * width; k++) depth[y0 * width + k] = count[k] > 0 ? sum[k] / count[k] : zfar;
+    });
+}
+
+void CpuEngine::tvl1(float * u, const float * raw, const float * guide, const int width, const int height,
+                     const unsigned int niters, const float lambda, const float tau, const float sigma,
+                     const float theta, const float beta, const float gamma, const float znear, const float zfar)
+{
+    const size_t area = size_t(width) * height;
+    const int tiles = (height + CPU_TILE_ROWS - 1) / CPU_TILE_ROWS;
+    std::vector<float> input(area), R(area, 0.f), Px(area, 0.f), Py(area, 0.f);
+    std::vector<float> T11(area), T12(area), T21(area), T22(area);
+
+    // Scaled solution and input, diffusion tensor of the guide as Anisotropic_diffusion_tensor
+    parallel(tiles, [&](int t){
+        const int y0 = t * CPU_TILE_ROWS, y1 = std::min(y0 + CPU_TILE_ROWS, height);
+        for (int y = y0; y < y1; y++) {
+            const int yn = std::min(y + 1, height - 1);
+            for (int x = 0; x < width; x++) {
+                const int i = y * width + x, xn = std::min(x + 1, width - 1);
+                u[i] = (raw[i] - znear) / (zfar - znear);
+                input[i] = (raw[i] - znear) * (-sigma / (zfar - znear));
+
+                float gx = guide[y * width + xn] - guide[i];
+                float gy = guide[yn * width + x] - guide[i];
+                const float d = std::sqrt(gx * gx + gy * gy);
+                if (d > 0.f) {
+                    gx /= d;
+                    gy /= d;
+                    const float k = std::exp(-beta * std::pow(d, gamma));
+                    T11[i] = k * gx * gx + gy * gy;
+                    T12[i] = T21[i] = (k - 1) * gx * gy;
+                    T22[i] = k * gy * gy + gx * gx;
+                }
+                else {
+                    T11[i] = T22[i] = 1.f;
+                    T12[i] = T21[i] = 0.f;
+                }
+            }
+        }
+    });
+
+    // Dual update reads the solution only, primal update reads the duals only, so both run over tiles in parallel
+    for (unsigned int it = 0; it < niters; it++) {
+        const float s = it == 0 ? 1 + sigma : sigma;
+        parallel(tiles, [&](int t){
+            const int y0 = t * CPU_TILE_ROWS, y1 = std::min(y0 + CPU_TILE_ROWS, height);
+            for (int y = y0; y < y1; y++) {
+                const float * un = u + std::min(y + 1, height - 1) * width;
+                const float * uc = u + y * width;
+                for (int x = 0; x < width; x++) {
+                    const int i = y * width + x;
+                    const float gx = uc[std::min(x + 1, width - 1)] - uc[x];
+                    const float gy = un[x] - uc[x];
+                    const float dx = Px[i] + s * (T11[i] * gx + T12[i] * gy);
+                    const float dy = Py[i] + s * (T21[i] * gx + T22[i] * gy);
+                    const float d = std::max(1.f, std::sqrt(dx * dx + dy * dy));
+                    Px[i] = dx / d;
+                    Py[i] = dy / d;
+                }
+            }
+        });
+        parallel(tiles, [&](int t){
+            const int y0 = t * CPU_TILE_ROWS, y1 = std::min(y0 + CPU_TILE_ROWS, height);
+            for (int y = y0; y < y1; y++) {
+                const int yp = std::max(y - 1, 0);
+                for (int x = 0; x < width; x++) {
+                    const int i = y * width + x;
+                    R[i] = std::min(std::max(R[i] + input[i] + sigma * u[i], -lambda), lambda);
+                    const float div = (x > 0 ? Px[i] - Px[i - 1] : 0.f) + Py[i] - Py[yp * width + x];
+                    const float unew = u[i] + tau * div - tau * R[i];
+                    u[i] = unew + theta * (unew - u[i]);
+                }
+            }
+        });
+    }
+
+    for (size_t i = 0; i < area; i++) u[i] = u[i] * (zfar - znear) + znear;
+}
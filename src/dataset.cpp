@@ -0,0 +1,85 @@
+#include "dataset.h"
+#include "planesweep.h"
+#include "reader.h"
+#include "image_loader.h"
+#include <QVector>
+#include <algorithm>
+#include <memory>
+
+QString Dataset::imageName(int number, QString & impos) const
+{
+    return Reader::ImageName(impos, number, digits, dir, name, format);
+}
+
+void Dataset::request(int number, bool pin)
+{
+    QString impos;
+    QString imname = imageName(number, impos);
+    FrameCache::value_ptr cached = frames.find(number);
+    if (!cached || (cached->name != imname)) ImageLoader::instance().request(imname, pin);
+}
+
+FrameCache::value_ptr Dataset::load(int number)
+{
+    QString impos;
+    QString imname = imageName(number, impos);
+    FrameCache::value_ptr cached = frames.find(number);
+    if (cached && (cached->name == imname)) return cached;
+
+    std::shared_ptr<CachedFrame> frame = std::make_shared<CachedFrame>();
+    frame->name = imname;
+    poses.openOrBuild(dir + '/' + name + POSE_INDEX_EXTENSION, dir,
+                      [&](const QString & fname){ return PoseIndex::buildICLNUIM(fname, dir, name, digits); });
+    if (!poses.pose(number, frame->K, frame->R, frame->t)) {
+        Vector3D cam_pos, cam_dir, cam_up, cam_lookat, cam_sky, cam_right, cam_fpoint;
+        double cam_angle;
+        if (!Reader::getcamParameters(impos, cam_pos, cam_dir, cam_up, cam_lookat, cam_sky, cam_right, cam_fpoint,
+                                      cam_angle))
+            return FrameCache::value_ptr();
+        Reader::getcamK(frame->K, cam_dir, cam_up, cam_right);
+        Reader::computeRT(frame->R, frame->t, cam_dir, cam_pos, cam_up);
+    }
+
+    ImageLoader::Frame decoded;
+    if (!ImageLoader::instance().take(imname, decoded) || decoded.image.isNull()) return FrameCache::value_ptr();
+    frame->image = decoded.image;
+    frame->gray.swap(decoded.gray);
+
+    frames.insert(number, frame);
+    return frame;
+}
+
+bool Dataset::loadWindow(PlaneSweep & ps, int refn, int nimages, int step)
+{
+    int nsrc = nimages - 1;
+    int half = (nsrc + 1) / 2;
+    QVector<int> window;
+    window << refn;
+    for (int i = 0; i < nsrc; i++) window << refn + ((i < half) ? i + 1 : half - i - 1);
+
+    frames.setCapacity(std::max<size_t>(DEFAULT_FRAME_CACHE_SIZE, 2 * window.size()));
+    // Views of this window are pinned, so the look-ahead of the next one cannot evict them before they are taken
+    for (int i = 0; i < window.size(); i++) request(window[i], true);
+    for (int i = 0; i < window.size(); i++) request(window[i] + step);
+
+    FrameCache::value_ptr ref = load(refn);
+    if (!ref) return false;
+    const int w = ref->image.width(), h = ref->image.height();
+    ps.setK(ref->K);
+    ps.HostRef.reset(w, h);
+    ps.HostRef.R = ref->R;
+    ps.HostRef.t = ref->t;
+    std::copy(ref->gray.begin(), ref->gray.end(), ps.HostRef.data());
+
+    ps.HostSrc.resize(0);
+    for (int i = 1; i < window.size(); i++) {
+        FrameCache::value_ptr src = load(window[i]);
+        if (!src || (src->image.size() != ref->image.size())) continue;
+        ps.HostSrc.resize(ps.HostSrc.size() + 1);
+        ps.HostSrc.back().reset(w, h);
+        ps.HostSrc.back().R = src->R;
+        ps.HostSrc.back().t = src->t;
+        std::copy(src->gray.begin(), src->gray.end(), ps.HostSrc.back().data());
+    }
+    return !ps.HostSrc.empty();
+}
@@ -0,0 +1,517 @@
+// Accuracy versus throughput evaluation, runs a parameter grid over a dataset and reports the Pareto front.
+//
+// Usage: plane_sweep_eval <config.ini>
+//
+// Every combination of the [grid] lists is run over frames first to last of the dataset. Depthmaps are compared to
+// ICL-NUIM ground truth, at pixels where both are valid. Wall time per frame includes uploads and downloads, GPU time is
+// the sum of the StageTimer totals of the calls. If a reference cloud is set, depthmaps of each combination are fused
+// for every bins and fusioniters pair, and the mean distance of mesh vertices to the nearest cloud point is the surface
+// error. Configurations that no other configuration beats in time per frame, depth error, completeness and surface
+// error at once form the Pareto front. The front is printed and marked in the CSV file.
+//
+// Config file is in INI format, all keys except dataset/dir and dataset/name are optional:
+//
+//  [dataset]                      ; same keys as plane_sweep_batch
+//  dir = /data/living_room
+//  name = scene_00_
+//  digits = 4
+//  format = png
+//  first = 0
+//  last = 20
+//  step = 1
+//
+//  [groundtruth]
+//  scale = 1                      ; factor from .depth file units to camera file units
+//  threshold = 0.05               ; absolute depth error counted as inlier
+//  cloud =                        ; ASCII PCD reference surface, e.g. "example results/fusion_results.pcd", no fusion if empty
+//  radius = 0.1                   ; distances to the reference surface are capped at radius
+//
+//  [grid]                         ; comma separated lists
+//  planes = 100, 200
+//  winsize = 5
+//  images = 4
+//  cost = ncc                     ; ncc, sad, census
+//  precision = float              ; float, half, uchar
+//  pyramid = 1
+//  refine = tvl1                  ; none, tvl1, tgv
+//  tvl1iters = 100                ; only varied with refine = tvl1
+//  bins = 8                       ; 2 to 10
+//  fusioniters = 50
+//
+//  [planesweep]
+//  znear = 0.1
+//  zfar = 1.0
+//  std = 0.0001
+//  ncc = 0.5
+//
+//  [fusion]
+//  volume = -1, -1, 1, 1, 1, 3    ; corners x1, y1, z1, x2, y2, z2, default as in the viewer
+//  size = 128, 128, 128
+//  threshold = 0.1                ; also tau, lambda, sigma, defaults as in the viewer
+//
+//  [output]
+//  file = plane_sweep_eval.csv
+
+#include "planesweep.h"
+#include "reader.h"
+#include "dataset.h"
+#include "image.h"
+#include "fusion.cu.h"
+#include "fusion_mesh.cu.h"
+#include "cuda_exception.h"
+#include <QCoreApplication>
+#include <QSettings>
+#include <QStringList>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <cuda_runtime_api.h>
+
+// Depthmap of a frame with the pose fusion integrates it with
+struct EvalFrame
+{
+    std::vector<float> depth;
+    Matrix3D K, R;
+    Vector3D t;
+};
+
+// Planesweep parameters of one grid point
+struct EvalConfig
+{
+    int planes, winsize, images, pyramid, tvl1iters;
+    QString cost, precision, refine;
+};
+
+// One CSV row, fusion columns are negative if fusion did not run
+struct EvalResult
+{
+    EvalConfig config;
+    int bins = -1, fusioniters = -1, frames = 0;
+    double wallms = 0, gpums = 0, fusionms = -1;
+    double mae = 0, inliers = 0, completeness = 0, surface = -1;
+    bool pareto = false;
+
+    double msPerFrame() const { return wallms + std::max(fusionms, 0.0); }
+};
+
+// Settings value as list, single values are a list of one
+static QStringList list(QSettings & cfg, const QString & key, const QString & def)
+{
+    QStringList l = cfg.value(key, def).toStringList();
+    for (int i = 0; i < l.size(); i++) l[i] = l[i].trimmed().toLower();
+    l.removeAll(QString());
+    return l.isEmpty() ? QStringList(def) : l;
+}
+
+static std::vector<int> intList(QSettings & cfg, const QString & key, int def)
+{
+    const QStringList l = list(cfg, key, QString::number(def));
+    std::vector<int> v;
+    for (int i = 0; i < l.size(); i++) v.push_back(l[i].toInt());
+    return v;
+}
+
+// Nearest point distance queries against a point cloud, points are hashed into cubes of the capping radius
+class CloudDistance
+{
+public:
+    bool load(const std::string & fname, float radius)
+    {
+        r_ = radius;
+        std::ifstream in(fname.c_str());
+        std::string line;
+        bool data = false;
+        while (!data && std::getline(in, line)) {
+            if (line.compare(0, 4, "DATA") == 0) {
+                if (line.find("ascii") == std::string::npos) {
+                    std::cerr << "Only ASCII PCD files are supported\n";
+                    return false;
+                }
+                data = true;
+            }
+        }
+        if (!data) return false;
+
+        float3 p;
+        while (std::getline(in, line)) {
+            std::istringstream s(line);
+            if (!(s >> p.x >> p.y >> p.z)) continue;
+            cells_[key(cell(p.x), cell(p.y), cell(p.z))].push_back(p);
+        }
+        return !cells_.empty();
+    }
+
+    // Distance to the nearest point, at most the radius
+    float distance(const float3 & p) const
+    {
+        const int cx = cell(p.x), cy = cell(p.y), cz = cell(p.z);
+        float best = r_ * r_;
+        for (int z = cz - 1; z <= cz + 1; z++)
+            for (int y = cy - 1; y <= cy + 1; y++)
+                for (int x = cx - 1; x <= cx + 1; x++) {
+                    auto it = cells_.find(key(x, y, z));
+                    if (it == cells_.end()) continue;
+                    for (size_t i = 0; i < it->second.size(); i++) {
+                        const float3 & q = it->second[i];
+                        const float dx = q.x - p.x, dy = q.y - p.y, dz = q.z - p.z;
+                        best = std::min(best, dx * dx + dy * dy + dz * dz);
+                    }
+                }
+        return std::sqrt(best);
+    }
+
+private:
+    int cell(float v) const { return (int)std::floor(v / r_); }
+    static long long key(long long x, long long y, long long z) { return (x * 73856093LL) ^ (y * 19349663LL) ^ (z * 83492791LL); }
+
+    std::unordered_map<long long, std::vector<float3>> cells_;
+    float r_ = 1;
+};
+
+struct FusionParams
+{
+    float3 x1, x2;
+    int3 size;
+    float threshold, tau, lambda, sigma;
+};
+
+// Fuse all frames into a fresh volume and measure mesh vertices against the reference cloud
+template<unsigned char _bins>
+static void fuse(const std::vector<EvalFrame> & frames, int width, int height, const FusionParams & fp, int iterations,
+                 const CloudDistance & cloud, EvalResult & r)
+{
+    fusionData<_bins> f(fp.size.x, fp.size.y, fp.size.z);
+    f.setVolume(fp.x1, fp.x2);
+    CHECK_CUDA_ERRORS_AUTO(cudaMemset(f.voxelPtr(), 0, f.sizeBytes()));
+
+    const dim3 threads(DEFAULT_FUSION_THREADS_X, DEFAULT_FUSION_THREADS_Y,
+                       MAX_THREADS_PER_BLOCK / DEFAULT_FUSION_THREADS_X / DEFAULT_FUSION_THREADS_Y);
+    const dim3 blocks((fp.size.x + threads.x - 1) / threads.x, (fp.size.y + threads.y - 1) / threads.y,
+                      (fp.size.z + threads.z - 1) / threads.z);
+    Image<float> depth(width, height);
+    Image<float> su(fp.size.x, fp.size.y * fp.size.z);
+    Image<float3> sp(fp.size.x, fp.size.y * fp.size.z);
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < frames.size(); i++) {
+        CHECK_CUDA_ERRORS_AUTO(cudaMemcpy(depth.data(), frames[i].depth.data(), width * height * sizeof(float),
+                                          cudaMemcpyHostToDevice));
+        FusionUpdateIteration(f, depth.data(), frames[i].K, frames[i].R, frames[i].t, fp.threshold, fp.tau, fp.lambda,
+                              fp.sigma, width, height, blocks, threads);
+    }
+    FusionSolveFused(f, su.data(), sp.data(), iterations, fp.tau, fp.lambda, fp.sigma,
+                     dim3(DEFAULT_FUSION_THREADS_X, DEFAULT_FUSION_THREADS_Y));
+
+    fusionMesh mesh;
+    FusionExtractMesh<_bins>(f, mesh, blocks, threads);
+    std::vector<float3> vertices;
+    std::vector<uint3> triangles;
+    mesh.copyTo(vertices, triangles);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    r.fusionms = std::chrono::duration<double, std::milli>(t1 - t0).count() / std::max<size_t>(frames.size(), 1);
+
+    double sum = 0;
+    for (size_t i = 0; i < vertices.size(); i++) sum += cloud.distance(vertices[i]);
+    r.surface = vertices.empty() ? -1 : sum / vertices.size();
+}
+
+template<unsigned char _bins>
+static void fuseBins(int bins, const std::vector<EvalFrame> & frames, int width, int height, const FusionParams & fp,
+                     int iterations, const CloudDistance & cloud, EvalResult & r)
+{
+    if (bins == _bins) fuse<_bins>(frames, width, height, fp, iterations, cloud, r);
+    else fuseBins<_bins + 1>(bins, frames, width, height, fp, iterations, cloud, r);
+}
+
+template<>
+void fuseBins<11>(int bins, const std::vector<EvalFrame> &, int, int, const FusionParams &, int, const CloudDistance &,
+                  EvalResult &)
+{
+    std::cerr << "Unsupported number of bins " << bins << ", fusion skipped\n";
+}
+
+// a is at least as good as b in all objectives and better in one, surface error only counts if both have it.
+// Completeness is maximized, so sparse configurations with few accurate pixels do not dominate dense ones.
+static bool dominates(const EvalResult & a, const EvalResult & b)
+{
+    std::vector<double> oa = {a.msPerFrame(), a.mae, -a.completeness}, ob = {b.msPerFrame(), b.mae, -b.completeness};
+    if ((a.surface >= 0) && (b.surface >= 0)) {
+        oa.push_back(a.surface);
+        ob.push_back(b.surface);
+    }
+    bool better = false;
+    for (size_t i = 0; i < oa.size(); i++) {
+        if (oa[i] > ob[i]) return false;
+        if (oa[i] < ob[i]) better = true;
+    }
+    return better;
+}
+
+static void writeCSVHeader(std::ostream & out)
+{
+    out << "planes,winsize,images,cost,precision,pyramid,refine,tvl1iters,bins,fusioniters,frames,"
+           "wall_ms,gpu_ms,fusion_ms,ms_per_frame,mae,inliers,completeness,surface,pareto\n";
+}
+
+static void writeCSV(std::ostream & out, const EvalResult & r)
+{
+    const EvalConfig & c = r.config;
+    out << c.planes << ',' << c.winsize << ',' << c.images << ',' << c.cost.toStdString() << ','
+        << c.precision.toStdString() << ',' << c.pyramid << ',' << c.refine.toStdString() << ',' << c.tvl1iters << ','
+        << r.bins << ',' << r.fusioniters << ',' << r.frames << ',' << r.wallms << ',' << r.gpums << ',' << r.fusionms
+        << ',' << r.msPerFrame() << ',' << r.mae << ',' << r.inliers << ',' << r.completeness << ',' << r.surface << ','
+        << (r.pareto ? 1 : 0) << '\n';
+}
+
+int main(int argc, char * argv[])
+{
+    QCoreApplication app(argc, argv);
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <config.ini>\n";
+        return 1;
+    }
+
+    QSettings cfg(QString::fromLocal8Bit(argv[1]), QSettings::IniFormat);
+    if (cfg.status() != QSettings::NoError) {
+        std::cerr << "Could not read config file " << argv[1] << std::endl;
+        return 1;
+    }
+
+    Dataset data;
+    data.dir = cfg.value("dataset/dir").toString();
+    data.name = cfg.value("dataset/name").toString();
+    data.format = cfg.value("dataset/format", "png").toString();
+    data.digits = cfg.value("dataset/digits", 4).toInt();
+    const int first = cfg.value("dataset/first", 0).toInt();
+    const int last = cfg.value("dataset/last", first).toInt();
+    const int step = std::max(cfg.value("dataset/step", 1).toInt(), 1);
+    if (data.dir.isEmpty() || data.name.isEmpty()) {
+        std::cerr << "dataset/dir and dataset/name have to be set\n";
+        return 1;
+    }
+
+    const float gtscale = cfg.value("groundtruth/scale", 1.f).toFloat();
+    const float threshold = cfg.value("groundtruth/threshold", 0.05f).toFloat();
+    const QString cloudname = cfg.value("groundtruth/cloud").toString();
+    CloudDistance cloud;
+    if (!cloudname.isEmpty() &&
+        !cloud.load(cloudname.toLocal8Bit().constData(), cfg.value("groundtruth/radius", 0.1f).toFloat())) {
+        std::cerr << "Could not read reference cloud " << cloudname.toStdString() << std::endl;
+        return 1;
+    }
+
+    FusionParams fp;
+    const QStringList vol = cfg.value("fusion/volume").toStringList();
+    fp.x1 = make_float3(DEFAULT_FUSION_VOLUME_X1, DEFAULT_FUSION_VOLUME_Y1, DEFAULT_FUSION_VOLUME_Z1);
+    fp.x2 = make_float3(DEFAULT_FUSION_VOLUME_X2, DEFAULT_FUSION_VOLUME_Y2, DEFAULT_FUSION_VOLUME_Z2);
+    if (vol.size() == 6) {
+        fp.x1 = make_float3(vol[0].toFloat(), vol[1].toFloat(), vol[2].toFloat());
+        fp.x2 = make_float3(vol[3].toFloat(), vol[4].toFloat(), vol[5].toFloat());
+    }
+    const QStringList size = cfg.value("fusion/size").toStringList();
+    fp.size = make_int3(128, 128, 128);
+    if (size.size() == 3) fp.size = make_int3(size[0].toInt(), size[1].toInt(), size[2].toInt());
+    fp.threshold = cfg.value("fusion/threshold", DEFAULT_FUSION_SD_THRESHOLD).toFloat();
+    fp.tau = cfg.value("fusion/tau", DEFAULT_FUSION_TAU).toFloat();
+    fp.lambda = cfg.value("fusion/lambda", DEFAULT_FUSION_LAMBDA).toFloat();
+    fp.sigma = cfg.value("fusion/sigma", DEFAULT_FUSION_SIGMA).toFloat();
+
+    PlaneSweep ps(argc, argv);
+    const float znear = cfg.value("planesweep/znear", DEFAULT_Z_NEAR).toFloat();
+    const float zfar = cfg.value("planesweep/zfar", DEFAULT_Z_FAR).toFloat();
+    ps.setZ(znear, zfar);
+    ps.setSTDthreshold(cfg.value("planesweep/std", DEFAULT_STD_THRESHOLD).toFloat());
+    ps.setNCCthreshold(cfg.value("planesweep/ncc", DEFAULT_NCC_THRESHOLD).toFloat());
+
+    // Grid axes, the last axis varies fastest
+    const std::vector<int> planes = intList(cfg, "grid/planes", DEFAULT_NUMBER_OF_PLANES);
+    const std::vector<int> winsizes = intList(cfg, "grid/winsize", DEFAULT_WINDOW_SIZE);
+    const std::vector<int> images = intList(cfg, "grid/images", DEFAULT_NUMBER_OF_IMAGES);
+    const QStringList costs = list(cfg, "grid/cost", "ncc");
+    const QStringList precisions = list(cfg, "grid/precision", "float");
+    const std::vector<int> pyramids = intList(cfg, "grid/pyramid", 1);
+    const QStringList refines = list(cfg, "grid/refine", "tvl1");
+    const std::vector<int> tvl1iters = intList(cfg, "grid/tvl1iters", DEFAULT_TVL1_ITERATIONS);
+    const std::vector<int> bins = intList(cfg, "grid/bins", 8);
+    const std::vector<int> fusioniters = intList(cfg, "grid/fusioniters", DEFAULT_FUSION_ITERATIONS);
+
+    std::vector<EvalConfig> configs;
+    for (size_t a = 0; a < planes.size(); a++)
+    for (size_t b = 0; b < winsizes.size(); b++)
+    for (size_t c = 0; c < images.size(); c++)
+    for (int d = 0; d < costs.size(); d++)
+    for (int e = 0; e < precisions.size(); e++)
+    for (size_t f = 0; f < pyramids.size(); f++)
+    for (int g = 0; g < refines.size(); g++)
+    for (size_t h = 0; h < tvl1iters.size(); h++) {
+        // Iterations only change TVL1 results
+        if ((refines[g] != "tvl1") && (h > 0)) continue;
+        // Reduced source precision is only implemented by the per view NCC sweep
+        if ((precisions[e] != "float") && ((pyramids[f] > 1) || (costs[d] != "ncc"))) continue;
+        configs.push_back(EvalConfig{planes[a], winsizes[b], images[c], pyramids[f], tvl1iters[h], costs[d],
+                                     precisions[e], refines[g]});
+    }
+
+    std::vector<EvalResult> results;
+    for (size_t n = 0; n < configs.size(); n++) {
+        const EvalConfig & c = configs[n];
+        std::cerr << "Configuration " << n + 1 << "/" << configs.size() << std::endl;
+        ps.setNumberofPlanes(c.planes);
+        ps.setWindowSize(c.winsize);
+        ps.setNumberofImages(c.images);
+        ps.setPyramid(c.pyramid);
+        ps.setCostMetric((c.cost == "sad") ? PlaneSweep::CostSAD :
+                         ((c.cost == "census") ? PlaneSweep::CostCensus : PlaneSweep::CostNCC));
+        ps.setSourcePrecision((c.precision == "half") ? PlaneSweep::SourceHalf :
+                              ((c.precision == "uchar") ? PlaneSweep::SourceUChar : PlaneSweep::SourceFloat));
+
+        EvalResult r;
+        r.config = c;
+        std::vector<EvalFrame> frames;
+        double abserr = 0, inliers = 0, valid = 0, total = 0;
+        int width = 0, height = 0;
+        for (int refn = first; refn <= last; refn += step) {
+            if (!data.loadWindow(ps, refn, c.images, step)) {
+                std::cerr << "Frame " << refn << " skipped\n";
+                continue;
+            }
+
+            auto t0 = std::chrono::high_resolution_clock::now();
+            bool success = ps.RunAlgorithm(argc, argv);
+            double gpums = ps.getTimings().ms;
+            const CamImage<float> * result = 0;
+            if (success && (c.refine == "tvl1")) {
+                success = ps.CudaDenoise(argc, argv, c.tvl1iters, DEFAULT_TVL1_LAMBDA, DEFAULT_TVL1_TAU,
+                                         DEFAULT_TVL1_SIGMA, DEFAULT_TVL1_THETA, DEFAULT_TVL1_BETA, DEFAULT_TVL1_GAMMA);
+                gpums += ps.getTimings().ms;
+                result = ps.getDepthmapDenoised();
+            }
+            else if (success && (c.refine == "tgv")) {
+                success = ps.TGV(argc, argv, DEFAULT_TGV_NITERS, DEFAULT_TGV_NWARPS, DEFAULT_TGV_LAMBDA,
+                                 DEFAULT_TGV_ALPHA0, DEFAULT_TGV_ALPHA1, DEFAULT_TGV_TAU, DEFAULT_TGV_SIGMA,
+                                 DEFAULT_TGV_BETA, DEFAULT_TGV_GAMMA);
+                gpums += ps.getTimings().ms;
+                result = ps.getDepthmapTGV();
+            }
+            else if (success) result = ps.getDepthmap();
+            auto t1 = std::chrono::high_resolution_clock::now();
+            if (!success) {
+                std::cerr << "Frame " << refn << " failed\n";
+                continue;
+            }
+            r.wallms += std::chrono::duration<double, std::milli>(t1 - t0).count();
+            r.gpums += gpums;
+            r.frames++;
+
+            width = result->width();
+            height = result->height();
+            std::vector<float> gt;
+            if (!Reader::Read_ICL_NUIM_depth(gt, width, height, ps.getK(), refn, data.dir, data.name, data.format,
+                                             data.digits, gtscale))
+                continue;
+            // Unmatched pixels of the raw sweep are filled with zfar, they are missing rather than valid. Raw depthmaps
+            // use the valid mask of the sweep, refined ones only drop the fill value they kept.
+            std::vector<float> validmask;
+            if ((c.refine != "tvl1") && (c.refine != "tgv") && ps.getValidMaskPtr()) {
+                validmask.resize(width * height);
+                CHECK_CUDA_ERRORS_AUTO(cudaMemcpy(validmask.data(), ps.getValidMaskPtr(), width * height * sizeof(float),
+                                                  cudaMemcpyDeviceToHost));
+            }
+            const float * d = result->data();
+            for (int i = 0; i < width * height; i++) {
+                if (!(gt[i] > 0)) continue;
+                total++;
+                if (!std::isfinite(d[i]) || (d[i] < znear) || (d[i] >= zfar)) continue;
+                if (!validmask.empty() && !(validmask[i] > 0)) continue;
+                const double err = std::fabs(d[i] - gt[i]);
+                valid++;
+                abserr += err;
+                if (err <= threshold) inliers++;
+            }
+
+            if (!cloudname.isEmpty()) {
+                // Pixels that are not scored are not fused either, fusion skips QNANs
+                EvalFrame frame;
+                frame.depth.assign(d, d + width * height);
+                for (int i = 0; i < width * height; i++)
+                    if ((!validmask.empty() && !(validmask[i] > 0)) || !(frame.depth[i] < zfar))
+                        frame.depth[i] = std::numeric_limits<float>::quiet_NaN();
+                frame.K = ps.getK();
+                Matrix3D I;
+                Vector3D tm(0,0,0);
+                I.makeIdentity();
+                ps.RelativeMatrices(frame.R, frame.t, I, tm, ps.HostRef.R, ps.HostRef.t); // from world to ref
+                frames.push_back(frame);
+            }
+        }
+        if (r.frames == 0) continue;
+        r.wallms /= r.frames;
+        r.gpums /= r.frames;
+        r.mae = valid > 0 ? abserr / valid : -1;
+        r.inliers = valid > 0 ? 100.0 * inliers / valid : 0;
+        r.completeness = total > 0 ? 100.0 * valid / total : 0;
+
+        if (cloudname.isEmpty() || frames.empty()) {
+            results.push_back(r);
+            continue;
+        }
+        for (size_t b = 0; b < bins.size(); b++)
+            for (size_t i = 0; i < fusioniters.size(); i++) {
+                EvalResult fr = r;
+                fr.bins = bins[b];
+                fr.fusioniters = fusioniters[i];
+                fuseBins<2>(bins[b], frames, width, height, fp, fusioniters[i], cloud, fr);
+                results.push_back(fr);
+            }
+    }
+
+    for (size_t i = 0; i < results.size(); i++) {
+        results[i].pareto = results[i].mae >= 0;
+        for (size_t j = 0; (j < results.size()) && results[i].pareto; j++)
+            if ((j != i) && (results[j].mae >= 0) && dominates(results[j], results[i])) results[i].pareto = false;
+    }
+
+    const QString fname = cfg.value("output/file", "plane_sweep_eval.csv").toString();
+    std::ofstream csv(fname.toLocal8Bit().constData());
+    if (!csv) std::cerr << "Could not open output file " << fname.toStdString() << std::endl;
+    else {
+        writeCSVHeader(csv);
+        for (size_t i = 0; i < results.size(); i++) writeCSV(csv, results[i]);
+    }
+
+    // Pareto front from fastest to slowest
+    std::vector<EvalResult> front;
+    for (size_t i = 0; i < results.size(); i++)
+        if (results[i].pareto) front.push_back(results[i]);
+    std::sort(front.begin(), front.end(),
+              [](const EvalResult & a, const EvalResult & b){ return a.msPerFrame() < b.msPerFrame(); });
+
+    std::cout << std::left << std::setw(7) << "planes" << std::setw(5) << "win" << std::setw(5) << "img"
+              << std::setw(8) << "cost" << std::setw(7) << "prec" << std::setw(5) << "pyr" << std::setw(7) << "refine"
+              << std::setw(7) << "iters" << std::setw(6) << "bins" << std::setw(7) << "fiters" << std::right
+              << std::setw(10) << "ms/frame" << std::setw(10) << "gpu ms" << std::setw(10) << "MAE"
+              << std::setw(9) << "inl %" << std::setw(9) << "comp %" << std::setw(10) << "surface" << '\n';
+    std::cout << std::fixed;
+    for (size_t i = 0; i < front.size(); i++) {
+        const EvalResult & r = front[i];
+        const EvalConfig & c = r.config;
+        std::cout << std::left << std::setw(7) << c.planes << std::setw(5) << c.winsize << std::setw(5) << c.images
+                  << std::setw(8) << c.cost.toStdString() << std::setw(7) << c.precision.toStdString()
+                  << std::setw(5) << c.pyramid << std::setw(7) << c.refine.toStdString() << std::setw(7)
+                  << c.tvl1iters << std::setw(6) << r.bins << std::setw(7) << r.fusioniters << std::right
+                  << std::setprecision(2) << std::setw(10) << r.msPerFrame() << std::setw(10) << r.gpums
+                  << std::setprecision(4) << std::setw(10) << r.mae << std::setprecision(1) << std::setw(9)
+                  << r.inliers << std::setw(9) << r.completeness << std::setprecision(4) << std::setw(10)
+                  << r.surface << '\n';
+    }
+    std::cerr << results.size() << " configurations evaluated, " << front.size() << " on the Pareto front\n";
+    return results.empty() ? 2 : 0;
+}
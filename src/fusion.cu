@@ -1,50 +1,247 @@
 // Kernels for depthmap fusion (WIP):
 #include "fusion.cu.h"
 #include "dev_functions.h"
+#include "nvtx_range.h"
+#include "kernel_jit.h"
+#include <cstring>
+#include <cstddef>
+#include <map>
+#include <mutex>
 
-template<unsigned char _bins>
-__global__ void FusionUpdateHistogram_kernel(fusionData<_bins> f, const float * __restrict__ depthmap, const Matrix3D K,
+// Persistent descriptor of the dense volume read by all fusionData kernels below. Host wrappers bind their volume before
+// launching and the upload is skipped while it stays unchanged, so kernels take no per launch fusionData argument.
+__constant__ __align__(16) unsigned char c_fusion[FUSION_DESCRIPTOR_BYTES];
+
+// Host copy of the descriptor bound on each device, constant memory exists once per device context. The event is
+// recorded after the last upload, so launches on other streams wait for it.
+struct BoundFusion
+{
+    unsigned char bytes[FUSION_DESCRIPTOR_BYTES];
+    const void * type = 0;
+    cudaEvent_t uploaded = 0;
+};
+static std::map<int, BoundFusion> h_fusion;
+static std::mutex h_fusionMutex;
+
+/**
+ *  \brief Get fusionData bound in constant memory by \a bindFusion()
+ *
+ *  \return Reference to bound fusionData
+ */
+template<unsigned char _bins, typename _voxel>
+__device__ inline
+fusionData<_bins, Device, _voxel> & fusionDescriptor()
+{
+    return *reinterpret_cast<fusionData<_bins, Device, _voxel> *>(c_fusion);
+}
+
+/**
+ *  \brief Bind fusionData to constant memory descriptor read by fusion kernels
+ *
+ *  \param f      fusion data
+ *  \param stream CUDA stream of the launches reading the descriptor
+ *  \return No return value
+ *
+ *  \details The descriptor is only uploaded when \p f differs from the bound one, which happens after \a setVolume(),
+ * \a Resize() or when switching volumes. Upload is queued in \p stream, so it is ordered with the launches reading it
+ * even on non-blocking streams, and other streams binding the same descriptor wait for it. Bound descriptors are
+ * tracked per device and guarded by a mutex, so threads and devices may bind concurrently. Only a single volume can
+ * be bound per device at a time, volumes must not be switched while kernels of another one are in flight.
+ */
+template<unsigned char _bins, typename _voxel>
+void bindFusion(const fusionData<_bins, Device, _voxel> & f, cudaStream_t stream)
+{
+    static_assert(sizeof(fusionData<_bins, Device, _voxel>) <= FUSION_DESCRIPTOR_BYTES, "fusionData exceeds descriptor size");
+    static const char type = 0;
+    int device = 0;
+    CHECK_CUDA_ERRORS_AUTO(cudaGetDevice(&device));
+
+    // Upload and cache update are one step, so no thread skips an upload another one has not finished
+    std::lock_guard<std::mutex> lock(h_fusionMutex);
+    BoundFusion & bound = h_fusion[device];
+    if (!bound.uploaded) CHECK_CUDA_ERRORS_AUTO(cudaEventCreateWithFlags(&bound.uploaded, cudaEventDisableTiming));
+    if ((bound.type == &type) && (memcmp(bound.bytes, &f, sizeof(f)) == 0)) {
+        CHECK_CUDA_ERRORS_AUTO(cudaStreamWaitEvent(stream, bound.uploaded, 0));
+        return;
+    }
+
+    // Pageable source is staged before the call returns, so the host copy may change right after it
+    CHECK_CUDA_ERRORS_AUTO(cudaMemcpyToSymbolAsync(c_fusion, &f, sizeof(f), 0, cudaMemcpyHostToDevice, stream));
+    CHECK_CUDA_ERRORS_AUTO(cudaEventRecord(bound.uploaded, stream));
+    memcpy(bound.bytes, &f, sizeof(f));
+    bound.type = &type;
+}
+
+void FusionForgetBindings()
+{
+    std::lock_guard<std::mutex> lock(h_fusionMutex);
+    h_fusion.clear();
+}
+
+/**
+ *  \brief Project world point into depthmap and interpolate depthmap at its pixel coordinates
+ *
+ *  \param w         world coordinates
+ *  \param depthmap  pointer to depthmap data
+ *  \param K         3x3 camera calibration matrix
+ *  \param R         3x3 rotation matrix from world to camera coordinates
+ *  \param T         translation vector from world to camera position
+ *  \param width     width of depthmap
+ *  \param height    height of depthmap
+ *  \param voxdepth  depth of the point in camera coordinates returned by reference
+ *  \param depth     interpolated depthmap value returned by reference
+ *  \return False if the point projects outside of the depthmap or next to a \a QNAN pixel
+ */
+__device__ inline
+bool projectToDepthmap(float3 w, const float * __restrict__ depthmap, const Matrix3D & K, const Matrix3D & R, const Vector3D & T,
+                       const int width, const int height, float & voxdepth, float & depth)
+{
+    // Transform world coordinates to camera coordinates
+    float3 c = R * w + T;
+
+    // Transform camera coordinates to homogeneous pixel coordinates
+    c = K * c; // c.z - voxel depth in camera coordinates
+    float2 px = make_float2(c / c.z);
+
+    // Check if pixel coordinates fall inside image range
+    if ((px.x < 0) || (px.x > width-1) || (px.y < 0) || (px.y > height-1)) return false;
+
+    // Get int pixel coords
+    int2 pxc = make_int2(fmaxf(floorf(px.x), 0), fmaxf(floorf(px.y), 0));
+    int2 pxc1 = make_int2(fminf(pxc.x+1, width-1), fminf(pxc.y+1, height-1));
+
+    // Get fractions
+    float2 frac = fracf(px);
+
+    // Read image values for bilinterp
+    float2 y0 = make_float2(depthmap[pxc.x+pxc.y*width], depthmap[pxc1.x+pxc.y*width]); // values at (x,y) and (x+1,y)
+    float2 y1 = make_float2(depthmap[pxc.x+pxc1.y*width], depthmap[pxc1.x+pxc1.y*width]); // values at (x,y+1) and (x+1,y+1)
+
+    // Interpolate voxel depth, QNANs of masked pixels propagate to the interpolated depth
+    depth = bilinterp(y0, y1, frac);
+    voxdepth = c.z;
+    return isfinite(depth);
+}
+
+/**
+ *  \brief Project single voxel into depthmap and update its histogram
+ *
+ *  \param f         fusionData containing histogram
+ *  \param i         voxel indexes, have to be inside the volume
+ *  \param depthmap  pointer to depthmap data
+ *  \param K         3x3 camera calibration matrix
+ *  \param R         3x3 rotation matrix from world to camera coordinates
+ *  \param T         translation vector from world to camera position
+ *  \param threshold signed distance value threshold
+ *  \param width     width of depthmap
+ *  \param height    height of depthmap
+ *  \return No return value
+ */
+template<unsigned char _bins, typename _voxel>
+__device__ inline
+void updateVoxelHistogram(fusionData<_bins, Device, _voxel> & f, int3 i, const float * __restrict__ depthmap, const Matrix3D & K,
+                          const Matrix3D & R, const Vector3D & T, const float threshold, const int width, const int height)
+{
+    float voxdepth, depth;
+    if (projectToDepthmap(f.worldCoords(i.x, i.y, i.z), depthmap, K, R, T, width, height, voxdepth, depth))
+        f.updateHist(i.x, i.y, i.z, voxdepth, depth, threshold);
+}
+
+template<unsigned char _bins, typename _voxel>
+__global__ void FusionUpdateHistogram_kernel(const float * __restrict__ depthmap, const Matrix3D K,
                                              const Matrix3D R, const Vector3D T, const float threshold, const int width, const int height)
 {
+    fusionData<_bins, Device, _voxel> & f = fusionDescriptor<_bins, _voxel>();
     int3 i = f.indexes(getGlobalIdx());
 
     if ((i.x < f.width()) && (i.y < f.height()) && (i.z < f.depth()))
-    {
-        // Get world coordinates of the voxel
-        float3 c = f.worldCoords(i.x, i.y, i.z);
+        updateVoxelHistogram(f, i, depthmap, K, R, T, threshold, width, height);
+}
 
-        // Transform world coordinates to camera coordinates
-        c = R * c + T;
+template<unsigned char _bins, typename _voxel>
+__global__ void FusionUpdateHistogramBatch_kernel(const fusionViews views, const float threshold,
+                                                  const int width, const int height)
+{
+    fusionData<_bins, Device, _voxel> & f = fusionDescriptor<_bins, _voxel>();
+    int3 i = f.indexes(getGlobalIdx());
 
-        // Transform camera coordinates to homogeneous pixel coordinates
-        c = K * c; // c.z - voxel depth in camera coordinates
-        float2 px = make_float2(c / c.z);
+    if ((i.x < f.width()) && (i.y < f.height()) && (i.z < f.depth()))
+    {
+        // Histogram is read and written once for all views
+        typename fusionData<_bins, Device, _voxel>::hist_type h = f.h(i.x, i.y, i.z);
+        const float3 w = f.worldCoords(i.x, i.y, i.z);
+        float voxdepth, depth;
+        for (int v = 0; v < views.n; v++)
+            if (projectToDepthmap(w, views.depthmap[v], views.K[v], views.R[v], views.T[v], width, height, voxdepth, depth))
+                f.updateHist(h, voxdepth, depth, threshold);
+        f.h(i.x, i.y, i.z) = h;
+    }
+}
 
-        // Check if pixel coordinates fall inside image range
-        if ((px.x < 0) || (px.x > width-1) || (px.y < 0) || (px.y > height-1)) return;
+template<unsigned char _bins, typename _voxel>
+__global__ void FusionCullBricks_kernel(const Matrix3D K, const Matrix3D R, const Vector3D T,
+                                        const float znear, const float zfar, const int width, const int height,
+                                        const int3 lo, const int3 nb, int * list)
+{
+    fusionData<_bins, Device, _voxel> & f = fusionDescriptor<_bins, _voxel>();
+    const int ix = blockIdx.x * blockDim.x + threadIdx.x;
+    if (ix >= nb.x * nb.y * nb.z) return;
 
-        // Get int pixel coords
-        int2 pxc = make_int2(fmaxf(floorf(px.x), 0), fmaxf(floorf(px.y), 0));
-        int2 pxc1 = make_int2(fminf(pxc.x+1, width-1), fminf(pxc.y+1, height-1));
+    // Brick coordinates and its first and last voxel
+    const int3 b = make_int3(lo.x + ix % nb.x, lo.y + ix / nb.x % nb.y, lo.z + ix / (nb.x * nb.y));
+    const int3 v0 = b * FUSION_CULL_BRICK_SIZE;
+    const int3 v1 = make_int3(min(v0.x + FUSION_CULL_BRICK_SIZE, (int)f.width()) - 1, min(v0.y + FUSION_CULL_BRICK_SIZE, (int)f.height()) - 1,
+                              min(v0.z + FUSION_CULL_BRICK_SIZE, (int)f.depth()) - 1);
 
-        // Get fractions
-        float2 frac = fracf(px);
+    // Project voxel centers at brick corners, keep brick if any part may be visible
+    float zmin = FLT_MAX, zmax = -FLT_MAX;
+    float2 pmin = make_float2(FLT_MAX, FLT_MAX), pmax = make_float2(-FLT_MAX, -FLT_MAX);
+    bool behind = false;
+    for (int k = 0; k < 8; k++) {
+        float3 c = R * f.worldCoords((k & 1) ? v1.x : v0.x, (k & 2) ? v1.y : v0.y, (k & 4) ? v1.z : v0.z) + T;
+        zmin = fminf(zmin, c.z);
+        zmax = fmaxf(zmax, c.z);
+        if (c.z <= 0) {
+            behind = true;
+            continue;
+        }
+        c = K * c;
+        const float2 px = make_float2(c / c.z);
+        pmin = fminf(pmin, px);
+        pmax = fmaxf(pmax, px);
+    }
+    if ((zmax < znear) || (zmin > zfar)) return;
+    if (!behind && ((pmax.x < 0) || (pmin.x > width - 1) || (pmax.y < 0) || (pmin.y > height - 1))) return;
 
-        // Read image values for bilinterp
-        float2 y0 = make_float2(depthmap[pxc.x+pxc.y*width], depthmap[pxc1.x+pxc.y*width]); // values at (x,y) and (x+1,y)
-        float2 y1 = make_float2(depthmap[pxc.x+pxc1.y*width], depthmap[pxc1.x+pxc1.y*width]); // values at (x,y+1) and (x+1,y+1)
+    // Store brick index in the volume brick grid
+    const int gx = (f.width() + FUSION_CULL_BRICK_SIZE - 1) / FUSION_CULL_BRICK_SIZE;
+    const int gy = (f.height() + FUSION_CULL_BRICK_SIZE - 1) / FUSION_CULL_BRICK_SIZE;
+    list[1 + atomicAdd(list, 1)] = b.x + b.y * gx + b.z * gx * gy;
+}
 
-        // Interpolate voxel depth
-        float depth = bilinterp(y0, y1, frac);
+template<unsigned char _bins, typename _voxel>
+__global__ void FusionUpdateHistogramBricks_kernel(const float * __restrict__ depthmap,
+                                                   const Matrix3D K, const Matrix3D R, const Vector3D T, const float threshold,
+                                                   const int width, const int height, const int * __restrict__ list)
+{
+    fusionData<_bins, Device, _voxel> & f = fusionDescriptor<_bins, _voxel>();
+    // One block per listed brick, one thread per voxel of the brick
+    if ((int)blockIdx.x >= list[0]) return;
+    const int gx = (f.width() + FUSION_CULL_BRICK_SIZE - 1) / FUSION_CULL_BRICK_SIZE;
+    const int gy = (f.height() + FUSION_CULL_BRICK_SIZE - 1) / FUSION_CULL_BRICK_SIZE;
+    const int bi = list[1 + blockIdx.x];
+    const int3 i = make_int3(bi % gx, bi / gx % gy, bi / (gx * gy)) * FUSION_CULL_BRICK_SIZE +
+                   make_int3(threadIdx.x % FUSION_CULL_BRICK_SIZE, threadIdx.x / FUSION_CULL_BRICK_SIZE % FUSION_CULL_BRICK_SIZE,
+                             threadIdx.x / (FUSION_CULL_BRICK_SIZE * FUSION_CULL_BRICK_SIZE));
 
-        // Update histogram
-        f.updateHist(i.x, i.y, i.z, c.z, depth, threshold);
-    }
+    if ((i.x < f.width()) && (i.y < f.height()) && (i.z < f.depth()))
+        updateVoxelHistogram(f, i, depthmap, K, R, T, threshold, width, height);
 }
 
-template<unsigned char _bins>
-__global__ void FusionUpdateU_kernel(fusionData<_bins> f, const double tau, const double lambda)
+template<unsigned char _bins, typename _voxel>
+__global__ void FusionUpdateU_kernel(const double tau, const double lambda)
 {
+    fusionData<_bins, Device, _voxel> & f = fusionDescriptor<_bins, _voxel>();
     int3 i = f.indexes(getGlobalIdx());
 	
     if ((i.x < f.width()) && (i.y < f.height()) && (i.z < f.depth()))
@@ -56,9 +253,10 @@ __global__ void FusionUpdateU_kernel(fusionData<_bins> f, const double tau, cons
     }
 }
 
-template<unsigned char _bins>
-__global__ void FusionUpdateP_kernel(fusionData<_bins> f, const double sigma)
+template<unsigned char _bins, typename _voxel>
+__global__ void FusionUpdateP_kernel(const double sigma)
 {
+    fusionData<_bins, Device, _voxel> & f = fusionDescriptor<_bins, _voxel>();
     int3 i = f.indexes(getGlobalIdx());
 
     if ((i.x < f.width()) && (i.y < f.height()) && (i.z < f.depth()))
@@ -69,31 +267,797 @@ __global__ void FusionUpdateP_kernel(fusionData<_bins> f, const double sigma)
     }
 }
 
+// Tiled stencil kernels: each block holds a threads.x x threads.y tile of one z slice plus one voxel halo in shared
+// memory and marches FUSION_STENCIL_SLICES slices along z, z neighbours are kept in registers
+template<unsigned char _bins, typename _voxel>
+__global__ void FusionUpdateUTiled_kernel(const double tau, const double lambda)
+{
+    fusionData<_bins, Device, _voxel> & f = fusionDescriptor<_bins, _voxel>();
+    extern __shared__ float s_tile[];
+
+    const int tx = threadIdx.x, ty = threadIdx.y, bx = blockDim.x, by = blockDim.y;
+    const int x = blockIdx.x * bx + tx, y = blockIdx.y * by + ty;
+    const int w = f.width(), h = f.height(), d = f.depth();
+    const int z0 = blockIdx.z * FUSION_STENCIL_SLICES, z1 = min(z0 + FUSION_STENCIL_SLICES, d);
+    const bool inside = (x < w) && (y < h);
+
+    // p.x with -x halo column, p.y with -y halo row
+    float * s_px = s_tile;
+    float * s_py = s_tile + (bx + 1) * by;
+
+    float pz = (inside && (z0 > 0)) ? ((float3)f.p(x, y, z0 - 1)).z : 0.f;
+    for (int z = z0; z < z1; z++) {
+        float3 p = make_float3(0.f, 0.f, 0.f);
+        if (inside) p = f.p(x, y, z);
+        s_px[ty * (bx + 1) + tx + 1] = p.x;
+        s_py[(ty + 1) * bx + tx] = p.y;
+        if ((tx == 0) && (x > 0) && (y < h)) s_px[ty * (bx + 1)] = ((float3)f.p(x - 1, y, z)).x;
+        if ((ty == 0) && (y > 0) && (x < w)) s_py[tx] = ((float3)f.p(x, y - 1, z)).y;
+        __syncthreads();
+
+        if (inside) {
+            float div = p.x + p.y + p.z;
+            if (x > 0) div -= s_px[ty * (bx + 1) + tx];
+            if (y > 0) div -= s_py[ty * bx + tx];
+            if (z > 0) div -= pz;
+
+            const double un = f.u(x, y, z);
+            const float u = f.proxHist(un + tau * div, x, y, z, tau, lambda);
+            f.u(x, y, z) = u;
+            f.v(x, y, z) = 2 * u - un;
+        }
+        pz = p.z;
+        __syncthreads();
+    }
+}
+
+template<unsigned char _bins, typename _voxel>
+__global__ void FusionUpdatePTiled_kernel(const double sigma)
+{
+    fusionData<_bins, Device, _voxel> & f = fusionDescriptor<_bins, _voxel>();
+    extern __shared__ float s_tile[];
+
+    const int tx = threadIdx.x, ty = threadIdx.y, bx = blockDim.x, by = blockDim.y;
+    const int x = blockIdx.x * bx + tx, y = blockIdx.y * by + ty;
+    const int w = f.width(), h = f.height(), d = f.depth();
+    const int z0 = blockIdx.z * FUSION_STENCIL_SLICES, z1 = min(z0 + FUSION_STENCIL_SLICES, d);
+    const bool inside = (x < w) && (y < h);
+    const int s = ty * (bx + 1) + tx; // v with +x halo column and +y halo row
+
+    float vn = (inside && (z0 < d)) ? (float)f.v(x, y, z0) : 0.f;
+    for (int z = z0; z < z1; z++) {
+        const float v = vn;
+        s_tile[s] = v;
+        if ((tx == bx - 1) && (x + 1 < w) && (y < h)) s_tile[s + 1] = f.v(x + 1, y, z);
+        if ((ty == by - 1) && (y + 1 < h) && (x < w)) s_tile[s + bx + 1] = f.v(x, y + 1, z);
+        vn = (inside && (z + 1 < d)) ? (float)f.v(x, y, z + 1) : 0.f;
+        __syncthreads();
+
+        if (inside) {
+            float3 g = make_float3(0.f, 0.f, 0.f);
+            if (x < w - 1) g.x = s_tile[s + 1] - v;
+            if (y < h - 1) g.y = s_tile[s + bx + 1] - v;
+            if (z < d - 1) g.z = vn - v;
+            const float3 p = f.p(x, y, z);
+            f.p(x, y, z) = f.projectUnitBall(p + (float)sigma * g);
+        }
+        __syncthreads();
+    }
+}
+
+/**
+ *  \brief Read solver state \f$(u, p)\f$ of voxel from fusion data or scratch arrays
+ *
+ *  \param f       fusion data
+ *  \param su      scratch \f$u\f$
+ *  \param sp      scratch \f$p\f$
+ *  \param x       voxel x index
+ *  \param y       voxel y index
+ *  \param z       voxel z index
+ *  \param i       linear voxel index
+ *  \param u       \f$u\f$ returned by reference
+ *  \param p       \f$p\f$ returned by reference
+ *  \return No return value
+ */
+template<bool _scratch, unsigned char _bins, typename _voxel>
+__device__ inline
+void readState(fusionData<_bins, Device, _voxel> & f, const float * su, const float3 * sp, int x, int y, int z, size_t i,
+               float & u, float3 & p)
+{
+    if (_scratch) {
+        u = su[i];
+        p = sp[i];
+    }
+    else {
+        u = f.u(x, y, z);
+        p = f.p(x, y, z);
+    }
+}
+
+template<unsigned char _bins, typename _voxel, bool _intoVolume>
+__global__ void FusionUpdateFused_kernel(float * __restrict__ su, float3 * __restrict__ sp,
+                                         const double tau, const double lambda, const double sigma)
+{
+    fusionData<_bins, Device, _voxel> & f = fusionDescriptor<_bins, _voxel>();
+    extern __shared__ float s_tile[];
+
+    // Block covers the tile plus one voxel halo on each side in x and y. u is updated on the tile and +x / +y halo,
+    // p on the tile one slice behind, so v of both neighbours is known. State is read from one buffer and written to
+    // the other, so halo reads never see values of the same launch.
+    const int pitch = blockDim.x, s = threadIdx.y * pitch + threadIdx.x;
+    const int tw = blockDim.x - 2, th = blockDim.y - 2;
+    const int lx = threadIdx.x - 1, ly = threadIdx.y - 1;
+    const int x = blockIdx.x * tw + lx, y = blockIdx.y * th + ly;
+    const int w = f.width(), h = f.height(), d = f.depth();
+    const int z0 = blockIdx.z * FUSION_STENCIL_SLICES, zend = min(z0 + FUSION_STENCIL_SLICES, d);
+    const bool valid = (x >= 0) && (y >= 0) && (x < w) && (y < h);
+    const bool solveU = valid && (lx >= 0) && (ly >= 0);
+    const bool solveP = solveU && (lx < tw) && (ly < th);
+    const size_t slice = (size_t)w * h, i0 = valid ? x + (size_t)y * w : 0;
+
+    const int n = blockDim.x * blockDim.y;
+    float * s_px = s_tile, * s_py = s_tile + n, * s_vp = s_tile + 2 * n, * s_vc = s_tile + 3 * n;
+
+    float un, vprev = 0.f, pz = 0.f;
+    float3 p, pprev = make_float3(0.f, 0.f, 0.f);
+    if (solveU && (z0 > 0)) {
+        readState<_intoVolume>(f, su, sp, x, y, z0 - 1, i0 + (z0 - 1) * slice, un, p);
+        pz = p.z;
+    }
+
+    // Slice zend only feeds v to p update of slice zend - 1
+    for (int z = z0; z <= zend; z++) {
+        const bool slab = z < d;
+        un = 0.f;
+        p = make_float3(0.f, 0.f, 0.f);
+        if (slab && valid) readState<_intoVolume>(f, su, sp, x, y, z, i0 + z * slice, un, p);
+        s_px[s] = p.x;
+        s_py[s] = p.y;
+        __syncthreads();
+
+        float vcur = 0.f;
+        if (slab && solveU) {
+            float div = p.x + p.y + p.z;
+            if (x > 0) div -= s_px[s - 1];
+            if (y > 0) div -= s_py[s - pitch];
+            if (z > 0) div -= pz;
+            const float u = f.proxHist(un + tau * div, x, y, z, tau, lambda);
+            vcur = 2 * u - un;
+            if (solveP && (z < zend)) {
+                if (_intoVolume) {
+                    f.u(x, y, z) = u;
+                    f.v(x, y, z) = vcur;
+                }
+                else su[i0 + z * slice] = u;
+            }
+        }
+        s_vc[s] = vcur;
+        __syncthreads();
+
+        if (solveP && (z > z0)) {
+            float3 g = make_float3(0.f, 0.f, 0.f);
+            if (x < w - 1) g.x = s_vp[s + 1] - vprev;
+            if (y < h - 1) g.y = s_vp[s + pitch] - vprev;
+            if (z - 1 < d - 1) g.z = vcur - vprev;
+            const float3 pn = f.projectUnitBall(pprev + (float)sigma * g);
+            if (_intoVolume) f.p(x, y, z - 1) = pn;
+            else sp[i0 + (z - 1) * slice] = pn;
+        }
+
+        float * t = s_vp;
+        s_vp = s_vc;
+        s_vc = t;
+        vprev = vcur;
+        pprev = p;
+        pz = p.z;
+        __syncthreads();
+    }
+}
+
+/**
+ *  \brief Get grid dimensions of tiled stencil kernels
+ *
+ *  \param f       fusion data
+ *  \param threads single block dimensions, only x and y are used
+ *  \return Grid dimensions
+ */
+template<unsigned char _bins, typename _voxel>
+inline dim3 stencilBlocks(fusionData<_bins, Device, _voxel> & f, dim3 threads)
+{
+    return dim3((f.width() + threads.x - 1) / threads.x, (f.height() + threads.y - 1) / threads.y,
+                (f.depth() + FUSION_STENCIL_SLICES - 1) / FUSION_STENCIL_SLICES);
+}
+
+template<unsigned char _bins, typename _voxel>
+__global__ void FusionResidual_kernel(float * __restrict__ d_sums)
+{
+    fusionData<_bins, Device, _voxel> & f = fusionDescriptor<_bins, _voxel>();
+    extern __shared__ float s_sums[];
+
+    const int tid = (threadIdx.z * blockDim.y + threadIdx.y) * blockDim.x + threadIdx.x;
+    const int n = blockDim.x * blockDim.y * blockDim.z;
+    int3 i = f.indexes(getGlobalIdx());
+
+    // After u update v = 2 u - u_prev, so u - u_prev = v - u
+    float diff = 0.f, norm = 0.f;
+    if ((i.x < f.width()) && (i.y < f.height()) && (i.z < f.depth())) {
+        const float u = f.u(i.x, i.y, i.z);
+        const float d = f.v(i.x, i.y, i.z) - u;
+        diff = d * d;
+        norm = u * u;
+    }
+    s_sums[tid] = diff;
+    s_sums[n + tid] = norm;
+
+    __syncthreads();
+
+    // tree reduction over block, block size does not have to be a power of 2
+    for (int stride = 1; stride < n; stride *= 2) {
+        if ((tid % (2 * stride) == 0) && (tid + stride < n)) {
+            s_sums[tid] += s_sums[tid + stride];
+            s_sums[n + tid] += s_sums[n + tid + stride];
+        }
+        __syncthreads();
+    }
+
+    if (tid == 0) {
+        atomicAdd(d_sums, s_sums[0]);
+        atomicAdd(d_sums + 1, s_sums[n]);
+    }
+}
+
+template<unsigned char _bins, typename _voxel>
+__global__ void FusionExtractSurface_kernel(fusionPoint * __restrict__ points,
+                                            const unsigned int capacity, unsigned int * __restrict__ d_count,
+                                            const unsigned int * __restrict__ colormap)
+{
+    fusionData<_bins, Device, _voxel> & f = fusionDescriptor<_bins, _voxel>();
+    __shared__ unsigned int s_count, s_first;
+
+    const int tid = (threadIdx.z * blockDim.y + threadIdx.y) * blockDim.x + threadIdx.x;
+    int3 i = f.indexes(getGlobalIdx());
+
+    if (tid == 0) s_count = 0;
+    __syncthreads();
+
+    // Reserve slot within block, then one global atomic per block
+    bool surface = false;
+    unsigned int local = 0;
+    if ((i.x < f.width()) && (i.y < f.height()) && (i.z < f.depth())) {
+        const float u = f.u(i.x, i.y, i.z);
+        surface = (u < 0) && (u > -1);
+        if (surface) local = atomicAdd(&s_count, 1u);
+    }
+    __syncthreads();
+
+    if ((tid == 0) && (s_count > 0)) s_first = atomicAdd(d_count, s_count);
+    __syncthreads();
+
+    if (surface && (s_first + local < capacity)) {
+        const float3 c = f.worldCoords(i.x, i.y, i.z);
+        fusionPoint pt;
+        pt.x = c.x;
+        pt.y = c.y;
+        pt.z = c.z;
+        pt.rgba = colormap[min(255, max(0, (int)(255 * (c.x - f.volume().a.x) / f.volume().size().x)))];
+        points[s_first + local] = pt;
+    }
+}
+
+/**
+ *  \brief Mix bits of a voxel index for summed set signatures
+ *
+ *  \param i linear voxel index
+ *  \return MurmurHash3 32 bit finalizer of \p i
+ *
+ *  \details Sums of linear functions of the indexes collide for many different sets, e.g. any two sets with the same
+ * index sum, mixed values do not
+ */
+__device__ inline
+unsigned int mixIndex(unsigned int i)
+{
+    i ^= i >> 16;
+    i *= 0x85ebca6bu;
+    i ^= i >> 13;
+    i *= 0xc2b2ae35u;
+    i ^= i >> 16;
+    return i;
+}
+
+template<unsigned char _bins, typename _voxel>
+__global__ void FusionDecimateSurface_kernel(fusionPoint * __restrict__ cells, uint2 * __restrict__ signatures,
+                                             const int cell, const int3 grid, const int3 blocksgrid, const int block,
+                                             const unsigned int * __restrict__ colormap)
+{
+    fusionData<_bins, Device, _voxel> & f = fusionDescriptor<_bins, _voxel>();
+
+    const int3 c = make_int3(threadIdx.x + blockDim.x * blockIdx.x,
+                             threadIdx.y + blockDim.y * blockIdx.y,
+                             threadIdx.z + blockDim.z * blockIdx.z);
+    if ((c.x >= grid.x) || (c.y >= grid.y) || (c.z >= grid.z)) return;
+
+    // Average surface voxels of the cell, hash of their indexes identifies the set for change detection
+    float3 sum = make_float3(0.f);
+    unsigned int n = 0, hash = 0;
+    const int xe = min((c.x + 1) * cell, f.width()), ye = min((c.y + 1) * cell, f.height()),
+              ze = min((c.z + 1) * cell, f.depth());
+    for (int z = c.z * cell; z < ze; z++)
+        for (int y = c.y * cell; y < ye; y++)
+            for (int x = c.x * cell; x < xe; x++) {
+                const float u = f.u(x, y, z);
+                if ((u < 0) && (u > -1)) {
+                    sum += f.worldCoords(x, y, z);
+                    hash += mixIndex((unsigned int)f.index(x, y, z));
+                    n++;
+                }
+            }
+
+    fusionPoint pt;
+    pt.x = pt.y = pt.z = 0.f;
+    pt.rgba = 0; // empty cell
+    if (n > 0) {
+        const float3 m = sum / (float)n;
+        pt.x = m.x;
+        pt.y = m.y;
+        pt.z = m.z;
+        pt.rgba = colormap[min(255, max(0, (int)(255 * (m.x - f.volume().a.x) / f.volume().size().x)))];
+
+        const int b = (c.z / block * blocksgrid.y + c.y / block) * blocksgrid.x + c.x / block;
+        atomicAdd(&signatures[b].x, 1u);
+        atomicAdd(&signatures[b].y, hash);
+    }
+    cells[(c.z * grid.y + c.y) * grid.x + c.x] = pt;
+}
+
+__global__ void FusionGatherCells_kernel(fusionPoint * __restrict__ points, unsigned int * __restrict__ cursors,
+                                         const fusionPoint * __restrict__ cells, const int * __restrict__ offsets,
+                                         const int3 grid, const int3 blocksgrid, const int block)
+{
+    const int3 c = make_int3(threadIdx.x + blockDim.x * blockIdx.x,
+                             threadIdx.y + blockDim.y * blockIdx.y,
+                             threadIdx.z + blockDim.z * blockIdx.z);
+    if ((c.x >= grid.x) || (c.y >= grid.y) || (c.z >= grid.z)) return;
+
+    const fusionPoint pt = cells[(c.z * grid.y + c.y) * grid.x + c.x];
+    const int b = (c.z / block * blocksgrid.y + c.y / block) * blocksgrid.x + c.x / block;
+    if ((pt.rgba != 0) && (offsets[b] >= 0)) points[offsets[b] + atomicAdd(&cursors[b], 1u)] = pt;
+}
+
 template<unsigned char _bins>
-void FusionUpdateU(fusionData<_bins> f, const double tau, const double lambda, dim3 blocks, dim3 threads)
+void FusionUpdateU(fusionData<_bins> f, const double tau, const double lambda, dim3 blocks, dim3 threads, cudaStream_t stream)
 {
-    FusionUpdateU_kernel<_bins><<<blocks, threads>>>(f, tau, lambda);
+    bindFusion(f, stream);
+    FusionUpdateU_kernel<_bins, fusionvoxel<_bins>><<<blocks, threads, 0, stream>>>(tau, lambda);
 }
 
 template<unsigned char _bins>
-void FusionUpdateP(fusionData<_bins> f, const double sigma, dim3 blocks, dim3 threads)
+void FusionUpdateP(fusionData<_bins> f, const double sigma, dim3 blocks, dim3 threads, cudaStream_t stream)
+{
+    bindFusion(f, stream);
+    FusionUpdateP_kernel<_bins, fusionvoxel<_bins>><<<blocks, threads, 0, stream>>>(sigma);
+}
+
+template<unsigned char _bins, typename _voxel>
+void FusionUpdateUTiled(fusionData<_bins, Device, _voxel> f, const double tau, const double lambda, dim3 threads,
+                        cudaStream_t stream)
 {
-    FusionUpdateP_kernel<_bins><<<blocks, threads>>>(f, sigma);
+    bindFusion(f, stream);
+    threads.z = 1;
+    const size_t shared = ((threads.x + 1) * threads.y + threads.x * (threads.y + 1)) * sizeof(float);
+    FusionUpdateUTiled_kernel<_bins, _voxel><<<stencilBlocks(f, threads), threads, shared, stream>>>(tau, lambda);
+}
+
+template<unsigned char _bins, typename _voxel>
+void FusionUpdatePTiled(fusionData<_bins, Device, _voxel> f, const double sigma, dim3 threads, cudaStream_t stream)
+{
+    bindFusion(f, stream);
+    threads.z = 1;
+    const size_t shared = (threads.x + 1) * (threads.y + 1) * sizeof(float);
+    FusionUpdatePTiled_kernel<_bins, _voxel><<<stencilBlocks(f, threads), threads, shared, stream>>>(sigma);
+}
+
+template<unsigned char _bins, typename _voxel>
+void FusionSolveFused(fusionData<_bins, Device, _voxel> f, float * su, float3 * sp, unsigned int iterations,
+                      const double tau, const double lambda, const double sigma, dim3 threads, cudaStream_t stream)
+{
+    NVTX_RANGE_INDEX("fusion solve", NvtxFusion, iterations);
+    bindFusion(f, stream);
+    threads.z = 1;
+
+    // Fused launches come in pairs, volume to scratch and back
+    if (iterations % 2) {
+        FusionUpdateUTiled<_bins, _voxel>(f, tau, lambda, threads, stream);
+        FusionUpdatePTiled<_bins, _voxel>(f, sigma, threads, stream);
+        iterations--;
+    }
+
+    // Blocks carry a one voxel halo, shrink the tile until it fits the thread limit of the kernel
+    cudaFuncAttributes attr;
+    CHECK_CUDA_ERRORS_AUTO(cudaFuncGetAttributes(&attr, FusionUpdateFused_kernel<_bins, _voxel, false>));
+    while (((threads.x + 2) * (threads.y + 2) > (unsigned int)attr.maxThreadsPerBlock) && ((threads.x > 1) || (threads.y > 1))) {
+        if (threads.x >= threads.y) threads.x = (threads.x + 1) / 2;
+        else threads.y = (threads.y + 1) / 2;
+    }
+
+    const dim3 t(threads.x + 2, threads.y + 2), b = stencilBlocks(f, threads);
+    const size_t shared = 4 * t.x * t.y * sizeof(float);
+    for (unsigned int i = 0; i < iterations; i += 2) {
+        FusionUpdateFused_kernel<_bins, _voxel, false><<<b, t, shared, stream>>>(su, sp, tau, lambda, sigma);
+        FusionUpdateFused_kernel<_bins, _voxel, true><<<b, t, shared, stream>>>(su, sp, tau, lambda, sigma);
+    }
 }
 
 template<unsigned char _bins>
 void FusionUpdateHistogram(fusionData<_bins> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
-                           const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads)
+                           const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads,
+                           cudaStream_t stream)
 {
-    FusionUpdateHistogram_kernel<_bins><<<blocks, threads>>>(f, depthmap, K, R, t, threshold, width, height);
+    NVTX_RANGE("fusion integrate", NvtxFusion);
+
+    // Specialized kernel addresses fusionvoxel records directly, so it needs no bound descriptor
+    if (f.layout() == ArrayOfStructs) {
+        const Rectangle3D vol = f.volume();
+        if (KernelJit::instance().fusionHistogram(f.voxelPtr(), f.pitch(), f.slicePitch(), sizeof(fusionvoxel<_bins>),
+                                                  offsetof(fusionvoxel<_bins>, h), _bins,
+                                                  make_int3(f.width(), f.height(), f.depth()), vol.a, vol.size(),
+                                                  depthmap, K, R, t, threshold, width, height, blocks, threads, stream))
+            return;
+    }
+    bindFusion(f, stream);
+    FusionUpdateHistogram_kernel<_bins, fusionvoxel<_bins>><<<blocks, threads, 0, stream>>>(depthmap, K, R, t, threshold, width, height);
 }
 
-template<unsigned char _bins> inline
-void FusionUpdateIteration(fusionData<_bins> f, const float * depthmap, const Matrix3D K, const Matrix3D R, const Vector3D t,
+template<unsigned char _bins, typename _voxel> inline
+void FusionUpdateIteration(fusionData<_bins, Device, _voxel> f, const float * depthmap, const Matrix3D K, const Matrix3D R, const Vector3D t,
                            const float threshold, const double tau, const double lambda, const double sigma,
-                           const int width, const int height, dim3 blocks, dim3 threads)
+                           const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream)
+{
+    bindFusion(f, stream);
+    {
+        NVTX_RANGE("fusion integrate", NvtxFusion);
+        FusionUpdateHistogram_kernel<_bins, _voxel><<<blocks, threads, 0, stream>>>(depthmap, K, R, t, threshold, width, height);
+    }
+    NVTX_RANGE("fusion solve", NvtxFusion);
+    FusionUpdateUTiled<_bins, _voxel>(f, tau, lambda, threads, stream);
+    FusionUpdatePTiled<_bins, _voxel>(f, sigma, threads, stream);
+}
+
+// Sparse voxel block hashing kernels:
+// block kernels run one thread block of FUSION_HASH_BLOCK_VOXELS threads per allocated voxel block
+template<unsigned char _bins>
+__global__ void FusionHashAllocate_kernel(fusionHashData<_bins> f, const float * __restrict__ depthmap, const Matrix3D Kinv,
+                                          const Matrix3D Rt, const Vector3D T, const float threshold, const int width, const int height)
+{
+    const int x = blockIdx.x * blockDim.x + threadIdx.x;
+    const int y = blockIdx.y * blockDim.y + threadIdx.y;
+
+    if ((x >= width) || (y >= height)) return;
+
+    const float d = depthmap[x + y * width];
+    if (!isfinite(d) || (d <= 0)) return;
+
+    // Viewing ray with unit depth
+    const float3 dir = Kinv * make_float3(x, y, 1.f);
+
+    // Step along the truncation band with half of the smallest voxel side
+    const Rectangle3D vol = f.volume();
+    const float3 dims = make_float3(f.width(), f.height(), f.depth());
+    const float3 vs = vol.size() / dims;
+    const float dz = 0.5f * fminf(vs.x, fminf(vs.y, vs.z)) / length(dir);
+
+    int3 last = make_int3(-1, -1, -1);
+    for (float z = fmaxf(d - threshold, dz); z <= d + threshold; z += dz){
+        // Transform camera coordinates to world coordinates and voxel indexes
+        const float3 w = Rt * (z * dir - (float3)T);
+        const float3 v = (w - vol.a) / vs;
+        if ((v.x < 0) || (v.y < 0) || (v.z < 0) || (v.x >= dims.x) || (v.y >= dims.y) || (v.z >= dims.z)) continue;
+
+        const int3 b = f.blockOf((int)v.x, (int)v.y, (int)v.z);
+        if ((b.x == last.x) && (b.y == last.y) && (b.z == last.z)) continue;
+        f.insert(b);
+        last = b;
+    }
+}
+
+template<unsigned char _bins>
+__global__ void FusionHashInit_kernel(fusionHashData<_bins> f)
+{
+    const int b = blockIdx.x;
+    const int * count = f.counter();
+    if ((b < count[1]) || (b >= min(count[0], (int)f.capacity()))) return;
+
+    f.voxel(b, threadIdx.x) = fusionvoxel<_bins>();
+}
+
+/**
+ *  \brief Get volume indexes of voxel handled by current thread
+ *
+ *  \param f fusionHashData holding the block
+ *  \param b index of block in block pool
+ *  \return Voxel indexes in volume
+ */
+template<unsigned char _bins>
+__device__ inline
+int3 hashVoxelIndexes(fusionHashData<_bins> & f, int b)
+{
+    const int3 bc = f.blockCoords(b);
+    return make_int3(bc.x * FUSION_HASH_BLOCK_SIZE + threadIdx.x % FUSION_HASH_BLOCK_SIZE,
+                     bc.y * FUSION_HASH_BLOCK_SIZE + threadIdx.x / FUSION_HASH_BLOCK_SIZE % FUSION_HASH_BLOCK_SIZE,
+                     bc.z * FUSION_HASH_BLOCK_SIZE + threadIdx.x / (FUSION_HASH_BLOCK_SIZE * FUSION_HASH_BLOCK_SIZE));
+}
+
+template<unsigned char _bins>
+__global__ void FusionHashUpdateHistogram_kernel(fusionHashData<_bins> f, const float * __restrict__ depthmap, const Matrix3D K,
+                                                 const Matrix3D R, const Vector3D T, const float threshold, const int width, const int height)
+{
+    const int b = blockIdx.x;
+    if (b >= min(*f.counter(), (int)f.capacity())) return;
+
+    int3 i = hashVoxelIndexes(f, b);
+    if ((i.x >= f.width()) || (i.y >= f.height()) || (i.z >= f.depth())) return;
+
+    // Same projection as FusionUpdateHistogram_kernel
+    float3 c = R * f.worldCoords(i.x, i.y, i.z) + T;
+    c = K * c;
+    float2 px = make_float2(c / c.z);
+
+    if ((px.x < 0) || (px.x > width-1) || (px.y < 0) || (px.y > height-1)) return;
+
+    int2 pxc = make_int2(fmaxf(floorf(px.x), 0), fmaxf(floorf(px.y), 0));
+    int2 pxc1 = make_int2(fminf(pxc.x+1, width-1), fminf(pxc.y+1, height-1));
+    float2 frac = fracf(px);
+
+    float2 y0 = make_float2(depthmap[pxc.x+pxc.y*width], depthmap[pxc1.x+pxc.y*width]);
+    float2 y1 = make_float2(depthmap[pxc.x+pxc1.y*width], depthmap[pxc1.x+pxc1.y*width]);
+    float depth = bilinterp(y0, y1, frac);
+    if (!isfinite(depth)) return;
+
+    f.updateHist(f.voxel(b, threadIdx.x).h, c.z, depth, threshold);
+}
+
+template<unsigned char _bins>
+__global__ void FusionHashUpdateU_kernel(fusionHashData<_bins> f, const double tau, const double lambda)
+{
+    const int b = blockIdx.x;
+    if (b >= min(*f.counter(), (int)f.capacity())) return;
+
+    // Blocks holding backward neighbours in x, y and z
+    __shared__ int nb[3];
+    if (threadIdx.x < 3){
+        int3 bc = f.blockCoords(b);
+        if (threadIdx.x == 0) bc.x--;
+        if (threadIdx.x == 1) bc.y--;
+        if (threadIdx.x == 2) bc.z--;
+        nb[threadIdx.x] = f.find(bc);
+    }
+    __syncthreads();
+
+    int3 i = hashVoxelIndexes(f, b);
+    if ((i.x >= f.width()) || (i.y >= f.height()) || (i.z >= f.depth())) return;
+
+    const int l = threadIdx.x;
+    const int3 li = make_int3(l % FUSION_HASH_BLOCK_SIZE, l / FUSION_HASH_BLOCK_SIZE % FUSION_HASH_BLOCK_SIZE,
+                              l / (FUSION_HASH_BLOCK_SIZE * FUSION_HASH_BLOCK_SIZE));
+    const int sy = FUSION_HASH_BLOCK_SIZE, sz = FUSION_HASH_BLOCK_SIZE * FUSION_HASH_BLOCK_SIZE;
+
+    // Backward difference divergence, voxels of unallocated blocks are treated as border
+    fusionvoxel<_bins> & vox = f.voxel(b, l);
+    float3 p = vox.p;
+    float div = p.x + p.y + p.z;
+    if (li.x > 0) div -= f.voxel(b, l - 1).p.x;
+    else if (nb[0] >= 0) div -= f.voxel(nb[0], l + FUSION_HASH_BLOCK_SIZE - 1).p.x;
+    if (li.y > 0) div -= f.voxel(b, l - sy).p.y;
+    else if (nb[1] >= 0) div -= f.voxel(nb[1], l + sz - sy).p.y;
+    if (li.z > 0) div -= f.voxel(b, l - sz).p.z;
+    else if (nb[2] >= 0) div -= f.voxel(nb[2], l + FUSION_HASH_BLOCK_VOXELS - sz).p.z;
+
+    const double un = vox.u;
+    const double u = un - tau * (- div);
+    vox.u = f.proxHist(u, vox.h, tau, lambda);
+    vox.v = 2 * vox.u - un;
+}
+
+template<unsigned char _bins>
+__global__ void FusionHashUpdateP_kernel(fusionHashData<_bins> f, const double sigma)
+{
+    const int b = blockIdx.x;
+    if (b >= min(*f.counter(), (int)f.capacity())) return;
+
+    // Blocks holding forward neighbours in x, y and z
+    __shared__ int nb[3];
+    if (threadIdx.x < 3){
+        int3 bc = f.blockCoords(b);
+        if (threadIdx.x == 0) bc.x++;
+        if (threadIdx.x == 1) bc.y++;
+        if (threadIdx.x == 2) bc.z++;
+        nb[threadIdx.x] = f.find(bc);
+    }
+    __syncthreads();
+
+    int3 i = hashVoxelIndexes(f, b);
+    if ((i.x >= f.width()) || (i.y >= f.height()) || (i.z >= f.depth())) return;
+
+    const int l = threadIdx.x;
+    const int3 li = make_int3(l % FUSION_HASH_BLOCK_SIZE, l / FUSION_HASH_BLOCK_SIZE % FUSION_HASH_BLOCK_SIZE,
+                              l / (FUSION_HASH_BLOCK_SIZE * FUSION_HASH_BLOCK_SIZE));
+    const int sy = FUSION_HASH_BLOCK_SIZE, sz = FUSION_HASH_BLOCK_SIZE * FUSION_HASH_BLOCK_SIZE;
+    const int n = FUSION_HASH_BLOCK_SIZE - 1;
+
+    // Forward difference gradient, voxels of unallocated blocks are treated as border
+    fusionvoxel<_bins> & vox = f.voxel(b, l);
+    const float v = vox.v;
+    float3 g = make_float3(0.f, 0.f, 0.f);
+    if (i.x < f.width() - 1){
+        if (li.x < n) g.x = f.voxel(b, l + 1).v - v;
+        else if (nb[0] >= 0) g.x = f.voxel(nb[0], l - n).v - v;
+    }
+    if (i.y < f.height() - 1){
+        if (li.y < n) g.y = f.voxel(b, l + sy).v - v;
+        else if (nb[1] >= 0) g.y = f.voxel(nb[1], l - n * sy).v - v;
+    }
+    if (i.z < f.depth() - 1){
+        if (li.z < n) g.z = f.voxel(b, l + sz).v - v;
+        else if (nb[2] >= 0) g.z = f.voxel(nb[2], l - n * sz).v - v;
+    }
+
+    vox.p = f.projectUnitBall(vox.p + sigma * g);
+}
+
+template<unsigned char _bins>
+__global__ void FusionHashRestoreAllocate_kernel(fusionHashData<_bins> f, const int3 * __restrict__ coords, const int blocks)
+{
+    const int i = blockIdx.x * blockDim.x + threadIdx.x;
+    if (i < blocks) f.insert(coords[i]);
+}
+
+template<unsigned char _bins>
+__global__ void FusionHashRestoreVoxels_kernel(fusionHashData<_bins> f, const int3 * __restrict__ coords,
+                                               const fusionvoxel<_bins> * __restrict__ voxels)
+{
+    const int b = f.find(coords[blockIdx.x]);
+    if ((b < 0) || (b >= (int)f.capacity())) return;
+
+    f.voxel(b, threadIdx.x) = voxels[blockIdx.x * FUSION_HASH_BLOCK_VOXELS + threadIdx.x];
+}
+
+template<unsigned char _bins>
+void FusionHashUpdateIteration(fusionHashData<_bins> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                               const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                               const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream)
+{
+    // Remember number of blocks before allocation, new ones get initialized
+    CHECK_CUDA_ERRORS_AUTO(cudaMemcpyAsync(f.counter() + 1, f.counter(), sizeof(int), cudaMemcpyDeviceToDevice, stream));
+    FusionHashAllocate_kernel<_bins><<<blocks, threads, 0, stream>>>(f, depthmap, K.inv(), R.trans(), t, threshold, width, height);
+
+    const dim3 vblocks(f.capacity());
+    const dim3 vthreads(FUSION_HASH_BLOCK_VOXELS);
+    FusionHashInit_kernel<_bins><<<vblocks, vthreads, 0, stream>>>(f);
+    {
+        NVTX_RANGE("fusion integrate", NvtxFusion);
+        FusionHashUpdateHistogram_kernel<_bins><<<vblocks, vthreads, 0, stream>>>(f, depthmap, K, R, t, threshold, width, height);
+    }
+    NVTX_RANGE("fusion solve", NvtxFusion);
+    FusionHashUpdateU_kernel<_bins><<<vblocks, vthreads, 0, stream>>>(f, tau, lambda);
+    FusionHashUpdateP_kernel<_bins><<<vblocks, vthreads, 0, stream>>>(f, sigma);
+}
+
+template<unsigned char _bins>
+void FusionHashRestore(fusionHashData<_bins> f, const int3 * coords, const fusionvoxel<_bins> * voxels, const int blocks,
+                       cudaStream_t stream)
+{
+    if (blocks <= 0) return;
+    const int threads = 256;
+    FusionHashRestoreAllocate_kernel<_bins><<<(blocks + threads - 1) / threads, threads, 0, stream>>>(f, coords, blocks);
+    FusionHashRestoreVoxels_kernel<_bins><<<blocks, FUSION_HASH_BLOCK_VOXELS, 0, stream>>>(f, coords, voxels);
+
+    // Restored blocks are not reinitialized by the next iteration
+    CHECK_CUDA_ERRORS_AUTO(cudaMemcpyAsync(f.counter() + 1, f.counter(), sizeof(int), cudaMemcpyDeviceToDevice, stream));
+}
+
+template<unsigned char _bins, typename _voxel>
+void FusionUpdateHistogramCulled(fusionData<_bins, Device, _voxel> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                                 const Vector3D t, const float threshold, const float znear, const float zfar,
+                                 const int width, const int height, int * list, cudaStream_t stream)
+{
+    NVTX_RANGE("fusion integrate", NvtxFusion);
+    bindFusion(f, stream);
+    // Frustum bounding box in bricks
+    int3 lo, hi;
+    if (!f.frustumBox(K, R, t, width, height, znear, zfar, lo, hi)) return;
+    const int bs = FUSION_CULL_BRICK_SIZE;
+    lo = make_int3(lo.x / bs, lo.y / bs, lo.z / bs);
+    hi = make_int3((hi.x + bs - 1) / bs, (hi.y + bs - 1) / bs, (hi.z + bs - 1) / bs);
+    const int3 nb = hi - lo;
+    const int n = nb.x * nb.y * nb.z;
+
+    CHECK_CUDA_ERRORS_AUTO(cudaMemsetAsync(list, 0, sizeof(int), stream));
+    FusionCullBricks_kernel<_bins, _voxel><<<(n + 127) / 128, 128, 0, stream>>>(K, R, t, znear, zfar, width, height, lo, nb, list);
+    FusionUpdateHistogramBricks_kernel<_bins, _voxel><<<n, FUSION_CULL_BRICK_SIZE * FUSION_CULL_BRICK_SIZE * FUSION_CULL_BRICK_SIZE,
+                                                         0, stream>>>(depthmap, K, R, t, threshold, width, height, list);
+}
+
+template<unsigned char _bins, typename _voxel>
+void FusionUpdateIterationCulled(fusionData<_bins, Device, _voxel> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                                 const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                                 const float znear, const float zfar, const int width, const int height, int * list,
+                                 dim3 blocks, dim3 threads, cudaStream_t stream)
+{
+    FusionUpdateHistogramCulled<_bins, _voxel>(f, depthmap, K, R, t, threshold, znear, zfar, width, height, list, stream);
+    NVTX_RANGE("fusion solve", NvtxFusion);
+    FusionUpdateUTiled<_bins, _voxel>(f, tau, lambda, threads, stream);
+    FusionUpdatePTiled<_bins, _voxel>(f, sigma, threads, stream);
+}
+
+template<unsigned char _bins, typename _voxel>
+void FusionUpdateHistogramBatch(fusionData<_bins, Device, _voxel> f, const float * const * depthmaps, const Matrix3D * K,
+                                const Matrix3D * R, const Vector3D * t, const int views, const float threshold,
+                                const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream)
+{
+    NVTX_RANGE_INDEX("fusion integrate batch", NvtxFusion, views);
+    bindFusion(f, stream);
+    // Views are passed by value in batches of FUSION_BATCH_VIEWS
+    for (int first = 0; first < views; first += FUSION_BATCH_VIEWS) {
+        fusionViews v;
+        v.n = min(views - first, FUSION_BATCH_VIEWS);
+        for (int i = 0; i < v.n; i++) {
+            v.depthmap[i] = depthmaps[first + i];
+            v.K[i] = K[first + i];
+            v.R[i] = R[first + i];
+            v.T[i] = t[first + i];
+        }
+        FusionUpdateHistogramBatch_kernel<_bins, _voxel><<<blocks, threads, 0, stream>>>(v, threshold, width, height);
+    }
+}
+
+template<unsigned char _bins>
+void FusionResidual(fusionData<_bins> f, float * d_sums, dim3 blocks, dim3 threads, cudaStream_t stream)
+{
+    bindFusion(f, stream);
+    size_t shared = 2 * threads.x * threads.y * threads.z * sizeof(float);
+    FusionResidual_kernel<_bins, fusionvoxel<_bins>><<<blocks, threads, shared, stream>>>(d_sums);
+}
+
+template<unsigned char _bins>
+int FusionResidualBlockSize()
+{
+    auto shared = [](int threads){ return 2 * threads * sizeof(float); };
+    int grid = 0, block = 0;
+    CHECK_CUDA_ERRORS_AUTO(cudaOccupancyMaxPotentialBlockSizeVariableSMem(&grid, &block, FusionResidual_kernel<_bins, fusionvoxel<_bins>>,
+                                                                         shared));
+    return block;
+}
+
+template<unsigned char _bins>
+unsigned int FusionExtractSurface(fusionData<_bins> f, fusionPoint * points, unsigned int capacity, unsigned int * d_count,
+                                  const unsigned int * colormap, dim3 blocks, dim3 threads, cudaStream_t stream)
+{
+    bindFusion(f, stream);
+    unsigned int count = 0;
+    CHECK_CUDA_ERRORS_AUTO(cudaMemsetAsync(d_count, 0, sizeof(unsigned int), stream));
+    FusionExtractSurface_kernel<_bins, fusionvoxel<_bins>><<<blocks, threads, 0, stream>>>(points, capacity, d_count, colormap);
+    CHECK_CUDA_ERRORS_AUTO(cudaMemcpyAsync(&count, d_count, sizeof(unsigned int), cudaMemcpyDeviceToHost, stream));
+    CHECK_CUDA_ERRORS_AUTO(cudaStreamSynchronize(stream));
+    return count;
+}
+
+template<unsigned char _bins>
+void FusionDecimateSurface(fusionData<_bins> f, fusionPoint * cells, uint2 * signatures, const int cell, const int block,
+                           const unsigned int * colormap, dim3 threads, cudaStream_t stream)
+{
+    bindFusion(f, stream);
+    const int3 grid = FusionLODGrid(f, cell), blocksgrid = FusionLODBlocks(f, cell, block);
+    dim3 blocks((grid.x + threads.x - 1) / threads.x, (grid.y + threads.y - 1) / threads.y,
+                (grid.z + threads.z - 1) / threads.z);
+    CHECK_CUDA_ERRORS_AUTO(cudaMemsetAsync(signatures, 0, blocksgrid.x * blocksgrid.y * blocksgrid.z * sizeof(uint2), stream));
+    FusionDecimateSurface_kernel<_bins, fusionvoxel<_bins>><<<blocks, threads, 0, stream>>>(cells, signatures, cell, grid,
+                                                                                           blocksgrid, block, colormap);
+}
+
+void FusionGatherCells(fusionPoint * points, unsigned int * cursors, const fusionPoint * cells, const int * offsets,
+                       const int3 grid, const int3 blocksgrid, const int block, dim3 threads, cudaStream_t stream)
 {
-    FusionUpdateHistogram_kernel<_bins><<<blocks, threads>>>(f, depthmap, K, R, t, threshold, width, height);
-    FusionUpdateU_kernel<_bins><<<blocks, threads>>>(f, tau, lambda);
-    FusionUpdateP_kernel<_bins><<<blocks, threads>>>(f, sigma);
+    dim3 blocks((grid.x + threads.x - 1) / threads.x, (grid.y + threads.y - 1) / threads.y,
+                (grid.z + threads.z - 1) / threads.z);
+    CHECK_CUDA_ERRORS_AUTO(cudaMemsetAsync(cursors, 0, blocksgrid.x * blocksgrid.y * blocksgrid.z * sizeof(unsigned int), stream));
+    FusionGatherCells_kernel<<<blocks, threads, 0, stream>>>(points, cursors, cells, offsets, grid, blocksgrid, block);
 }
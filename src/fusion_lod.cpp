@@ -0,0 +1,96 @@
+#include "fusion_lod.h"
+#include "cuda_exception.h"
+
+static inline bool sameDims(const int3 & a, const int3 & b)
+{
+    return (a.x == b.x) && (a.y == b.y) && (a.z == b.z);
+}
+
+void FusionLOD::setColormap(const unsigned int * colormap)
+{
+    if (!colors.isValid()) colors.reset(256, 1);
+    colors.copyFrom(colormap, 256 * sizeof(unsigned int));
+}
+
+void FusionLOD::reset()
+{
+    shown.clear();
+    cellgrid = blockgrid = make_int3(0, 0, 0);
+    updated = false;
+}
+
+void FusionLOD::prepare(const int3 grid, const int3 blocksgrid)
+{
+    const size_t nb = blocksgrid.x * blocksgrid.y * blocksgrid.z;
+    if (sameDims(grid, cellgrid) && sameDims(blocksgrid, blockgrid) && (shown.size() == nb)) return;
+
+    // Kernels index cells linearly, device images are unpadded
+    if (!sameDims(grid, cellgrid)) cells.reset(grid.x, grid.y * grid.z);
+    if (!sameDims(blocksgrid, blockgrid)) {
+        signatures.reset(nb, 1);
+        offsets.reset(nb, 1);
+        cursors.reset(nb, 1);
+    }
+    cellgrid = grid;
+    blockgrid = blocksgrid;
+
+    // Points of the previous cell size are all stale, no signature matches this one
+    shown.assign(nb, make_uint2(~0u, ~0u));
+}
+
+bool FusionLOD::decimated(cudaStream_t stream)
+{
+    current.resize(signatures.width());
+    CHECK_CUDA_ERRORS_AUTO(cudaMemcpyAsync(current.data(), signatures.data(), current.size() * sizeof(uint2),
+                                           cudaMemcpyDeviceToHost, stream));
+    CHECK_CUDA_ERRORS_AUTO(cudaStreamSynchronize(stream));
+
+    total = 0;
+    for (size_t i = 0; i < current.size(); i++) total += current[i].x;
+
+    // Surface points scale with the square of the cell size, coarsen until the budget is met
+    if ((total > budget_) && (cell < FUSION_LOD_BLOCK_SIZE)) {
+        cell *= 2;
+        return true;
+    }
+    return false;
+}
+
+void FusionLOD::collect(std::vector<Block> & changed, dim3 threads, cudaStream_t stream)
+{
+    // Only changed blocks are gathered, each one contiguous in the point buffer
+    std::vector<int> offs(current.size(), -1);
+    size_t count = 0;
+    for (size_t i = 0; i < current.size(); i++) {
+        if ((current[i].x == shown[i].x) && (current[i].y == shown[i].y)) continue;
+        Block b;
+        b.index = i;
+        changed.push_back(b);
+        offs[i] = count;
+        count += current[i].x;
+    }
+
+    if (count > 0) {
+        if (points.width() < count) points.reset(count, 1);
+        CHECK_CUDA_ERRORS_AUTO(cudaMemcpyAsync(offsets.data(), offs.data(), offs.size() * sizeof(int),
+                                               cudaMemcpyHostToDevice, stream));
+        FusionGatherCells(points.data(), cursors.data(), cells.data(), offsets.data(), cellgrid, blockgrid,
+                          FUSION_LOD_BLOCK_SIZE / cell, threads, stream);
+
+        std::vector<fusionPoint> host(count);
+        CHECK_CUDA_ERRORS_AUTO(cudaMemcpyAsync(host.data(), points.data(), count * sizeof(fusionPoint),
+                                               cudaMemcpyDeviceToHost, stream));
+        CHECK_CUDA_ERRORS_AUTO(cudaStreamSynchronize(stream));
+        for (size_t i = 0; i < changed.size(); i++) {
+            const int b = changed[i].index;
+            changed[i].points.assign(host.begin() + offs[b], host.begin() + offs[b] + current[b].x);
+        }
+    }
+    shown = current;
+
+    // Refine again once the surface shrank well below the budget, hysteresis avoids switching back and forth
+    if ((cell > 1) && (total * 8 < budget_)) cell /= 2;
+
+    last = std::chrono::steady_clock::now();
+    updated = true;
+}
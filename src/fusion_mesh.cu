@@ -0,0 +1,419 @@
+// Marching cubes mesh extraction from depthmap fusion data
+#include <thrust/scan.h>
+#include <thrust/device_ptr.h>
+#include <thrust/execution_policy.h>
+#include "fusion_mesh.cu.h"
+#include "cuda_exception.h"
+#include "dev_functions.h"
+
+// Cell corners: 0 (0,0,0), 1 (1,0,0), 2 (1,1,0), 3 (0,1,0), 4 (0,0,1), 5 (1,0,1), 6 (1,1,1), 7 (0,1,1)
+// Cell edges: 0 0-1, 1 1-2, 2 2-3, 3 3-0, 4 4-5, 5 5-6, 6 6-7, 7 7-4, 8 0-4, 9 1-5, 10 2-6, 11 3-7
+// Corner bit is set for u < 0, faces with 4 crossings separate the corners with u < 0
+
+/// Number of triangles of each cell configuration
+__constant__ unsigned char c_mcTriangles[256] = {
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 2, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 3,
+    1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 3, 2, 3, 3, 2, 3, 4, 4, 3, 3, 4, 4, 3, 4, 5, 5, 2,
+    1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 3, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 4,
+    2, 3, 3, 4, 3, 4, 2, 3, 3, 4, 4, 5, 4, 5, 3, 2, 3, 4, 4, 3, 4, 5, 3, 2, 4, 5, 5, 4, 5, 2, 4, 1,
+    1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 3, 2, 3, 3, 4, 3, 4, 4, 5, 3, 2, 4, 3, 4, 3, 5, 2,
+    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 4, 3, 4, 4, 3, 4, 5, 5, 4, 4, 3, 5, 2, 5, 4, 2, 1,
+    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 2, 3, 3, 2, 3, 4, 4, 5, 4, 5, 5, 2, 4, 3, 5, 4, 3, 2, 4, 1,
+    3, 4, 4, 5, 4, 5, 3, 4, 4, 5, 5, 2, 3, 4, 2, 1, 2, 3, 3, 2, 3, 4, 2, 1, 3, 2, 4, 1, 2, 1, 1, 0
+};
+
+/// Edges of triangle vertices of each cell configuration, -1 terminated
+__constant__ signed char c_mcTable[256][16] = {
+    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  3,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  9,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  8,  9,  1,  3,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 1, 10,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  3,  8,  1, 10,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 10,  2,  0,  9, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 2,  9, 10,  2,  8,  9,  2,  3,  8, -1, -1, -1, -1, -1, -1, -1},
+    { 2, 11,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 11,  8,  0,  2, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  9,  1,  2, 11,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  8,  9,  1, 11,  8,  1,  2, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 1, 11,  3,  1, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 11,  8,  0, 10, 11,  0,  1, 10, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 11,  3,  0, 10, 11,  0,  9, 10, -1, -1, -1, -1, -1, -1, -1},
+    { 8, 10, 11,  8,  9, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 4,  8,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  7,  4,  0,  3,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  9,  1,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  4,  9,  1,  7,  4,  1,  3,  7, -1, -1, -1, -1, -1, -1, -1},
+    { 1, 10,  2,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  7,  4,  0,  3,  7,  1, 10,  2, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 10,  2,  0,  9, 10,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1},
+    { 2,  9, 10,  2,  4,  9,  2,  7,  4,  2,  3,  7, -1, -1, -1, -1},
+    { 2, 11,  3,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  7,  4,  0, 11,  7,  0,  2, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  9,  1,  2, 11,  3,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  4,  9,  1,  7,  4,  1, 11,  7,  1,  2, 11, -1, -1, -1, -1},
+    { 1, 11,  3,  1, 10, 11,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  7,  4,  0, 11,  7,  0, 10, 11,  0,  1, 10, -1, -1, -1, -1},
+    { 0, 11,  3,  0, 10, 11,  0,  9, 10,  4,  8,  7, -1, -1, -1, -1},
+    { 4, 11,  7,  4, 10, 11,  4,  9, 10, -1, -1, -1, -1, -1, -1, -1},
+    { 4,  5,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  3,  8,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  5,  1,  0,  4,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  4,  5,  1,  8,  4,  1,  3,  8, -1, -1, -1, -1, -1, -1, -1},
+    { 1, 10,  2,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  3,  8,  1, 10,  2,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 10,  2,  0,  5, 10,  0,  4,  5, -1, -1, -1, -1, -1, -1, -1},
+    { 2,  5, 10,  2,  4,  5,  2,  8,  4,  2,  3,  8, -1, -1, -1, -1},
+    { 2, 11,  3,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 11,  8,  0,  2, 11,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  5,  1,  0,  4,  5,  2, 11,  3, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  4,  5,  1,  8,  4,  1, 11,  8,  1,  2, 11, -1, -1, -1, -1},
+    { 1, 11,  3,  1, 10, 11,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 11,  8,  0, 10, 11,  0,  1, 10,  4,  5,  9, -1, -1, -1, -1},
+    { 0, 11,  3,  0, 10, 11,  0,  5, 10,  0,  4,  5, -1, -1, -1, -1},
+    { 4, 11,  8,  4, 10, 11,  4,  5, 10, -1, -1, -1, -1, -1, -1, -1},
+    { 5,  8,  7,  5,  9,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  5,  9,  0,  7,  5,  0,  3,  7, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  5,  1,  0,  7,  5,  0,  8,  7, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  7,  5,  1,  3,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 1, 10,  2,  5,  8,  7,  5,  9,  8, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  5,  9,  0,  7,  5,  0,  3,  7,  1, 10,  2, -1, -1, -1, -1},
+    { 0, 10,  2,  0,  5, 10,  0,  7,  5,  0,  8,  7, -1, -1, -1, -1},
+    { 2,  5, 10,  2,  7,  5,  2,  3,  7, -1, -1, -1, -1, -1, -1, -1},
+    { 2, 11,  3,  5,  8,  7,  5,  9,  8, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  5,  9,  0,  7,  5,  0, 11,  7,  0,  2, 11, -1, -1, -1, -1},
+    { 0,  5,  1,  0,  7,  5,  0,  8,  7,  2, 11,  3, -1, -1, -1, -1},
+    { 1,  7,  5,  1, 11,  7,  1,  2, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 1, 11,  3,  1, 10, 11,  5,  8,  7,  5,  9,  8, -1, -1, -1, -1},
+    { 0,  5,  9,  0,  7,  5,  0, 11,  7,  0, 10, 11,  0,  1, 10, -1},
+    { 0, 11,  3,  0, 10, 11,  0,  5, 10,  0,  7,  5,  0,  8,  7, -1},
+    { 5, 11,  7,  5, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 5,  6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  3,  8,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  9,  1,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  8,  9,  1,  3,  8,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  6,  2,  1,  5,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  3,  8,  1,  6,  2,  1,  5,  6, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  6,  2,  0,  5,  6,  0,  9,  5, -1, -1, -1, -1, -1, -1, -1},
+    { 2,  5,  6,  2,  9,  5,  2,  8,  9,  2,  3,  8, -1, -1, -1, -1},
+    { 2, 11,  3,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 11,  8,  0,  2, 11,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  9,  1,  2, 11,  3,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  8,  9,  1, 11,  8,  1,  2, 11,  5,  6, 10, -1, -1, -1, -1},
+    { 1, 11,  3,  1,  6, 11,  1,  5,  6, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 11,  8,  0,  6, 11,  0,  5,  6,  0,  1,  5, -1, -1, -1, -1},
+    { 0, 11,  3,  0,  6, 11,  0,  5,  6,  0,  9,  5, -1, -1, -1, -1},
+    { 5,  8,  9,  5, 11,  8,  5,  6, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 4,  8,  7,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  7,  4,  0,  3,  7,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  9,  1,  4,  8,  7,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  4,  9,  1,  7,  4,  1,  3,  7,  5,  6, 10, -1, -1, -1, -1},
+    { 1,  6,  2,  1,  5,  6,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  7,  4,  0,  3,  7,  1,  6,  2,  1,  5,  6, -1, -1, -1, -1},
+    { 0,  6,  2,  0,  5,  6,  0,  9,  5,  4,  8,  7, -1, -1, -1, -1},
+    { 2,  5,  6,  2,  9,  5,  2,  4,  9,  2,  7,  4,  2,  3,  7, -1},
+    { 2, 11,  3,  4,  8,  7,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  7,  4,  0, 11,  7,  0,  2, 11,  5,  6, 10, -1, -1, -1, -1},
+    { 0,  9,  1,  2, 11,  3,  4,  8,  7,  5,  6, 10, -1, -1, -1, -1},
+    { 1,  4,  9,  1,  7,  4,  1, 11,  7,  1,  2, 11,  5,  6, 10, -1},
+    { 1, 11,  3,  1,  6, 11,  1,  5,  6,  4,  8,  7, -1, -1, -1, -1},
+    { 0,  7,  4,  0, 11,  7,  0,  6, 11,  0,  5,  6,  0,  1,  5, -1},
+    { 0, 11,  3,  0,  6, 11,  0,  5,  6,  0,  9,  5,  4,  8,  7, -1},
+    { 4, 11,  7,  4,  6, 11,  4,  5,  6,  4,  9,  5, -1, -1, -1, -1},
+    { 4, 10,  9,  4,  6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  3,  8,  4, 10,  9,  4,  6, 10, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 10,  1,  0,  6, 10,  0,  4,  6, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  6, 10,  1,  4,  6,  1,  8,  4,  1,  3,  8, -1, -1, -1, -1},
+    { 1,  6,  2,  1,  4,  6,  1,  9,  4, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  3,  8,  1,  6,  2,  1,  4,  6,  1,  9,  4, -1, -1, -1, -1},
+    { 0,  6,  2,  0,  4,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 2,  4,  6,  2,  8,  4,  2,  3,  8, -1, -1, -1, -1, -1, -1, -1},
+    { 2, 11,  3,  4, 10,  9,  4,  6, 10, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 11,  8,  0,  2, 11,  4, 10,  9,  4,  6, 10, -1, -1, -1, -1},
+    { 0, 10,  1,  0,  6, 10,  0,  4,  6,  2, 11,  3, -1, -1, -1, -1},
+    { 1,  6, 10,  1,  4,  6,  1,  8,  4,  1, 11,  8,  1,  2, 11, -1},
+    { 1, 11,  3,  1,  6, 11,  1,  4,  6,  1,  9,  4, -1, -1, -1, -1},
+    { 0, 11,  8,  0,  6, 11,  0,  4,  6,  0,  9,  4,  0,  1,  9, -1},
+    { 0, 11,  3,  0,  6, 11,  0,  4,  6, -1, -1, -1, -1, -1, -1, -1},
+    { 4, 11,  8,  4,  6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 6,  8,  7,  6,  9,  8,  6, 10,  9, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 10,  9,  0,  6, 10,  0,  7,  6,  0,  3,  7, -1, -1, -1, -1},
+    { 0, 10,  1,  0,  6, 10,  0,  7,  6,  0,  8,  7, -1, -1, -1, -1},
+    { 1,  6, 10,  1,  7,  6,  1,  3,  7, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  6,  2,  1,  7,  6,  1,  8,  7,  1,  9,  8, -1, -1, -1, -1},
+    { 0,  1,  9,  0,  2,  1,  0,  6,  2,  0,  7,  6,  0,  3,  7, -1},
+    { 0,  6,  2,  0,  7,  6,  0,  8,  7, -1, -1, -1, -1, -1, -1, -1},
+    { 2,  7,  6,  2,  3,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 2, 11,  3,  6,  8,  7,  6,  9,  8,  6, 10,  9, -1, -1, -1, -1},
+    { 0, 10,  9,  0,  6, 10,  0,  7,  6,  0, 11,  7,  0,  2, 11, -1},
+    { 0, 10,  1,  0,  6, 10,  0,  7,  6,  0,  8,  7,  2, 11,  3, -1},
+    { 1,  6, 10,  1,  7,  6,  1, 11,  7,  1,  2, 11, -1, -1, -1, -1},
+    { 1, 11,  3,  1,  6, 11,  1,  7,  6,  1,  8,  7,  1,  9,  8, -1},
+    { 0,  1,  9,  6, 11,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 11,  3,  0,  6, 11,  0,  7,  6,  0,  8,  7, -1, -1, -1, -1},
+    { 6, 11,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 6,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  3,  8,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  9,  1,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  8,  9,  1,  3,  8,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 1, 10,  2,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  3,  8,  1, 10,  2,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 10,  2,  0,  9, 10,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 2,  9, 10,  2,  8,  9,  2,  3,  8,  6,  7, 11, -1, -1, -1, -1},
+    { 2,  7,  3,  2,  6,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  7,  8,  0,  6,  7,  0,  2,  6, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  9,  1,  2,  7,  3,  2,  6,  7, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  8,  9,  1,  7,  8,  1,  6,  7,  1,  2,  6, -1, -1, -1, -1},
+    { 1,  7,  3,  1,  6,  7,  1, 10,  6, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  7,  8,  0,  6,  7,  0, 10,  6,  0,  1, 10, -1, -1, -1, -1},
+    { 0,  7,  3,  0,  6,  7,  0, 10,  6,  0,  9, 10, -1, -1, -1, -1},
+    { 6,  9, 10,  6,  8,  9,  6,  7,  8, -1, -1, -1, -1, -1, -1, -1},
+    { 4, 11,  6,  4,  8, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  6,  4,  0, 11,  6,  0,  3, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  9,  1,  4, 11,  6,  4,  8, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  4,  9,  1,  6,  4,  1, 11,  6,  1,  3, 11, -1, -1, -1, -1},
+    { 1, 10,  2,  4, 11,  6,  4,  8, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  6,  4,  0, 11,  6,  0,  3, 11,  1, 10,  2, -1, -1, -1, -1},
+    { 0, 10,  2,  0,  9, 10,  4, 11,  6,  4,  8, 11, -1, -1, -1, -1},
+    { 2,  9, 10,  2,  4,  9,  2,  6,  4,  2, 11,  6,  2,  3, 11, -1},
+    { 2,  8,  3,  2,  4,  8,  2,  6,  4, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  6,  4,  0,  2,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  9,  1,  2,  8,  3,  2,  4,  8,  2,  6,  4, -1, -1, -1, -1},
+    { 1,  4,  9,  1,  6,  4,  1,  2,  6, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  8,  3,  1,  4,  8,  1,  6,  4,  1, 10,  6, -1, -1, -1, -1},
+    { 0,  6,  4,  0, 10,  6,  0,  1, 10, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  8,  3,  0,  4,  8,  0,  6,  4,  0, 10,  6,  0,  9, 10, -1},
+    { 4, 10,  6,  4,  9, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 4,  5,  9,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  3,  8,  4,  5,  9,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  5,  1,  0,  4,  5,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  4,  5,  1,  8,  4,  1,  3,  8,  6,  7, 11, -1, -1, -1, -1},
+    { 1, 10,  2,  4,  5,  9,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  3,  8,  1, 10,  2,  4,  5,  9,  6,  7, 11, -1, -1, -1, -1},
+    { 0, 10,  2,  0,  5, 10,  0,  4,  5,  6,  7, 11, -1, -1, -1, -1},
+    { 2,  5, 10,  2,  4,  5,  2,  8,  4,  2,  3,  8,  6,  7, 11, -1},
+    { 2,  7,  3,  2,  6,  7,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  7,  8,  0,  6,  7,  0,  2,  6,  4,  5,  9, -1, -1, -1, -1},
+    { 0,  5,  1,  0,  4,  5,  2,  7,  3,  2,  6,  7, -1, -1, -1, -1},
+    { 1,  4,  5,  1,  8,  4,  1,  7,  8,  1,  6,  7,  1,  2,  6, -1},
+    { 1,  7,  3,  1,  6,  7,  1, 10,  6,  4,  5,  9, -1, -1, -1, -1},
+    { 0,  7,  8,  0,  6,  7,  0, 10,  6,  0,  1, 10,  4,  5,  9, -1},
+    { 0,  7,  3,  0,  6,  7,  0, 10,  6,  0,  5, 10,  0,  4,  5, -1},
+    { 4,  7,  8,  4,  6,  7,  4, 10,  6,  4,  5, 10, -1, -1, -1, -1},
+    { 5, 11,  6,  5,  8, 11,  5,  9,  8, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  5,  9,  0,  6,  5,  0, 11,  6,  0,  3, 11, -1, -1, -1, -1},
+    { 0,  5,  1,  0,  6,  5,  0, 11,  6,  0,  8, 11, -1, -1, -1, -1},
+    { 1,  6,  5,  1, 11,  6,  1,  3, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 1, 10,  2,  5, 11,  6,  5,  8, 11,  5,  9,  8, -1, -1, -1, -1},
+    { 0,  5,  9,  0,  6,  5,  0, 11,  6,  0,  3, 11,  1, 10,  2, -1},
+    { 0, 10,  2,  0,  5, 10,  0,  6,  5,  0, 11,  6,  0,  8, 11, -1},
+    { 2,  5, 10,  2,  6,  5,  2, 11,  6,  2,  3, 11, -1, -1, -1, -1},
+    { 2,  8,  3,  2,  9,  8,  2,  5,  9,  2,  6,  5, -1, -1, -1, -1},
+    { 0,  5,  9,  0,  6,  5,  0,  2,  6, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  5,  1,  0,  6,  5,  0,  2,  6,  0,  3,  2,  0,  8,  3, -1},
+    { 1,  6,  5,  1,  2,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  8,  3,  1,  9,  8,  1,  5,  9,  1,  6,  5,  1, 10,  6, -1},
+    { 0,  5,  9,  0,  6,  5,  0, 10,  6,  0,  1, 10, -1, -1, -1, -1},
+    { 0,  8,  3,  5, 10,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 5, 10,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 5, 11, 10,  5,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  3,  8,  5, 11, 10,  5,  7, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  9,  1,  5, 11, 10,  5,  7, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  8,  9,  1,  3,  8,  5, 11, 10,  5,  7, 11, -1, -1, -1, -1},
+    { 1, 11,  2,  1,  7, 11,  1,  5,  7, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  3,  8,  1, 11,  2,  1,  7, 11,  1,  5,  7, -1, -1, -1, -1},
+    { 0, 11,  2,  0,  7, 11,  0,  5,  7,  0,  9,  5, -1, -1, -1, -1},
+    { 2,  7, 11,  2,  5,  7,  2,  9,  5,  2,  8,  9,  2,  3,  8, -1},
+    { 2,  7,  3,  2,  5,  7,  2, 10,  5, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  7,  8,  0,  5,  7,  0, 10,  5,  0,  2, 10, -1, -1, -1, -1},
+    { 0,  9,  1,  2,  7,  3,  2,  5,  7,  2, 10,  5, -1, -1, -1, -1},
+    { 1,  8,  9,  1,  7,  8,  1,  5,  7,  1, 10,  5,  1,  2, 10, -1},
+    { 1,  7,  3,  1,  5,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  7,  8,  0,  5,  7,  0,  1,  5, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  7,  3,  0,  5,  7,  0,  9,  5, -1, -1, -1, -1, -1, -1, -1},
+    { 5,  8,  9,  5,  7,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 4, 10,  5,  4, 11, 10,  4,  8, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  5,  4,  0, 10,  5,  0, 11, 10,  0,  3, 11, -1, -1, -1, -1},
+    { 0,  9,  1,  4, 10,  5,  4, 11, 10,  4,  8, 11, -1, -1, -1, -1},
+    { 1,  4,  9,  1,  5,  4,  1, 10,  5,  1, 11, 10,  1,  3, 11, -1},
+    { 1, 11,  2,  1,  8, 11,  1,  4,  8,  1,  5,  4, -1, -1, -1, -1},
+    { 0,  5,  4,  0,  1,  5,  0,  2,  1,  0, 11,  2,  0,  3, 11, -1},
+    { 0, 11,  2,  0,  8, 11,  0,  4,  8,  0,  5,  4,  0,  9,  5, -1},
+    { 2,  3, 11,  4,  9,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 2,  8,  3,  2,  4,  8,  2,  5,  4,  2, 10,  5, -1, -1, -1, -1},
+    { 0,  5,  4,  0, 10,  5,  0,  2, 10, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  9,  1,  2,  8,  3,  2,  4,  8,  2,  5,  4,  2, 10,  5, -1},
+    { 1,  4,  9,  1,  5,  4,  1, 10,  5,  1,  2, 10, -1, -1, -1, -1},
+    { 1,  8,  3,  1,  4,  8,  1,  5,  4, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  5,  4,  0,  1,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  8,  3,  0,  4,  8,  0,  5,  4,  0,  9,  5, -1, -1, -1, -1},
+    { 4,  9,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 4, 10,  9,  4, 11, 10,  4,  7, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  3,  8,  4, 10,  9,  4, 11, 10,  4,  7, 11, -1, -1, -1, -1},
+    { 0, 10,  1,  0, 11, 10,  0,  7, 11,  0,  4,  7, -1, -1, -1, -1},
+    { 1, 11, 10,  1,  7, 11,  1,  4,  7,  1,  8,  4,  1,  3,  8, -1},
+    { 1, 11,  2,  1,  7, 11,  1,  4,  7,  1,  9,  4, -1, -1, -1, -1},
+    { 0,  3,  8,  1, 11,  2,  1,  7, 11,  1,  4,  7,  1,  9,  4, -1},
+    { 0, 11,  2,  0,  7, 11,  0,  4,  7, -1, -1, -1, -1, -1, -1, -1},
+    { 2,  7, 11,  2,  4,  7,  2,  8,  4,  2,  3,  8, -1, -1, -1, -1},
+    { 2,  7,  3,  2,  4,  7,  2,  9,  4,  2, 10,  9, -1, -1, -1, -1},
+    { 0,  7,  8,  0,  4,  7,  0,  9,  4,  0, 10,  9,  0,  2, 10, -1},
+    { 0, 10,  1,  0,  2, 10,  0,  3,  2,  0,  7,  3,  0,  4,  7, -1},
+    { 1,  2, 10,  4,  7,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  7,  3,  1,  4,  7,  1,  9,  4, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  7,  8,  0,  4,  7,  0,  9,  4,  0,  1,  9, -1, -1, -1, -1},
+    { 0,  7,  3,  0,  4,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 4,  7,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 8, 10,  9,  8, 11, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 10,  9,  0, 11, 10,  0,  3, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 10,  1,  0, 11, 10,  0,  8, 11, -1, -1, -1, -1, -1, -1, -1},
+    { 1, 11, 10,  1,  3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 1, 11,  2,  1,  8, 11,  1,  9,  8, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  1,  9,  0,  2,  1,  0, 11,  2,  0,  3, 11, -1, -1, -1, -1},
+    { 0, 11,  2,  0,  8, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 2,  3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 2,  8,  3,  2,  9,  8,  2, 10,  9, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 10,  9,  0,  2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0, 10,  1,  0,  2, 10,  0,  3,  2,  0,  8,  3, -1, -1, -1, -1},
+    { 1,  2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 1,  8,  3,  1,  9,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  1,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    { 0,  8,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}
+};
+
+/// Corner of edge owning its vertex and axis of the edge
+__constant__ unsigned char c_mcEdgeOwner[12] = { 0, 1, 3, 0, 4, 5, 7, 4, 0, 1, 2, 3 };
+__constant__ unsigned char c_mcEdgeAxis[12] = { 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2 };
+
+/**
+ *  \brief Check if voxel edge along given axis crosses zero level set
+ *
+ *  \param f    fusion data
+ *  \param i    voxel indexes of first edge end
+ *  \param axis 0, 1 or 2 for x, y or z axis
+ *  \param u0   \f$u\f$ at \p i
+ *  \param u1   \f$u\f$ at other edge end returned by reference
+ *  \return False if edge leaves the volume or does not cross
+ */
+template<unsigned char _bins>
+__device__ inline
+bool edgeCrosses(fusionData<_bins> & f, int3 i, int axis, float u0, float & u1)
+{
+    const int3 j = make_int3(i.x + (axis == 0), i.y + (axis == 1), i.z + (axis == 2));
+    if ((j.x >= f.width()) || (j.y >= f.height()) || (j.z >= f.depth())) return false;
+    u1 = f.u(j.x, j.y, j.z);
+    return (u0 < 0) != (u1 < 0);
+}
+
+/**
+ *  \brief Get marching cubes configuration of cell starting at voxel
+ *
+ *  \param f fusion data
+ *  \param i voxel indexes of corner 0
+ *  \return Configuration index, -1 if the cell leaves the volume
+ */
+template<unsigned char _bins>
+__device__ inline
+int cellConfiguration(fusionData<_bins> & f, int3 i)
+{
+    if ((i.x + 1 >= f.width()) || (i.y + 1 >= f.height()) || (i.z + 1 >= f.depth())) return -1;
+    int cube = 0;
+    for (int c = 0; c < 8; c++) {
+        const int x = i.x + ((c & 1) ^ ((c >> 1) & 1)), y = i.y + ((c >> 1) & 1), z = i.z + (c >> 2);
+        if (f.u(x, y, z) < 0) cube |= 1 << c;
+    }
+    return cube;
+}
+
+template<unsigned char _bins>
+__global__ void FusionMeshClassify_kernel(fusionData<_bins> f, unsigned int * __restrict__ vcount,
+                                          unsigned int * __restrict__ tcount)
+{
+    const int ix = getGlobalIdx();
+    if ((size_t)ix >= f.elements()) return;
+    const int3 i = f.indexes(ix);
+
+    const float u0 = f.u(i.x, i.y, i.z);
+    float u1;
+    unsigned int v = 0;
+    for (int a = 0; a < 3; a++) v += edgeCrosses(f, i, a, u0, u1);
+    vcount[ix] = v;
+
+    const int cube = cellConfiguration(f, i);
+    tcount[ix] = (cube < 0) ? 0 : c_mcTriangles[cube];
+}
+
+template<unsigned char _bins>
+__global__ void FusionMeshVertices_kernel(fusionData<_bins> f, const unsigned int * __restrict__ voffset,
+                                          float3 * __restrict__ vertices)
+{
+    const int ix = getGlobalIdx();
+    if ((size_t)ix >= f.elements()) return;
+    const int3 i = f.indexes(ix);
+
+    const float u0 = f.u(i.x, i.y, i.z);
+    const float3 w0 = f.worldCoords(i.x, i.y, i.z);
+    unsigned int v = voffset[ix];
+    float u1;
+    for (int a = 0; a < 3; a++)
+        if (edgeCrosses(f, i, a, u0, u1)) {
+            const float3 w1 = f.worldCoords(i.x + (a == 0), i.y + (a == 1), i.z + (a == 2));
+            vertices[v++] = w0 + (w1 - w0) * (u0 / (u0 - u1));
+        }
+}
+
+template<unsigned char _bins>
+__global__ void FusionMeshTriangles_kernel(fusionData<_bins> f, const unsigned int * __restrict__ voffset,
+                                           const unsigned int * __restrict__ toffset, uint3 * __restrict__ triangles)
+{
+    const int ix = getGlobalIdx();
+    if ((size_t)ix >= f.elements()) return;
+    const int3 i = f.indexes(ix);
+
+    const int cube = cellConfiguration(f, i);
+    if (cube <= 0) return;
+
+    unsigned int t = toffset[ix];
+    unsigned int idx[3];
+    float u1;
+    for (int k = 0; c_mcTable[cube][k] >= 0; k += 3) {
+        for (int j = 0; j < 3; j++) {
+            // Vertex index is offset of owning voxel plus number of its crossing edges along preceding axes
+            const int e = c_mcTable[cube][k + j], c = c_mcEdgeOwner[e], axis = c_mcEdgeAxis[e];
+            const int3 o = make_int3(i.x + ((c & 1) ^ ((c >> 1) & 1)), i.y + ((c >> 1) & 1), i.z + (c >> 2));
+            const float u0 = f.u(o.x, o.y, o.z);
+            unsigned int v = voffset[o.x + o.y * f.width() + o.z * f.width() * f.height()];
+            for (int a = 0; a < axis; a++) v += edgeCrosses(f, o, a, u0, u1);
+            idx[j] = v;
+        }
+        triangles[t++] = make_uint3(idx[0], idx[1], idx[2]);
+    }
+}
+
+template<unsigned char _bins>
+void FusionExtractMesh(fusionData<_bins> f, fusionMesh & mesh, dim3 blocks, dim3 threads, cudaStream_t stream)
+{
+    const size_t n = f.elements();
+    unsigned int * vcount = mesh.scratch(n);
+    unsigned int * tcount = vcount + n;
+    unsigned int last[4];
+
+    FusionMeshClassify_kernel<_bins><<<blocks, threads, 0, stream>>>(f, vcount, tcount);
+    CHECK_CUDA_ERRORS_AUTO(cudaMemcpyAsync(last, vcount + n - 1, sizeof(unsigned int), cudaMemcpyDeviceToHost, stream));
+    CHECK_CUDA_ERRORS_AUTO(cudaMemcpyAsync(last + 1, tcount + n - 1, sizeof(unsigned int), cudaMemcpyDeviceToHost, stream));
+
+    // In place exclusive scans turn counts into offsets
+    thrust::device_ptr<unsigned int> v(vcount), t(tcount);
+    thrust::exclusive_scan(thrust::cuda::par.on(stream), v, v + n, v);
+    thrust::exclusive_scan(thrust::cuda::par.on(stream), t, t + n, t);
+    CHECK_CUDA_ERRORS_AUTO(cudaMemcpyAsync(last + 2, vcount + n - 1, sizeof(unsigned int), cudaMemcpyDeviceToHost, stream));
+    CHECK_CUDA_ERRORS_AUTO(cudaMemcpyAsync(last + 3, tcount + n - 1, sizeof(unsigned int), cudaMemcpyDeviceToHost, stream));
+    CHECK_CUDA_ERRORS_AUTO(cudaStreamSynchronize(stream));
+
+    mesh.resize(last[0] + last[2], last[1] + last[3]);
+    if (mesh.triangleCount() == 0) return;
+
+    FusionMeshVertices_kernel<_bins><<<blocks, threads, 0, stream>>>(f, vcount, mesh.vertices());
+    FusionMeshTriangles_kernel<_bins><<<blocks, threads, 0, stream>>>(f, vcount, tcount, mesh.triangles());
+}
@@ -0,0 +1,148 @@
+#include "image_loader.h"
+#include "nvtx_range.h"
+#include <algorithm>
+
+ImageLoader & ImageLoader::instance()
+{
+    static ImageLoader loader;
+    return loader;
+}
+
+ImageLoader::ImageLoader(unsigned int threads, unsigned int lookahead)
+    : lookahead_(std::max(lookahead, 1u)), stop_(false)
+{
+    if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned int i = 0; i < threads; i++) workers_.emplace_back(&ImageLoader::work, this);
+}
+
+ImageLoader::~ImageLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        queue_.clear();
+    }
+    queued_.notify_all();
+    for (size_t i = 0; i < workers_.size(); i++) workers_[i].join();
+}
+
+void ImageLoader::request(const QString & fname, bool pin)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = slots_.find(fname);
+        if (it != slots_.end()) {
+            // Pinning an earlier look-ahead request takes it out of eviction order
+            if (pin && !it->second->pinned) {
+                it->second->pinned = true;
+                order_.erase(std::find(order_.begin(), order_.end(), fname));
+            }
+            return;
+        }
+        std::shared_ptr<Slot> slot = std::make_shared<Slot>();
+        slot->pinned = pin;
+        slots_[fname] = slot;
+        queue_.push_back(fname);
+        if (!pin) order_.push_back(fname);
+        evict();
+    }
+    queued_.notify_one();
+}
+
+void ImageLoader::request(const QStringList & fnames, bool pin)
+{
+    for (int i = 0; i < fnames.size(); i++) request(fnames.at(i), pin);
+}
+
+bool ImageLoader::take(const QString & fname, Frame & frame)
+{
+    std::shared_ptr<Slot> slot;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = slots_.find(fname);
+        if (it != slots_.end()) {
+            slot = it->second;
+            slots_.erase(it);
+            if (!slot->pinned) order_.erase(std::find(order_.begin(), order_.end(), fname));
+
+            // Not started yet, decode here instead of waiting for a worker
+            auto q = std::find(queue_.begin(), queue_.end(), fname);
+            if (q != queue_.end()) {
+                queue_.erase(q);
+                slot.reset();
+            }
+            else decoded_.wait(lock, [&slot]{ return slot->done; });
+        }
+    }
+
+    if (!slot) return decode(fname, frame);
+    frame = std::move(slot->frame);
+    return frame.loaded;
+}
+
+void ImageLoader::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.clear();
+    order_.clear();
+    slots_.clear();
+}
+
+bool ImageLoader::decode(const QString & fname, Frame & frame)
+{
+    NVTX_RANGE("decode image", NvtxIO);
+    frame.gray.clear();
+    frame.loaded = frame.image.load(fname);
+    if (!frame.loaded) return false;
+
+    // Weighted grayscale straight from 32 bit scanlines
+    QImage rgb = frame.image.convertToFormat(QImage::Format_RGB32);
+    const int w = rgb.width(), h = rgb.height();
+    frame.gray.resize((size_t)w * h);
+    for (int y = 0; y < h; y++) {
+        const QRgb * line = (const QRgb *)rgb.constScanLine(y);
+        float * g = frame.gray.data() + (size_t)y * w;
+        for (int x = 0; x < w; x++)
+            g[x] = float(RGB2GRAY_WEIGHT_RED * qRed(line[x]) + RGB2GRAY_WEIGHT_GREEN * qGreen(line[x]) +
+                         RGB2GRAY_WEIGHT_BLUE * qBlue(line[x]));
+    }
+    return true;
+}
+
+void ImageLoader::work()
+{
+    for (;;) {
+        QString fname;
+        std::shared_ptr<Slot> slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            queued_.wait(lock, [this]{ return stop_ || !queue_.empty(); });
+            if (stop_) return;
+            fname = queue_.front();
+            queue_.pop_front();
+            slot = slots_[fname];
+        }
+
+        // Slot is kept alive by this worker even if it is evicted meanwhile
+        Frame frame;
+        decode(fname, frame);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            slot->frame = std::move(frame);
+            slot->done = true;
+        }
+        decoded_.notify_all();
+    }
+}
+
+void ImageLoader::evict()
+{
+    while (order_.size() > lookahead_) {
+        const QString fname = order_.front();
+        order_.pop_front();
+        slots_.erase(fname);
+        auto q = std::find(queue_.begin(), queue_.end(), fname);
+        if (q != queue_.end()) queue_.erase(q);
+    }
+}
@@ -3,23 +3,34 @@
 
 #include "image.h"
 #include "structs.h"
+#include "defines.h"
 
-template<typename T>
-struct CamImage : public Image<T, Standard>
+/**
+ *  \brief Host image with camera rotation and translation
+ *
+ *  \tparam T      type of data to work with
+ *  \tparam memT   host data location, \a Host allocates pinned memory so \a copyFromAsync / \a copyToAsync
+ * transfers do not need pageable staging and can overlap with kernel execution
+ *
+ *  \details Default memory kind is set by \a CAM_IMAGE_MEMORY. Pinned memory belongs to the CUDA context,
+ * so pinned images have to be reallocated after \a cudaDeviceReset().
+ */
+template<typename T, MemoryKind memT = CAM_IMAGE_MEMORY>
+struct CamImage : public Image<T, memT>
 {
     Matrix3D R;
     Vector3D t;
 
     virtual ~CamImage() { free(); }
 
-    template<MemoryKind memT>
+    template<MemoryKind memFrom>
     inline __host__ __device__
-    CamImage( const Image<T,memT>& img )
+    CamImage( const Image<T,memFrom>& img )
         : Image(img), R(), t()
     {}
 
     inline __host__ __device__
-    CamImage( const CamImage<T>& img )
+    CamImage( const CamImage<T,memT>& img )
         : Image(img), R(img.R), t(img.t)
     {}
 
@@ -31,9 +42,7 @@ struct CamImage : public Image<T, Standard>
     inline __host__
     CamImage(size_t w, size_t h)
         : Image(w, h), R(), t()
-    {
-       Malloc(ptr_, w_, h_, pitch_);
-    }
+    {}
 
     inline __device__ __host__
     CamImage(T* ptr)
@@ -0,0 +1,128 @@
+/**
+ *  \file compute_worker.h
+ *  \brief Header file containing background thread running reconstruction jobs off the GUI thread
+ */
+#ifndef COMPUTE_WORKER_H
+#define COMPUTE_WORKER_H
+
+#include <QObject>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+/**
+ *  \brief Queue of compute jobs run one after another on a single worker thread
+ *
+ *  \details The worker thread makes the CUDA device that was current when the worker was created current for itself,
+ * so all jobs share the device and context of the objects they use, e.g. \a PlaneSweep. Objects used by jobs must
+ * only be touched by other threads while the worker is idle, i.e. after \a wait(). Signals are emitted from the
+ * worker thread and are delivered queued to receivers living in the GUI thread, by then the worker may already run
+ * the next job, so \a finished() handlers must only read results the job copied out of the shared objects.
+ */
+class ComputeWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** \brief Kind of job, passed back with the signals */
+    enum JobType{
+        JobSweep = 0,   //!< planesweep
+        JobDenoise,     //!< TVL1 denoising
+        JobTGV,         //!< TGV
+        JobFusion,      //!< single depthmap fusion step
+        JobOther        //!< anything else
+    };
+
+    /** \brief Job function, returns success/failure */
+    typedef std::function<bool()> job_type;
+
+    /**
+     *  \brief Constructor, starts worker thread
+     *
+     *  \param parent parent object
+     */
+    explicit ComputeWorker(QObject * parent = 0);
+
+    /** \brief Destructor, cancels pending jobs, waits for the running one and joins worker thread */
+    ~ComputeWorker();
+
+    /**
+     *  \brief Queue job
+     *
+     *  \param type    kind of job
+     *  \param job     job function, must own or share everything it uses
+     *  \param replace drop pending jobs of the same \p type first, e.g. for parameter changes that make them stale
+     *  \return Job id, passed back with the signals
+     *
+     *  \details Dropped jobs emit \a finished() with \p success false.
+     */
+    unsigned int submit(JobType type, job_type job, bool replace = false);
+
+    /**
+     *  \brief Cancel pending jobs and request the running one to stop
+     *
+     *  \return No return value
+     *
+     *  \details Dropped jobs emit \a finished() with \p success false, without \a started(). Running job finishes
+     * normally unless it polls \a cancelled().
+     * Cancellation request is cleared when the next job starts.
+     */
+    void cancel();
+
+    /** \brief Check if cancellation of the running job was requested, polled by long jobs */
+    bool cancelled() const { return cancel_; }
+
+    /** \brief Check if a job is running or pending */
+    bool busy();
+
+    /** \brief Wait until all jobs are done */
+    void wait();
+
+    /**
+     *  \brief Report progress of the running job, emits \a progress()
+     *
+     *  \param done  finished steps
+     *  \param total total number of steps
+     *  \return No return value
+     */
+    void reportProgress(int done, int total);
+
+signals:
+    /** \brief Emitted when job \p id starts running */
+    void started(unsigned int id, int type);
+
+    /** \brief Emitted by \a reportProgress() of job \p id */
+    void progress(unsigned int id, int done, int total);
+
+    /** \brief Emitted when job \p id is done, \p success is false if it failed or threw */
+    void finished(unsigned int id, int type, bool success);
+
+protected:
+    struct Job
+    {
+        unsigned int id;
+        JobType type;
+        job_type run;
+    };
+
+    void work();
+
+    std::thread worker_;
+    std::deque<Job> jobs_;
+    std::mutex mutex_;
+    std::condition_variable queued_, done_;
+    std::atomic<bool> cancel_;
+    unsigned int next_, current_;
+    int device_;
+    bool running_;
+    bool stop_;
+
+private:
+    ComputeWorker(const ComputeWorker &);
+    ComputeWorker & operator=(const ComputeWorker &);
+};
+
+#endif // COMPUTE_WORKER_H
@@ -0,0 +1,103 @@
+/**
+ *  \file cpu_engine.h
+ *  \brief Header file containing multithreaded CPU planesweep and TVL1 denoising used when there is no CUDA device
+ */
+#ifndef CPU_ENGINE_H
+#define CPU_ENGINE_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include "structs.h"
+
+/**
+ *  \brief Planesweep and TVL1 denoising on the CPU with the results of the default CUDA path up to float rounding
+ *
+ *  \details Work is split into tiles of \a CPU_TILE_ROWS rows, which a pool of worker threads takes from a shared
+ * counter. Planesweep tiles are fused: warped rows of the tile and its window halo, their windowed sums and the NCC of
+ * a plane are computed on row buffers of the tile, so intermediate images stay in cache. Inner loops run over
+ * contiguous rows without branches so the compiler vectorizes them, configure with \a CPU_NATIVE to target AVX2 or
+ * NEON of the build host.
+ */
+class CpuEngine
+{
+public:
+    /**
+     *  \brief Constructor, starts worker threads
+     *
+     *  \param threads number of threads including the calling one, 0 for hardware concurrency
+     */
+    explicit CpuEngine(unsigned int threads = 0);
+
+    /** \brief Destructor, joins worker threads */
+    ~CpuEngine();
+
+    CpuEngine(const CpuEngine &) = delete;
+    CpuEngine & operator=(const CpuEngine &) = delete;
+
+    /** \brief Get number of threads including the calling one */
+    unsigned int threads() const { return (unsigned int)workers_.size() + 1; }
+
+    /**
+     *  \brief Planesweep of all source views with NCC, same as \a PlaneSweep::RunAlgorithm() with default settings
+     *
+     *  \param depth     output depthmap of \p width x \p height, \p zfar where no view passed \p nccthresh
+     *  \param ref       reference grayscale in [0, 255]
+     *  \param src       grayscale of all source views
+     *  \param H         homographies of all source views and planes, view major, see \a PlaneSweep::HomographyTable()
+     *  \param depths    depths of all planes
+     *  \param width     image width
+     *  \param height    image height
+     *  \param winsize   NCC window side length
+     *  \param stdthresh standard deviation threshold for both views
+     *  \param nccthresh NCC threshold of a view to contribute to the averaged depth
+     *  \param zfar      depth of pixels without contributing views
+     *  \return No return value
+     */
+    void planesweep(float * depth, const float * ref, const std::vector<const float *> & src,
+                    const std::vector<Matrix3D> & H, const std::vector<float> & depths, const int width,
+                    const int height, const unsigned int winsize, const float stdthresh, const float nccthresh,
+                    const float zfar);
+
+    /**
+     *  \brief TVL1 denoising with anisotropic diffusion tensor, same as \a PlaneSweep::CudaDenoise()
+     *
+     *  \param u      output denoised depthmap of \p width x \p height
+     *  \param raw    raw depthmap
+     *  \param guide  reference grayscale in [0, 1] the diffusion tensor is computed from
+     *  \param width  image width
+     *  \param height image height
+     *  \param niters number of iterations
+     *  \param lambda data term weight
+     *  \param tau    primal step
+     *  \param sigma  dual step
+     *  \param theta  extrapolation factor
+     *  \param beta   tensor edge weight
+     *  \param gamma  tensor edge exponent
+     *  \param znear  smallest depth
+     *  \param zfar   largest depth
+     *  \return No return value
+     */
+    void tvl1(float * u, const float * raw, const float * guide, const int width, const int height,
+              const unsigned int niters, const float lambda, const float tau, const float sigma, const float theta,
+              const float beta, const float gamma, const float znear, const float zfar);
+
+protected:
+    // Runs task(0) ... task(count - 1) on all threads, returns when all are done
+    void parallel(int count, const std::function<void(int)> & task);
+    void work();
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_, done_;
+    const std::function<void(int)> * task_ = 0;
+    int count_ = 0;
+    std::atomic<int> next_;
+    unsigned int busy_ = 0, generation_ = 0;
+    bool stop_ = false;
+};
+
+#endif // CPU_ENGINE_H
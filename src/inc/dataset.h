@@ -0,0 +1,65 @@
+/**
+ *  \file dataset.h
+ *  \brief Header file containing ICL-NUIM style dataset access of the headless tools
+ */
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <QString>
+#include "frame_cache.h"
+#include "pose_index.h"
+
+class PlaneSweep;
+
+/**
+ *  \brief Numbered images and camera files of a dataset directory, decoded frames are cached
+ *
+ *  \details Frames are looked up the same way as in the viewer, pose index first and camera files if the frame is
+ * not in it.
+ */
+struct Dataset
+{
+    QString dir, name, format;  //!< directory, image file name before number and image file extension
+    int digits = 4;             //!< number of digits in image file names
+    FrameCache frames;
+    PoseIndex poses;
+
+    /**
+     *  \brief Get image file name of a frame
+     *
+     *  \param number frame number
+     *  \param impos  camera file name returned by reference
+     *  \return Image file name
+     */
+    QString imageName(int number, QString & impos) const;
+
+    /**
+     *  \brief Queue decoding of a frame unless it is cached
+     *
+     *  \param number frame number
+     *  \param pin    keep the decoded frame in the loader until it is loaded, see \a ImageLoader::request()
+     *  \return No return value
+     */
+    void request(int number, bool pin = false);
+
+    /**
+     *  \brief Get decoded frame with camera
+     *
+     *  \param number frame number
+     *  \return Cached frame, empty if image or camera are missing
+     */
+    FrameCache::value_ptr load(int number);
+
+    /**
+     *  \brief Load sweep window of a reference frame into planesweep host images, next window is decoded ahead
+     *
+     *  \param ps      planesweep whose \a HostRef, \a HostSrc and K are set
+     *  \param refn    reference frame number
+     *  \param nimages number of images in the window including the reference
+     *  \param step    step to the next reference frame
+     *  \return True if the reference and at least one source view were loaded
+     */
+    bool loadWindow(PlaneSweep & ps, int refn, int nimages, int step);
+};
+
+#endif // DATASET_H
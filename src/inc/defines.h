@@ -29,12 +29,76 @@
 #define DEFAULT_STD_THRESHOLD       0.0001f
 #define DEFAULT_NCC_THRESHOLD       0.5f
 #define NO_DEPTH                    -1
+#define DEFAULT_PYRAMID_LEVELS      1 // coarse to fine planesweep disabled
+#define DEFAULT_PYRAMID_BAND        3
+#define DEFAULT_TEMPORAL_BAND       3 // planes tested on each side of the depth predicted from the previous frame
+#define CENSUS_WINDOW               7 // census descriptor window side length
+#define CENSUS_BITS                 (CENSUS_WINDOW * CENSUS_WINDOW - 1) // descriptor bits, at most 64
+#define RECTIFIED_TOLERANCE         1e-3f // rotation and off-axis translation of views detected as rectified
+#define DEFAULT_PATCHMATCH_ITERATIONS 4 // red and black passes of PatchMatch
+#define DEFAULT_PATCHMATCH_VIEWS    2 // best source views averaged per pixel by PatchMatch
+#define PATCHMATCH_MAX_VIEWS        8 // source views evaluated by PatchMatch
+#define PATCHMATCH_REFINE_SAMPLES   2 // random perturbations tested per pixel and pass
+#define DEFAULT_SGM_PATHS           8 // semi-global aggregation paths, 4 or 8
+#define DEFAULT_SGM_P1              8 // penalty of neighbouring planes in 8 bit cost units
+#define DEFAULT_SGM_P2              48 // penalty of plane jumps in 8 bit cost units
+#define SGM_MAX_PLANES              256 // planes of a cost volume kept in registers of one warp
+#define SGM_WARPS_PER_BLOCK         4 // aggregation traces per block
+#define SGM_COST_SCALE              127.5f // 8 bit cost of NCC ncc is (1 - ncc) * SGM_COST_SCALE
+#define SUBPLANE_NONE               -3.0e38f // sub-plane score of a plane that was not swept
+#define SUBPLANE_PENDING            3.0e38f // sub-plane score of the plane after the best one until it is swept
 
 // Default GPU parameters
 #define NO_CUDA_DEVICE              -1
 #define MAX_THREADS_PER_BLOCK       512
 #define MAX_PLANESWEEP_THREADS      1 // multithreading does not reduce execution time
 #define DEFAULT_BLOCK_XDIM          32
+#define DEFAULT_SLIDING_MEAN_SEGMENT 32 // elements per thread in sliding window mean kernels
+#define DEFAULT_SLIDING_MEAN_ROWS 4 // rows per block of the row wise sliding mean, one warp of threads per row
+#define SLIDING_MEAN_ROW_THREADS 32 // threads per row of the row wise sliding mean
+#define SLIDING_MEAN_MAX_SHARED 49152 // shared memory bytes of a row wise sliding mean block, larger windows fall back
+#define CPU_TILE_ROWS               16 // rows of a tile processed by one CPU fallback thread
+#ifndef CAM_IMAGE_MEMORY
+#define CAM_IMAGE_MEMORY            Standard // memory kind of CamImage, Host allocates pinned memory
+#endif
+
+// Device memory planner parameters
+#define DEFAULT_MEMORY_HEADROOM     0.9 // fraction of available device memory a call may plan with
+#define DEFAULT_STRIP_HALO          32 // rows computed above and below each strip of iterative solvers
+#define MIN_STRIP_ROWS              16 // smallest number of kept rows per strip
+
+// Launch configuration autotuner parameters
+#define DEFAULT_LAUNCH_TUNER_CACHE  "launch_tuning.txt" // tuned block dimensions per device name
+#define DEFAULT_LAUNCH_TUNER_TRIALS 3 // timed launches per candidate after a warm-up launch
+#define MIN_LAUNCH_TUNER_THREADS    64 // smallest candidate block, two warps
+
+// Runtime kernel specialization parameters
+#define DEFAULT_JIT_CACHE_DIR       "jit_cache" // PTX of compiled configurations, one file per hash
+
+// Image loader thread pool parameters
+#define DEFAULT_LOADER_THREADS      0  // decoding threads, 0 uses hardware concurrency
+#define DEFAULT_LOADER_LOOKAHEAD    32 // images kept decoded ahead of use
+#define DEFAULT_FRAME_CACHE_SIZE    32 // decoded frames kept for overlapping sweep windows
+
+// Binary pose index file format
+#define POSE_INDEX_MAGIC            "PSPOSES"
+#define POSE_INDEX_VERSION          1
+#define POSE_INDEX_EXTENSION        ".poses" // appended to image file name prefix of ICL-NUIM style datasets
+#define KITTI_POSE_INDEX_NAME       "/oxts/poses.index"
+
+// Depthmap files written by ResultWriter
+#define DEPTH_FILE_MAGIC            "PSDEPTH"
+#define DEPTH_FILE_VERSION          1
+#define DEPTH_FILE_EXTENSION        ".dmap"
+#define DEFAULT_WRITER_QUEUE        8 // pending writes before submitting blocks
+#define DEFAULT_ZSTD_LEVEL          1 // fast compression level, depthmaps are written every frame
+#ifndef SAVE_FUSION_DEPTHMAPS
+#define SAVE_FUSION_DEPTHMAPS       0 // write float depthmap of every fused frame
+#endif
+
+// TUM RGB-D dataset
+#define TUM_GROUNDTRUTH_NAME        "groundtruth.txt" // next to rgb text file
+#define TUM_MAX_TIME_DIFFERENCE     0.02 // seconds between image and groundtruth timestamps to associate them
 
 // Default TVL1 denoising parameters
 #define DEFAULT_TVL1_ITERATIONS     100
@@ -55,6 +119,12 @@
 #define DEFAULT_TGV_TAU             0.02
 #define DEFAULT_TGV_BETA            0.f
 #define DEFAULT_TGV_GAMMA           1.f
+#define DEFAULT_TGV_PYRAMID_LEVELS  1 // coarse to fine TGV disabled
+#define DEFAULT_TGV_PYRAMID_WARPS   2 // warps at full resolution of coarse to fine TGV
+
+// Default TVL1 / TGV2 stopping criterion parameters
+#define DEFAULT_CONVERGENCE_TOLERANCE 0.f // relative change of u, 0 runs all iterations
+#define DEFAULT_CONVERGENCE_INTERVAL  10  // iterations between checks
 
 // Default fusion parameters
 #define DEFAULT_FUSION_SD_THRESHOLD 0.05
@@ -63,6 +133,7 @@
 #define DEFAULT_FUSION_SIGMA        1.f
 #define DEFAULT_FUSION_IMSTEP       3
 #define DEFAULT_FUSION_ITERATIONS   50
+#define DEFAULT_FUSION_MIN_CONFIDENCE 0.5f // fraction of source views that have to match a fused depthmap pixel
 
 // Default fusion kernel parameters
 #define DEFAULT_FUSION_THREADS_X    16
@@ -81,4 +152,40 @@
 #define DEFAULT_FUSION_VOLUME_Y2    2.9
 #define DEFAULT_FUSION_VOLUME_Z2    4.2
 
+// Number of views integrated by single batched histogram update kernel
+#define FUSION_BATCH_VIEWS          16
+
+// Number of z slices marched by single block of tiled fusion stencil kernels
+#define FUSION_STENCIL_SLICES       16
+
+// Size in bytes of constant memory fusionData descriptor bound by fusion kernel wrappers
+#define FUSION_DESCRIPTOR_BYTES     512
+
+// Frustum culled histogram update brick side in voxels
+#define FUSION_CULL_BRICK_SIZE      8
+
+// Sparse (voxel block hashing) fusion parameters
+#define FUSION_HASH_BLOCK_SIZE      8 // voxels per block side
+#define FUSION_HASH_BLOCK_VOXELS    (FUSION_HASH_BLOCK_SIZE * FUSION_HASH_BLOCK_SIZE * FUSION_HASH_BLOCK_SIZE)
+#define FUSION_HASH_EMPTY           0xFFFFFFFFFFFFFFFFull // empty hash table slot key
+#define DEFAULT_FUSION_HASH_BLOCKS  0 // block pool capacity, 0 covers the volume within available device memory
+
+// Out-of-core (host paged bricks) fusion parameters
+#define DEFAULT_FUSION_BRICK_SIZE   32   // voxels per brick side
+#define DEFAULT_FUSION_BRICK_BUDGET 1024 // device window size in MB
+
+// Fusion volume checkpoint file format
+#define FUSION_FILE_MAGIC           "PSFUSION"
+#define FUSION_FILE_VERSION         1
+#define FUSION_FILE_ALIGNMENT       4096 // payload offset alignment in bytes
+
+// Initial capacity of extracted fusion surface point buffer
+#define DEFAULT_FUSION_SURFACE_POINTS (1 << 20)
+
+// Level of detail view of fusion surface
+#define DEFAULT_FUSION_LOD_POINTS   (1 << 19) // point budget of the whole view
+#define DEFAULT_FUSION_VIEW_INTERVAL 1000     // minimum time between view refreshes in ms
+#define FUSION_LOD_BLOCK_SIZE       64        // voxels per view block side, power of 2
+#define FUSION_LOD_THREADS          8         // threads per block side of decimation kernels
+
 #endif // DEFINES_H
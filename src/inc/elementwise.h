@@ -0,0 +1,81 @@
+/**
+ *  \file elementwise.h
+ *  \brief Header file containing flat float4 kernel of element wise wrappers in kernels.cu and TGV2_kernels.cu
+ */
+#ifndef ELEMENTWISE_H
+#define ELEMENTWISE_H
+
+#include <cuda_runtime_api.h>
+#include <algorithm>
+
+template<typename Op>
+__device__ inline float4 elementwise4(const Op & op, const float4 o, const float4 a, const float4 b)
+{
+    return make_float4(op(o.x, a.x, b.x), op(o.y, a.y, b.y), op(o.z, a.z, b.z), op(o.w, a.w, b.w));
+}
+
+// Images are dense, so element wise kernels see them as flat arrays whatever their width. Threads below n4 handle four
+// elements with float4 loads and stores, threads below n - 4 * n4 one element of the remainder. Output may alias an
+// input, each element is read before it is written by the same thread.
+template<typename Op>
+__global__ void elementwise_kernel(float * d_output, const float * d_input1, const float * d_input2, const Op op,
+                                   const int n4, const int n)
+{
+    const int i = threadIdx.x + blockDim.x * blockIdx.x;
+    const float4 zero = make_float4(0.f, 0.f, 0.f, 0.f);
+
+    if (i < n4) {
+        const float4 o = Op::output ? reinterpret_cast<const float4 *>(d_output)[i] : zero;
+        const float4 a = Op::inputs > 0 ? reinterpret_cast<const float4 *>(d_input1)[i] : zero;
+        const float4 b = Op::inputs > 1 ? reinterpret_cast<const float4 *>(d_input2)[i] : zero;
+        const float4 r = elementwise4(op, o, a, b);
+
+        // Bitwise comparison, so QNANs compare equal and unchanged vectors are not stored
+        const bool changed = !Op::output || (__float_as_int(r.x) != __float_as_int(o.x)) ||
+                             (__float_as_int(r.y) != __float_as_int(o.y)) || (__float_as_int(r.z) != __float_as_int(o.z)) ||
+                             (__float_as_int(r.w) != __float_as_int(o.w));
+        if (changed) reinterpret_cast<float4 *>(d_output)[i] = r;
+    }
+
+    const int k = 4 * n4 + i;
+    if (k < n) {
+        const float o = Op::output ? d_output[k] : 0.f;
+        const float r = op(o, Op::inputs > 0 ? d_input1[k] : 0.f, Op::inputs > 1 ? d_input2[k] : 0.f);
+        if (!Op::output || (__float_as_int(r) != __float_as_int(o))) d_output[k] = r;
+    }
+}
+
+/**
+ *  \brief Apply element wise operation to dense arrays
+ *
+ *  \param d_output pointer to output data, may be the same as an input
+ *  \param d_input1 pointer to input data 1, ignored unless \a Op::inputs > 0
+ *  \param d_input2 pointer to input data 2, ignored unless \a Op::inputs > 1
+ *  \param op       operation functor
+ *  \param width    width of given arrays
+ *  \param height   height of given arrays
+ *  \param threads  block dimensions of the calling wrapper, only their number of threads is used
+ *  \param stream   stream to launch kernel in
+ *  \return No return value
+ *
+ *  \details An operation is a functor <em>float operator()(float o, float a, float b) const</em> of the old output
+ * value and the values of up to two inputs of an element. Its static member \a inputs is the number of read input
+ * arrays and \a output is true if the old output value is read, unchanged output values are not written back then.
+ * Accesses are float4 if all read arrays are 16 byte aligned, otherwise, e.g. for odd row offsets into strips, single
+ * floats.
+ */
+template<typename Op> inline
+void elementwise(float * d_output, const float * d_input1, const float * d_input2, const Op & op,
+                 const int width, const int height, dim3 threads, cudaStream_t stream = 0)
+{
+    auto aligned = [](const void * p){ return ((size_t)p % sizeof(float4)) == 0; };
+    const int n = width * height;
+    const bool vec = aligned(d_output) && ((Op::inputs < 1) || aligned(d_input1)) && ((Op::inputs < 2) || aligned(d_input2));
+    const int n4 = vec ? n / 4 : 0;
+    const int count = std::max(n4, n - 4 * n4);
+    const int t = threads.x * threads.y * threads.z;
+    if (count <= 0) return;
+    elementwise_kernel<<<(count + t - 1) / t, t, 0, stream>>>(d_output, d_input1, d_input2, op, n4, n);
+}
+
+#endif // ELEMENTWISE_H
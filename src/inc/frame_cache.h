@@ -0,0 +1,137 @@
+/**
+ *  \file frame_cache.h
+ *  \brief Header file containing least recently used cache of loaded frames
+ */
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <QString>
+#include <QImage>
+#include "structs.h"
+#include "defines.h"
+
+/**
+ *  \brief Decoded frame with its camera parameters
+ */
+struct CachedFrame
+{
+    QString name;               //!< image file name, identifies the dataset the frame was loaded from
+    QImage image;               //!< decoded image
+    std::vector<float> gray;    //!< row major grayscale of \a image
+    Matrix3D K;                 //!< camera calibration matrix
+    Matrix3D R;                 //!< rotation from world to camera coordinates
+    Vector3D t;                 //!< translation from world to camera position
+};
+
+/**
+ *  \brief Least recently used cache
+ *
+ *  \tparam _key   key type, has to be ordered
+ *  \tparam _value cached value type, values are shared so evicting does not invalidate values still in use
+ *
+ *  \details Used to keep frames of overlapping sweep windows, so only frames entering the window are loaded
+ */
+template<typename _key, typename _value>
+class LRUCache
+{
+public:
+    typedef std::shared_ptr<const _value> value_ptr;
+
+    /**
+     *  \brief Constructor
+     *
+     *  \param capacity maximum number of cached values
+     */
+    explicit LRUCache(size_t capacity = DEFAULT_FRAME_CACHE_SIZE) : capacity_(capacity) {}
+
+    /**
+     *  \brief Find cached value and mark it as most recently used
+     *
+     *  \param key key of the value
+     *  \return Cached value or empty pointer if it is not cached
+     */
+    value_ptr find(const _key & key)
+    {
+        auto it = index_.find(key);
+        if (it == index_.end()) return value_ptr();
+        order_.splice(order_.begin(), order_, it->second);
+        return it->second->second;
+    }
+
+    /**
+     *  \brief Check if value is cached without changing its use order
+     *
+     *  \param key key of the value
+     *  \return True if value is cached
+     */
+    bool contains(const _key & key) const { return index_.count(key) != 0; }
+
+    /**
+     *  \brief Cache value as most recently used, evicting least recently used values over capacity
+     *
+     *  \param key   key of the value
+     *  \param value value to cache, replaces value cached under the same key
+     *  \return No return value
+     */
+    void insert(const _key & key, value_ptr value)
+    {
+        erase(key);
+        order_.push_front(std::make_pair(key, value));
+        index_[key] = order_.begin();
+        trim();
+    }
+
+    /** \brief Remove value from cache */
+    void erase(const _key & key)
+    {
+        auto it = index_.find(key);
+        if (it == index_.end()) return;
+        order_.erase(it->second);
+        index_.erase(it);
+    }
+
+    /** \brief Remove all values */
+    void clear()
+    {
+        order_.clear();
+        index_.clear();
+    }
+
+    /** \brief Set maximum number of cached values */
+    void setCapacity(size_t capacity)
+    {
+        capacity_ = capacity;
+        trim();
+    }
+
+    /** \brief Get maximum number of cached values */
+    size_t capacity() const { return capacity_; }
+
+    /** \brief Get number of cached values */
+    size_t size() const { return index_.size(); }
+
+protected:
+    typedef std::list<std::pair<_key, value_ptr>> list_type;
+
+    void trim()
+    {
+        while (index_.size() > capacity_) {
+            index_.erase(order_.back().first);
+            order_.pop_back();
+        }
+    }
+
+    size_t capacity_;
+    list_type order_;
+    std::map<_key, typename list_type::iterator> index_;
+};
+
+/** \brief Frame cache keyed by image number */
+typedef LRUCache<int, CachedFrame> FrameCache;
+
+#endif // FRAME_CACHE_H
@@ -9,6 +9,8 @@
 #include <cuda_runtime_api.h>
 #include <cuda.h>
 #include "fusion.h"
+#include "fusion_hash.h"
+#include "defines.h"
 
 /** \addtogroup fusion  Depthmap fusion
 * \brief Depthmap fusion functions running on GPU
@@ -33,13 +35,15 @@
  *  \param height       height of depthmap
  *  \param blocks       kernel grid dimensions
  *  \param threads      single block dimensions
+ *  \param stream       CUDA stream to launch kernel on
  *  \return No return value
  *
  *  \details Signed distance is clamped to [-threshold,threshold] and divided by \a threshold before updating any histogram bins.
  */
 template<unsigned char _bins>
 void FusionUpdateHistogram(fusionData<_bins> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
-                           const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads);
+                           const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads,
+                           cudaStream_t stream = 0);
 
 /**
  *  \brief Update primal variable \f$u\f$ and helper variable \f$v\f$ using histogram depthmap fusion algorithm
@@ -49,12 +53,14 @@ void FusionUpdateHistogram(fusionData<_bins> f, const float * depthmap, const Ma
  *  \param lambda  fusion parameter \f$\lambda\f$
  *  \param blocks  kernel grid dimensions
  *  \param threads single block dimensions
+ *  \param stream  CUDA stream to launch kernel on
  *  \return No return value
  *
  *  \details
  */
 template<unsigned char _bins>
-void FusionUpdateU(fusionData<_bins> f, const double tau, const double lambda, dim3 blocks, dim3 threads);
+void FusionUpdateU(fusionData<_bins> f, const double tau, const double lambda, dim3 blocks, dim3 threads,
+                   cudaStream_t stream = 0);
 
 /**
  *  \brief Update dual variable \f$p\f$ using histogram depthmap fusion algorithm
@@ -63,12 +69,97 @@ void FusionUpdateU(fusionData<_bins> f, const double tau, const double lambda, d
  *  \param sigma   fusion parameter \f$\sigma\f$
  *  \param blocks  kernel grid dimensions
  *  \param threads single block dimensions
+ *  \param stream  CUDA stream to launch kernel on
  *  \return No return value
  *
  *  \details
  */
 template<unsigned char _bins>
-void FusionUpdateP(fusionData<_bins> f, const double sigma, dim3 blocks, dim3 threads);
+void FusionUpdateP(fusionData<_bins> f, const double sigma, dim3 blocks, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Update primal variable \f$u\f$ with tiled stencil kernel
+ *
+ *  \param f       \p fusionData
+ *  \param tau     fusion parameter \f$\tau\f$
+ *  \param lambda  fusion parameter \f$\lambda\f$
+ *  \param threads tile dimensions, \a threads.z is ignored
+ *  \param stream  CUDA stream to launch kernel on
+ *  \return No return value
+ *
+ *  \details Same result as \a FusionUpdateU(). Each block stages \f$p\f$ of a \a threads.x x \a threads.y tile with
+ * a one voxel halo in shared memory and marches FUSION_STENCIL_SLICES slices along z keeping the previous slice in
+ * registers, so each \f$p\f$ is loaded from global memory about once instead of up to four times. Grid dimensions
+ * are derived from the volume.
+ */
+template<unsigned char _bins, typename _voxel = fusionvoxel<_bins>>
+void FusionUpdateUTiled(fusionData<_bins, Device, _voxel> f, const double tau, const double lambda, dim3 threads,
+                        cudaStream_t stream = 0);
+
+/**
+ *  \brief Update dual variable \f$p\f$ with tiled stencil kernel
+ *
+ *  \param f       \p fusionData
+ *  \param sigma   fusion parameter \f$\sigma\f$
+ *  \param threads tile dimensions, \a threads.z is ignored
+ *  \param stream  CUDA stream to launch kernel on
+ *  \return No return value
+ *
+ *  \details Same result as \a FusionUpdateP(), \f$v\f$ is staged like \f$p\f$ in \a FusionUpdateUTiled().
+ */
+template<unsigned char _bins, typename _voxel = fusionvoxel<_bins>>
+void FusionUpdatePTiled(fusionData<_bins, Device, _voxel> f, const double sigma, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Run TV-L1 solver iterations with fused \f$u\f$ and \f$p\f$ updates
+ *
+ *  \param f          \p fusionData
+ *  \param su         device scratch of \a f.elements() floats
+ *  \param sp         device scratch of \a f.elements() float3s
+ *  \param iterations number of iterations
+ *  \param tau        fusion parameter \f$\tau\f$
+ *  \param lambda     fusion parameter \f$\lambda\f$
+ *  \param sigma      fusion parameter \f$\sigma\f$
+ *  \param threads    tile dimensions, blocks are launched with one voxel halo, the tile is halved along its longer side
+ * until (x + 2) * (y + 2) threads fit a block of the fused kernel
+ *  \param stream     CUDA stream to launch kernels on
+ *  \return No return value
+ *
+ *  \details Same result as \a iterations pairs of \a FusionUpdateU() and \a FusionUpdateP(), but each iteration is
+ * a single pass: blocks march along z, update \f$u\f$ of a slice and \f$p\f$ of the slice behind it, and never
+ * store \f$v\f$ between the updates. Updating in place would let halo reads see values of neighbouring blocks, so
+ * state alternates between \p f and the scratch arrays and every second iteration writes back to \p f. An odd
+ * iteration runs \a FusionUpdateUTiled() and \a FusionUpdatePTiled().
+ */
+template<unsigned char _bins, typename _voxel = fusionvoxel<_bins>>
+void FusionSolveFused(fusionData<_bins, Device, _voxel> f, float * su, float3 * sp, unsigned int iterations,
+                      const double tau, const double lambda, const double sigma, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Accumulate sums for relative change of primal variable \f$u\f$ in last \a FusionUpdateU() call
+ *
+ *  \param f       \p fusionData
+ *  \param d_sums  pointer to 2 floats on device, \f$\sum (u - u_{prev})^2\f$ and \f$\sum u^2\f$ are added to them
+ *  \param blocks  kernel grid dimensions
+ *  \param threads single block dimensions
+ *  \param stream  CUDA stream to launch kernel on
+ *  \return No return value
+ *
+ *  \details Uses \f$u - u_{prev} = v - u\f$, so no copy of previous \f$u\f$ is kept. \p d_sums has to be zeroed first.
+ */
+template<unsigned char _bins>
+void FusionResidual(fusionData<_bins> f, float * d_sums, dim3 blocks, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Threads per block with maximum occupancy of \a FusionResidual
+ *
+ *  \tparam _bins number of histogram bins
+ *  \return Threads per block suggested by \a cudaOccupancyMaxPotentialBlockSizeVariableSMem
+ *
+ *  \details Seeds 3D block candidates of \a LaunchTuner, the residual reads the whole volume and leaves it unchanged
+ */
+template<unsigned char _bins>
+int FusionResidualBlockSize();
 
 /**
  *  \brief Single depthmap fusion iteration function
@@ -84,93 +175,713 @@ void FusionUpdateP(fusionData<_bins> f, const double sigma, dim3 blocks, dim3 th
  *  \param sigma        fusion parameter \f$\sigma\f$
  *  \param width        width of depthmap
  *  \param height       height of depthmap
+ *  \param blocks       kernel grid dimensions of histogram update
+ *  \param threads      single block dimensions, x and y also set tile size of \f$u\f$ and \f$p\f$ updates
+ *  \param stream       CUDA stream to launch kernels on
+ *  \return No return value
+ *
+ *  \details Signed distance is clamped to [-threshold,threshold] and divided by \a threshold before updating any histogram bins.
+ * All kernels are queued on \a stream without synchronization, \a depthmap has to stay valid until they complete.
+ * \f$u\f$ and \f$p\f$ are updated by \a FusionUpdateUTiled() and \a FusionUpdatePTiled().
+ *
+ * Instantiated for \a fusionvoxel and for compact \a halffusionvoxel with plain and packed histograms.
+ */
+template<unsigned char _bins, typename _voxel = fusionvoxel<_bins>>
+void FusionUpdateIteration(fusionData<_bins, Device, _voxel> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                           const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                           const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Depthmaps and camera poses of views integrated by a single batched histogram update kernel
+ *
+ *  \details Passed to the kernel by value, so no device copy of the poses is needed.
+ */
+struct fusionViews
+{
+    const float * depthmap[FUSION_BATCH_VIEWS];
+    Matrix3D K[FUSION_BATCH_VIEWS];
+    Matrix3D R[FUSION_BATCH_VIEWS];
+    Vector3D T[FUSION_BATCH_VIEWS];
+    int n;
+};
+
+/**
+ *  \brief Update histogram from a batch of depthmaps
+ *
+ *  \param f            \p fusionData containing histogram
+ *  \param depthmaps    host array of pointers to device depthmaps
+ *  \param K            host array of 3x3 camera calibration matrices \f$K\f$
+ *  \param R            host array of 3x3 rotation matrices from world to camera coordinates
+ *  \param t            host array of translation vectors from world to camera position
+ *  \param views        number of depthmaps
+ *  \param threshold    signed distance value threshold
+ *  \param width        width of depthmaps
+ *  \param height       height of depthmaps
  *  \param blocks       kernel grid dimensions
  *  \param threads      single block dimensions
+ *  \param stream       CUDA stream to launch kernels on
  *  \return No return value
  *
- *  \details Signed distance is clamped to [-threshold,threshold] and divided by \a threshold before updating any histogram bins.
+ *  \details Same as calling \a FusionUpdateHistogram() for each view, but every voxel histogram is read and written once
+ * per FUSION_BATCH_VIEWS views. Depthmaps have to stay valid until kernels complete.
+ */
+template<unsigned char _bins, typename _voxel = fusionvoxel<_bins>>
+void FusionUpdateHistogramBatch(fusionData<_bins, Device, _voxel> f, const float * const * depthmaps, const Matrix3D * K,
+                                const Matrix3D * R, const Vector3D * t, const int views, const float threshold,
+                                const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Surface point extracted from fusion volume, 16 bytes
+ */
+struct fusionPoint
+{
+    float x, y, z;       ///< world coordinates of voxel center
+    unsigned int rgba;   ///< packed color 0xAARRGGBB
+};
+
+/**
+ *  \brief Extract voxels close to the surface into packed point buffer
+ *
+ *  \param f        \p fusionData
+ *  \param points   pointer to device point buffer
+ *  \param capacity size of \p points in number of points
+ *  \param d_count  pointer to single unsigned int on device, used as output counter
+ *  \param colormap pointer to 256 packed 0xAARRGGBB colors on device, indexed by x position of the voxel in the volume
+ *  \param blocks   kernel grid dimensions
+ *  \param threads  single block dimensions
+ *  \param stream   CUDA stream to launch kernel on
+ *  \return Number of surface voxels, points past \p capacity are not written
+ *
+ *  \details Voxels with \f$-1 < u < 0\f$ (occluded, but close to the surface) are compacted with one atomic per
+ * block, order of points is arbitrary. Synchronizes \p stream to read the counter, if returned value exceeds
+ * \p capacity, call again with a larger buffer.
  */
 template<unsigned char _bins>
-void FusionUpdateIteration(fusionData<_bins, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
-                           const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
-                           const int width, const int height, dim3 blocks, dim3 threads);
+unsigned int FusionExtractSurface(fusionData<_bins> f, fusionPoint * points, unsigned int capacity, unsigned int * d_count,
+                                  const unsigned int * colormap, dim3 blocks, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Get dimensions of level of detail cell grid
+ *
+ *  \param f    \p fusionData
+ *  \param cell cell size in voxels per side
+ *  \return Number of cells along each axis
+ */
+template<unsigned char _bins, typename _voxel>
+inline int3 FusionLODGrid(fusionData<_bins, Device, _voxel> & f, const int cell)
+{
+    return make_int3((f.width() + cell - 1) / cell, (f.height() + cell - 1) / cell, (f.depth() + cell - 1) / cell);
+}
+
+/**
+ *  \brief Get dimensions of level of detail view block grid
+ *
+ *  \param f     \p fusionData
+ *  \param cell  cell size in voxels per side
+ *  \param block view block size in cells per side
+ *  \return Number of view blocks along each axis
+ */
+template<unsigned char _bins, typename _voxel>
+inline int3 FusionLODBlocks(fusionData<_bins, Device, _voxel> & f, const int cell, const int block)
+{
+    const int3 g = FusionLODGrid(f, cell);
+    return make_int3((g.x + block - 1) / block, (g.y + block - 1) / block, (g.z + block - 1) / block);
+}
+
+/**
+ *  \brief Decimate surface voxels on a coarse voxel grid
+ *
+ *  \param f          \p fusionData
+ *  \param cells      pointer to device buffer of one point per cell of \a FusionLODGrid(), in x fastest order
+ *  \param signatures pointer to device buffer of one signature per view block of \a FusionLODBlocks()
+ *  \param cell       cell size in voxels per side
+ *  \param block      view block size in cells per side
+ *  \param colormap   pointer to 256 packed 0xAARRGGBB colors on device, indexed by x position of the point in the volume
+ *  \param threads    single block dimensions, one thread per cell
+ *  \param stream     CUDA stream to launch kernel on
+ *  \return No return value
+ *
+ *  \details Each cell holds the mean of its surface voxels (same test as \a FusionExtractSurface()), empty cells have
+ * \a rgba 0. Signature of a view block is the number of its non empty cells and the sum of mixed (MurmurHash3
+ * finalizer) surface voxel indexes inside it, so a block whose points did not change keeps its signature between calls with the same \p cell.
+ */
+template<unsigned char _bins>
+void FusionDecimateSurface(fusionData<_bins> f, fusionPoint * cells, uint2 * signatures, const int cell, const int block,
+                           const unsigned int * colormap, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Forget volume descriptors bound by fusion wrappers without releasing them
+ *
+ *  \return No return value
+ *
+ *  \details Use after \a cudaDeviceReset(), which already cleared constant memory and destroyed the upload events.
+ * The next launch uploads its descriptor again.
+ */
+void FusionForgetBindings();
+
+/**
+ *  \brief Compact non empty cells of selected view blocks
+ *
+ *  \param points     pointer to device output points
+ *  \param cursors    pointer to device workspace of one unsigned int per view block
+ *  \param cells      cells written by \a FusionDecimateSurface()
+ *  \param offsets    pointer to device offsets of view blocks into \p points, -1 for blocks that are skipped
+ *  \param grid       cell grid dimensions
+ *  \param blocksgrid view block grid dimensions
+ *  \param block      view block size in cells per side
+ *  \param threads    single block dimensions, one thread per cell
+ *  \param stream     CUDA stream to launch kernel on
+ *  \return No return value
+ *
+ *  \details Points of a view block are contiguous starting at its offset, order within the block is arbitrary
+ */
+void FusionGatherCells(fusionPoint * points, unsigned int * cursors, const fusionPoint * cells, const int * offsets,
+                       const int3 grid, const int3 blocksgrid, const int block, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Get number of ints required for brick list of frustum culled fusion functions
+ *
+ *  \param f \p fusionData
+ *  \return Size of brick list in number of ints
+ */
+template<unsigned char _bins, typename _voxel>
+inline size_t FusionCullListSize(fusionData<_bins, Device, _voxel> & f)
+{
+    const size_t b = FUSION_CULL_BRICK_SIZE;
+    return 1 + ((f.width() + b - 1) / b) * ((f.height() + b - 1) / b) * ((f.depth() + b - 1) / b);
+}
+
+/**
+ *  \brief Update histogram from given \p depthmap only in voxels inside camera frustum
+ *
+ *  \param f            \p fusionData containing histogram
+ *  \param depthmap     pointer to depthmap data
+ *  \param K            3x3 camera calibration matrix \f$K\f$
+ *  \param R            3x3 rotation matrix from world to camera coordinates
+ *  \param t            translation vector from world to camera position
+ *  \param threshold    signed distance value threshold
+ *  \param znear        near clipping plane depth
+ *  \param zfar         far clipping plane depth
+ *  \param width        width of depthmap
+ *  \param height       height of depthmap
+ *  \param list         device workspace of at least \a FusionCullListSize() ints for compacted list of visible bricks
+ *  \param stream       CUDA stream to launch kernels on
+ *  \return No return value
+ *
+ *  \details Voxel bounding box of the frustum is computed on the host (\a fusionData::frustumBox()). Bricks of
+ * FUSION_CULL_BRICK_SIZE^3 voxels inside the box, which project into the image between \a znear and \a zfar, are
+ * compacted into \a list. Histogram update is then launched with one block per listed brick. Result is the same as
+ * \a FusionUpdateHistogram() for voxels within <em>[znear, zfar]</em>.
+ */
+template<unsigned char _bins, typename _voxel = fusionvoxel<_bins>>
+void FusionUpdateHistogramCulled(fusionData<_bins, Device, _voxel> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                                 const Vector3D t, const float threshold, const float znear, const float zfar,
+                                 const int width, const int height, int * list, cudaStream_t stream = 0);
+
+/**
+ *  \brief Single depthmap fusion iteration function with frustum culled histogram update
+ *
+ *  \param f            \p fusionData
+ *  \param depthmap     pointer to depthmap to be used in updating histograms
+ *  \param K            3x3 camera calibration matrix \f$K\f$
+ *  \param R            3x3 rotation matrix from world to camera coordinates
+ *  \param t            translation vector from world to camera position
+ *  \param threshold    signed distance value threshold
+ *  \param tau          fusion parameter \f$\tau\f$
+ *  \param lambda       fusion parameter \f$\lambda\f$
+ *  \param sigma        fusion parameter \f$\sigma\f$
+ *  \param znear        near clipping plane depth
+ *  \param zfar         far clipping plane depth
+ *  \param width        width of depthmap
+ *  \param height       height of depthmap
+ *  \param list         device workspace of at least \a FusionCullListSize() ints
+ *  \param blocks       unused, tiled \f$u\f$ and \f$p\f$ updates derive their grid from the volume
+ *  \param threads      tile dimensions of \f$u\f$ and \f$p\f$ updates
+ *  \param stream       CUDA stream to launch kernels on
+ *  \return No return value
+ *
+ *  \details Same as \a FusionUpdateIteration() with histogram update from \a FusionUpdateHistogramCulled().
+ */
+template<unsigned char _bins, typename _voxel = fusionvoxel<_bins>>
+void FusionUpdateIterationCulled(fusionData<_bins, Device, _voxel> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                                 const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                                 const float znear, const float zfar, const int width, const int height, int * list,
+                                 dim3 blocks, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Single sparse depthmap fusion iteration function
+ *
+ *  \param f            \p fusionHashData
+ *  \param depthmap     pointer to depthmap to be used in allocating blocks and updating histograms
+ *  \param K            3x3 camera calibration matrix \f$K\f$
+ *  \param R            3x3 rotation matrix from world to camera coordinates
+ *  \param t            translation vector from world to camera position
+ *  \param threshold    signed distance value threshold
+ *  \param tau          fusion parameter \f$\tau\f$
+ *  \param lambda       fusion parameter \f$\lambda\f$
+ *  \param sigma        fusion parameter \f$\sigma\f$
+ *  \param width        width of depthmap
+ *  \param height       height of depthmap
+ *  \param blocks       kernel grid dimensions covering depthmap
+ *  \param threads      single block dimensions
+ *  \param stream       CUDA stream to launch kernels on
+ *  \return No return value
+ *
+ *  \details Allocates voxel blocks intersected by truncation band <em>[depth - threshold, depth + threshold]</em> of each
+ * depthmap pixel, then runs the same histogram, \f$u\f$ and \f$p\f$ updates as \a FusionUpdateIteration() on allocated
+ * blocks only, one thread block per voxel block. Voxels outside allocated blocks get no votes and act as border.
+ */
+template<unsigned char _bins>
+void FusionHashUpdateIteration(fusionHashData<_bins> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                               const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                               const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Restore voxel blocks of \p fusionHashData
+ *
+ *  \param f      \p fusionHashData, should be cleared
+ *  \param coords pointer to block coordinates, device or mapped pinned host memory
+ *  \param voxels pointer to FUSION_HASH_BLOCK_VOXELS voxels of each block, device or mapped pinned host memory
+ *  \param blocks number of blocks
+ *  \param stream CUDA stream to launch kernels on
+ *  \return No return value
+ *
+ *  \details Blocks are inserted into the hash table first, then voxels are copied to the pool slot each block got.
+ * Blocks over \a capacity() are dropped.
+ */
+template<unsigned char _bins>
+void FusionHashRestore(fusionHashData<_bins> f, const int3 * coords, const fusionvoxel<_bins> * voxels, const int blocks,
+                       cudaStream_t stream = 0);
 
 // Explicit template instantiations
 template void
 FusionUpdateIteration<2>(fusionData<2, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
                          const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
-                         const int width, const int height, dim3 blocks, dim3 threads);
+                         const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
 template void
 FusionUpdateIteration<3>(fusionData<3, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
                          const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
-                         const int width, const int height, dim3 blocks, dim3 threads);
+                         const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
 template void
 FusionUpdateIteration<4>(fusionData<4, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
                          const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
-                         const int width, const int height, dim3 blocks, dim3 threads);
+                         const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
 template void
 FusionUpdateIteration<5>(fusionData<5, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
                          const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
-                         const int width, const int height, dim3 blocks, dim3 threads);
+                         const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
 template void
 FusionUpdateIteration<6>(fusionData<6, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
                          const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
-                         const int width, const int height, dim3 blocks, dim3 threads);
+                         const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
 template void
 FusionUpdateIteration<7>(fusionData<7, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
                          const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
-                         const int width, const int height, dim3 blocks, dim3 threads);
+                         const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
 template void
 FusionUpdateIteration<8>(fusionData<8, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
                          const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
-                         const int width, const int height, dim3 blocks, dim3 threads);
+                         const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
 template void
 FusionUpdateIteration<9>(fusionData<9, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
                          const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
-                         const int width, const int height, dim3 blocks, dim3 threads);
+                         const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
 template void
 FusionUpdateIteration<10>(fusionData<10, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
                           const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
-                          const int width, const int height, dim3 blocks, dim3 threads);
-
-template void FusionUpdateP<2>(fusionData<2> f, const double sigma, dim3 blocks, dim3 threads);
-template void FusionUpdateP<3>(fusionData<3> f, const double sigma, dim3 blocks, dim3 threads);
-template void FusionUpdateP<4>(fusionData<4> f, const double sigma, dim3 blocks, dim3 threads);
-template void FusionUpdateP<5>(fusionData<5> f, const double sigma, dim3 blocks, dim3 threads);
-template void FusionUpdateP<6>(fusionData<6> f, const double sigma, dim3 blocks, dim3 threads);
-template void FusionUpdateP<7>(fusionData<7> f, const double sigma, dim3 blocks, dim3 threads);
-template void FusionUpdateP<8>(fusionData<8> f, const double sigma, dim3 blocks, dim3 threads);
-template void FusionUpdateP<9>(fusionData<9> f, const double sigma, dim3 blocks, dim3 threads);
-template void FusionUpdateP<10>(fusionData<10> f, const double sigma, dim3 blocks, dim3 threads);
-
-template void FusionUpdateU<2>(fusionData<2> f, const double tau, const double lambda, dim3 blocks, dim3 threads);
-template void FusionUpdateU<3>(fusionData<3> f, const double tau, const double lambda, dim3 blocks, dim3 threads);
-template void FusionUpdateU<4>(fusionData<4> f, const double tau, const double lambda, dim3 blocks, dim3 threads);
-template void FusionUpdateU<5>(fusionData<5> f, const double tau, const double lambda, dim3 blocks, dim3 threads);
-template void FusionUpdateU<6>(fusionData<6> f, const double tau, const double lambda, dim3 blocks, dim3 threads);
-template void FusionUpdateU<7>(fusionData<7> f, const double tau, const double lambda, dim3 blocks, dim3 threads);
-template void FusionUpdateU<8>(fusionData<8> f, const double tau, const double lambda, dim3 blocks, dim3 threads);
-template void FusionUpdateU<9>(fusionData<9> f, const double tau, const double lambda, dim3 blocks, dim3 threads);
-template void FusionUpdateU<10>(fusionData<10> f, const double tau, const double lambda, dim3 blocks, dim3 threads);
+                          const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionUpdateIteration<2, halffusionvoxel<2, false>>(fusionData<2, Device, halffusionvoxel<2, false>> f, const float * depthmap,
+                                                    const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                    const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                    cudaStream_t stream);
+template void
+FusionUpdateIteration<3, halffusionvoxel<3, false>>(fusionData<3, Device, halffusionvoxel<3, false>> f, const float * depthmap,
+                                                    const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                    const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                    cudaStream_t stream);
+template void
+FusionUpdateIteration<4, halffusionvoxel<4, false>>(fusionData<4, Device, halffusionvoxel<4, false>> f, const float * depthmap,
+                                                    const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                    const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                    cudaStream_t stream);
+template void
+FusionUpdateIteration<5, halffusionvoxel<5, false>>(fusionData<5, Device, halffusionvoxel<5, false>> f, const float * depthmap,
+                                                    const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                    const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                    cudaStream_t stream);
+template void
+FusionUpdateIteration<6, halffusionvoxel<6, false>>(fusionData<6, Device, halffusionvoxel<6, false>> f, const float * depthmap,
+                                                    const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                    const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                    cudaStream_t stream);
+template void
+FusionUpdateIteration<7, halffusionvoxel<7, false>>(fusionData<7, Device, halffusionvoxel<7, false>> f, const float * depthmap,
+                                                    const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                    const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                    cudaStream_t stream);
+template void
+FusionUpdateIteration<8, halffusionvoxel<8, false>>(fusionData<8, Device, halffusionvoxel<8, false>> f, const float * depthmap,
+                                                    const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                    const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                    cudaStream_t stream);
+template void
+FusionUpdateIteration<9, halffusionvoxel<9, false>>(fusionData<9, Device, halffusionvoxel<9, false>> f, const float * depthmap,
+                                                    const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                    const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                    cudaStream_t stream);
+template void
+FusionUpdateIteration<10, halffusionvoxel<10, false>>(fusionData<10, Device, halffusionvoxel<10, false>> f, const float * depthmap,
+                                                      const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                      const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                      cudaStream_t stream);
+template void
+FusionUpdateIteration<2, halffusionvoxel<2, true>>(fusionData<2, Device, halffusionvoxel<2, true>> f, const float * depthmap,
+                                                   const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                   const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                   cudaStream_t stream);
+template void
+FusionUpdateIteration<3, halffusionvoxel<3, true>>(fusionData<3, Device, halffusionvoxel<3, true>> f, const float * depthmap,
+                                                   const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                   const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                   cudaStream_t stream);
+template void
+FusionUpdateIteration<4, halffusionvoxel<4, true>>(fusionData<4, Device, halffusionvoxel<4, true>> f, const float * depthmap,
+                                                   const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                   const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                   cudaStream_t stream);
+template void
+FusionUpdateIteration<5, halffusionvoxel<5, true>>(fusionData<5, Device, halffusionvoxel<5, true>> f, const float * depthmap,
+                                                   const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                   const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                   cudaStream_t stream);
+template void
+FusionUpdateIteration<6, halffusionvoxel<6, true>>(fusionData<6, Device, halffusionvoxel<6, true>> f, const float * depthmap,
+                                                   const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                   const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                   cudaStream_t stream);
+template void
+FusionUpdateIteration<7, halffusionvoxel<7, true>>(fusionData<7, Device, halffusionvoxel<7, true>> f, const float * depthmap,
+                                                   const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                   const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                   cudaStream_t stream);
+template void
+FusionUpdateIteration<8, halffusionvoxel<8, true>>(fusionData<8, Device, halffusionvoxel<8, true>> f, const float * depthmap,
+                                                   const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                   const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                   cudaStream_t stream);
+template void
+FusionUpdateIteration<9, halffusionvoxel<9, true>>(fusionData<9, Device, halffusionvoxel<9, true>> f, const float * depthmap,
+                                                   const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                   const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                   cudaStream_t stream);
+template void
+FusionUpdateIteration<10, halffusionvoxel<10, true>>(fusionData<10, Device, halffusionvoxel<10, true>> f, const float * depthmap,
+                                                     const Matrix3D K, const Matrix3D R, const Vector3D t, const float threshold, const double tau,
+                                                     const double lambda, const double sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                                     cudaStream_t stream);
+
+template void
+FusionUpdateHistogramBatch<2>(fusionData<2, Device> f, const float * const * depthmaps, const Matrix3D * K,
+                              const Matrix3D * R, const Vector3D * t, const int views, const float threshold,
+                              const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionUpdateHistogramBatch<3>(fusionData<3, Device> f, const float * const * depthmaps, const Matrix3D * K,
+                              const Matrix3D * R, const Vector3D * t, const int views, const float threshold,
+                              const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionUpdateHistogramBatch<4>(fusionData<4, Device> f, const float * const * depthmaps, const Matrix3D * K,
+                              const Matrix3D * R, const Vector3D * t, const int views, const float threshold,
+                              const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionUpdateHistogramBatch<5>(fusionData<5, Device> f, const float * const * depthmaps, const Matrix3D * K,
+                              const Matrix3D * R, const Vector3D * t, const int views, const float threshold,
+                              const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionUpdateHistogramBatch<6>(fusionData<6, Device> f, const float * const * depthmaps, const Matrix3D * K,
+                              const Matrix3D * R, const Vector3D * t, const int views, const float threshold,
+                              const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionUpdateHistogramBatch<7>(fusionData<7, Device> f, const float * const * depthmaps, const Matrix3D * K,
+                              const Matrix3D * R, const Vector3D * t, const int views, const float threshold,
+                              const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionUpdateHistogramBatch<8>(fusionData<8, Device> f, const float * const * depthmaps, const Matrix3D * K,
+                              const Matrix3D * R, const Vector3D * t, const int views, const float threshold,
+                              const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionUpdateHistogramBatch<9>(fusionData<9, Device> f, const float * const * depthmaps, const Matrix3D * K,
+                              const Matrix3D * R, const Vector3D * t, const int views, const float threshold,
+                              const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionUpdateHistogramBatch<10>(fusionData<10, Device> f, const float * const * depthmaps, const Matrix3D * K,
+                               const Matrix3D * R, const Vector3D * t, const int views, const float threshold,
+                               const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+
+template void
+FusionUpdateIterationCulled<2>(fusionData<2, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                               const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                               const float znear, const float zfar, const int width, const int height, int * list,
+                               dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionUpdateIterationCulled<3>(fusionData<3, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                               const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                               const float znear, const float zfar, const int width, const int height, int * list,
+                               dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionUpdateIterationCulled<4>(fusionData<4, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                               const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                               const float znear, const float zfar, const int width, const int height, int * list,
+                               dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionUpdateIterationCulled<5>(fusionData<5, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                               const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                               const float znear, const float zfar, const int width, const int height, int * list,
+                               dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionUpdateIterationCulled<6>(fusionData<6, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                               const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                               const float znear, const float zfar, const int width, const int height, int * list,
+                               dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionUpdateIterationCulled<7>(fusionData<7, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                               const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                               const float znear, const float zfar, const int width, const int height, int * list,
+                               dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionUpdateIterationCulled<8>(fusionData<8, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                               const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                               const float znear, const float zfar, const int width, const int height, int * list,
+                               dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionUpdateIterationCulled<9>(fusionData<9, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                               const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                               const float znear, const float zfar, const int width, const int height, int * list,
+                               dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionUpdateIterationCulled<10>(fusionData<10, Device> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                                const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                                const float znear, const float zfar, const int width, const int height, int * list,
+                                dim3 blocks, dim3 threads, cudaStream_t stream);
+
+template void
+FusionHashUpdateIteration<2>(fusionHashData<2> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                             const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                             const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionHashUpdateIteration<3>(fusionHashData<3> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                             const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                             const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionHashUpdateIteration<4>(fusionHashData<4> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                             const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                             const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionHashUpdateIteration<5>(fusionHashData<5> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                             const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                             const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionHashUpdateIteration<6>(fusionHashData<6> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                             const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                             const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionHashUpdateIteration<7>(fusionHashData<7> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                             const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                             const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionHashUpdateIteration<8>(fusionHashData<8> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                             const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                             const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionHashUpdateIteration<9>(fusionHashData<9> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                             const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                             const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void
+FusionHashUpdateIteration<10>(fusionHashData<10> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
+                              const Vector3D t, const float threshold, const double tau, const double lambda, const double sigma,
+                              const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream);
+
+template void FusionHashRestore<2>(fusionHashData<2> f, const int3 * coords, const fusionvoxel<2> * voxels, const int blocks,
+                                   cudaStream_t stream);
+template void FusionHashRestore<3>(fusionHashData<3> f, const int3 * coords, const fusionvoxel<3> * voxels, const int blocks,
+                                   cudaStream_t stream);
+template void FusionHashRestore<4>(fusionHashData<4> f, const int3 * coords, const fusionvoxel<4> * voxels, const int blocks,
+                                   cudaStream_t stream);
+template void FusionHashRestore<5>(fusionHashData<5> f, const int3 * coords, const fusionvoxel<5> * voxels, const int blocks,
+                                   cudaStream_t stream);
+template void FusionHashRestore<6>(fusionHashData<6> f, const int3 * coords, const fusionvoxel<6> * voxels, const int blocks,
+                                   cudaStream_t stream);
+template void FusionHashRestore<7>(fusionHashData<7> f, const int3 * coords, const fusionvoxel<7> * voxels, const int blocks,
+                                   cudaStream_t stream);
+template void FusionHashRestore<8>(fusionHashData<8> f, const int3 * coords, const fusionvoxel<8> * voxels, const int blocks,
+                                   cudaStream_t stream);
+template void FusionHashRestore<9>(fusionHashData<9> f, const int3 * coords, const fusionvoxel<9> * voxels, const int blocks,
+                                   cudaStream_t stream);
+template void FusionHashRestore<10>(fusionHashData<10> f, const int3 * coords, const fusionvoxel<10> * voxels, const int blocks,
+                                    cudaStream_t stream);
+
+template unsigned int FusionExtractSurface<2>(fusionData<2> f, fusionPoint * points, unsigned int capacity, unsigned int * d_count,
+                                              const unsigned int * colormap, dim3 blocks, dim3 threads, cudaStream_t stream);
+template unsigned int FusionExtractSurface<3>(fusionData<3> f, fusionPoint * points, unsigned int capacity, unsigned int * d_count,
+                                              const unsigned int * colormap, dim3 blocks, dim3 threads, cudaStream_t stream);
+template unsigned int FusionExtractSurface<4>(fusionData<4> f, fusionPoint * points, unsigned int capacity, unsigned int * d_count,
+                                              const unsigned int * colormap, dim3 blocks, dim3 threads, cudaStream_t stream);
+template unsigned int FusionExtractSurface<5>(fusionData<5> f, fusionPoint * points, unsigned int capacity, unsigned int * d_count,
+                                              const unsigned int * colormap, dim3 blocks, dim3 threads, cudaStream_t stream);
+template unsigned int FusionExtractSurface<6>(fusionData<6> f, fusionPoint * points, unsigned int capacity, unsigned int * d_count,
+                                              const unsigned int * colormap, dim3 blocks, dim3 threads, cudaStream_t stream);
+template unsigned int FusionExtractSurface<7>(fusionData<7> f, fusionPoint * points, unsigned int capacity, unsigned int * d_count,
+                                              const unsigned int * colormap, dim3 blocks, dim3 threads, cudaStream_t stream);
+template unsigned int FusionExtractSurface<8>(fusionData<8> f, fusionPoint * points, unsigned int capacity, unsigned int * d_count,
+                                              const unsigned int * colormap, dim3 blocks, dim3 threads, cudaStream_t stream);
+template unsigned int FusionExtractSurface<9>(fusionData<9> f, fusionPoint * points, unsigned int capacity, unsigned int * d_count,
+                                              const unsigned int * colormap, dim3 blocks, dim3 threads, cudaStream_t stream);
+template unsigned int FusionExtractSurface<10>(fusionData<10> f, fusionPoint * points, unsigned int capacity, unsigned int * d_count,
+                                               const unsigned int * colormap, dim3 blocks, dim3 threads, cudaStream_t stream);
+
+template void FusionDecimateSurface<2>(fusionData<2> f, fusionPoint * cells, uint2 * signatures, const int cell,
+                                        const int block, const unsigned int * colormap, dim3 threads, cudaStream_t stream);
+template void FusionDecimateSurface<3>(fusionData<3> f, fusionPoint * cells, uint2 * signatures, const int cell,
+                                        const int block, const unsigned int * colormap, dim3 threads, cudaStream_t stream);
+template void FusionDecimateSurface<4>(fusionData<4> f, fusionPoint * cells, uint2 * signatures, const int cell,
+                                        const int block, const unsigned int * colormap, dim3 threads, cudaStream_t stream);
+template void FusionDecimateSurface<5>(fusionData<5> f, fusionPoint * cells, uint2 * signatures, const int cell,
+                                        const int block, const unsigned int * colormap, dim3 threads, cudaStream_t stream);
+template void FusionDecimateSurface<6>(fusionData<6> f, fusionPoint * cells, uint2 * signatures, const int cell,
+                                        const int block, const unsigned int * colormap, dim3 threads, cudaStream_t stream);
+template void FusionDecimateSurface<7>(fusionData<7> f, fusionPoint * cells, uint2 * signatures, const int cell,
+                                        const int block, const unsigned int * colormap, dim3 threads, cudaStream_t stream);
+template void FusionDecimateSurface<8>(fusionData<8> f, fusionPoint * cells, uint2 * signatures, const int cell,
+                                        const int block, const unsigned int * colormap, dim3 threads, cudaStream_t stream);
+template void FusionDecimateSurface<9>(fusionData<9> f, fusionPoint * cells, uint2 * signatures, const int cell,
+                                        const int block, const unsigned int * colormap, dim3 threads, cudaStream_t stream);
+template void FusionDecimateSurface<10>(fusionData<10> f, fusionPoint * cells, uint2 * signatures, const int cell,
+                                         const int block, const unsigned int * colormap, dim3 threads, cudaStream_t stream);
+
+template void FusionSolveFused<2>(fusionData<2> f, float * su, float3 * sp, unsigned int iterations,
+                                  const double tau, const double lambda, const double sigma, dim3 threads, cudaStream_t stream);
+template void FusionSolveFused<3>(fusionData<3> f, float * su, float3 * sp, unsigned int iterations,
+                                  const double tau, const double lambda, const double sigma, dim3 threads, cudaStream_t stream);
+template void FusionSolveFused<4>(fusionData<4> f, float * su, float3 * sp, unsigned int iterations,
+                                  const double tau, const double lambda, const double sigma, dim3 threads, cudaStream_t stream);
+template void FusionSolveFused<5>(fusionData<5> f, float * su, float3 * sp, unsigned int iterations,
+                                  const double tau, const double lambda, const double sigma, dim3 threads, cudaStream_t stream);
+template void FusionSolveFused<6>(fusionData<6> f, float * su, float3 * sp, unsigned int iterations,
+                                  const double tau, const double lambda, const double sigma, dim3 threads, cudaStream_t stream);
+template void FusionSolveFused<7>(fusionData<7> f, float * su, float3 * sp, unsigned int iterations,
+                                  const double tau, const double lambda, const double sigma, dim3 threads, cudaStream_t stream);
+template void FusionSolveFused<8>(fusionData<8> f, float * su, float3 * sp, unsigned int iterations,
+                                  const double tau, const double lambda, const double sigma, dim3 threads, cudaStream_t stream);
+template void FusionSolveFused<9>(fusionData<9> f, float * su, float3 * sp, unsigned int iterations,
+                                  const double tau, const double lambda, const double sigma, dim3 threads, cudaStream_t stream);
+template void FusionSolveFused<10>(fusionData<10> f, float * su, float3 * sp, unsigned int iterations,
+                                   const double tau, const double lambda, const double sigma, dim3 threads, cudaStream_t stream);
+
+template void FusionUpdateUTiled<2>(fusionData<2> f, const double tau, const double lambda, dim3 threads,
+                                    cudaStream_t stream);
+template void FusionUpdateUTiled<3>(fusionData<3> f, const double tau, const double lambda, dim3 threads,
+                                    cudaStream_t stream);
+template void FusionUpdateUTiled<4>(fusionData<4> f, const double tau, const double lambda, dim3 threads,
+                                    cudaStream_t stream);
+template void FusionUpdateUTiled<5>(fusionData<5> f, const double tau, const double lambda, dim3 threads,
+                                    cudaStream_t stream);
+template void FusionUpdateUTiled<6>(fusionData<6> f, const double tau, const double lambda, dim3 threads,
+                                    cudaStream_t stream);
+template void FusionUpdateUTiled<7>(fusionData<7> f, const double tau, const double lambda, dim3 threads,
+                                    cudaStream_t stream);
+template void FusionUpdateUTiled<8>(fusionData<8> f, const double tau, const double lambda, dim3 threads,
+                                    cudaStream_t stream);
+template void FusionUpdateUTiled<9>(fusionData<9> f, const double tau, const double lambda, dim3 threads,
+                                    cudaStream_t stream);
+template void FusionUpdateUTiled<10>(fusionData<10> f, const double tau, const double lambda, dim3 threads,
+                                     cudaStream_t stream);
+
+template void FusionUpdatePTiled<2>(fusionData<2> f, const double sigma, dim3 threads, cudaStream_t stream);
+template void FusionUpdatePTiled<3>(fusionData<3> f, const double sigma, dim3 threads, cudaStream_t stream);
+template void FusionUpdatePTiled<4>(fusionData<4> f, const double sigma, dim3 threads, cudaStream_t stream);
+template void FusionUpdatePTiled<5>(fusionData<5> f, const double sigma, dim3 threads, cudaStream_t stream);
+template void FusionUpdatePTiled<6>(fusionData<6> f, const double sigma, dim3 threads, cudaStream_t stream);
+template void FusionUpdatePTiled<7>(fusionData<7> f, const double sigma, dim3 threads, cudaStream_t stream);
+template void FusionUpdatePTiled<8>(fusionData<8> f, const double sigma, dim3 threads, cudaStream_t stream);
+template void FusionUpdatePTiled<9>(fusionData<9> f, const double sigma, dim3 threads, cudaStream_t stream);
+template void FusionUpdatePTiled<10>(fusionData<10> f, const double sigma, dim3 threads, cudaStream_t stream);
+
+template void FusionResidual<2>(fusionData<2> f, float * d_sums, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionResidual<3>(fusionData<3> f, float * d_sums, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionResidual<4>(fusionData<4> f, float * d_sums, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionResidual<5>(fusionData<5> f, float * d_sums, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionResidual<6>(fusionData<6> f, float * d_sums, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionResidual<7>(fusionData<7> f, float * d_sums, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionResidual<8>(fusionData<8> f, float * d_sums, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionResidual<9>(fusionData<9> f, float * d_sums, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionResidual<10>(fusionData<10> f, float * d_sums, dim3 blocks, dim3 threads, cudaStream_t stream);
+
+template int FusionResidualBlockSize<2>();
+template int FusionResidualBlockSize<3>();
+template int FusionResidualBlockSize<4>();
+template int FusionResidualBlockSize<5>();
+template int FusionResidualBlockSize<6>();
+template int FusionResidualBlockSize<7>();
+template int FusionResidualBlockSize<8>();
+template int FusionResidualBlockSize<9>();
+template int FusionResidualBlockSize<10>();
+
+template void FusionUpdateP<2>(fusionData<2> f, const double sigma, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionUpdateP<3>(fusionData<3> f, const double sigma, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionUpdateP<4>(fusionData<4> f, const double sigma, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionUpdateP<5>(fusionData<5> f, const double sigma, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionUpdateP<6>(fusionData<6> f, const double sigma, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionUpdateP<7>(fusionData<7> f, const double sigma, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionUpdateP<8>(fusionData<8> f, const double sigma, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionUpdateP<9>(fusionData<9> f, const double sigma, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionUpdateP<10>(fusionData<10> f, const double sigma, dim3 blocks, dim3 threads, cudaStream_t stream);
+
+template void FusionUpdateU<2>(fusionData<2> f, const double tau, const double lambda, dim3 blocks, dim3 threads,
+                                cudaStream_t stream);
+template void FusionUpdateU<3>(fusionData<3> f, const double tau, const double lambda, dim3 blocks, dim3 threads,
+                                cudaStream_t stream);
+template void FusionUpdateU<4>(fusionData<4> f, const double tau, const double lambda, dim3 blocks, dim3 threads,
+                                cudaStream_t stream);
+template void FusionUpdateU<5>(fusionData<5> f, const double tau, const double lambda, dim3 blocks, dim3 threads,
+                                cudaStream_t stream);
+template void FusionUpdateU<6>(fusionData<6> f, const double tau, const double lambda, dim3 blocks, dim3 threads,
+                                cudaStream_t stream);
+template void FusionUpdateU<7>(fusionData<7> f, const double tau, const double lambda, dim3 blocks, dim3 threads,
+                                cudaStream_t stream);
+template void FusionUpdateU<8>(fusionData<8> f, const double tau, const double lambda, dim3 blocks, dim3 threads,
+                                cudaStream_t stream);
+template void FusionUpdateU<9>(fusionData<9> f, const double tau, const double lambda, dim3 blocks, dim3 threads,
+                                cudaStream_t stream);
+template void FusionUpdateU<10>(fusionData<10> f, const double tau, const double lambda, dim3 blocks, dim3 threads,
+                                cudaStream_t stream);
 
 template void FusionUpdateHistogram<2>(fusionData<2> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
-                                      const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads);
+                                      const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads,
+                                      cudaStream_t stream);
 template void FusionUpdateHistogram<3>(fusionData<3> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
-                                       const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads);
+                                       const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads,
+                                      cudaStream_t stream);
 template void FusionUpdateHistogram<4>(fusionData<4> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
-                                       const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads);
+                                       const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads,
+                                      cudaStream_t stream);
 template void FusionUpdateHistogram<5>(fusionData<5> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
-                                       const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads);
+                                       const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads,
+                                      cudaStream_t stream);
 template void FusionUpdateHistogram<6>(fusionData<6> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
-                                       const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads);
+                                       const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads,
+                                      cudaStream_t stream);
 template void FusionUpdateHistogram<7>(fusionData<7> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
-                                       const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads);
+                                       const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads,
+                                      cudaStream_t stream);
 template void FusionUpdateHistogram<8>(fusionData<8> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
-                                       const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads);
+                                       const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads,
+                                      cudaStream_t stream);
 template void FusionUpdateHistogram<9>(fusionData<9> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
-                                       const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads);
+                                       const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads,
+                                      cudaStream_t stream);
 template void FusionUpdateHistogram<10>(fusionData<10> f, const float * depthmap, const Matrix3D K, const Matrix3D R,
-                                        const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads);
+                                        const Vector3D t, const float threshold, const int width, const int height, dim3 blocks, dim3 threads,
+                                      cudaStream_t stream);
 /** @} */ // group fusion
 
 #endif // FUSION_CU_H
@@ -8,21 +8,30 @@
 #include <helper_cuda.h>
 #include <cuda_runtime_api.h>
 #include <cuda.h>
+#include <cfloat>
 #include "memory.h"
 #include "structs.h"
 #include "helper_structs.h"
 
 // Forward declarations
-template<unsigned char _histBins, MemoryKind memT = Device>
+template<unsigned char _histBins, MemoryKind memT = Device, typename _voxel = fusionvoxel<_histBins>>
 class fusionData;
 
-template<unsigned char bins>
+template<unsigned char bins, typename _voxel = fusionvoxel<bins>>
 struct fusionDataSettings;
 
 /** \addtogroup fusion
 * @{
 */
 
+/**
+ *  \brief Enum for indicating voxel data layout of fusionData
+ */
+typedef enum FusionLayout{
+    ArrayOfStructs, //!< single array of \a fusionvoxel records
+    StructOfArrays  //!< separate arrays of \f$u\f$, \f$v\f$, \f$p\f$ and histograms
+} FusionLayout;
+
 /**
  *  \brief Structure for storing all fusionData settings
  *
@@ -34,7 +43,7 @@ struct fusionDataSettings;
  *
  *  * Wrapping up all fusionData members in this structure restores correct \a cudaMemcpy function.
  */
-template<unsigned char _bins>
+template<unsigned char _bins, typename _voxel>
 struct fusionDataSettings : public Manage
 {
     size_t  width,
@@ -46,38 +55,45 @@ struct fusionDataSettings : public Manage
     Rectangle3D volume;
     float bin[_bins];   // bin centers
     bool own;           // boolean data management
-    fusionvoxel<_bins> * ptr;
+    _voxel * ptr;
+    FusionLayout layout;
+    typename voxelTraits<_voxel>::scalar_type * pu; // StructOfArrays planes
+    typename voxelTraits<_voxel>::scalar_type * pv;
+    typename voxelTraits<_voxel>::vector_type * pp;
+    typename voxelTraits<_voxel>::hist_type * ph;
 
     __host__ __device__ inline
     fusionDataSettings() :
-        width(0), height(0), depth(0), pitch(0), spitch(0), binstep(0), volume(), own(false), ptr(0)
+        width(0), height(0), depth(0), pitch(0), spitch(0), binstep(0), volume(), own(false), ptr(0),
+        layout(ArrayOfStructs), pu(0), pv(0), pp(0), ph(0)
     {}
 
     __host__ __device__ inline
     fusionDataSettings(size_t width, size_t height, size_t depth, size_t pitch, size_t spitch, float step, bool manage,
-                       fusionvoxel<_bins> * pointer, Rectangle3D volume) :
+                       _voxel * pointer, Rectangle3D volume) :
         width(width), height(height), depth(depth), pitch(pitch), spitch(spitch),
-        binstep(step), volume(volume), own(manage), ptr(pointer)
+        binstep(step), volume(volume), own(manage), ptr(pointer), layout(ArrayOfStructs), pu(0), pv(0), pp(0), ph(0)
     {}
 
     __host__ __device__ inline
-    fusionDataSettings(const fusionDataSettings<_bins> & f) :
+    fusionDataSettings(const fusionDataSettings<_bins, _voxel> & f) :
         width(f.width), height(f.height), depth(f.depth), pitch(f.pitch), spitch(f.spitch),
-        binstep(f.binstep), volume(f.volume), own(f.own), ptr(f.ptr)
+        binstep(f.binstep), volume(f.volume), own(f.own), ptr(f.ptr), layout(f.layout), pu(f.pu), pv(f.pv), pp(f.pp), ph(f.ph)
     {
         for (int i = 0; i < _bins; i++) bin[i] = f.bin[i];
     }
 
     __host__ __device__ inline
-    fusionDataSettings(fusionData<_bins> & f) :
+    fusionDataSettings(fusionData<_bins, Device, _voxel> & f) :
         width(f.width()), height(f.height()), depth(f.depth()), pitch(f.pitch()), spitch(f.slicePitch()),
-        binstep(f.binStep()), volume(f.volume()), own(f.ManageData()), ptr(f.voxelPtr())
+        binstep(f.binStep()), volume(f.volume()), own(f.ManageData()), ptr(f.voxelPtr()), layout(f.layout()),
+        pu(f.uPtr()), pv(f.vPtr()), pp(f.pPtr()), ph(f.hPtr())
     {
         for (int i = 0; i < _bins; i++) bin[i] = f.binCenter(i);
     }
 
     __host__ __device__ inline
-    fusionDataSettings<_bins>& operator=(const fusionDataSettings<_bins> & f)
+    fusionDataSettings<_bins, _voxel>& operator=(const fusionDataSettings<_bins, _voxel> & f)
     {
         if (this == &f) return *this;
         width = f.width;
@@ -89,6 +105,11 @@ struct fusionDataSettings : public Manage
         volume = f.volume;
         own = f.own;
         ptr = f.ptr;
+        layout = f.layout;
+        pu = f.pu;
+        pv = f.pv;
+        pp = f.pp;
+        ph = f.ph;
         for (int i = 0; i < _bins; i++) bin[i] = f.bin[i];
         return *this;
     }
@@ -99,13 +120,24 @@ struct fusionDataSettings : public Manage
  *
  *  \tparam _histBins   number of histogram bins
  *  \tparam memT        type of memory, where data is stored
+ *  \tparam _voxel      voxel type, \a fusionvoxel or compact \a halffusionvoxel
  *
  *  \details This class holds and implements some useful functions to work with depthmap fusion algorithm
+ *
+ * Voxels are stored either as a single array of \a fusionvoxel records (\a ArrayOfStructs, default) or as separate
+ * arrays of \f$u\f$, \f$v\f$, \f$p\f$ and histograms (\a StructOfArrays), so each kernel only loads the fields it
+ * uses. Field accessors \a u(), \a v(), \a p() and \a h() work with both layouts, whole voxel access (\a operator(),
+ * \a Get(), \a voxelPtr()) requires \a ArrayOfStructs. \a StructOfArrays is only used for \p Device and
+ * \p Managed memory.
  */
-template<unsigned char _histBins, MemoryKind memT>
-class fusionData : public MemoryManagement<fusionvoxel<_histBins>, memT>, public Manage
+template<unsigned char _histBins, MemoryKind memT, typename _voxel>
+class fusionData : public MemoryManagement<_voxel, memT>, public Manage
 {
 public:
+    /** \brief Voxel field access traits */
+    typedef voxelTraits<_voxel> traits;
+    /** \brief Histogram type of voxels */
+    typedef typename traits::hist_type hist_type;
 
     /**
      *  \brief Default constructor
@@ -125,15 +157,16 @@ public:
      *  \param w width in number of voxels
      *  \param h height in number of voxels
      *  \param d depth in number of voxels
+     *  \param layout voxel data layout
      *
      *  \details Allocates memory on call
      */
     __device__ __host__ inline
-    fusionData(size_t w, size_t h, size_t d) :
+    fusionData(size_t w, size_t h, size_t d, FusionLayout layout = ArrayOfStructs) :
         stg(w, h, d, 0, 0, 0, true, 0, Rectangle3D())
     {
         binParams();
-        Malloc(stg.ptr, stg.width, stg.height, stg.depth, stg.pitch, stg.spitch);
+        allocate(layout);
     }
 
     /**
@@ -144,15 +177,16 @@ public:
      *  \param d depth in number of voxels
      *  \param x corner of bounding volume in world coordinates
      *  \param y corner opposite to \a x of bounding volume in world coordinates
+     *  \param layout voxel data layout
      *
      *  \details Allocates memory on call
      */
     __device__ __host__ inline
-    fusionData(size_t w, size_t h, size_t d, float3 x, float3 y) :
+    fusionData(size_t w, size_t h, size_t d, float3 x, float3 y, FusionLayout layout = ArrayOfStructs) :
         stg(w, h, d, 0, 0, 0, true, 0, Rectangle3D(x, y))
     {
         binParams();
-        Malloc(stg.ptr, stg.width, stg.height, stg.depth, stg.pitch, stg.spitch);
+        allocate(layout);
     }
 
     /**
@@ -162,19 +196,20 @@ public:
      *  \param h   height in number of voxels
      *  \param d   depth in number of voxels
      *  \param vol bounding volume Rectangle3D
+     *  \param layout voxel data layout
      *
      *  \details Allocates memory on call
      */
     __device__ __host__ inline
-    fusionData(size_t w, size_t h, size_t d, Rectangle3D& vol) :
+    fusionData(size_t w, size_t h, size_t d, Rectangle3D& vol, FusionLayout layout = ArrayOfStructs) :
         stg(w, h, d, 0, 0, 0, true, 0, vol)
     {
         binParams();
-        Malloc(stg.ptr, stg.width, stg.height, stg.depth, stg.pitch, stg.spitch);
+        allocate(layout);
     }
 
     __device__ __host__ inline
-    fusionData(const fusionData<_histBins, memT> & fd)
+    fusionData(const fusionData<_histBins, memT, _voxel> & fd)
     {
         stg = fd.exportSettings();
         stg.own = false;
@@ -189,7 +224,7 @@ public:
     __device__ __host__ inline
     ~fusionData()
     {
-        if (stg.own) CleanUp(stg.ptr);
+        if (stg.own) deallocate();
     }
 
     // Getters:
@@ -300,9 +335,37 @@ public:
         stg.width = w;
         stg.height = h;
         stg.depth = d;
-        if (stg.own) CleanUp(stg.ptr);
+        if (stg.own) deallocate();
+        stg.own = true;
+        allocate(stg.layout);
+    }
+
+    /**
+     *  \brief Change voxel data layout
+     *
+     *  \param layout new voxel data layout
+     *  \return No return value
+     *
+     *  \details Data is reallocated (and not preserved) if layout changes, the new data will be managed.
+     */
+    __host__ inline
+    void setLayout(FusionLayout layout)
+    {
+        if (layout == this->layout()) return;
+        if (stg.own) deallocate();
         stg.own = true;
-        Malloc(stg.ptr, stg.width, stg.height, stg.depth, stg.pitch, stg.spitch);
+        allocate(layout);
+    }
+
+    /**
+     *  \brief Get voxel data layout
+     *
+     *  \return Voxel data layout
+     */
+    __device__ __host__ inline
+    FusionLayout layout() const
+    {
+        return stg.layout;
     }
 
     /**
@@ -322,6 +385,8 @@ public:
      */
     __device__ __host__ inline
     size_t sizeBytes(){
+        if (stg.layout == StructOfArrays)
+            return elements() * (2 * sizeof(typename traits::scalar_type) + sizeof(typename traits::vector_type) + sizeof(hist_type));
         return stg.spitch * stg.depth;
     }
 
@@ -333,6 +398,53 @@ public:
     __device__ __host__ inline
     float sizeKBytes(){ return sizeBytes() / 1024.f; }
 
+    /**
+     *  \brief Migrate \p Managed voxel data to device or host
+     *
+     *  \param device target CUDA device, \a cudaCpuDeviceId migrates to host
+     *  \param stream CUDA stream to queue migration on
+     *  \return No return value
+     *
+     *  \details Call before fusion kernels and before host access, so the volume is not page faulted over on first
+     * touch. No-op for other memory kinds.
+     */
+    __host__ inline
+    void prefetch(int device, cudaStream_t stream = 0)
+    {
+        if (stg.layout == ArrayOfStructs) {
+            this->Prefetch(stg.ptr, stg.spitch * stg.depth, device, stream);
+            return;
+        }
+        size_t n = elements();
+        MemoryManagement<typename traits::scalar_type, memT>::Prefetch(stg.pu, n * sizeof(typename traits::scalar_type), device, stream);
+        MemoryManagement<typename traits::scalar_type, memT>::Prefetch(stg.pv, n * sizeof(typename traits::scalar_type), device, stream);
+        MemoryManagement<typename traits::vector_type, memT>::Prefetch(stg.pp, n * sizeof(typename traits::vector_type), device, stream);
+        MemoryManagement<hist_type, memT>::Prefetch(stg.ph, n * sizeof(hist_type), device, stream);
+    }
+
+    /**
+     *  \brief Set usage hint of \p Managed voxel data
+     *
+     *  \param advice \a cudaMemoryAdvise hint, e.g. \a cudaMemAdviseSetPreferredLocation
+     *  \param device CUDA device the hint applies to, \a cudaCpuDeviceId for host
+     *  \return No return value
+     *
+     *  \details No-op for other memory kinds
+     */
+    __host__ inline
+    void advise(int advice, int device)
+    {
+        if (stg.layout == ArrayOfStructs) {
+            this->Advise(stg.ptr, stg.spitch * stg.depth, advice, device);
+            return;
+        }
+        size_t n = elements();
+        MemoryManagement<typename traits::scalar_type, memT>::Advise(stg.pu, n * sizeof(typename traits::scalar_type), advice, device);
+        MemoryManagement<typename traits::scalar_type, memT>::Advise(stg.pv, n * sizeof(typename traits::scalar_type), advice, device);
+        MemoryManagement<typename traits::vector_type, memT>::Advise(stg.pp, n * sizeof(typename traits::vector_type), advice, device);
+        MemoryManagement<hist_type, memT>::Advise(stg.ph, n * sizeof(hist_type), advice, device);
+    }
+
     /**
      *  \brief Get data size in Megabytes
      *
@@ -363,6 +475,47 @@ public:
         return stg.volume.a + stg.volume.size() * make_float3((x + .5) / stg.width, (y + .5) / stg.height, (z + .5) / stg.depth);
     }
 
+    /**
+     *  \brief Get voxel index bounding box of camera frustum
+     *
+     *  \param K      3x3 camera calibration matrix \f$K\f$
+     *  \param R      3x3 rotation matrix from world to camera coordinates
+     *  \param t      translation vector from world to camera position
+     *  \param width  image width
+     *  \param height image height
+     *  \param znear  near clipping plane depth
+     *  \param zfar   far clipping plane depth
+     *  \param lo     first voxel indexes inside the box returned by reference
+     *  \param hi     voxel indexes past the last one inside the box returned by reference
+     *  \return False if frustum does not intersect the volume
+     *
+     *  \details Box bounds world coordinates of the 8 image corners at \a znear and \a zfar, clipped to the volume.
+     */
+    __host__ inline
+    bool frustumBox(const Matrix3D & K, const Matrix3D & R, const Vector3D & t, int width, int height, float znear, float zfar,
+                    int3 & lo, int3 & hi) const
+    {
+        const Matrix3D Kinv = K.inv(), Rt = R.trans();
+        const float px[2] = { 0.f, width - 1.f }, py[2] = { 0.f, height - 1.f }, pz[2] = { znear, zfar };
+        float3 mn = make_float3(FLT_MAX, FLT_MAX, FLT_MAX), mx = -mn;
+        for (int k = 0; k < 2; k++)
+            for (int j = 0; j < 2; j++)
+                for (int i = 0; i < 2; i++) {
+                    const float3 c = pz[k] * (Kinv * make_float3(px[i], py[j], 1.f));
+                    const float3 w = Rt * (c - (float3)t);
+                    mn = fminf(mn, w);
+                    mx = fmaxf(mx, w);
+                }
+
+        const float3 dims = make_float3(stg.width, stg.height, stg.depth);
+        const float3 l = clamp((mn - stg.volume.a) / stg.volume.size() * dims, make_float3(-1.f), dims + 1.f);
+        const float3 h = clamp((mx - stg.volume.a) / stg.volume.size() * dims, make_float3(-1.f), dims + 1.f);
+        lo = make_int3(max(0, (int)floorf(l.x)), max(0, (int)floorf(l.y)), max(0, (int)floorf(l.z)));
+        hi = make_int3(min((int)stg.width, (int)floorf(h.x) + 1), min((int)stg.height, (int)floorf(h.y) + 1),
+                       min((int)stg.depth, (int)floorf(h.z) + 1));
+        return (lo.x < hi.x) && (lo.y < hi.y) && (lo.z < hi.z);
+    }
+
     /**
      *  \brief Get state of data stored
      *
@@ -417,12 +570,13 @@ public:
      *  \param nx voxel x index
      *  \param ny voxel y index
      *  \param nz voxel z index
-     *  \return Reference to primal variable \f$u\f$
+     *  \return Reference to primal variable \f$u\f$, converting reference for half precision voxels
      */
     __device__ __host__ inline
-    float& u(int nx = 0, int ny = 0, int nz = 0)
+    typename traits::scalar_ref u(int nx = 0, int ny = 0, int nz = 0)
     {
-        return voxelRowPtr(ny, nz)[nx].u;
+        if (stg.layout == StructOfArrays) return traits::ref(stg.pu[nx + ny * stg.width + nz * stg.width * stg.height]);
+        return traits::ref(voxelRowPtr(ny, nz)[nx].u);
     }
 
     /**
@@ -431,12 +585,13 @@ public:
     *  \param nx voxel x index
     *  \param ny voxel y index
     *  \param nz voxel z index
-    *  \return Constant reference to primal variable \f$u\f$
+    *  \return Value of primal variable \f$u\f$
     */
     __device__ __host__ inline
-    const float& u(int nx = 0, int ny = 0, int nz = 0) const
+    float u(int nx = 0, int ny = 0, int nz = 0) const
     {
-        return voxelRowPtr(ny, nz)[nx].u;
+        if (stg.layout == StructOfArrays) return traits::get(stg.pu[nx + ny * stg.width + nz * stg.width * stg.height]);
+        return traits::get(voxelRowPtr(ny, nz)[nx].u);
     }
 
     /**
@@ -445,12 +600,13 @@ public:
     *  \param nx voxel x index
     *  \param ny voxel y index
     *  \param nz voxel z index
-    *  \return Reference to helper variable \f$v\f$
+    *  \return Reference to helper variable \f$v\f$, converting reference for half precision voxels
     */
     __device__ __host__ inline
-    float& v(int nx = 0, int ny = 0, int nz = 0)
+    typename traits::scalar_ref v(int nx = 0, int ny = 0, int nz = 0)
     {
-        return voxelRowPtr(ny, nz)[nx].v;
+        if (stg.layout == StructOfArrays) return traits::ref(stg.pv[nx + ny * stg.width + nz * stg.width * stg.height]);
+        return traits::ref(voxelRowPtr(ny, nz)[nx].v);
     }
 
     /**
@@ -459,12 +615,13 @@ public:
     *  \param nx voxel x index
     *  \param ny voxel y index
     *  \param nz voxel z index
-    *  \return Constant reference to helper variable \f$v\f$
+    *  \return Value of helper variable \f$v\f$
     */
     __device__ __host__ inline
-    const float& v(int nx = 0, int ny = 0, int nz = 0) const
+    float v(int nx = 0, int ny = 0, int nz = 0) const
     {
-        return voxelRowPtr(ny, nz)[nx].v;
+        if (stg.layout == StructOfArrays) return traits::get(stg.pv[nx + ny * stg.width + nz * stg.width * stg.height]);
+        return traits::get(voxelRowPtr(ny, nz)[nx].v);
     }
 
     /**
@@ -473,12 +630,13 @@ public:
     *  \param nx voxel x index
     *  \param ny voxel y index
     *  \param nz voxel z index
-    *  \return Reference to dual variable \f$p\f$
+    *  \return Reference to dual variable \f$p\f$, converting reference for half precision voxels
     */
     __device__ __host__ inline
-    float3& p(int nx = 0, int ny = 0, int nz = 0)
+    typename traits::vector_ref p(int nx = 0, int ny = 0, int nz = 0)
     {
-        return voxelRowPtr(ny, nz)[nx].p;
+        if (stg.layout == StructOfArrays) return traits::ref(stg.pp[nx + ny * stg.width + nz * stg.width * stg.height]);
+        return traits::ref(voxelRowPtr(ny, nz)[nx].p);
     }
 
     /**
@@ -487,12 +645,13 @@ public:
     *  \param nx voxel x index
     *  \param ny voxel y index
     *  \param nz voxel z index
-    *  \return Constant reference to dual variable \f$p\f$
+    *  \return Value of dual variable \f$p\f$
     */
     __device__ __host__ inline
-    const float3& p(int nx = 0, int ny = 0, int nz = 0) const
+    float3 p(int nx = 0, int ny = 0, int nz = 0) const
     {
-        return voxelRowPtr(ny, nz)[nx].p;
+        if (stg.layout == StructOfArrays) return traits::get(stg.pp[nx + ny * stg.width + nz * stg.width * stg.height]);
+        return traits::get(voxelRowPtr(ny, nz)[nx].p);
     }
 
     /**
@@ -504,8 +663,9 @@ public:
     *  \return Reference to histogram
     */
     __device__ __host__ inline
-    histogram<_histBins>& h(int nx = 0, int ny = 0, int nz = 0)
+    hist_type& h(int nx = 0, int ny = 0, int nz = 0)
     {
+        if (stg.layout == StructOfArrays) return stg.ph[nx + ny * stg.width + nz * stg.width * stg.height];
         return voxelRowPtr(ny, nz)[nx].h;
     }
 
@@ -518,8 +678,9 @@ public:
     *  \return Constant reference to histogram
     */
     __device__ __host__ inline
-    const histogram<_histBins>& h(int nx = 0, int ny = 0, int nz = 0) const
+    const hist_type& h(int nx = 0, int ny = 0, int nz = 0) const
     {
+        if (stg.layout == StructOfArrays) return stg.ph[nx + ny * stg.width + nz * stg.width * stg.height];
         return voxelRowPtr(ny, nz)[nx].h;
     }
 
@@ -530,9 +691,9 @@ public:
      *  \return Const pointer to first element in plane \p nz
      */
     __device__ __host__ inline
-    const fusionvoxel<_histBins> * voxelPtr(int nz = 0) const
+    const _voxel * voxelPtr(int nz = 0) const
     {
-        return (fusionvoxel<_histBins> *)((unsigned char*)(stg.ptr) + nz*stg.spitch);
+        return (_voxel *)((unsigned char*)(stg.ptr) + nz*stg.spitch);
     }
 
     /**
@@ -542,9 +703,9 @@ public:
      *  \return Pointer to first element in plane \p nz
      */
     __device__ __host__ inline
-    fusionvoxel<_histBins> * voxelPtr(int nz = 0)
+    _voxel * voxelPtr(int nz = 0)
     {
-        return (fusionvoxel<_histBins> *)((unsigned char*)(stg.ptr) + nz*stg.spitch);
+        return (_voxel *)((unsigned char*)(stg.ptr) + nz*stg.spitch);
     }
 
     /**
@@ -555,9 +716,9 @@ public:
      *  \return Pointer to first element in row \p ny and plane \p nz
      */
     __device__ __host__ inline
-    fusionvoxel<_histBins> * voxelRowPtr(int ny = 0, int nz = 0)
+    _voxel * voxelRowPtr(int ny = 0, int nz = 0)
     {
-        return (fusionvoxel<_histBins> *)((unsigned char*)(stg.ptr) + nz*stg.spitch + ny*stg.pitch);
+        return (_voxel *)((unsigned char*)(stg.ptr) + nz*stg.spitch + ny*stg.pitch);
     }
 
     /**
@@ -568,11 +729,27 @@ public:
      *  \return Const pointer to first element in row \p ny and plane \p nz
      */
     __device__ __host__ inline
-    const fusionvoxel<_histBins> * voxelRowPtr(int ny = 0, int nz = 0) const
+    const _voxel * voxelRowPtr(int ny = 0, int nz = 0) const
     {
-        return (fusionvoxel<_histBins> *)((unsigned char*)(stg.ptr) + nz*stg.spitch + ny*stg.pitch);
+        return (_voxel *)((unsigned char*)(stg.ptr) + nz*stg.spitch + ny*stg.pitch);
     }
 
+    /** \brief Get pointer to \f$u\f$ array, 0 unless layout is \a StructOfArrays */
+    __device__ __host__ inline
+    typename traits::scalar_type * uPtr() const { return stg.pu; }
+
+    /** \brief Get pointer to \f$v\f$ array, 0 unless layout is \a StructOfArrays */
+    __device__ __host__ inline
+    typename traits::scalar_type * vPtr() const { return stg.pv; }
+
+    /** \brief Get pointer to \f$p\f$ array, 0 unless layout is \a StructOfArrays */
+    __device__ __host__ inline
+    typename traits::vector_type * pPtr() const { return stg.pp; }
+
+    /** \brief Get pointer to histogram array, 0 unless layout is \a StructOfArrays */
+    __device__ __host__ inline
+    hist_type * hPtr() const { return stg.ph; }
+
     /**
      *  \brief Access operator
      *
@@ -586,7 +763,7 @@ public:
      *  \p memT has to be either \p Device or \p Managed for this function to work on kernel.
      */
     __device__ __host__ inline
-    fusionvoxel<_histBins> & operator()(int nx = 0, int ny = 0, int nz = 0)
+    _voxel & operator()(int nx = 0, int ny = 0, int nz = 0)
     {
         return voxelRowPtr(ny,nz)[nx];
     }
@@ -604,7 +781,7 @@ public:
      *  \p memT has to be either \p Device or \p Managed for this function to work on kernel.
      */
     __device__ __host__ inline
-    const fusionvoxel<_histBins> & operator()(int nx = 0, int ny = 0, int nz = 0) const
+    const _voxel & operator()(int nx = 0, int ny = 0, int nz = 0) const
     {
         return voxelRowPtr(ny,nz)[nx];
     }
@@ -620,7 +797,7 @@ public:
      *  \p memT has to be either \p Device or \p Managed for this function to work on kernel.
      */
     __device__ __host__ inline
-    fusionvoxel<_histBins> & operator[](int ix)
+    _voxel & operator[](int ix)
     {
         return stg.ptr[ix];
     }
@@ -636,7 +813,7 @@ public:
      *  \p memT has to be either \p Device or \p Managed for this function to work on kernel.
      */
     __device__ __host__ inline
-    const fusionvoxel<_histBins> & operator[](int ix) const
+    const _voxel & operator[](int ix) const
     {
         return stg.ptr[ix];
     }
@@ -652,7 +829,7 @@ public:
      *  \p memT has to be either \p Device or \p Managed for this function to work on kernel.
      */
     __device__ __host__ inline
-    fusionvoxel<_histBins> & Get(int nx, int ny, int nz)
+    _voxel & Get(int nx, int ny, int nz)
     {
         return voxelRowPtr(ny,nz)[nx];
     }
@@ -663,7 +840,7 @@ public:
      *  \sa fusionData::operator()
      */
     __device__ __host__ inline
-    const fusionvoxel<_histBins> & Get(int nx, int ny, int nz) const
+    const _voxel & Get(int nx, int ny, int nz) const
     {
         return voxelRowPtr(ny,nz)[nx];
     }
@@ -675,7 +852,7 @@ public:
      *  \sa fusionData::operator()
      */
     __device__ __host__ inline
-    fusionvoxel<_histBins> & Get(int3 p)
+    _voxel & Get(int3 p)
     {
         return voxelRowPtr(p.y,p.z)[p.x];
     }
@@ -687,7 +864,7 @@ public:
      *  \sa fusionData::operator()
      */
     __device__ __host__ inline
-    const fusionvoxel<_histBins> & Get(int3 p) const
+    const _voxel & Get(int3 p) const
     {
         return voxelRowPtr(p.y,p.z)[p.x];
     }
@@ -699,10 +876,10 @@ public:
      * setManageData(true) is called later.
      */
     __device__ __host__ inline
-    fusionData<_histBins, memT>& operator=(fusionData<_histBins, memT> & fd)
+    fusionData<_histBins, memT, _voxel>& operator=(fusionData<_histBins, memT, _voxel> & fd)
     {
         if (this == &fd) return *this;
-        if (stg.own) CleanUp(stg.ptr);
+        if (stg.own) deallocate();
         stg = fd.exportSettings();
         binParams();
         stg.own = false;
@@ -812,10 +989,23 @@ public:
      */
     __host__ __device__ inline
     int Wi(unsigned char i, int x, int y, int z)
+    {
+        return Wi(i, this->h(x, y, z));
+    }
+
+    /**
+     *  \brief Helper function for \f$\operatorname{prox}_{hist}\f$
+     *
+     *  \param i    index of histogram bin
+     *  \param hist voxel histogram
+     *  \return \f$W_i\f$ intermediate variable in \f$\operatorname{prox}_{hist}\f$ calculation
+     */
+    __host__ __device__ inline
+    int Wi(unsigned char i, hist_type & hist)
     {
         int r = 0;
-        for (unsigned char j = 1; j <= i; j++) r -= this->h(x, y, z)(j-1);
-        for (unsigned char j = i + 1; j <= _histBins; j++) r += this->h(x, y, z)(j-1);
+        for (unsigned char j = 1; j <= i; j++) r -= hist(j-1);
+        for (unsigned char j = i + 1; j <= _histBins; j++) r += hist(j-1);
         return r;
     }
 
@@ -851,10 +1041,42 @@ public:
     __host__ __device__ inline
     float proxHist(float u, int x, int y, int z, float tau, float lambda)
     {
-        sortedHist<_histBins> prox(stg.bin);
-        prox.insert(u); // insert p0
-        for (unsigned char j = 1; j <= _histBins; j++) prox.insert(pi(u, j, x, y, z, tau, lambda));
-        return prox.median();
+        return proxHist(u, this->h(x, y, z), tau, lambda);
+    }
+
+    /**
+     *  \brief Calculate \f$\operatorname{prox}_{hist}(u)\f$ of given histogram
+     *
+     *  \param u      variable in \f$\operatorname{prox}_{hist}(u)\f$
+     *  \param hist   voxel histogram
+     *  \param tau    depthmap fusion parameter \f$\tau\f$
+     *  \param lambda depthmap fusion parameter \f$\lambda\f$
+     *  \return Value of \f$\operatorname{prox}_{hist}(u)\f$
+     *
+     *  \details Allows voxels stored outside of this fusionData (e.g. \a fusionHashData blocks) to share the solver.
+     *
+     * Median of bin centers, \f$u\f$ and \f$p_i\f$ is selected with a branch free network instead of sorting: bin centers
+     * are ascending and \f$p_i = u + \tau\lambda W_i\f$ descending, so one min / max stage over the pairs
+     * \f$(c_i, p_i)\f$ splits them into lower and upper halves, and the median is \f$u\f$ clamped between the largest
+     * lower and smallest upper element. Loops have compile time trip counts and unroll into registers.
+     */
+    __host__ __device__ inline
+    float proxHist(float u, hist_type & hist, float tau, float lambda)
+    {
+        const float tl = tau * lambda;
+
+        // W_i is updated incrementally, W_1 = sum(h) - 2 h_0, W_i+1 = W_i - 2 h_i
+        int w = 0;
+        for (unsigned char j = 0; j < _histBins; j++) w += hist(j);
+
+        float lo = -FLT_MAX, hi = FLT_MAX;
+        for (unsigned char j = 0; j < _histBins; j++) {
+            w -= 2 * hist(j);
+            const float p = u + tl * w;
+            lo = fmaxf(lo, fminf(stg.bin[j], p));
+            hi = fminf(hi, fmaxf(stg.bin[j], p));
+        }
+        return fmaxf(lo, fminf(u, hi));
     }
 
     /**
@@ -882,6 +1104,21 @@ public:
      */
     __host__ __device__ inline
     void updateHist(int x, int y, int z, float voxdepth, float depth, float threshold)
+    {
+        updateHist(this->h(x, y, z), voxdepth, depth, threshold);
+    }
+
+    /**
+     *  \brief Update given voxel histogram
+     *
+     *  \param hist      voxel histogram
+     *  \param voxdepth  voxel depth wrt camera reference frame
+     *  \param depth     pixel depth at voxel coordinates interpolated from depthmap
+     *  \param threshold signed distance value threshold
+     *  \return No return value
+     */
+    __host__ __device__ inline
+    void updateHist(hist_type & hist, float voxdepth, float depth, float threshold)
     {
         float sd = depth - voxdepth;
         float thresh = threshold;
@@ -890,20 +1127,20 @@ public:
         // check if empty
         if (sd >= thresh)
         {
-            this->h(x, y, z).last()++;
+            hist.increment(_histBins - 1);
             return;
         }
 
         // check if occluded
         if (sd <= - thresh)
         {
-            this->h(x, y, z).first()++;
+            hist.increment(0);
             return;
         }
 
         // close to surface
         unsigned char i = (unsigned char)fminf(roundf((sd + thresh) / (2.f * thresh) * (_histBins - 3) + 1), _histBins - 2);
-        this->h(x, y, z).bin[i]++;
+        hist.increment(i);
     }
 
     /**
@@ -914,8 +1151,9 @@ public:
      *  \return Returns \a cudaError_t (CUDA error code)
      */
     __host__ inline
-    cudaError_t copyFrom(fusionvoxel<_histBins> * data, size_t npitch)
+    cudaError_t copyFrom(_voxel * data, size_t npitch)
     {
+        if (stg.layout == StructOfArrays) return copyPlanes(data, npitch, true);
         if (memT == Device) return Host2DeviceCopy(stg.ptr, stg.pitch, data, npitch, stg.width, stg.height, stg.depth);
 #if CUDA_VERSION_MAJOR >= 6
         if (memT == Managed) return Host2DeviceCopy(stg.ptr, stg.pitch, data, npitch, stg.width, stg.height, stg.depth);
@@ -931,8 +1169,12 @@ public:
      *  \return Returns \a cudaError_t (CUDA error code)
      */
     __host__ inline
-    void copyTo(fusionvoxel<_histBins> * data, size_t npitch)
+    void copyTo(_voxel * data, size_t npitch)
     {
+        if (stg.layout == StructOfArrays) {
+            copyPlanes(data, npitch, false);
+            return;
+        }
         if (memT == Device) {
             Device2HostCopy(data, npitch, stg.ptr, stg.pitch, stg.width, stg.height, stg.depth);
             return;
@@ -954,16 +1196,16 @@ public:
      *  \details If data is already on the device, no copying of the data is taking place
      */
     __host__ inline
-    fusionData<_histBins, Device> * toDevice()
+    fusionData<_histBins, Device, _voxel> * toDevice()
     {
         size_t p = stg.pitch, s = stg.spitch;
         bool owned = stg.own;
 
         // Copy the elements to the device.
-        fusionvoxel<_histBins> * voxels, * voxelsthis = stg.ptr;
-        if (memT != Device) {
+        _voxel * voxels, * voxelsthis = stg.ptr;
+        if ((memT != Device) && (stg.layout == ArrayOfStructs)) {
             size_t pitch, spitch;
-            MemoryManagement<fusionvoxel<_histBins>, Device>::Malloc(voxels, stg.width, stg.height, stg.depth, pitch, spitch);
+            MemoryManagement<_voxel, Device>::Malloc(voxels, stg.width, stg.height, stg.depth, pitch, spitch);
             Host2DeviceCopy(voxels, pitch, stg.ptr, stg.pitch, stg.width, stg.height, stg.depth);
             stg.pitch = pitch;
             stg.spitch = spitch;
@@ -976,9 +1218,9 @@ public:
 
         // Copy this to the device.
         stg.ptr = voxels;
-        fusionData<_histBins, Device> * deviceArray;
-        cudaMalloc((void **)&deviceArray, sizeof(fusionData<_histBins, memT>));
-        cudaMemcpy((void *)deviceArray, this, sizeof(fusionData<_histBins, memT>),
+        fusionData<_histBins, Device, _voxel> * deviceArray;
+        cudaMalloc((void **)&deviceArray, sizeof(fusionData<_histBins, memT, _voxel>));
+        cudaMemcpy((void *)deviceArray, this, sizeof(fusionData<_histBins, memT, _voxel>),
                    cudaMemcpyHostToDevice);
 
         stg.pitch = p;
@@ -995,7 +1237,7 @@ public:
      *  \return Struct with this fusionData members
      */
     __host__ __device__ inline
-    fusionDataSettings<_histBins> exportSettings()
+    fusionDataSettings<_histBins, _voxel> exportSettings()
     {
         return stg;
     }
@@ -1006,7 +1248,7 @@ public:
      *  \return Struct with this fusionData members
      */
     __host__ __device__ inline
-    const fusionDataSettings<_histBins> exportSettings() const
+    const fusionDataSettings<_histBins, _voxel> exportSettings() const
     {
         return stg;
     }
@@ -1021,9 +1263,9 @@ public:
      *  voxel data in \p f. If \p this had allocated data which it controlled, it is deallocated.
      */
     __host__ __device__ inline
-    void importSettings(fusionDataSettings<_histBins> & f)
+    void importSettings(fusionDataSettings<_histBins, _voxel> & f)
     {
-        if (stg.own) CleanUp(stg.ptr);
+        if (stg.own) deallocate();
         stg = f;
     }
 
@@ -1031,7 +1273,77 @@ protected:
 
     /** \brief Structure with all the reuired data stored.
      * Required to ensure correct copying to device and back.*/
-    fusionDataSettings<_histBins> stg;
+    fusionDataSettings<_histBins, _voxel> stg;
+
+    /**
+     *  \brief Allocate voxel data in given layout
+     *
+     *  \param layout voxel data layout, \a StructOfArrays falls back to \a ArrayOfStructs on host memory
+     *  \return No return value
+     */
+    __host__ inline
+    void allocate(FusionLayout layout)
+    {
+        stg.layout = ((memT == Standard) || (memT == Host)) ? ArrayOfStructs : layout;
+        if (stg.layout == ArrayOfStructs) {
+            this->Malloc(stg.ptr, stg.width, stg.height, stg.depth, stg.pitch, stg.spitch);
+            return;
+        }
+        size_t n = elements();
+        stg.ptr = 0;
+        stg.pitch = 0;
+        stg.spitch = 0;
+        MemoryManagement<typename traits::scalar_type, memT>::Malloc(stg.pu, n);
+        MemoryManagement<typename traits::scalar_type, memT>::Malloc(stg.pv, n);
+        MemoryManagement<typename traits::vector_type, memT>::Malloc(stg.pp, n);
+        MemoryManagement<hist_type, memT>::Malloc(stg.ph, n);
+    }
+
+    /**
+     *  \brief Deallocate voxel data
+     *
+     *  \return No return value
+     */
+    __host__ __device__ inline
+    void deallocate()
+    {
+        if (stg.layout == ArrayOfStructs) {
+            this->CleanUp(stg.ptr);
+            return;
+        }
+        MemoryManagement<typename traits::scalar_type, memT>::CleanUp(stg.pu);
+        MemoryManagement<typename traits::scalar_type, memT>::CleanUp(stg.pv);
+        MemoryManagement<typename traits::vector_type, memT>::CleanUp(stg.pp);
+        MemoryManagement<hist_type, memT>::CleanUp(stg.ph);
+    }
+
+    /**
+     *  \brief Copy \a StructOfArrays planes to or from array of \a fusionvoxel on host
+     *
+     *  \param data     pointer to host voxels in \a ArrayOfStructs layout
+     *  \param npitch   step size in bytes of host memory, rows have to be packed
+     *  \param toplanes copy direction, true copies from \p data to planes
+     *  \return Returns \a cudaError_t (CUDA error code)
+     *
+     *  \details Each field is gathered or scattered with a single strided \a cudaMemcpy2D.
+     */
+    __host__ inline
+    cudaError_t copyPlanes(_voxel * data, size_t npitch, bool toplanes)
+    {
+        if (npitch != stg.width * sizeof(_voxel)) return cudaErrorInvalidPitchValue;
+        const size_t n = elements(), vs = sizeof(_voxel);
+        void * planes[4] = { stg.pu, stg.pv, stg.pp, stg.ph };
+        void * fields[4] = { &data->u, &data->v, &data->p, &data->h };
+        const size_t sizes[4] = { sizeof(typename traits::scalar_type), sizeof(typename traits::scalar_type),
+                                  sizeof(typename traits::vector_type), sizeof(hist_type) };
+        cudaError_t err = cudaSuccess;
+        for (int i = 0; (i < 4) && (err == cudaSuccess); i++) {
+            if (toplanes) err = cudaMemcpy2D(planes[i], sizes[i], fields[i], vs, sizes[i], n, cudaMemcpyHostToDevice);
+            else err = cudaMemcpy2D(fields[i], vs, planes[i], sizes[i], sizes[i], n, cudaMemcpyDeviceToHost);
+        }
+        CHECK_CUDA_ERRORS_AUTO(err);
+        return err;
+    }
 
     /**
      *  \brief Calculate and set histogram bin parameters
@@ -1092,6 +1404,11 @@ typedef fusionData<9, Host> fusionData9;
 /** \brief Convenience typedef for fusionData with 10 bins and stored on host */
 typedef fusionData<10, Host> fusionData10;
 
+/** \brief Convenience typedef for fusionData with 8 bins, half precision voxels and stored on device */
+typedef fusionData<8, Device, halffusionvoxel<8>> dhfusionData8;
+/** \brief Convenience typedef for fusionData with 8 bins, half precision voxels, 4 bit histograms and stored on device */
+typedef fusionData<8, Device, halffusionvoxel<8, true>> dhpfusionData8;
+
 /** @} */ // group fusion
 
 #endif // FUSION_H
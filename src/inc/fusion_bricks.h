@@ -0,0 +1,281 @@
+/**
+ *  \file fusion_bricks.h
+ *  \brief Header file containing out-of-core depthmap fusion data class with bricks paged from host memory
+ */
+#ifndef FUSION_BRICKS_H
+#define FUSION_BRICKS_H
+
+#include <algorithm>
+#include "fusion.h"
+#include "defines.h"
+
+/** \addtogroup fusion
+* @{
+*/
+
+/**
+ *  \brief Templated class for storing depthmap fusion data larger than device memory
+ *
+ *  \tparam _histBins   number of histogram bins
+ *
+ *  \details Volume of \a width x \a height x \a depth voxels is divided into bricks of \a brickSize()^3 voxels, which
+ * are stored in pinned host memory (\p Host) or \p Managed memory. \a stage() pages bricks intersecting the camera
+ * frustum into a dense device \a window(), which is passed to \a FusionUpdateIteration() as regular \a fusionData.
+ * When the window moves, its bricks are written back before new ones are loaded. Window border acts as volume border
+ * for the solver, so bricks are only fused while they are staged.
+ *
+ * Volume and bin parameters are inherited from \a fusionData, which holds no voxel data here.
+ */
+template<unsigned char _histBins>
+class fusionBrickData : public fusionData<_histBins, Device>
+{
+public:
+
+    /**
+     *  \brief Constructor
+     *
+     *  \param w      width of the volume in number of voxels
+     *  \param h      height of the volume in number of voxels
+     *  \param d      depth of the volume in number of voxels
+     *  \param vol    bounding volume Rectangle3D
+     *  \param store  memory kind of brick storage, \p Host (pinned) or \p Managed
+     *  \param brick  brick side in number of voxels
+     *  \param budget maximum size of device window in Megabytes
+     *
+     *  \details Allocates and initializes brick storage on call
+     */
+    __host__ inline
+    fusionBrickData(size_t w, size_t h, size_t d, Rectangle3D vol, MemoryKind store = Host,
+                    unsigned int brick = DEFAULT_FUSION_BRICK_SIZE, size_t budget = DEFAULT_FUSION_BRICK_BUDGET) :
+        fusionData<_histBins, Device>(), store_(0), kind_(store), brick_(brick), budget_(budget << 20),
+        wlo_(make_int3(0, 0, 0)), whi_(make_int3(0, 0, 0))
+    {
+        this->stg.width = w;
+        this->stg.height = h;
+        this->stg.depth = d;
+        this->stg.volume = vol;
+        this->stg.own = false;
+
+        nb_ = make_int3((w + brick_ - 1) / brick_, (h + brick_ - 1) / brick_, (d + brick_ - 1) / brick_);
+        const size_t n = (size_t)nb_.x * nb_.y * nb_.z * brickVoxels();
+#if CUDA_VERSION_MAJOR >= 6
+        if (kind_ == Managed) MemoryManagement<fusionvoxel<_histBins>, Managed>::Malloc(store_, n);
+        else
+#endif // CUDA_VERSION_MAJOR >= 6
+        {
+            kind_ = Host;
+            MemoryManagement<fusionvoxel<_histBins>, Host>::Malloc(store_, n);
+        }
+        for (size_t i = 0; i < n; i++) store_[i] = fusionvoxel<_histBins>();
+    }
+
+    /**
+     *  \brief Destructor
+     *
+     *  \details Deallocates brick storage, window data is not written back
+     */
+    __host__ inline
+    ~fusionBrickData()
+    {
+#if CUDA_VERSION_MAJOR >= 6
+        if (kind_ == Managed) MemoryManagement<fusionvoxel<_histBins>, Managed>::CleanUp(store_);
+        else
+#endif // CUDA_VERSION_MAJOR >= 6
+        MemoryManagement<fusionvoxel<_histBins>, Host>::CleanUp(store_);
+    }
+
+    /**
+     *  \brief Page bricks intersecting camera frustum onto the device
+     *
+     *  \param K      3x3 camera calibration matrix \f$K\f$
+     *  \param R      3x3 rotation matrix from world to camera coordinates
+     *  \param t      translation vector from world to camera position
+     *  \param width  image width
+     *  \param height image height
+     *  \param znear  near clipping plane depth
+     *  \param zfar   far clipping plane depth
+     *  \param stream stream to queue copies in, same as the one \a FusionUpdateIteration() is launched on
+     *  \return False if frustum does not intersect the volume
+     *
+     *  \details Window is shrunk from the side farther from the camera until it fits in the budget. If the window moves,
+     * \a stream is synchronized after writing back old bricks, loading new ones is asynchronous.
+     */
+    __host__ inline
+    bool stage(const Matrix3D & K, const Matrix3D & R, const Vector3D & t, int width, int height, float znear, float zfar,
+               cudaStream_t stream = 0)
+    {
+        int3 lo, hi;
+        if (!this->frustumBox(K, R, t, width, height, znear, zfar, lo, hi)) return false;
+
+        // Voxel box to brick range
+        lo = make_int3(lo.x / brick_, lo.y / brick_, lo.z / brick_);
+        hi = make_int3((hi.x + brick_ - 1) / brick_, (hi.y + brick_ - 1) / brick_, (hi.z + brick_ - 1) / brick_);
+
+        // Camera brick coordinates
+        const float3 c = R.trans() * (-(float3)t);
+        const float3 cb = (c - this->stg.volume.a) / this->stg.volume.size() *
+                          make_float3(this->stg.width, this->stg.height, this->stg.depth) / (float)brick_;
+
+        while ((windowBytes(lo, hi) > budget_) && ((hi.x - lo.x) * (hi.y - lo.y) * (hi.z - lo.z) > 1)) {
+            int a = 0;
+            const int e[3] = { hi.x - lo.x, hi.y - lo.y, hi.z - lo.z };
+            if (e[1] > e[a]) a = 1;
+            if (e[2] > e[a]) a = 2;
+            int & l = (a == 0) ? lo.x : ((a == 1) ? lo.y : lo.z);
+            int & h = (a == 0) ? hi.x : ((a == 1) ? hi.y : hi.z);
+            const float cc = (a == 0) ? cb.x : ((a == 1) ? cb.y : cb.z);
+            if (fabsf(l + .5f - cc) > fabsf(h - .5f - cc)) l++;
+            else h--;
+        }
+
+        if ((lo.x == wlo_.x) && (lo.y == wlo_.y) && (lo.z == wlo_.z) &&
+            (hi.x == whi_.x) && (hi.y == whi_.y) && (hi.z == whi_.z)) return true;
+
+        flush(stream);
+        CHECK_CUDA_ERRORS_AUTO(cudaStreamSynchronize(stream));
+
+        wlo_ = lo;
+        whi_ = hi;
+        const int3 v0 = voxelOffset(lo), v1 = voxelEnd(hi);
+        win_.Resize(v1.x - v0.x, v1.y - v0.y, v1.z - v0.z);
+        win_.setVolume(this->worldCorner(v0), this->worldCorner(v1));
+        copyBricks(true, stream);
+        return true;
+    }
+
+    /**
+     *  \brief Write staged bricks back to brick storage
+     *
+     *  \param stream stream to queue copies in
+     *  \return No return value
+     */
+    __host__ inline
+    void flush(cudaStream_t stream = 0)
+    {
+        if (stagedBricks() > 0) copyBricks(false, stream);
+    }
+
+    /**
+     *  \brief Get device window holding staged bricks
+     *
+     *  \return Reference to dense device fusionData of staged bricks
+     */
+    __host__ inline
+    fusionData<_histBins, Device> & window() { return win_; }
+
+    /** \brief Get voxel indexes of first voxel in the window */
+    __host__ inline
+    int3 windowOffset() const { return voxelOffset(wlo_); }
+
+    /** \brief Get number of staged bricks */
+    __host__ inline
+    int stagedBricks() const { return (whi_.x - wlo_.x) * (whi_.y - wlo_.y) * (whi_.z - wlo_.z); }
+
+    /** \brief Get number of bricks along each axis */
+    __host__ inline
+    int3 bricks() const { return nb_; }
+
+    /** \brief Get brick side in number of voxels */
+    __host__ inline
+    unsigned int brickSize() const { return brick_; }
+
+    /** \brief Get number of voxels in single brick */
+    __host__ inline
+    size_t brickVoxels() const { return (size_t)brick_ * brick_ * brick_; }
+
+    /**
+     *  \brief Get pointer to brick in brick storage
+     *
+     *  \param b brick coordinates
+     *  \return Pointer to first voxel of brick, voxels are stored in x, y, z order with \a brickSize() pitch
+     */
+    __host__ inline
+    fusionvoxel<_histBins> * brickPtr(int3 b) { return store_ + ((size_t)b.x + b.y * nb_.x + (size_t)b.z * nb_.x * nb_.y) * brickVoxels(); }
+
+    /** \brief Get size of brick storage in bytes */
+    __host__ inline
+    size_t sizeBytes() { return (size_t)nb_.x * nb_.y * nb_.z * brickVoxels() * sizeof(fusionvoxel<_histBins>); }
+
+    /** \brief Get size of brick storage in Megabytes */
+    __host__ inline
+    float sizeMBytes(){ return sizeBytes() / 1024.f / 1024.f; }
+
+protected:
+    fusionvoxel<_histBins> * store_;
+    MemoryKind kind_;
+    unsigned int brick_;
+    size_t budget_;
+    int3 nb_, wlo_, whi_;
+    fusionData<_histBins, Device> win_;
+
+    /** \brief First voxel indexes of brick */
+    __host__ inline
+    int3 voxelOffset(int3 b) const { return make_int3(b.x * brick_, b.y * brick_, b.z * brick_); }
+
+    /** \brief Voxel indexes past the last voxel of brick range ending before brick \a b, clipped to volume */
+    __host__ inline
+    int3 voxelEnd(int3 b) const
+    {
+        return make_int3(std::min<int>(b.x * brick_, this->stg.width), std::min<int>(b.y * brick_, this->stg.height),
+                         std::min<int>(b.z * brick_, this->stg.depth));
+    }
+
+    /** \brief World coordinates of voxel corner */
+    __host__ inline
+    float3 worldCorner(int3 v)
+    {
+        return this->stg.volume.a + this->stg.volume.size() *
+               make_float3((float)v.x / this->stg.width, (float)v.y / this->stg.height, (float)v.z / this->stg.depth);
+    }
+
+    /** \brief Device window size of brick range in bytes */
+    __host__ inline
+    size_t windowBytes(int3 lo, int3 hi) const
+    {
+        const int3 v0 = voxelOffset(lo), v1 = voxelEnd(hi);
+        return (size_t)(v1.x - v0.x) * (v1.y - v0.y) * (v1.z - v0.z) * sizeof(fusionvoxel<_histBins>);
+    }
+
+    /**
+     *  \brief Copy staged bricks between brick storage and device window
+     *
+     *  \param load   true copies from brick storage to window, false writes window back
+     *  \param stream stream to queue copies in
+     *  \return No return value
+     */
+    __host__ inline
+    void copyBricks(bool load, cudaStream_t stream)
+    {
+        const size_t vs = sizeof(fusionvoxel<_histBins>);
+        const int3 w0 = voxelOffset(wlo_);
+        cudaPitchedPtr wp = make_cudaPitchedPtr(win_.voxelPtr(), win_.pitch(), win_.width(), win_.height());
+
+        for (int bz = wlo_.z; bz < whi_.z; bz++)
+            for (int by = wlo_.y; by < whi_.y; by++)
+                for (int bx = wlo_.x; bx < whi_.x; bx++) {
+                    const int3 b = make_int3(bx, by, bz);
+                    const int3 v0 = voxelOffset(b), v1 = voxelEnd(make_int3(bx + 1, by + 1, bz + 1));
+                    cudaPitchedPtr bp = make_cudaPitchedPtr(brickPtr(b), brick_ * vs, brick_, brick_);
+                    cudaPos wpos = make_cudaPos((v0.x - w0.x) * vs, v0.y - w0.y, v0.z - w0.z);
+
+                    cudaMemcpy3DParms p = { 0 };
+                    p.extent = make_cudaExtent((v1.x - v0.x) * vs, v1.y - v0.y, v1.z - v0.z);
+                    p.kind = cudaMemcpyDefault;
+                    if (load) {
+                        p.srcPtr = bp;
+                        p.dstPtr = wp;
+                        p.dstPos = wpos;
+                    }
+                    else {
+                        p.srcPtr = wp;
+                        p.srcPos = wpos;
+                        p.dstPtr = bp;
+                    }
+                    CHECK_CUDA_ERRORS_AUTO(cudaMemcpy3DAsync(&p, stream));
+                }
+    }
+};
+
+/** @} */ // group fusion
+
+#endif // FUSION_BRICKS_H
@@ -0,0 +1,247 @@
+/**
+ *  \file fusion_engine.h
+ *  \brief Header file containing depthmap fusion engine with separate integration and solver schedules
+ */
+#ifndef FUSION_ENGINE_H
+#define FUSION_ENGINE_H
+
+#include <cmath>
+#include <algorithm>
+#include "fusion.cu.h"
+#include "defines.h"
+
+/** \addtogroup fusion
+* @{
+*/
+
+/**
+ *  \brief Depthmap fusion engine running histogram integration and TV-L1 solver on separate streams
+ *
+ *  \tparam _bins number of histogram bins
+ *
+ *  \details \a integrate() queues a histogram update of single depthmap and returns, so frames can be ingested at camera
+ * rate. \a solve() runs \f$u\f$ and \f$p\f$ updates on the solver stream independently of the number of frames,
+ * optionally until relative change of \f$u\f$ (\a residual()) drops under a tolerance.
+ *
+ * Each batch of solver iterations waits on the solver stream for the histogram updates integrated up to the time it
+ * is queued, updates integrated later are picked up by the next batch. Each histogram update in turn waits on the
+ * integration stream for the solver batches queued before it, so histograms are never written while a batch reads
+ * them. Neither call blocks the host. Fusion data is not owned by the engine and has to outlive it.
+ */
+template<unsigned char _bins>
+class FusionEngine
+{
+public:
+
+    /**
+     *  \brief Constructor
+     *
+     *  \param f         fusion data to work on
+     *  \param threshold signed distance value threshold
+     *  \param tau       fusion parameter \f$\tau\f$
+     *  \param lambda    fusion parameter \f$\lambda\f$
+     *  \param sigma     fusion parameter \f$\sigma\f$
+     *  \param threads   single block dimensions of fusion kernels
+     *
+     *  \details Creates non-blocking integration and solver streams and prefetches \p Managed volume to the device
+     */
+    __host__ inline
+    FusionEngine(fusionData<_bins> & f, float threshold = DEFAULT_FUSION_SD_THRESHOLD, double tau = DEFAULT_FUSION_TAU,
+                 double lambda = DEFAULT_FUSION_LAMBDA, double sigma = DEFAULT_FUSION_SIGMA,
+                 dim3 threads = dim3(DEFAULT_FUSION_THREADS_X, DEFAULT_FUSION_THREADS_Y, 1)) :
+        fd_(f), threshold_(threshold), tau_(tau), lambda_(lambda), sigma_(sigma), threads_(threads), frames_(0), iterations_(0),
+        su_(0), sp_(0), scratch_(0)
+    {
+        CHECK_CUDA_ERRORS_AUTO(cudaStreamCreateWithFlags(&integratestream_, cudaStreamNonBlocking));
+        CHECK_CUDA_ERRORS_AUTO(cudaStreamCreateWithFlags(&solvestream_, cudaStreamNonBlocking));
+        CHECK_CUDA_ERRORS_AUTO(cudaEventCreateWithFlags(&integrated_, cudaEventDisableTiming));
+        CHECK_CUDA_ERRORS_AUTO(cudaEventCreateWithFlags(&solved_, cudaEventDisableTiming));
+        MemoryManagement<float, Device>::Malloc(d_sums_, 2);
+        MemoryManagement<float, Host>::Malloc(h_sums_, 2);
+
+        // Managed volumes live on the device while the engine runs
+        int device;
+        CHECK_CUDA_ERRORS_AUTO(cudaGetDevice(&device));
+        fd_.prefetch(device, integratestream_);
+    }
+
+    /**
+     *  \brief Destructor
+     *
+     *  \details Waits for all queued work before destroying streams
+     */
+    __host__ inline
+    ~FusionEngine()
+    {
+        synchronize();
+        MemoryManagement<float, Device>::CleanUp(d_sums_);
+        MemoryManagement<float, Host>::CleanUp(h_sums_);
+        if (su_) MemoryManagement<float, Device>::CleanUp(su_);
+        if (sp_) MemoryManagement<float3, Device>::CleanUp(sp_);
+        CHECK_CUDA_ERRORS_AUTO(cudaEventDestroy(integrated_));
+        CHECK_CUDA_ERRORS_AUTO(cudaEventDestroy(solved_));
+        CHECK_CUDA_ERRORS_AUTO(cudaStreamDestroy(integratestream_));
+        CHECK_CUDA_ERRORS_AUTO(cudaStreamDestroy(solvestream_));
+    }
+
+    /**
+     *  \brief Queue histogram update from single depthmap
+     *
+     *  \param depthmap pointer to device depthmap, has to stay valid until \a integrated() event completes
+     *  \param K        3x3 camera calibration matrix \f$K\f$
+     *  \param R        3x3 rotation matrix from world to camera coordinates
+     *  \param t        translation vector from world to camera position
+     *  \param width    width of depthmap
+     *  \param height   height of depthmap
+     *  \return No return value
+     *
+     *  \details Returns without waiting for the update, which runs after solver iterations queued so far
+     */
+    __host__ inline
+    void integrate(const float * depthmap, const Matrix3D & K, const Matrix3D & R, const Vector3D & t, int width, int height)
+    {
+        // Queued solver batches read the histograms this update writes
+        CHECK_CUDA_ERRORS_AUTO(cudaStreamWaitEvent(integratestream_, solved_, 0));
+        FusionUpdateHistogram<_bins>(fd_, depthmap, K, R, t, threshold_, width, height, blocks(), threads_, integratestream_);
+        CHECK_CUDA_ERRORS_AUTO(cudaEventRecord(integrated_, integratestream_));
+        frames_++;
+    }
+
+    /**
+     *  \brief Run TV-L1 solver iterations
+     *
+     *  \param iterations maximum number of iterations
+     *  \param tolerance  stop when relative change of \f$u\f$ drops under this value, 0 runs all iterations
+     *  \param interval   iterations between residual checks
+     *  \return Number of iterations run
+     *
+     *  \details Without \p tolerance all iterations are only queued on \a solveStream(). Otherwise the call blocks on
+     * each residual check and may be called from a separate host thread to keep integration going. Iterations run
+     * through \a FusionSolveFused() after all depthmaps integrated so far, scratch state is allocated on first call.
+     */
+    __host__ inline
+    unsigned int solve(unsigned int iterations, float tolerance = DEFAULT_CONVERGENCE_TOLERANCE,
+                       unsigned int interval = DEFAULT_CONVERGENCE_INTERVAL)
+    {
+        reserveScratch();
+        const unsigned int step = (tolerance > 0) ? std::max(interval, 1u) : iterations;
+        unsigned int i = 0;
+        while (i < iterations) {
+            const unsigned int n = std::min(step, iterations - i);
+
+            // Histograms must not be read while a queued update is still writing them
+            CHECK_CUDA_ERRORS_AUTO(cudaStreamWaitEvent(solvestream_, integrated_, 0));
+            FusionSolveFused<_bins>(fd_, su_, sp_, n, tau_, lambda_, sigma_, threads_, solvestream_);
+            CHECK_CUDA_ERRORS_AUTO(cudaEventRecord(solved_, solvestream_));
+            i += n;
+            iterations_ += n;
+            if ((tolerance > 0) && (residual() < tolerance)) break;
+        }
+        return i;
+    }
+
+    /**
+     *  \brief Get relative change of \f$u\f$ in last solver iteration
+     *
+     *  \return \f$\sqrt{\sum (u - u_{prev})^2 / \sum u^2}\f$, 0 for zero \f$u\f$
+     *
+     *  \details Reduction is queued after last solver iteration, waits for the solver stream
+     */
+    __host__ inline
+    float residual()
+    {
+        CHECK_CUDA_ERRORS_AUTO(cudaMemsetAsync(d_sums_, 0, 2 * sizeof(float), solvestream_));
+        FusionResidual<_bins>(fd_, d_sums_, blocks(), threads_, solvestream_);
+        CHECK_CUDA_ERRORS_AUTO(cudaMemcpyAsync(h_sums_, d_sums_, 2 * sizeof(float), cudaMemcpyDeviceToHost, solvestream_));
+        CHECK_CUDA_ERRORS_AUTO(cudaStreamSynchronize(solvestream_));
+        return h_sums_[1] > 0 ? std::sqrt(h_sums_[0] / h_sums_[1]) : 0.f;
+    }
+
+    /**
+     *  \brief Wait for all queued integration and solver work
+     *
+     *  \return No return value
+     */
+    __host__ inline
+    void synchronize()
+    {
+        CHECK_CUDA_ERRORS_AUTO(cudaStreamSynchronize(integratestream_));
+        CHECK_CUDA_ERRORS_AUTO(cudaStreamSynchronize(solvestream_));
+    }
+
+    /**
+     *  \brief Set fusion parameters
+     *
+     *  \param threshold signed distance value threshold
+     *  \param tau       fusion parameter \f$\tau\f$
+     *  \param lambda    fusion parameter \f$\lambda\f$
+     *  \param sigma     fusion parameter \f$\sigma\f$
+     *  \return No return value
+     */
+    __host__ inline
+    void setParameters(float threshold, double tau, double lambda, double sigma)
+    {
+        threshold_ = threshold;
+        tau_ = tau;
+        lambda_ = lambda;
+        sigma_ = sigma;
+    }
+
+    /** \brief Get stream histogram updates are queued on */
+    __host__ inline
+    cudaStream_t integrateStream() const { return integratestream_; }
+
+    /** \brief Get stream solver iterations are queued on */
+    __host__ inline
+    cudaStream_t solveStream() const { return solvestream_; }
+
+    /** \brief Get event recorded after last histogram update, depthmap of last \a integrate() is free once it completes */
+    __host__ inline
+    cudaEvent_t integrated() const { return integrated_; }
+
+    /** \brief Get number of integrated depthmaps */
+    __host__ inline
+    unsigned int frames() const { return frames_; }
+
+    /** \brief Get total number of solver iterations */
+    __host__ inline
+    unsigned int iterations() const { return iterations_; }
+
+protected:
+    fusionData<_bins> & fd_;
+    float threshold_;
+    double tau_, lambda_, sigma_;
+    dim3 threads_;
+    unsigned int frames_, iterations_;
+    cudaStream_t integratestream_, solvestream_;
+    cudaEvent_t integrated_, solved_;
+    float * d_sums_;
+    float * h_sums_;
+    float * su_;
+    float3 * sp_;
+    size_t scratch_;
+
+    /** \brief Allocate solver scratch state for current volume size */
+    __host__ inline
+    void reserveScratch()
+    {
+        if (scratch_ >= fd_.elements()) return;
+        if (su_) MemoryManagement<float, Device>::CleanUp(su_);
+        if (sp_) MemoryManagement<float3, Device>::CleanUp(sp_);
+        scratch_ = fd_.elements();
+        MemoryManagement<float, Device>::Malloc(su_, scratch_);
+        MemoryManagement<float3, Device>::Malloc(sp_, scratch_);
+    }
+
+    /** \brief Kernel grid dimensions covering the volume */
+    __host__ inline
+    dim3 blocks() const
+    {
+        return dim3((fd_.width() + threads_.x - 1) / threads_.x, (fd_.height() + threads_.y - 1) / threads_.y,
+                    (fd_.depth() + threads_.z - 1) / threads_.z);
+    }
+};
+
+/** @} */ // group fusion
+
+#endif // FUSION_ENGINE_H
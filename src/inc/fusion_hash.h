@@ -0,0 +1,316 @@
+/**
+ *  \file fusion_hash.h
+ *  \brief Header file containing sparse depthmap fusion data class with voxel blocks allocated in a hash table
+ */
+#ifndef FUSION_HASH_H
+#define FUSION_HASH_H
+
+#include <vector>
+#include <algorithm>
+#include "fusion.h"
+#include "defines.h"
+#include "memory_planner.h"
+
+/** \addtogroup fusion
+* @{
+*/
+
+/**
+ *  \brief Templated class for storing depthmap fusion data in sparse voxel blocks
+ *
+ *  \tparam _histBins   number of histogram bins
+ *
+ *  \details Volume of \a width x \a height x \a depth voxels is divided into blocks of
+ * FUSION_HASH_BLOCK_SIZE^3 voxels. Blocks are taken from a preallocated pool on the device and registered in an open
+ * addressing hash table (linear probing) keyed by block coordinates, when truncation band of a depthmap touches them
+ * (see \a FusionHashUpdateIteration()). Voxels outside of allocated blocks are treated as volume border by the solver.
+ *
+ * Volume, bin parameters and per voxel functions (\a worldCoords(), \a updateHist(), \a proxHist(), \a projectUnitBall())
+ * are inherited from \a fusionData, which holds no dense voxel data here. Data is always stored on the device,
+ * copy constructor does not take ownership of it.
+ */
+template<unsigned char _histBins>
+class fusionHashData : public fusionData<_histBins, Device>
+{
+public:
+
+    /**
+     *  \brief Constructor
+     *
+     *  \param w        width of the volume in number of voxels
+     *  \param h        height of the volume in number of voxels
+     *  \param d        depth of the volume in number of voxels
+     *  \param vol      bounding volume Rectangle3D
+     *  \param capacity maximum number of allocated voxel blocks, 0 sizes the pool with \a defaultCapacity()
+     *
+     *  \details Allocates block pool and hash table with twice as many slots (rounded up to power of 2) on call
+     */
+    __host__ inline
+    fusionHashData(size_t w, size_t h, size_t d, Rectangle3D vol, unsigned int capacity = DEFAULT_FUSION_HASH_BLOCKS) :
+        fusionData<_histBins, Device>(), capacity_(capacity ? capacity : defaultCapacity(w, h, d)), tablesize_(1), own_(true)
+    {
+        this->stg.width = w;
+        this->stg.height = h;
+        this->stg.depth = d;
+        this->stg.volume = vol;
+        this->stg.own = false;
+
+        while (tablesize_ < 2 * capacity_) tablesize_ *= 2;
+
+        MemoryManagement<unsigned long long, Device>::Malloc(keys_, tablesize_);
+        MemoryManagement<int, Device>::Malloc(values_, tablesize_);
+        MemoryManagement<int3, Device>::Malloc(coords_, capacity_);
+        MemoryManagement<fusionvoxel<_histBins>, Device>::Malloc(voxels_, (size_t)capacity_ * FUSION_HASH_BLOCK_VOXELS);
+        MemoryManagement<int, Device>::Malloc(count_, 2);
+        clear();
+    }
+
+    /** \brief Copy constructor, does not take ownership of the data */
+    __host__ __device__ inline
+    fusionHashData(const fusionHashData<_histBins> & f) :
+        fusionData<_histBins, Device>(f), keys_(f.keys_), values_(f.values_), coords_(f.coords_), voxels_(f.voxels_),
+        count_(f.count_), capacity_(f.capacity_), tablesize_(f.tablesize_), own_(false)
+    {}
+
+    /** \brief Assignment is not supported, it would leave two owners of the same tables */
+    fusionHashData<_histBins> & operator=(const fusionHashData<_histBins> &) = delete;
+
+    /**
+     *  \brief Destructor
+     *
+     *  \details Deallocates memory if data is owned
+     */
+    __host__ __device__ inline
+    ~fusionHashData()
+    {
+#ifndef __CUDA_ARCH__
+        if (own_){
+            MemoryManagement<unsigned long long, Device>::CleanUp(keys_);
+            MemoryManagement<int, Device>::CleanUp(values_);
+            MemoryManagement<int3, Device>::CleanUp(coords_);
+            MemoryManagement<fusionvoxel<_histBins>, Device>::CleanUp(voxels_);
+            MemoryManagement<int, Device>::CleanUp(count_);
+        }
+#endif
+    }
+
+    /**
+     *  \brief Remove all voxel blocks
+     *
+     *  \param stream stream to queue memset operations in
+     *  \return No return value
+     */
+    __host__ inline
+    void clear(cudaStream_t stream = 0)
+    {
+        CHECK_CUDA_ERRORS_AUTO(cudaMemsetAsync(keys_, 0xff, tablesize_ * sizeof(unsigned long long), stream));
+        CHECK_CUDA_ERRORS_AUTO(cudaMemsetAsync(values_, 0xff, tablesize_ * sizeof(int), stream));
+        CHECK_CUDA_ERRORS_AUTO(cudaMemsetAsync(count_, 0, 2 * sizeof(int), stream));
+    }
+
+    /**
+     *  \brief Get number of allocated voxel blocks
+     *
+     *  \return Number of allocated voxel blocks
+     *
+     *  \details Synchronizes with the device
+     */
+    __host__ inline
+    unsigned int blocks() const
+    {
+        int n = 0;
+        CHECK_CUDA_ERRORS_AUTO(cudaMemcpy(&n, count_, sizeof(int), cudaMemcpyDeviceToHost));
+        return std::min((unsigned int)n, capacity_);
+    }
+
+    /**
+     *  \brief Get default block pool capacity of a volume
+     *
+     *  \param w width of the volume in number of voxels
+     *  \param h height of the volume in number of voxels
+     *  \param d depth of the volume in number of voxels
+     *  \return Number of blocks covering the volume, at most as many as fit into \a DEFAULT_MEMORY_HEADROOM of the
+     * memory available on the current device
+     *
+     *  \details Hash table of up to four slots per block is counted with each block
+     */
+    __host__ inline
+    static unsigned int defaultCapacity(size_t w, size_t h, size_t d)
+    {
+        const size_t n = FUSION_HASH_BLOCK_SIZE;
+        const size_t dense = ((w + n - 1) / n) * ((h + n - 1) / n) * ((d + n - 1) / n);
+        const size_t block = FUSION_HASH_BLOCK_VOXELS * sizeof(fusionvoxel<_histBins>) + sizeof(int3) +
+                             4 * (sizeof(unsigned long long) + sizeof(int));
+        const size_t fit = (size_t)(DEFAULT_MEMORY_HEADROOM * MemoryPlanner::available()) / block;
+        return (unsigned int)std::max<size_t>(1, std::min<size_t>(std::min(dense, fit), 1u << 30));
+    }
+
+    /** \brief Get maximum number of voxel blocks */
+    __host__ __device__ inline
+    unsigned int capacity() const { return capacity_; }
+
+    /** \brief Get number of hash table slots */
+    __host__ __device__ inline
+    unsigned int tableSize() const { return tablesize_; }
+
+    /**
+     *  \brief Get size of block pool and hash table in bytes
+     *
+     *  \return Size of allocated device memory in bytes
+     */
+    __host__ __device__ inline
+    size_t sizeBytes()
+    {
+        return (size_t)capacity_ * (FUSION_HASH_BLOCK_VOXELS * sizeof(fusionvoxel<_histBins>) + sizeof(int3)) +
+               (size_t)tablesize_ * (sizeof(unsigned long long) + sizeof(int));
+    }
+
+    /** \brief Get size of allocated device memory in Megabytes */
+    __host__ __device__ inline
+    float sizeMBytes(){ return sizeBytes() / 1024.f / 1024.f; }
+
+    /** \brief Get pointer to device counter of allocated blocks, second element holds counter before last allocation */
+    __host__ __device__ inline
+    int * counter() const { return count_; }
+
+    /**
+     *  \brief Get block coordinates of voxel
+     *
+     *  \param x voxel x index
+     *  \param y voxel y index
+     *  \param z voxel z index
+     *  \return Coordinates of block containing the voxel
+     */
+    __host__ __device__ inline
+    int3 blockOf(int x, int y, int z) const
+    {
+        return make_int3(x / FUSION_HASH_BLOCK_SIZE, y / FUSION_HASH_BLOCK_SIZE, z / FUSION_HASH_BLOCK_SIZE);
+    }
+
+    /**
+     *  \brief Check if block coordinates are within the volume
+     *
+     *  \param b block coordinates
+     *  \return True if block holds at least one voxel of the volume
+     */
+    __host__ __device__ inline
+    bool validBlock(int3 b) const
+    {
+        return (b.x >= 0) && (b.y >= 0) && (b.z >= 0) && (b.x * FUSION_HASH_BLOCK_SIZE < (int)this->stg.width) &&
+               (b.y * FUSION_HASH_BLOCK_SIZE < (int)this->stg.height) && (b.z * FUSION_HASH_BLOCK_SIZE < (int)this->stg.depth);
+    }
+
+    /**
+     *  \brief Find voxel block in hash table
+     *
+     *  \param b block coordinates
+     *  \return Index of block in block pool, -1 if block is not allocated
+     */
+    __device__ inline
+    int find(int3 b) const
+    {
+        if (!validBlock(b)) return -1;
+        const unsigned long long k = key(b);
+        unsigned int s = slot(b);
+        for (unsigned int n = 0; n < tablesize_; n++, s = (s + 1) & (tablesize_ - 1)){
+            const unsigned long long c = keys_[s];
+            if (c == k) return values_[s];
+            if (c == FUSION_HASH_EMPTY) return -1;
+        }
+        return -1;
+    }
+
+    /**
+     *  \brief Allocate voxel block if it does not exist yet
+     *
+     *  \param b block coordinates
+     *  \return No return value
+     *
+     *  \details Block index is only visible to \a find() in subsequent kernels. Blocks over \a capacity() are dropped.
+     */
+    __device__ inline
+    void insert(int3 b)
+    {
+        if (!validBlock(b)) return;
+        const unsigned long long k = key(b);
+        unsigned int s = slot(b);
+        for (unsigned int n = 0; n < tablesize_; n++, s = (s + 1) & (tablesize_ - 1)){
+            const unsigned long long c = atomicCAS(keys_ + s, FUSION_HASH_EMPTY, k);
+            if (c == FUSION_HASH_EMPTY){
+                const int i = atomicAdd(count_, 1);
+                if (i < (int)capacity_){
+                    coords_[i] = b;
+                    values_[s] = i;
+                }
+                return;
+            }
+            if (c == k) return;
+        }
+    }
+
+    /**
+     *  \brief Get coordinates of allocated block
+     *
+     *  \param block index of block in block pool
+     *  \return Block coordinates
+     */
+    __device__ inline
+    int3 blockCoords(int block) const { return coords_[block]; }
+
+    /**
+     *  \brief Access voxel of allocated block
+     *
+     *  \param block index of block in block pool
+     *  \param local index of voxel within block, <em>x + y * FUSION_HASH_BLOCK_SIZE + z * FUSION_HASH_BLOCK_SIZE^2</em>
+     *  \return Reference to voxel
+     */
+    __device__ inline
+    fusionvoxel<_histBins> & voxel(int block, int local) { return voxels_[block * FUSION_HASH_BLOCK_VOXELS + local]; }
+
+    /**
+     *  \brief Copy allocated blocks to host
+     *
+     *  \param coords block coordinates of each allocated block
+     *  \param voxels voxels of each allocated block, FUSION_HASH_BLOCK_VOXELS per block
+     *  \return No return value
+     */
+    __host__ inline
+    void copyBlocksTo(std::vector<int3> & coords, std::vector<fusionvoxel<_histBins>> & voxels) const
+    {
+        unsigned int n = blocks();
+        coords.resize(n);
+        voxels.resize((size_t)n * FUSION_HASH_BLOCK_VOXELS);
+        if (n == 0) return;
+        MemoryManagement<int3, Device>::Device2HostCopy(coords.data(), coords_, n);
+        MemoryManagement<fusionvoxel<_histBins>, Device>::Device2HostCopy(voxels.data(), voxels_, voxels.size());
+    }
+
+protected:
+    unsigned long long * keys_;
+    int * values_;
+    int3 * coords_;
+    fusionvoxel<_histBins> * voxels_;
+    int * count_;
+    unsigned int capacity_, tablesize_;
+    bool own_;
+
+    /** \brief Pack block coordinates into hash key, 21 bits per axis */
+    __host__ __device__ inline
+    static unsigned long long key(int3 b)
+    {
+        return ((unsigned long long)(b.x & 0x1FFFFF) << 42) | ((unsigned long long)(b.y & 0x1FFFFF) << 21) |
+                (unsigned long long)(b.z & 0x1FFFFF);
+    }
+
+    /** \brief First hash table slot of block */
+    __host__ __device__ inline
+    unsigned int slot(int3 b) const
+    {
+        return (((unsigned int)b.x * 73856093u) ^ ((unsigned int)b.y * 19349669u) ^ ((unsigned int)b.z * 83492791u)) &
+                (tablesize_ - 1);
+    }
+};
+
+/** @} */ // group fusion
+
+#endif // FUSION_HASH_H
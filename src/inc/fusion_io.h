@@ -0,0 +1,312 @@
+/**
+ *  \file fusion_io.h
+ *  \brief Header file containing checkpoint file format of depthmap fusion volumes
+ */
+#ifndef FUSION_IO_H
+#define FUSION_IO_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "fusion.cu.h"
+#include "exception.h"
+#include "defines.h"
+
+/** \addtogroup fusion
+* @{
+*/
+
+/**
+ *  \brief Header of fusion checkpoint file
+ *
+ *  \details Stored at the start of the file in native byte order. Payload starts at \a offset, which is aligned to
+ * FUSION_FILE_ALIGNMENT bytes, so it can be mapped and pinned as is. Dense payload holds \a width x \a height x \a depth
+ * voxels in x, y, z order with row step \a pitch. Sparse payload holds \a blocks block coordinates (int3) followed by
+ * FUSION_HASH_BLOCK_VOXELS voxels of each block at \a voxeloffset.
+ */
+struct fusionFileHeader
+{
+    char magic[8];                  ///< FUSION_FILE_MAGIC
+    unsigned int version;           ///< FUSION_FILE_VERSION
+    unsigned int bins;              ///< number of histogram bins
+    unsigned int voxelsize;         ///< size of single voxel in bytes
+    unsigned int sparse;            ///< 1 for voxel block payload of \a fusionHashData
+    unsigned long long width;       ///< volume width in voxels
+    unsigned long long height;      ///< volume height in voxels
+    unsigned long long depth;       ///< volume depth in voxels
+    unsigned long long pitch;       ///< row step of dense payload in bytes
+    float volume[6];                ///< bounding volume corners a and b
+    float binstep;                  ///< histogram bin step
+    unsigned int reserved;
+    unsigned long long blocks;      ///< number of voxel blocks of sparse payload
+    unsigned long long offset;      ///< payload offset from file start in bytes
+    unsigned long long voxeloffset; ///< offset of block voxels from payload start in bytes
+    unsigned long long bytes;       ///< payload size in bytes
+};
+
+/**
+ *  \brief Fill checkpoint file header with volume parameters of \p f
+ *
+ *  \param f fusion data
+ *  \return Header without payload description
+ */
+template<unsigned char _bins, MemoryKind memT, typename _voxel>
+inline fusionFileHeader fusionHeader(fusionData<_bins, memT, _voxel> & f)
+{
+    fusionFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, FUSION_FILE_MAGIC, sizeof(h.magic));
+    h.version = FUSION_FILE_VERSION;
+    h.bins = _bins;
+    h.voxelsize = sizeof(_voxel);
+    h.width = f.width();
+    h.height = f.height();
+    h.depth = f.depth();
+    const Rectangle3D vol = f.volume();
+    h.volume[0] = vol.a.x; h.volume[1] = vol.a.y; h.volume[2] = vol.a.z;
+    h.volume[3] = vol.b.x; h.volume[4] = vol.b.y; h.volume[5] = vol.b.z;
+    h.binstep = f.binStep();
+    h.offset = FUSION_FILE_ALIGNMENT;
+    return h;
+}
+
+/**
+ *  \brief Write checkpoint header and payload chunks to file
+ *
+ *  \param filename path to output file
+ *  \param h        file header
+ *  \param chunks   pointers to payload chunks, written one after another
+ *  \param sizes    sizes of payload chunks in bytes
+ *  \param n        number of chunks
+ *  \return No return value
+ */
+inline void writeFusionFile(const std::string & filename, const fusionFileHeader & h, const void * const * chunks,
+                            const size_t * sizes, int n)
+{
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    ASSERT_AUTO((out.is_open()));
+    std::vector<char> header(h.offset, 0);
+    memcpy(header.data(), &h, sizeof(h));
+    out.write(header.data(), header.size());
+    for (int i = 0; i < n; i++) out.write((const char *)chunks[i], sizes[i]);
+    ASSERT_AUTO((out.good()));
+}
+
+/**
+ *  \brief Save dense fusion volume to checkpoint file
+ *
+ *  \param filename path to output file
+ *  \param f        fusion data, any memory kind and layout
+ *  \return No return value
+ */
+template<unsigned char _bins, MemoryKind memT, typename _voxel>
+inline void saveFusionData(const std::string & filename, fusionData<_bins, memT, _voxel> & f)
+{
+    fusionFileHeader h = fusionHeader(f);
+    h.pitch = f.width() * sizeof(_voxel);
+    h.bytes = f.elements() * sizeof(_voxel);
+
+    std::vector<_voxel> voxels(f.elements());
+    f.copyTo(voxels.data(), h.pitch);
+
+    const void * chunks[1] = { voxels.data() };
+    const size_t sizes[1] = { h.bytes };
+    writeFusionFile(filename, h, chunks, sizes, 1);
+}
+
+/**
+ *  \brief Save allocated voxel blocks of sparse fusion volume to checkpoint file
+ *
+ *  \param filename path to output file
+ *  \param f        sparse fusion data
+ *  \return No return value
+ */
+template<unsigned char _bins>
+inline void saveFusionData(const std::string & filename, fusionHashData<_bins> & f)
+{
+    std::vector<int3> coords;
+    std::vector<fusionvoxel<_bins>> voxels;
+    f.copyBlocksTo(coords, voxels);
+
+    fusionFileHeader h = fusionHeader(f);
+    h.sparse = 1;
+    h.blocks = coords.size();
+    h.voxeloffset = (coords.size() * sizeof(int3) + 15) / 16 * 16;
+    h.bytes = h.voxeloffset + voxels.size() * sizeof(fusionvoxel<_bins>);
+
+    const char pad[16] = { 0 };
+    const void * chunks[3] = { coords.data(), pad, voxels.data() };
+    const size_t sizes[3] = { coords.size() * sizeof(int3), h.voxeloffset - coords.size() * sizeof(int3),
+                              voxels.size() * sizeof(fusionvoxel<_bins>) };
+    writeFusionFile(filename, h, chunks, sizes, 3);
+}
+
+/**
+ *  \brief Fusion checkpoint file mapped into pinned host memory
+ *
+ *  \details File is mapped with \a mmap (private copy on write mapping) and registered as pinned, mapped memory.
+ * Registering reads the whole file and, since the mapping is writable, pins private copies of its pages rather than
+ * the page cache itself. Payload is then uploaded with asynchronous copies from these pages, without a separate
+ * staging buffer. The file has to stay open until uploads complete.
+ */
+class fusionFile
+{
+public:
+
+    /**
+     *  \brief Constructor, maps and pins checkpoint file
+     *
+     *  \param filename path to checkpoint file
+     *
+     *  \details Throws if the file can not be mapped or is not a checkpoint of a supported version
+     */
+    __host__ inline
+    fusionFile(const std::string & filename) : base_(0), size_(0)
+    {
+        const int fd = open(filename.c_str(), O_RDONLY);
+        ASSERT_MSG(fd >= 0, "Cannot open fusion checkpoint " + filename);
+        struct stat st;
+        const bool ok = (fstat(fd, &st) == 0) && ((size_t)st.st_size >= sizeof(fusionFileHeader));
+        if (ok) {
+            size_ = st.st_size;
+            base_ = mmap(0, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        ASSERT_MSG(ok && (base_ != MAP_FAILED), "Cannot map fusion checkpoint " + filename);
+
+        // The destructor does not run if the constructor throws, the mapping is released here instead
+        struct Unmap {
+            void * base;
+            size_t size;
+            ~Unmap() { if (base) munmap(base, size); }
+        } unmap = { base_, size_ };
+
+        memcpy(&h_, base_, sizeof(h_));
+        ASSERT_MSG((memcmp(h_.magic, FUSION_FILE_MAGIC, sizeof(h_.magic)) == 0) && (h_.version == FUSION_FILE_VERSION),
+                   "Unsupported fusion checkpoint " + filename);
+        ASSERT_MSG(h_.offset + h_.bytes <= size_, "Truncated fusion checkpoint " + filename);
+
+        CHECK_CUDA_ERRORS_AUTO(cudaHostRegister(base_, size_, cudaHostRegisterMapped));
+        unmap.base = 0;
+    }
+
+    /**
+     *  \brief Destructor, unpins and unmaps the file
+     *
+     *  \details Uploads from the file have to be completed
+     */
+    __host__ inline
+    ~fusionFile()
+    {
+        cudaHostUnregister(base_);
+        munmap(base_, size_);
+    }
+
+    /** \brief Get file header */
+    __host__ inline
+    const fusionFileHeader & header() const { return h_; }
+
+    /** \brief Check if file holds sparse voxel blocks */
+    __host__ inline
+    bool sparse() const { return h_.sparse != 0; }
+
+    /** \brief Get pointer to pinned payload */
+    __host__ inline
+    const char * payload() const { return (const char *)base_ + h_.offset; }
+
+    /**
+     *  \brief Upload dense volume into fusion data on the device
+     *
+     *  \param f      device fusion data, resized if volume dimensions differ
+     *  \param stream CUDA stream to queue copies in
+     *  \return No return value
+     *
+     *  \details Copies are asynchronous, file has to stay open until \p stream reaches them
+     */
+    template<unsigned char _bins, typename _voxel>
+    __host__ inline
+    void upload(fusionData<_bins, Device, _voxel> & f, cudaStream_t stream = 0)
+    {
+        check(_bins, sizeof(_voxel), false);
+        if ((f.width() != h_.width) || (f.height() != h_.height) || (f.depth() != h_.depth))
+            f.Resize(h_.width, h_.height, h_.depth);
+        f.setVolume(make_float3(h_.volume[0], h_.volume[1], h_.volume[2]),
+                    make_float3(h_.volume[3], h_.volume[4], h_.volume[5]));
+
+        const _voxel * src = (const _voxel *)payload();
+        const size_t rows = h_.height * h_.depth;
+        if (f.layout() == StructOfArrays) {
+            // Scatter fields into planes with strided copies
+            typedef typename fusionData<_bins, Device, _voxel>::traits traits;
+            void * planes[4] = { f.uPtr(), f.vPtr(), f.pPtr(), f.hPtr() };
+            const void * fields[4] = { &src->u, &src->v, &src->p, &src->h };
+            const size_t sizes[4] = { sizeof(typename traits::scalar_type), sizeof(typename traits::scalar_type),
+                                      sizeof(typename traits::vector_type), sizeof(typename traits::hist_type) };
+            for (int i = 0; i < 4; i++)
+                CHECK_CUDA_ERRORS_AUTO(cudaMemcpy2DAsync(planes[i], sizes[i], fields[i], sizeof(_voxel), sizes[i],
+                                                         f.elements(), cudaMemcpyHostToDevice, stream));
+            return;
+        }
+        if (f.slicePitch() == f.pitch() * h_.height)
+            CHECK_CUDA_ERRORS_AUTO(cudaMemcpy2DAsync(f.voxelPtr(), f.pitch(), src, h_.pitch, h_.width * sizeof(_voxel), rows,
+                                                     cudaMemcpyHostToDevice, stream));
+        else
+            for (size_t z = 0; z < h_.depth; z++)
+                CHECK_CUDA_ERRORS_AUTO(cudaMemcpy2DAsync((char *)f.voxelPtr() + z * f.slicePitch(), f.pitch(),
+                                                         (const char *)src + z * h_.height * h_.pitch, h_.pitch,
+                                                         h_.width * sizeof(_voxel), h_.height, cudaMemcpyHostToDevice, stream));
+    }
+
+    /**
+     *  \brief Restore voxel blocks into sparse fusion data
+     *
+     *  \param f      sparse fusion data with the same volume dimensions, it is cleared first
+     *  \param stream CUDA stream to launch restore kernels on
+     *  \return No return value
+     *
+     *  \details Restore kernels read blocks straight from the mapped file, file has to stay open until \p stream
+     * reaches them
+     */
+    template<unsigned char _bins>
+    __host__ inline
+    void upload(fusionHashData<_bins> & f, cudaStream_t stream = 0)
+    {
+        check(_bins, sizeof(fusionvoxel<_bins>), true);
+        ASSERT_MSG((f.width() == h_.width) && (f.height() == h_.height) && (f.depth() == h_.depth),
+                   "Fusion checkpoint volume dimensions differ");
+        f.setVolume(make_float3(h_.volume[0], h_.volume[1], h_.volume[2]),
+                    make_float3(h_.volume[3], h_.volume[4], h_.volume[5]));
+
+        void * d_payload;
+        CHECK_CUDA_ERRORS_AUTO(cudaHostGetDevicePointer(&d_payload, base_, 0));
+        const char * p = (const char *)d_payload + h_.offset;
+        f.clear(stream);
+        FusionHashRestore<_bins>(f, (const int3 *)p, (const fusionvoxel<_bins> *)(p + h_.voxeloffset), (int)h_.blocks, stream);
+    }
+
+protected:
+    void * base_;
+    size_t size_;
+    fusionFileHeader h_;
+
+    /** \brief Check that file matches fusion data type */
+    __host__ inline
+    void check(unsigned int bins, unsigned int voxelsize, bool sparse) const
+    {
+        ASSERT_MSG((h_.bins == bins) && (h_.voxelsize == voxelsize), "Fusion checkpoint voxel type differs");
+        ASSERT_MSG(this->sparse() == sparse, "Fusion checkpoint payload kind differs");
+    }
+
+private:
+    fusionFile(const fusionFile &);
+    fusionFile & operator=(const fusionFile &);
+};
+
+/** @} */ // group fusion
+
+#endif // FUSION_IO_H
@@ -0,0 +1,123 @@
+/**
+ *  \file fusion_lod.h
+ *  \brief Header file containing level of detail surface view of fusion volume with incremental updates
+ */
+#ifndef FUSION_LOD_H
+#define FUSION_LOD_H
+
+#include <vector>
+#include <chrono>
+#include "fusion.cu.h"
+#include "image.h"
+#include "defines.h"
+
+/**
+ *  \brief Decimated surface of a fusion volume, split into view blocks that are updated only when they change
+ *
+ *  \details Surface voxels are averaged on a grid of cells of \a cellSize()^3 voxels. Cell size is a power of 2 chosen
+ * so the number of points stays within the point budget. Cells are grouped into view blocks of FUSION_LOD_BLOCK_SIZE^3
+ * voxels, and \a update() only brings points of blocks whose surface changed since the previous update to the host,
+ * so a viewer can keep one cloud per block and re-upload just those. Updates are throttled to at most one per
+ * \a interval() milliseconds.
+ */
+class FusionLOD
+{
+public:
+    /** \brief Points of a single view block */
+    struct Block
+    {
+        int index;                          //!< view block index, x fastest
+        std::vector<fusionPoint> points;    //!< decimated surface points, empty if block has no surface anymore
+    };
+
+    /**
+     *  \brief Constructor
+     *
+     *  \param budget   maximum number of points of the whole surface
+     *  \param interval minimum time between updates in milliseconds
+     */
+    explicit FusionLOD(unsigned int budget = DEFAULT_FUSION_LOD_POINTS, int interval = DEFAULT_FUSION_VIEW_INTERVAL)
+        : cellgrid(make_int3(0, 0, 0)), blockgrid(make_int3(0, 0, 0)), cell(1), total(0), budget_(budget),
+          interval_(interval), updated(false) {}
+
+    /**
+     *  \brief Update decimated surface
+     *
+     *  \param f       fusion volume
+     *  \param changed view blocks that changed since the previous update returned by reference
+     *  \param force   ignore refresh interval
+     *  \param stream  CUDA stream of pending fusion work, synchronized to read block signatures
+     *  \return False if update was skipped because the previous one was less than \a interval() ago
+     *
+     *  \details After the cell size changes or the volume is resized all blocks are reported, including empty ones,
+     * so a viewer can drop blocks it shows.
+     */
+    template<unsigned char _bins>
+    bool update(fusionData<_bins> & f, std::vector<Block> & changed, bool force = false, cudaStream_t stream = 0)
+    {
+        changed.clear();
+        if (!force && !due()) return false;
+        ASSERT_AUTO((colors.isValid()));
+
+        const dim3 threads(FUSION_LOD_THREADS, FUSION_LOD_THREADS, FUSION_LOD_THREADS);
+        for (;;) {
+            int3 g = FusionLODGrid(f, cell), b = FusionLODBlocks(f, cell, FUSION_LOD_BLOCK_SIZE / cell);
+            prepare(g, b);
+            FusionDecimateSurface(f, cells.data(), signatures.data(), cell, FUSION_LOD_BLOCK_SIZE / cell, colors.data(),
+                                  threads, stream);
+            if (!decimated(stream)) break; // cell size fits the budget
+        }
+        collect(changed, threads, stream);
+        return true;
+    }
+
+    /**
+     *  \brief Set colormap of points
+     *
+     *  \param colormap 256 packed 0xAARRGGBB colors, indexed by x position of the point in the volume
+     *  \return No return value
+     */
+    void setColormap(const unsigned int * colormap);
+
+    /** \brief Forget shown blocks, next update reports all of them */
+    void reset();
+
+    /** \brief Check if refresh interval has passed since the last update */
+    bool due() const
+    {
+        return !updated || (std::chrono::steady_clock::now() - last >= std::chrono::milliseconds(interval_));
+    }
+
+    void setBudget(unsigned int budget){ budget_ = budget; }
+    void setInterval(int interval){ interval_ = interval; }
+    unsigned int budget() const { return budget_; }
+    int interval() const { return interval_; }
+    int cellSize() const { return cell; }
+
+    /** \brief Get number of points of the last update */
+    size_t size() const { return total; }
+
+protected:
+    void prepare(const int3 grid, const int3 blocksgrid);
+    bool decimated(cudaStream_t stream);
+    void collect(std::vector<Block> & changed, dim3 threads, cudaStream_t stream);
+
+    Image<fusionPoint> cells, points;
+    Image<uint2> signatures;
+    Image<int> offsets;
+    Image<unsigned int> cursors, colors;
+    std::vector<uint2> current, shown;
+    int3 cellgrid, blockgrid;
+    int cell;
+    size_t total;
+    unsigned int budget_;
+    int interval_;
+    bool updated;
+    std::chrono::steady_clock::time_point last;
+
+private:
+    FusionLOD(const FusionLOD &);
+    FusionLOD & operator=(const FusionLOD &);
+};
+
+#endif // FUSION_LOD_H
@@ -0,0 +1,189 @@
+/**
+ *  \file fusion_mesh.cu.h
+ *  \brief Header file containing marching cubes mesh extraction from depthmap fusion data
+ */
+#ifndef FUSION_MESH_CU_H
+#define FUSION_MESH_CU_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cuda_runtime_api.h>
+#include "fusion.h"
+#include "memory.h"
+#include "exception.h"
+
+/** \addtogroup fusion
+* @{
+*/
+
+/**
+ *  \brief Triangle mesh stored on the device
+ *
+ *  \details Vertices are shared between triangles, triangles hold three vertex indexes each, front faces point
+ * towards positive \f$u\f$ (free space). Buffers and scratch memory only grow, so extracting meshes of the same volume
+ * repeatedly does not reallocate.
+ */
+class fusionMesh
+{
+public:
+
+    /** \brief Default constructor, no memory is allocated */
+    __host__ inline
+    fusionMesh() : vertices_(0), triangles_(0), scratch_(0), nvertices_(0), ntriangles_(0), vcapacity_(0), tcapacity_(0),
+        scapacity_(0)
+    {}
+
+    /** \brief Destructor, deallocates all device buffers */
+    __host__ inline
+    ~fusionMesh()
+    {
+        if (vertices_) MemoryManagement<float3, Device>::CleanUp(vertices_);
+        if (triangles_) MemoryManagement<uint3, Device>::CleanUp(triangles_);
+        if (scratch_) MemoryManagement<unsigned int, Device>::CleanUp(scratch_);
+    }
+
+    /**
+     *  \brief Set number of vertices and triangles, growing buffers if needed
+     *
+     *  \param nvertices  number of vertices
+     *  \param ntriangles number of triangles
+     *  \return No return value
+     *
+     *  \details Contents of grown buffers are not kept
+     */
+    __host__ inline
+    void resize(unsigned int nvertices, unsigned int ntriangles)
+    {
+        if (nvertices > vcapacity_) {
+            if (vertices_) MemoryManagement<float3, Device>::CleanUp(vertices_);
+            MemoryManagement<float3, Device>::Malloc(vertices_, nvertices);
+            vcapacity_ = nvertices;
+        }
+        if (ntriangles > tcapacity_) {
+            if (triangles_) MemoryManagement<uint3, Device>::CleanUp(triangles_);
+            MemoryManagement<uint3, Device>::Malloc(triangles_, ntriangles);
+            tcapacity_ = ntriangles;
+        }
+        nvertices_ = nvertices;
+        ntriangles_ = ntriangles;
+    }
+
+    /**
+     *  \brief Get scratch memory for per voxel counters
+     *
+     *  \param elements number of voxels
+     *  \return Pointer to 2 * \p elements unsigned ints on the device
+     */
+    __host__ inline
+    unsigned int * scratch(size_t elements)
+    {
+        if (2 * elements > scapacity_) {
+            if (scratch_) MemoryManagement<unsigned int, Device>::CleanUp(scratch_);
+            MemoryManagement<unsigned int, Device>::Malloc(scratch_, 2 * elements);
+            scapacity_ = 2 * elements;
+        }
+        return scratch_;
+    }
+
+    /** \brief Get pointer to device vertex buffer */
+    __host__ inline
+    float3 * vertices() const { return vertices_; }
+
+    /** \brief Get pointer to device triangle index buffer */
+    __host__ inline
+    uint3 * triangles() const { return triangles_; }
+
+    /** \brief Get number of vertices */
+    __host__ inline
+    unsigned int vertexCount() const { return nvertices_; }
+
+    /** \brief Get number of triangles */
+    __host__ inline
+    unsigned int triangleCount() const { return ntriangles_; }
+
+    /**
+     *  \brief Copy mesh to host
+     *
+     *  \param vertices  vertex world coordinates
+     *  \param triangles vertex indexes of each triangle
+     *  \return No return value
+     */
+    __host__ inline
+    void copyTo(std::vector<float3> & vertices, std::vector<uint3> & triangles) const
+    {
+        vertices.resize(nvertices_);
+        triangles.resize(ntriangles_);
+        if (nvertices_ > 0) MemoryManagement<float3, Device>::Device2HostCopy(vertices.data(), vertices_, nvertices_);
+        if (ntriangles_ > 0) MemoryManagement<uint3, Device>::Device2HostCopy(triangles.data(), triangles_, ntriangles_);
+    }
+
+    /**
+     *  \brief Write mesh to binary PLY file
+     *
+     *  \param filename path to output file
+     *  \return No return value
+     */
+    __host__ inline
+    void savePLY(const std::string & filename) const
+    {
+        std::vector<float3> v;
+        std::vector<uint3> t;
+        copyTo(v, t);
+
+        std::ofstream out(filename.c_str(), std::ios::binary);
+        ASSERT_AUTO((out.is_open()));
+        out << "ply\nformat binary_little_endian 1.0\n"
+            << "element vertex " << v.size() << "\nproperty float x\nproperty float y\nproperty float z\n"
+            << "element face " << t.size() << "\nproperty list uchar int vertex_indices\nend_header\n";
+        for (size_t i = 0; i < v.size(); i++) out.write((const char *)&v[i], 3 * sizeof(float));
+        const unsigned char n = 3;
+        for (size_t i = 0; i < t.size(); i++) {
+            out.write((const char *)&n, 1);
+            out.write((const char *)&t[i], 3 * sizeof(unsigned int));
+        }
+    }
+
+protected:
+    float3 * vertices_;
+    uint3 * triangles_;
+    unsigned int * scratch_;
+    unsigned int nvertices_, ntriangles_, vcapacity_, tcapacity_;
+    size_t scapacity_;
+
+private:
+    fusionMesh(const fusionMesh &);
+    fusionMesh & operator=(const fusionMesh &);
+};
+
+/**
+ *  \brief Extract triangle mesh of zero level set of \f$u\f$ with marching cubes
+ *
+ *  \param f       \p fusionData
+ *  \param mesh    output mesh, buffers are grown as needed
+ *  \param blocks  kernel grid dimensions covering all voxels
+ *  \param threads single block dimensions
+ *  \param stream  CUDA stream to launch kernels on
+ *  \return No return value
+ *
+ *  \details Cells between 8 neighbouring voxel centers are classified by signs of \f$u\f$, per voxel vertex and
+ * triangle counts are exclusive scanned and vertices / triangles are then written at their offsets. Each voxel owns
+ * vertices on the three cell edges starting at it, so vertices are shared between cells. Synchronizes \p stream once
+ * to read mesh size.
+ */
+template<unsigned char _bins>
+void FusionExtractMesh(fusionData<_bins> f, fusionMesh & mesh, dim3 blocks, dim3 threads, cudaStream_t stream = 0);
+
+template void FusionExtractMesh<2>(fusionData<2> f, fusionMesh & mesh, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionExtractMesh<3>(fusionData<3> f, fusionMesh & mesh, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionExtractMesh<4>(fusionData<4> f, fusionMesh & mesh, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionExtractMesh<5>(fusionData<5> f, fusionMesh & mesh, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionExtractMesh<6>(fusionData<6> f, fusionMesh & mesh, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionExtractMesh<7>(fusionData<7> f, fusionMesh & mesh, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionExtractMesh<8>(fusionData<8> f, fusionMesh & mesh, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionExtractMesh<9>(fusionData<9> f, fusionMesh & mesh, dim3 blocks, dim3 threads, cudaStream_t stream);
+template void FusionExtractMesh<10>(fusionData<10> f, fusionMesh & mesh, dim3 blocks, dim3 threads, cudaStream_t stream);
+
+/** @} */ // group fusion
+
+#endif // FUSION_MESH_CU_H
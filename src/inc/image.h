@@ -117,6 +117,25 @@ public:
         if (hto && hfrom) { Host2HostCopy(img.data(), img.pitch(), ptr_, pitch_, w_, h_); return; }
     }
 
+    template<MemoryKind memFrom>
+    inline __host__
+    void copyFromAsync(const Image<T,memFrom>& img, cudaStream_t stream)
+    {
+        ASSERT_AUTO(((w_ == img.width()) && (h_ == img.height())));
+        bool dto = (memT == Device) || (memT == Managed);
+        bool dfrom = (memFrom == Device) || (memFrom == Managed);
+        cudaMemcpyKind kind = dto ? (dfrom ? cudaMemcpyDeviceToDevice : cudaMemcpyHostToDevice)
+                                  : (dfrom ? cudaMemcpyDeviceToHost : cudaMemcpyHostToHost);
+        Copy2DAsync(ptr_, pitch_, img.data(), img.pitch(), w_, h_, kind, stream);
+    }
+
+    template<MemoryKind memTo>
+    inline __host__
+    void copyToAsync(Image<T,memTo> & img, cudaStream_t stream) const
+    {
+        img.copyFromAsync(*this, stream);
+    }
+
     inline __host__
     void copyFrom(const T* ptr, size_t pitch)
     {
@@ -131,6 +150,19 @@ public:
         else return Host2HostCopy(ptr, pitch, ptr_, pitch_, w_, h_);
     }
 
+    // Managed memory migration and usage hints, no-op for other memory kinds
+    inline __host__
+    void prefetch(int device, cudaStream_t stream = 0) const
+    {
+        this->Prefetch(ptr_, pitch_ * h_, device, stream);
+    }
+
+    inline __host__
+    void advise(int advice, int device) const
+    {
+        this->Advise(ptr_, pitch_ * h_, advice, device);
+    }
+
     inline __host__
     void reset(size_t w, size_t h)
     {
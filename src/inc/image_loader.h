@@ -0,0 +1,136 @@
+/**
+ *  \file image_loader.h
+ *  \brief Header file containing thread pool image loader with bounded look-ahead
+ */
+#ifndef IMAGE_LOADER_H
+#define IMAGE_LOADER_H
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <QString>
+#include <QStringList>
+#include <QImage>
+#include "defines.h"
+
+/**
+ *  \brief Thread pool decoding images ahead of use
+ *
+ *  \details Images are requested by file name and decoded in parallel by worker threads, together with their
+ * grayscale conversion. \a take() waits for a requested image or decodes it on the calling thread if it was never
+ * requested. At most \a lookahead() images are kept, the oldest request is dropped first, so look-ahead does not grow
+ * without bound when frames are skipped. Pinned requests, e.g. views of the current window, are never dropped, so
+ * look-ahead requested after them cannot evict them before they are taken.
+ */
+class ImageLoader
+{
+public:
+    /**
+     *  \brief Decoded image
+     */
+    struct Frame
+    {
+        QImage image;               //!< decoded image
+        std::vector<float> gray;    //!< row major grayscale of \a image, RGB2GRAY_WEIGHT_* weighted
+        bool loaded = false;        //!< false if decoding failed
+
+        int width() const { return image.width(); }
+        int height() const { return image.height(); }
+
+        /**
+         *  \brief Copy grayscale to contiguous buffer of \a width() * \a height() elements, e.g. pinned host image
+         *
+         *  \param data pointer to destination buffer
+         *  \return No return value
+         */
+        template<typename T>
+        void copyGray(T * data) const
+        {
+            for (size_t i = 0; i < gray.size(); i++) data[i] = T(gray[i]);
+        }
+    };
+
+    /** \brief Process wide loader instance */
+    static ImageLoader & instance();
+
+    /**
+     *  \brief Constructor, starts worker threads
+     *
+     *  \param threads   number of decoding threads, 0 uses hardware concurrency
+     *  \param lookahead maximum number of requested and decoded images kept
+     */
+    ImageLoader(unsigned int threads = DEFAULT_LOADER_THREADS, unsigned int lookahead = DEFAULT_LOADER_LOOKAHEAD);
+
+    /** \brief Destructor, drops queued requests and joins worker threads */
+    ~ImageLoader();
+
+    /**
+     *  \brief Queue image for decoding, returns immediately
+     *
+     *  \param fname image file name
+     *  \param pin   keep the image until it is taken, it does not count towards \a lookahead()
+     *  \return No return value
+     *
+     *  \details Already requested images are not queued again, they are pinned if \p pin is set
+     */
+    void request(const QString & fname, bool pin = false);
+
+    /** \brief Queue multiple images for decoding in the given order */
+    void request(const QStringList & fnames, bool pin = false);
+
+    /**
+     *  \brief Get decoded image, waiting for it if needed
+     *
+     *  \param fname image file name
+     *  \param frame decoded image returned by reference
+     *  \return False if the image could not be loaded
+     *
+     *  \details The image is removed from the loader
+     */
+    bool take(const QString & fname, Frame & frame);
+
+    /** \brief Drop all queued and decoded images */
+    void clear();
+
+    /** \brief Get maximum number of kept images */
+    unsigned int lookahead() const { return lookahead_; }
+
+    /**
+     *  \brief Decode image and compute its grayscale
+     *
+     *  \param fname image file name
+     *  \param frame decoded image returned by reference
+     *  \return False if the image could not be loaded
+     */
+    static bool decode(const QString & fname, Frame & frame);
+
+protected:
+    struct Slot
+    {
+        Frame frame;
+        bool done = false;
+        bool pinned = false;
+    };
+
+    void work();
+    void evict();
+
+    std::vector<std::thread> workers_;
+    std::deque<QString> queue_;                         // names waiting for a worker
+    std::deque<QString> order_;                         // names of unpinned requests in request order, for eviction
+    std::map<QString, std::shared_ptr<Slot>> slots_;
+    std::mutex mutex_;
+    std::condition_variable queued_, decoded_;
+    unsigned int lookahead_;
+    bool stop_;
+
+private:
+    ImageLoader(const ImageLoader &);
+    ImageLoader & operator=(const ImageLoader &);
+};
+
+#endif // IMAGE_LOADER_H
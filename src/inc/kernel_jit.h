@@ -0,0 +1,132 @@
+/**
+ *  \file kernel_jit.h
+ *  \brief Header file containing runtime specialization of hot kernels with NVRTC
+ */
+#ifndef KERNEL_JIT_H
+#define KERNEL_JIT_H
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cuda.h>
+#include <cuda_runtime_api.h>
+#include "structs.h"
+#include "defines.h"
+
+/**
+ *  \brief Compiles the fused NCC sweep, fused TVL1 and fusion histogram kernels for the active configuration
+ *
+ *  \details Image sizes, window size, solver parameters, histogram bins and block dimensions are compile time constants
+ * of the JIT kernels, so window loops are unrolled and index arithmetic is folded without adding static instances.
+ * Sources are compiled with NVRTC for the virtual architecture of the current device and PTX is kept in memory and in
+ * \a DEFAULT_JIT_CACHE_DIR, named by a 64 bit FNV-1a hash of the source, compile options, architecture and NVRTC
+ * version, so a configuration is only compiled once per machine.
+ *
+ * Launchers return false if JIT is disabled, the library was built without \a USE_NVRTC or compiling or launching
+ * failed, callers launch their static kernels then. Results match the static kernels up to float rounding. Modules
+ * belong to the primary context of a device, \a forget() drops them after a device reset.
+ */
+class KernelJit
+{
+public:
+    /** \brief Process wide instance, its cache directory is \a DEFAULT_JIT_CACHE_DIR */
+    static KernelJit & instance();
+
+    /**
+     *  \brief Constructor
+     *
+     *  \param dir cache directory, no disk cache is used if empty
+     */
+    explicit KernelJit(const std::string & dir = DEFAULT_JIT_CACHE_DIR);
+
+    /**
+     *  \brief Enable or disable JIT kernels
+     *
+     *  \param enable use JIT kernels, ignored if the library was built without \a USE_NVRTC
+     *  \return No return value
+     */
+    void setEnabled(bool enable) { enabled_ = enable && available(); }
+
+    /** \brief Get whether JIT kernels are used */
+    bool enabled() const { return enabled_; }
+
+    /** \brief Get whether the library was built with NVRTC */
+    static bool available();
+
+    /**
+     *  \brief Use other cache directory
+     *
+     *  \param dir cache directory, created on first write, no disk cache is used if empty
+     *  \return No return value
+     */
+    void setCacheDir(const std::string & dir);
+
+    /** \brief Drop loaded modules without unloading them, e.g. after \a cudaDeviceReset() */
+    void forget();
+
+    /**
+     *  \brief Specialized \a planesweep_fused_NCC() of float sources
+     *
+     *  \return True if the JIT kernel was launched, see \a planesweep_fused_NCC() for the other parameters
+     */
+    bool planesweepNCC(float * d_depthmap, float * d_bestncc, float * d_subplane, const float * d_src, const float * d_ref,
+                       const float * d_refmean, const float * d_refstd, const Matrix3D * d_h, const float current_depth,
+                       const unsigned int winsize, const float stdthresh, const int width, const int height,
+                       dim3 blocks, dim3 threads);
+
+    /**
+     *  \brief Specialized \a denoising_TVL1_fused()
+     *
+     *  \return True if the JIT kernel was launched, see \a denoising_TVL1_fused() for the parameters
+     */
+    bool tvl1Fused(float * d_output, float * d_R, float * d_Px, float * d_Py, const float * d_input,
+                   const float * d_Rin, const float * d_Pxin, const float * d_Pyin, const float * d_origin,
+                   const float * d_T11, const float * d_T12, const float * d_T21, const float * d_T22,
+                   const float tau, const float theta, const float lambda, const float sigma, const float firstsigma,
+                   const unsigned int iterations, const int width, const int height, dim3 blocks, dim3 threads);
+
+    /**
+     *  \brief Specialized \a FusionUpdateHistogram() of a dense \a fusionvoxel volume in \a ArrayOfStructs layout
+     *
+     *  \param d_voxels   pointer to first voxel
+     *  \param pitch      bytes between voxel rows
+     *  \param spitch     bytes between voxel slices
+     *  \param voxelbytes size of a voxel
+     *  \param histoffset offset of the histogram in a voxel
+     *  \param bins       number of histogram bins
+     *  \param size       number of voxels in each dimension
+     *  \param a          first volume corner in world coordinates
+     *  \param extent     volume size in world coordinates
+     *  \param depthmap   pointer to depthmap on the device
+     *  \param K          3x3 camera calibration matrix
+     *  \param R          3x3 rotation matrix from world to camera coordinates
+     *  \param t          translation vector from world to camera position
+     *  \param threshold  signed distance value threshold
+     *  \param width      depthmap width
+     *  \param height     depthmap height
+     *  \param blocks     kernel grid dimensions covering all voxels
+     *  \param threads    single block dimensions
+     *  \param stream     CUDA stream
+     *  \return True if the JIT kernel was launched
+     */
+    bool fusionHistogram(void * d_voxels, size_t pitch, size_t spitch, size_t voxelbytes, size_t histoffset, int bins,
+                         int3 size, float3 a, float3 extent, const float * depthmap, const Matrix3D & K,
+                         const Matrix3D & R, const Vector3D & t, const float threshold, const int width,
+                         const int height, dim3 blocks, dim3 threads, cudaStream_t stream = 0);
+
+protected:
+    // Loaded kernel of a source and its compile options on the current device, 0 if it failed before
+    CUfunction function(const char * source, const char * name, const std::vector<std::string> & options);
+    bool compile(const char * source, const std::vector<std::string> & options, std::string & ptx, std::string & log);
+    bool launch(CUfunction f, dim3 blocks, dim3 threads, cudaStream_t stream, void ** args);
+
+    std::map<std::string, CUmodule> modules_;  // device ordinal and configuration hash to loaded module
+    std::set<std::string> failed_;             // configurations that did not compile or load, not retried
+    std::string dir_;
+    bool enabled_ = false;
+    std::mutex mutex_;
+};
+
+#endif // KERNEL_JIT_H
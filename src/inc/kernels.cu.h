@@ -11,10 +11,17 @@
 #include <helper_cuda.h>    // includes for helper CUDA functions
 #include <cuda_runtime_api.h>
 #include <cuda.h>
+#include <cuda_fp16.h>
 #include <structs.h>
 
 /** \addtogroup general  General
 * \brief General CUDA kernel functions, mostly for float type data
+*
+* Arrays are dense, rows are \a width elements apart. Element wise functions (\a calculate_STD(), \a set_value(),
+* \a element_multiply(), \a element_rdivide(), \a element_scale(), \a element_add(), \a set_QNAN_value(),
+* \a replace_QNAN(), \a valid_mask(), \a depth_confidence(), \a set_QNAN_masked(), \a subtract() and
+* \a calculateWeights_sparseDepth()) run over flat arrays with float4 accesses if all arrays are 16 byte aligned, so any
+* width runs at full bandwidth. They only take the number of threads from \p threads and ignore \p blocks.
 * @{
 */
 
@@ -39,6 +46,46 @@ void bilinear_interpolation(float * d_result, const float * d_data,
                             const int M1, const int M2, const int N1, const int N2,
                             dim3 blocks, dim3 threads);
 
+/**
+ *  \brief This is an overloaded function for half precision input data
+ *
+ *  \details Samples are converted to float before interpolation
+ */
+void bilinear_interpolation(float * d_result, const __half * d_data,
+                            const float * d_xout, const float * d_yout,
+                            const int M1, const int M2, const int N1, const int N2,
+                            dim3 blocks, dim3 threads);
+
+/**
+ *  \brief This is an overloaded function for unsigned char input data
+ *
+ *  \details Samples are converted to float before interpolation
+ */
+void bilinear_interpolation(float * d_result, const unsigned char * d_data,
+                            const float * d_xout, const float * d_yout,
+                            const int M1, const int M2, const int N1, const int N2,
+                            dim3 blocks, dim3 threads);
+
+/**
+ *  \brief Perform bilinear interpolation on data stored in texture
+ *
+ *  \param d_result pointer to output 2D data from interpolation, same size and \a d_xout and \a d_yout
+ *  \param tex      texture object of input 2D data, see \a Texture
+ *  \param d_xout   pointer to \a x indexes to evaluate input data at
+ *  \param d_yout   pointer to \a y indexes to evaluate input data at
+ *  \param N1       \a d_xout and \a d_yout width
+ *  \param N2       \a d_xout and \a d_yout height
+ *  \param blocks   kernel grid dimensions
+ *  \param threads  single block dimensions
+ *
+ *  \details Same indexing as \a bilinear_interpolation(), interpolation is done by texture units.
+ * Texture border addressing blends samples within one pixel of the border with 0 instead of setting them to 0.
+ */
+void bilinear_interpolation_texture(float * d_result, const cudaTextureObject_t tex,
+                                    const float * d_xout, const float * d_yout,
+                                    const int N1, const int N2,
+                                    dim3 blocks, dim3 threads);
+
 /**
  *  \brief Calculate normalized cross correlation (NCC) for each element
  *
@@ -94,8 +141,10 @@ void calculate_STD(float * d_std, const float * d_mean,
  *  \param height      height of given arrays
  *  \param blocks      kernel grid dimensions
  *  \param threads     single block dimensions
+ *  \param stream      stream to launch kernel in
  */
-void set_value(float * d_output, const float value, const int width, const int height, dim3 blocks, dim3 threads);
+void set_value(float * d_output, const float value, const int width, const int height, dim3 blocks, dim3 threads,
+               cudaStream_t stream = 0);
 
 /**
  *  \brief Element wise mutiplication
@@ -145,8 +194,8 @@ void element_rdivide(float * d_output, const float * d_input1,
  *  \param blocks      kernel grid dimensions
  *  \param threads     single block dimensions
  *
- *  \details <b>DOES NOT WORK, OUTPUTS WRONG VALUES</b>
- * All values below \a min are set to 0, above \a max - to 255
+ *  \details All values below \a min are set to 0, above \a max - to 255, QNANs are set to 255.
+ * If \a min > \a max scale is inverted.
  */
 void convert_float_to_uchar(unsigned char *d_output, const float * d_input,
                             const float min, const float max,
@@ -164,6 +213,9 @@ void convert_float_to_uchar(unsigned char *d_output, const float * d_input,
  *  \param height      height of given arrays
  *  \param blocks      kernel grid dimensions
  *  \param threads     single block dimensions
+ *
+ *  \details Window sizes 3, 5, 7, 9, 11 and 15 run unrolled instances with \p squared fixed at compile time, other
+ * sizes run the generic kernel. Both sum taps in the same order, so results are bit identical.
  */
 void windowed_mean_row(float * d_output, const float * d_input,
                        const unsigned int winsize, const bool squared,
@@ -180,26 +232,169 @@ void windowed_mean_row(float * d_output, const float * d_input,
  *  \param height      height of given arrays
  *  \param blocks      kernel grid dimensions
  *  \param threads     single block dimensions
+ *
+ *  \details Window sizes 3, 5, 7, 9, 11 and 15 run unrolled instances with \p squared fixed at compile time, other
+ * sizes run the generic kernel. Both sum taps in the same order, so results are bit identical.
  */
 void windowed_mean_column(float * d_output, const float * d_input,
                           const unsigned int winsize, const bool squared,
                           const int width, const int height, dim3 blocks, dim3 threads);
 
+/**
+ *  \brief Row wise mean calculation using sliding window sums
+ *
+ *  \param d_output    pointer to output means
+ *  \param d_input     pointer to input data
+ *  \param winsize     size of window to calculate means in
+ *  \param squared     calculate mean of squares?
+ *  \param width       width of given arrays
+ *  \param height      height of given arrays
+ *  \param blocks      ignored, grid is calculated from the row span of a block
+ *  \param threads     ignored, blocks have \a SLIDING_MEAN_ROW_THREADS threads per row
+ *
+ *  \details Same result and mirrored borders as \a windowed_mean_row(), but cost per element does not depend on \a winsize.
+ * Each thread sums a full window once and then slides it over \a DEFAULT_SLIDING_MEAN_SEGMENT elements of a row. Rows
+ * of a block are staged in shared memory with coalesced loads and means are stored the same way, so no warp reads
+ * or writes the image with a stride. Windows whose tile exceeds \a SLIDING_MEAN_MAX_SHARED run \a windowed_mean_row().
+ */
+void windowed_mean_row_sliding(float * d_output, const float * d_input,
+                               const unsigned int winsize, const bool squared,
+                               const int width, const int height, dim3 blocks, dim3 threads);
+
+/**
+ *  \brief Column wise mean calculation using sliding window sums
+ *
+ *  \param d_output    pointer to output means
+ *  \param d_input     pointer to input data
+ *  \param winsize     size of window to calculate means in
+ *  \param squared     calculate mean of squares?
+ *  \param width       width of given arrays
+ *  \param height      height of given arrays
+ *  \param blocks      ignored, grid is calculated from \a threads
+ *  \param threads     single block dimensions
+ *
+ *  \details Same result and mirrored borders as \a windowed_mean_column(), but cost per element does not depend on \a winsize.
+ * Each thread sums a full window once and then slides it over \a DEFAULT_SLIDING_MEAN_SEGMENT elements of a column.
+ */
+void windowed_mean_column_sliding(float * d_output, const float * d_input,
+                                  const unsigned int winsize, const bool squared,
+                                  const int width, const int height, dim3 blocks, dim3 threads);
+
 /**
  *  \brief Conversion from unsigned char to float array
  *
  *  \param d_output    pointer to output float data
  *  \param d_input     pointer to input unsigned char data
+ *  \param scale       factor applied to every element, e.g. 1/255 to normalize
  *  \param width       width of given arrays
  *  \param height      height of given arrays
  *  \param blocks      kernel grid dimensions
  *  \param threads     single block dimensions
- *
- *  \details <b>DOES NOT WORK, OUTPUTS WRONG VALUES</b>
+ *  \param stream      stream to launch kernel in
  */
-void convert_uchar_to_float(float * d_output, const unsigned char * d_input,
+void convert_uchar_to_float(float * d_output, const unsigned char * d_input, const float scale,
                             const int width, const int height,
-                            dim3 blocks, dim3 threads);
+                            dim3 blocks, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Conversion from 8 bit color to grayscale float array
+ *
+ *  \param d_output     pointer to output grayscale data
+ *  \param d_normalized pointer to additional output of grayscale divided by 255, not written if 0
+ *  \param d_input      pointer to input color data in \a QImage::Format_RGB32 memory order, i.e. B, G, R, A bytes
+ *  \param scale        factor applied to \p d_output, 1 keeps [0, 255] range
+ *  \param width        width of given arrays
+ *  \param height       height of given arrays
+ *  \param blocks       kernel grid dimensions
+ *  \param threads      single block dimensions
+ *  \param stream       stream to launch kernel in
+ *
+ *  \details Gray conversion uses RGB2GRAY_WEIGHT_* weights, same as host side conversion of loaded images.
+ * Color images are uploaded as one 32 bit element per pixel, which replaces host conversion to gray followed by
+ * a separate normalization kernel.
+ */
+void convert_rgba_to_gray(float * d_output, float * d_normalized, const uchar4 * d_input, const float scale,
+                          const int width, const int height,
+                          dim3 blocks, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Project 3D points into sparse depthmap
+ *
+ *  \param d_depth  pointer to output depthmap, 0 where no point projects
+ *  \param d_w      pointer to output weights, 1 where a point projects and 0 elsewhere, not written if 0
+ *  \param d_points pointer to points, w component is ignored, e.g. Velodyne scan uploaded by \a KITTI::VeloScan::upload()
+ *  \param npoints  number of points
+ *  \param T        transformation of points to camera coordinates, e.g. \a KITTIData::getTFormVelo2RectCam()
+ *  \param K        camera calibration matrix
+ *  \param zmin     points at or closer than this depth are skipped
+ *  \param width    width of given depthmap
+ *  \param height   height of given depthmap
+ *  \param blocks   kernel grid dimensions of the depthmap
+ *  \param threads  single block dimensions, points are processed by blocks of the same number of threads
+ *  \param stream   stream to launch kernels in
+ *
+ *  \details Closest point of each pixel is kept by atomic minimum on the bit pattern of its depth, so \p d_depth
+ * serves as z-buffer and no other memory is needed. Output is ready for \a calculateWeights_sparseDepth() or can be
+ * used with \p d_w directly.
+ */
+void project_points_depth(float * d_depth, float * d_w, const float4 * d_points, const int npoints,
+                          const Matrix4D & T, const Matrix3D & K, const float zmin,
+                          const int width, const int height,
+                          dim3 blocks, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Back-project depthmap into interleaved colored points
+ *
+ *  \param d_points    pointer to output points, one per pixel in row major order
+ *  \param stride      size of single point in bytes, multiple of 16
+ *  \param coloroffset offset of 32 bit color from the start of a point in bytes, e.g. of \a rgba in \a pcl::PointXYZRGBA
+ *  \param d_depth     pointer to depthmap
+ *  \param d_color     pointer to color image in B, G, R, A byte order, gray is used if 0
+ *  \param d_gray      pointer to grayscale image in range [0, 255], black is used if 0 as well
+ *  \param invK        inverse of camera calibration matrix
+ *  \param width       width of given images
+ *  \param height      height of given images
+ *  \param blocks      kernel grid dimensions
+ *  \param threads     single block dimensions
+ *  \param stream      stream to launch kernel in
+ *
+ *  \details Each point starts with x, y, z and 1 as \a float4, followed by color at \p coloroffset
+ * packed as 0xAARRGGBB.
+ */
+void depth_to_points(void * d_points, const int stride, const int coloroffset, const float * d_depth,
+                     const uchar4 * d_color, const float * d_gray, const Matrix3D & invK,
+                     const int width, const int height,
+                     dim3 blocks, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Conversion from float to half precision array
+ *
+ *  \param d_output    pointer to output half precision data
+ *  \param d_input     pointer to input float data
+ *  \param width       width of given arrays
+ *  \param height      height of given arrays
+ *  \param blocks      kernel grid dimensions
+ *  \param threads     single block dimensions
+ */
+void convert_float_to_half(__half * d_output, const float * d_input,
+                           const int width, const int height,
+                           dim3 blocks, dim3 threads);
+
+/**
+ *  \brief Conversion from float to unsigned char array without rescaling
+ *
+ *  \param d_output    pointer to output unsigned char data
+ *  \param d_input     pointer to input float data
+ *  \param width       width of given arrays
+ *  \param height      height of given arrays
+ *  \param blocks      kernel grid dimensions
+ *  \param threads     single block dimensions
+ *
+ *  \details Values are rounded to nearest integer and clamped to [0, 255], intended for intensity images
+ */
+void quantize_float_to_uchar(unsigned char * d_output, const float * d_input,
+                             const int width, const int height,
+                             dim3 blocks, dim3 threads);
 
 /**
  *  \brief Scale elements of given array
@@ -225,6 +420,18 @@ void element_scale(float * d_output, const float scale, const int width, const i
  */
 void element_add(float * d_output, const float value, const int width, const int height, dim3 blocks, dim3 threads);
 
+/**
+ *  \brief Add second array to given array elements
+ *
+ *  \param d_output    pointer to data values to modify
+ *  \param d_input     pointer to values to add
+ *  \param width       width of given arrays
+ *  \param height      height of given arrays
+ *  \param blocks      kernel grid dimensions
+ *  \param threads     single block dimensions
+ */
+void element_add(float * d_output, const float * d_input, const int width, const int height, dim3 blocks, dim3 threads);
+
 /**
  *  \brief Find and replace all \a QNANs with scalar value
  *
@@ -237,6 +444,99 @@ void element_add(float * d_output, const float value, const int width, const int
  */
 void set_QNAN_value(float * d_output, const float value, const int width, const int height, dim3 blocks, dim3 threads);
 
+/**
+ *  \brief Find and replace all \a QNANs with values of another image
+ *
+ *  \param d_output    pointer to data to replace \a QNANs in
+ *  \param d_fill      pointer to replacement values
+ *  \param width       width of given arrays
+ *  \param height      height of given arrays
+ *  \param blocks      kernel grid dimensions
+ *  \param threads     single block dimensions
+ */
+void replace_QNAN(float * d_output, const float * d_fill, const int width, const int height, dim3 blocks, dim3 threads);
+
+/**
+ *  \brief Validity of averaged depthmap pixels
+ *
+ *  \param d_valid     pointer to validity returned by reference, 1 for valid pixels and 0 otherwise
+ *  \param d_count     pointer to number of source views that passed the NCC threshold, see \a sum_depthmap_NCC()
+ *  \param d_mask      pointer to optional validity mask, pixels with values <= 0 are invalid, 0 for none
+ *  \param width       width of given arrays
+ *  \param height      height of given arrays
+ *  \param blocks      kernel grid dimensions
+ *  \param threads     single block dimensions
+ */
+void valid_mask(float * d_valid, const float * d_count, const float * d_mask, const int width, const int height,
+                dim3 blocks, dim3 threads);
+
+/**
+ *  \brief Confidence of averaged depthmap pixels
+ *
+ *  \param d_confidence pointer to confidence returned by reference, in range [0,1]
+ *  \param d_count      pointer to number of source views that passed the NCC threshold, see \a sum_depthmap_NCC()
+ *  \param scale        confidence of a single view, counts are clamped to 1 / \p scale
+ *  \param width        width of given arrays
+ *  \param height       height of given arrays
+ *  \param blocks       kernel grid dimensions
+ *  \param threads      single block dimensions
+ */
+void depth_confidence(float * d_confidence, const float * d_count, const float scale, const int width, const int height,
+                      dim3 blocks, dim3 threads);
+
+/**
+ *  \brief Set invalid pixels to \a QNAN
+ *
+ *  \param d_output    pointer to data to be masked
+ *  \param d_valid     pointer to validity, pixels with values <= 0 are set
+ *  \param width       width of given arrays
+ *  \param height      height of given arrays
+ *  \param blocks      kernel grid dimensions
+ *  \param threads     single block dimensions
+ *  \param threshold   pixels with values below it are set as well, e.g. a minimum confidence
+ */
+void set_QNAN_masked(float * d_output, const float * d_valid, const int width, const int height, dim3 blocks, dim3 threads,
+                     const float threshold = 0.f);
+
+/**
+ *  \brief Forward warp depthmap into another view of the same camera
+ *
+ *  \param d_output    pointer to warped depthmap, \a QNAN where no pixel was warped to
+ *  \param d_depth     pointer to input depthmap
+ *  \param Rrel        relative rotation from input to output view, see \a PlaneSweep::RelativeMatrices()
+ *  \param trel        relative translation from input to output view
+ *  \param K           calibration matrix of both views, 1 based pixel coordinates
+ *  \param zmin        input and warped depths at or below are unknown
+ *  \param zmax        input and warped depths at or above are unknown
+ *  \param width       width of given arrays
+ *  \param height      height of given arrays
+ *  \param blocks      kernel grid dimensions
+ *  \param threads     single block dimensions
+ *
+ *  \details Each input pixel is moved to its 3D point, transformed and splatted onto the 4 output pixels around its
+ * projection. Nearest depth wins, so occluded surfaces are hidden and disoccluded pixels stay \a QNAN.
+ */
+void depthmap_forward_warp(float * d_output, const float * d_depth,
+                           const Matrix3D & Rrel, const Vector3D & trel, const Matrix3D & K,
+                           const float zmin, const float zmax,
+                           const int width, const int height, dim3 blocks, dim3 threads);
+
+/**
+ *  \brief Accumulate squared change and squared norm of an array
+ *
+ *  \param d_sums      pointer to 2 floats, \f$\sum (u - u_{prev})^2\f$ and \f$\sum u^2\f$ are added to them
+ *  \param d_u         pointer to current values
+ *  \param d_uprev     pointer to previous values
+ *  \param width       width of given arrays
+ *  \param height      height of given arrays
+ *  \param blocks      kernel grid dimensions
+ *  \param threads     single block dimensions
+ *
+ *  \details Each block reduces its sums in shared memory and adds them atomically, \a d_sums has to be set to 0 before the call
+ */
+void relative_change(float * d_sums, const float * d_u, const float * d_uprev,
+                     const int width, const int height, dim3 blocks, dim3 threads);
+
 /**
 *  \brief Calculate 3D world positions of pixels in an image
 *
@@ -266,6 +566,45 @@ void compute3D(float * d_x, float * d_y, float * d_z, const Matrix3D Rrel, const
 *  \param threads  single block dimensions
 */
 void subtract(float * d_out, const float * d_in1, const float * d_in2, const int width, const int height, dim3 blocks, dim3 threads);
+/**
+*  \brief Downsample data to half size by averaging 2x2 neighbourhoods
+*
+*  \param d_output      pointer to output data
+*  \param d_input       pointer to input data
+*  \param input_width   width of input array
+*  \param input_height  height of input array
+*  \param width         width of output array, should be <em>(input_width + 1) / 2</em>
+*  \param height        height of output array, should be <em>(input_height + 1) / 2</em>
+*  \param blocks        kernel grid dimensions of output array
+*  \param threads       single block dimensions
+*
+*  \details Last row and column are repeated for odd input sizes. Output pixel \a i is centered
+* at input coordinate <em>2i + 0.5</em>.
+*/
+void downsample_half(float * d_output, const float * d_input,
+                     const int input_width, const int input_height,
+                     const int width, const int height,
+                     dim3 blocks, dim3 threads);
+
+/**
+*  \brief Upsample data to double size with bilinear interpolation
+*
+*  \param d_output      pointer to output data
+*  \param d_input       pointer to input data
+*  \param input_width   width of input array
+*  \param input_height  height of input array
+*  \param width         width of output array, e.g. width of array \a d_input was downsampled from
+*  \param height        height of output array
+*  \param blocks        kernel grid dimensions of output array
+*  \param threads       single block dimensions
+*
+*  \details Inverse of \a downsample_half() sampling, output pixel \a i is sampled at input coordinate
+* <em>i/2 - 0.25</em>, clamped to input array.
+*/
+void upsample_double(float * d_output, const float * d_input,
+                     const int input_width, const int input_height,
+                     const int width, const int height,
+                     dim3 blocks, dim3 threads);
 /** @} */ // group general
 
 /** \addtogroup planesweep  Planesweep
@@ -291,6 +630,23 @@ void transform_indexes(float * d_x, float * d_y,
                        const Matrix3D h,
                        const int width, const int height, dim3 blocks, dim3 threads);
 
+/**
+*  \brief This is an overloaded function taking homography from device memory
+*
+*  \param d_x     pointer to output \a x indexes
+*  \param d_y     pointer to output \a y indexes
+*  \param d_h     pointer to 3x3 transformation matrix on the device, e.g. entry of a homography table
+*  \param width   width of given arrays
+*  \param height  height of given arrays
+*  \param blocks  kernel grid dimensions
+*  \param threads single block dimensions
+*
+*  \details Transformation is applied to 1 based index coordinates
+*/
+void transform_indexes(float * d_x, float * d_y,
+                       const Matrix3D * d_h,
+                       const int width, const int height, dim3 blocks, dim3 threads);
+
 /**
 *  \brief Depthmap update function
 *
@@ -302,14 +658,17 @@ void transform_indexes(float * d_x, float * d_y,
 *  \param height          height of given arrays
 *  \param blocks          kernel grid dimensions
 *  \param threads         single block dimensions
+*  \param d_subplane      optional sub-plane state, 3 arrays of \a width x \a height
 *
 *  \details If current NCC value is greater than best value, best value is changed to current
-and depthmap value is changed to current depth
+and depthmap value is changed to current depth. With \a d_subplane the NCC of the last plane, the plane before the
+best one and the plane after it are kept for \a sum_depthmap_NCC(), planes have to be swept in order. State is
+initialized to \a SUBPLANE_NONE.
 */
 void update_arrays(float * d_depthmap, float * d_bestncc,
                    const float * d_currentncc, const float current_depth,
                    const int width, const int height,
-                   dim3 blocks, dim3 threads);
+                   dim3 blocks, dim3 threads, float * d_subplane = 0);
 
 /**
 *  \brief Sum depthmaps and increases summation count if corresponding NCC value is greater than threshold
@@ -323,14 +682,575 @@ void update_arrays(float * d_depthmap, float * d_bestncc,
 *  \param height          height of given arrays
 *  \param blocks          kernel grid dimensions
 *  \param threads         single block dimensions
+*  \param d_subplane      optional sub-plane state of the sweep, see \a update_arrays()
+*  \param step            plane step of the sampled parameter, depth or inverse depth
+*  \param inverse         planes are sampled uniformly in inverse depth
 *
-*  \details Keeping count is required for averaging in later step
+*  \details Keeping count is required for averaging in later step. With \a d_subplane a parabola is fit through
+the NCC of the best plane and its neighbours, depth is moved to its vertex by at most half a plane.
 */
 void sum_depthmap_NCC(float * d_depthmap_out, float * d_count,
                       const float * d_depthmap, const float * d_ncc,
                       const float nccthreshold,
                       const int width, const int height,
-                      dim3 blocks, dim3 threads);
+                      dim3 blocks, dim3 threads,
+                      const float * d_subplane = 0, const float step = 0.f, const bool inverse = false);
+
+/**
+*  \brief Fused planesweep step evaluating a single depth plane in one kernel
+*
+*  \param d_depthmap      pointer to depthmap to be updated
+*  \param d_bestncc       pointer to best NCC values to be updated
+*  \param d_src           pointer to source view intensity image
+*  \param d_ref           pointer to reference view intensity image
+*  \param d_refmean       pointer to reference windowed means image
+*  \param d_refstd        pointer to reference windowed STD image
+*  \param d_h             pointer to 3x3 homography from reference to source view at \a current_depth on the device
+*  \param current_depth   current depth of planesweep algorithm
+*  \param winsize         NCC window side length
+*  \param stdthresh       standard deviation threshold for both views
+*  \param width           width of given arrays
+*  \param height          height of given arrays
+*  \param blocks          kernel grid dimensions
+*  \param threads         single block dimensions
+*  \param d_subplane      optional sub-plane state, see \a update_arrays()
+*
+*  \details Equivalent to \a transform_indexes, \a bilinear_interpolation, windowed means, \a calculate_STD,
+* \a calcNCC and \a update_arrays sequence. Each block warps its tile with a <em>winsize / 2</em> halo into
+* shared memory, so \a threads and \a winsize set the dynamic shared memory size of
+* <em>2 * (threads.x + winsize - 1) * (threads.y + winsize - 1)</em> floats. Window sizes 3, 5, 7, 9, 11 and 15 run
+* instances with unrolled window loops for all source storage types.
+*/
+void planesweep_fused_NCC(float * d_depthmap, float * d_bestncc,
+                          const float * d_src, const float * d_ref,
+                          const float * d_refmean, const float * d_refstd,
+                          const Matrix3D * d_h, const float current_depth,
+                          const unsigned int winsize, const float stdthresh,
+                          const int width, const int height,
+                          dim3 blocks, dim3 threads, float * d_subplane = 0);
+
+/**
+*  \brief This is an overloaded function for source view stored in half precision
+*
+*  \details Warped samples are converted to float, windowed sums and NCC are accumulated in float.
+*/
+void planesweep_fused_NCC(float * d_depthmap, float * d_bestncc,
+                          const __half * d_src, const float * d_ref,
+                          const float * d_refmean, const float * d_refstd,
+                          const Matrix3D * d_h, const float current_depth,
+                          const unsigned int winsize, const float stdthresh,
+                          const int width, const int height,
+                          dim3 blocks, dim3 threads, float * d_subplane = 0);
+
+/**
+*  \brief This is an overloaded function for source view stored as unsigned char
+*
+*  \details Warped samples are converted to float, windowed sums and NCC are accumulated in float.
+*/
+void planesweep_fused_NCC(float * d_depthmap, float * d_bestncc,
+                          const unsigned char * d_src, const float * d_ref,
+                          const float * d_refmean, const float * d_refstd,
+                          const Matrix3D * d_h, const float current_depth,
+                          const unsigned int winsize, const float stdthresh,
+                          const int width, const int height,
+                          dim3 blocks, dim3 threads, float * d_subplane = 0);
+
+/**
+*  \brief Threads per block with maximum occupancy of \a planesweep_fused_NCC
+*
+*  \param winsize NCC window side length, shared memory size depends on it
+*  \return Threads per block suggested by \a cudaOccupancyMaxPotentialBlockSizeVariableSMem for
+* \a DEFAULT_BLOCK_XDIM wide blocks
+*/
+int planesweep_fused_NCC_block_size(const unsigned int winsize);
+
+/**
+*  \brief Fused planesweep step evaluating a single depth plane with windowed SAD cost
+*
+*  \param d_depthmap      pointer to depthmap to be updated
+*  \param d_bestncc       pointer to best similarity values to be updated
+*  \param d_src           pointer to source view intensity image
+*  \param d_ref           pointer to reference view intensity image
+*  \param d_h             pointer to 3x3 homography from reference to source view at \a current_depth on the device
+*  \param current_depth   current depth of planesweep algorithm
+*  \param winsize         SAD window side length
+*  \param width           width of given arrays
+*  \param height          height of given arrays
+*  \param blocks          kernel grid dimensions
+*  \param threads         single block dimensions
+*  \param d_subplane      optional sub-plane state, see \a update_arrays()
+*
+*  \details Same tiling as \a planesweep_fused_NCC without windowed statistics of the reference view. Similarity is
+* <em>1 - mean absolute difference / 255</em>, so it lies in [0, 1] for 8 bit intensities.
+*/
+void planesweep_fused_SAD(float * d_depthmap, float * d_bestncc,
+                          const float * d_src, const float * d_ref,
+                          const Matrix3D * d_h, const float current_depth, const unsigned int winsize,
+                          const int width, const int height,
+                          dim3 blocks, dim3 threads, float * d_subplane = 0);
+
+/**
+*  \brief Fused planesweep step evaluating a single depth plane with census cost
+*
+*  \param d_depthmap      pointer to depthmap to be updated
+*  \param d_bestncc       pointer to best similarity values to be updated
+*  \param d_src           pointer to source view census descriptors from \a census_transform
+*  \param d_ref           pointer to reference view census descriptors from \a census_transform
+*  \param d_h             pointer to 3x3 homography from reference to source view at \a current_depth on the device
+*  \param current_depth   current depth of planesweep algorithm
+*  \param winsize         side length of window Hamming distances are averaged over
+*  \param width           width of given arrays
+*  \param height          height of given arrays
+*  \param blocks          kernel grid dimensions
+*  \param threads         single block dimensions
+*  \param d_subplane      optional sub-plane state, see \a update_arrays()
+*
+*  \details Source descriptors are computed once per view and sampled at the nearest pixel of the warped position.
+* Similarity is <em>1 - mean Hamming distance / CENSUS_BITS</em>, pixels warped outside of the source view count as
+* all bits different.
+*/
+void planesweep_fused_census(float * d_depthmap, float * d_bestncc,
+                             const unsigned long long * d_src, const unsigned long long * d_ref,
+                             const Matrix3D * d_h, const float current_depth, const unsigned int winsize,
+                             const int width, const int height,
+                             dim3 blocks, dim3 threads, float * d_subplane = 0);
+
+/**
+*  \brief Planesweep of consecutive planes of a rectified pair in one kernel
+*
+*  \param d_depthmap      pointer to depthmap to be updated
+*  \param d_bestncc       pointer to best NCC values to be updated
+*  \param d_src           pointer to source view intensity image
+*  \param d_ref           pointer to reference view intensity image
+*  \param d_refmean       pointer to reference windowed means image
+*  \param d_refstd        pointer to reference windowed STD image
+*  \param d_disparity     pointer to horizontal shifts of the source view of all planes on the device
+*  \param d_depth         pointer to depths of all planes on the device
+*  \param nplanes         number of planes
+*  \param dmin            floor of the smallest disparity
+*  \param dmax            floor of the largest disparity
+*  \param winsize         NCC window side length
+*  \param stdthresh       standard deviation threshold for both views
+*  \param width           width of given arrays
+*  \param height          height of given arrays
+*  \param blocks          kernel grid dimensions
+*  \param threads         single block dimensions
+*  \param d_subplane      optional sub-plane state, see \a update_arrays()
+*
+*  \details Source pixel of reference pixel \f$(x, y)\f$ is \f$(x + d, y)\f$, so warping is a linear interpolation
+* within rows. Each block loads its reference tile and the source rows of all disparities once and sweeps all
+* planes, best NCC and depth are kept in registers and written once. Dynamic shared memory is
+* <em>(2 * (threads.x + winsize - 1) + dmax - dmin + 1) * (threads.y + winsize - 1)</em> floats, see
+* \a planesweep_rectified_span(). Same NCC as \a planesweep_fused_NCC with the homography of a pure x translation,
+* except that the last row is sampled instead of being set to 0.
+*/
+void planesweep_rectified_NCC(float * d_depthmap, float * d_bestncc,
+                              const float * d_src, const float * d_ref,
+                              const float * d_refmean, const float * d_refstd,
+                              const float * d_disparity, const float * d_depth,
+                              const int nplanes, const int dmin, const int dmax,
+                              const unsigned int winsize, const float stdthresh,
+                              const int width, const int height,
+                              dim3 blocks, dim3 threads, float * d_subplane = 0);
+
+/**
+*  \brief Get largest disparity range of a single \a planesweep_rectified_NCC launch on the current device
+*
+*  \param winsize NCC window side length
+*  \param threads single block dimensions
+*  \return Largest <em>dmax - dmin</em> whose tile fits into shared memory of a block, negative if none fits
+*/
+int planesweep_rectified_span(const unsigned int winsize, dim3 threads);
+
+/**
+*  \brief Store NCC of one plane in an 8 bit cost volume, one launch per plane and source view
+*
+*  \param d_volume  pointer to cost volume of <em>width * height * nplanes</em> bytes, plane index varies fastest
+*  \param d_sum     pointer to NCC sum of the views of this plane launched so far
+*  \param d_src     pointer to source view intensity image
+*  \param d_ref     pointer to reference view intensity image
+*  \param d_refmean pointer to reference windowed means image
+*  \param d_refstd  pointer to reference windowed STD image
+*  \param d_h       pointer to homography of the source view and plane
+*  \param plane     plane index
+*  \param nplanes   number of planes of the volume
+*  \param view      index of the source view among the \p nviews views of this plane
+*  \param nviews    number of source views
+*  \param winsize   NCC window side length
+*  \param stdthresh standard deviation threshold for both views
+*  \param width     width of given arrays
+*  \param height    height of given arrays
+*  \param blocks    kernel grid dimensions
+*  \param threads   single block dimensions
+*
+*  \details Same NCC as \a planesweep_fused_NCC. The launch of the last view writes cost
+* <em>(1 - mean NCC) * SGM_COST_SCALE</em> of all views, rounded and clamped to [0, 255].
+*/
+void planesweep_volume_NCC(unsigned char * d_volume, float * d_sum,
+                           const float * d_src, const float * d_ref,
+                           const float * d_refmean, const float * d_refstd,
+                           const Matrix3D * d_h, const int plane, const int nplanes,
+                           const int view, const int nviews,
+                           const unsigned int winsize, const float stdthresh,
+                           const int width, const int height,
+                           dim3 blocks, dim3 threads);
+
+/**
+*  \brief Semi-global aggregation of an 8 bit cost volume
+*
+*  \param d_aggregated pointer to aggregated costs of volume size, must be zero initialized, sums of all paths
+*  \param d_volume     pointer to cost volume, plane index varies fastest
+*  \param nplanes      number of planes, at most \a SGM_MAX_PLANES
+*  \param paths        4 for horizontal and vertical paths, 8 adds diagonals
+*  \param P1           penalty of a change to a neighbouring plane between neighbouring pixels
+*  \param P2           penalty of larger changes, at least \p P1
+*  \param width        volume width
+*  \param height       volume height
+*
+*  \details Path costs are \f$L_r(p, d) = C(p, d) + \min(L_r(p - r, d), L_r(p - r, d \pm 1) + P_1, \min_k L_r(p - r, k)
+* + P_2) - \min_k L_r(p - r, k)\f$. One launch per path direction, one warp per scanline of the direction with the
+* path costs of all planes of the current pixel in registers of its lanes. Grid and block dimensions are derived from
+* the path, \a SGM_WARPS_PER_BLOCK scanlines per block.
+*/
+void sgm_aggregate(unsigned short * d_aggregated, const unsigned char * d_volume, const int nplanes,
+                   const unsigned int paths, const int P1, const int P2, const int width, const int height);
+
+/**
+*  \brief Select plane of lowest aggregated cost of each pixel
+*
+*  \param d_depthmap   pointer to output depthmap, 0 where invalid
+*  \param d_count      pointer to output count, 1 where valid and 0 otherwise, see \a sum_depthmap_NCC
+*  \param d_aggregated pointer to aggregated costs of \a sgm_aggregate
+*  \param d_volume     pointer to cost volume
+*  \param d_depth      pointer to depths of all planes on the device
+*  \param nplanes      number of planes
+*  \param nccthresh    pixels whose selected plane has a mean NCC not above are invalid
+*  \param width        volume width
+*  \param height       volume height
+*  \param blocks       kernel grid dimensions
+*  \param threads      single block dimensions
+*
+*  \details Depth between planes is interpolated by a parabola through the aggregated costs of the neighbouring planes.
+*/
+void sgm_select(float * d_depthmap, float * d_count, const unsigned short * d_aggregated,
+                const unsigned char * d_volume, const float * d_depth, const int nplanes, const float nccthresh,
+                const int width, const int height, dim3 blocks, dim3 threads);
+
+/**
+*  \brief Initialize PatchMatch with random slanted planes and score them
+*
+*  \param d_planes  pointer to planes of all pixels, normal in reference camera coordinates and depth at the pixel
+*  \param d_score   pointer to scores of all planes
+*  \param d_src     pointer to stacked source view intensity images
+*  \param d_ref     pointer to reference view intensity image
+*  \param d_refmean pointer to reference windowed means image
+*  \param d_refstd  pointer to reference windowed STD image
+*  \param d_KRK     pointer to \f$K R_{rel} K^{-1}\f$ of all source views
+*  \param d_Kt      pointer to \f$K t_{rel}\f$ of all source views
+*  \param invK      inverse camera matrix
+*  \param nviews    number of source views, at most \a PATCHMATCH_MAX_VIEWS are used
+*  \param best      number of best views whose NCC is averaged per pixel
+*  \param znear     smallest depth
+*  \param zfar      largest depth
+*  \param seed      random seed
+*  \param winsize   NCC window side length
+*  \param stdthresh standard deviation threshold for both views
+*  \param width     width of given arrays
+*  \param height    height of given arrays
+*  \param blocks    kernel grid dimensions
+*  \param threads   single block dimensions
+*
+*  \details Depths are uniform in <em>[znear, zfar]</em>, normals uniform on the hemisphere facing the camera. Score is
+* NCC of the window warped by the plane induced homography, averaged over the \p best source views of the pixel.
+*/
+void patchmatch_init(float4 * d_planes, float * d_score,
+                     const float * d_src, const float * d_ref,
+                     const float * d_refmean, const float * d_refstd,
+                     const Matrix3D * d_KRK, const float3 * d_Kt, const Matrix3D & invK,
+                     const int nviews, const int best, const float znear, const float zfar, const unsigned int seed,
+                     const unsigned int winsize, const float stdthresh,
+                     const int width, const int height,
+                     dim3 blocks, dim3 threads);
+
+/**
+*  \brief PatchMatch propagation and refinement of pixels of one checkerboard colour
+*
+*  \param d_planes  pointer to planes of all pixels, updated
+*  \param d_score   pointer to scores of all planes, updated
+*  \param d_src     pointer to stacked source view intensity images
+*  \param d_ref     pointer to reference view intensity image
+*  \param d_refmean pointer to reference windowed means image
+*  \param d_refstd  pointer to reference windowed STD image
+*  \param d_KRK     pointer to \f$K R_{rel} K^{-1}\f$ of all source views
+*  \param d_Kt      pointer to \f$K t_{rel}\f$ of all source views
+*  \param invK      inverse camera matrix
+*  \param nviews    number of source views, at most \a PATCHMATCH_MAX_VIEWS are used
+*  \param best      number of best views whose NCC is averaged per pixel
+*  \param znear     smallest depth
+*  \param zfar      largest depth
+*  \param parity    pixels with <em>(x + y) % 2 == parity</em> are updated
+*  \param range     perturbation range of refinement relative to depth range and unit normal
+*  \param seed      random seed
+*  \param winsize   NCC window side length
+*  \param stdthresh standard deviation threshold for both views
+*  \param width     width of given arrays
+*  \param height    height of given arrays
+*  \param blocks    kernel grid dimensions
+*  \param threads   single block dimensions
+*
+*  \details Planes of the 4 neighbours and of the pixels 5 away in each direction, all of the other colour, replace
+* the plane of a pixel if they score better, followed by \a PATCHMATCH_REFINE_SAMPLES random perturbations of halving
+* range. Alternating red and black launches never read planes written by the same launch.
+*/
+void patchmatch_propagate(float4 * d_planes, float * d_score,
+                          const float * d_src, const float * d_ref,
+                          const float * d_refmean, const float * d_refstd,
+                          const Matrix3D * d_KRK, const float3 * d_Kt, const Matrix3D & invK,
+                          const int nviews, const int best, const float znear, const float zfar,
+                          const int parity, const float range, const unsigned int seed,
+                          const unsigned int winsize, const float stdthresh,
+                          const int width, const int height,
+                          dim3 blocks, dim3 threads);
+
+/**
+*  \brief Extract depthmap of PatchMatch planes
+*
+*  \param d_depthmap pointer to output depthmap, QNaN where score is not above \p nccthresh
+*  \param d_planes   pointer to planes of all pixels
+*  \param d_score    pointer to scores of all planes
+*  \param nccthresh  score threshold
+*  \param width      width of given arrays
+*  \param height     height of given arrays
+*  \param blocks     kernel grid dimensions
+*  \param threads    single block dimensions
+*/
+void patchmatch_depthmap(float * d_depthmap, const float4 * d_planes, const float * d_score, const float nccthresh,
+                         const int width, const int height, dim3 blocks, dim3 threads);
+
+/**
+*  \brief Census transform
+*
+*  \param d_census pointer to descriptors, one per pixel
+*  \param d_input  pointer to intensity image
+*  \param width    width of given arrays
+*  \param height   height of given arrays
+*  \param blocks   kernel grid dimensions
+*  \param threads  single block dimensions
+*
+*  \details Each descriptor has one bit per neighbour of the \a CENSUS_WINDOW window, set if it is darker than the
+* center pixel. Neighbours outside of the image are taken at mirrored coordinates.
+*/
+void census_transform(unsigned long long * d_census, const float * d_input,
+                      const int width, const int height, dim3 blocks, dim3 threads);
+
+/**
+*  \brief Fused planesweep step restricted to a compacted list of active tiles
+*
+*  \param d_depthmap      pointer to depthmap to be updated
+*  \param d_bestncc       pointer to best NCC values to be updated
+*  \param d_src           pointer to source view intensity image
+*  \param d_ref           pointer to reference view intensity image
+*  \param d_refmean       pointer to reference windowed means image
+*  \param d_refstd        pointer to reference windowed STD image
+*  \param d_h             pointer to 3x3 homography from reference to source view at \a current_depth on the device
+*  \param current_depth   current depth of planesweep algorithm
+*  \param winsize         NCC window side length
+*  \param stdthresh       standard deviation threshold for both views
+*  \param d_tiles         pointer to block coordinates of tiles with valid pixels
+*  \param ntiles          number of listed tiles
+*  \param d_valid         pointer to validity mask, pixels with values <= 0 are skipped
+*  \param width           width of given arrays
+*  \param height          height of given arrays
+*  \param threads         single block dimensions, tiles are \a threads.x x \a threads.y pixels
+*  \param d_subplane      optional sub-plane state, see \a update_arrays()
+*
+*  \details Same as \a planesweep_fused_NCC, but a block is launched for each listed tile only, so masked parts of
+* the frame cost nothing. Window halos of listed tiles still read masked pixels.
+*/
+void planesweep_fused_NCC_tiles(float * d_depthmap, float * d_bestncc,
+                                const float * d_src, const float * d_ref,
+                                const float * d_refmean, const float * d_refstd,
+                                const Matrix3D * d_h, const float current_depth,
+                                const unsigned int winsize, const float stdthresh,
+                                const int2 * d_tiles, const int ntiles, const float * d_valid,
+                                const int width, const int height,
+                                dim3 threads, float * d_subplane = 0);
+
+/**
+*  \brief Fused planesweep step sampling source view from texture
+*
+*  \param d_depthmap      pointer to depthmap to be updated
+*  \param d_bestncc       pointer to best NCC values to be updated
+*  \param src             texture object of source view intensity image, see \a Texture
+*  \param d_ref           pointer to reference view intensity image
+*  \param d_refmean       pointer to reference windowed means image
+*  \param d_refstd        pointer to reference windowed STD image
+*  \param d_h             pointer to 3x3 homography from reference to source view at \a current_depth on the device
+*  \param current_depth   current depth of planesweep algorithm
+*  \param winsize         NCC window side length
+*  \param stdthresh       standard deviation threshold for both views
+*  \param width           width of given arrays
+*  \param height          height of given arrays
+*  \param blocks          kernel grid dimensions
+*  \param threads         single block dimensions
+*  \param d_subplane      optional sub-plane state, see \a update_arrays()
+*
+*  \details Same as \a planesweep_fused_NCC, but warped values are interpolated by texture units.
+*/
+void planesweep_fused_NCC_texture(float * d_depthmap, float * d_bestncc,
+                                  const cudaTextureObject_t src, const float * d_ref,
+                                  const float * d_refmean, const float * d_refstd,
+                                  const Matrix3D * d_h, const float current_depth,
+                                  const unsigned int winsize, const float stdthresh,
+                                  const int width, const int height,
+                                  dim3 blocks, dim3 threads, float * d_subplane = 0);
+
+/**
+*  \brief Fused planesweep step evaluating a single depth plane for a stack of source views in one launch
+*
+*  \param d_depthmap      pointer to \a nviews stacked depthmaps to be updated
+*  \param d_bestncc       pointer to \a nviews stacked best NCC values to be updated
+*  \param d_src           pointer to \a nviews stacked source view intensity images
+*  \param d_ref           pointer to reference view intensity image
+*  \param d_refmean       pointer to reference windowed means image
+*  \param d_refstd        pointer to reference windowed STD image
+*  \param d_h             pointer to homography from reference to first source view at \a current_depth on the device
+*  \param hstride         distance between homographies of consecutive source views in \a d_h
+*  \param nviews          number of source views
+*  \param current_depth   current depth of planesweep algorithm
+*  \param winsize         NCC window side length
+*  \param stdthresh       standard deviation threshold for both views
+*  \param width           width of given arrays
+*  \param height          height of a single image in given arrays
+*  \param blocks          kernel grid dimensions of a single view
+*  \param threads         single block dimensions
+*  \param d_subplane      optional sub-plane state, see \a update_arrays(), 3 arrays per view
+*
+*  \details Same as \a planesweep_fused_NCC for each view, stacked images are \a width x \a height arrays placed
+* one after another. Grid \a z dimension selects source view.
+*/
+void planesweep_fused_NCC_multiview(float * d_depthmap, float * d_bestncc,
+                                    const float * d_src, const float * d_ref,
+                                    const float * d_refmean, const float * d_refstd,
+                                    const Matrix3D * d_h, const int hstride, const int nviews, const float current_depth,
+                                    const unsigned int winsize, const float stdthresh,
+                                    const int width, const int height,
+                                    dim3 blocks, dim3 threads, float * d_subplane = 0);
+
+/**
+*  \brief Fused planesweep step evaluating a single depth plane for a stack of reference views in one launch
+*
+*  \param d_depthmap      pointer to \a nrefs stacked depthmaps to be updated
+*  \param d_bestncc       pointer to \a nrefs stacked best NCC values to be updated
+*  \param d_pool          pointer to stacked intensity images of the shared source pool
+*  \param d_adjacency     pointer to pool index of the first reference view's source on the device, -1 for none
+*  \param adjstride       distance between pool indexes of consecutive reference views in \a d_adjacency
+*  \param d_ref           pointer to \a nrefs stacked reference view intensity images
+*  \param d_refmean       pointer to \a nrefs stacked reference windowed means images
+*  \param d_refstd        pointer to \a nrefs stacked reference windowed STD images
+*  \param d_h             pointer to homography from first reference to its source at \a current_depth on the device
+*  \param hstride         distance between homographies of consecutive reference views in \a d_h
+*  \param nrefs           number of reference views
+*  \param current_depth   current depth of planesweep algorithm
+*  \param winsize         NCC window side length
+*  \param stdthresh       standard deviation threshold for both views
+*  \param width           width of given arrays
+*  \param height          height of a single image in given arrays
+*  \param blocks          kernel grid dimensions of a single view
+*  \param threads         single block dimensions
+*  \param d_subplane      optional sub-plane state, see \a update_arrays(), 3 arrays per reference view
+*
+*  \details Same as \a planesweep_fused_NCC_multiview with grid \a z dimension selecting the reference view. Sources
+* are read from the pool by index, so views shared by neighbouring references are uploaded once. References whose
+* pool index is -1 are skipped.
+*/
+void planesweep_fused_NCC_batch(float * d_depthmap, float * d_bestncc,
+                                const float * d_pool, const int * d_adjacency, const int adjstride,
+                                const float * d_ref, const float * d_refmean, const float * d_refstd,
+                                const Matrix3D * d_h, const int hstride, const int nrefs, const float current_depth,
+                                const unsigned int winsize, const float stdthresh,
+                                const int width, const int height,
+                                dim3 blocks, dim3 threads, float * d_subplane = 0);
+
+/**
+*  \brief Fused planesweep step restricted to per pixel plane bands
+*
+*  \param d_depthmap      pointer to depthmap to be updated
+*  \param d_bestncc       pointer to best NCC values to be updated
+*  \param d_src           pointer to source view intensity image
+*  \param d_ref           pointer to reference view intensity image
+*  \param d_refmean       pointer to reference windowed means image
+*  \param d_refstd        pointer to reference windowed STD image
+*  \param d_h             pointer to 3x3 homography from reference to source view at \a current_depth on the device
+*  \param current_depth   current depth of planesweep algorithm
+*  \param plane           index of plane at \a current_depth
+*  \param d_planemin      pointer to first plane index to test for each pixel
+*  \param d_planemax      pointer to last plane index to test for each pixel
+*  \param d_blockmin      pointer to smallest \a d_planemin of each block, see \a planesweep_block_band()
+*  \param d_blockmax      pointer to largest \a d_planemax of each block, see \a planesweep_block_band()
+*  \param winsize         NCC window side length
+*  \param stdthresh       standard deviation threshold for both views
+*  \param width           width of given arrays
+*  \param height          height of given arrays
+*  \param blocks          kernel grid dimensions
+*  \param threads         single block dimensions
+*  \param d_subplane      optional sub-plane state, see \a update_arrays()
+*
+*  \details Same as \a planesweep_fused_NCC for pixels with \a plane inside their band, other pixels are not changed.
+* Blocks with \a plane outside of their band return without warping.
+*/
+void planesweep_fused_NCC_band(float * d_depthmap, float * d_bestncc,
+                               const float * d_src, const float * d_ref,
+                               const float * d_refmean, const float * d_refstd,
+                               const Matrix3D * d_h, const float current_depth, const int plane,
+                               const int * d_planemin, const int * d_planemax,
+                               const int * d_blockmin, const int * d_blockmax,
+                               const unsigned int winsize, const float stdthresh,
+                               const int width, const int height,
+                               dim3 blocks, dim3 threads, float * d_subplane = 0);
+
+/**
+*  \brief Calculate per pixel plane bands from half or full resolution depthmap
+*
+*  \param d_planemin      pointer to output first plane index for each pixel
+*  \param d_planemax      pointer to output last plane index for each pixel
+*  \param d_coarse        pointer to half or full resolution depthmap, QNaN where depth is unknown
+*  \param coarse_width    width of \p d_coarse
+*  \param coarse_height   height of \p d_coarse
+*  \param znear           depth of plane 0, inverse depth if \p inverse
+*  \param dstep           depth step between planes, inverse depth step if \p inverse
+*  \param radius          number of planes tested on each side of coarse estimate
+*  \param nplanes         number of planes
+*  \param width           width of output arrays
+*  \param height          height of output arrays
+*  \param blocks          kernel grid dimensions
+*  \param threads         single block dimensions
+*  \param inverse         planes are sampled uniformly in inverse depth
+*
+*  \details Pixels without coarse estimate get full band <em>[0, nplanes - 1]</em>.
+*/
+void planesweep_band(int * d_planemin, int * d_planemax,
+                     const float * d_coarse, const int coarse_width, const int coarse_height,
+                     const float znear, const float dstep, const int radius, const int nplanes,
+                     const int width, const int height,
+                     dim3 blocks, dim3 threads, const bool inverse = false);
+
+/**
+*  \brief Calculate plane band of each kernel block
+*
+*  \param d_blockmin      pointer to output smallest \a d_planemin of each block, size <em>blocks.x * blocks.y</em>
+*  \param d_blockmax      pointer to output largest \a d_planemax of each block, size <em>blocks.x * blocks.y</em>
+*  \param d_planemin      pointer to first plane index of each pixel
+*  \param d_planemax      pointer to last plane index of each pixel
+*  \param width           width of given arrays
+*  \param height          height of given arrays
+*  \param blocks          kernel grid dimensions, must be the same as in \a planesweep_fused_NCC_band()
+*  \param threads         single block dimensions, must be the same as in \a planesweep_fused_NCC_band()
+*/
+void planesweep_block_band(int * d_blockmin, int * d_blockmax,
+                           const int * d_planemin, const int * d_planemax,
+                           const int width, const int height,
+                           dim3 blocks, dim3 threads);
 
 /** @} */ // group planesweep
 
@@ -372,6 +1292,13 @@ void denoising_TVL1_update(float * d_output, float * d_R,
                            const float tau, const float theta, const float lambda, const float sigma,
                            const int width, const int height, dim3 blocks, dim3 threads);
 
+/**
+ *  \brief Threads per block with maximum occupancy of \a denoising_TVL1_update
+ *
+ *  \return Threads per block suggested by \a cudaOccupancyMaxPotentialBlockSize
+ */
+int denoising_TVL1_update_block_size();
+
 /**
  *  \brief Update dual variable \f$r\f$ and primal variable \f$u\f$ values by weighing with 2 by 2 tensor \f$T\f$
  *
@@ -440,6 +1367,58 @@ void denoising_TVL1_calculateP_tensor_weighed(float * d_Px, float * d_Py,
                                               const float * d_input, const float sigma,
                                               const int width, const int height,
                                               dim3 blocks, dim3 threads);
+/**
+ *  \brief Several tensor weighed TVL1 iterations in one kernel launch
+ *
+ *  \param d_output   pointer to output primal variable \f$u\f$ values
+ *  \param d_R        pointer to output dual variable \f$r\f$ values
+ *  \param d_Px       pointer to output component \a x of dual variable \f$p\f$
+ *  \param d_Py       pointer to output component \a y of dual variable \f$p\f$
+ *  \param d_input    pointer to input primal variable \f$u\f$ values
+ *  \param d_Rin      pointer to input dual variable \f$r\f$ values
+ *  \param d_Pxin     pointer to input component \a x of dual variable \f$p\f$
+ *  \param d_Pyin     pointer to input component \a y of dual variable \f$p\f$
+ *  \param d_origin   pointer to input original input image normalized and scaled by \f$-\sigma\f$
+ *  \param d_T11      pointer to input values of \f$T(1,1)\f$
+ *  \param d_T12      pointer to input values of \f$T(1,2)\f$
+ *  \param d_T21      pointer to input values of \f$T(2,1)\f$
+ *  \param d_T22      pointer to input values of \f$T(2,2)\f$
+ *  \param tau        TVL1 parameter \f$\tau\f$
+ *  \param theta      TVL1 parameter \f$\theta\f$
+ *  \param lambda     TVL1 parameter \f$\lambda\f$
+ *  \param sigma      TVL1 parameter \f$\sigma\f$
+ *  \param firstsigma \f$\sigma\f$ used in dual \f$p\f$ update of the first iteration of this launch
+ *  \param iterations number of iterations per launch
+ *  \param width      width of given arrays
+ *  \param height     height of given arrays
+ *  \param blocks     kernel grid dimensions
+ *  \param threads    single block dimensions
+ *  \return False if the kernel could not be launched, the arrays are left unchanged
+ *
+ *  \details Equivalent to \a iterations calls of \a denoising_TVL1_calculateP_tensor_weighed followed by
+ * \a denoising_TVL1_update. Each block keeps its tile in shared memory with an \a iterations pixel halo, which is
+ * recomputed redundantly, so global memory is only read and written once per launch. Halos are read from other
+ * blocks, so output arrays must not alias the input arrays, callers alternate between two sets of state arrays. Dynamic shared memory size is
+ * <em>9 * (threads.x + 2 * iterations) * (threads.y + 2 * iterations)</em> floats, see
+ * \a denoising_TVL1_fused_iterations for the number of iterations that fit a block.
+ */
+bool denoising_TVL1_fused(float * d_output, float * d_R, float * d_Px, float * d_Py,
+                          const float * d_input, const float * d_Rin, const float * d_Pxin, const float * d_Pyin,
+                          const float * d_origin,
+                          const float * d_T11, const float * d_T12, const float * d_T21, const float * d_T22,
+                          const float tau, const float theta, const float lambda,
+                          const float sigma, const float firstsigma, const unsigned int iterations,
+                          const int width, const int height, dim3 blocks, dim3 threads);
+
+/**
+ *  \brief Iterations per launch of \a denoising_TVL1_fused whose halo'd tile fits shared memory
+ *
+ *  \param iterations requested number of iterations per launch
+ *  \param threads    single block dimensions
+ *  \return At most \a iterations, 0 if even a single iteration does not fit the opt-in shared memory of the device
+ */
+unsigned int denoising_TVL1_fused_iterations(const unsigned int iterations, dim3 threads);
+
 /** @} */ // group TVL1
 
 /** \addtogroup TGV2  TGV2 Multiview Stereo
@@ -493,9 +1472,11 @@ void TGV2_updateP(float * d_Px, float * d_Py, const float * d_u, const float * d
  *  \param height  height of given arrays
  *  \param blocks  kernel grid dimensions
  *  \param threads single block dimensions
+ *  \param stream  stream to launch kernel in
  */
 void TGV2_updateQ(float * d_Qx, float * d_Qy, float * d_Qz, float * d_Qw, const float * d_u1x, const float * d_u1y,
-                  const float alpha0, const float sigma, const int width, const int height, dim3 blocks, dim3 threads);
+                  const float alpha0, const float sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                  cudaStream_t stream = 0);
 
 /**
  *  \brief Update dual variable \f$r\f$ using TGV2 algorithm and cumulatively sum \f$r\f$ and \f$I_u\f$ product
@@ -512,9 +1493,36 @@ void TGV2_updateQ(float * d_Qx, float * d_Qy, float * d_Qz, float * d_Qw, const
  *  \param height   		height of given arrays
  *  \param blocks  		kernel grid dimensions
  *  \param threads  		single block dimensions
+ *  \param stream  		stream to launch kernel in
  */
 void TGV2_updateR(float * d_r, float * d_prodsum, const float * d_u, const float * d_u0, const float * d_It, const float * d_Iu,
-                  const float sigma, const float lambda, const int width, const int height, dim3 blocks, dim3 threads);
+                  const float sigma, const float lambda, const int width, const int height, dim3 blocks, dim3 threads,
+                  cudaStream_t stream = 0);
+
+/**
+ *  \brief Update dual variables \f$r^i\f$ of all source views using TGV2 algorithm and sum \f$r^i\f$ and \f$I^i_u\f$ products
+ *
+ *  \param d_r       		pointer to layered dual variables \f$r^i\f$ to be updated
+ *  \param d_prodsum            pointer to sum of \f$I^i_u r^i\f$, overwritten
+ *  \param d_u       		pointer to primal variable \f$u\f$
+ *  \param d_u0      		pointer to primal variable \f$u\f$ initialization value
+ *  \param d_It                 pointer to layered difference images \f$I^i_t\f$
+ *  \param d_Iu                 pointer to layered derivative images \f$I^i_u\f$
+ *  \param nimages              number of source views
+ *  \param sigma                TGV2 parameter \f$\sigma\f$
+ *  \param lambda               TGV2 parameter \f$\lambda\f$
+ *  \param width    		width of given arrays
+ *  \param height   		height of single layer
+ *  \param blocks  		kernel grid dimensions
+ *  \param threads  		single block dimensions
+ *  \param stream  		stream to launch kernel in
+ *
+ *  \details Layer \a i starts at element \a i*width*height. Same result as setting \a d_prodsum to 0 and calling
+ * \a TGV2_updateR() for each view, but \a d_prodsum is written once per pixel.
+ */
+void TGV2_updateR_multiview(float * d_r, float * d_prodsum, const float * d_u, const float * d_u0, const float * d_It,
+                            const float * d_Iu, const int nimages, const float sigma, const float lambda,
+                            const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream = 0);
 
 /**
  *  \brief Update primal variables \f$u\f$, \f$\overline{u}\f$, \f$u_1\f$ and \f$\overline{u}_1\f$ using TGV2 algorithm
@@ -622,6 +1630,66 @@ void TGV2_calculate_derivativeF(float * d_dfx, float * d_dfy, const float * d_X,
 void TGV2_calculate_Iu(float * d_Iu, const float * d_I, const float * d_dfx, const float * d_dfy,
                        const int width, const int height, dim3 blocks, dim3 threads);
 
+/**
+ *  \brief Linearization terms of a source view that do not depend on the solution \f$u\f$
+ *
+ *  \details Built once per source view, pyramid level and strip by \a PlaneSweep::TGV() and reused by all of its warps.
+ * Pixel rays \f$R_{rel} K^{-1} x\f$ are the coordinate derivatives of \a TGV2_calculate_coordinate_derivatives().
+ */
+struct TGV2ViewCache
+{
+    Matrix3D RinvK;     //!< \f$R_{rel} K^{-1}\f$
+    Matrix3D KRinvK;    //!< \f$K R_{rel} K^{-1}\f$
+    float3 trel;        //!< relative translation \f$t_{rel}\f$
+    float3 Kt;          //!< \f$K t_{rel}\f$
+    float fx, fy;       //!< focal lengths of \f$K\f$
+
+    /**
+     *  \brief Constructor
+     *
+     *  \param K    calibration matrix of the level
+     *  \param invK inverse calibration matrix of the level, including strip row offset
+     *  \param Rrel relative rotation of the source view
+     *  \param t    relative translation of the source view
+     */
+    TGV2ViewCache(const Matrix3D & K, const Matrix3D & invK, const Matrix3D & Rrel, const Vector3D & t);
+};
+
+/**
+ *  \brief Calculate \f$I_t\f$ and \f$I_u\f$ of a source view at \f$u_0\f$ and reset its \f$r\f$ in one pass
+ *
+ *  \param d_It       pointer to output difference image \f$I_t\f$
+ *  \param d_Iu       pointer to output derivative image \f$I_u\f$
+ *  \param d_r        pointer to dual variable \f$r\f$ of the view, set to 0
+ *  \param d_u0       pointer to linearization point \f$u_0\f$
+ *  \param d_ref      pointer to reference intensity image
+ *  \param d_src      pointer to source view intensity image
+ *  \param src_width  width of source view
+ *  \param src_height height of source view
+ *  \param view       precomputed terms of the source view
+ *  \param width      width of given arrays
+ *  \param height     height of given arrays
+ *  \param blocks     kernel grid dimensions
+ *  \param threads    single block dimensions
+ *
+ *  \details Same result as \a TGV2_transform_coordinates(), \a TGV2_calculate_coordinate_derivatives(),
+ * \a TGV2_calculate_derivativeF(), \a bilinear_interpolation(), \a TGV2_calculate_Iu(), \a subtract() and
+ * \a set_value() of \a d_r, without intermediate images. Forward differences of the warped image are taken by warping
+ * right and lower neighbour pixels as well.
+ */
+void TGV2_linearize(float * d_It, float * d_Iu, float * d_r, const float * d_u0, const float * d_ref,
+                    const float * d_src, const int src_width, const int src_height, const TGV2ViewCache & view,
+                    const int width, const int height, dim3 blocks, dim3 threads);
+
+/**
+ *  \brief This is an overloaded function for source view in texture memory
+ *
+ *  \details Same as \a bilinear_interpolation_texture() for warped samples.
+ */
+void TGV2_linearize_texture(float * d_It, float * d_Iu, float * d_r, const float * d_u0, const float * d_ref,
+                            const cudaTextureObject_t src, const TGV2ViewCache & view,
+                            const int width, const int height, dim3 blocks, dim3 threads);
+
 /**
  *  \brief Calculate anisotropic diffusion tensor \f$T\f$
  *
@@ -672,13 +1740,14 @@ void Anisotropic_diffusion_tensor(float * d_T11, float * d_T12, float * d_T21, f
  *  \param height       height of given arrays
  *  \param blocks       kernel grid dimensions
  *  \param threads      single block dimensions
+ *  \param stream       stream to launch kernel in
  */
 void TGV2_updateU_tensor_weighed(float * d_u, float * d_u1x, float * d_u1y, const float * d_T11, const float * d_T12,
                                  const float * d_T21, const float * d_T22, float * d_ubar, float * d_u1xbar, float * d_u1ybar,
                                  const float * d_Px, const float * d_Py, const float * d_Qx, const float * d_Qy,
                                  const float * d_Qz, const float * d_Qw, const float * d_prodsum,
                                  const float alpha0, const float alpha1, const float tau, const float lambda,
-                                 const int width, const int height, dim3 blocks, dim3 threads);
+                                 const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream = 0);
 
 /**
  *  \brief Update dual variable \f$p\f$ values weighed by tensor \f$T\f$ using TGV2 algorithm
@@ -698,10 +1767,102 @@ void TGV2_updateU_tensor_weighed(float * d_u, float * d_u1x, float * d_u1y, cons
  *  \param height   height of given arrays
  *  \param blocks   kernel grid dimensions
  *  \param threads  single block dimensions
+ *  \param stream   stream to launch kernel in
  */
 void TGV2_updateP_tensor_weighed(float * d_Px, float * d_Py, const float * d_T11, const float * d_T12, const float * d_T21, const float * d_T22,
                                  const float * d_u, const float * d_u1x, const float * d_u1y, const float alpha1,
-                                 const float sigma, const int width, const int height, dim3 blocks, dim3 threads);
+                                 const float sigma, const int width, const int height, dim3 blocks, dim3 threads,
+                                 cudaStream_t stream = 0);
+
+/**
+ *  \brief Calculate anisotropic diffusion tensor stored packed as \a float4
+ *
+ *  \param d_T      pointer to tensor values \f$(T(1,1), T(1,2), T(2,1), T(2,2))\f$
+ *  \param d_Img    pointer to input image
+ *  \param beta     tensor parameter \f$\beta\f$
+ *  \param gamma    tensor parameter \f$\gamma\f$
+ *  \param width    width of given arrays
+ *  \param height   height of given arrays
+ *  \param blocks   kernel grid dimensions
+ *  \param threads  single block dimensions
+ *
+ *  \details Same tensor as \a Anisotropic_diffusion_tensor()
+ */
+void Anisotropic_diffusion_tensor_packed(float4 * d_T, const float * d_Img, const float beta, const float gamma,
+                                         const int width, const int height, dim3 blocks, dim3 threads);
+
+/**
+ *  \brief Update packed dual variable \f$p\f$ weighed by packed tensor \f$T\f$ using TGV2 algorithm
+ *
+ *  \param d_P      pointer to dual variable \f$p\f$ to be updated
+ *  \param d_T      pointer to packed tensor, see \a Anisotropic_diffusion_tensor_packed()
+ *  \param d_ubar   pointer to input primal variable \f$\overline{u}\f$
+ *  \param d_u1     pointer to packed primal variables \f$(u_{1x}, u_{1y}, \overline{u}_{1x}, \overline{u}_{1y})\f$
+ *  \param alpha1   TGV2 weight parameter \f$\alpha_1\f$
+ *  \param sigma    TGV2 parameter \f$\sigma\f$
+ *  \param width    width of given arrays
+ *  \param height   height of given arrays
+ *  \param blocks   kernel grid dimensions
+ *  \param threads  single block dimensions
+ *  \param stream   stream to launch kernel in
+ *
+ *  \details Packed equivalent of \a TGV2_updateP_tensor_weighed()
+ */
+void TGV2_updateP_packed(float2 * d_P, const float4 * d_T, const float * d_ubar, const float4 * d_u1,
+                         const float alpha1, const float sigma, const int width, const int height,
+                         dim3 blocks, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Update packed dual variable \f$q\f$ using TGV2 algorithm
+ *
+ *  \param d_Q      pointer to dual variable \f$q\f$ to be updated
+ *  \param d_u1     pointer to packed primal variables \f$(u_{1x}, u_{1y}, \overline{u}_{1x}, \overline{u}_{1y})\f$
+ *  \param alpha0   TGV2 weight parameter \f$\alpha_0\f$
+ *  \param sigma    TGV2 parameter \f$\sigma\f$
+ *  \param width    width of given arrays
+ *  \param height   height of given arrays
+ *  \param blocks   kernel grid dimensions
+ *  \param threads  single block dimensions
+ *  \param stream   stream to launch kernel in
+ *
+ *  \details Packed equivalent of \a TGV2_updateQ()
+ */
+void TGV2_updateQ_packed(float4 * d_Q, const float4 * d_u1, const float alpha0, const float sigma,
+                         const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Update primal variables \f$u\f$, \f$\overline{u}\f$ and packed \f$u_1\f$, \f$\overline{u}_1\f$ using TGV2 algorithm
+ *
+ *  \param d_u          pointer to primal variable \f$u\f$ to be updated
+ *  \param d_ubar       pointer to primal variable \f$\overline{u}\f$ to be updated
+ *  \param d_u1         pointer to packed primal variables \f$(u_{1x}, u_{1y}, \overline{u}_{1x}, \overline{u}_{1y})\f$ to be updated
+ *  \param d_T          pointer to packed tensor, see \a Anisotropic_diffusion_tensor_packed()
+ *  \param d_P          pointer to input dual variable \f$p\f$
+ *  \param d_Q          pointer to input dual variable \f$q\f$
+ *  \param d_prodsum    pointer to input sum of \f$I^i_u r^i\f$
+ *  \param alpha0       TGV2 weight parameter \f$\alpha_0\f$
+ *  \param alpha1       TGV2 weight parameter \f$\alpha_1\f$
+ *  \param tau          TGV2 parameter \f$\tau\f$
+ *  \param lambda       TGV2 parameter \f$\lambda\f$
+ *  \param width        width of given arrays
+ *  \param height       height of given arrays
+ *  \param blocks       kernel grid dimensions
+ *  \param threads      single block dimensions
+ *  \param stream       stream to launch kernel in
+ *
+ *  \details Packed equivalent of \a TGV2_updateU_tensor_weighed(), 10 vector loads per pixel instead of 21 scalar ones
+ */
+void TGV2_updateU_packed(float * d_u, float * d_ubar, float4 * d_u1, const float4 * d_T, const float2 * d_P,
+                         const float4 * d_Q, const float * d_prodsum, const float alpha0, const float alpha1,
+                         const float tau, const float lambda, const int width, const int height,
+                         dim3 blocks, dim3 threads, cudaStream_t stream = 0);
+
+/**
+ *  \brief Threads per block with maximum occupancy of \a TGV2_updateU_packed
+ *
+ *  \return Threads per block suggested by \a cudaOccupancyMaxPotentialBlockSize
+ */
+int TGV2_updateU_packed_block_size();
 
 /** @} */ // group TGV2
 
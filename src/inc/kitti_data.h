@@ -2,7 +2,12 @@
 #define KITTI_DATA_H
 
 #include "kitti_reader.h"
+#include "pose_index.h"
 #include <QObject>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 namespace KITTI
 {
@@ -15,6 +20,20 @@ namespace KITTI
         Q_OBJECT
 
     public:
+        /**
+         * @brief Data of a single index, as loaded by loadData()
+         */
+        struct Frame
+        {
+            int index = -1;
+            QVector<QImage> imgs;
+            OxTS oxts;
+            QVector<VeloPoint> points;
+            bool loaded = false;    // false if any of the files could not be read
+        };
+
+        ~KITTIData() { stopSequence(); }
+
         // load data
         bool loadTimestamps();
         bool loadCalibration();
@@ -22,6 +41,19 @@ namespace KITTI
         bool loadImages(int index);
         bool loadOxTS(int index);
         bool loadVelo(int index);
+        bool loadVeloScan(int index, int prefetch = 1);
+        bool loadPoseIndex();
+        bool loadFrame(Frame & frame, int index) const;
+
+        // Sequence iterator: indexes first, first + step, ... up to last are loaded by a background thread, at most
+        // lookahead of them ahead of the consumer. Use frameReady() to poll and consumeFrame() or nextData() to take
+        // the next index, which wait for it if needed and return false at the end of the sequence.
+        void startSequence(int first, int last = -1, int step = 1, int lookahead = KITTI_SEQUENCE_LOOKAHEAD);
+        void stopSequence();
+        bool frameReady() const;
+        bool consumeFrame(Frame & frame);
+        bool nextData();
+        int getLoadedIndex() const                                              { return loaded; }
 
         // get calibration parameters:
         Matrix3D getK() const                                                   { return K; }
@@ -54,19 +86,22 @@ namespace KITTI
         // get data:
         const QVector<QImage> & getLoadedImages() const                         { return imgs; }
         const QVector<VeloPoint> & getLoadedVeloPoints() const                  { return points; }
+        const VeloScan & getLoadedVeloScan() const                              { return scan; }
         const QImage & getLoadedImages(int index) const                         { return imgs[index]; }
         OxTS getLoadedOxTS() const                                              { return oxts; }
         Transformation3D getLoadedOxTSTForm() const                             { return convertOxtsToTForm(oxts, scale); }
         Matrix4D getLoadedOxTSPose() const                                      { return Tr_0_inv * Matrix4D(getLoadedOxTSTForm(), make_float4(0,0,0,1)); }
         int getNumberOfImages() const                                           { return imgs.size(); }
         int getNumberOfVeloPoints() const                                       { return points.size(); }
+        const PoseIndex & getPoseIndex() const                                  { return poses; }
+        bool getOxTSPose(int index, Matrix4D & pose) const;
         double getScale() const                                                 { return scale; }
 
         // redefine setters of KITTIReader as slots so they can be easily connected to widget signals
     public slots:
         void setCalibrationDir(const QString & c_dir)                           { KITTIReader::setCalibrationDir(c_dir); loadCalibration(); }
-        void setBaseDir(const QString & b_dir)                                  { KITTIReader::setBaseDir(b_dir); loadReference(); loadTimestamps(); }
-        void setFileNameLength(const int length = KITTI_FILENAME_LENGTH)        { KITTIReader::setFileNameLength(length); }
+        void setBaseDir(const QString & b_dir)                                  { stopSequence(); KITTIReader::setBaseDir(b_dir); loadReference(); loadTimestamps(); }
+        void setFileNameLength(const int length = KITTI_FILENAME_LENGTH)        { stopSequence(); KITTIReader::setFileNameLength(length); }
 
     protected:
         QVector<double> tsoxts, tsvelo, tsvelostart, tsveloend;
@@ -80,12 +115,24 @@ namespace KITTI
 
         QVector<QImage> imgs;
         QVector<VeloPoint> points;
+        VeloScan scan;
+        PoseIndex poses;
         OxTS oxts;
         Matrix4D Tr_0_inv;
         double scale;
+        int loaded = -1;
+
+        // sequence iterator state, guarded by seqmutex
+        std::thread seqthread;
+        std::deque<Frame> seqframes;
+        mutable std::mutex seqmutex;
+        std::condition_variable seqloaded, seqconsumed;
+        int seqlookahead = KITTI_SEQUENCE_LOOKAHEAD;
+        bool seqstop = false, seqdone = true;
 
     private:
         void loadReference();
+        void loadSequence(int first, int last, int step);
     };
 
 } // namespace KITTI
@@ -35,6 +35,7 @@
 #define KITTI_VELODYNE_FORMAT                           "bin"
 #define KITTI_IMAGE_FORMAT                              "png"
 #define KITTI_FILENAME_LENGTH                           10
+#define KITTI_SEQUENCE_LOOKAHEAD                        2 // indexes loaded ahead by KITTIData sequence iterator
 
 // timestamp file names
 #define KITTI_TIMESTAMPS                                "/timestamps.txt"
@@ -3,6 +3,8 @@
 
 #include "kitti_helper.h"
 #include <QString>
+#include <QFile>
+#include <cuda_runtime_api.h>
 
 namespace KITTI
 {
@@ -15,6 +17,40 @@ namespace KITTI
         TSImages
     };
 
+    /**
+     * @brief Memory mapped Velodyne scan
+     *
+     * @details Points are exposed in place as float4 (x, y, z, reflectance) records of the mapped file, nothing is
+     * copied on the host. The mapping is released by close() or when the scan is destroyed or reopened.
+     */
+    class VeloScan
+    {
+    public:
+        VeloScan() : pts(0), n(0) {}
+        ~VeloScan() { close(); }
+
+        bool open(const QString & fname);
+        void close();
+
+        // Copy all points to device memory of at least sizeBytes() bytes
+        void upload(float4 * d_points, cudaStream_t stream = 0) const;
+
+        bool isOpen() const                                                     { return pts != 0; }
+        const float4 * points() const                                           { return pts; }
+        const float4 & operator[](int i) const                                  { return pts[i]; }
+        int size() const                                                        { return n; }
+        size_t sizeBytes() const                                                { return n * sizeof(float4); }
+
+    protected:
+        QFile file;
+        const float4 * pts;
+        int n;
+
+    private:
+        VeloScan(const VeloScan &);
+        VeloScan & operator=(const VeloScan &);
+    };
+
     class KITTIReader
     {
     public:
@@ -53,6 +89,12 @@ namespace KITTI
 
         static bool ReadVeloFile(QVector<VeloPoint> & points, const QString & fname);
         bool ReadVeloFile(QVector<VeloPoint> &points, const int index) const { return ReadVeloFile(points, KITTI_VELO_NAME(bdir, index, fnw)); }
+        static bool ReadVeloFile(VeloScan & scan, const QString & fname) { return scan.open(fname); }
+        bool ReadVeloFile(VeloScan & scan, const int index) const { return scan.open(KITTI_VELO_NAME(bdir, index, fnw)); }
+
+        // Start asynchronous read ahead of Velodyne files into the page cache, returns immediately
+        static void PrefetchVeloFile(const QString & fname);
+        void PrefetchVelodyneData(const QVector<int> & indexes) const;
 
         static bool ReadImageFile(QImage & img, const QString & fname){ return img.load(fname); }
         bool ReadImageFile(QImage &img, const unsigned char cam, const int index) const { return img.load(KITTI_IMAGE_NAME(bdir, cam, index, fnw)); }
@@ -0,0 +1,96 @@
+/**
+ *  \file launch_tuner.h
+ *  \brief Header file containing occupancy driven autotuner of kernel block dimensions
+ */
+#ifndef LAUNCH_TUNER_H
+#define LAUNCH_TUNER_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <functional>
+#include <cuda_runtime_api.h>
+#include "defines.h"
+
+/**
+ *  \brief Chooses block dimensions per kernel family, resolution and device by timed trials
+ *
+ *  \details Candidates are 2D or 3D block shapes up to the threads per block limit, seeded with the block size of
+ * maximum occupancy of the family's main kernel (e.g. \a planesweep_fused_NCC_block_size()). Each candidate is timed
+ * with CUDA events over \a DEFAULT_LAUNCH_TUNER_TRIALS launches after a warm-up launch, candidates failing to launch
+ * are skipped. Choices are kept per device name and written to a small text cache file, so known hardware reuses them
+ * at the next start without trials.
+ *
+ * Cache file lines are tab separated: device name, family, width, height, depth and block x, y, z. Lines of other
+ * devices are kept when the file is rewritten.
+ */
+class LaunchTuner
+{
+public:
+    /** \brief Single trial launch of the kernel family with given block dimensions on the current device */
+    typedef std::function<void(dim3 threads)> trial_type;
+
+    /** \brief Process wide tuner instance, its cache file is \a DEFAULT_LAUNCH_TUNER_CACHE */
+    static LaunchTuner & instance();
+
+    /**
+     *  \brief Constructor, reads cache file
+     *
+     *  \param fname cache file name, no file is used if empty
+     */
+    LaunchTuner(const std::string & fname = DEFAULT_LAUNCH_TUNER_CACHE);
+
+    /**
+     *  \brief Use other cache file, tuned choices are replaced by the ones stored in it
+     *
+     *  \param fname cache file name, no file is used if empty
+     *  \return No return value
+     */
+    void setCacheFile(const std::string & fname);
+
+    /**
+     *  \brief Find tuned block dimensions of the current device
+     *
+     *  \param family  kernel family, e.g. "sweep"
+     *  \param width   problem width
+     *  \param height  problem height
+     *  \param depth   problem depth, 1 for 2D kernels
+     *  \param threads tuned block dimensions, unchanged if there are none
+     *  \return True if the family was tuned for this resolution
+     */
+    bool find(const std::string & family, int width, int height, int depth, dim3 & threads);
+
+    /**
+     *  \brief Get tuned block dimensions, running trials first if the family was not tuned for this resolution
+     *
+     *  \param family     kernel family, e.g. "sweep"
+     *  \param width      problem width
+     *  \param height     problem height
+     *  \param depth      problem depth, 1 for 2D kernels
+     *  \param suggested  threads per block of maximum occupancy, 0 if unknown
+     *  \param maxthreads threads per block limit
+     *  \param trial      launches the family once with given block dimensions, grid is derived by it
+     *  \return Fastest block dimensions, new choices are written to the cache file
+     */
+    dim3 tune(const std::string & family, int width, int height, int depth, int suggested, int maxthreads,
+              const trial_type & trial);
+
+    /** \brief Drop all tuned choices, cache file is not changed */
+    void clear();
+
+protected:
+    std::string key(const std::string & family, int width, int height, int depth);
+    std::string deviceName();
+    std::vector<dim3> candidates(int depth, int suggested, int maxthreads) const;
+    float time(const trial_type & trial, dim3 threads) const;
+    void load();
+    void save();
+
+    std::map<std::string, dim3> configs_;   // device name, family and resolution to block dimensions
+    std::map<int, std::string> devices_;    // names of devices by ordinal
+    std::string fname_;
+    std::mutex mutex_;
+};
+
+#endif // LAUNCH_TUNER_H
@@ -8,7 +8,11 @@
 #include <helper_cuda.h>
 #include <cuda_runtime_api.h>
 #include <cuda.h>
+#include <map>
+#include <mutex>
+#include <tuple>
 #include "cuda_exception.h"
+#include "nvtx_range.h"
 
 /** \addtogroup memory Memory Management
  *
@@ -55,6 +59,205 @@ public:
 #endif // CUDA_VERSION_MAJOR >= 6
 };
 
+/**
+ *  \brief Caching allocator for pitched host / device / managed memory
+ *
+ *  \details Allocations are keyed by memory kind, row size in bytes, number of rows, number of slices and
+ * current CUDA device.
+ * Released blocks are kept in a free list and handed out again to the next request with the same key,
+ * so repeated construction of same sized images does not hit \a cudaMalloc* / \a cudaFree* (which
+ * synchronize the device). Cached blocks are only returned to the driver on trim(). Call forget()
+ * after \a cudaDeviceReset(), since all pointers known to the pool are invalid at that point.
+ * Standard memory is never cached.
+ */
+class MemoryPool
+{
+public:
+    /**
+     *  \brief Allocation statistics
+     */
+    struct Stats
+    {
+        size_t hits = 0;        //!< requests served from free list
+        size_t misses = 0;      //!< requests that had to allocate
+        size_t bytesInUse = 0;  //!< bytes handed out and not yet released
+        size_t bytesCached = 0; //!< bytes held in free list
+    };
+
+    /** \brief Process wide pool instance */
+    __host__ inline
+    static MemoryPool& instance()
+    {
+        static MemoryPool pool;
+        return pool;
+    }
+
+    /**
+     *  \brief Get block for given key from the free list
+     *
+     *  \param kind   memory kind
+     *  \param wbytes row size in bytes
+     *  \param h      number of rows
+     *  \param d      number of slices
+     *  \return pointer to cached block or 0 if there is none
+     */
+    __host__ inline
+    void * acquire(MemoryKind kind, size_t wbytes, size_t h, size_t d)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Key key(kind, wbytes, h, d, CurrentDevice());
+        size_t bytes = wbytes * h * d;
+        void * ptr = 0;
+        auto it = free_.find(key);
+        if (enabled_ && it != free_.end()){
+            ptr = it->second;
+            free_.erase(it);
+            live_[ptr] = key;
+            stats_.hits++;
+            stats_.bytesCached -= bytes;
+            stats_.bytesInUse += bytes;
+        }
+        else
+            stats_.misses++;
+        return ptr;
+    }
+
+    /**
+     *  \brief Register freshly allocated block so it is cached on release
+     *
+     *  \param ptr    pointer to allocated memory
+     *  \param kind   memory kind
+     *  \param wbytes row size in bytes
+     *  \param h      number of rows
+     *  \param d      number of slices
+     */
+    __host__ inline
+    void track(void * ptr, MemoryKind kind, size_t wbytes, size_t h, size_t d)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!enabled_) return;
+        Key key(kind, wbytes, h, d, CurrentDevice());
+        live_[ptr] = key;
+        stats_.bytesInUse += wbytes * h * d;
+    }
+
+    /**
+     *  \brief Put block back to the free list
+     *
+     *  \return false if \a ptr was not allocated through the pool and has to be freed by the caller
+     */
+    __host__ inline
+    bool release(void * ptr)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = live_.find(ptr);
+        if (it == live_.end()) return false;
+        Key key = it->second;
+        size_t bytes = std::get<1>(key) * std::get<2>(key) * std::get<3>(key);
+        live_.erase(it);
+        free_.insert(std::make_pair(key, ptr));
+        stats_.bytesInUse -= bytes;
+        stats_.bytesCached += bytes;
+        return true;
+    }
+
+    /**
+     *  \brief Return all cached blocks to the driver
+     */
+    __host__ inline
+    void trim()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int dev = CurrentDevice();
+        for (auto & blk : free_){
+            CHECK_CUDA_ERRORS_AUTO(cudaSetDevice(std::get<4>(blk.first)));
+            Free(std::get<0>(blk.first), blk.second);
+        }
+        CHECK_CUDA_ERRORS_AUTO(cudaSetDevice(dev));
+        free_.clear();
+        stats_.bytesCached = 0;
+    }
+
+    /**
+     *  \brief Forget all blocks without freeing them
+     *
+     *  \details Use after \a cudaDeviceReset(), which already freed the memory. Blocks still held by
+     * images are freed directly on their release.
+     */
+    __host__ inline
+    void forget()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.clear();
+        live_.clear();
+        stats_.bytesInUse = 0;
+        stats_.bytesCached = 0;
+    }
+
+    /** \brief Enable / disable caching, disabling does not trim */
+    __host__ inline
+    void setEnabled(bool enabled)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        enabled_ = enabled;
+    }
+
+    __host__ inline
+    bool isEnabled() const
+    {
+        return enabled_;
+    }
+
+    __host__ inline
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    __host__ inline
+    void resetStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.hits = 0;
+        stats_.misses = 0;
+    }
+
+protected:
+    typedef std::tuple<int, size_t, size_t, size_t, int> Key;
+
+    MemoryPool() = default;
+    MemoryPool(const MemoryPool&) = delete;
+    MemoryPool& operator=(const MemoryPool&) = delete;
+
+    __host__ inline
+    ~MemoryPool()
+    {
+        // context may already be destroyed at exit, driver releases memory anyway
+    }
+
+    __host__ inline
+    static int CurrentDevice()
+    {
+        int dev = 0;
+        CHECK_CUDA_ERRORS_AUTO(cudaGetDevice(&dev));
+        return dev;
+    }
+
+    __host__ inline
+    static void Free(int kind, void * ptr)
+    {
+        if (kind == Host) CHECK_CUDA_ERRORS_AUTO(cudaFreeHost(ptr));
+        else CHECK_CUDA_ERRORS_AUTO(cudaFree(ptr));
+    }
+
+    std::multimap<Key, void *> free_;
+    std::map<void *, Key> live_;
+    Stats stats_;
+    bool enabled_ = true;
+    mutable std::mutex mutex_;
+};
+
 /**
  *  \brief Templated class for managing memory allocation and deallocation on host / device
  *
@@ -79,6 +282,7 @@ public:
     static void CleanUp(T * ptr)
     {
         if (memT == Standard) delete[] ptr;
+        else if (MemoryPool::instance().release(ptr)) {}
         else if (memT == Host) CHECK_CUDA_ERRORS_AUTO(cudaFreeHost(ptr));
         else CHECK_CUDA_ERRORS_AUTO(cudaFree(ptr));
         ptr = 0;
@@ -93,12 +297,14 @@ public:
     __host__ inline
     static void Malloc(T *&ptr, size_t len)
     {
-        if (memT == Standard) ptr = new T[len];
+        if (memT == Standard) { ptr = new T[len]; return; }
+        if ((ptr = (T *)MemoryPool::instance().acquire(memT, len * sizeof(T), 1, 1))) return;
         if (memT == Device) CHECK_CUDA_ERRORS_AUTO(cudaMalloc((void **)&ptr, len * sizeof(T)));
 #if CUDA_VERSION_MAJOR >= 6
         if (memT == Managed) CHECK_CUDA_ERRORS_AUTO(cudaMallocManaged((void **)&ptr, len * sizeof(T), cudaMemAttachGlobal));
 #endif
         if (memT == Host) CHECK_CUDA_ERRORS_AUTO(cudaMallocHost((void **)&ptr, len * sizeof(T)));
+        MemoryPool::instance().track(ptr, memT, len * sizeof(T), 1, 1);
     }
 
     /**
@@ -112,13 +318,16 @@ public:
     __host__ inline
     static void Malloc(T *&ptr, size_t w, size_t h, size_t &pitch)
     {
-        if (memT == Device) CHECK_CUDA_ERRORS_AUTO(cudaMallocPitch((void **)&ptr, &pitch, w * sizeof(T), h));
         pitch = w * sizeof(T);
-        if (memT == Standard) ptr = new T[w * h];
+        if (memT == Standard) { ptr = new T[w * h]; return; }
+        if ((ptr = (T *)MemoryPool::instance().acquire(memT, w * sizeof(T), h, 1))) return;
+        // Rows are dense, kernels index them by width and element wise kernels run over flat float4 arrays
+        if (memT == Device) CHECK_CUDA_ERRORS_AUTO(cudaMalloc((void **)&ptr, pitch * h));
 #if CUDA_VERSION_MAJOR >= 6
         if (memT == Managed) CHECK_CUDA_ERRORS_AUTO(cudaMallocManaged((void **)&ptr, pitch * h, cudaMemAttachGlobal));
 #endif
         if (memT == Host) CHECK_CUDA_ERRORS_AUTO(cudaMallocHost((void **)&ptr, pitch * h));
+        MemoryPool::instance().track(ptr, memT, w * sizeof(T), h, 1);
     }
 
     /**
@@ -136,14 +345,79 @@ public:
     __host__ inline
     static void Malloc(T *&ptr, size_t w, size_t h, size_t d, size_t &pitch, size_t &spitch)
     {
-        if (memT == Device) CHECK_CUDA_ERRORS_AUTO(cudaMallocPitch((void **)&ptr, &pitch, w * sizeof(T), h * d));
         pitch = w * sizeof(T);
-        if (memT == Standard) ptr = new T[w*h*d];
+        spitch = h * pitch;
+        if (memT == Standard) { ptr = new T[w*h*d]; return; }
+        if ((ptr = (T *)MemoryPool::instance().acquire(memT, w * sizeof(T), h, d))) return;
+        if (memT == Device) CHECK_CUDA_ERRORS_AUTO(cudaMalloc((void **)&ptr, spitch * d));
 #if CUDA_VERSION_MAJOR >= 6
         if (memT == MemoryKind::Managed) CHECK_CUDA_ERRORS_AUTO(cudaMallocManaged((void **)&ptr, pitch * h * d, cudaMemAttachGlobal));
 #endif
         if (memT == Host) CHECK_CUDA_ERRORS_AUTO(cudaMallocHost((void **)&ptr, pitch * h * d));
-        spitch = h * pitch;
+        MemoryPool::instance().track(ptr, memT, w * sizeof(T), h, d);
+    }
+
+    /**
+     *  \brief Check if managed memory can be prefetched and advised on the device
+     *
+     *  \param device CUDA device
+     *  \return True if \p device supports concurrent managed access
+     */
+    __host__ inline
+    static bool ManagedHintsSupported(int device)
+    {
+#if CUDA_VERSION_MAJOR >= 8
+        int supported = 0;
+        CHECK_CUDA_ERRORS_AUTO(cudaDeviceGetAttribute(&supported, cudaDevAttrConcurrentManagedAccess, device));
+        return supported != 0;
+#else
+        return false;
+#endif // CUDA_VERSION_MAJOR >= 8
+    }
+
+    /**
+     *  \brief Migrate managed memory to device or host ahead of access
+     *
+     *  \param ptr    pointer to memory
+     *  \param bytes  size in bytes
+     *  \param device target CUDA device, \a cudaCpuDeviceId migrates to host
+     *  \param stream CUDA stream to queue migration on
+     *
+     *  \details Avoids page faulting memory back one page at a time on first touch. No-op unless \p memT is
+     * \p Managed and the device supports concurrent managed access.
+     */
+    __host__ inline
+    static void Prefetch(const T * ptr, size_t bytes, int device, cudaStream_t stream = 0)
+    {
+#if CUDA_VERSION_MAJOR >= 8
+        if ((memT != Managed) || (ptr == 0) || (bytes == 0)) return;
+        int current = device;
+        if (device == cudaCpuDeviceId) CHECK_CUDA_ERRORS_AUTO(cudaGetDevice(&current));
+        if (!ManagedHintsSupported(current)) return;
+        CHECK_CUDA_ERRORS_AUTO(cudaMemPrefetchAsync(ptr, bytes, device, stream));
+#endif // CUDA_VERSION_MAJOR >= 8
+    }
+
+    /**
+     *  \brief Set usage hint of managed memory
+     *
+     *  \param ptr    pointer to memory
+     *  \param bytes  size in bytes
+     *  \param advice \a cudaMemoryAdvise hint
+     *  \param device CUDA device the hint applies to, \a cudaCpuDeviceId for host
+     *
+     *  \details No-op unless \p memT is \p Managed and the device supports concurrent managed access.
+     */
+    __host__ inline
+    static void Advise(const T * ptr, size_t bytes, int advice, int device)
+    {
+#if CUDA_VERSION_MAJOR >= 8
+        if ((memT != Managed) || (ptr == 0) || (bytes == 0)) return;
+        int current = device;
+        if (device == cudaCpuDeviceId) CHECK_CUDA_ERRORS_AUTO(cudaGetDevice(&current));
+        if (!ManagedHintsSupported(current)) return;
+        CHECK_CUDA_ERRORS_AUTO(cudaMemAdvise(ptr, bytes, (cudaMemoryAdvise)advice, device));
+#endif // CUDA_VERSION_MAJOR >= 8
     }
 
     /**
@@ -169,6 +443,7 @@ public:
     __host__ inline
     static void Device2HostCopy(T *pDst, const T *pSrc, size_t len)
     {
+        NVTX_RANGE_INDEX("D2H copy", NvtxCopy, len * sizeof(T));
         CHECK_CUDA_ERRORS_AUTO(cudaMemcpy(pDst, pSrc, len * sizeof(T), cudaMemcpyDeviceToHost));
     }
 
@@ -182,6 +457,7 @@ public:
     __host__ inline
     static void Host2DeviceCopy(T *pDst, const T *pSrc, size_t len)
     {
+        NVTX_RANGE_INDEX("H2D copy", NvtxCopy, len * sizeof(T));
         CHECK_CUDA_ERRORS_AUTO(cudaMemcpy(pDst, pSrc, len * sizeof(T), cudaMemcpyHostToDevice));
     }
 
@@ -227,6 +503,7 @@ public:
     __host__ inline
     static void Device2HostCopy(T *pDst, size_t DstPitch, const T *pSrc, size_t SrcPitch, size_t width, size_t height)
     {
+        NVTX_RANGE_INDEX("D2H copy", NvtxCopy, width * height * sizeof(T));
         CHECK_CUDA_ERRORS_AUTO(cudaMemcpy2D(pDst, DstPitch, pSrc, SrcPitch, width * sizeof(T), height, cudaMemcpyDeviceToHost));
     }
 
@@ -243,6 +520,7 @@ public:
     __host__ inline
     static void Host2DeviceCopy(T *pDst, size_t DstPitch, const T *pSrc, size_t SrcPitch, size_t width, size_t height)
     {
+        NVTX_RANGE_INDEX("H2D copy", NvtxCopy, width * height * sizeof(T));
         CHECK_CUDA_ERRORS_AUTO(cudaMemcpy2D(pDst, DstPitch, pSrc, SrcPitch, width * sizeof(T), height, cudaMemcpyHostToDevice));
     }
 
@@ -262,6 +540,30 @@ public:
         CHECK_CUDA_ERRORS_AUTO(cudaMemcpy2D(pDst, DstPitch, pSrc, SrcPitch, width * sizeof(T), height, cudaMemcpyHostToHost));
     }
 
+    /**
+     *  \brief Asynchronous 2D memory copy
+     *
+     *  \param pDst     pointer to destination memory
+     *  \param DstPitch step size in bytes of destination memory
+     *  \param pSrc     pointer to source memory
+     *  \param SrcPitch step size in bytes of source memory
+     *  \param width    width in number of elements
+     *  \param height   height in number of elements
+     *  \param kind     direction of the copy
+     *  \param stream   CUDA stream to queue the copy on
+     *
+     *  \details Copy is only asynchronous to the host if host memory is pinned, pageable memory is staged by the driver
+     */
+    __host__ inline
+    static void Copy2DAsync(T *pDst, size_t DstPitch, const T *pSrc, size_t SrcPitch, size_t width, size_t height,
+                            cudaMemcpyKind kind, cudaStream_t stream)
+    {
+        NVTX_RANGE_INDEX(kind == cudaMemcpyHostToDevice ? "H2D copy async" :
+                         (kind == cudaMemcpyDeviceToHost ? "D2H copy async" : "copy async"),
+                         NvtxCopy, width * height * sizeof(T));
+        CHECK_CUDA_ERRORS_AUTO(cudaMemcpy2DAsync(pDst, DstPitch, pSrc, SrcPitch, width * sizeof(T), height, kind, stream));
+    }
+
     /**
      *  \brief Device to device 3D memory copy
      *
@@ -293,6 +595,7 @@ public:
     __host__ inline
     static void Device2HostCopy(T *pDst, size_t DstPitch, const T *pSrc, size_t SrcPitch, size_t width, size_t height, size_t depth)
     {
+        NVTX_RANGE_INDEX("D2H copy", NvtxCopy, width * height * depth * sizeof(T));
         CHECK_CUDA_ERRORS_AUTO(cudaMemcpy2D(pDst, DstPitch, pSrc, SrcPitch, width * sizeof(T), height * depth, cudaMemcpyDeviceToHost));
     }
 
@@ -310,6 +613,7 @@ public:
     __host__ inline
     static void Host2DeviceCopy(T *pDst, size_t DstPitch, const T *pSrc, size_t SrcPitch, size_t width, size_t height, size_t depth)
     {
+        NVTX_RANGE_INDEX("H2D copy", NvtxCopy, width * height * depth * sizeof(T));
         CHECK_CUDA_ERRORS_AUTO(cudaMemcpy2D(pDst, DstPitch, pSrc, SrcPitch, width * sizeof(T), height * depth, cudaMemcpyHostToDevice));
     }
 
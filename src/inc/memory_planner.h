@@ -0,0 +1,163 @@
+/**
+ *  \file memory_planner.h
+ *  \brief Header file containing device memory predictions of pipeline stages and strip planning
+ */
+#ifndef MEMORY_PLANNER_H
+#define MEMORY_PLANNER_H
+
+#include <vector>
+#include <cstddef>
+#include "defines.h"
+
+/**
+ *  \brief Predicted device memory of a call
+ *
+ *  \details Working sets are split into memory that does not depend on how many reference rows are processed at once,
+ * e.g. full source views and output depthmaps, and memory per processed reference row, e.g. windowed statistics.
+ */
+struct MemoryEstimate
+{
+    size_t fixed = 0;   //!< bytes independent of the number of processed rows
+    size_t perRow = 0;  //!< bytes per processed reference row
+
+    /**
+     *  \brief Get predicted peak device memory
+     *
+     *  \param rows number of reference rows processed at once
+     *  \return Bytes
+     */
+    size_t bytes(size_t rows) const { return fixed + perRow * rows; }
+};
+
+/**
+ *  \brief Horizontal strip of reference rows
+ *
+ *  \details Rows \a r0 to \a r0 + \a h are computed, rows \a y0 to \a y0 + \a rows are kept. The difference is a halo
+ * available to windows and solver neighbourhoods of the kept rows.
+ */
+struct Strip
+{
+    int y0;     //!< first kept row
+    int rows;   //!< number of kept rows
+    int r0;     //!< first computed row
+    int h;      //!< number of computed rows
+};
+
+/**
+ *  \brief Predicts peak device memory of planesweep, denoising, TGV and fusion and plans strips that fit
+ *
+ *  \details Predictions count the float images the calls allocate, they do not include CUDA context, kernel code and
+ * allocation granularity, so only \a DEFAULT_MEMORY_HEADROOM of the available memory is planned. Memory available to a
+ * call is free device memory plus blocks cached by \a MemoryPool.
+ */
+class MemoryPlanner
+{
+public:
+    /**
+     *  \brief Predict memory of \a PlaneSweep::RunAlgorithm()
+     *
+     *  \param width     reference width
+     *  \param height    reference height
+     *  \param images    number of source views
+     *  \param planes    number of depth planes
+     *  \param fused     fused planesweep kernel, otherwise separable statistics of warped images are kept
+     *  \param multiview all source views are swept at once
+     *  \param census    census descriptors of reference and source view are kept
+     *  \param tiled     prediction for strips, full frame buffers of the call are counted as fixed
+     *  \param volume    8 bit cost volume, aggregated 16 bit costs and all source views are kept, see
+     * \a PlaneSweep::setSemiGlobal()
+     *  \param subplane  scores around the best plane are kept, see \a PlaneSweep::setSubPlane()
+     *  \return Estimate per processed reference row
+     */
+    static MemoryEstimate planesweep(int width, int height, int images, int planes, bool fused, bool multiview,
+                                     bool census, bool tiled, bool volume = false, bool subplane = false);
+
+    /**
+     *  \brief Predict memory of \a PlaneSweep::RunAlgorithmBatch()
+     *
+     *  \param width    view width
+     *  \param height   view height
+     *  \param refs     number of reference views
+     *  \param sources  number of source views in the shared pool
+     *  \param planes   number of depth planes
+     *  \param subplane scores around the best plane are kept, see \a PlaneSweep::setSubPlane()
+     *  \return Bytes, batches are not split into strips
+     */
+    static size_t batch(int width, int height, int refs, int sources, int planes, bool subplane = false);
+
+    /**
+     *  \brief Predict memory of \a PlaneSweep::CudaDenoise()
+     *
+     *  \param width  depthmap width
+     *  \param height depthmap height
+     *  \param check  previous solution is kept for convergence checks
+     *  \param tiled  prediction for strips, full frame buffers of the call are counted as fixed
+     *  \param fused  fused launches keep a second copy of the solver state, see \a denoising_TVL1_fused()
+     *  \return Estimate per processed row
+     */
+    static MemoryEstimate tvl1(int width, int height, bool check, bool tiled, bool fused = false);
+
+    /**
+     *  \brief Predict memory of \a PlaneSweep::TGV()
+     *
+     *  \param width   reference width
+     *  \param height  reference height
+     *  \param images  number of source views
+     *  \param levels  number of pyramid levels
+     *  \param texture source views are also kept in texture memory
+     *  \param tiled   prediction for strips, full frame buffers of the call are counted as fixed
+     *  \return Estimate per processed reference row
+     */
+    static MemoryEstimate tgv(int width, int height, int images, int levels, bool texture, bool tiled);
+
+    /**
+     *  \brief Predict memory of fusion volume
+     *
+     *  \param voxels     number of voxels
+     *  \param voxelbytes bytes of a single voxel, e.g. \a sizeof(fusionvoxel<8>)
+     *  \param scratch    solver scratch of one float and one float3 per voxel is allocated
+     *  \return Bytes
+     */
+    static size_t fusion(size_t voxels, size_t voxelbytes, bool scratch = true);
+
+    /**
+     *  \brief Get device memory available to the next call on the current device
+     *
+     *  \param limit upper limit, 0 for none
+     *  \return Free device memory plus memory cached by \a MemoryPool, at most \p limit
+     */
+    static size_t available(size_t limit = 0);
+
+    /**
+     *  \brief Check if a working set fits into available memory
+     *
+     *  \param bytes     predicted bytes
+     *  \param available available bytes, e.g. from \a available()
+     *  \return True if \p bytes is at most \a DEFAULT_MEMORY_HEADROOM of \p available
+     */
+    static bool fits(size_t bytes, size_t available);
+
+    /**
+     *  \brief Split rows into strips that fit into available memory
+     *
+     *  \param e         estimate for strips
+     *  \param height    number of rows
+     *  \param halo      rows computed above and below each strip
+     *  \param available available bytes
+     *  \return Strips covering all rows, throws \a CException if strips of \a MIN_STRIP_ROWS rows do not fit either
+     *
+     *  \details All strips compute the same number of rows, border strips keep more of them. A single strip is
+     * returned if all rows fit.
+     */
+    static std::vector<Strip> strips(const MemoryEstimate & e, int height, int halo, size_t available);
+
+    /**
+     *  \brief Single strip of all rows
+     *
+     *  \param height number of rows
+     *  \return Strip without halo
+     */
+    static std::vector<Strip> frame(int height) { return std::vector<Strip>(1, Strip{0, height, 0, height}); }
+};
+
+#endif // MEMORY_PLANNER_H
@@ -0,0 +1,96 @@
+/**
+ *  \file nvtx_range.h
+ *  \brief Header file containing NVTX ranges of pipeline stages for Nsight Systems timelines
+ *
+ *  \details Ranges are only compiled in if the project is configured with \a USE_NVTX and the NVTX library was found,
+ * otherwise the macros expand to nothing. Every range carries the frame index set by \a NVTX_FRAME() as payload, so
+ * kernels and copies on the timeline can be attributed to the frame they belong to.
+ */
+#ifndef NVTX_RANGE_H
+#define NVTX_RANGE_H
+
+#ifdef NVTX_FOUND
+
+#include <nvToolsExt.h>
+#include <atomic>
+#include <string>
+
+/** \brief Range colors, one per pipeline part */
+enum NvtxColor
+{
+    NvtxSweep   = 0xff76b900,   //!< planesweep
+    NvtxDenoise = 0xff1f77b4,   //!< TVL1 and TGV refinement
+    NvtxFusion  = 0xff9467bd,   //!< fusion integrate and solve steps
+    NvtxIO      = 0xff7f7f7f,   //!< image reading and decoding
+    NvtxCopy    = 0xffd62728    //!< host to device and device to host copies
+};
+
+/**
+ *  \brief Scoped NVTX push/pop range
+ */
+class NvtxRange
+{
+public:
+    /**
+     *  \brief Push range, popped by the destructor
+     *
+     *  \param name  range name
+     *  \param color range color
+     *  \param index optional index appended to the name, e.g. source view or warp, none if negative
+     */
+    NvtxRange(const char * name, NvtxColor color, long long index = -1)
+    {
+        std::string message(name);
+        if (index >= 0) message += " " + std::to_string(index);
+
+        nvtxEventAttributes_t attr = {};
+        attr.version = NVTX_VERSION;
+        attr.size = NVTX_EVENT_ATTRIB_STRUCT_SIZE;
+        attr.colorType = NVTX_COLOR_ARGB;
+        attr.color = color;
+        attr.messageType = NVTX_MESSAGE_TYPE_ASCII;
+        attr.message.ascii = message.c_str();
+        attr.payloadType = NVTX_PAYLOAD_TYPE_INT64;
+        attr.payload.llValue = frame();
+        nvtxRangePushEx(&attr);
+    }
+
+    ~NvtxRange() { nvtxRangePop(); }
+
+    /**
+     *  \brief Frame index carried by ranges of all threads
+     *
+     *  \return Reference to frame index, -1 until it is set
+     */
+    static std::atomic<long long> & frame()
+    {
+        static std::atomic<long long> index(-1);
+        return index;
+    }
+
+private:
+    NvtxRange(const NvtxRange &);
+    NvtxRange & operator=(const NvtxRange &);
+};
+
+#define NVTX_CONCAT_(a, b) a##b
+#define NVTX_CONCAT(a, b) NVTX_CONCAT_(a, b)
+
+/** \brief Range from here to the end of the enclosing scope */
+#define NVTX_RANGE(name, color) NvtxRange NVTX_CONCAT(nvtx_range_, __LINE__)(name, color)
+
+/** \brief Range with an index appended to its name from here to the end of the enclosing scope */
+#define NVTX_RANGE_INDEX(name, color, index) NvtxRange NVTX_CONCAT(nvtx_range_, __LINE__)(name, color, index)
+
+/** \brief Set frame index payload of the following ranges */
+#define NVTX_FRAME(index) (NvtxRange::frame() = (index))
+
+#else
+
+#define NVTX_RANGE(name, color)
+#define NVTX_RANGE_INDEX(name, color, index)
+#define NVTX_FRAME(index)
+
+#endif // NVTX_FOUND
+
+#endif // NVTX_RANGE_H
@@ -7,6 +7,8 @@
 
 #include "defines.h"
 #include <iostream>
+#include <map>
+#include <memory>
 
 // Qt
 #include <QMainWindow>
@@ -25,8 +27,16 @@
 
 #include "planesweep.h"
 #include "fusion.cu.h"
+#include "fusion_mesh.cu.h"
+#include "fusion_io.h"
+#include "fusion_lod.h"
 #include "kitti_data.h"
 #include "reader.h"
+#include "image_loader.h"
+#include "frame_cache.h"
+#include "pose_index.h"
+#include "result_writer.h"
+#include "compute_worker.h"
 
 typedef pcl::PointXYZRGBA PointT;
 typedef pcl::PointCloud<PointT> PointCloudT;
@@ -84,6 +94,10 @@ protected:
     PointCloudT::Ptr cloudtgv;
     PointCloudT::Ptr cloudfusion;
 
+    // decimated fusion surface shown in viewerfusion, one cloud per view block, null for blocks without surface
+    FusionLOD fusionlod;
+    std::vector<PointCloudT::Ptr> lodclouds;
+
     // command line arguments
     int argc;
     char **argv;
@@ -91,11 +105,55 @@ protected:
     KITTI::KITTIData kitti;
     Reader reader;
 
+    // frames of recent sweep windows, keyed by image number
+    FrameCache frames;
+
+    // camera poses of the image directory, built from its camera files on first use
+    PoseIndex poses;
+
     // classes that implement 3d reconstruction methods
     PlaneSweep ps;
     dfusionData8 fd;
     fusionData<8, Standard> f;
 
+    // background writer of depthmaps and clouds, declared after everything it writes so pending writes finish first
+    ResultWriter writer;
+
+    // runs planesweep, denoising and fusion off the GUI thread, declared last so its jobs are done before anything
+    // they use is freed
+    ComputeWorker worker;
+
+    // state of running reconstruction, advanced one fusion step per job
+    struct FusionRun
+    {
+        bool active = false, cancelled = false;
+        int iteration = 0, iterations = 0;
+        double threshold = 0, tau = 0, lambda = 0, sigma = 0;
+        dim3 blocks, threads;
+        cudaStream_t stream = 0;
+        cudaEvent_t ready[2], fused[2];
+        Image<float> depth[2];  // double buffered denoised depthmaps
+        int * culllist = 0;
+        std::vector<FusionLOD::Block> changed;  // view blocks decimated by the last step
+        StageTimer timer;       // GPU time of fusion updates and surface decimation over all steps
+    } fusionrun;
+
+    // results of a planesweep, TVL1 or TGV job, copied by the job so they are shown while the next job runs
+    struct JobResult
+    {
+        QImage depth8u;         // 8 bit depthmap
+        PointCloudT::Ptr cloud; // back-projected depthmap
+    };
+    std::map<unsigned int, std::shared_ptr<JobResult> > results; // by job id, only used by the GUI thread
+
+    // planesweep parameters of the widgets, copied into each job when it is queued and set by the worker
+    struct SweepSettings
+    {
+        int images, winsize, planes, threadsx, threadsy;
+        double znear, zfar, stdthresh, nccthresh;
+        bool altmethod;
+    };
+
 private slots: // GUI widgets slots
 
     // Fusion volume widgets slots:///////////////////
@@ -118,26 +176,9 @@ private slots: // GUI widgets slots
     /** \brief Planesweep start push button slot */
     void on_pushButton_pressed();
 
-    // Planesweep settings widgets slots:////////////
-    void on_imNumber_valueChanged(int arg1);
-
+    // Planesweep settings widgets slots, values are read when a job is queued, see sweepSettings():
     void on_winSize_valueChanged(int arg1);
 
-    void on_numberPlanes_valueChanged(int arg1);
-
-    void on_zNear_valueChanged(double arg1);
-
-    void on_zFar_valueChanged(double arg1);
-
-    void on_stdThresh_valueChanged(double arg1);
-
-    void on_nccThresh_valueChanged(double arg1);
-
-    void on_threadsx_valueChanged(int arg1);
-
-    void on_threadsy_valueChanged(int arg1);
-
-    void on_altmethod_toggled(bool checked);
     ////////////////////////////////////////////
 
     /** \brief Planesweep + TVL1 denoising QVTK widget point size slider slot */
@@ -200,6 +241,9 @@ private slots: // GUI widgets slots
 
     void colorbar_selected(double value);
 
+    /** \brief Show results of compute job \p id of given \a ComputeWorker::JobType */
+    void computeFinished(unsigned int id, int type, bool success);
+
 private:
     // pointer to UI
     Ui::PCLViewer *ui;
@@ -219,16 +263,6 @@ private:
     QPixmap dendepthim;
     QPixmap tgvdepthim;
 
-    // pointers to depthmaps
-    CamImage<float> * depth;
-    CamImage<uchar> * depth8u;
-
-    CamImage<float> * dendepth;
-    CamImage<uchar> * dendepth8u;
-
-    CamImage<float> * tgvdepth;
-    CamImage<uchar> * tgvdepth8u;
-
     // pointers to world coordinates
     CamImage<float> * cx;
     CamImage<float> * cy;
@@ -260,6 +294,26 @@ private:
     */
     QString ImageName(int number, QString & imagePos);
 
+    /**
+    *  \brief Get frame from frame cache, loading it on a miss
+    *
+    *  \param number image number
+    *  \return Frame or empty pointer if its image or camera parameters could not be loaded
+    *
+    *  \details Missing frames are taken from \a ImageLoader, which decodes them ahead if they were requested. Frames
+    * that failed to load are not cached.
+    */
+    FrameCache::value_ptr loadFrame(int number);
+
+    /**
+    *  \brief Queue frame for decoding unless it is cached
+    *
+    *  \param number image number
+    *  \param pin    keep the decoded image in the loader until it is loaded, see \a ImageLoader::request()
+    *  \return No return value
+    */
+    void requestFrame(int number, bool pin = false);
+
 
     /**
     *  \brief RGB Qimage to grayscale conversion using predefined colour weights
@@ -273,6 +327,14 @@ private:
     template<typename T>
     void rgb2gray(T * data, const QImage & img);
 
+    /**
+    *  \brief RGB Qimage to 8 bit color image for device side grayscale conversion
+    *
+    *  \param dst color image reallocated to \p img size, \a QImage::Format_RGB32 memory order
+    *  \param img RGB image to convert
+    */
+    void rgb2rgba(CamImage<uchar4> & dst, const QImage & img);
+
     /**
     *  \brief Depthmap coloring function
     *
@@ -290,6 +352,54 @@ private:
     /** \brief Function to setup fusion GUI widgets */
     void setupFusion();
 
+    /** \brief Get planesweep parameters of the widgets, only called in the GUI thread */
+    SweepSettings sweepSettings() const;
+
+    /**
+    *  \brief Set planesweep parameters
+    *
+    *  \param s parameters copied when the job was queued
+    *  \return No return value
+    *
+    *  \details Called by jobs in the worker thread, so the GUI thread never changes \a ps while a job uses it
+    */
+    void applySettings(const SweepSettings & s);
+
+    /** \brief Show planesweep results computed by the worker */
+    void showDepthmap(const JobResult & res);
+
+    /** \brief Show TVL1 results computed by the worker */
+    void showDepthmapDenoised(const JobResult & res);
+
+    /** \brief Show TGV results computed by the worker */
+    void showDepthmapTGV(const JobResult & res);
+
+    /** \brief Load next reconstruction frame and queue its fusion step */
+    void reconstructStep();
+
+    /** \brief Continue or finish reconstruction after a fusion step */
+    void reconstructStepDone(bool success);
+
+    /** \brief Release reconstruction resources, extract and show fused surface */
+    void finishReconstruction();
+
+    /**
+    *  \brief Refresh decimated fusion surface in fusion viewer
+    *
+    *  \param force  refresh even if the last refresh was less than the refresh interval ago
+    *  \param stream CUDA stream of pending fusion work
+    *  \return No return value
+    *
+    *  \details Only clouds of view blocks that changed since the last refresh are uploaded to the viewer
+    */
+    void updateFusionView(bool force, cudaStream_t stream = 0);
+
+    /** \brief Upload clouds of changed view blocks to fusion viewer */
+    void showFusionView(const std::vector<FusionLOD::Block> & changed);
+
+    /** \brief Remove view block clouds and decimated surface, required whenever the fusion volume is reinitialised */
+    void resetFusionView();
+
     bool loadSparseDepthmap(const QString & fileName);
 };
 
@@ -9,10 +9,20 @@
 #include "structs.h"
 #include <cuda_runtime_api.h>
 #include <vector>
+#include <algorithm>
+#include <map>
+#include <string>
 #include "cam_image.h"
+#include "stage_timer.h"
+#include "memory_planner.h"
+#include <memory>
+
+class CpuEngine;
 
 typedef unsigned char uchar;
 
+namespace KITTI { class VeloScan; }
+
 /** \addtogroup planesweep
 * @{
 */
@@ -27,6 +37,27 @@ typedef unsigned char uchar;
 class PlaneSweep
 {
 public:
+    /** \brief Storage precision of source views on the device during planesweep */
+    typedef enum SourcePrecision{
+        SourceFloat,    //!< 32 bit float
+        SourceHalf,     //!< 16 bit half precision float
+        SourceUChar     //!< 8 bit unsigned integer, intensities rounded to nearest integer
+    } SourcePrecision;
+
+    /** \brief Matching cost of planesweep */
+    typedef enum CostMetric{
+        CostNCC,        //!< zero mean normalized cross correlation of window
+        CostSAD,        //!< sum of absolute differences of window
+        CostCensus      //!< Hamming distance of census descriptors averaged over window
+    } CostMetric;
+
+    /** \brief Rectified pair fast path of planesweep */
+    typedef enum RectifiedMode{
+        RectifiedOff,   //!< homographies for all views
+        RectifiedAuto,  //!< row shifts if all swept views are detected as rectified to the reference
+        RectifiedOn     //!< row shifts for all views, only the x translation of the relative pose is used
+    } RectifiedMode;
+
     /** \brief Reference image in float format */
     CamImage<float> HostRef;
 
@@ -39,6 +70,17 @@ public:
     /** \brief Source images in unsigned char format */
     std::vector<CamImage<uchar>> HostSrc8u;
 
+    /**
+    *  \brief Reference image in 8 bit color, \a QImage::Format_RGB32 memory order
+    *
+    *  \details Optional. If it has \a HostRef size, it is uploaded instead of \a HostRef and converted to gray
+    * and normalized on the device. Set \a CAM_IMAGE_MEMORY to \a Host for pinned memory uploads.
+    */
+    CamImage<uchar4> HostRefRGBA;
+
+    /** \brief Source images in 8 bit color, same use as \a HostRefRGBA */
+    std::vector<CamImage<uchar4>> HostSrcRGBA;
+
     /** \brief Default constructor */
     PlaneSweep();
 
@@ -66,6 +108,44 @@ public:
     */
     bool RunAlgorithm(int argc, char **argv);
 
+    /**
+    *  \brief PatchMatch stereo, alternative to the exhaustive planesweep of \a RunAlgorithm()
+    *
+    *  \param argc number of command line arguments
+    *  \param argv pointers to command line argument strings
+    *  \return Success/failure of the algorithm
+    *
+    *  \details Each pixel keeps a slanted plane, initialized randomly between \a znear and \a zfar and improved by red
+    * black checkerboard propagation from neighbours and random refinement, see \a setPatchMatch(). Its score is the
+    * window NCC of the plane induced homography averaged over the best source views of the pixel, with the same
+    * window, STD and NCC thresholds as \a RunAlgorithm(). Cost depends on the number of iterations instead of
+    * \a numberplanes. Results are retrieved, denoised and refined like those of \a RunAlgorithm(), tiling, temporal
+    * warm start and other cost metrics do not apply.
+    */
+    bool RunPatchMatch(int argc, char **argv);
+
+    /**
+    *  \brief Planesweep of a batch of reference views against a shared pool of source views
+    *
+    *  \param argc      number of command line arguments
+    *  \param argv      pointers to command line argument strings
+    *  \param refs      grayscale reference views with their poses
+    *  \param pool      grayscale source views with their poses, each is uploaded once for the whole batch
+    *  \param adjacency pool indexes of the source views of each reference view
+    *  \param depthmaps averaged depthmaps of all reference views returned by reference
+    *  \return Success/failure of the algorithm
+    *
+    *  \details Used to densify every k-th frame of a sequence, where neighbouring references share most of their
+    * source views. All views have the same size and calibration \f$K\f$. Each reference is swept with the fused NCC of
+    * \a RunAlgorithm() and default settings, sub-plane refinement and inverse depth sampling included, with all
+    * references of the batch evaluated by one launch per plane and source slot, so small frames still fill the device.
+    * Throws if the batch does not fit into device memory, split it into smaller batches then. \a HostRef,
+    * \a HostSrc and the depthmap of \a getDepthmap() are not changed.
+    */
+    bool RunAlgorithmBatch(int argc, char **argv, const std::vector<CamImage<float>> &refs,
+                           const std::vector<CamImage<float>> &pool, const std::vector<std::vector<int>> &adjacency,
+                           std::vector<CamImage<float>> &depthmaps);
+
     /**
     *  \brief \a OpenCV TVL1 denoising on CPU
     *
@@ -125,8 +205,8 @@ public:
     *  \details Requires camera calibration matrix \f$K\f$ to be set with \a setK.
     * Depthmaps can be retrieved by calling
     * \a getDepthmapTGV() and \a getDepthmap8uTGV() functions.
-    *
-    * <b>UNOPTIMIZED</b>
+    * Inner iterations are replayed from a CUDA graph, see \a setTGVGraph(). With \a setTGVPyramid() coarser levels
+    * are solved first and upsampled as initialization of finer ones, \a warps then applies to coarser levels only.
     */
     bool TGV(int argc, char **argv, const unsigned int niters = DEFAULT_TGV_NITERS, const unsigned int warps = DEFAULT_TGV_NWARPS,
              const double lambda = DEFAULT_TGV_LAMBDA, const double alpha0 = DEFAULT_TGV_ALPHA0, const double alpha1 = DEFAULT_TGV_ALPHA1,
@@ -139,6 +219,22 @@ public:
                               const double alpha0, const double alpha1, const double tau, const double sigma, const double theta,
                               const double beta, const double gamma);
 
+    /**
+    *  \brief \a TGVdenoiseFromSparse() with sparse depthmap projected from a Velodyne scan on the device
+    *
+    *  \param argc     number of command line arguments
+    *  \param argv     pointers to command line argument strings
+    *  \param scan     opened Velodyne scan
+    *  \param velo2cam transformation from Velodyne to rectified camera coordinates of the reference view,
+    *                  e.g. \a KITTIData::getTFormVelo2RectCam()
+    *
+    *  \details Remaining parameters are the same. Points are projected with \a K set by \a setK(), the sparse
+    * depthmap and its weights never leave the device.
+    */
+    bool TGVdenoiseFromSparse(int argc, char **argv, const KITTI::VeloScan &scan, const Matrix4D &velo2cam,
+                              const unsigned int niters, const double alpha0, const double alpha1, const double tau,
+                              const double sigma, const double theta, const double beta, const double gamma);
+
     /**
     *  \brief Calculate relative rotation and translation from reference to source views
     *
@@ -169,6 +265,343 @@ public:
     */
     void setAlternativeRelativeMatrixMethod(bool method) { alternativemethod = method; }
 
+    /**
+    *  \brief Select fused single kernel planesweep step
+    *
+    *  \param fused use fused kernel for each depth plane
+    *
+    *  \details With \a fused = \a true each depth plane is evaluated by \a planesweep_fused_NCC instead of
+    * separate warping, windowed mean and NCC kernels. Both methods should give the same depthmap.
+    */
+    void setFusedSweep(bool fused) { fusedsweep = fused; }
+
+    /**
+    *  \brief Select sliding window sums for windowed means
+    *
+    *  \param sliding use constant time per element windowed means
+    *
+    *  \details With \a sliding = \a true \a windowed_mean_row_sliding and \a windowed_mean_column_sliding are used
+    * instead of kernels summing whole window for each element. Borders are treated the same way, so NCC values are comparable.
+    */
+    void setSlidingWindowMean(bool sliding) { slidingmean = sliding; }
+
+    /**
+    *  \brief Select multiview planesweep
+    *
+    *  \param multiview sweep all source views in one pass
+    *
+    *  \details With \a multiview = \a true all source views are evaluated for each depth plane by a single
+    * \a planesweep_fused_NCC_multiview launch instead of separate \a PlaneSweepThread calls. Fused kernel is always used
+    * in this mode, see \a setFusedSweep(). Device memory use grows with number of source views.
+    */
+    void setMultiviewSweep(bool multiview) { multiviewsweep = multiview; }
+
+    /**
+    *  \brief Select texture sampling of source views
+    *
+    *  \param texture sample source views with hardware bilinear filtering
+    *
+    *  \details With \a texture = \a true source views in \a PlaneSweepThread and \a TGV are kept in CUDA arrays
+    * bound to texture objects (see \a Texture) instead of linear memory. Samples within one pixel of the image border
+    * are blended with 0 instead of being set to 0. Multiview sweep always uses linear memory.
+    */
+    void setTextureSampling(bool texture) { texturesampling = texture; }
+
+    /**
+    *  \brief Set coarse to fine planesweep parameters
+    *
+    *  \param levels number of pyramid levels including full resolution, 1 disables coarse to fine sweep
+    *  \param band   number of planes tested on each side of coarser level estimate
+    *
+    *  \details Each level halves image size. All planes are tested only at the coarsest level, finer
+    * levels test <em>2 * band + 1</em> planes per pixel. Pixels without coarse estimate are tested on all planes.
+    */
+    void setPyramid(unsigned int levels, unsigned int band = DEFAULT_PYRAMID_BAND) { pyramidlevels = std::max(levels, 1u); pyramidband = band; }
+
+    /**
+    *  \brief Set storage precision of source views
+    *
+    *  \param precision source view storage type on the device
+    *
+    *  \details Half precision and unsigned char sources halve or quarter memory traffic of warping. Samples are converted
+    * to float after loading, so all windowed sums and NCC are still computed in float and results can be compared
+    * to \a SourceFloat directly. Reduced precision sources are converted on the host, so uploads also shrink to 2 or 1
+    * bytes per pixel. Only the default per view NCC sweep with linear memory sampling implements it, \a RunAlgorithm(),
+    * \a RunPatchMatch() and \a RunAlgorithmBatch() fail with an error for every other configuration (multiview, coarse
+    * to fine, texture sampled, rectified, semi-global, temporal, multi device and SAD/census sweeps). Frames swept
+    * in strips because they do not fit into device memory fall back to float sources.
+    */
+    void setSourcePrecision(SourcePrecision precision) { sourceprecision = precision; }
+
+    /**
+    *  \brief Set matching cost of planesweep
+    *
+    *  \param metric cost of a window between reference and warped source view
+    *
+    *  \details Each cost is a separate instance of the fused planesweep kernel. SAD and census skip windowed statistics
+    * of the reference view, census descriptors are computed once per view and compared with a population count.
+    * All costs are mapped to similarities compared against \a setNCCthreshold(), SAD and census similarities lie in
+    * [0, 1]. SAD and census sweep each source view with \a PlaneSweepThread from float sources in linear memory, so
+    * multiview, multi device, coarse to fine, texture and reduced precision settings only apply to NCC.
+    */
+    void setCostMetric(CostMetric metric) { costmetric = metric; }
+
+    /**
+    *  \brief Select rectified pair planesweep
+    *
+    *  \param mode    rectified fast path mode
+    *  \param integer sweep integer disparities between \a znear and \a zfar instead of \a numberplanes depths
+    *
+    *  \details Views with the same rotation as the reference and a translation along its x axis, e.g. KITTI cam2 and
+    * cam3 after rectification, see each plane as a horizontal shift by disparity \f$f_x b / z\f$ for baseline \f$b\f$.
+    * Such views are swept by \a planesweep_rectified_NCC, one launch covers many planes and reuses source rows between
+    * them. With \a integer = \a true planes are placed at integer disparities of the first source view, their depth is
+    * \f$f_x b / d\f$. Only applies to full frame NCC sweeps from float sources, other settings sweep homographies.
+    */
+    void setRectifiedSweep(RectifiedMode mode, bool integer = false) { rectifiedmode = mode; rectifiedinteger = integer; }
+
+    /**
+    *  \brief Select temporal warm start for video sequences
+    *
+    *  \param enable warm start each frame from the result of the previous one
+    *  \param band   number of planes tested on each side of the predicted depth
+    *
+    *  \details The last depthmap of \a RunAlgorithm(), \a CudaDenoise() or \a TGV() is kept on the device with its
+    * reference pose. The next \a RunAlgorithm() forward warps it into the new reference view and only tests
+    * <em>2 * band + 1</em> planes around the prediction, disoccluded pixels are swept over all planes. Predicted depth,
+    * completed with the new raw depthmap, also initializes \a CudaDenoise() and \a TGV(), so both start close to their
+    * solution and stop early with \a setConvergence(). Only applies to full frame NCC sweeps with the same reference
+    * size, the first frame and frames after \a resetTemporal() are swept over all planes.
+    */
+    void setTemporal(bool enable, unsigned int band = DEFAULT_TEMPORAL_BAND) { temporal = enable; temporalband = band; }
+
+    /**
+    *  \brief Forget the depthmap kept for temporal warm start, e.g. at a cut in the sequence
+    *
+    *  \return No return value
+    */
+    void resetTemporal() { temporalprior = false; temporalinit = false; }
+
+    /**
+    *  \brief Select CPU fallback used when there is no CUDA device
+    *
+    *  \param enable  run \a RunAlgorithm() and \a CudaDenoise() on the CPU instead of failing
+    *  \param threads number of CPU threads, 0 for hardware concurrency
+    *
+    *  \details Fallback sweeps with NCC and denoises with TVL1 as the default GPU settings do, tiles of reference rows
+    * are processed by a thread pool in \a CpuEngine. Depthmaps are written to the host images returned by the getters,
+    * device pointer getters return 0. Other cost metrics, sweep variants, convergence checks, TGV and fusion need a
+    * CUDA device. Enabled by default.
+    */
+    void setCpuFallback(bool enable, unsigned int threads = 0)
+    {
+        cpufallback = enable;
+        if (threads != cputhreads) cpuengine.reset();
+        cputhreads = threads;
+    }
+
+    /**
+    *  \brief Select semi-global aggregation of the planesweep cost volume
+    *
+    *  \param enable keep an 8 bit cost volume during the sweep and aggregate it instead of winner-take-all per view
+    *  \param paths  4 or 8 aggregation paths
+    *  \param P1     penalty of a change to a neighbouring plane, cost units are <em>(1 - NCC) * 127.5</em>
+    *  \param P2     penalty of larger changes, at least \p P1 and at most <em>65535 / paths - 255</em> so that costs
+    * summed over all paths fit the 16 bit aggregation buffer
+    *
+    *  \details NCC of all source views is averaged per plane into a <em>width * height * numberplanes</em> byte volume,
+    * aggregated along scanlines by \a sgm_aggregate and the plane of lowest aggregated cost is selected with
+    * sub-plane interpolation. Depth is spatially regularized in one pass, so \a CudaDenoise() needs fewer or no
+    * iterations. Only applies to full frame NCC sweeps of at most \a SGM_MAX_PLANES planes whose volume fits into
+    * device memory, other settings sweep as before.
+    */
+    void setSemiGlobal(bool enable, unsigned int paths = DEFAULT_SGM_PATHS, unsigned int P1 = DEFAULT_SGM_P1,
+                       unsigned int P2 = DEFAULT_SGM_P2)
+    {
+        semiglobal = enable;
+        sgmpaths = paths > 4 ? 8 : 4;
+
+        // Each path adds at most 255 + P2 to the 16 bit aggregated cost
+        const unsigned int maxP2 = 65535 / sgmpaths - 255;
+        sgmP1 = std::min(P1, maxP2);
+        sgmP2 = std::min(std::max(P1, P2), maxP2);
+    }
+
+    /**
+    *  \brief Select sub-plane depth refinement
+    *
+    *  \param enable fit a parabola through the NCC of the best plane and its neighbours per source view
+    *
+    *  \details NCC of the plane before and after the best one are kept during the sweep and the depth averaged over
+    * source views is moved to the vertex of their parabola, at most half a plane from the best one. Depth resolution
+    * no longer steps with \a numberplanes, so a fraction of the planes gives comparable precision. Applies to all
+    * sweeps of \a RunAlgorithm() except semi-global aggregation, which interpolates its own costs.
+    */
+    void setSubPlane(bool enable) { subplanerefine = enable; }
+
+    /**
+    *  \brief Select sampling of planes uniform in inverse depth
+    *
+    *  \param enable place planes uniformly in inverse depth between \a znear and \a zfar instead of in depth
+    *
+    *  \details Pixel motion of a plane step is the same for all planes, so near planes are denser and far ones are
+    * not wasted. Requires \a znear > 0.
+    */
+    void setInverseDepth(bool enable) { inversedepth = enable; }
+
+    /**
+    *  \brief Set per pixel validity mask of the reference view
+    *
+    *  \param mask mask of the reference size, pixels with value 0 are not swept, an invalid image clears the mask
+    *
+    *  \details Used to drop the sky, the ego vehicle hood or other parts known to be useless. Masked pixels get
+    * \a zfar like pixels without matching source views and are invalid in \a getValidMaskPtr(). The default fused
+    * sweep of \a RunAlgorithm() only launches blocks for tiles with valid pixels, other full frame sweeps evaluate
+    * masked pixels and drop them before averaging. Masked sweeps run on the selected device even if several are
+    * enabled with \a setDeviceCount(). A mask of a different size than the reference is ignored.
+    */
+    void setMask(const CamImage<uchar> & mask)
+    {
+        maskdata.assign(mask.data(), mask.isValid() ? mask.data() + mask.width() * mask.height() : mask.data());
+        maskwidth = mask.isValid() ? mask.width() : 0;
+        maskheight = mask.isValid() ? mask.height() : 0;
+        maskcache.valid = false;
+    }
+
+    /**
+    *  \brief Set rectangular region of interest of the reference view
+    *
+    *  \param x first column
+    *  \param y first row
+    *  \param w width, 0 clears the region
+    *  \param h height, 0 clears the region
+    *
+    *  \details Pixels outside of the region are masked, see \a setMask(). Combined with a mask, pixels have to be
+    * valid in both.
+    */
+    void setROI(int x, int y, int w, int h)
+    {
+        roi = (w > 0) && (h > 0) ? RoiRect{x, y, w, h} : RoiRect{0, 0, 0, 0};
+        maskcache.valid = false;
+    }
+
+    /**
+    *  \brief Set PatchMatch parameters of \a RunPatchMatch()
+    *
+    *  \param iterations number of iterations, each updates red and then black pixels
+    *  \param views      number of best source views averaged per pixel, views where the pixel is occluded are left out
+    */
+    void setPatchMatch(unsigned int iterations, unsigned int views = DEFAULT_PATCHMATCH_VIEWS)
+    {
+        patchmatchiterations = iterations;
+        patchmatchviews = std::max(views, 1u);
+    }
+
+    /**
+    *  \brief Set number of GPUs used by planesweep
+    *
+    *  \param count number of devices, 0 uses all available devices
+    *
+    *  \details Source views are distributed round robin over the device selected by \a cudaDevInit and the
+    * following devices, partial depthmap sums are reduced on the selected device. Each device needs its own copy
+    * of reference statistics and workspace. Coarse to fine and multiview sweeps always run on a single device.
+    */
+    void setDeviceCount(unsigned int count) { devicecount = count; }
+
+    /**
+    *  \brief Set number of TVL1 iterations done by a single fused kernel launch in \a CudaDenoise()
+    *
+    *  \param iterations iterations per launch, 0 uses separate dual and primal update kernels
+    *
+    *  \details Fused kernel keeps each tile with an \a iterations pixel halo in shared memory, which needs
+    * <em>9 * (blockx + 2 * iterations) * (blocky + 2 * iterations)</em> floats per block. Results are the same as with separate kernels.
+    */
+    void setTVL1FusedIterations(unsigned int iterations) { tvl1fused = iterations; }
+
+    /**
+    *  \brief Select CUDA graph replay of \a TGV() iterations
+    *
+    *  \param graph capture one inner iteration into a CUDA graph and replay it
+    *
+    *  \details All kernels of one iteration are launched with a single \a cudaGraphLaunch(), which removes most of the
+    * launch overhead at small image sizes. The graph is captured once per \a TGV() call. Requires CUDA 11.4 or newer,
+    * otherwise kernels are always launched separately.
+    */
+    void setTGVGraph(bool graph) { tgvgraph = graph; }
+
+    /**
+    *  \brief Select autotuned block dimensions
+    *
+    *  \param tune choose block dimensions of planesweep, TVL1 and TGV kernels with \a LaunchTuner
+    *
+    *  \details Overrides \a setThreadsPerBlock(). The first call at a new resolution runs short timed trials on scratch
+    * images, choices are kept per device name in the tuner cache file and reused after the next start.
+    */
+    void setAutotune(bool tune) { autotune = tune; }
+
+    /**
+    *  \brief Set upper limit of device memory planned by a single call
+    *
+    *  \param bytes limit in bytes, 0 plans with all free device memory
+    *
+    *  \details \a RunAlgorithm(), \a CudaDenoise() and \a TGV() predict their working set with \a MemoryPlanner.
+    * If it does not fit, reference rows are processed in horizontal strips with a halo and only kept rows are written
+    * to the full depthmap. Strips sweep each source view with separable NCC from float sources, multiview, coarse to
+    * fine, multi device, texture, reduced precision and SAD or census sweeps are not used then. Iterative solvers
+    * only see their halo of neighbouring strips, so their results close to strip borders differ slightly.
+    */
+    void setMemoryLimit(size_t bytes) { memorylimit = bytes; }
+
+    /**
+    *  \brief Set coarse to fine \a TGV() parameters
+    *
+    *  \param levels    number of pyramid levels including full resolution, 1 disables coarse to fine TGV
+    *  \param finewarps number of warps at full resolution
+    *
+    *  \details Each level halves image size. Coarser levels run all \a warps passed to \a TGV(), their solution is
+    * bilinearly upsampled as initialization of the next level. Full resolution only refines it with \a finewarps warps.
+    */
+    void setTGVPyramid(unsigned int levels, unsigned int finewarps = DEFAULT_TGV_PYRAMID_WARPS)
+    {
+        tgvpyramidlevels = std::max(levels, 1u);
+        tgvfinewarps = finewarps;
+    }
+
+    /**
+    *  \brief Select initialization of \a TGV() from planesweep depthmap
+    *
+    *  \param seed initialize \a u with depthmap of last \a RunAlgorithm() call instead of constant 1
+    *
+    *  \details Depthmap is taken from the device, so it is only used if it is still there and matches reference image
+    * size. With coarse to fine TGV it is downsampled to the coarsest level.
+    */
+    void setTGVSeed(bool seed) { tgvseed = seed; }
+
+    /**
+    *  \brief Set stopping criterion of \a CudaDenoise() and \a TGV()
+    *
+    *  \param tolerance relative change \f$\|u - u_{prev}\| / \|u\|\f$ below which iterations stop, 0 runs all iterations
+    *  \param interval  number of iterations between checks
+    *
+    *  \details Change is reduced on the device and only 2 floats are read back per check, so the host synchronizes
+    * once per \a interval iterations. Iteration counts passed to \a CudaDenoise() and \a TGV() become maximums,
+    * in \a TGV() the criterion is applied to the iterations of each warp. For fused TVL1 checks happen at launch boundaries.
+    */
+    void setConvergence(float tolerance, unsigned int interval = DEFAULT_CONVERGENCE_INTERVAL)
+    {
+        convergencetol = tolerance;
+        convergenceinterval = std::max(interval, 1u);
+    }
+
+    /**
+    *  \brief Enable progress and stage timing printouts
+    *
+    *  \param verbose print start messages and stage timings of every call to \a std::cout
+    *
+    *  \details Off by default. Timings are always recorded and can be queried with \a getTimings().
+    */
+    void setVerbose(bool verbose) { this->verbose = verbose; }
+
     /**
     *  \brief Set camera calibration matrix overload
     *
@@ -286,6 +719,279 @@ public:
     */
     bool getAlternativeRelativeMatrixMethod() const { return alternativemethod; }
 
+    /**
+    *  \brief Get planesweep step method
+    *
+    *  \return Whether fused single kernel planesweep step is used
+    *
+    *  \details Control method with \a setFusedSweep()
+    */
+    bool getFusedSweep() const { return fusedsweep; }
+
+    /**
+    *  \brief Get windowed mean method
+    *
+    *  \return Whether sliding window sums are used for windowed means
+    *
+    *  \details Control method with \a setSlidingWindowMean()
+    */
+    bool getSlidingWindowMean() const { return slidingmean; }
+
+    /**
+    *  \brief Get multiview planesweep setting
+    *
+    *  \return Whether all source views are swept in one pass
+    *
+    *  \details Control method with \a setMultiviewSweep()
+    */
+    bool getMultiviewSweep() const { return multiviewsweep; }
+
+    /**
+    *  \brief Get source view sampling method
+    *
+    *  \return Whether source views are sampled from textures
+    *
+    *  \details Control method with \a setTextureSampling()
+    */
+    bool getTextureSampling() const { return texturesampling; }
+
+    /**
+    *  \brief Get number of coarse to fine planesweep levels
+    *
+    *  \return Number of pyramid levels including full resolution
+    */
+    unsigned int getPyramidLevels() const { return pyramidlevels; }
+
+    /**
+    *  \brief Get coarse to fine planesweep band
+    *
+    *  \return Number of planes tested on each side of coarser level estimate
+    */
+    unsigned int getPyramidBand() const { return pyramidband; }
+
+    /**
+    *  \brief Get storage precision of source views
+    *
+    *  \return Source view storage type on the device
+    *
+    *  \details Control method with \a setSourcePrecision()
+    */
+    SourcePrecision getSourcePrecision() const { return sourceprecision; }
+
+    /**
+    *  \brief Get matching cost of planesweep
+    *
+    *  \return Cost of a window between reference and warped source view
+    *
+    *  \details Control method with \a setCostMetric()
+    */
+    CostMetric getCostMetric() const { return costmetric; }
+
+    /**
+    *  \brief Get rectified pair planesweep mode
+    *
+    *  \return Rectified fast path mode
+    *
+    *  \details Control method with \a setRectifiedSweep()
+    */
+    RectifiedMode getRectifiedSweep() const { return rectifiedmode; }
+
+    /**
+    *  \brief Get whether temporal warm start is selected
+    *
+    *  \return True if frames are warm started from the previous one
+    *
+    *  \details Control method with \a setTemporal()
+    */
+    bool getTemporal() const { return temporal; }
+
+    /**
+    *  \brief Get whether the last \a RunAlgorithm() call was warm started
+    *
+    *  \return True if the sweep was limited to bands around a prediction from the previous frame
+    */
+    bool getTemporalPredicted() const { return temporalinit; }
+
+    /**
+    *  \brief Get number of PatchMatch iterations
+    *
+    *  \return Iterations of \a RunPatchMatch()
+    *
+    *  \details Control method with \a setPatchMatch()
+    */
+    unsigned int getPatchMatchIterations() const { return patchmatchiterations; }
+
+    /**
+    *  \brief Get whether semi-global aggregation is selected
+    *
+    *  \return True if the sweep keeps and aggregates a cost volume
+    *
+    *  \details Control method with \a setSemiGlobal()
+    */
+    bool getSemiGlobal() const { return semiglobal; }
+
+    /**
+    *  \brief Get whether sub-plane depth refinement is selected
+    *
+    *  \return True if depths are interpolated between planes
+    *
+    *  \details Control method with \a setSubPlane()
+    */
+    bool getSubPlane() const { return subplanerefine; }
+
+    /**
+    *  \brief Get whether planes are sampled uniformly in inverse depth
+    *
+    *  \return True if planes are uniform in inverse depth
+    *
+    *  \details Control method with \a setInverseDepth()
+    */
+    bool getInverseDepth() const { return inversedepth; }
+
+    /**
+    *  \brief Get whether a mask or region of interest is set
+    *
+    *  \return True if \a setMask() or \a setROI() restrict the sweep
+    *
+    *  \details Control method with \a setMask() and \a setROI()
+    */
+    bool getMaskActive() const { return !maskdata.empty() || (roi.w > 0); }
+
+    /**
+    *  \brief Get whether the last depthmap was computed by the CPU fallback
+    *
+    *  \return True if \a RunAlgorithm() found no CUDA device and ran on the CPU
+    *
+    *  \details Control method with \a setCpuFallback()
+    */
+    bool getCpuActive() const { return cpuactive; }
+
+    /**
+    *  \brief Get number of best source views averaged per pixel by PatchMatch
+    *
+    *  \return Views of \a RunPatchMatch()
+    *
+    *  \details Control method with \a setPatchMatch()
+    */
+    unsigned int getPatchMatchViews() const { return patchmatchviews; }
+
+    /**
+    *  \brief Check if a source view is rectified to the reference view
+    *
+    *  \param view  index of source view in \a HostSrc
+    *  \param shift disparity times depth returned by reference, \f$f_x\f$ times x translation of the relative pose
+    *  \return True if relative rotation is the identity and translation is along the x axis within \a RECTIFIED_TOLERANCE
+    */
+    bool isRectified(unsigned int view, float & shift) const;
+
+    /**
+    *  \brief Get number of GPUs used by planesweep
+    *
+    *  \return Requested number of devices, 0 means all available devices
+    *
+    *  \details Control method with \a setDeviceCount()
+    */
+    unsigned int getDeviceCount() const { return devicecount; }
+
+    /**
+    *  \brief Get number of TVL1 iterations done by a single fused kernel launch
+    *
+    *  \return Iterations per launch, 0 if separate kernels are used
+    *
+    *  \details Control method with \a setTVL1FusedIterations()
+    */
+    unsigned int getTVL1FusedIterations() const { return tvl1fused; }
+
+    /**
+    *  \brief Get TGV iteration launch method
+    *
+    *  \return Whether \a TGV() iterations are replayed from a CUDA graph
+    *
+    *  \details Control method with \a setTGVGraph()
+    */
+    bool getTGVGraph() const { return tgvgraph; }
+
+    /**
+    *  \brief Get number of coarse to fine TGV levels
+    *
+    *  \return Number of pyramid levels including full resolution
+    */
+    unsigned int getTGVPyramidLevels() const { return tgvpyramidlevels; }
+
+    /**
+    *  \brief Get number of full resolution warps of coarse to fine TGV
+    *
+    *  \return Number of warps at full resolution
+    */
+    unsigned int getTGVFineWarps() const { return tgvfinewarps; }
+
+    /**
+    *  \brief Get TGV initialization method
+    *
+    *  \return Whether \a TGV() is initialized from planesweep depthmap
+    *
+    *  \details Control method with \a setTGVSeed()
+    */
+    bool getTGVSeed() const { return tgvseed; }
+
+    /**
+    *  \brief Get stopping criterion tolerance
+    *
+    *  \return Relative change of \f$u\f$ below which iterations stop, 0 if disabled
+    *
+    *  \details Control method with \a setConvergence()
+    */
+    float getConvergenceTolerance() const { return convergencetol; }
+
+    /**
+    *  \brief Get number of iterations between stopping criterion checks
+    *
+    *  \return Iterations between checks
+    */
+    unsigned int getConvergenceInterval() const { return convergenceinterval; }
+
+    /**
+    *  \brief Get number of TVL1 iterations used by last \a CudaDenoise()
+    *
+    *  \return Number of iterations
+    */
+    unsigned int getTVL1Iterations() const { return tvl1iterations; }
+
+    /**
+    *  \brief Get number of TGV iterations used by last \a TGV()
+    *
+    *  \return Number of iterations summed over all warps
+    */
+    unsigned int getTGVIterations() const { return tgviterations; }
+
+    /**
+    *  \brief Get whether progress and stage timings are printed
+    *
+    *  \return True if printouts are enabled
+    */
+    bool getVerbose() const { return verbose; }
+
+    /**
+    *  \brief Get whether block dimensions are autotuned
+    *
+    *  \return True if \a LaunchTuner chooses block dimensions
+    */
+    bool getAutotune() const { return autotune; }
+
+    /**
+    *  \brief Get upper limit of device memory planned by a single call
+    *
+    *  \return Limit in bytes, 0 if all free device memory is planned with
+    */
+    size_t getMemoryLimit() const { return memorylimit; }
+
+    /**
+    *  \brief Get GPU stage timings of the last \a RunAlgorithm(), \a CudaDenoise(), \a TGV() or \a TGVdenoiseFromSparse()
+    *
+    *  \return Stage timings, waits for the GPU work of the call on first query
+    */
+    const StageTimings & getTimings() { return timer.timings(); }
+
     /**
     *  \brief Get camera calibration matrix \f$K\f$
     *  \return Camera calibration matrix
@@ -303,18 +1009,30 @@ public:
     *
     *  \return pointer to raw planesweep depthmap
     *
-    *  \details Depthmap returned is the last one calculated by running \a RunAlgorithm()
+    *  \details Depthmap returned is the last one calculated by running \a RunAlgorithm(). It is downloaded from the device on the first call
+    * after each run.
     */
-    CamImage<float> * getDepthmap(){ return &depthmap; }
+    CamImage<float> * getDepthmap()
+    {
+        if (depthmappending) DownloadDepthmap(d_rawdepthmap, &depthmap, 0);
+        depthmappending = false;
+        return &depthmap;
+    }
 
     /**
     *  \brief Get pointer to denoised planesweep depthmap
     *
     *  \return pointer to denoised planesweep depthmap
     *
-    *  \details Depthmap returned is the last one calculated by running \a RunAlgorithm() and \a CudaDenoise() or \a Denoise() after that
+    *  \details Depthmap returned is the last one calculated by running \a RunAlgorithm() and \a CudaDenoise() or \a Denoise() after that.
+    * It is downloaded from the device on the first call after each \a CudaDenoise().
     */
-    CamImage<float> * getDepthmapDenoised(){ return &depthmapdenoised; }
+    CamImage<float> * getDepthmapDenoised()
+    {
+        if (denoisedpending) DownloadDepthmap(d_depthmap, &depthmapdenoised, 0);
+        denoisedpending = false;
+        return &depthmapdenoised;
+    }
 
     /**
     *  \brief Get pointer to denoised planesweep depthmap on device memory
@@ -326,23 +1044,78 @@ public:
     */
     float * getDepthmapDenoisedPtr(){ return d_depthmap; }
 
+    /**
+    *  \brief Get pointer to raw planesweep depthmap on device memory
+    *
+    *  \return pointer to raw planesweep depthmap on the device
+    *
+    *  \details Data pointed to by the pointer is overwritten on each new \a RunAlgorithm() call
+    */
+    float * getDepthmapPtr(){ return d_rawdepthmap; }
+
+    /**
+    *  \brief Get pointer to validity of the raw planesweep depthmap on device memory
+    *
+    *  \return pointer to 1 for pixels with a matching source view inside of the mask and region of interest and 0
+    * otherwise, 0 if the last \a RunAlgorithm() swept in strips or ran on the CPU or \a RunAlgorithmBatch() ran after it
+    *
+    *  \details Data pointed to by the pointer is overwritten on each new \a RunAlgorithm() or \a RunPatchMatch() call
+    */
+    float * getValidMaskPtr(){ return d_validmask; }
+
+    /**
+    *  \brief Get pointer to confidence of the raw planesweep depthmap on device memory
+    *
+    *  \return pointer to fraction of source views that passed the NCC threshold, 0 outside of the mask and region of
+    * interest, 0 if the last \a RunAlgorithm() swept in strips or ran on the CPU or \a RunAlgorithmBatch() ran after it
+    *
+    *  \details Semi-global sweeps and \a RunPatchMatch() have a single vote per pixel, so their confidence is 0 or 1 and
+    * equals the validity. Data pointed to by the pointer is overwritten on each new \a RunAlgorithm() or
+    * \a RunPatchMatch() call
+    */
+    float * getConfidencePtr(){ return d_confidence; }
+
+    /**
+    *  \brief Set pixels that are invalid in \a getValidMaskPtr() or not confident enough to \a QNAN
+    *
+    *  \param d_depth       pointer to depthmap of the last \a RunAlgorithm() call on the device, e.g. a denoised copy
+    *  \param minconfidence pixels below this \a getConfidencePtr() value are set as well, e.g.
+    * \a DEFAULT_FUSION_MIN_CONFIDENCE
+    *
+    *  \details Fusion skips \a QNAN pixels, so masked pixels, pixels filled with \a zfar and pixels matched by few
+    * source views neither cast histogram votes nor carve free space. Does nothing without a validity mask.
+    */
+    void MaskDepthmap(float * d_depth, float minconfidence = 0.f);
+
     /**
     *  \brief Get pointer to raw normalized planesweep depthmap
     *
     *  \return pointer to raw normalized planesweep depthmap
     *
-    *  \details Depthmap returned is the last one calculated by running \a RunAlgorithm() and scaled to range [0,255] from [znear,zfar]
+    *  \details Depthmap returned is the last one calculated by running \a RunAlgorithm() and scaled to range [0,255] from [znear,zfar].
+    * Conversion is done on the device on the first call after each run.
     */
-    CamImage<uchar> * getDepthmap8u(){ return &depthmap8u; }
+    CamImage<uchar> * getDepthmap8u()
+    {
+        if (depthmap8upending) DownloadDepthmap(d_rawdepthmap, 0, &depthmap8u);
+        depthmap8upending = false;
+        return &depthmap8u;
+    }
 
     /**
     *  \brief Get pointer to denoised normalized planesweep depthmap
     *
     *  \return pointer to denoised normalized planesweep depthmap
     *
-    *  \details Depthmap returned is the last one calculated by running \a RunAlgorithm() and \a CudaDenoise() or \a Denoise() after that and scaled to range [0,255] from [znear,zfar]
+    *  \details Depthmap returned is the last one calculated by running \a RunAlgorithm() and \a CudaDenoise() or \a Denoise() after that and scaled to range [0,255] from [znear,zfar].
+    * Conversion is done on the device on the first call after each \a CudaDenoise().
     */
-    CamImage<uchar> * getDepthmap8uDenoised(){ return &depthmap8udenoised; }
+    CamImage<uchar> * getDepthmap8uDenoised()
+    {
+        if (denoised8upending) DownloadDepthmap(d_depthmap, 0, &depthmap8udenoised);
+        denoised8upending = false;
+        return &depthmap8udenoised;
+    }
 
     /**
     *  \brief Get pointer to TGV depthmap
@@ -373,6 +1146,21 @@ public:
     */
     void get3Dcoordinates(CamImage<float> * &x, CamImage<float> * &y, CamImage<float> * &z);
 
+    /**
+    *  \brief Get colored points of reference view pixels, computed on the device
+    *
+    *  \param points      host array of reference image size points to fill
+    *  \param stride      size of single point in bytes, multiple of 16
+    *  \param coloroffset offset of 32 bit color from the start of a point in bytes
+    *  \param depth       depthmap of reference image size
+    *  \param d_depth     device copy of \p depth, e.g. \a getDepthmapDenoisedPtr(), \p depth is uploaded if 0
+    *  \return Success/failure of the function
+    *
+    *  \details Points are laid out as described by \a depth_to_points(), so \a pcl::PointXYZRGBA arrays are filled
+    * by a single copy. Colors come from \a HostRefRGBA if it is set, from \a HostRef otherwise.
+    */
+    bool getPoints(void *points, size_t stride, size_t coloroffset, const CamImage<float> &depth, const float *d_depth = 0);
+
     /**
     *  \brief Get currently set planesweep near plane depth
     *
@@ -452,6 +1240,22 @@ protected:
     // pointer to depthmap on the device after TVL1 denoising
     float * d_depthmap;
 
+    // pointer to raw planesweep depthmap on the device, owned by workspace
+    float * d_rawdepthmap = 0;
+
+    // pointer to reference image scaled to [0,1] on the device, owned by workspace
+    float * d_refnormalized = 0;
+    unsigned long long * d_refcensus = 0;  // census descriptors of reference view during CostCensus sweeps
+
+    // host depthmaps are only downloaded by getters when device copies are newer
+    bool depthmappending = false;
+    bool depthmap8upending = false;
+    bool denoisedpending = false;
+    bool denoised8upending = false;
+
+    // device scratch images reused between calls and frames, see scratch()
+    std::map<std::string, Image<float>> workspace;
+
     // stored coordinates
     CamImage<float> coord_x, coord_y, coord_z;
 
@@ -463,8 +1267,13 @@ protected:
     unsigned int winsize = DEFAULT_WINDOW_SIZE;
     float stdthresh = DEFAULT_STD_THRESHOLD;
     float nccthresh = DEFAULT_NCC_THRESHOLD;
+    unsigned int pyramidlevels = DEFAULT_PYRAMID_LEVELS;
+    unsigned int pyramidband = DEFAULT_PYRAMID_BAND;
 
     // CUDA kernel parameters
+    int cudadevice = NO_CUDA_DEVICE;
+    unsigned int devicecount = 1;
+    std::vector<int> sweepdevices;
     int maxThreadsPerBlock = MAX_THREADS_PER_BLOCK;
     int maxPlanesweepThreads = MAX_PLANESWEEP_THREADS;
     dim3 blocks, threads;
@@ -472,6 +1281,190 @@ protected:
     // PlaneSweep method flags
     bool depthavailable = false;
     bool alternativemethod = false;
+    bool fusedsweep = false;
+    bool slidingmean = false;
+    bool multiviewsweep = false;
+    bool texturesampling = false;
+    SourcePrecision sourceprecision = SourceFloat;
+    CostMetric costmetric = CostNCC;
+    RectifiedMode rectifiedmode = RectifiedOff;
+    bool rectifiedinteger = false;
+
+    // temporal warm start, prior is kept in workspace as "temporal.prior" with the reference pose it belongs to
+    bool temporal = false;
+    unsigned int temporalband = DEFAULT_TEMPORAL_BAND;
+    bool temporalprior = false;     // prior holds a depthmap of the current size
+    bool temporalinit = false;      // "temporal.predicted" holds the prediction of the current frame
+    Matrix3D temporalR;
+    Vector3D temporalt;
+    int temporalwidth = 0, temporalheight = 0;
+
+    // PatchMatch iterations and best views per pixel
+    unsigned int patchmatchiterations = DEFAULT_PATCHMATCH_ITERATIONS;
+    unsigned int patchmatchviews = DEFAULT_PATCHMATCH_VIEWS;
+
+    // semi-global aggregation of the cost volume
+    bool semiglobal = false;
+    unsigned int sgmpaths = DEFAULT_SGM_PATHS;
+    unsigned int sgmP1 = DEFAULT_SGM_P1;
+    unsigned int sgmP2 = DEFAULT_SGM_P2;
+
+    // Sub-plane refinement and plane sampling, inversesweep is set by RunAlgorithm() for the planes it sweeps
+    bool subplanerefine = false;
+    bool inversedepth = false;
+    bool inversesweep = false;
+
+    // Validity mask and region of interest of the reference view, device mask and tiles of the current call
+    struct RoiRect { int x, y, w, h; };
+    std::vector<uchar> maskdata;
+    size_t maskwidth = 0, maskheight = 0;
+    RoiRect roi = {0, 0, 0, 0};
+    float * d_maskinput = 0;
+    int2 * d_masktiles = 0;
+    int nmasktiles = 0;
+    float * d_validmask = 0;
+    float * d_confidence = 0;
+
+    // device mask and tiles uploaded by prepareMask() for a device, resolution and block size
+    struct MaskCache { bool valid; int device, w, h; dim3 threads; float * input; int2 * tiles; int ntiles; };
+    MaskCache maskcache = {false, 0, 0, 0, dim3(), 0, 0, 0};
+
+    /**
+    *  \brief Upload validity mask of the reference view and list tiles of the current block size with valid pixels
+    *
+    *  \param w reference width
+    *  \param h reference height
+    *  \return True if a mask or region of interest restricts the sweep
+    *
+    *  \details Later frames reuse the upload until \a setMask(), \a setROI(), the block size or the device change, or
+    * the "mask." workspace is released.
+    */
+    bool prepareMask(int w, int h);
+
+    /**
+    *  \brief Get sub-plane state of a sweep initialized to \a SUBPLANE_NONE, see \a update_arrays()
+    *
+    *  \param name  workspace image name
+    *  \param w     width of swept views
+    *  \param h     height of swept views
+    *  \param views number of stacked views
+    *  \return Device pointer to 3 arrays per view, 0 if \a setSubPlane() is not selected
+    */
+    float * subplaneState(const std::string & name, int w, int h, int views);
+
+    /**
+    *  \brief Get plane step of the sampled parameter for \a sum_depthmap_NCC()
+    *
+    *  \param depths depths of all planes
+    *  \return Depth step, inverse depth step if planes are uniform in inverse depth
+    */
+    float subplaneStep(const std::vector<float> & depths) const;
+
+    // CPU fallback without CUDA device, engine is created on first use
+    bool cpufallback = true;
+    bool cpuactive = false;
+    bool nodevice = false;
+    unsigned int cputhreads = 0;
+    std::shared_ptr<CpuEngine> cpuengine;
+    std::vector<float> cpuguide;
+
+    /**
+    *  \brief Planesweep on the CPU, see \a setCpuFallback()
+    *
+    *  \return Success/failure of the algorithm
+    */
+    bool RunAlgorithmCpu();
+
+    /**
+    *  \brief TVL1 denoising of the CPU depthmap on the CPU, see \a setCpuFallback()
+    *
+    *  \return Success/failure of denoising
+    */
+    bool CudaDenoiseCpu(const unsigned int niters, const double lambda, const double tau, const double sigma,
+                        const double theta, const double beta, const double gamma);
+
+    /**
+    *  \brief Get grayscale of a view on the host as uploaded by \a UploadGray()
+    *
+    *  \param dst  grayscale in [0, 255] of view size
+    *  \param view source view index, -1 for reference view
+    */
+    void HostGray(std::vector<float> &dst, int view) const;
+
+    /**
+    *  \brief Keep depthmap of the current reference view for the temporal warm start of the next frame
+    *
+    *  \param d_depth device depthmap of reference size, host depthmap is uploaded if 0
+    *  \param depth   host depthmap, only used if \p d_depth is 0
+    *  \return No return value
+    */
+    void storeTemporalPrior(const float * d_depth, const CamImage<float> * depth = 0);
+
+    unsigned int tvl1fused = 0;
+    bool tgvgraph = true;
+    unsigned int tgvpyramidlevels = DEFAULT_TGV_PYRAMID_LEVELS;
+    unsigned int tgvfinewarps = DEFAULT_TGV_PYRAMID_WARPS;
+    bool tgvseed = false;
+    float convergencetol = DEFAULT_CONVERGENCE_TOLERANCE;
+    unsigned int convergenceinterval = DEFAULT_CONVERGENCE_INTERVAL;
+    unsigned int tvl1iterations = 0;
+    unsigned int tgviterations = 0;
+
+    // GPU stage timing of the last call, printed after every call if verbose
+    StageTimer timer;
+    bool verbose = false;
+
+    // block dimensions chosen by LaunchTuner, see tunedThreads()
+    bool autotune = false;
+
+    /**
+    *  \brief Get autotuned block dimensions of a kernel family
+    *
+    *  \param family "sweep", "tvl1" or "tgv"
+    *  \param w      image width
+    *  \param h      image height
+    *  \return Block dimensions from \a LaunchTuner, trials run on scratch images so results of calls are not touched
+    *
+    *  \details Sweep choices are kept per window size. The "tune." scratch images are released after the trials.
+    */
+    dim3 tunedThreads(const std::string & family, int w, int h);
+
+    // device memory limit of a call and computed rows of the current planesweep strip, 0 for full frames
+    size_t memorylimit = 0;
+    int striprows = 0;
+
+    /**
+    *  \brief Decide whether a call has to process reference rows in strips
+    *
+    *  \param call     call name for printouts
+    *  \param frame    estimate of processing all rows at once
+    *  \param strip    estimate of processing rows in strips
+    *  \param h        number of rows
+    *  \param halo     rows computed above and below kept rows of a strip
+    *  \param prefixes workspace name prefixes of the call, e.g. "denoise."
+    *  \param strips   strips returned by reference, a single strip of all rows if the frame fits
+    *  \return True if rows are processed in strips
+    *
+    *  \details Workspace images of the call are counted as available. They are released and the memory pool is trimmed
+    * before tiling, so strips do not compete with cached full frame images.
+    */
+    bool planStrips(const std::string & call, const MemoryEstimate & frame, const MemoryEstimate & strip, int h, int halo,
+                    const std::vector<std::string> & prefixes, std::vector<Strip> & strips);
+
+    /**
+    *  \brief Get bytes held by workspace images of the current device
+    *
+    *  \param prefixes workspace name prefixes
+    *  \return Bytes of allocated images whose name starts with one of \p prefixes
+    */
+    size_t workspaceBytes(const std::vector<std::string> & prefixes);
+
+    /**
+    *  \brief Free workspace images of the current device, they are allocated again on their next \a scratch() use
+    *
+    *  \param prefixes workspace name prefixes
+    */
+    void releaseWorkspace(const std::vector<std::string> & prefixes);
 
     /**
     *  \brief Depthmap normalization function for easy representation as grayscale image
@@ -483,6 +1476,155 @@ protected:
     */
     void ConvertDepthtoUChar(const CamImage<float> &input, CamImage<uchar> &output);
 
+    /**
+    *  \brief Download depthmap from the device and / or convert it to unsigned char on the device
+    *
+    *  \param d_depth pointer to unpadded depthmap of reference image size on the device
+    *  \param depth   host float depthmap to fill, skipped if 0
+    *  \param depth8u host unsigned char depthmap scaled from [znear,zfar] to fill, skipped if 0
+    */
+    void DownloadDepthmap(const float * d_depth, CamImage<float> * depth, CamImage<uchar> * depth8u);
+
+    /**
+    *  \brief Relative change of \f$u\f$ since previous check
+    *
+    *  \param d_u   pointer to current \f$u\f$ values on the device, reference image size
+    *  \param uprev \f$u\f$ values of previous check, overwritten with \a d_u
+    *  \return \f$\|u - u_{prev}\| / \|u\|\f$
+    */
+    float RelativeChange(const float * d_u, Image<float> & uprev);
+
+    /**
+    *  \brief Get device scratch image from workspace
+    *
+    *  \param name  unique name of the scratch image
+    *  \param w     required width
+    *  \param h     required height
+    *  \return Reference to workspace image of size \a w x \a h
+    *
+    *  \details Image is allocated on first use and reallocated only if \a w or \a h changes, so
+    * repeated calls on same resolution frames do not allocate device memory. Contents are left from the previous use.
+    * Workspace images are kept per CUDA device, so host threads driving different devices may call this concurrently.
+    * Workspace is released by \a cudaReset().
+    */
+    Image<float> & scratch(const std::string & name, size_t w, size_t h);
+
+    /**
+    *  \brief Get packed device scratch buffer from workspace
+    *
+    *  \tparam T   packed element type, e.g. \a float2 or \a float4
+    *  \param name unique name of the scratch buffer
+    *  \param w    required width in number of \a T elements
+    *  \param h    required height
+    *  \return Pointer to \a w x \a h unpadded elements of type \a T
+    *
+    *  \details Buffer is a \a scratch() image holding \a sizeof(T)/sizeof(float) floats per element.
+    */
+    template<typename T>
+    T * scratchPacked(const std::string & name, size_t w, size_t h)
+    {
+        static_assert(sizeof(T) % sizeof(float) == 0, "packed type must consist of floats");
+        return reinterpret_cast<T *>(scratch(name, w * (sizeof(T) / sizeof(float)), h).data());
+    }
+
+    /**
+    *  \brief Get device scratch buffer of elements smaller than a float from workspace
+    *
+    *  \tparam T   element type, e.g. \a __half or \a uchar
+    *  \param name unique name of the scratch buffer
+    *  \param w    required width in number of \a T elements
+    *  \param h    required height
+    *  \return Pointer to \a w x \a h unpadded elements of type \a T
+    *
+    *  \details Buffer is a single row \a scratch() image rounded up to whole floats, so \a workspaceBytes() counts it.
+    */
+    template<typename T>
+    T * scratchDense(const std::string & name, size_t w, size_t h)
+    {
+        return reinterpret_cast<T *>(scratch(name, (w * h * sizeof(T) + sizeof(float) - 1) / sizeof(float), 1).data());
+    }
+
+    /**
+    *  \brief Upload view to the device as grayscale
+    *
+    *  \param dst        device image of view size to fill
+    *  \param normalized device image of view size to fill with grayscale divided by 255, skipped if 0
+    *  \param view       source view index, -1 for reference view
+    *  \param scale      factor applied to \p dst
+    *
+    *  \details 8 bit color of \a HostRefRGBA or \a HostSrcRGBA is uploaded and converted by a single kernel if it
+    * matches the view size, float grayscale of \a HostRef or \a HostSrc is uploaded and scaled otherwise.
+    */
+    void UploadGray(Image<float> &dst, Image<float> *normalized, int view, float scale);
+
+    /**
+    *  \brief Queue upload of a source view on the upload stream, ahead of its sweep by \a PlaneSweepThread()
+    *
+    *  \param view source view index
+    *  \return No return value
+    *
+    *  \details Two staging images are used in turns, so view \a i + 1 is uploaded and converted while view \a i is
+    * swept on the default stream. An upload waits for the sweep of view \a i - 1 to release its staging image. Sources
+    * in \a Host (pinned) memory, see \a CAM_IMAGE_MEMORY, are copied without blocking the host, pageable sources are
+    * staged by the driver before the call returns while queued sweep kernels keep running.
+    */
+    void stageSource(int view);
+
+    /**
+    *  \brief Get staged source view, the default stream waits for its upload
+    *
+    *  \param view source view index
+    *  \return Device pointer to the grayscale of \p view, 0 if it was not staged by \a stageSource()
+    */
+    const float * stagedSource(int view);
+
+    /**
+    *  \brief Release staging image of a source view once the default stream is done with it
+    *
+    *  \param view source view index
+    *  \return No return value
+    */
+    void releaseSource(int view);
+
+    // stream, events and views of source uploads queued by stageSource(), views are -1 for unused staging images
+    cudaStream_t uploadstream = 0;
+    cudaEvent_t uploaded[2] = {0, 0};
+    cudaEvent_t consumed[2] = {0, 0};
+    int stagedviews[2] = {-1, -1};
+
+    /**
+    *  \brief Upload source view to the device as reduced precision grayscale
+    *
+    *  \param dst  device image of view size to fill
+    *  \param view source view index, -1 for reference view
+    *
+    *  \details Grayscale of \a HostGray() is converted on the host, so only the stored bytes are transferred.
+    */
+    void UploadGray(Image<__half> &dst, int view);
+
+    /** \brief Same as above, grayscale is rounded to nearest integer and clamped to [0, 255] */
+    void UploadGray(Image<uchar> &dst, int view);
+
+    /**
+    *  \brief Check that the configured source precision is implemented by a sweep
+    *
+    *  \param call      name of calling function for the error message
+    *  \param supported true if the sweep honours \a setSourcePrecision()
+    *  \return True if \p supported or sources are float, prints an error otherwise
+    */
+    bool sourcePrecisionSupported(const char *call, bool supported) const;
+
+    /**
+    *  \brief Sparse depth TGV denoising shared by \a TGVdenoiseFromSparse() overloads
+    *
+    *  \param depth    host sparse depthmap, used if not 0
+    *  \param scan     Velodyne scan projected on the device otherwise
+    *  \param velo2cam transformation from Velodyne to camera coordinates of \p scan
+    */
+    bool TGVSparse(int argc, char **argv, const CamImage<float> *depth, const KITTI::VeloScan *scan, const Matrix4D &velo2cam,
+                   const unsigned int niters, const double alpha0, const double alpha1, const double tau, const double sigma,
+                   const double theta, const double beta, const double gamma);
+
     /**
     *  \brief Single planesweep thread operating on single source view (all pointers point to memory on the GPU):
     *
@@ -491,16 +1633,186 @@ protected:
     *  \param Ref       pointer to reference intensity image
     *  \param Refmean  pointer to reference windowed means image
     *  \param Refstd    pointer to reference windowed STD image
+    *  \param d_H       pointer to homographies of all planes for this source view
+    *  \param depths    depths of all planes, stored on the host
     *  \param index     index of source view image in \a std::vector
     *
     *  \details Multithreading does not increase performance
     */
     void PlaneSweepThread(float * globDepth, float * globN, const float * Ref, const float * Refmean, const float * Refstd,
-                          const unsigned int &index);
+                          const Matrix3D * d_H, const std::vector<float> & depths, const unsigned int &index);
+
+    /**
+    *  \brief Planesweep of all source views in one pass (all pointers point to memory on the GPU):
+    *
+    *  \param globDepth pointer to sum of depthmaps
+    *  \param globN     pointer to depthmap summation count
+    *  \param Ref       pointer to reference intensity image
+    *  \param Refmean   pointer to reference windowed means image
+    *  \param Refstd    pointer to reference windowed STD image
+    *  \param d_H       pointer to homography table of all source views, see \a HomographyTable()
+    *  \param depths    depths of all planes, stored on the host
+    *  \param nimgs     number of source views from the start of \a HostSrc
+    *
+    *  \details Gives the same result as calling \a PlaneSweepThread for each view with fused sweep enabled
+    */
+    void PlaneSweepMultiview(float * globDepth, float * globN, const float * Ref, const float * Refmean, const float * Refstd,
+                             const Matrix3D * d_H, const std::vector<float> & depths, const unsigned int nimgs);
+
+    /**
+    *  \brief Planesweep of source views distributed over several GPUs (all pointers point to memory on the selected GPU):
+    *
+    *  \param globDepth pointer to sum of depthmaps
+    *  \param globN     pointer to depthmap summation count
+    *  \param Ref       pointer to reference intensity image
+    *  \param Refmean   pointer to reference windowed means image
+    *  \param Refstd    pointer to reference windowed STD image
+    *  \param H         homography table of all source views stored on the host, see \a HomographyTable()
+    *  \param depths    depths of all planes, stored on the host
+    *  \param nimgs     number of source views from the start of \a HostSrc
+    *
+    *  \details Source view \a i is swept by \a PlaneSweepThread on device <em>i % sweepdevices.size()</em>, each
+    * additional device is driven by its own host thread. Reference images are copied between devices with peer copies
+    * and partial sums are added to \a globDepth and \a globN at the end. Masked sweeps (see \a setMask()) are not
+    * distributed, the mask is only prepared on the selected device.
+    */
+    void PlaneSweepMultiDevice(float * globDepth, float * globN, const float * Ref, const float * Refmean, const float * Refstd,
+                               const std::vector<Matrix3D> & H, const std::vector<float> & depths, const unsigned int nimgs);
+
+    /**
+    *  \brief Get depths of all planesweep planes between \a znear and \a zfar
+    *
+    *  \param depths depths of planes returned by reference, uniform in inverse depth if \a setInverseDepth() is selected
+    */
+    void PlaneDepths(std::vector<float> & depths) const;
+
+    /**
+    *  \brief Calculate homographies from a reference to a source view for all planes
+    *
+    *  \param H      pointer to \a depths.size() homographies returned by reference
+    *  \param depths depths of planes
+    *  \param ref    reference view pose
+    *  \param src    source view pose
+    *  \param Km     calibration matrix
+    */
+    void PairHomographies(Matrix3D * H, const std::vector<float> & depths, const CamImage<float> & ref,
+                          const CamImage<float> & src, const Matrix3D & Km) const;
+
+    /**
+    *  \brief Calculate homographies from reference to source views for all planesweep planes
+    *
+    *  \param H       homography table returned by reference, entry <em>i * depths.size() + p</em> belongs to source view \a i and plane \a p
+    *  \param depths  depths of planes returned by reference
+    *  \param nimgs   number of source views from the start of \a HostSrc
+    *
+    *  \details Table is calculated once per reference view and moved to device memory as a single block,
+    * so kernels only need plane index to get their homography.
+    */
+    void HomographyTable(std::vector<Matrix3D> & H, std::vector<float> & depths, const unsigned int nimgs) const;
+
+    /**
+    *  \brief This is an overloaded function using calibration matrix \p Km instead of \f$K\f$
+    *
+    *  \param H       homography table returned by reference
+    *  \param depths  depths of planes returned by reference
+    *  \param nimgs   number of source views from the start of \a HostSrc
+    *  \param Km      calibration matrix, e.g. of a lower resolution pyramid level
+    */
+    void HomographyTable(std::vector<Matrix3D> & H, std::vector<float> & depths, const unsigned int nimgs, const Matrix3D & Km) const;
+
+    /**
+    *  \brief Coarse to fine planesweep of all source views (all pointers point to memory on the GPU):
+    *
+    *  \param globDepth pointer to sum of depthmaps at full resolution
+    *  \param globN     pointer to depthmap summation count at full resolution
+    *  \param Ref       reference intensity image at full resolution
+    *  \param Refmean   pointer to reference windowed means image at full resolution
+    *  \param Refstd    pointer to reference windowed STD image at full resolution
+    *  \param d_H       pointer to full resolution homography table, see \a HomographyTable()
+    *  \param depths    depths of all planes, stored on the host
+    *  \param nimgs     number of source views from the start of \a HostSrc
+    *
+    *  \details Images are halved \a pyramidlevels - 1 times. Coarsest level is swept over all planes, each finer level
+    * only tests planes within \a pyramidband planes of upsampled averaged depthmap of the previous level. Fused kernel is always used.
+    */
+    void PlaneSweepPyramid(float * globDepth, float * globN, const Image<float> & Ref, const float * Refmean, const float * Refstd,
+                           const Matrix3D * d_H, const std::vector<float> & depths, const unsigned int nimgs);
+
+    /**
+    *  \brief Planesweep of all source views into a cost volume with semi-global aggregation (all pointers point to memory on the GPU):
+    *
+    *  \param globDepth pointer to depthmap, selected depth where valid
+    *  \param globN     pointer to depthmap count, 1 where valid and 0 otherwise
+    *  \param Ref       pointer to reference intensity image
+    *  \param Refmean   pointer to reference windowed means image
+    *  \param Refstd    pointer to reference windowed STD image
+    *  \param d_H       pointer to homography table of all source views, see \a HomographyTable()
+    *  \param depths    depths of all planes, stored on the host
+    *  \param nimgs     number of source views from the start of \a HostSrc
+    *
+    *  \details All source views are kept on the device, planes are swept in the outer loop so the volume holds the
+    * mean NCC of all views, see \a setSemiGlobal().
+    */
+    void PlaneSweepSemiGlobal(float * globDepth, float * globN, const float * Ref, const float * Refmean, const float * Refstd,
+                              const Matrix3D * d_H, const std::vector<float> & depths, const unsigned int nimgs);
+
+    /**
+    *  \brief Planesweep of all source views in plane bands around a predicted depthmap (all pointers point to memory on the GPU):
+    *
+    *  \param globDepth pointer to sum of depthmaps
+    *  \param globN     pointer to depthmap summation count
+    *  \param Ref       pointer to reference intensity image
+    *  \param Refmean   pointer to reference windowed means image
+    *  \param Refstd    pointer to reference windowed STD image
+    *  \param d_H       pointer to homography table of all source views, see \a HomographyTable()
+    *  \param predicted pointer to predicted depthmap, QNaN where there is no prediction
+    *  \param depths    depths of all planes, stored on the host
+    *  \param nimgs     number of source views from the start of \a HostSrc
+    *
+    *  \details Same band kernels as the finest level of \a PlaneSweepPyramid(), blocks skip planes outside of the bands
+    * of all their pixels.
+    */
+    void PlaneSweepTemporal(float * globDepth, float * globN, const float * Ref, const float * Refmean, const float * Refstd,
+                            const Matrix3D * d_H, const float * predicted, const std::vector<float> & depths,
+                            const unsigned int nimgs);
+
+    /**
+    *  \brief Rectified planesweep of all source views (all pointers point to memory on the GPU):
+    *
+    *  \param globDepth pointer to sum of depthmaps
+    *  \param globN     pointer to depthmap summation count
+    *  \param Ref       pointer to reference intensity image
+    *  \param Refmean   pointer to reference windowed means image
+    *  \param Refstd    pointer to reference windowed STD image
+    *  \param depths    depths of all planes, stored on the host
+    *  \param shifts    disparity times depth of each source view, see \a isRectified()
+    *  \param nimgs     number of source views from the start of \a HostSrc
+    *
+    *  \details Disparities of all views and planes are uploaded as one table. Consecutive planes are swept by one
+    * \a planesweep_rectified_NCC launch as long as their disparity range fits into shared memory.
+    */
+    void PlaneSweepRectified(float * globDepth, float * globN, const float * Ref, const float * Refmean, const float * Refstd,
+                             const std::vector<float> & depths, const std::vector<float> & shifts, const unsigned int nimgs);
+
+    /**
+    *  \brief Planesweep of all source views in horizontal strips of reference rows (all images are on the GPU):
+    *
+    *  \param depthmap averaged depthmap at full resolution returned by reference
+    *  \param Ref      reference intensity image at full resolution
+    *  \param strips   strips from \a planStrips()
+    *  \param H        full resolution homography table stored on the host, see \a HomographyTable()
+    *  \param depths   depths of all planes, stored on the host
+    *  \param nimgs    number of source views from the start of \a HostSrc
+    *
+    *  \details Homographies are multiplied by the row offset of each strip, so \a PlaneSweepThread warps strip pixels
+    * into full source views. Kept rows are the same as those of a full frame separable sweep.
+    */
+    void PlaneSweepStrips(Image<float> & depthmap, const Image<float> & Ref, const std::vector<Strip> & strips,
+                          const std::vector<Matrix3D> & H, const std::vector<float> & depths, const unsigned int nimgs);
 
 private:
 
-    // CUDA initialization functions
+    // CUDA initialization functions, device is initialized only on the first call
     int cudaDevInit(int argc, const char **argv);
 
     /** \brief Cuda GPU reset function. Use this function to reallocate memory on the device when it
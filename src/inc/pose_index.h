@@ -0,0 +1,145 @@
+/**
+ *  \file pose_index.h
+ *  \brief Header file containing memory mapped binary index of dataset camera poses
+ */
+#ifndef POSE_INDEX_H
+#define POSE_INDEX_H
+
+#include <QString>
+#include <QFile>
+#include <QVector>
+#include "structs.h"
+#include "defines.h"
+
+namespace KITTI { class KITTIReader; }
+
+/**
+ *  \brief Binary table of per frame camera calibration, pose and timestamp
+ *
+ *  \details The table is built once from the text files of a dataset, written next to the data and memory mapped on
+ * later runs, so looking up a frame is a single array access without any parsing. File layout is a 32 byte
+ * header followed by one fixed size record per frame number in [first, first + size).
+ */
+class PoseIndex
+{
+public:
+    /** \brief Single frame entry */
+    struct Record
+    {
+        Matrix3D K;     //!< camera calibration matrix
+        Matrix3D R;     //!< rotation matrix
+        Vector3D t;     //!< translation vector
+        int valid;      //!< 0 if the frame has no camera data
+        double tstamp;  //!< timestamp in seconds, 0 if unknown
+    };
+
+    /** \brief File header */
+    struct Header
+    {
+        char magic[8];
+        unsigned int version;
+        unsigned int record;    // record size in bytes
+        int first;
+        int count;
+        int reserved[2];
+    };
+
+    PoseIndex() : records(0), first_(0), count_(0) {}
+    ~PoseIndex() { close(); }
+
+    /**
+     *  \brief Map index file
+     *
+     *  \param fname index file name
+     *  \return False if the file is missing or was written by another version
+     */
+    bool open(const QString & fname);
+
+    /** \brief Unmap index file */
+    void close();
+
+    /**
+     *  \brief Get pose of a frame
+     *
+     *  \param number frame number
+     *  \param K      camera calibration matrix returned by reference
+     *  \param R      rotation matrix returned by reference
+     *  \param t      translation vector returned by reference
+     *  \return False if the frame is not in the index
+     */
+    bool pose(int number, Matrix3D & K, Matrix3D & R, Vector3D & t) const;
+
+    /** \brief Get record of a frame, 0 if it is not in the index */
+    const Record * record(int number) const;
+
+    bool isOpen() const { return records != 0; }
+    int first() const { return first_; }
+    int size() const { return count_; }
+    QString fileName() const { return file.fileName(); }
+
+    /**
+     *  \brief Build index of ICL-NUIM style dataset from its camera \a txt files
+     *
+     *  \param fname  index file name to write
+     *  \param dir    directory of images
+     *  \param name   image file name before number
+     *  \param digits number of digits that make up number in a file name
+     *  \return Success/failure of writing the index
+     *
+     *  \details R and t are from world to camera coordinates, as computed by \a Reader::computeRT()
+     */
+    static bool buildICLNUIM(const QString & fname, const QString & dir, const QString & name, const int digits);
+
+    /**
+     *  \brief Build index of KITTI OxTS poses and timestamps
+     *
+     *  \param fname  index file name to write
+     *  \param reader reader with base directory set
+     *  \param K      camera calibration matrix stored with every pose
+     *  \return Success/failure of writing the index
+     *
+     *  \details R and t are OxTS unit poses w.r.t. the first one, as computed by \a KITTI::convertOxtsToPose()
+     */
+    static bool buildKITTI(const QString & fname, const KITTI::KITTIReader & reader, const Matrix3D & K);
+
+    /**
+     *  \brief Open index, building it first if it is missing or older than \p source
+     *
+     *  \param fname  index file name
+     *  \param source file or directory the index is built from
+     *  \param build  function building the index into \p fname
+     *  \return Success/failure of opening the index
+     *
+     *  \details Building is not retried for an index that failed to build
+     */
+    template<typename _build>
+    bool openOrBuild(const QString & fname, const QString & source, _build build)
+    {
+        if (isOpen() && (fileName() == fname)) return true;
+        if (failed == fname) return false; // do not retry building on every lookup
+        if (stale(fname, source) || !open(fname)) {
+            close();
+            if (!build(fname) || !open(fname)) {
+                failed = fname;
+                return false;
+            }
+        }
+        failed.clear();
+        return true;
+    }
+
+protected:
+    static bool write(const QString & fname, int first, const QVector<Record> & recs);
+    static bool stale(const QString & fname, const QString & source);
+
+    QFile file;
+    QString failed;
+    const Record * records;
+    int first_, count_;
+
+private:
+    PoseIndex(const PoseIndex &);
+    PoseIndex & operator=(const PoseIndex &);
+};
+
+#endif // POSE_INDEX_H
@@ -3,7 +3,11 @@
 
 #include "structs.h"
 #include <QImage>
+#include <QVector>
+#include <functional>
+#include <vector>
 #include "kitti_helper.h"
+#include "defines.h"
 
 class Reader
 {
@@ -39,8 +43,24 @@ public:
                         depthdata;  // depth image data
     };
 
+    /** \brief Function reporting file errors, receives title and message */
+    typedef std::function<void(const QString & title, const QString & message)> ErrorHandler;
+
+    /**
+    *  \brief Set function reporting file errors of all readers
+    *
+    *  \param handler error handler, errors are printed to \a stderr if it is empty
+    *  \return No return value
+    *
+    *  \details Readers do not depend on a GUI, the viewer installs a handler showing a message box
+    */
+    static void setErrorHandler(ErrorHandler handler);
+
+    /** \brief Report file error through the installed error handler */
+    static void reportError(const QString & title, const QString & message);
+
     static bool Read_FromSource(QImage & ref, Matrix3D & Rref, Vector3D & tref,
-                                QVector<QImage> & src, QVector<Matrix3D> & Rsrc, QVector<Vector3D> tsrc,
+                                QVector<QImage> & src, QVector<Matrix3D> & Rsrc, QVector<Vector3D> & tsrc,
                                 Matrix3D & K);
     static bool Read_ICL_NUIM_RGB(QImage & ref, Matrix3D & Rref, Vector3D & tref, const int refn,
                                   QVector<QImage> & src, QVector<Matrix3D> & Rsrc, QVector<Vector3D> & tsrc, const QVector<int> & srcn,
@@ -48,11 +68,75 @@ public:
     static bool Read_ICL_NUIM_depth(QImage & depth, const int number, const QString & directory,
                                     const QString &fname, const QString &format, const int digits);
 
-    /** @brief ONLY A PLACEHOLDER AT THE TIME, STILL EMPTY */
+    /**
+    *  \brief Read ICL-NUIM ground truth depth as depth along the optical axis
+    *
+    *  \param depth     depth values of all pixels returned by reference, row by row
+    *  \param width     image width
+    *  \param height    image height
+    *  \param K         calibration matrix of the view, 1 based pixel coordinates
+    *  \param number    image number
+    *  \param directory dataset directory
+    *  \param fname     image file name before number
+    *  \param format    image file extension
+    *  \param digits    number of digits in image file names
+    *  \param scale     factor applied to depth values, e.g. to convert units
+    *  \return Success/failure of reading the \a .depth file next to the image
+    *
+    *  \details \a .depth files hold distances from the camera center along each pixel ray, they are divided by
+    * the ray length of the pixel at unit depth.
+    */
+    static bool Read_ICL_NUIM_depth(std::vector<float> & depth, const int width, const int height, const Matrix3D & K,
+                                    const int number, const QString & directory, const QString & fname,
+                                    const QString & format, const int digits, const float scale = 1.f);
+
+    /**
+    *  \brief Read reference and source views of TUM RGB-D sequence
+    *
+    *  \param ref         reference image returned by reference
+    *  \param Rref        reference rotation matrix from world to camera coordinates
+    *  \param tref        reference camera position
+    *  \param refindex    index of reference image among associated images
+    *  \param src         source images returned by reference, views without image or pose are left out
+    *  \param Rsrc        source rotation matrices
+    *  \param tsrc        source camera positions
+    *  \param srcindex    indexes of source images among associated images
+    *  \param rgbtextfile \a rgb.txt file of the sequence, groundtruth is read from TUM_GROUNDTRUTH_NAME next to it
+    *  \param line        fields of \p rgbtextfile lines
+    *  \return Success/failure of reading the reference view
+    *
+    *  \details Association index is built on first use of \p rgbtextfile and kept for later calls. Views are decoded
+    * by \a ImageLoader, next reference and source views are queued before returning so consecutive calls overlap
+    * decoding with processing. Camera calibration depends on the sensor and has to be set separately.
+    */
     static bool Read_TUM_RGBD_RGB(QImage & ref, Matrix3D & Rref, Vector3D & tref, const int refindex,
                                   QVector<QImage> & src, QVector<Matrix3D> & Rsrc, QVector<Vector3D> & tsrc, const QVector<int> & srcindex,
                                   const QString & rgbtextfile, const TUM_RGBD_line & line);
 
+    /**
+    *  \brief Associate TUM RGB-D images with groundtruth poses
+    *
+    *  \param files           associated images returned by reference, in image text file order
+    *  \param rgbtextfile     image text file, e.g. \a rgb.txt
+    *  \param groundtruthfile groundtruth text file with \a timestamp \a tx \a ty \a tz \a qx \a qy \a qz \a qw lines
+    *  \param line            fields of \p rgbtextfile lines
+    *  \param maxdiff         maximum time difference in seconds to nearest groundtruth pose
+    *  \return Success/failure of reading both files
+    *
+    *  \details Groundtruth is sorted by timestamp once and each image pose is found by binary search, interpolated
+    * between the enclosing groundtruth poses. Images farther than \p maxdiff from any pose are left out.
+    */
+    static bool Associate_TUM_RGBD(QVector<TUM_RGBD_file> & files, const QString & rgbtextfile, const QString & groundtruthfile,
+                                   const TUM_RGBD_line & line, const double maxdiff = TUM_MAX_TIME_DIFFERENCE);
+
+    /**
+    *  \brief Rotation matrix from world to camera coordinates of TUM RGB-D pose
+    *
+    *  \param q quaternion \a (qx, qy, qz, qw) of camera orientation w.r.t. world
+    *  \return Rotation matrix
+    */
+    static Matrix3D quat2R(const float4 & q);
+
     /**
     *  \brief Concatenate strings and \p number to create image file name
     *
@@ -0,0 +1,193 @@
+/**
+ *  \file result_writer.h
+ *  \brief Header file containing background writer of per frame results and lossless depthmap file format
+ */
+#ifndef RESULT_WRITER_H
+#define RESULT_WRITER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include <cuda_runtime_api.h>
+#include "cam_image.h"
+#include "structs.h"
+#include "defines.h"
+
+/** \brief Sample format of depthmap file payload */
+typedef enum DepthFormat{
+    DepthFloat32 = 0,   //!< 32 bit float, lossless
+    DepthHalf = 1       //!< 16 bit half precision float
+} DepthFormat;
+
+/** \brief Compression of depthmap file payload */
+typedef enum DepthCompression{
+    CompressNone = 0,   //!< raw samples
+    CompressLZ4 = 1,    //!< LZ4, requires LZ4_FOUND
+    CompressZstd = 2    //!< Zstandard, requires ZSTD_FOUND
+} DepthCompression;
+
+/**
+ *  \brief Header of depthmap file
+ *
+ *  \details Stored at the start of the file in native byte order, followed by \a bytes of payload. Uncompressed
+ * payload holds \a channels planes of \a width x \a height samples, depth first and confidence second.
+ */
+struct depthFileHeader
+{
+    char magic[8];                  ///< DEPTH_FILE_MAGIC
+    unsigned int version;           ///< DEPTH_FILE_VERSION
+    unsigned int format;            ///< DepthFormat of samples
+    unsigned int compression;       ///< DepthCompression of payload
+    unsigned int channels;          ///< 1 for depth only, 2 for depth and confidence
+    unsigned int width;             ///< depthmap width
+    unsigned int height;            ///< depthmap height
+    float R[9];                     ///< row major rotation from world to camera coordinates
+    float t[3];                     ///< camera translation
+    unsigned long long rawbytes;    ///< payload size before compression in bytes
+    unsigned long long bytes;       ///< stored payload size in bytes
+};
+
+/**
+ *  \brief Queue writing results on a background thread
+ *
+ *  \details Depthmaps are written from pinned buffers obtained by \a acquire(). Device results are downloaded into
+ * them asynchronously and the writer thread waits for the download on its own, so disk I/O overlaps with computation
+ * of the next frame. Any other result, e.g. a point cloud, can be written by \a enqueue(). At most \a queue() writes
+ * are pending, submitting more blocks the caller until the oldest one is written. Buffers are pinned memory of the
+ * current CUDA context, so all writers are flushed by \a flushAll() before \a cudaDeviceReset() and drop their pool
+ * by \a forgetAll() after it, as \a PlaneSweep does on every reset.
+ */
+class ResultWriter
+{
+public:
+    typedef CamImage<float, Host> Buffer;
+    typedef std::shared_ptr<Buffer> buffer_ptr;
+
+    /**
+     *  \brief Constructor, starts writer thread
+     *
+     *  \param queue maximum number of pending writes
+     */
+    explicit ResultWriter(unsigned int queue = DEFAULT_WRITER_QUEUE);
+
+    /** \brief Destructor, writes all pending results and joins writer thread */
+    ~ResultWriter();
+
+    /**
+     *  \brief Get pinned buffer that is not used by a pending write
+     *
+     *  \param w width of the buffer
+     *  \param h height of the buffer
+     *  \return Unpadded pinned buffer, reused between frames of the same size
+     */
+    buffer_ptr acquire(size_t w, size_t h);
+
+    /**
+     *  \brief Download unpadded device image into pinned buffer without waiting for it
+     *
+     *  \param buffer buffer from \a acquire()
+     *  \param d_src  pointer to device data of buffer size
+     *  \param stream stream to copy in, pass the same stream to \a writeDepth()
+     *  \return No return value
+     */
+    static void download(const buffer_ptr & buffer, const float * d_src, cudaStream_t stream = 0);
+
+    /**
+     *  \brief Queue depthmap write
+     *
+     *  \param fname       output file name
+     *  \param depth       depthmap buffer from \a acquire(), its R and t are stored in the header
+     *  \param confidence  optional confidence buffer of the same size
+     *  \param format      sample format
+     *  \param compression payload compression, falls back to none if the library was not found
+     *  \param stream      stream of pending downloads into the buffers, written once all work in it is done
+     *  \return No return value
+     *
+     *  \details Buffers must not be modified by the caller until they are returned by \a acquire() again.
+     */
+    void writeDepth(const std::string & fname, const buffer_ptr & depth, const buffer_ptr & confidence = buffer_ptr(),
+                    DepthFormat format = DepthFloat32, DepthCompression compression = CompressNone, cudaStream_t stream = 0);
+
+    /** \brief Queue depthmap write of host image, copied into a pinned buffer first */
+    void writeDepth(const std::string & fname, const CamImage<float> & depth,
+                    DepthFormat format = DepthFloat32, DepthCompression compression = CompressNone);
+
+    /**
+     *  \brief Queue arbitrary write
+     *
+     *  \param job function writing the result, must own or share everything it uses
+     *  \return No return value
+     */
+    void enqueue(std::function<void()> job);
+
+    /** \brief Wait until all pending writes are done */
+    void flush();
+
+    /**
+     *  \brief Wait for pending writes and drop pinned buffers without freeing them
+     *
+     *  \details Use after \a cudaDeviceReset(), which already freed the memory. Buffers still held by the caller are
+     * not freed on their release either.
+     */
+    void forget();
+
+    /** \brief Wait until pending writes of all writers are done */
+    static void flushAll();
+
+    /** \brief Call \a forget() of all writers */
+    static void forgetAll();
+
+    /** \brief Get maximum number of pending writes */
+    unsigned int queue() const { return queue_; }
+
+    /**
+     *  \brief Read depthmap file
+     *
+     *  \param fname      depthmap file name
+     *  \param h          file header returned by reference
+     *  \param depth      depth samples returned by reference
+     *  \param confidence confidence samples returned by reference, empty if not stored
+     *  \return False if the file is missing, corrupt or compressed by an unavailable library
+     */
+    static bool readDepth(const std::string & fname, depthFileHeader & h, std::vector<float> & depth,
+                          std::vector<float> & confidence);
+
+    /** \brief Check if \p compression is available in this build */
+    static bool compressionSupported(DepthCompression compression);
+
+protected:
+    struct Job
+    {
+        std::function<void()> run;
+        cudaEvent_t event;  // 0 if nothing has to be waited for
+    };
+
+    void push(std::function<void()> run, cudaEvent_t event);
+    void work();
+
+    static bool writeDepthFile(const std::string & fname, const Buffer & depth, const Buffer * confidence,
+                               DepthFormat format, DepthCompression compression);
+
+    std::thread worker_;
+    std::deque<Job> jobs_;
+    std::vector<buffer_ptr> buffers_;
+    std::mutex mutex_;
+    std::condition_variable queued_, done_;
+    unsigned int queue_;
+    unsigned int running_;
+    bool stop_;
+
+    static std::mutex instancesMutex_;          // guards instances_
+    static std::vector<ResultWriter *> instances_;
+
+private:
+    ResultWriter(const ResultWriter &);
+    ResultWriter & operator=(const ResultWriter &);
+};
+
+#endif // RESULT_WRITER_H
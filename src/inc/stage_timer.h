@@ -0,0 +1,154 @@
+/**
+ *  \file stage_timer.h
+ *  \brief Header file containing GPU timing and counters of pipeline stages
+ */
+#ifndef STAGE_TIMER_H
+#define STAGE_TIMER_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <ostream>
+#include <cuda_runtime_api.h>
+
+/**
+ *  \brief GPU time and counters of a single stage
+ */
+struct StageTiming
+{
+    std::string name;           //!< stage name
+    float ms = 0;               //!< GPU time between stage events, summed over all intervals of the stage
+    size_t bytes = 0;           //!< bytes transferred between host and device
+    unsigned int launches = 0;  //!< kernel launches, a replayed graph counts as one
+    unsigned int iterations = 0;//!< iterations run, e.g. planes, solver iterations or warps
+};
+
+/**
+ *  \brief Stage timings of a single call, e.g. \a PlaneSweep::RunAlgorithm()
+ */
+struct StageTimings
+{
+    std::string call;                   //!< name of timed call
+    float ms = 0;                       //!< GPU time from start to stop of the call
+    std::vector<StageTiming> stages;    //!< stages in order of their first interval
+
+    /**
+     *  \brief Find stage by name
+     *
+     *  \param name stage name
+     *  \return Pointer to stage or null pointer if there is no such stage
+     */
+    const StageTiming * stage(const std::string & name) const;
+
+    /**
+     *  \brief Write CSV header line matching \a writeCSV()
+     *
+     *  \param out output stream
+     *  \return No return value
+     */
+    static void writeCSVHeader(std::ostream & out);
+
+    /**
+     *  \brief Write one CSV line per stage and one for the whole call with stage name "total"
+     *
+     *  \param out   output stream
+     *  \param label first column, e.g. frame number
+     *  \return No return value
+     */
+    void writeCSV(std::ostream & out, const std::string & label = "") const;
+
+    /** \brief Print human readable table */
+    void print(std::ostream & out) const;
+};
+
+/**
+ *  \brief Records CUDA events around pipeline stages of a call and collects their counters
+ *
+ *  \details \a start() begins a call, \a begin() opens a stage interval and closes the previous one, \a stop() ends the
+ * call. Intervals of stages with the same name are summed, so stages of loops are written as one. Events are recorded
+ * on the given stream and the timer never synchronizes while recording, so timing does not change the overlap of work.
+ * \a timings() waits for the last event of the call the first time it is queried. Counters may be added from several
+ * host threads at once, e.g. multi device planesweep.
+ *
+ * Events belong to the device that was current when they were created, so all stages of a call have to be recorded on
+ * that device. Call \a forget() after \a cudaDeviceReset().
+ */
+class StageTimer
+{
+public:
+    /** \brief Constructor, no events are created until the first call is started */
+    StageTimer() : used_(0), open_(-1), current_(-1), stream_(0), callstream_(0), pending_(false), started_(false) {}
+
+    /** \brief Destructor, destroys events */
+    ~StageTimer();
+
+    /**
+     *  \brief Start timing a call, previous timings are dropped
+     *
+     *  \param call   name of the call
+     *  \param stream CUDA stream of the call
+     *  \return No return value
+     */
+    void start(const std::string & call, cudaStream_t stream = 0);
+
+    /**
+     *  \brief Open an interval of stage \p name, closes the open interval
+     *
+     *  \param name   stage name
+     *  \param stream CUDA stream of the stage work
+     *  \return No return value
+     */
+    void begin(const std::string & name, cudaStream_t stream = 0);
+
+    /** \brief Close the open interval */
+    void end();
+
+    /**
+     *  \brief Add counters to the current stage
+     *
+     *  \param launches   kernel launches
+     *  \param bytes      bytes transferred between host and device
+     *  \param iterations iterations run
+     *  \return No return value
+     */
+    void count(unsigned int launches, size_t bytes = 0, unsigned int iterations = 0);
+
+    /** \brief End the call, closes the open interval */
+    void stop();
+
+    /**
+     *  \brief Get timings of the last call
+     *
+     *  \return Timings, stage times are resolved on first query after \a stop()
+     */
+    const StageTimings & timings();
+
+    /** \brief Drop all events without destroying them, required after \a cudaDeviceReset() */
+    void forget();
+
+protected:
+    struct Interval
+    {
+        int stage;
+        cudaEvent_t start, stop;
+    };
+
+    cudaEvent_t event();
+    void resolve();
+
+    std::vector<cudaEvent_t> events_;   // event pool, reused by every call
+    size_t used_;
+    std::vector<Interval> intervals_;
+    cudaEvent_t first_, last_;
+    int open_, current_;
+    cudaStream_t stream_, callstream_;   // stream of open interval and of the call
+    bool pending_, started_;
+    StageTimings result_;
+    std::mutex mutex_;
+
+private:
+    StageTimer(const StageTimer &);
+    StageTimer & operator=(const StageTimer &);
+};
+
+#endif // STAGE_TIMER_H
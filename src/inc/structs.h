@@ -9,8 +9,10 @@
 #define STRUCTS_H
 
 #include <helper_math.h>
+#include <cuda_fp16.h>
 #include "memory.h"
 #include <iostream>
+#include <type_traits>
 
 // Forward declarations of structs contained in this file:
 template<unsigned char _nBins>  struct histogram;
@@ -103,6 +105,58 @@ struct histogram
     */
     __device__ __host__ inline
     unsigned char& operator()(unsigned char i){ return bin[i]; }
+
+    /**
+    *  \brief Add single vote to bin
+    *
+    *  \param i index of bin
+    */
+    __device__ __host__ inline
+    void increment(unsigned char i){ bin[i]++; }
+};
+
+/**
+*  \brief Histogram with 4 bit saturating counters, two bins per byte
+*  \tparam _nBins   number of histogram bins
+*
+*  \details Same bin meaning as \a histogram. Counters stop at 15 votes.
+*/
+template<unsigned char _nBins>
+struct packedHistogram
+{
+    /** \brief Array of bin pairs, even bins in low nibbles */
+    unsigned char bin[(_nBins + 1) / 2];
+
+    /**
+    *  \brief Default constructor
+    *
+    *  \details All bins are initialized to 0
+    */
+    __device__ __host__ inline
+    packedHistogram()
+    {
+        for (unsigned char i = 0; i < (_nBins + 1) / 2; i++) bin[i] = 0;
+    }
+
+    /**
+    *  \brief Access operator
+    *
+    *  \param i index of bin
+    *  \return Number of votes in bin at index \a i
+    */
+    __device__ __host__ inline
+    unsigned char operator()(unsigned char i) const { return (bin[i >> 1] >> ((i & 1) * 4)) & 0xF; }
+
+    /**
+    *  \brief Add single vote to bin, unless counter is saturated
+    *
+    *  \param i index of bin
+    */
+    __device__ __host__ inline
+    void increment(unsigned char i)
+    {
+        if ((*this)(i) < 0xF) bin[i >> 1] += 1 << ((i & 1) * 4);
+    }
 };
 
 /** \brief histogram struct with overloaded \a new and \a delete operators from class \p Manage */
@@ -205,6 +259,142 @@ struct Mfusionvoxel : public fusionvoxel<_nBins>, public Manage
     {}
 };
 
+/** \brief Half precision 3D vector */
+struct halfvec3
+{
+    __half x, y, z;
+};
+
+/**
+*  \brief Reference to half precision value, reads and writes convert from and to float
+*/
+struct halfRef
+{
+    __half & r;
+
+    __host__ __device__ inline
+    halfRef(__half & r) : r(r)
+    {}
+
+    __host__ __device__ inline
+    operator float() const { return __half2float(r); }
+
+    __host__ __device__ inline
+    halfRef& operator=(float f)
+    {
+        r = __float2half(f);
+        return *this;
+    }
+
+    __host__ __device__ inline
+    halfRef& operator=(const halfRef & h)
+    {
+        r = h.r;
+        return *this;
+    }
+};
+
+/**
+*  \brief Reference to \a halfvec3, reads and writes convert from and to float3
+*/
+struct halfvec3Ref
+{
+    halfRef x, y, z;
+
+    __host__ __device__ inline
+    halfvec3Ref(halfvec3 & v) : x(v.x), y(v.y), z(v.z)
+    {}
+
+    __host__ __device__ inline
+    operator float3() const { return make_float3(x, y, z); }
+
+    __host__ __device__ inline
+    halfvec3Ref& operator=(float3 f)
+    {
+        x = f.x;
+        y = f.y;
+        z = f.z;
+        return *this;
+    }
+};
+
+/**
+*  \brief Compact voxel for depthmap fusion with half precision \f$u\f$, \f$v\f$ and \f$p\f$
+*  \tparam _nBins      number of histogram bins
+*  \tparam _packedHist store histogram in 4 bit saturating counters (\a packedHistogram)
+*
+*  \details Holds 10 bytes of state instead of 20 bytes of \a fusionvoxel.
+*/
+template<unsigned char _nBins, bool _packedHist = false>
+struct halffusionvoxel
+{
+    /** \brief Histogram type */
+    typedef typename std::conditional<_packedHist, packedHistogram<_nBins>, histogram<_nBins>>::type hist_type;
+
+    /** \brief Primal variable \f$u\f$ */
+    __half u;
+    /** \brief Helper variable \f$v\f$ */
+    __half v;
+    /** \brief Dual variable \f$p\f$ */
+    halfvec3 p;
+    /** \brief Histogram */
+    hist_type h;
+
+    /**
+    * \brief Default constructor
+    *
+    *  \details All variables are intialized to 0.
+    */
+    __host__ __device__ inline
+    halffusionvoxel() :
+        u(__float2half(0.f)), v(__float2half(0.f)), h()
+    {
+        p.x = p.y = p.z = __float2half(0.f);
+    }
+};
+
+/**
+*  \brief Voxel type traits used by \a fusionData to access fields of different voxel formats
+*  \tparam _voxel voxel type
+*/
+template<typename _voxel>
+struct voxelTraits;
+
+/** \brief Traits of \a fusionvoxel, accessors return plain references */
+template<unsigned char _nBins>
+struct voxelTraits<fusionvoxel<_nBins>>
+{
+    typedef float scalar_type;
+    typedef float3 vector_type;
+    typedef histogram<_nBins> hist_type;
+    typedef float & scalar_ref;
+    typedef float3 & vector_ref;
+
+    __host__ __device__ inline static scalar_ref ref(scalar_type & x){ return x; }
+    __host__ __device__ inline static vector_ref ref(vector_type & x){ return x; }
+    __host__ __device__ inline static float get(const scalar_type & x){ return x; }
+    __host__ __device__ inline static float3 get(const vector_type & x){ return x; }
+};
+
+/** \brief Traits of \a halffusionvoxel, accessors return converting references */
+template<unsigned char _nBins, bool _packedHist>
+struct voxelTraits<halffusionvoxel<_nBins, _packedHist>>
+{
+    typedef __half scalar_type;
+    typedef halfvec3 vector_type;
+    typedef typename halffusionvoxel<_nBins, _packedHist>::hist_type hist_type;
+    typedef halfRef scalar_ref;
+    typedef halfvec3Ref vector_ref;
+
+    __host__ __device__ inline static scalar_ref ref(scalar_type & x){ return halfRef(x); }
+    __host__ __device__ inline static vector_ref ref(vector_type & x){ return halfvec3Ref(x); }
+    __host__ __device__ inline static float get(const scalar_type & x){ return __half2float(x); }
+    __host__ __device__ inline static float3 get(const vector_type & x)
+    {
+        return make_float3(__half2float(x.x), __half2float(x.y), __half2float(x.z));
+    }
+};
+
 /**
 *  \brief Helper structure for calculating \f$\operatorname{prox}_{hist}(u)\f$.
 *  \tparam _nBins   number of histogram bins
@@ -0,0 +1,143 @@
+/**
+ *  \file texture.h
+ *  \brief Header file containing templated class for 2D data stored in CUDA arrays and sampled with texture objects
+ */
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <cstring>
+#include "image.h"
+
+/** \addtogroup memory
+* @{
+*/
+
+/**
+ *  \brief Templated class holding 2D data in a CUDA array bound to a texture object
+ *
+ *  \tparam T type of data to work with
+ *
+ *  \details Texture uses unnormalized coordinates, hardware bilinear filtering (if \a T supports it) and border
+ * addressing, so samples outside the array return 0. Texel centers are at <em>index + 0.5</em>.
+ * Copy constructor does not take ownership of the array, same as Image.
+ */
+template<typename T>
+struct Texture
+{
+public:
+    inline __host__
+    Texture()
+        : array_(0), tex_(0), w_(0), h_(0), managed_(false)
+    {}
+
+    inline __host__
+    Texture(size_t w, size_t h, bool linear = true)
+        : array_(0), tex_(0), w_(0), h_(0), managed_(false)
+    {
+        reset(w, h, linear);
+    }
+
+    inline __host__
+    Texture(const Texture<T>& tex)
+        : array_(tex.array_), tex_(tex.tex_), w_(tex.w_), h_(tex.h_), managed_(false)
+    {}
+
+    inline __host__
+    virtual ~Texture()
+    {
+        free();
+    }
+
+    /**
+     *  \brief Allocate CUDA array and create texture object for it
+     *
+     *  \param w      width in number of elements
+     *  \param h      height in number of elements
+     *  \param linear use hardware bilinear filtering, otherwise nearest point sampling
+     */
+    inline __host__
+    void reset(size_t w, size_t h, bool linear = true)
+    {
+        free();
+        w_ = w;
+        h_ = h;
+
+        cudaChannelFormatDesc desc = cudaCreateChannelDesc<T>();
+        CHECK_CUDA_ERRORS_AUTO(cudaMallocArray(&array_, &desc, w_, h_));
+
+        cudaResourceDesc res;
+        memset(&res, 0, sizeof(res));
+        res.resType = cudaResourceTypeArray;
+        res.res.array.array = array_;
+
+        cudaTextureDesc td;
+        memset(&td, 0, sizeof(td));
+        td.addressMode[0] = cudaAddressModeBorder;
+        td.addressMode[1] = cudaAddressModeBorder;
+        td.filterMode = linear ? cudaFilterModeLinear : cudaFilterModePoint;
+        td.readMode = cudaReadModeElementType;
+        td.normalizedCoords = 0;
+
+        CHECK_CUDA_ERRORS_AUTO(cudaCreateTextureObject(&tex_, &res, &td, NULL));
+        managed_ = true;
+    }
+
+    inline __host__
+    void free()
+    {
+        if (managed_){
+            CHECK_CUDA_ERRORS_AUTO(cudaDestroyTextureObject(tex_));
+            CHECK_CUDA_ERRORS_AUTO(cudaFreeArray(array_));
+        }
+        managed_ = false;
+        array_ = 0;
+        tex_ = 0;
+        w_ = 0;
+        h_ = 0;
+    }
+
+    template<MemoryKind memFrom>
+    inline __host__
+    void copyFrom(const Image<T,memFrom>& img)
+    {
+        ASSERT_AUTO(((w_ == img.width()) && (h_ == img.height())));
+        bool dfrom = (memFrom == Device) || (memFrom == Managed);
+        CHECK_CUDA_ERRORS_AUTO(cudaMemcpy2DToArray(array_, 0, 0, img.data(), img.pitch(), w_ * sizeof(T), h_,
+                                                   dfrom ? cudaMemcpyDeviceToDevice : cudaMemcpyHostToDevice));
+    }
+
+    inline __host__
+    cudaTextureObject_t texture() const
+    {
+        return tex_;
+    }
+
+    inline __host__
+    size_t width() const
+    {
+        return w_;
+    }
+
+    inline __host__
+    size_t height() const
+    {
+        return h_;
+    }
+
+    inline __host__
+    bool isValid() const
+    {
+        return array_ != 0;
+    }
+
+protected:
+    cudaArray_t array_;
+    cudaTextureObject_t tex_;
+    size_t w_;
+    size_t h_;
+    bool managed_;
+};
+
+/** @} */ // group memory
+
+#endif // TEXTURE_H
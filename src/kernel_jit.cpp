@@ -0,0 +1,526 @@
+#include "kernel_jit.h"
+#include <QDir>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <iostream>
+#ifdef NVRTC_FOUND
+#include <nvrtc.h>
+#endif
+
+// JIT sources are self contained, constants come from -D options of the configuration. Arithmetic follows the static
+// kernels statement by statement, so results only differ where folding constants changes float rounding.
+
+static const char * planesweep_source = R"(
+#define N (WINSIZE / 2)
+#define TW (BLOCK_X + 2 * N)
+#define TH (BLOCK_Y + 2 * N)
+
+__device__ inline int mirror_index(int k, const int size)
+{
+    if (k < 0) k = -k;
+    if (k > size - 1) k = 2 * (size - 1) - k;
+    return min(max(k, 0), size - 1);
+}
+
+__device__ inline float sample(const float * __restrict__ d_data, const float x, const float y)
+{
+    const int   ix = floor(x);
+    const float a  = x - ix;
+    const int   iy = floor(y);
+    const float b  = y - iy;
+
+    if ((ix < 0) || (iy < 0) || (iy+1 > HEIGHT-1) || (ix+1 > WIDTH-1)) return 0.f;
+
+    const float r1 = a * d_data[iy*WIDTH+ix+1] + (1 - a) * d_data[iy*WIDTH+ix];
+    const float r2 = a * d_data[(iy+1)*WIDTH+ix+1] + (1 - a) * d_data[(iy+1)*WIDTH+ix];
+    return b * r2 + (1 - b) * r1;
+}
+
+extern "C" __global__ void __launch_bounds__(BLOCK_X * BLOCK_Y)
+planesweep_fused_NCC_jit(float * __restrict__ d_depthmap, float * __restrict__ d_bestncc, float * __restrict__ d_subplane,
+                         const float * __restrict__ d_src, const float * __restrict__ d_ref,
+                         const float * __restrict__ d_refmean, const float * __restrict__ d_refstd,
+                         const float * __restrict__ d_h, const float current_depth)
+{
+    __shared__ float s_warped[TW * TH];
+    __shared__ float s_ref[TW * TH];
+
+    float h[9];
+    for (int i = 0; i < 9; i++) h[i] = d_h[i];
+
+    for (int ty = threadIdx.y; ty < TH; ty += BLOCK_Y) {
+        const int gy = mirror_index(BLOCK_Y * blockIdx.y + ty - N, HEIGHT);
+        for (int tx = threadIdx.x; tx < TW; tx += BLOCK_X) {
+            const int gx = mirror_index(BLOCK_X * blockIdx.x + tx - N, WIDTH);
+            const float x = gx + 1, y = gy + 1;
+            const float X = h[0] * x + h[1] * y + h[2];
+            const float Y = h[3] * x + h[4] * y + h[5];
+            const float Z = h[6] * x + h[7] * y + h[8];
+            s_warped[ty * TW + tx] = sample(d_src, X / Z - 1, Y / Z - 1);
+            s_ref[ty * TW + tx] = d_ref[gy * WIDTH + gx];
+        }
+    }
+
+    __syncthreads();
+
+    const int ind_x = threadIdx.x + BLOCK_X * blockIdx.x;
+    const int ind_y = threadIdx.y + BLOCK_Y * blockIdx.y;
+    if ((ind_x >= WIDTH) || (ind_y >= HEIGHT)) return;
+
+    const int ind = ind_y * WIDTH + ind_x;
+    float mean = 0.f, sqmean = 0.f, prodmean = 0.f;
+#pragma unroll
+    for (int j = 0; j <= 2 * N; j++) {
+        const int row = (threadIdx.y + j) * TW + threadIdx.x;
+#pragma unroll
+        for (int i = 0; i <= 2 * N; i++) {
+            const float w = s_warped[row + i];
+            mean += w;
+            sqmean += w * w;
+            prodmean += w * s_ref[row + i];
+        }
+    }
+
+    const float norm = 1.f / (float)(WINSIZE * WINSIZE);
+    mean *= norm;
+    sqmean *= norm;
+    prodmean *= norm;
+
+    const float var = sqmean - mean * mean;
+    const float std = var > 0 ? sqrt(var) : 0.f;
+    const float refstd = d_refstd[ind];
+    const float score = ((refstd >= STDTHRESH) && (std >= STDTHRESH)) ?
+                        (prodmean - d_refmean[ind] * mean) / (refstd * std) : 0.f;
+
+    const bool better = score > d_bestncc[ind];
+    if (better) {
+        d_bestncc[ind] = score;
+        d_depthmap[ind] = current_depth;
+    }
+#if SUBPLANE
+    float & last = d_subplane[ind];
+    float & prev = d_subplane[WIDTH * HEIGHT + ind];
+    float & next = d_subplane[2 * WIDTH * HEIGHT + ind];
+    if (better) {
+        prev = last;
+        next = SUBPLANE_PENDING;
+    }
+    else if (next == SUBPLANE_PENDING) next = score;
+    last = score;
+#endif
+}
+)";
+
+static const char * tvl1_source = R"(
+#define K ITERATIONS
+#define TW (BLOCK_X + 2 * K)
+#define TH (BLOCK_Y + 2 * K)
+#define TSIZE (TW * TH)
+
+extern "C" __global__ void __launch_bounds__(BLOCK_X * BLOCK_Y)
+denoising_TVL1_fused_jit(float * __restrict__ d_output, float * __restrict__ d_R,
+                         float * __restrict__ d_Px, float * __restrict__ d_Py,
+                         const float * __restrict__ d_input, const float * __restrict__ d_Rin,
+                         const float * __restrict__ d_Pxin, const float * __restrict__ d_Pyin,
+                         const float * __restrict__ d_origin,
+                         const float * __restrict__ d_T11, const float * __restrict__ d_T12,
+                         const float * __restrict__ d_T21, const float * __restrict__ d_T22,
+                         const float firstsigma)
+{
+    extern __shared__ float s_tile[];
+
+    const int x0 = BLOCK_X * blockIdx.x - K;
+    const int y0 = BLOCK_Y * blockIdx.y - K;
+
+    float * s_u = s_tile;
+    float * s_px = s_u + TSIZE;
+    float * s_py = s_px + TSIZE;
+    float * s_r = s_py + TSIZE;
+    float * s_t11 = s_r + TSIZE;
+    float * s_t12 = s_t11 + TSIZE;
+    float * s_t21 = s_t12 + TSIZE;
+    float * s_t22 = s_t21 + TSIZE;
+    float * s_origin = s_t22 + TSIZE;
+
+    for (int ty = threadIdx.y; ty < TH; ty += BLOCK_Y)
+        for (int tx = threadIdx.x; tx < TW; tx += BLOCK_X) {
+            const int gx = min(max(x0 + tx, 0), WIDTH - 1);
+            const int gy = min(max(y0 + ty, 0), HEIGHT - 1);
+            const int g = gy * WIDTH + gx;
+            const int t = ty * TW + tx;
+            s_u[t] = d_input[g];
+            s_px[t] = d_Pxin[g];
+            s_py[t] = d_Pyin[g];
+            s_r[t] = d_Rin[g];
+            s_t11[t] = d_T11[g];
+            s_t12[t] = d_T12[g];
+            s_t21[t] = d_T21[g];
+            s_t22[t] = d_T22[g];
+            s_origin[t] = d_origin[g];
+        }
+
+    __syncthreads();
+
+    for (int it = 0; it < K; it++) {
+        const double psigma = it == 0 ? firstsigma : SIGMA;
+
+        for (int ty = threadIdx.y; ty < TH; ty += BLOCK_Y)
+            for (int tx = threadIdx.x; tx < TW; tx += BLOCK_X) {
+                const int gx = x0 + tx, gy = y0 + ty;
+                if ((gx < 0) || (gy < 0) || (gx >= WIDTH) || (gy >= HEIGHT)) continue;
+
+                const int t = ty * TW + tx;
+                const int xn = ((gx + 1 < WIDTH) && (tx + 1 < TW)) ? t + 1 : t;
+                const int yn = ((gy + 1 < HEIGHT) && (ty + 1 < TH)) ? t + TW : t;
+
+                double x = s_u[xn] - s_u[t];
+                double y = s_u[yn] - s_u[t];
+                double dx = s_px[t] + psigma * (s_t11[t] * x + s_t12[t] * y);
+                double dy = s_py[t] + psigma * (s_t21[t] * x + s_t22[t] * y);
+                double d = fmaxf(1.f, sqrt(dx * dx + dy * dy));
+                s_px[t] = dx / d;
+                s_py[t] = dy / d;
+            }
+
+        __syncthreads();
+
+        for (int ty = threadIdx.y; ty < TH; ty += BLOCK_Y)
+            for (int tx = threadIdx.x; tx < TW; tx += BLOCK_X) {
+                const int gx = x0 + tx, gy = y0 + ty;
+                if ((gx < 0) || (gy < 0) || (gx >= WIDTH) || (gy >= HEIGHT)) continue;
+
+                const int t = ty * TW + tx;
+                const int yp = ((gy > 0) && (ty > 0)) ? t - TW : t;
+                double x_new;
+
+                s_r[t] += s_origin[t];
+                s_r[t] += SIGMA * s_u[t];
+                if (s_r[t] > LAMBDA) s_r[t] = LAMBDA;
+                if (s_r[t] < -LAMBDA) s_r[t] = -LAMBDA;
+
+                if ((gx == 0) || (tx == 0))
+                    x_new = s_u[t] + TAU*(s_py[t] - s_py[yp]) - TAU * s_r[t];
+                else
+                    x_new = s_u[t] + TAU*(s_px[t] - s_px[t - 1] + s_py[t] - s_py[yp]) - TAU * s_r[t];
+                s_u[t] = x_new + THETA*(x_new - s_u[t]);
+            }
+
+        __syncthreads();
+    }
+
+    const int ind_x = threadIdx.x + BLOCK_X * blockIdx.x;
+    const int ind_y = threadIdx.y + BLOCK_Y * blockIdx.y;
+
+    if ((ind_x < WIDTH) && (ind_y < HEIGHT)) {
+        const int g = ind_y * WIDTH + ind_x;
+        const int t = (threadIdx.y + K) * TW + threadIdx.x + K;
+        d_output[g] = s_u[t];
+        d_Px[g] = s_px[t];
+        d_Py[g] = s_py[t];
+        d_R[g] = s_r[t];
+    }
+}
+)";
+
+static const char * fusion_source = R"(
+struct mat3 { float m[9]; };
+struct vec3 { float x, y, z; };
+
+__device__ inline vec3 mul(const mat3 & a, const vec3 & v)
+{
+    vec3 r = {a.m[0] * v.x + a.m[1] * v.y + a.m[2] * v.z,
+              a.m[3] * v.x + a.m[4] * v.y + a.m[5] * v.z,
+              a.m[6] * v.x + a.m[7] * v.y + a.m[8] * v.z};
+    return r;
+}
+
+__device__ inline float lerp(const float a, const float b, const float t) { return a + t * (b - a); }
+
+extern "C" __global__ void
+FusionUpdateHistogram_jit(unsigned char * __restrict__ d_voxels, const float * __restrict__ depthmap,
+                          const mat3 K, const mat3 R, const vec3 T, const vec3 a, const vec3 extent)
+{
+    const int blockId = blockIdx.x + blockIdx.y * gridDim.x + gridDim.x * gridDim.y * blockIdx.z;
+    const int ix = blockId * (blockDim.x * blockDim.y * blockDim.z) + (threadIdx.z * (blockDim.x * blockDim.y)) +
+                   (threadIdx.y * blockDim.x) + threadIdx.x;
+    const int x = ix % VW, y = ix / VW % VH, z = ix / (VW * VH);
+    if ((x >= VW) || (y >= VH) || (z >= VD)) return;
+
+    // Voxel center in world, camera and pixel coordinates
+    const vec3 w = {a.x + extent.x * (float)((x + .5) / VW), a.y + extent.y * (float)((y + .5) / VH),
+                    a.z + extent.z * (float)((z + .5) / VD)};
+    vec3 c = mul(R, w);
+    c.x += T.x;
+    c.y += T.y;
+    c.z += T.z;
+    c = mul(K, c);
+    const float px = c.x / c.z, py = c.y / c.z;
+    if ((px < 0) || (px > WIDTH-1) || (py < 0) || (py > HEIGHT-1)) return;
+
+    const int x0 = fmaxf(floorf(px), 0), y0 = fmaxf(floorf(py), 0);
+    const int x1 = fminf(x0 + 1, WIDTH - 1), y1 = fminf(y0 + 1, HEIGHT - 1);
+    const float fx = px - floorf(px), fy = py - floorf(py);
+    const float l = lerp(depthmap[x0 + y0 * WIDTH], depthmap[x0 + y1 * WIDTH], fy);
+    const float r = lerp(depthmap[x1 + y0 * WIDTH], depthmap[x1 + y1 * WIDTH], fy);
+    const float depth = lerp(l, r, fx);
+    if (!isfinite(depth)) return;
+
+    // Same votes as fusionData::updateHist
+    unsigned char * bin = d_voxels + (size_t)z * SPITCH + (size_t)y * PITCH + (size_t)x * VOXEL_BYTES + HIST_OFFSET;
+    const float sd = depth - c.z;
+    const float thresh = BINS == 2 ? 0.f : THRESHOLD;
+    if (sd >= thresh) bin[BINS - 1]++;
+    else if (sd <= -thresh) bin[0]++;
+    else bin[(unsigned char)fminf(roundf((sd + thresh) / (2.f * thresh) * (BINS - 3) + 1), BINS - 2)]++;
+}
+)";
+
+// Exact decimal float constant for -D options
+static std::string literal(const float v)
+{
+    char s[32];
+    snprintf(s, sizeof(s), "%.9ef", v);
+    return s;
+}
+
+template<typename T>
+static std::string define(const char * name, const T & v)
+{
+    std::ostringstream s;
+    s << "-D" << name << "=" << v;
+    return s.str();
+}
+
+static std::string define(const char * name, const float v) { return std::string("-D") + name + "=" + literal(v); }
+
+// 64 bit FNV-1a of all parts of a configuration
+static std::string hash(const std::vector<std::string> & parts)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < parts.size(); i++) {
+        for (size_t j = 0; j <= parts[i].size(); j++) {
+            h ^= j < parts[i].size() ? (unsigned char)parts[i][j] : 0;
+            h *= 1099511628211ULL;
+        }
+    }
+    char s[17];
+    snprintf(s, sizeof(s), "%016llx", (unsigned long long)h);
+    return s;
+}
+
+KernelJit & KernelJit::instance()
+{
+    static KernelJit jit;
+    return jit;
+}
+
+KernelJit::KernelJit(const std::string & dir) : dir_(dir)
+{
+}
+
+bool KernelJit::available()
+{
+#ifdef NVRTC_FOUND
+    return true;
+#else
+    return false;
+#endif
+}
+
+void KernelJit::setCacheDir(const std::string & dir)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    dir_ = dir;
+}
+
+void KernelJit::forget()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    modules_.clear();
+}
+
+bool KernelJit::planesweepNCC(float * d_depthmap, float * d_bestncc, float * d_subplane, const float * d_src,
+                              const float * d_ref, const float * d_refmean, const float * d_refstd, const Matrix3D * d_h,
+                              const float current_depth, const unsigned int winsize, const float stdthresh,
+                              const int width, const int height, dim3 blocks, dim3 threads)
+{
+    if (!enabled_) return false;
+    const std::vector<std::string> options = {define("WIDTH", width), define("HEIGHT", height), define("WINSIZE", winsize),
+                                              define("BLOCK_X", threads.x), define("BLOCK_Y", threads.y),
+                                              define("STDTHRESH", stdthresh), define("SUBPLANE", d_subplane ? 1 : 0),
+                                              define("SUBPLANE_PENDING", SUBPLANE_PENDING)};
+    CUfunction f = function(planesweep_source, "planesweep_fused_NCC_jit", options);
+    if (!f) return false;
+
+    float current = current_depth;
+    void * args[] = {&d_depthmap, &d_bestncc, &d_subplane, &d_src, &d_ref, &d_refmean, &d_refstd, &d_h, &current};
+    return launch(f, blocks, threads, 0, args);
+}
+
+bool KernelJit::tvl1Fused(float * d_output, float * d_R, float * d_Px, float * d_Py, const float * d_input,
+                          const float * d_Rin, const float * d_Pxin, const float * d_Pyin, const float * d_origin,
+                          const float * d_T11, const float * d_T12, const float * d_T21, const float * d_T22,
+                          const float tau, const float theta, const float lambda, const float sigma, const float firstsigma,
+                          const unsigned int iterations, const int width, const int height, dim3 blocks, dim3 threads)
+{
+    if (!enabled_) return false;
+    const std::vector<std::string> options = {define("WIDTH", width), define("HEIGHT", height),
+                                              define("ITERATIONS", iterations), define("BLOCK_X", threads.x),
+                                              define("BLOCK_Y", threads.y), define("TAU", tau), define("THETA", theta),
+                                              define("LAMBDA", lambda), define("SIGMA", sigma)};
+    CUfunction f = function(tvl1_source, "denoising_TVL1_fused_jit", options);
+    if (!f) return false;
+
+    float first = firstsigma;
+    void * args[] = {&d_output, &d_R, &d_Px, &d_Py, &d_input, &d_Rin, &d_Pxin, &d_Pyin, &d_origin,
+                     &d_T11, &d_T12, &d_T21, &d_T22, &first};
+    const size_t shared = 9 * (threads.x + 2 * iterations) * (threads.y + 2 * iterations) * sizeof(float);
+#ifdef NVRTC_FOUND
+    if (cuFuncSetAttribute(f, CU_FUNC_ATTRIBUTE_MAX_DYNAMIC_SHARED_SIZE_BYTES, (int)shared) != CUDA_SUCCESS) return false;
+    return cuLaunchKernel(f, blocks.x, blocks.y, blocks.z, threads.x, threads.y, threads.z, (unsigned int)shared, 0,
+                          args, 0) == CUDA_SUCCESS;
+#else
+    (void)args;
+    (void)shared;
+    return false;
+#endif
+}
+
+bool KernelJit::fusionHistogram(void * d_voxels, size_t pitch, size_t spitch, size_t voxelbytes, size_t histoffset,
+                                int bins, int3 size, float3 a, float3 extent, const float * depthmap, const Matrix3D & K, const Matrix3D & R,
+                                const Vector3D & t, const float threshold, const int width, const int height,
+                                dim3 blocks, dim3 threads, cudaStream_t stream)
+{
+    if (!enabled_) return false;
+    const std::vector<std::string> options = {define("WIDTH", width), define("HEIGHT", height), define("BINS", bins),
+                                              define("VW", size.x), define("VH", size.y), define("VD", size.z),
+                                              define("PITCH", pitch), define("SPITCH", spitch), define("VOXEL_BYTES", voxelbytes),
+                                              define("HIST_OFFSET", histoffset),
+                                              define("THRESHOLD", threshold)};
+    CUfunction f = function(fusion_source, "FusionUpdateHistogram_jit", options);
+    if (!f) return false;
+
+    // Matrix3D rows and Vector3D are packed floats, same layout as mat3 and vec3 of the source
+    static_assert(sizeof(Matrix3D) == 9 * sizeof(float) && sizeof(Vector3D) == 3 * sizeof(float), "unexpected layout");
+    Matrix3D k = K, r = R;
+    Vector3D tv = t;
+    void * args[] = {&d_voxels, &depthmap, &k, &r, &tv, &a, &extent};
+    return launch(f, blocks, threads, stream, args);
+}
+
+CUfunction KernelJit::function(const char * source, const char * name, const std::vector<std::string> & options)
+{
+#ifdef NVRTC_FOUND
+    int dev = 0, major = 0, minor = 0, version[2] = {0, 0};
+    if (cudaGetDevice(&dev) != cudaSuccess) return 0;
+    cudaDeviceGetAttribute(&major, cudaDevAttrComputeCapabilityMajor, dev);
+    cudaDeviceGetAttribute(&minor, cudaDevAttrComputeCapabilityMinor, dev);
+    nvrtcVersion(&version[0], &version[1]);
+
+    std::vector<std::string> opts = options;
+    opts.push_back("--gpu-architecture=compute_" + std::to_string(major * 10 + minor));
+    std::vector<std::string> parts = opts;
+    parts.push_back(source);
+    parts.push_back(std::to_string(version[0]) + "." + std::to_string(version[1]));
+    const std::string h = hash(parts);
+    const std::string key = std::to_string(dev) + ":" + h;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (failed_.count(h)) return 0;
+
+    CUmodule module = 0;
+    auto it = modules_.find(key);
+    if (it != modules_.end()) module = it->second;
+    else {
+        // Runtime API has made the primary context of the device current, modules are loaded into it
+        std::string ptx, log;
+        const std::string fname = dir_.empty() ? std::string() : dir_ + "/" + h + ".ptx";
+        if (!fname.empty()) {
+            std::ifstream in(fname, std::ios::binary);
+            if (in) ptx.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        if (ptx.empty()) {
+            if (!compile(source, opts, ptx, log)) {
+                std::cerr << "JIT compilation of " << name << " failed, using static kernel\n" << log << std::endl;
+                failed_.insert(h);
+                return 0;
+            }
+
+            // Written under another name first, so concurrent processes never read partial files
+            if (!fname.empty() && QDir().mkpath(QString::fromStdString(dir_))) {
+                const std::string tmp = fname + "." + std::to_string(dev) + ".tmp";
+                std::ofstream out(tmp, std::ios::binary);
+                out.write(ptx.data(), ptx.size());
+                out.close();
+                if (!out || std::rename(tmp.c_str(), fname.c_str())) std::remove(tmp.c_str());
+            }
+        }
+
+        if ((cuInit(0) != CUDA_SUCCESS) || (cuModuleLoadData(&module, ptx.c_str()) != CUDA_SUCCESS)) {
+            std::cerr << "Loading JIT module of " << name << " failed, using static kernel" << std::endl;
+            failed_.insert(h);
+            return 0;
+        }
+        modules_[key] = module;
+    }
+
+    CUfunction f = 0;
+    if (cuModuleGetFunction(&f, module, name) != CUDA_SUCCESS) return 0;
+    return f;
+#else
+    (void)source;
+    (void)name;
+    (void)options;
+    return 0;
+#endif
+}
+
+bool KernelJit::compile(const char * source, const std::vector<std::string> & options, std::string & ptx, std::string & log)
+{
+#ifdef NVRTC_FOUND
+    nvrtcProgram prog;
+    if (nvrtcCreateProgram(&prog, source, "kernel_jit.cu", 0, 0, 0) != NVRTC_SUCCESS) return false;
+
+    std::vector<const char *> opts;
+    for (size_t i = 0; i < options.size(); i++) opts.push_back(options[i].c_str());
+    const nvrtcResult res = nvrtcCompileProgram(prog, (int)opts.size(), opts.data());
+
+    size_t size = 0;
+    nvrtcGetProgramLogSize(prog, &size);
+    log.assign(size, '\0');
+    if (size) nvrtcGetProgramLog(prog, &log[0]);
+
+    if (res == NVRTC_SUCCESS) {
+        nvrtcGetPTXSize(prog, &size);
+        ptx.assign(size, '\0');
+        nvrtcGetPTX(prog, &ptx[0]);
+    }
+    nvrtcDestroyProgram(&prog);
+    return res == NVRTC_SUCCESS;
+#else
+    (void)source;
+    (void)options;
+    (void)ptx;
+    (void)log;
+    return false;
+#endif
+}
+
+bool KernelJit::launch(CUfunction f, dim3 blocks, dim3 threads, cudaStream_t stream, void ** args)
+{
+#ifdef NVRTC_FOUND
+    // Runtime API streams are driver API streams, 0 is the legacy default stream of both
+    return cuLaunchKernel(f, blocks.x, blocks.y, blocks.z, threads.x, threads.y, threads.z, 0, (CUstream)stream,
+                          args, 0) == CUDA_SUCCESS;
+#else
+    (void)f;
+    (void)blocks;
+    (void)threads;
+    (void)stream;
+    (void)args;
+    return false;
+#endif
+}
@@ -1,5 +1,39 @@
 #include <kernels.cu.h>
 #include <helper_structs.h>
+#include <defines.h>
+#include <cuda_exception.h>
+#include <elementwise.h>
+#include <math_constants.h>
+#include <limits>
+#include <algorithm>
+
+__device__ inline int mirror_index(int k, const int size)
+{
+    // mirror index at array borders, same as windowed mean kernels
+    if (k < 0) k = -k;
+    if (k > size - 1) k = 2 * (size - 1) - k;
+    return min(max(k, 0), size - 1);
+}
+
+// Sub-plane state of a pixel is the score of the last swept plane and of the planes before and after the best one.
+// SUBPLANE_NONE marks planes that were not swept, SUBPLANE_PENDING the plane after the best one until it is swept.
+__device__ inline void subplane_step(float & last, float & prev, float & next, const float score, const bool better)
+{
+    if (better) {
+        prev = last;
+        next = SUBPLANE_PENDING;
+    }
+    else if (next == SUBPLANE_PENDING) next = score;
+    last = score;
+}
+
+// Vertex of the parabola through the scores of the best plane and its neighbours, in planes from the best one
+__device__ inline float subplane_offset(const float prev, const float best, const float next)
+{
+    if ((prev == SUBPLANE_NONE) || (next == SUBPLANE_NONE) || (next == SUBPLANE_PENDING)) return 0.f;
+    const float c = prev - 2 * best + next;
+    return c < 0 ? fminf(fmaxf(0.5f * (prev - next) / c, -0.5f), 0.5f) : 0.f;
+}
 
 __global__ void bilinear_interpolation_kernel_GPU(float * __restrict__ d_result, const float * __restrict__ d_data,
                                                   const float * __restrict__ d_xout, const float * __restrict__ d_yout,
@@ -28,6 +62,19 @@ __global__ void bilinear_interpolation_kernel_GPU(float * __restrict__ d_result,
     }
 }
 
+__global__ void bilinear_interpolation_texture_kernel(float * __restrict__ d_result, const cudaTextureObject_t tex,
+                                                     const float * __restrict__ d_xout, const float * __restrict__ d_yout,
+                                                     const int N1, const int N2)
+{
+    const int l = threadIdx.x + blockDim.x * blockIdx.x;
+    const int k = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((l<N1)&&(k<N2)) {
+        // texel centers are at index + 0.5
+        d_result[k*N1+l] = tex2D<float>(tex, d_xout[k*N1+l] + 0.5f, d_yout[k*N1+l] + 0.5f);
+    }
+}
+
 __global__ void transform_indexes_kernel(float * __restrict__ d_x, float * __restrict__ d_y,
                                          const Matrix3D h,
                                          const int width, const int height)
@@ -43,6 +90,21 @@ __global__ void transform_indexes_kernel(float * __restrict__ d_x, float * __res
     }
 }
 
+__global__ void transform_indexes_kernel(float * __restrict__ d_x, float * __restrict__ d_y,
+                                         const Matrix3D * __restrict__ d_h,
+                                         const int width, const int height)
+{
+    const int l = threadIdx.x + blockDim.x * blockIdx.x;
+    const int k = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((l < width) && (k < height)) {
+        float3 x = *d_h * make_float3(l+1, k+1, 1);
+        x = x / x.z - 1;
+        d_x[width * k + l] = x.x;
+        d_y[width * k + l] = x.y;
+    }
+}
+
 __global__ void calcNCC_kernel(float * __restrict__ d_ncc, const float * __restrict d_prod_mean,
                                const float * __restrict__ d_mean1, const float * __restrict__ d_mean2,
                                const float * __restrict__ d_std1, const float * __restrict__ d_std2,
@@ -64,6 +126,7 @@ __global__ void calcNCC_kernel(float * __restrict__ d_ncc, const float * __restr
 }
 
 __global__ void update_arrays_kernel(float * __restrict__ d_depthmap, float * __restrict__ d_bestncc,
+                                     float * __restrict__ d_subplane,
                                      const float * __restrict__ d_currentncc, const float current_depth,
                                      const int width, const int height)
 {
@@ -71,18 +134,22 @@ __global__ void update_arrays_kernel(float * __restrict__ d_depthmap, float * __
     const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
 
     if ((ind_x < width) && (ind_y < height)) {
-        const int ind = ind_y * width + ind_x;
+        const int ind = ind_y * width + ind_x, area = width * height;
 
         // Update if better correspondance was found
-        if (d_currentncc[ind] > d_bestncc[ind]){
+        const bool better = d_currentncc[ind] > d_bestncc[ind];
+        if (better){
             d_bestncc[ind] = d_currentncc[ind];
             d_depthmap[ind] = current_depth;
         }
+        if (d_subplane) subplane_step(d_subplane[ind], d_subplane[area + ind], d_subplane[2 * area + ind],
+                                      d_currentncc[ind], better);
     }
 }
 
 __global__ void sum_depthmap_NCC_kernel(float * __restrict__ d_depthmap_out, float * __restrict__ d_count,
                                         const float * __restrict__ d_depthmap, const float * __restrict__ d_ncc,
+                                        const float * __restrict__ d_subplane, const float step, const bool inverse,
                                         const float nccthreshold,
                                         const int width, const int height)
 {
@@ -90,69 +157,167 @@ __global__ void sum_depthmap_NCC_kernel(float * __restrict__ d_depthmap_out, flo
     const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
 
     if ((ind_x < width) && (ind_y < height)) {
-        const int ind = ind_y * width + ind_x;
+        const int ind = ind_y * width + ind_x, area = width * height;
 
         // Sum if NCC is above threshold
         if (d_ncc[ind] > nccthreshold){
-            d_depthmap_out[ind] += d_depthmap[ind];
+            float depth = d_depthmap[ind];
+
+            // Sub-plane fit moves the depth along the sampled parameter, depth or inverse depth
+            if (d_subplane) {
+                const float o = subplane_offset(d_subplane[area + ind], d_ncc[ind], d_subplane[2 * area + ind]) * step;
+                depth = inverse ? 1.f / (1.f / depth + o) : depth + o;
+            }
+            d_depthmap_out[ind] += depth;
             d_count[ind]++;
         }
     }
 }
 
-__global__ void calculate_STD_kernel(float * __restrict__ d_std, const float * __restrict__ d_mean,
-                                     const float * __restrict__ d_mean_of_squares,
-                                     const int width, const int height)
+// Operations of element wise wrappers, see elementwise.h
+struct CalculateSTDOp
 {
-    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
-    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+    static const int inputs = 2;
+    static const bool output = false;
+    __device__ inline float operator()(float, const float mean, const float sqmean) const
+    {
+        // variance (easy but numerically unstable method)
+        const float var = sqmean - mean * mean;
+        return var > 0 ? sqrt(var) : 0.f;
+    }
+};
 
-    if ((ind_x < width) && (ind_y < height)) {
-        const int ind = ind_y * width + ind_x;
+struct SetValueOp
+{
+    static const int inputs = 0;
+    static const bool output = false;
+    float value;
+    __device__ inline float operator()(float, float, float) const { return value; }
+};
 
-        // variance (easy but numerically unstable method)
-        float var = d_mean_of_squares[ind] - d_mean[ind] * d_mean[ind];
+struct MultiplyOp
+{
+    static const int inputs = 2;
+    static const bool output = false;
+    __device__ inline float operator()(float, const float a, const float b) const { return a * b; }
+};
 
-        // check for negative variance
-        if (var > 0) d_std[ind] = sqrt(var);
-        else d_std[ind] = 0.f;
-    }
-}
+struct RdivideOp
+{
+    static const int inputs = 2;
+    static const bool output = false;
+    float QNaN;
+    __device__ inline float operator()(float, const float a, const float b) const { return b != 0 ? a / b : QNaN; }
+};
 
-__global__ void set_value_kernel(float * __restrict__ d_output, const float value, const int width, const int height)
+struct ScaleOp
 {
-    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
-    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+    static const int inputs = 0;
+    static const bool output = true;
+    float scale;
+    __device__ inline float operator()(const float o, float, float) const { return o * scale; }
+};
 
-    if ((ind_x < width) && (ind_y < height)) {
-        const int ind = ind_y * width + ind_x;
-        d_output[ind] = value;
+struct AddValueOp
+{
+    static const int inputs = 0;
+    static const bool output = true;
+    float value;
+    __device__ inline float operator()(const float o, float, float) const { return o + value; }
+};
+
+struct AddOp
+{
+    static const int inputs = 1;
+    static const bool output = true;
+    __device__ inline float operator()(const float o, const float a, float) const { return o + a; }
+};
+
+struct ReplaceQNANValueOp
+{
+    static const int inputs = 0;
+    static const bool output = true;
+    float value;
+    __device__ inline float operator()(const float o, float, float) const { return o != o ? value : o; }
+};
+
+struct ReplaceQNANOp
+{
+    static const int inputs = 1;
+    static const bool output = true;
+    __device__ inline float operator()(const float o, const float fill, float) const { return o != o ? fill : o; }
+};
+
+struct ValidOp
+{
+    static const int inputs = 1;
+    static const bool output = false;
+    __device__ inline float operator()(float, const float count, float) const { return count > 0.f ? 1.f : 0.f; }
+};
+
+struct ValidMaskedOp
+{
+    static const int inputs = 2;
+    static const bool output = false;
+    __device__ inline float operator()(float, const float count, const float mask) const
+    {
+        return (count > 0.f) && (mask > 0.f) ? 1.f : 0.f;
     }
-}
+};
 
-__global__ void element_multiply_kernel(float * __restrict__ d_output, const float * __restrict__ d_input1,
-                                        const float * __restrict__ d_input2,
-                                        const int width, const int height)
+struct ConfidenceOp
 {
-    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
-    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+    static const int inputs = 1;
+    static const bool output = false;
+    float scale;
+    __device__ inline float operator()(float, const float count, float) const { return fminf(count * scale, 1.f); }
+};
 
-    if ((ind_x < width) && (ind_y < height)) {
-        d_output[ind_x+ind_y*width] = d_input1[ind_x+ind_y*width] * d_input2[ind_x+ind_y*width];
+struct QNANMaskedOp
+{
+    static const int inputs = 1;
+    static const bool output = true;
+    float threshold;
+    __device__ inline float operator()(const float o, const float valid, float) const
+    {
+        return (valid <= 0.f) || (valid < threshold) ? CUDART_NAN_F : o;
     }
-}
+};
 
-__global__ void element_rdivide_kernel(float * __restrict__ d_output, const float * __restrict__ d_input1,
-                                       const float * __restrict__ d_input2,
-                                       const int width, const int height, const float QNaN)
+__global__ void relative_change_kernel(float * __restrict__ d_sums, const float * __restrict__ d_u,
+                                       const float * __restrict__ d_uprev, const int width, const int height)
 {
+    extern __shared__ float s_sums[];
+
     const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
     const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+    const int tid = threadIdx.y * blockDim.x + threadIdx.x;
+    const int n = blockDim.x * blockDim.y;
 
+    float diff = 0.f, norm = 0.f;
     if ((ind_x < width) && (ind_y < height)) {
         const int ind = ind_y * width + ind_x;
-        if (d_input2[ind] != 0) d_output[ind] = d_input1[ind] / d_input2[ind];
-        else d_output[ind] = QNaN;
+        const float d = d_u[ind] - d_uprev[ind];
+        diff = d * d;
+        norm = d_u[ind] * d_u[ind];
+    }
+    s_sums[tid] = diff;
+    s_sums[n + tid] = norm;
+
+    __syncthreads();
+
+    // tree reduction over block, block size does not have to be a power of 2
+    for (int stride = 1; stride < n; stride *= 2) {
+        if ((tid % (2 * stride) == 0) && (tid + stride < n)) {
+            s_sums[tid] += s_sums[tid + stride];
+            s_sums[n + tid] += s_sums[n + tid + stride];
+        }
+        __syncthreads();
+    }
+
+    if (tid == 0) {
+        atomicAdd(d_sums, s_sums[0]);
+        atomicAdd(d_sums + 1, s_sums[n]);
     }
 }
 
@@ -234,8 +399,240 @@ __global__ void windowed_mean_column_kernel(float * __restrict__ d_output, const
     }
 }
 
+// Box filter instances for fixed window sizes, the tap loop is unrolled and squared is resolved at compile time.
+// Taps are summed in the same order as by the generic kernels, so results are bit identical.
+template<unsigned int W, bool S>
+__global__ void windowed_mean_row_fixed_kernel(float * __restrict__ d_output, const float * __restrict__ d_input,
+                                               const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int ind = ind_y * width + ind_x;
+        const int n = W / 2;
+
+        float mean = 0.f;
+        #pragma unroll
+        for (int i = -n; i <= n; i++){
+            int k = ind_x + i;
+            if (k < 0) k = -k;
+            if (k > width - 1) k = 2 * (width - 1) - k;
+            const float v = d_input[ind_y * width + k];
+            if (S) mean += v * v;
+            else mean += v;
+        }
+        d_output[ind] = mean / (float)W;
+    }
+}
+
+template<unsigned int W, bool S>
+__global__ void windowed_mean_column_fixed_kernel(float * __restrict__ d_output, const float * __restrict__ d_input,
+                                                  const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int ind = ind_y * width + ind_x;
+        const int n = W / 2;
+
+        float mean = 0.f;
+        #pragma unroll
+        for (int i = -n; i <= n; i++){
+            int k = ind_y + i;
+            if (k < 0) k = -k;
+            if (k > height - 1) k = 2 * (height - 1) - k;
+            const float v = d_input[k * width + ind_x];
+            if (S) mean += v * v;
+            else mean += v;
+        }
+        d_output[ind] = mean / (float)W;
+    }
+}
+
+typedef void (*windowed_mean_fixed_type)(float *, const float *, const int, const int);
+
+// Specialized box filter instances of common window sizes, null for other sizes
+static windowed_mean_fixed_type windowed_mean_row_instance(const unsigned int winsize, const bool squared)
+{
+    switch (winsize) {
+    case 3:  if (squared) return windowed_mean_row_fixed_kernel<3, true>;
+             return windowed_mean_row_fixed_kernel<3, false>;
+    case 5:  if (squared) return windowed_mean_row_fixed_kernel<5, true>;
+             return windowed_mean_row_fixed_kernel<5, false>;
+    case 7:  if (squared) return windowed_mean_row_fixed_kernel<7, true>;
+             return windowed_mean_row_fixed_kernel<7, false>;
+    case 9:  if (squared) return windowed_mean_row_fixed_kernel<9, true>;
+             return windowed_mean_row_fixed_kernel<9, false>;
+    case 11: if (squared) return windowed_mean_row_fixed_kernel<11, true>;
+             return windowed_mean_row_fixed_kernel<11, false>;
+    case 15: if (squared) return windowed_mean_row_fixed_kernel<15, true>;
+             return windowed_mean_row_fixed_kernel<15, false>;
+    default: return 0;
+    }
+}
+
+static windowed_mean_fixed_type windowed_mean_column_instance(const unsigned int winsize, const bool squared)
+{
+    switch (winsize) {
+    case 3:  if (squared) return windowed_mean_column_fixed_kernel<3, true>;
+             return windowed_mean_column_fixed_kernel<3, false>;
+    case 5:  if (squared) return windowed_mean_column_fixed_kernel<5, true>;
+             return windowed_mean_column_fixed_kernel<5, false>;
+    case 7:  if (squared) return windowed_mean_column_fixed_kernel<7, true>;
+             return windowed_mean_column_fixed_kernel<7, false>;
+    case 9:  if (squared) return windowed_mean_column_fixed_kernel<9, true>;
+             return windowed_mean_column_fixed_kernel<9, false>;
+    case 11: if (squared) return windowed_mean_column_fixed_kernel<11, true>;
+             return windowed_mean_column_fixed_kernel<11, false>;
+    case 15: if (squared) return windowed_mean_column_fixed_kernel<15, true>;
+             return windowed_mean_column_fixed_kernel<15, false>;
+    default: return 0;
+    }
+}
+
+// Shared memory index with one padding word per 32 elements, so threads sliding over consecutive segments of 32
+// elements hit different banks
+__device__ inline int sliding_index(const int i)
+{
+    return i + i / 32;
+}
+
+__global__ void windowed_mean_row_sliding_kernel(float * __restrict__ d_output, const float * __restrict__ d_input,
+                                                 const unsigned int winsize, const bool squared, const int segment,
+                                                 const int width, const int height)
+{
+    extern __shared__ float s_rows[];
+
+    // Each row of the block covers blockDim.x segments, staged with a halo of n elements on both sides
+    const int n = winsize / 2;
+    const int span = blockDim.x * segment;
+    const int x0 = span * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+    const int instride = sliding_index(span + 2 * n) + 1, outstride = sliding_index(span) + 1;
+    float * s_in = s_rows + threadIdx.y * instride;
+    float * s_out = s_rows + blockDim.y * instride + threadIdx.y * outstride;
+    const bool valid = ind_y < height;
+
+    // Consecutive threads read consecutive elements of the row, squares are taken once per element
+    if (valid) {
+        const float * row = d_input + ind_y * width;
+        for (int i = threadIdx.x; i <= span + 2 * n; i += blockDim.x) {
+            const float v = row[mirror_index(x0 - n + i, width)];
+            s_in[sliding_index(i)] = squared ? v * v : v;
+        }
+    }
+    __syncthreads();
+
+    const int s0 = threadIdx.x * segment;
+    if (valid && (x0 + s0 < width)) {
+        const int s1 = min(s0 + segment, width - x0);
+        float sum = 0.f;
+
+        // full window only for the first element of the segment
+        for (int i = 0; i <= 2 * n; i++) sum += s_in[sliding_index(s0 + i)];
+
+        // then slide the window: add entering, subtract leaving element
+        for (int s = s0; s < s1; s++){
+            s_out[sliding_index(s)] = sum / (float)winsize;
+            sum += s_in[sliding_index(s + 2 * n + 1)];
+            sum -= s_in[sliding_index(s)];
+        }
+    }
+    __syncthreads();
+
+    // Means are written back row by row with consecutive threads on consecutive elements
+    if (valid) {
+        const int count = min(span, width - x0);
+        for (int i = threadIdx.x; i < count; i += blockDim.x) d_output[ind_y * width + x0 + i] = s_out[sliding_index(i)];
+    }
+}
+
+__global__ void windowed_mean_column_sliding_kernel(float * __restrict__ d_output, const float * __restrict__ d_input,
+                                                    const unsigned int winsize, const bool squared, const int segment,
+                                                    const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_s = threadIdx.y + blockDim.y * blockIdx.y;
+    const int y0 = ind_s * segment;
+
+    if ((ind_x < width) && (y0 < height)) {
+        const int n = winsize / 2;
+        const int y1 = min(y0 + segment, height);
+        float v, sum = 0.f;
+
+        // full window only for the first element of the segment
+        for (int i = -n; i <= n; i++){
+            v = d_input[mirror_index(y0 + i, height) * width + ind_x];
+            sum += squared ? v * v : v;
+        }
+
+        // then slide the window: add entering, subtract leaving element
+        for (int y = y0; y < y1; y++){
+            d_output[y * width + ind_x] = sum / (float)winsize;
+            v = d_input[mirror_index(y + n + 1, height) * width + ind_x];
+            sum += squared ? v * v : v;
+            v = d_input[mirror_index(y - n, height) * width + ind_x];
+            sum -= squared ? v * v : v;
+        }
+    }
+}
+
 __global__ void convert_uchar_to_float_kernel(float * __restrict__ d_output, const unsigned char * __restrict__ d_input,
-                                              const int width, const int height)
+                                              const float scale, const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int ind = ind_y * width + ind_x;
+
+        d_output[ind] = scale * d_input[ind];
+    }
+}
+
+__global__ void convert_rgba_to_gray_kernel(float * __restrict__ d_output, float * __restrict__ d_normalized,
+                                            const uchar4 * __restrict__ d_input, const float scale,
+                                            const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int ind = ind_y * width + ind_x;
+
+        // QImage::Format_RGB32 byte order on little endian hosts is B, G, R, A
+        const uchar4 c = d_input[ind];
+        const float gray = RGB2GRAY_WEIGHT_RED * c.z + RGB2GRAY_WEIGHT_GREEN * c.y + RGB2GRAY_WEIGHT_BLUE * c.x;
+
+        d_output[ind] = scale * gray;
+        if (d_normalized) d_normalized[ind] = gray * (1.f / 255.f);
+    }
+}
+
+__global__ void project_points_depth_kernel(unsigned int * __restrict__ d_zbuf, const float4 * __restrict__ d_points,
+                                            const int npoints, const Matrix4D T, const Matrix3D K, const float zmin,
+                                            const int width, const int height)
+{
+    const int i = threadIdx.x + blockDim.x * blockIdx.x;
+
+    if (i < npoints) {
+        const float4 p = d_points[i];
+        const float4 c = T * make_float4(p.x, p.y, p.z, 1.f);
+        if (c.z <= zmin) return;
+
+        const float3 uv = K * make_float3(c.x / c.z, c.y / c.z, 1.f);
+        const int x = __float2int_rn(uv.x), y = __float2int_rn(uv.y);
+        if ((x < 0) || (x >= width) || (y < 0) || (y >= height)) return;
+
+        // bit patterns of positive floats order the same as the floats, nearest point wins
+        atomicMin(d_zbuf + y * width + x, __float_as_uint(c.z));
+    }
+}
+
+__global__ void resolve_depth_kernel(float * __restrict__ d_depth, float * __restrict__ d_w,
+                                     const int width, const int height)
 {
     const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
     const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
@@ -243,7 +640,43 @@ __global__ void convert_uchar_to_float_kernel(float * __restrict__ d_output, con
     if ((ind_x < width) && (ind_y < height)) {
         const int ind = ind_y * width + ind_x;
 
-        d_output[ind] = d_input[ind];
+        // z-buffer is converted in place, untouched pixels still hold the cleared bit pattern
+        const unsigned int z = __float_as_uint(d_depth[ind]);
+        const bool hit = z != 0xffffffffu;
+        d_depth[ind] = hit ? __uint_as_float(z) : 0.f;
+        if (d_w) d_w[ind] = hit ? 1.f : 0.f;
+    }
+}
+
+__global__ void depth_to_points_kernel(unsigned char * __restrict__ d_points, const int stride, const int coloroffset,
+                                       const float * __restrict__ d_depth, const uchar4 * __restrict__ d_color,
+                                       const float * __restrict__ d_gray, const Matrix3D invK,
+                                       const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int ind = ind_y * width + ind_x;
+        const float z = d_depth[ind];
+
+        // same back-projection as the viewers used on the host, z flips with the sign of the y focal length
+        const float4 p = make_float4(z * (invK.r[0].x * ind_x + invK.r[0].y * ind_y + invK.r[0].z),
+                                     z * (invK.r[1].x * ind_x + invK.r[1].y * ind_y + invK.r[1].z),
+                                     invK.r[1].y < 0 ? -z : z, 1.f);
+        unsigned char * pt = d_points + (size_t)ind * stride;
+        *(float4 *)pt = p;
+
+        unsigned int rgba = 0xff000000u;
+        if (d_color) {
+            const uchar4 c = d_color[ind];
+            rgba |= ((unsigned int)c.z << 16) | ((unsigned int)c.y << 8) | c.x;
+        }
+        else if (d_gray) {
+            const unsigned int g = min(max(__float2int_rn(d_gray[ind]), 0), 255);
+            rgba |= (g << 16) | (g << 8) | g;
+        }
+        *(unsigned int *)(pt + coloroffset) = rgba;
     }
 }
 
@@ -306,36 +739,46 @@ __global__ void denoising_TVL1_calculateP_tensor_weighed_kernel(float * __restri
     }
 }
 
-__global__ void element_scale_kernel(float * __restrict__ d_output, const float scale, const int width, const int height)
+__global__ void depthmap_forward_warp_kernel(float * __restrict__ d_output, const float * __restrict__ d_depth,
+                                             const Matrix3D Rrel, const Vector3D trel,
+                                             const Matrix3D K, const Matrix3D invK,
+                                             const float zmin, const float zmax,
+                                             const int width, const int height)
 {
     const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
     const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
 
     if ((ind_x < width) && (ind_y < height)) {
-        const int ind = ind_y * width + ind_x;
-        d_output[ind] = d_output[ind] * scale;
-    }
-}
+        const float z = d_depth[ind_y * width + ind_x];
+        if (!(z > zmin) || !(z < zmax)) return;
 
-__global__ void element_add_kernel(float * __restrict__ d_output, const float value, const int width, const int height)
-{
-    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
-    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+        // Points leaving the depth range have no prediction
+        const float3 X = Rrel * (z * invK * make_float3(ind_x + 1, ind_y + 1, 1)) + trel;
+        if (!(X.z > zmin) || !(X.z < zmax)) return;
+        float3 x = K * X;
+        x = x / x.z - 1;
 
-    if ((ind_x < width) && (ind_y < height)) {
-        const int ind = ind_y * width + ind_x;
-        d_output[ind] += value;
+        // Splat onto the 4 nearest pixels so magnified surfaces leave no holes, nearest depth wins. Positive floats
+        // order like their bit patterns, so the z-buffer is updated with integer atomics
+        const int x0 = floorf(x.x), y0 = floorf(x.y);
+        const unsigned int zb = __float_as_uint(X.z);
+        for (int j = 0; j <= 1; j++)
+            for (int i = 0; i <= 1; i++) {
+                const int xi = x0 + i, yi = y0 + j;
+                if ((xi < 0) || (yi < 0) || (xi > width - 1) || (yi > height - 1)) continue;
+                atomicMin(reinterpret_cast<unsigned int *>(d_output) + yi * width + xi, zb);
+            }
     }
 }
 
-__global__ void set_QNAN_value_kernel(float * __restrict__ d_output, const float value, const int width, const int height)
+__global__ void depthmap_forward_warp_finish_kernel(float * __restrict__ d_output, const int width, const int height)
 {
     const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
     const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
 
     if ((ind_x < width) && (ind_y < height)) {
         const int ind = ind_y * width + ind_x;
-        if (d_output[ind] != d_output[ind]) d_output[ind] = value;
+        if (isinf(d_output[ind])) d_output[ind] = CUDART_NAN_F;
     }
 }
 
@@ -369,6 +812,120 @@ __global__ void denoising_TVL1_update_kernel(float * __restrict__ d_output, floa
     }
 }
 
+__global__ void denoising_TVL1_fused_kernel(float * __restrict__ d_output, float * __restrict__ d_R,
+                                            float * __restrict__ d_Px, float * __restrict__ d_Py,
+                                            const float * __restrict__ d_input, const float * __restrict__ d_Rin,
+                                            const float * __restrict__ d_Pxin, const float * __restrict__ d_Pyin,
+                                            const float * __restrict__ d_origin,
+                                            const float * __restrict__ d_T11, const float * __restrict__ d_T12,
+                                            const float * __restrict__ d_T21, const float * __restrict__ d_T22,
+                                            const float tau, const float theta, const float lambda,
+                                            const float sigma, const float firstsigma, const unsigned int iterations,
+                                            const int width, const int height)
+{
+    extern __shared__ float s_tile[];
+
+    // Tile covers block with a halo of one pixel per iteration, values in the halo become invalid
+    // one pixel per iteration from the tile edge, so block interior is exact after all iterations. State is read from
+    // the input arrays and written to the output arrays, so halos never see values of other blocks of the same launch
+    const int k = iterations;
+    const int tw = blockDim.x + 2 * k;
+    const int th = blockDim.y + 2 * k;
+    const int tsize = tw * th;
+    const int x0 = blockDim.x * blockIdx.x - k;
+    const int y0 = blockDim.y * blockIdx.y - k;
+
+    float * s_u = s_tile;
+    float * s_px = s_u + tsize;
+    float * s_py = s_px + tsize;
+    float * s_r = s_py + tsize;
+    float * s_t11 = s_r + tsize;
+    float * s_t12 = s_t11 + tsize;
+    float * s_t21 = s_t12 + tsize;
+    float * s_t22 = s_t21 + tsize;
+    float * s_origin = s_t22 + tsize;
+
+    for (int ty = threadIdx.y; ty < th; ty += blockDim.y)
+        for (int tx = threadIdx.x; tx < tw; tx += blockDim.x) {
+            const int gx = min(max(x0 + tx, 0), width - 1);
+            const int gy = min(max(y0 + ty, 0), height - 1);
+            const int g = gy * width + gx;
+            const int t = ty * tw + tx;
+            s_u[t] = d_input[g];
+            s_px[t] = d_Pxin[g];
+            s_py[t] = d_Pyin[g];
+            s_r[t] = d_Rin[g];
+            s_t11[t] = d_T11[g];
+            s_t12[t] = d_T12[g];
+            s_t21[t] = d_T21[g];
+            s_t22[t] = d_T22[g];
+            s_origin[t] = d_origin[g];
+        }
+
+    __syncthreads();
+
+    for (int it = 0; it < k; it++) {
+        const double psigma = it == 0 ? firstsigma : sigma;
+
+        // dual update, same as denoising_TVL1_calculateP_tensor_weighed
+        for (int ty = threadIdx.y; ty < th; ty += blockDim.y)
+            for (int tx = threadIdx.x; tx < tw; tx += blockDim.x) {
+                const int gx = x0 + tx, gy = y0 + ty;
+                if ((gx < 0) || (gy < 0) || (gx >= width) || (gy >= height)) continue;
+
+                const int t = ty * tw + tx;
+                const int xn = ((gx + 1 < width) && (tx + 1 < tw)) ? t + 1 : t;
+                const int yn = ((gy + 1 < height) && (ty + 1 < th)) ? t + tw : t;
+
+                double x = s_u[xn] - s_u[t];
+                double y = s_u[yn] - s_u[t];
+                double dx = s_px[t] + psigma * (s_t11[t] * x + s_t12[t] * y);
+                double dy = s_py[t] + psigma * (s_t21[t] * x + s_t22[t] * y);
+                double d = fmaxf(1.f, sqrt(dx * dx + dy * dy));
+                s_px[t] = dx / d;
+                s_py[t] = dy / d;
+            }
+
+        __syncthreads();
+
+        // primal update, same as denoising_TVL1_update
+        for (int ty = threadIdx.y; ty < th; ty += blockDim.y)
+            for (int tx = threadIdx.x; tx < tw; tx += blockDim.x) {
+                const int gx = x0 + tx, gy = y0 + ty;
+                if ((gx < 0) || (gy < 0) || (gx >= width) || (gy >= height)) continue;
+
+                const int t = ty * tw + tx;
+                const int yp = ((gy > 0) && (ty > 0)) ? t - tw : t;
+                double x_new;
+
+                s_r[t] += s_origin[t];
+                s_r[t] += sigma * s_u[t];
+                if (s_r[t] > lambda) s_r[t] = lambda;
+                if (s_r[t] < -lambda) s_r[t] = -lambda;
+
+                if ((gx == 0) || (tx == 0))
+                    x_new = s_u[t] + tau*(s_py[t] - s_py[yp]) - tau * s_r[t];
+                else
+                    x_new = s_u[t] + tau*(s_px[t] - s_px[t - 1] + s_py[t] - s_py[yp]) - tau * s_r[t];
+                s_u[t] = x_new + theta*(x_new - s_u[t]);
+            }
+
+        __syncthreads();
+    }
+
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int g = ind_y * width + ind_x;
+        const int t = (threadIdx.y + k) * tw + threadIdx.x + k;
+        d_output[g] = s_u[t];
+        d_Px[g] = s_px[t];
+        d_Py[g] = s_py[t];
+        d_R[g] = s_r[t];
+    }
+}
+
 __global__ void denoising_TVL1_update_tensor_weighed_kernel(float * __restrict__ d_output, float * __restrict__ d_R,
                                                             const float * d_Px, const float * d_Py, const float * __restrict__ d_origin,
                                                             const float * __restrict__ d_T11, const float * __restrict__ d_T12,
@@ -428,43 +985,1044 @@ __global__ void compute3D_kernel(float * __restrict__ d_x, float * __restrict__
     }
 }
 
-void transform_indexes(float * d_x, float *  d_y,
-                       const Matrix3D h,
-                       const int width, const int height, dim3 blocks, dim3 threads)
+// Source view samplers for fused planesweep step, both return 0 outside of the image
+// Conversion of reduced precision source storage to float, all arithmetic is done in float
+__device__ inline float load_float(const float v) { return v; }
+__device__ inline float load_float(const __half v) { return __half2float(v); }
+__device__ inline float load_float(const unsigned char v) { return (float)v; }
+
+template<typename S = float>
+struct LinearMemorySampler
 {
-    transform_indexes_kernel<<<blocks, threads>>>(d_x, d_y,
-                                                  h,
-                                                  width, height);
-}
+    const S * d_data;
+    int width, height;
 
-void bilinear_interpolation(float * d_result, const float * d_data,
-                            const float * d_xout, const float * d_yout,
-                            const int M1, const int M2, const int N1, const int N2,
-                            dim3 blocks, dim3 threads)
+    __device__ inline float operator()(const float x, const float y) const
+    {
+        const int   ix = floor(x);
+        const float a  = x - ix;
+        const int   iy = floor(y);
+        const float b  = y - iy;
+
+        if ((ix < 0) || (iy < 0) || (iy+1 > height-1) || (ix+1 > width-1)) return 0.f;
+
+        const float r1 = a * load_float(d_data[iy*width+ix+1]) + (1 - a) * load_float(d_data[iy*width+ix]);
+        const float r2 = a * load_float(d_data[(iy+1)*width+ix+1]) + (1 - a) * load_float(d_data[(iy+1)*width+ix]);
+        return b * r2 + (1 - b) * r1;
+    }
+};
+
+template<typename S>
+__global__ void bilinear_interpolation_lowp_kernel(float * __restrict__ d_result, const S * __restrict__ d_data,
+                                                   const float * __restrict__ d_xout, const float * __restrict__ d_yout,
+                                                   const int M1, const int M2, const int N1, const int N2)
 {
-    bilinear_interpolation_kernel_GPU<<<blocks, threads>>>(d_result, d_data, d_xout, d_yout, M1, M2, N1, N2);
+    const int l = threadIdx.x + blockDim.x * blockIdx.x;
+    const int k = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((l<N1)&&(k<N2)) {
+        const LinearMemorySampler<S> src = {d_data, M1, M2};
+        d_result[k*N1+l] = src(d_xout[k*N1+l], d_yout[k*N1+l]);
+    }
 }
 
-void calcNCC(float * d_ncc, const float * d_prod_mean,
-             const float * d_mean1, const float * d_mean2,
-             const float * d_std1, const float * d_std2,
-             const float stdthresh1, const float stdthresh2,
-             const int width, const int height,
-             dim3 blocks, dim3 threads)
+__global__ void convert_float_to_half_kernel(__half * __restrict__ d_output, const float * __restrict__ d_input,
+                                             const int width, const int height)
 {
-    calcNCC_kernel<<<blocks, threads>>>(d_ncc, d_prod_mean,
-                                        d_mean1, d_mean2,
-                                        d_std1, d_std2,
-                                        stdthresh1, stdthresh2,
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int ind = ind_y * width + ind_x;
+
+        d_output[ind] = __float2half(d_input[ind]);
+    }
+}
+
+__global__ void quantize_float_to_uchar_kernel(unsigned char * __restrict__ d_output, const float * __restrict__ d_input,
+                                               const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int ind = ind_y * width + ind_x;
+
+        d_output[ind] = (unsigned char)fminf(fmaxf(rintf(d_input[ind]), 0.f), (float)UCHAR_MAX);
+    }
+}
+
+struct TextureSampler
+{
+    cudaTextureObject_t tex;
+
+    __device__ inline float operator()(const float x, const float y) const
+    {
+        // texel centers are at index + 0.5
+        return tex2D<float>(tex, x + 0.5f, y + 0.5f);
+    }
+};
+
+// Pixel masks for fused planesweep step, pixels outside of the mask keep their depth and best NCC. block() returns the
+// tile of the frame the block works on
+struct AllPixels
+{
+    __device__ inline int2 block() const { return make_int2(blockIdx.x, blockIdx.y); }
+    __device__ inline bool operator()(const int) const { return true; }
+};
+
+struct PlaneBand
+{
+    const int * d_planemin;
+    const int * d_planemax;
+    int plane;
+
+    __device__ inline int2 block() const { return make_int2(blockIdx.x, blockIdx.y); }
+    __device__ inline bool operator()(const int ind) const { return (plane >= d_planemin[ind]) && (plane <= d_planemax[ind]); }
+};
+
+// Compacted list of tiles with valid pixels, one block per listed tile
+struct ActiveTiles
+{
+    const int2 * d_tiles;
+    const float * d_valid;
+
+    __device__ inline int2 block() const { return d_tiles[blockIdx.x]; }
+    __device__ inline bool operator()(const int ind) const { return d_valid[ind] > 0.f; }
+};
+
+// Matching cost policies of fused planesweep step. load() fills the shared tiles at a warped position, score() returns
+// the similarity of the window around a pixel, larger is better, so the best score and depth are kept per pixel
+template<typename Sampler>
+struct NCCCost
+{
+    Sampler src;
+    const float * d_ref;
+    const float * d_refmean;
+    const float * d_refstd;
+    float stdthresh;
+
+    __device__ inline void load(float & warped, float & ref, const float x, const float y, const int gind) const
+    {
+        warped = src(x, y);
+        ref = d_ref[gind];
+    }
+
+    __device__ inline float score(const float * s_warped, const float * s_ref, const int tw,
+                                  const unsigned int winsize, const int ind) const
+    {
+        const int n = winsize / 2;
+        float mean = 0.f, sqmean = 0.f, prodmean = 0.f;
+        for (int j = 0; j <= 2 * n; j++) {
+            const int row = (threadIdx.y + j) * tw + threadIdx.x;
+            for (int i = 0; i <= 2 * n; i++) {
+                const float w = s_warped[row + i];
+                mean += w;
+                sqmean += w * w;
+                prodmean += w * s_ref[row + i];
+            }
+        }
+
+        const float norm = 1.f / (float)(winsize * winsize);
+        mean *= norm;
+        sqmean *= norm;
+        prodmean *= norm;
+
+        // variance (easy but numerically unstable method)
+        const float var = sqmean - mean * mean;
+        const float std = var > 0 ? sqrt(var) : 0.f;
+
+        // If either STD is below threshold, set NCC to 0
+        if ((d_refstd[ind] >= stdthresh) && (std >= stdthresh))
+            return (prodmean - d_refmean[ind] * mean) / (d_refstd[ind] * std);
+        return 0.f;
+    }
+};
+
+template<typename Sampler>
+struct SADCost
+{
+    Sampler src;
+    const float * d_ref;
+
+    __device__ inline void load(float & warped, float & ref, const float x, const float y, const int gind) const
+    {
+        warped = src(x, y);
+        ref = d_ref[gind];
+    }
+
+    __device__ inline float score(const float * s_warped, const float * s_ref, const int tw,
+                                  const unsigned int winsize, const int) const
+    {
+        const int n = winsize / 2;
+        float sad = 0.f;
+        for (int j = 0; j <= 2 * n; j++) {
+            const int row = (threadIdx.y + j) * tw + threadIdx.x;
+            for (int i = 0; i <= 2 * n; i++) sad += fabsf(s_warped[row + i] - s_ref[row + i]);
+        }
+
+        // mean absolute difference of 8 bit intensities mapped to [0, 1]
+        return 1.f - sad / (float)(winsize * winsize * UCHAR_MAX);
+    }
+};
+
+struct CensusCost
+{
+    const unsigned long long * d_src;
+    const unsigned long long * d_ref;
+    int width, height;
+
+    // Hamming distance to the nearest source descriptor is kept in the warped tile, the reference tile is unused
+    __device__ inline void load(float & warped, float & ref, const float x, const float y, const int gind) const
+    {
+        const int ix = __float2int_rn(x);
+        const int iy = __float2int_rn(y);
+        ref = 0.f;
+        if ((ix < 0) || (iy < 0) || (ix > width - 1) || (iy > height - 1)) warped = CENSUS_BITS;
+        else warped = __popcll(d_src[iy * width + ix] ^ d_ref[gind]);
+    }
+
+    __device__ inline float score(const float * s_warped, const float *, const int tw,
+                                  const unsigned int winsize, const int) const
+    {
+        const int n = winsize / 2;
+        float hamming = 0.f;
+        for (int j = 0; j <= 2 * n; j++) {
+            const int row = (threadIdx.y + j) * tw + threadIdx.x;
+            for (int i = 0; i <= 2 * n; i++) hamming += s_warped[row + i];
+        }
+        return 1.f - hamming / (float)(winsize * winsize * CENSUS_BITS);
+    }
+};
+
+// Warp tile of the block and its halo into shared memory, halo values are taken at mirrored coordinates
+// so results match separable windowed mean kernels
+template<typename Cost>
+__device__ inline void planesweep_load_tile(float * s_warped, float * s_ref, const Cost & cost, const Matrix3D & h,
+                                            const int tw, const int th, const int n, const int width, const int height,
+                                            const int2 block)
+{
+    for (int ty = threadIdx.y; ty < th; ty += blockDim.y) {
+        const int gy = mirror_index(blockDim.y * block.y + ty - n, height);
+        for (int tx = threadIdx.x; tx < tw; tx += blockDim.x) {
+            const int gx = mirror_index(blockDim.x * block.x + tx - n, width);
+
+            float3 x = h * make_float3(gx+1, gy+1, 1);
+            x = x / x.z - 1;
+
+            cost.load(s_warped[ty * tw + tx], s_ref[ty * tw + tx], x.x, x.y, gy * width + gx);
+        }
+    }
+
+    __syncthreads();
+}
+
+template<typename Cost, typename Mask>
+__device__ inline void planesweep_fused_step(float * __restrict__ d_depthmap, float * __restrict__ d_bestncc,
+                                             float * __restrict__ d_subplane, const Cost & cost, const Matrix3D & h, const float current_depth,
+                                             const unsigned int winsize, const Mask & mask, const int width, const int height)
+{
+    extern __shared__ float s_tile[];
+
+    const int n = winsize / 2;
+    const int tw = blockDim.x + 2 * n;
+    const int th = blockDim.y + 2 * n;
+
+    float * s_warped = s_tile;
+    float * s_ref = s_tile + tw * th;
+    const int2 block = mask.block();
+    planesweep_load_tile(s_warped, s_ref, cost, h, tw, th, n, width, height, block);
+
+    const int ind_x = threadIdx.x + blockDim.x * block.x;
+    const int ind_y = threadIdx.y + blockDim.y * block.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int ind = ind_y * width + ind_x, area = width * height;
+        if (!mask(ind)) return;
+
+        const float score = cost.score(s_warped, s_ref, tw, winsize, ind);
+
+        // Update if better correspondance was found
+        const bool better = score > d_bestncc[ind];
+        if (better){
+            d_bestncc[ind] = score;
+            d_depthmap[ind] = current_depth;
+        }
+        if (d_subplane) subplane_step(d_subplane[ind], d_subplane[area + ind], d_subplane[2 * area + ind], score, better);
+    }
+}
+
+// NCC step of the sweep kernels below
+template<typename Sampler, typename Mask>
+__device__ inline void planesweep_fused_NCC_step(float * __restrict__ d_depthmap, float * __restrict__ d_bestncc,
+                                                 float * __restrict__ d_subplane, const Sampler & src, const float * __restrict__ d_ref,
+                                                 const float * __restrict__ d_refmean, const float * __restrict__ d_refstd,
+                                                 const Matrix3D & h, const float current_depth,
+                                                 const unsigned int winsize, const float stdthresh,
+                                                 const Mask & mask, const int width, const int height)
+{
+    const NCCCost<Sampler> cost = {src, d_ref, d_refmean, d_refstd, stdthresh};
+    planesweep_fused_step(d_depthmap, d_bestncc, d_subplane, cost, h, current_depth, winsize, mask, width, height);
+}
+
+// W is a fixed window size whose window loops are unrolled after inlining, 0 takes winsize at run time
+template<typename S, unsigned int W>
+__global__ void planesweep_fused_NCC_kernel(float * __restrict__ d_depthmap, float * __restrict__ d_bestncc,
+                                            float * __restrict__ d_subplane, const S * __restrict__ d_src, const float * __restrict__ d_ref,
+                                            const float * __restrict__ d_refmean, const float * __restrict__ d_refstd,
+                                            const Matrix3D * __restrict__ d_h, const float current_depth,
+                                            const unsigned int winsize, const float stdthresh,
+                                            const int width, const int height)
+{
+    const LinearMemorySampler<S> src = {d_src, width, height};
+    planesweep_fused_NCC_step(d_depthmap, d_bestncc, d_subplane, src, d_ref, d_refmean, d_refstd,
+                              *d_h, current_depth, W ? W : winsize, stdthresh, AllPixels(), width, height);
+}
+
+// Fused NCC instance of a source storage type and window size, common window sizes have specialized instances
+template<typename S>
+void planesweep_fused_NCC_launch(float * d_depthmap, float * d_bestncc,
+                                 const S * d_src, const float * d_ref,
+                                 const float * d_refmean, const float * d_refstd,
+                                 const Matrix3D * d_h, const float current_depth,
+                                 const unsigned int winsize, const float stdthresh,
+                                 const int width, const int height,
+                                 dim3 blocks, dim3 threads, float * d_subplane)
+{
+    typedef void (*kernel_type)(float *, float *, float *, const S *, const float *, const float *, const float *,
+                                const Matrix3D *, const float, const unsigned int, const float, const int, const int);
+    kernel_type kernel;
+    switch (winsize) {
+    case 3:  kernel = planesweep_fused_NCC_kernel<S, 3>; break;
+    case 5:  kernel = planesweep_fused_NCC_kernel<S, 5>; break;
+    case 7:  kernel = planesweep_fused_NCC_kernel<S, 7>; break;
+    case 9:  kernel = planesweep_fused_NCC_kernel<S, 9>; break;
+    case 11: kernel = planesweep_fused_NCC_kernel<S, 11>; break;
+    case 15: kernel = planesweep_fused_NCC_kernel<S, 15>; break;
+    default: kernel = planesweep_fused_NCC_kernel<S, 0>;
+    }
+
+    const int n = winsize / 2;
+    size_t shared = 2 * (threads.x + 2 * n) * (threads.y + 2 * n) * sizeof(float);
+    kernel<<<blocks, threads, shared>>>(d_depthmap, d_bestncc, d_subplane, d_src, d_ref, d_refmean, d_refstd,
+                                        d_h, current_depth, winsize, stdthresh, width, height);
+}
+
+__global__ void planesweep_fused_NCC_texture_kernel(float * __restrict__ d_depthmap, float * __restrict__ d_bestncc,
+                                                    float * __restrict__ d_subplane, const cudaTextureObject_t src_tex, const float * __restrict__ d_ref,
+                                                    const float * __restrict__ d_refmean, const float * __restrict__ d_refstd,
+                                                    const Matrix3D * __restrict__ d_h, const float current_depth,
+                                                    const unsigned int winsize, const float stdthresh,
+                                                    const int width, const int height)
+{
+    const TextureSampler src = {src_tex};
+    planesweep_fused_NCC_step(d_depthmap, d_bestncc, d_subplane, src, d_ref, d_refmean, d_refstd,
+                              *d_h, current_depth, winsize, stdthresh, AllPixels(), width, height);
+}
+
+__global__ void planesweep_fused_NCC_tiles_kernel(float * __restrict__ d_depthmap, float * __restrict__ d_bestncc,
+                                                  float * __restrict__ d_subplane, const float * __restrict__ d_src, const float * __restrict__ d_ref,
+                                                  const float * __restrict__ d_refmean, const float * __restrict__ d_refstd,
+                                                  const Matrix3D * __restrict__ d_h, const float current_depth,
+                                                  const unsigned int winsize, const float stdthresh,
+                                                  const int2 * __restrict__ d_tiles, const float * __restrict__ d_valid,
+                                                  const int width, const int height)
+{
+    const LinearMemorySampler<> src = {d_src, width, height};
+    const ActiveTiles mask = {d_tiles, d_valid};
+    planesweep_fused_NCC_step(d_depthmap, d_bestncc, d_subplane, src, d_ref, d_refmean, d_refstd,
+                              *d_h, current_depth, winsize, stdthresh, mask, width, height);
+}
+
+__global__ void planesweep_fused_NCC_multiview_kernel(float * __restrict__ d_depthmap, float * __restrict__ d_bestncc,
+                                                      float * __restrict__ d_subplane, const float * __restrict__ d_src, const float * __restrict__ d_ref,
+                                                      const float * __restrict__ d_refmean, const float * __restrict__ d_refstd,
+                                                      const Matrix3D * __restrict__ d_h, const int hstride, const float current_depth,
+                                                      const unsigned int winsize, const float stdthresh,
+                                                      const int width, const int height)
+{
+    // each grid z slice processes one source view
+    const int offset = blockIdx.z * width * height;
+    const LinearMemorySampler<> src = {d_src + offset, width, height};
+    float * subplane = d_subplane ? d_subplane + 3 * offset : 0;
+    planesweep_fused_NCC_step(d_depthmap + offset, d_bestncc + offset, subplane, src, d_ref, d_refmean, d_refstd,
+                              d_h[blockIdx.z * hstride], current_depth, winsize, stdthresh, AllPixels(), width, height);
+}
+
+__global__ void planesweep_fused_NCC_batch_kernel(float * __restrict__ d_depthmap, float * __restrict__ d_bestncc,
+                                                  float * __restrict__ d_subplane, const float * __restrict__ d_pool,
+                                                  const int * __restrict__ d_adjacency, const int adjstride,
+                                                  const float * __restrict__ d_ref, const float * __restrict__ d_refmean,
+                                                  const float * __restrict__ d_refstd, const Matrix3D * __restrict__ d_h,
+                                                  const int hstride, const float current_depth,
+                                                  const unsigned int winsize, const float stdthresh,
+                                                  const int width, const int height)
+{
+    // each grid z slice processes one reference view against its source in the shared pool, references without
+    // a source in this slot return as a whole block before the tile barrier
+    const int src = d_adjacency[blockIdx.z * adjstride];
+    if (src < 0) return;
+
+    const int offset = blockIdx.z * width * height;
+    const LinearMemorySampler<> sampler = {d_pool + src * width * height, width, height};
+    float * subplane = d_subplane ? d_subplane + 3 * offset : 0;
+    planesweep_fused_NCC_step(d_depthmap + offset, d_bestncc + offset, subplane, sampler, d_ref + offset,
+                              d_refmean + offset, d_refstd + offset, d_h[blockIdx.z * hstride], current_depth,
+                              winsize, stdthresh, AllPixels(), width, height);
+}
+
+__global__ void planesweep_fused_NCC_band_kernel(float * __restrict__ d_depthmap, float * __restrict__ d_bestncc,
+                                                 float * __restrict__ d_subplane, const float * __restrict__ d_src, const float * __restrict__ d_ref,
+                                                 const float * __restrict__ d_refmean, const float * __restrict__ d_refstd,
+                                                 const Matrix3D * __restrict__ d_h, const float current_depth, const int plane,
+                                                 const int * __restrict__ d_planemin, const int * __restrict__ d_planemax,
+                                                 const int * __restrict__ d_blockmin, const int * __restrict__ d_blockmax,
+                                                 const unsigned int winsize, const float stdthresh,
+                                                 const int width, const int height)
+{
+    // whole block leaves if plane is outside of band of all its pixels
+    const int bid = blockIdx.y * gridDim.x + blockIdx.x;
+    if ((plane < d_blockmin[bid]) || (plane > d_blockmax[bid])) return;
+
+    const LinearMemorySampler<> src = {d_src, width, height};
+    const PlaneBand band = {d_planemin, d_planemax, plane};
+    planesweep_fused_NCC_step(d_depthmap, d_bestncc, d_subplane, src, d_ref, d_refmean, d_refstd,
+                              *d_h, current_depth, winsize, stdthresh, band, width, height);
+}
+
+template<typename Cost>
+__global__ void planesweep_fused_cost_kernel(float * __restrict__ d_depthmap, float * __restrict__ d_bestncc,
+                                             float * __restrict__ d_subplane, const Cost cost,
+                                             const Matrix3D * __restrict__ d_h, const float current_depth,
+                                             const unsigned int winsize, const int width, const int height)
+{
+    planesweep_fused_step(d_depthmap, d_bestncc, d_subplane, cost, *d_h, current_depth, winsize, AllPixels(), width, height);
+}
+
+// Rectified sweep of consecutive planes, a plane is a horizontal shift of the source view by its disparity. Each block
+// keeps its reference tile and the source rows covering all disparities of the planes in shared memory, so windows of
+// consecutive disparities are read from the same rows. W is a fixed window size as in planesweep_fused_NCC_kernel.
+template<unsigned int W>
+__global__ void planesweep_rectified_NCC_kernel(float * __restrict__ d_depthmap, float * __restrict__ d_bestncc,
+                                                float * __restrict__ d_subplane, const float * __restrict__ d_src, const float * __restrict__ d_ref,
+                                                const float * __restrict__ d_refmean, const float * __restrict__ d_refstd,
+                                                const float * __restrict__ d_disparity, const float * __restrict__ d_depth,
+                                                const int nplanes, const int dmin, const int dmax,
+                                                const unsigned int winsize, const float stdthresh,
+                                                const int width, const int height)
+{
+    extern __shared__ float s_tile[];
+
+    const unsigned int ws = W ? W : winsize;
+    const int n = ws / 2;
+    const int tw = blockDim.x + 2 * n;
+    const int th = blockDim.y + 2 * n;
+    const int sw = tw + dmax - dmin + 1;
+
+    float * s_ref = s_tile;
+    float * s_src = s_tile + tw * th;
+
+    // Window columns at mirrored coordinates lie in [mlo, mlo + tw), source rows start at mlo + dmin
+    const int lo = blockDim.x * blockIdx.x - n, hi = lo + tw - 1;
+    const int mlo = max(min(max(lo, 0), hi > width - 1 ? 2 * (width - 1) - hi : width), 0);
+    const int slo = mlo + dmin;
+
+    for (int ty = threadIdx.y; ty < th; ty += blockDim.y) {
+        const int gy = mirror_index(blockDim.y * blockIdx.y + ty - n, height);
+        for (int tx = threadIdx.x; tx < tw; tx += blockDim.x)
+            s_ref[ty * tw + tx] = d_ref[gy * width + mirror_index(lo + tx, width)];
+        for (int tx = threadIdx.x; tx < sw; tx += blockDim.x) {
+            const int gx = slo + tx;
+            s_src[ty * sw + tx] = ((gx >= 0) && (gx < width)) ? d_src[gy * width + gx] : 0.f;
+        }
+    }
+
+    __syncthreads();
+
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+    if ((ind_x >= width) || (ind_y >= height)) return;
+
+    const int ind = ind_y * width + ind_x;
+    const float refmean = d_refmean[ind], refstd = d_refstd[ind];
+    const float norm = 1.f / (float)(ws * ws);
+    const int area = width * height;
+    float best = d_bestncc[ind], depth = d_depthmap[ind];
+    float last = SUBPLANE_NONE, prev = SUBPLANE_NONE, next = SUBPLANE_NONE;
+    if (d_subplane) {
+        last = d_subplane[ind];
+        prev = d_subplane[area + ind];
+        next = d_subplane[2 * area + ind];
+    }
+
+    for (int p = 0; p < nplanes; p++) {
+        const float d = d_disparity[p];
+        const int id = floorf(d);
+        const float a = d - id;
+
+        float mean = 0.f, sqmean = 0.f, prodmean = 0.f;
+        for (int i = 0; i <= 2 * n; i++) {
+            // Samples are 0 unless both neighbours are inside the source view, as in LinearMemorySampler
+            const int sx = mirror_index(lo + threadIdx.x + i, width) + id;
+            const bool inside = (sx >= 0) && (sx + 1 <= width - 1);
+            const int c = sx - slo;
+            for (int j = 0; j <= 2 * n; j++) {
+                const float * row = s_src + (threadIdx.y + j) * sw;
+                const float w = inside ? (1 - a) * row[c] + a * row[c + 1] : 0.f;
+                mean += w;
+                sqmean += w * w;
+                prodmean += w * s_ref[(threadIdx.y + j) * tw + threadIdx.x + i];
+            }
+        }
+        mean *= norm;
+        sqmean *= norm;
+        prodmean *= norm;
+
+        const float var = sqmean - mean * mean;
+        const float std = var > 0 ? sqrt(var) : 0.f;
+        const float score = ((refstd >= stdthresh) && (std >= stdthresh)) ? (prodmean - refmean * mean) / (refstd * std) : 0.f;
+
+        // Update if better correspondance was found
+        const bool better = score > best;
+        if (better) {
+            best = score;
+            depth = d_depth[p];
+        }
+        subplane_step(last, prev, next, score, better);
+    }
+
+    d_bestncc[ind] = best;
+    d_depthmap[ind] = depth;
+    if (d_subplane) {
+        d_subplane[ind] = last;
+        d_subplane[area + ind] = prev;
+        d_subplane[2 * area + ind] = next;
+    }
+}
+
+// Cost volume slice of one plane, NCC of all source views are summed over consecutive launches and the last one
+// stores the mean as 8 bit cost (1 - NCC) * 127.5 at plane-minor position
+__global__ void planesweep_volume_NCC_kernel(unsigned char * __restrict__ d_volume, float * __restrict__ d_sum,
+                                             const float * __restrict__ d_src, const float * __restrict__ d_ref,
+                                             const float * __restrict__ d_refmean, const float * __restrict__ d_refstd,
+                                             const Matrix3D * __restrict__ d_h, const int plane, const int nplanes,
+                                             const int view, const int nviews,
+                                             const unsigned int winsize, const float stdthresh,
+                                             const int width, const int height)
+{
+    extern __shared__ float s_tile[];
+
+    const int n = winsize / 2;
+    const int tw = blockDim.x + 2 * n;
+    const int th = blockDim.y + 2 * n;
+
+    float * s_warped = s_tile;
+    float * s_ref = s_tile + tw * th;
+    const LinearMemorySampler<> src = {d_src, width, height};
+    const NCCCost<LinearMemorySampler<> > cost = {src, d_ref, d_refmean, d_refstd, stdthresh};
+    planesweep_load_tile(s_warped, s_ref, cost, *d_h, tw, th, n, width, height, make_int2(blockIdx.x, blockIdx.y));
+
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int ind = ind_y * width + ind_x;
+        float sum = cost.score(s_warped, s_ref, tw, winsize, ind);
+        if (view > 0) sum += d_sum[ind];
+
+        if (view < nviews - 1) d_sum[ind] = sum;
+        else d_volume[ind * nplanes + plane] =
+                (unsigned char)fminf(fmaxf(rintf((1.f - sum / nviews) * SGM_COST_SCALE), 0.f), (float)UCHAR_MAX);
+    }
+}
+
+// Trace of an aggregation path, all traces together start at every pixel whose predecessor is outside of the image
+__device__ inline bool sgm_trace_start(int & x, int & y, const int trace, const int dx, const int dy,
+                                       const int width, const int height)
+{
+    const int x0 = dx < 0 ? width - 1 : 0, y0 = dy < 0 ? height - 1 : 0;
+    if (dy == 0) {
+        x = x0;
+        y = trace;
+        return trace < height;
+    }
+    if ((dx == 0) || (trace < width)) {
+        x = trace;
+        y = y0;
+        return trace < width;
+    }
+    x = x0;
+    y = dy > 0 ? trace - width + 1 : height - 1 - (trace - width + 1);
+    return trace < width + height - 1;
+}
+
+// One warp walks one trace, lane l keeps path costs of planes l, l + 32, ... in registers, so neighbouring planes are
+// exchanged by shuffles and consecutive planes of a pixel are read by consecutive lanes
+__global__ void sgm_aggregate_kernel(unsigned short * __restrict__ d_aggregated, const unsigned char * __restrict__ d_volume,
+                                     const int nplanes, const int dx, const int dy, const int P1, const int P2,
+                                     const int width, const int height)
+{
+    const int K = SGM_MAX_PLANES / 32;
+    const int INF = 1 << 24;
+    const unsigned int all = 0xffffffffu;
+    const int lane = threadIdx.x;
+
+    int x, y;
+    if (!sgm_trace_start(x, y, blockIdx.x * blockDim.y + threadIdx.y, dx, dy, width, height)) return;
+
+    int L[K];
+    for (int j = 0; j < K; j++) L[j] = INF;
+    int minprev = 0;
+    bool first = true;
+
+    for (; (x >= 0) && (y >= 0) && (x < width) && (y < height); x += dx, y += dy) {
+        const int base = (y * width + x) * nplanes;
+        int Ln[K];
+        int localmin = INF;
+        for (int j = 0; j < K; j++) {
+            const int d = j * 32 + lane;
+
+            // path costs of planes d - 1 and d + 1, which cross to the neighbouring register at lanes 0 and 31
+            int lo = __shfl_up_sync(all, L[j], 1);
+            const int lowrap = __shfl_sync(all, j > 0 ? L[j - 1] : INF, 31);
+            if (lane == 0) lo = lowrap;
+            int hi = __shfl_down_sync(all, L[j], 1);
+            const int hiwrap = __shfl_sync(all, j < K - 1 ? L[j + 1] : INF, 0);
+            if (lane == 31) hi = hiwrap;
+
+            int l = INF;
+            if (d < nplanes) {
+                l = d_volume[base + d];
+                if (!first) l += min(min(L[j], min(lo, hi) + P1), minprev + P2) - minprev;
+                d_aggregated[base + d] += l;
+            }
+            Ln[j] = l;
+            localmin = min(localmin, l);
+        }
+
+        for (int o = 16; o > 0; o >>= 1) localmin = min(localmin, __shfl_xor_sync(all, localmin, o));
+        minprev = localmin;
+        for (int j = 0; j < K; j++) L[j] = Ln[j];
+        first = false;
+    }
+}
+
+__global__ void sgm_select_kernel(float * __restrict__ d_depthmap, float * __restrict__ d_count,
+                                  const unsigned short * __restrict__ d_aggregated,
+                                  const unsigned char * __restrict__ d_volume, const float * __restrict__ d_depth,
+                                  const int nplanes, const float costthresh, const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int ind = ind_y * width + ind_x;
+        const unsigned short * s = d_aggregated + ind * nplanes;
+
+        int best = 0;
+        for (int d = 1; d < nplanes; d++)
+            if (s[d] < s[best]) best = d;
+
+        // Matching cost of the selected plane decides validity the way the NCC threshold does for the sweep
+        if (d_volume[ind * nplanes + best] > costthresh) {
+            d_depthmap[ind] = 0.f;
+            d_count[ind] = 0.f;
+            return;
+        }
+
+        // Parabola through the aggregated costs of neighbouring planes gives sub-plane depth
+        float depth = d_depth[best];
+        if ((best > 0) && (best < nplanes - 1)) {
+            const float c0 = s[best - 1], c1 = s[best], c2 = s[best + 1];
+            const float denom = c0 - 2.f * c1 + c2;
+            if (denom > 0) {
+                const float offset = 0.5f * (c0 - c2) / denom;
+                depth += offset * (offset > 0 ? d_depth[best + 1] - depth : depth - d_depth[best - 1]);
+            }
+        }
+        d_depthmap[ind] = depth;
+        d_count[ind] = 1.f;
+    }
+}
+
+// Stateless uniform samples in [0, 1) of pixel, PatchMatch pass and draw, no generator state is kept per pixel
+__device__ inline float patchmatch_random(const unsigned int ind, const unsigned int seed)
+{
+    unsigned int h = ind * 0x9E3779B9u ^ (seed * 0x85EBCA6Bu + 0x7F4A7C15u);
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return (h >> 8) * (1.f / 16777216.f);
+}
+
+// Unit normal facing the reference camera along ray r
+__device__ inline float3 patchmatch_facing(float3 n, const float3 r)
+{
+    n = normalize(n);
+    return dot(n, r) > 0 ? -n : n;
+}
+
+// Multiview NCC of plane hypothesis (normal, depth at the pixel) of pixel (x, y). Each source view warps the window
+// with the homography K * (Rrel + trel * n^T / (n^T X)) * K^-1 induced by the plane, which is split into the plane
+// independent K * Rrel * K^-1 and K * trel of each view. Mean of the best NCC values selects views per pixel, views
+// where the pixel is occluded or outside do not lower the score
+template<unsigned int W>
+__device__ inline float patchmatch_score(const float4 plane, const int x, const int y,
+                                         const float * __restrict__ d_src, const float * __restrict__ d_ref,
+                                         const float * __restrict__ d_refmean, const float * __restrict__ d_refstd,
+                                         const Matrix3D * __restrict__ d_KRK, const float3 * __restrict__ d_Kt,
+                                         const Matrix3D & invK, const int nviews, const int best,
+                                         const unsigned int winsize, const float stdthresh,
+                                         const int width, const int height)
+{
+    const int ind = y * width + x;
+    if (d_refstd[ind] < stdthresh) return 0.f;
+
+    const float3 n = make_float3(plane.x, plane.y, plane.z);
+    const float dist = plane.w * dot(n, invK * make_float3(x + 1, y + 1, 1));
+    if (fabsf(dist) < 1e-6f) return 0.f;
+    const float3 m = (invK.trans() * n) / dist;
+
+    const int r = (W ? W : winsize) / 2;
+    const float norm = 1.f / (float)((2 * r + 1) * (2 * r + 1));
+
+    float scores[PATCHMATCH_MAX_VIEWS];
+    for (int v = 0; v < nviews; v++) {
+        Matrix3D h = d_KRK[v];
+        const float3 t = d_Kt[v];
+        h.r[0] += t.x * m;
+        h.r[1] += t.y * m;
+        h.r[2] += t.z * m;
+
+        const LinearMemorySampler<> src = {d_src + v * width * height, width, height};
+        float mean = 0.f, sqmean = 0.f, prodmean = 0.f;
+        for (int j = -r; j <= r; j++) {
+            const int gy = mirror_index(y + j, height);
+            for (int i = -r; i <= r; i++) {
+                const int gx = mirror_index(x + i, width);
+                float3 p = h * make_float3(gx + 1, gy + 1, 1);
+                const float w = p.z > 0 ? src(p.x / p.z - 1, p.y / p.z - 1) : 0.f;
+                mean += w;
+                sqmean += w * w;
+                prodmean += w * d_ref[gy * width + gx];
+            }
+        }
+        mean *= norm;
+        sqmean *= norm;
+        prodmean *= norm;
+
+        const float var = sqmean - mean * mean;
+        const float std = var > 0 ? sqrt(var) : 0.f;
+        float ncc = std >= stdthresh ? (prodmean - d_refmean[ind] * mean) / (d_refstd[ind] * std) : 0.f;
+
+        // insertion into descending order
+        int k = v;
+        for (; (k > 0) && (scores[k - 1] < ncc); k--) scores[k] = scores[k - 1];
+        scores[k] = ncc;
+    }
+
+    const int nbest = min(best, nviews);
+    float score = 0.f;
+    for (int k = 0; k < nbest; k++) score += scores[k];
+    return nbest > 0 ? score / nbest : 0.f;
+}
+
+template<unsigned int W>
+__global__ void patchmatch_init_kernel(float4 * __restrict__ d_planes, float * __restrict__ d_score,
+                                       const float * __restrict__ d_src, const float * __restrict__ d_ref,
+                                       const float * __restrict__ d_refmean, const float * __restrict__ d_refstd,
+                                       const Matrix3D * __restrict__ d_KRK, const float3 * __restrict__ d_Kt,
+                                       const Matrix3D invK, const int nviews, const int best,
+                                       const float znear, const float zfar, const unsigned int seed,
+                                       const unsigned int winsize, const float stdthresh,
+                                       const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int ind = ind_y * width + ind_x;
+        const float3 ray = invK * make_float3(ind_x + 1, ind_y + 1, 1);
+
+        // uniform depth and normal uniform on the hemisphere facing the camera
+        const float z = 2.f * patchmatch_random(ind, seed) - 1.f;
+        const float phi = 2.f * CUDART_PI_F * patchmatch_random(ind, seed + 1);
+        const float s = sqrtf(fmaxf(1.f - z * z, 0.f));
+        const float3 n = patchmatch_facing(make_float3(s * cosf(phi), s * sinf(phi), z), ray);
+        const float4 plane = make_float4(n.x, n.y, n.z, znear + (zfar - znear) * patchmatch_random(ind, seed + 2));
+
+        d_planes[ind] = plane;
+        d_score[ind] = patchmatch_score<W>(plane, ind_x, ind_y, d_src, d_ref, d_refmean, d_refstd, d_KRK, d_Kt, invK,
+                                           nviews, best, winsize, stdthresh, width, height);
+    }
+}
+
+template<unsigned int W>
+__global__ void patchmatch_propagate_kernel(float4 * __restrict__ d_planes, float * __restrict__ d_score,
+                                            const float * __restrict__ d_src, const float * __restrict__ d_ref,
+                                            const float * __restrict__ d_refmean, const float * __restrict__ d_refstd,
+                                            const Matrix3D * __restrict__ d_KRK, const float3 * __restrict__ d_Kt,
+                                            const Matrix3D invK, const int nviews, const int best,
+                                            const float znear, const float zfar, const int parity,
+                                            const float range, const unsigned int seed,
+                                            const unsigned int winsize, const float stdthresh,
+                                            const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    // pixels of one checkerboard colour are updated from neighbours of the other one, which stay unchanged
+    if ((ind_x >= width) || (ind_y >= height) || (((ind_x + ind_y) & 1) != parity)) return;
+
+    const int ind = ind_y * width + ind_x;
+    const float3 ray = invK * make_float3(ind_x + 1, ind_y + 1, 1);
+    float4 plane = d_planes[ind];
+    float score = d_score[ind];
+
+    // Propagation: planes of neighbours at odd distances, the depth of their plane along this pixel's ray is tested
+    const int offsets[8][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}, {-5, 0}, {5, 0}, {0, -5}, {0, 5}};
+    for (int k = 0; k < 8; k++) {
+        const int qx = ind_x + offsets[k][0], qy = ind_y + offsets[k][1];
+        if ((qx < 0) || (qy < 0) || (qx > width - 1) || (qy > height - 1)) continue;
+
+        const float4 q = d_planes[qy * width + qx];
+        const float3 n = make_float3(q.x, q.y, q.z);
+        const float denom = dot(n, ray);
+        if (fabsf(denom) < 1e-6f) continue;
+        const float z = q.w * dot(n, invK * make_float3(qx + 1, qy + 1, 1)) / denom;
+        if (!(z >= znear) || !(z <= zfar)) continue;
+
+        const float4 candidate = make_float4(n.x, n.y, n.z, z);
+        const float s = patchmatch_score<W>(candidate, ind_x, ind_y, d_src, d_ref, d_refmean, d_refstd, d_KRK, d_Kt,
+                                            invK, nviews, best, winsize, stdthresh, width, height);
+        if (s > score) {
+            score = s;
+            plane = candidate;
+        }
+    }
+
+    // Refinement: random perturbations of depth and normal, range shrinks with each iteration
+    for (int k = 0; k < PATCHMATCH_REFINE_SAMPLES; k++) {
+        const unsigned int sk = seed + 5 * k;
+        const float scale = range / (1 << k);
+        const float3 dn = make_float3(patchmatch_random(ind, sk), patchmatch_random(ind, sk + 1),
+                                      patchmatch_random(ind, sk + 2)) * 2.f - 1.f;
+        const float3 n = patchmatch_facing(make_float3(plane.x, plane.y, plane.z) + scale * dn, ray);
+        const float z = plane.w + scale * (zfar - znear) * (2.f * patchmatch_random(ind, sk + 3) - 1.f);
+
+        const float4 candidate = make_float4(n.x, n.y, n.z, fminf(fmaxf(z, znear), zfar));
+        const float s = patchmatch_score<W>(candidate, ind_x, ind_y, d_src, d_ref, d_refmean, d_refstd, d_KRK, d_Kt,
+                                            invK, nviews, best, winsize, stdthresh, width, height);
+        if (s > score) {
+            score = s;
+            plane = candidate;
+        }
+    }
+
+    d_planes[ind] = plane;
+    d_score[ind] = score;
+}
+
+__global__ void patchmatch_depthmap_kernel(float * __restrict__ d_depthmap, const float4 * __restrict__ d_planes,
+                                           const float * __restrict__ d_score, const float nccthresh,
+                                           const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int ind = ind_y * width + ind_x;
+        d_depthmap[ind] = d_score[ind] > nccthresh ? d_planes[ind].w : CUDART_NAN_F;
+    }
+}
+
+__global__ void census_transform_kernel(unsigned long long * __restrict__ d_census, const float * __restrict__ d_input,
+                                        const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int n = CENSUS_WINDOW / 2;
+        const float center = d_input[ind_y * width + ind_x];
+
+        // one bit per neighbour darker than the center, neighbours are taken at mirrored coordinates
+        unsigned long long descriptor = 0;
+        for (int j = -n; j <= n; j++) {
+            const int y = mirror_index(ind_y + j, height);
+            for (int i = -n; i <= n; i++) {
+                if ((i == 0) && (j == 0)) continue;
+                descriptor = (descriptor << 1) | (d_input[y * width + mirror_index(ind_x + i, width)] < center);
+            }
+        }
+        d_census[ind_y * width + ind_x] = descriptor;
+    }
+}
+
+__global__ void planesweep_band_kernel(int * __restrict__ d_planemin, int * __restrict__ d_planemax,
+                                       const float * __restrict__ d_coarse, const int coarse_width, const int coarse_height,
+                                       const float znear, const float dstep, const int radius, const int nplanes,
+                                       const bool inverse, const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int ind = ind_y * width + ind_x;
+
+        // nearest coarse pixel, same as halving coordinates for half resolution and identity for full resolution
+        const int cx = min(ind_x * coarse_width / width, coarse_width - 1);
+        const int cy = min(ind_y * coarse_height / height, coarse_height - 1);
+        const float d = d_coarse[cy * coarse_width + cx];
+
+        // pixels without coarse estimate are swept over all planes
+        if (d != d) {
+            d_planemin[ind] = 0;
+            d_planemax[ind] = nplanes - 1;
+        }
+        else {
+            const int p = __float2int_rn(((inverse ? 1.f / d : d) - znear) / dstep);
+            d_planemin[ind] = max(p - radius, 0);
+            d_planemax[ind] = min(p + radius, nplanes - 1);
+        }
+    }
+}
+
+__global__ void planesweep_block_band_kernel(int * __restrict__ d_blockmin, int * __restrict__ d_blockmax,
+                                             const int * __restrict__ d_planemin, const int * __restrict__ d_planemax,
+                                             const int width, const int height)
+{
+    __shared__ int s_min, s_max;
+
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+    const bool first = (threadIdx.x == 0) && (threadIdx.y == 0);
+
+    if (first) { s_min = INT_MAX; s_max = INT_MIN; }
+    __syncthreads();
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int ind = ind_y * width + ind_x;
+        atomicMin(&s_min, d_planemin[ind]);
+        atomicMax(&s_max, d_planemax[ind]);
+    }
+    __syncthreads();
+
+    if (first) {
+        const int bid = blockIdx.y * gridDim.x + blockIdx.x;
+        d_blockmin[bid] = s_min;
+        d_blockmax[bid] = s_max;
+    }
+}
+
+__global__ void downsample_half_kernel(float * __restrict__ d_output, const float * __restrict__ d_input,
+                                       const int input_width, const int input_height,
+                                       const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        const int x0 = 2 * ind_x, y0 = 2 * ind_y;
+        const int x1 = min(x0 + 1, input_width - 1), y1 = min(y0 + 1, input_height - 1);
+
+        d_output[ind_y * width + ind_x] = 0.25f * (d_input[y0 * input_width + x0] + d_input[y0 * input_width + x1] +
+                                                   d_input[y1 * input_width + x0] + d_input[y1 * input_width + x1]);
+    }
+}
+
+__global__ void upsample_double_kernel(float * __restrict__ d_output, const float * __restrict__ d_input,
+                                      const int input_width, const int input_height,
+                                      const int width, const int height)
+{
+    const int ind_x = threadIdx.x + blockDim.x * blockIdx.x;
+    const int ind_y = threadIdx.y + blockDim.y * blockIdx.y;
+
+    if ((ind_x < width) && (ind_y < height)) {
+        // inverse of downsample_half_kernel() centering, coordinates are clamped to the input array
+        float x = fminf(fmaxf(0.5f * ind_x - 0.25f, 0.f), input_width - 1);
+        float y = fminf(fmaxf(0.5f * ind_y - 0.25f, 0.f), input_height - 1);
+        const int x0 = x, y0 = y;
+        const int x1 = min(x0 + 1, input_width - 1), y1 = min(y0 + 1, input_height - 1);
+        const float a = x - x0, b = y - y0;
+
+        d_output[ind_y * width + ind_x] = (1 - b) * ((1 - a) * d_input[y0 * input_width + x0] + a * d_input[y0 * input_width + x1]) +
+                                          b * ((1 - a) * d_input[y1 * input_width + x0] + a * d_input[y1 * input_width + x1]);
+    }
+}
+
+void transform_indexes(float * d_x, float *  d_y,
+                       const Matrix3D h,
+                       const int width, const int height, dim3 blocks, dim3 threads)
+{
+    transform_indexes_kernel<<<blocks, threads>>>(d_x, d_y,
+                                                  h,
+                                                  width, height);
+}
+
+void transform_indexes(float * d_x, float *  d_y,
+                       const Matrix3D * d_h,
+                       const int width, const int height, dim3 blocks, dim3 threads)
+{
+    transform_indexes_kernel<<<blocks, threads>>>(d_x, d_y,
+                                                  d_h,
+                                                  width, height);
+}
+
+void bilinear_interpolation(float * d_result, const float * d_data,
+                            const float * d_xout, const float * d_yout,
+                            const int M1, const int M2, const int N1, const int N2,
+                            dim3 blocks, dim3 threads)
+{
+    bilinear_interpolation_kernel_GPU<<<blocks, threads>>>(d_result, d_data, d_xout, d_yout, M1, M2, N1, N2);
+}
+
+void bilinear_interpolation(float * d_result, const __half * d_data,
+                            const float * d_xout, const float * d_yout,
+                            const int M1, const int M2, const int N1, const int N2,
+                            dim3 blocks, dim3 threads)
+{
+    bilinear_interpolation_lowp_kernel<<<blocks, threads>>>(d_result, d_data, d_xout, d_yout, M1, M2, N1, N2);
+}
+
+void bilinear_interpolation(float * d_result, const unsigned char * d_data,
+                            const float * d_xout, const float * d_yout,
+                            const int M1, const int M2, const int N1, const int N2,
+                            dim3 blocks, dim3 threads)
+{
+    bilinear_interpolation_lowp_kernel<<<blocks, threads>>>(d_result, d_data, d_xout, d_yout, M1, M2, N1, N2);
+}
+
+void bilinear_interpolation_texture(float * d_result, const cudaTextureObject_t tex,
+                                    const float * d_xout, const float * d_yout,
+                                    const int N1, const int N2,
+                                    dim3 blocks, dim3 threads)
+{
+    bilinear_interpolation_texture_kernel<<<blocks, threads>>>(d_result, tex, d_xout, d_yout, N1, N2);
+}
+
+void calcNCC(float * d_ncc, const float * d_prod_mean,
+             const float * d_mean1, const float * d_mean2,
+             const float * d_std1, const float * d_std2,
+             const float stdthresh1, const float stdthresh2,
+             const int width, const int height,
+             dim3 blocks, dim3 threads)
+{
+    calcNCC_kernel<<<blocks, threads>>>(d_ncc, d_prod_mean,
+                                        d_mean1, d_mean2,
+                                        d_std1, d_std2,
+                                        stdthresh1, stdthresh2,
                                         width, height);
 }
 
 void update_arrays(float * d_depthmap, float * d_bestncc,
                    const float * d_currentncc, const float current_depth,
                    const int width, const int height,
-                   dim3 blocks, dim3 threads)
+                   dim3 blocks, dim3 threads, float * d_subplane)
 {
-    update_arrays_kernel<<<blocks, threads>>>(d_depthmap, d_bestncc,
+    update_arrays_kernel<<<blocks, threads>>>(d_depthmap, d_bestncc, d_subplane,
                                               d_currentncc, current_depth,
                                               width, height);
 }
@@ -473,10 +2031,12 @@ void sum_depthmap_NCC(float * d_depthmap_out, float * d_count,
                       const float * d_depthmap, const float * d_ncc,
                       const float nccthreshold,
                       const int width, const int height,
-                      dim3 blocks, dim3 threads)
+                      dim3 blocks, dim3 threads,
+                      const float * d_subplane, const float step, const bool inverse)
 {
     sum_depthmap_NCC_kernel<<<blocks, threads>>>(d_depthmap_out, d_count,
                                                  d_depthmap, d_ncc,
+                                                 d_subplane, step, inverse,
                                                  nccthreshold,
                                                  width, height);
 }
@@ -486,14 +2046,20 @@ void calculate_STD(float * d_std, const float * d_mean,
                    const int width, const int height,
                    dim3 blocks, dim3 threads)
 {
-    calculate_STD_kernel<<<blocks, threads>>>(d_std, d_mean,
-                                              d_mean_of_squares,
-                                              width, height);
+    elementwise(d_std, d_mean, d_mean_of_squares, CalculateSTDOp(), width, height, threads);
+}
+
+void set_value(float * d_output, const float value, const int width, const int height, dim3 blocks, dim3 threads,
+               cudaStream_t stream)
+{
+    elementwise(d_output, 0, 0, SetValueOp{value}, width, height, threads, stream);
 }
 
-void set_value(float * d_output, const float value, const int width, const int height, dim3 blocks, dim3 threads)
+void relative_change(float * d_sums, const float * d_u, const float * d_uprev,
+                     const int width, const int height, dim3 blocks, dim3 threads)
 {
-    set_value_kernel<<<blocks, threads>>>(d_output, value, width, height);
+    size_t shared = 2 * threads.x * threads.y * sizeof(float);
+    relative_change_kernel<<<blocks, threads, shared>>>(d_sums, d_u, d_uprev, width, height);
 }
 
 void element_multiply(float * d_output, const float * d_input1,
@@ -501,8 +2067,7 @@ void element_multiply(float * d_output, const float * d_input1,
                       const int width, const int height,
                       dim3 blocks, dim3 threads)
 {
-    element_multiply_kernel<<<blocks, threads>>>(d_output, d_input1, d_input2,
-                                                 width, height);
+    elementwise(d_output, d_input1, d_input2, MultiplyOp(), width, height, threads);
 }
 
 void element_rdivide(float * d_output, const float * d_input1,
@@ -511,7 +2076,7 @@ void element_rdivide(float * d_output, const float * d_input1,
                      dim3 blocks, dim3 threads)
 {
     const float QNan = std::numeric_limits<float>::quiet_NaN();
-    element_rdivide_kernel<<<blocks, threads>>>(d_output, d_input1, d_input2, width, height, QNan);
+    elementwise(d_output, d_input1, d_input2, RdivideOp{QNan}, width, height, threads);
 }
 
 void convert_float_to_uchar(unsigned char * d_output, const float * d_input,
@@ -522,26 +2087,103 @@ void convert_float_to_uchar(unsigned char * d_output, const float * d_input,
     convert_float_to_uchar_kernel<<<blocks, threads>>>(d_output, d_input, min, max, width, height);
 }
 
+void convert_float_to_half(__half * d_output, const float * d_input,
+                           const int width, const int height,
+                           dim3 blocks, dim3 threads)
+{
+    convert_float_to_half_kernel<<<blocks, threads>>>(d_output, d_input, width, height);
+}
+
+void quantize_float_to_uchar(unsigned char * d_output, const float * d_input,
+                             const int width, const int height,
+                             dim3 blocks, dim3 threads)
+{
+    quantize_float_to_uchar_kernel<<<blocks, threads>>>(d_output, d_input, width, height);
+}
+
 void windowed_mean_row(float * d_output, const float * d_input,
                        const unsigned int winsize, const bool squared,
                        const int width, const int height, dim3 blocks, dim3 threads)
 {
-    windowed_mean_row_kernel<<<blocks, threads>>>(d_output, d_input, winsize, squared,
-                                                  width, height);
+    windowed_mean_fixed_type kernel = windowed_mean_row_instance(winsize, squared);
+    if (kernel) kernel<<<blocks, threads>>>(d_output, d_input, width, height);
+    else windowed_mean_row_kernel<<<blocks, threads>>>(d_output, d_input, winsize, squared,
+                                                       width, height);
 }
 
 void windowed_mean_column(float * d_output, const float * d_input,
                           const unsigned int winsize, const bool squared,
                           const int width, const int height, dim3 blocks, dim3 threads)
 {
-    windowed_mean_column_kernel<<<blocks, threads>>>(d_output, d_input, winsize, squared,
-                                                     width, height);
+    windowed_mean_fixed_type kernel = windowed_mean_column_instance(winsize, squared);
+    if (kernel) kernel<<<blocks, threads>>>(d_output, d_input, width, height);
+    else windowed_mean_column_kernel<<<blocks, threads>>>(d_output, d_input, winsize, squared,
+                                                          width, height);
 }
 
-void convert_uchar_to_float(float * d_output, const unsigned char * d_input,
-                            const int width, const int height, dim3 blocks, dim3 threads)
+void windowed_mean_row_sliding(float * d_output, const float * d_input,
+                               const unsigned int winsize, const bool squared,
+                               const int width, const int height, dim3 blocks, dim3 threads)
 {
-    convert_uchar_to_float_kernel<<<blocks, threads>>>(d_output, d_input, width, height);
+    // Threads of a row slide over consecutive segments staged in shared memory, fewer rows are used for wide windows
+    const int segment = DEFAULT_SLIDING_MEAN_SEGMENT;
+    const int span = SLIDING_MEAN_ROW_THREADS * segment, n = winsize / 2;
+    const size_t rowbytes = (span + 2 * n + (span + 2 * n) / 32 + 1 + span + span / 32 + 1) * sizeof(float);
+    int rows = DEFAULT_SLIDING_MEAN_ROWS;
+    while ((rows > 1) && (rows * rowbytes > SLIDING_MEAN_MAX_SHARED)) rows /= 2;
+    if (rows * rowbytes > SLIDING_MEAN_MAX_SHARED) {
+        windowed_mean_row(d_output, d_input, winsize, squared, width, height, blocks, threads);
+        return;
+    }
+
+    threads = dim3(SLIDING_MEAN_ROW_THREADS, rows);
+    blocks = dim3((width + span - 1) / span, (height + rows - 1) / rows);
+    windowed_mean_row_sliding_kernel<<<blocks, threads, rows * rowbytes>>>(d_output, d_input, winsize, squared, segment,
+                                                                            width, height);
+}
+
+void windowed_mean_column_sliding(float * d_output, const float * d_input,
+                                  const unsigned int winsize, const bool squared,
+                                  const int width, const int height, dim3 blocks, dim3 threads)
+{
+    const int segment = DEFAULT_SLIDING_MEAN_SEGMENT;
+    const int nseg = (height + segment - 1) / segment;
+    blocks = dim3((width + threads.x - 1) / threads.x, (nseg + threads.y - 1) / threads.y);
+    windowed_mean_column_sliding_kernel<<<blocks, threads>>>(d_output, d_input, winsize, squared, segment,
+                                                             width, height);
+}
+
+void convert_uchar_to_float(float * d_output, const unsigned char * d_input, const float scale,
+                            const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream)
+{
+    convert_uchar_to_float_kernel<<<blocks, threads, 0, stream>>>(d_output, d_input, scale, width, height);
+}
+
+void convert_rgba_to_gray(float * d_output, float * d_normalized, const uchar4 * d_input, const float scale,
+                          const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream)
+{
+    convert_rgba_to_gray_kernel<<<blocks, threads, 0, stream>>>(d_output, d_normalized, d_input, scale, width, height);
+}
+
+void project_points_depth(float * d_depth, float * d_w, const float4 * d_points, const int npoints,
+                          const Matrix4D & T, const Matrix3D & K, const float zmin,
+                          const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream)
+{
+    CHECK_CUDA_ERRORS_AUTO(cudaMemsetAsync(d_depth, 0xff, width * height * sizeof(float), stream));
+    if (npoints > 0) {
+        const int pthreads = threads.x * threads.y;
+        project_points_depth_kernel<<<(npoints + pthreads - 1) / pthreads, pthreads, 0, stream>>>(
+            (unsigned int *)d_depth, d_points, npoints, T, K, zmin, width, height);
+    }
+    resolve_depth_kernel<<<blocks, threads, 0, stream>>>(d_depth, d_w, width, height);
+}
+
+void depth_to_points(void * d_points, const int stride, const int coloroffset, const float * d_depth,
+                     const uchar4 * d_color, const float * d_gray, const Matrix3D & invK,
+                     const int width, const int height, dim3 blocks, dim3 threads, cudaStream_t stream)
+{
+    depth_to_points_kernel<<<blocks, threads, 0, stream>>>((unsigned char *)d_points, stride, coloroffset, d_depth,
+                                                           d_color, d_gray, invK, width, height);
 }
 
 void denoising_TVL1_calculateP(float * d_Px, float * d_Py,
@@ -564,17 +2206,56 @@ void denoising_TVL1_calculateP_tensor_weighed(float * d_Px, float * d_Py,
 
 void element_scale(float * d_output, const float scale, const int width, const int height, dim3 blocks, dim3 threads)
 {
-    element_scale_kernel<<<blocks, threads>>>(d_output, scale, width, height);
+    elementwise(d_output, 0, 0, ScaleOp{scale}, width, height, threads);
 }
 
 void element_add(float * d_output, const float value, const int width, const int height, dim3 blocks, dim3 threads)
 {
-    element_add_kernel<<<blocks, threads>>>(d_output, value, width, height);
+    elementwise(d_output, 0, 0, AddValueOp{value}, width, height, threads);
+}
+
+void element_add(float * d_output, const float * d_input, const int width, const int height, dim3 blocks, dim3 threads)
+{
+    elementwise(d_output, d_input, 0, AddOp(), width, height, threads);
 }
 
 void set_QNAN_value(float * d_output, const float value, const int width, const int height, dim3 blocks, dim3 threads)
 {
-    set_QNAN_value_kernel<<<blocks, threads>>>(d_output, value, width, height);
+    elementwise(d_output, 0, 0, ReplaceQNANValueOp{value}, width, height, threads);
+}
+
+void replace_QNAN(float * d_output, const float * d_fill, const int width, const int height, dim3 blocks, dim3 threads)
+{
+    elementwise(d_output, d_fill, 0, ReplaceQNANOp(), width, height, threads);
+}
+
+void valid_mask(float * d_valid, const float * d_count, const float * d_mask, const int width, const int height,
+                dim3 blocks, dim3 threads)
+{
+    if (d_mask) elementwise(d_valid, d_count, d_mask, ValidMaskedOp(), width, height, threads);
+    else elementwise(d_valid, d_count, 0, ValidOp(), width, height, threads);
+}
+
+void depth_confidence(float * d_confidence, const float * d_count, const float scale, const int width, const int height,
+                      dim3 blocks, dim3 threads)
+{
+    elementwise(d_confidence, d_count, 0, ConfidenceOp{scale}, width, height, threads);
+}
+
+void set_QNAN_masked(float * d_output, const float * d_valid, const int width, const int height, dim3 blocks, dim3 threads,
+                     const float threshold)
+{
+    elementwise(d_output, d_valid, 0, QNANMaskedOp{threshold}, width, height, threads);
+}
+
+void depthmap_forward_warp(float * d_output, const float * d_depth,
+                           const Matrix3D & Rrel, const Vector3D & trel, const Matrix3D & K,
+                           const float zmin, const float zmax,
+                           const int width, const int height, dim3 blocks, dim3 threads)
+{
+    set_value(d_output, std::numeric_limits<float>::infinity(), width, height, blocks, threads);
+    depthmap_forward_warp_kernel<<<blocks, threads>>>(d_output, d_depth, Rrel, trel, K, K.inv(), zmin, zmax, width, height);
+    depthmap_forward_warp_finish_kernel<<<blocks, threads>>>(d_output, width, height);
 }
 
 void denoising_TVL1_update(float * d_output, float * d_R,
@@ -586,6 +2267,46 @@ void denoising_TVL1_update(float * d_output, float * d_R,
                                                       tau, theta, lambda, sigma, width, height);
 }
 
+int denoising_TVL1_update_block_size()
+{
+    int grid = 0, block = 0;
+    CHECK_CUDA_ERRORS_AUTO(cudaOccupancyMaxPotentialBlockSize(&grid, &block, denoising_TVL1_update_kernel));
+    return block;
+}
+
+bool denoising_TVL1_fused(float * d_output, float * d_R, float * d_Px, float * d_Py,
+                          const float * d_input, const float * d_Rin, const float * d_Pxin, const float * d_Pyin,
+                          const float * d_origin,
+                          const float * d_T11, const float * d_T12, const float * d_T21, const float * d_T22,
+                          const float tau, const float theta, const float lambda,
+                          const float sigma, const float firstsigma, const unsigned int iterations,
+                          const int width, const int height, dim3 blocks, dim3 threads)
+{
+    size_t shared = 9 * (threads.x + 2 * iterations) * (threads.y + 2 * iterations) * sizeof(float);
+    if (cudaFuncSetAttribute(denoising_TVL1_fused_kernel, cudaFuncAttributeMaxDynamicSharedMemorySize, (int)shared) != cudaSuccess){
+        cudaGetLastError();
+        return false;
+    }
+    denoising_TVL1_fused_kernel<<<blocks, threads, shared>>>(d_output, d_R, d_Px, d_Py, d_input, d_Rin, d_Pxin, d_Pyin,
+                                                             d_origin,
+                                                             d_T11, d_T12, d_T21, d_T22,
+                                                             tau, theta, lambda, sigma, firstsigma, iterations,
+                                                             width, height);
+    // Launch errors are not sticky, clear them so callers can fall back to the unfused kernels
+    return cudaGetLastError() == cudaSuccess;
+}
+
+unsigned int denoising_TVL1_fused_iterations(const unsigned int iterations, dim3 threads)
+{
+    int dev = 0, shared = 0;
+    CHECK_CUDA_ERRORS_AUTO(cudaGetDevice(&dev));
+    CHECK_CUDA_ERRORS_AUTO(cudaDeviceGetAttribute(&shared, cudaDevAttrMaxSharedMemoryPerBlockOptin, dev));
+
+    unsigned int k = iterations;
+    while ((k > 0) && (9 * (threads.x + 2 * k) * (threads.y + 2 * k) * sizeof(float) > (size_t)shared)) k--;
+    return k;
+}
+
 void denoising_TVL1_update_tensor_weighed(float * d_output, float * d_R,
                                           const float * d_Px, const float * d_Py, const float * d_origin,
                                           const float * d_T11, const float * d_T12, const float * d_T21, const float * d_T22,
@@ -602,3 +2323,340 @@ void compute3D(float * d_x, float * d_y, float * d_z, const Matrix3D Rrel, const
     compute3D_kernel<<<blocks, threads>>>(d_x, d_y, d_z,
                                           Rrel, trel, invK, width, height);
 }
+
+void planesweep_fused_NCC(float * d_depthmap, float * d_bestncc,
+                          const float * d_src, const float * d_ref,
+                          const float * d_refmean, const float * d_refstd,
+                          const Matrix3D * d_h, const float current_depth,
+                          const unsigned int winsize, const float stdthresh,
+                          const int width, const int height,
+                          dim3 blocks, dim3 threads, float * d_subplane)
+{
+    planesweep_fused_NCC_launch(d_depthmap, d_bestncc, d_src, d_ref, d_refmean, d_refstd,
+                                d_h, current_depth, winsize, stdthresh, width, height, blocks, threads, d_subplane);
+}
+
+void planesweep_fused_NCC(float * d_depthmap, float * d_bestncc,
+                          const __half * d_src, const float * d_ref,
+                          const float * d_refmean, const float * d_refstd,
+                          const Matrix3D * d_h, const float current_depth,
+                          const unsigned int winsize, const float stdthresh,
+                          const int width, const int height,
+                          dim3 blocks, dim3 threads, float * d_subplane)
+{
+    planesweep_fused_NCC_launch(d_depthmap, d_bestncc, d_src, d_ref, d_refmean, d_refstd,
+                                d_h, current_depth, winsize, stdthresh, width, height, blocks, threads, d_subplane);
+}
+
+void planesweep_fused_NCC(float * d_depthmap, float * d_bestncc,
+                          const unsigned char * d_src, const float * d_ref,
+                          const float * d_refmean, const float * d_refstd,
+                          const Matrix3D * d_h, const float current_depth,
+                          const unsigned int winsize, const float stdthresh,
+                          const int width, const int height,
+                          dim3 blocks, dim3 threads, float * d_subplane)
+{
+    planesweep_fused_NCC_launch(d_depthmap, d_bestncc, d_src, d_ref, d_refmean, d_refstd,
+                                d_h, current_depth, winsize, stdthresh, width, height, blocks, threads, d_subplane);
+}
+
+int planesweep_fused_NCC_block_size(const unsigned int winsize)
+{
+    // Tile halo makes shared memory grow with block height, blocks are DEFAULT_BLOCK_XDIM wide
+    const int n = winsize / 2;
+    auto shared = [n](int threads){ return 2 * (DEFAULT_BLOCK_XDIM + 2 * n) * (threads / DEFAULT_BLOCK_XDIM + 2 * n) * sizeof(float); };
+    int grid = 0, block = 0;
+    CHECK_CUDA_ERRORS_AUTO(cudaOccupancyMaxPotentialBlockSizeVariableSMem(&grid, &block, planesweep_fused_NCC_kernel<float, 0>,
+                                                                                   shared));
+    return block;
+}
+
+void planesweep_fused_NCC_texture(float * d_depthmap, float * d_bestncc,
+                                  const cudaTextureObject_t src, const float * d_ref,
+                                  const float * d_refmean, const float * d_refstd,
+                                  const Matrix3D * d_h, const float current_depth,
+                                  const unsigned int winsize, const float stdthresh,
+                                  const int width, const int height,
+                                  dim3 blocks, dim3 threads, float * d_subplane)
+{
+    const int n = winsize / 2;
+    size_t shared = 2 * (threads.x + 2 * n) * (threads.y + 2 * n) * sizeof(float);
+    planesweep_fused_NCC_texture_kernel<<<blocks, threads, shared>>>(d_depthmap, d_bestncc, d_subplane, src, d_ref, d_refmean, d_refstd,
+                                                                     d_h, current_depth, winsize, stdthresh, width, height);
+}
+
+void planesweep_fused_NCC_tiles(float * d_depthmap, float * d_bestncc,
+                                const float * d_src, const float * d_ref,
+                                const float * d_refmean, const float * d_refstd,
+                                const Matrix3D * d_h, const float current_depth,
+                                const unsigned int winsize, const float stdthresh,
+                                const int2 * d_tiles, const int ntiles, const float * d_valid,
+                                const int width, const int height,
+                                dim3 threads, float * d_subplane)
+{
+    if (ntiles <= 0) return;
+    const int n = winsize / 2;
+    size_t shared = 2 * (threads.x + 2 * n) * (threads.y + 2 * n) * sizeof(float);
+    planesweep_fused_NCC_tiles_kernel<<<ntiles, threads, shared>>>(d_depthmap, d_bestncc, d_subplane, d_src, d_ref, d_refmean, d_refstd,
+                                                                   d_h, current_depth, winsize, stdthresh, d_tiles, d_valid,
+                                                                   width, height);
+}
+
+void planesweep_fused_NCC_multiview(float * d_depthmap, float * d_bestncc,
+                                    const float * d_src, const float * d_ref,
+                                    const float * d_refmean, const float * d_refstd,
+                                    const Matrix3D * d_h, const int hstride, const int nviews, const float current_depth,
+                                    const unsigned int winsize, const float stdthresh,
+                                    const int width, const int height,
+                                    dim3 blocks, dim3 threads, float * d_subplane)
+{
+    const int n = winsize / 2;
+    size_t shared = 2 * (threads.x + 2 * n) * (threads.y + 2 * n) * sizeof(float);
+    planesweep_fused_NCC_multiview_kernel<<<dim3(blocks.x, blocks.y, nviews), threads, shared>>>(
+                d_depthmap, d_bestncc, d_subplane, d_src, d_ref, d_refmean, d_refstd,
+                d_h, hstride, current_depth, winsize, stdthresh, width, height);
+}
+
+void planesweep_fused_NCC_batch(float * d_depthmap, float * d_bestncc,
+                                const float * d_pool, const int * d_adjacency, const int adjstride,
+                                const float * d_ref, const float * d_refmean, const float * d_refstd,
+                                const Matrix3D * d_h, const int hstride, const int nrefs, const float current_depth,
+                                const unsigned int winsize, const float stdthresh,
+                                const int width, const int height,
+                                dim3 blocks, dim3 threads, float * d_subplane)
+{
+    const int n = winsize / 2;
+    size_t shared = 2 * (threads.x + 2 * n) * (threads.y + 2 * n) * sizeof(float);
+    planesweep_fused_NCC_batch_kernel<<<dim3(blocks.x, blocks.y, nrefs), threads, shared>>>(
+                d_depthmap, d_bestncc, d_subplane, d_pool, d_adjacency, adjstride, d_ref, d_refmean, d_refstd,
+                d_h, hstride, current_depth, winsize, stdthresh, width, height);
+}
+
+void planesweep_fused_NCC_band(float * d_depthmap, float * d_bestncc,
+                               const float * d_src, const float * d_ref,
+                               const float * d_refmean, const float * d_refstd,
+                               const Matrix3D * d_h, const float current_depth, const int plane,
+                               const int * d_planemin, const int * d_planemax,
+                               const int * d_blockmin, const int * d_blockmax,
+                               const unsigned int winsize, const float stdthresh,
+                               const int width, const int height,
+                               dim3 blocks, dim3 threads, float * d_subplane)
+{
+    const int n = winsize / 2;
+    size_t shared = 2 * (threads.x + 2 * n) * (threads.y + 2 * n) * sizeof(float);
+    planesweep_fused_NCC_band_kernel<<<blocks, threads, shared>>>(d_depthmap, d_bestncc, d_subplane, d_src, d_ref, d_refmean, d_refstd,
+                                                                  d_h, current_depth, plane, d_planemin, d_planemax,
+                                                                  d_blockmin, d_blockmax, winsize, stdthresh, width, height);
+}
+
+void planesweep_fused_SAD(float * d_depthmap, float * d_bestncc,
+                          const float * d_src, const float * d_ref,
+                          const Matrix3D * d_h, const float current_depth, const unsigned int winsize,
+                          const int width, const int height,
+                          dim3 blocks, dim3 threads, float * d_subplane)
+{
+    const int n = winsize / 2;
+    size_t shared = 2 * (threads.x + 2 * n) * (threads.y + 2 * n) * sizeof(float);
+    const LinearMemorySampler<> src = {d_src, width, height};
+    const SADCost<LinearMemorySampler<> > cost = {src, d_ref};
+    planesweep_fused_cost_kernel<<<blocks, threads, shared>>>(d_depthmap, d_bestncc, d_subplane, cost, d_h, current_depth,
+                                                              winsize, width, height);
+}
+
+void planesweep_fused_census(float * d_depthmap, float * d_bestncc,
+                             const unsigned long long * d_src, const unsigned long long * d_ref,
+                             const Matrix3D * d_h, const float current_depth, const unsigned int winsize,
+                             const int width, const int height,
+                             dim3 blocks, dim3 threads, float * d_subplane)
+{
+    const int n = winsize / 2;
+    size_t shared = 2 * (threads.x + 2 * n) * (threads.y + 2 * n) * sizeof(float);
+    const CensusCost cost = {d_src, d_ref, width, height};
+    planesweep_fused_cost_kernel<<<blocks, threads, shared>>>(d_depthmap, d_bestncc, d_subplane, cost, d_h, current_depth,
+                                                              winsize, width, height);
+}
+
+void planesweep_rectified_NCC(float * d_depthmap, float * d_bestncc,
+                              const float * d_src, const float * d_ref,
+                              const float * d_refmean, const float * d_refstd,
+                              const float * d_disparity, const float * d_depth,
+                              const int nplanes, const int dmin, const int dmax,
+                              const unsigned int winsize, const float stdthresh,
+                              const int width, const int height,
+                              dim3 blocks, dim3 threads, float * d_subplane)
+{
+    typedef void (*kernel_type)(float *, float *, float *, const float *, const float *, const float *, const float *,
+                                const float *, const float *, const int, const int, const int,
+                                const unsigned int, const float, const int, const int);
+    kernel_type kernel;
+    switch (winsize) {
+    case 3:  kernel = planesweep_rectified_NCC_kernel<3>; break;
+    case 5:  kernel = planesweep_rectified_NCC_kernel<5>; break;
+    case 7:  kernel = planesweep_rectified_NCC_kernel<7>; break;
+    case 9:  kernel = planesweep_rectified_NCC_kernel<9>; break;
+    case 11: kernel = planesweep_rectified_NCC_kernel<11>; break;
+    case 15: kernel = planesweep_rectified_NCC_kernel<15>; break;
+    default: kernel = planesweep_rectified_NCC_kernel<0>;
+    }
+
+    const int n = winsize / 2;
+    const int tw = threads.x + 2 * n, th = threads.y + 2 * n;
+    size_t shared = (2 * tw + dmax - dmin + 1) * th * sizeof(float);
+    kernel<<<blocks, threads, shared>>>(d_depthmap, d_bestncc, d_subplane, d_src, d_ref, d_refmean, d_refstd,
+                                        d_disparity, d_depth, nplanes, dmin, dmax, winsize, stdthresh, width, height);
+}
+
+int planesweep_rectified_span(const unsigned int winsize, dim3 threads)
+{
+    int dev = 0, shared = 0;
+    CHECK_CUDA_ERRORS_AUTO(cudaGetDevice(&dev));
+    CHECK_CUDA_ERRORS_AUTO(cudaDeviceGetAttribute(&shared, cudaDevAttrMaxSharedMemoryPerBlock, dev));
+
+    const int n = winsize / 2;
+    const int tw = threads.x + 2 * n, th = threads.y + 2 * n;
+    return shared / (int)(th * sizeof(float)) - 2 * tw - 1;
+}
+
+void planesweep_volume_NCC(unsigned char * d_volume, float * d_sum,
+                           const float * d_src, const float * d_ref,
+                           const float * d_refmean, const float * d_refstd,
+                           const Matrix3D * d_h, const int plane, const int nplanes,
+                           const int view, const int nviews,
+                           const unsigned int winsize, const float stdthresh,
+                           const int width, const int height,
+                           dim3 blocks, dim3 threads)
+{
+    const int n = winsize / 2;
+    size_t shared = 2 * (threads.x + 2 * n) * (threads.y + 2 * n) * sizeof(float);
+    planesweep_volume_NCC_kernel<<<blocks, threads, shared>>>(d_volume, d_sum, d_src, d_ref, d_refmean, d_refstd,
+                                                              d_h, plane, nplanes, view, nviews, winsize, stdthresh,
+                                                              width, height);
+}
+
+void sgm_aggregate(unsigned short * d_aggregated, const unsigned char * d_volume, const int nplanes,
+                   const unsigned int paths, const int P1, const int P2, const int width, const int height)
+{
+    // horizontal and vertical paths first, diagonals for 8 paths
+    const int dirs[8][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {-1, -1}, {1, -1}, {-1, 1}};
+    const dim3 threads(32, SGM_WARPS_PER_BLOCK);
+    for (unsigned int r = 0; r < std::min(paths, 8u); r++) {
+        const int dx = dirs[r][0], dy = dirs[r][1];
+        const int traces = dy == 0 ? height : (dx == 0 ? width : width + height - 1);
+        const dim3 blocks((traces + SGM_WARPS_PER_BLOCK - 1) / SGM_WARPS_PER_BLOCK);
+        sgm_aggregate_kernel<<<blocks, threads>>>(d_aggregated, d_volume, nplanes, dx, dy, P1, std::max(P1, P2),
+                                                 width, height);
+    }
+}
+
+void sgm_select(float * d_depthmap, float * d_count, const unsigned short * d_aggregated,
+                const unsigned char * d_volume, const float * d_depth, const int nplanes, const float nccthresh,
+                const int width, const int height, dim3 blocks, dim3 threads)
+{
+    sgm_select_kernel<<<blocks, threads>>>(d_depthmap, d_count, d_aggregated, d_volume, d_depth, nplanes,
+                                           (1.f - nccthresh) * SGM_COST_SCALE, width, height);
+}
+
+void patchmatch_init(float4 * d_planes, float * d_score,
+                     const float * d_src, const float * d_ref,
+                     const float * d_refmean, const float * d_refstd,
+                     const Matrix3D * d_KRK, const float3 * d_Kt, const Matrix3D & invK,
+                     const int nviews, const int best, const float znear, const float zfar, const unsigned int seed,
+                     const unsigned int winsize, const float stdthresh,
+                     const int width, const int height,
+                     dim3 blocks, dim3 threads)
+{
+    typedef void (*kernel_type)(float4 *, float *, const float *, const float *, const float *, const float *,
+                                const Matrix3D *, const float3 *, const Matrix3D, const int, const int,
+                                const float, const float, const unsigned int, const unsigned int, const float,
+                                const int, const int);
+    kernel_type kernel;
+    switch (winsize) {
+    case 3:  kernel = patchmatch_init_kernel<3>; break;
+    case 5:  kernel = patchmatch_init_kernel<5>; break;
+    case 7:  kernel = patchmatch_init_kernel<7>; break;
+    case 9:  kernel = patchmatch_init_kernel<9>; break;
+    case 11: kernel = patchmatch_init_kernel<11>; break;
+    case 15: kernel = patchmatch_init_kernel<15>; break;
+    default: kernel = patchmatch_init_kernel<0>;
+    }
+
+    kernel<<<blocks, threads>>>(d_planes, d_score, d_src, d_ref, d_refmean, d_refstd, d_KRK, d_Kt, invK,
+                                std::min(nviews, PATCHMATCH_MAX_VIEWS), best, znear, zfar, seed, winsize, stdthresh,
+                                width, height);
+}
+
+void patchmatch_propagate(float4 * d_planes, float * d_score,
+                          const float * d_src, const float * d_ref,
+                          const float * d_refmean, const float * d_refstd,
+                          const Matrix3D * d_KRK, const float3 * d_Kt, const Matrix3D & invK,
+                          const int nviews, const int best, const float znear, const float zfar,
+                          const int parity, const float range, const unsigned int seed,
+                          const unsigned int winsize, const float stdthresh,
+                          const int width, const int height,
+                          dim3 blocks, dim3 threads)
+{
+    typedef void (*kernel_type)(float4 *, float *, const float *, const float *, const float *, const float *,
+                                const Matrix3D *, const float3 *, const Matrix3D, const int, const int,
+                                const float, const float, const int, const float, const unsigned int,
+                                const unsigned int, const float, const int, const int);
+    kernel_type kernel;
+    switch (winsize) {
+    case 3:  kernel = patchmatch_propagate_kernel<3>; break;
+    case 5:  kernel = patchmatch_propagate_kernel<5>; break;
+    case 7:  kernel = patchmatch_propagate_kernel<7>; break;
+    case 9:  kernel = patchmatch_propagate_kernel<9>; break;
+    case 11: kernel = patchmatch_propagate_kernel<11>; break;
+    case 15: kernel = patchmatch_propagate_kernel<15>; break;
+    default: kernel = patchmatch_propagate_kernel<0>;
+    }
+
+    kernel<<<blocks, threads>>>(d_planes, d_score, d_src, d_ref, d_refmean, d_refstd, d_KRK, d_Kt, invK,
+                                std::min(nviews, PATCHMATCH_MAX_VIEWS), best, znear, zfar, parity, range, seed,
+                                winsize, stdthresh, width, height);
+}
+
+void patchmatch_depthmap(float * d_depthmap, const float4 * d_planes, const float * d_score, const float nccthresh,
+                         const int width, const int height, dim3 blocks, dim3 threads)
+{
+    patchmatch_depthmap_kernel<<<blocks, threads>>>(d_depthmap, d_planes, d_score, nccthresh, width, height);
+}
+
+void census_transform(unsigned long long * d_census, const float * d_input,
+                      const int width, const int height, dim3 blocks, dim3 threads)
+{
+    census_transform_kernel<<<blocks, threads>>>(d_census, d_input, width, height);
+}
+
+void planesweep_band(int * d_planemin, int * d_planemax,
+                     const float * d_coarse, const int coarse_width, const int coarse_height,
+                     const float znear, const float dstep, const int radius, const int nplanes,
+                     const int width, const int height,
+                     dim3 blocks, dim3 threads, const bool inverse)
+{
+    planesweep_band_kernel<<<blocks, threads>>>(d_planemin, d_planemax, d_coarse, coarse_width, coarse_height,
+                                                znear, dstep, radius, nplanes, inverse, width, height);
+}
+
+void planesweep_block_band(int * d_blockmin, int * d_blockmax,
+                           const int * d_planemin, const int * d_planemax,
+                           const int width, const int height,
+                           dim3 blocks, dim3 threads)
+{
+    planesweep_block_band_kernel<<<blocks, threads>>>(d_blockmin, d_blockmax, d_planemin, d_planemax, width, height);
+}
+
+void downsample_half(float * d_output, const float * d_input,
+                     const int input_width, const int input_height,
+                     const int width, const int height,
+                     dim3 blocks, dim3 threads)
+{
+    downsample_half_kernel<<<blocks, threads>>>(d_output, d_input, input_width, input_height, width, height);
+}
+
+void upsample_double(float * d_output, const float * d_input,
+                     const int input_width, const int input_height,
+                     const int width, const int height,
+                     dim3 blocks, dim3 threads)
+{
+    upsample_double_kernel<<<blocks, threads>>>(d_output, d_input, input_width, input_height, width, height);
+}
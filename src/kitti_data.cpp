@@ -1,5 +1,6 @@
 #include "kitti_data.h"
 #include <QDir>
+#include <algorithm>
 
 namespace KITTI
 {
@@ -39,18 +40,108 @@ bool KITTIData::loadCalibration()
 
 bool KITTIData::loadData(int index)
 {
+    loaded = index;
     return loadImages(index) & loadOxTS(index) & loadVelo(index);
 }
 
 bool KITTIData::loadImages(int index)
 {
     bool sc = true;
+    imgs.resize(tsimg.size());
     for (int i = 0; i < tsimg.size(); i++){
         sc &= ReadImageFile(imgs[i], i, index);
     }
     return sc;
 }
 
+bool KITTIData::loadFrame(Frame & frame, int index) const
+{
+    frame.index = index;
+    frame.loaded = true;
+    frame.imgs.resize(tsimg.size());
+    for (int i = 0; i < tsimg.size(); i++) frame.loaded &= ReadImageFile(frame.imgs[i], i, index);
+    frame.loaded &= ReadOxTSFile(frame.oxts, index);
+    frame.loaded &= ReadVeloFile(frame.points, index);
+    return frame.loaded;
+}
+
+void KITTIData::startSequence(int first, int last, int step, int lookahead)
+{
+    stopSequence();
+    if (last < 0) last = getNumberOfTimestamps() - 1;
+    if (step < 1) step = 1;
+
+    std::lock_guard<std::mutex> lock(seqmutex);
+    seqlookahead = std::max(lookahead, 1);
+    seqstop = false;
+    seqdone = false;
+    seqthread = std::thread(&KITTIData::loadSequence, this, first, last, step);
+}
+
+void KITTIData::stopSequence()
+{
+    {
+        std::lock_guard<std::mutex> lock(seqmutex);
+        seqstop = true;
+    }
+    seqconsumed.notify_all();
+    if (seqthread.joinable()) seqthread.join();
+
+    std::lock_guard<std::mutex> lock(seqmutex);
+    seqframes.clear();
+    seqdone = true;
+}
+
+bool KITTIData::frameReady() const
+{
+    std::lock_guard<std::mutex> lock(seqmutex);
+    return !seqframes.empty();
+}
+
+bool KITTIData::consumeFrame(Frame & frame)
+{
+    {
+        std::unique_lock<std::mutex> lock(seqmutex);
+        seqloaded.wait(lock, [this]{ return !seqframes.empty() || seqdone; });
+        if (seqframes.empty()) return false;
+        frame = std::move(seqframes.front());
+        seqframes.pop_front();
+    }
+    seqconsumed.notify_one();
+    return true;
+}
+
+bool KITTIData::nextData()
+{
+    Frame frame;
+    if (!consumeFrame(frame)) return false;
+    loaded = frame.index;
+    imgs = frame.imgs;
+    oxts = frame.oxts;
+    points = frame.points;
+    return frame.loaded;
+}
+
+void KITTIData::loadSequence(int first, int last, int step)
+{
+    for (int index = first; index <= last; index += step){
+        // files are read without holding the lock, only the queue is shared
+        Frame frame;
+        loadFrame(frame, index);
+
+        std::unique_lock<std::mutex> lock(seqmutex);
+        seqconsumed.wait(lock, [this]{ return seqstop || ((int)seqframes.size() < seqlookahead); });
+        if (seqstop) break;
+        seqframes.push_back(std::move(frame));
+        lock.unlock();
+        seqloaded.notify_one();
+    }
+
+    std::lock_guard<std::mutex> lock(seqmutex);
+    seqdone = true;
+    seqloaded.notify_all();
+}
+
 bool KITTIData::loadOxTS(int index)
 {
     return ReadOxTSFile(oxts, index);
@@ -61,6 +152,30 @@ bool KITTIData::loadVelo(int index)
     return ReadVeloFile(points, index);
 }
 
+bool KITTIData::loadVeloScan(int index, int prefetch)
+{
+    // Scans of the next indexes are read ahead while this one is used
+    QVector<int> next;
+    for (int i = 1; (i <= prefetch) && (index + i < tsvelo.size()); i++) next.append(index + i);
+    PrefetchVelodyneData(next);
+    return ReadVeloFile(scan, index);
+}
+
+bool KITTIData::loadPoseIndex()
+{
+    // OxTS poses relative to the first one and their timestamps, built once next to the data
+    return poses.openOrBuild(KITTI_DIR_AND_NAME(bdir, KITTI_POSE_INDEX_NAME), KITTI_OXTS_TIMESTAMPS(bdir),
+                             [this](const QString & fname){ return PoseIndex::buildKITTI(fname, *this, K); });
+}
+
+bool KITTIData::getOxTSPose(int index, Matrix4D & pose) const
+{
+    const PoseIndex::Record * r = poses.record(index);
+    if (!r) return false;
+    pose = Matrix4D(Transformation3D(r->R, r->t), make_float4(0,0,0,1));
+    return true;
+}
+
 void KITTIData::loadReference()
 {
     OxTS o;
@@ -1,11 +1,14 @@
 #include "kitti_reader.h"
+#include "reader.h"
 #include <QFile>
 #include <QTextStream>
 #include <QStringList>
-#include <QMessageBox>
 #include <QDir>
 #include <QByteArray>
 #include <QList>
+#include <fcntl.h>
+#include "cuda_exception.h"
+#include "image_loader.h"
 
 namespace KITTI
 {
@@ -14,7 +17,7 @@ bool KITTIReader::ReadCalibrationCam2Cam(QVector<CamProperties> & cprops, double
     // try opening file
     QFile file(fname);
     if(!file.open(QIODevice::ReadOnly)) {
-        QMessageBox::information(0, "Error reading KITTI calibration file", QString("%1: %2").arg(fname).arg(file.errorString()));
+        Reader::reportError("Error reading KITTI calibration file", QString("%1: %2").arg(fname).arg(file.errorString()));
         return false;
     }
 
@@ -140,10 +143,16 @@ bool KITTIReader::ReadImages(QVector<TimedImage> & img, const QVector<int> & ind
 
     if (!ReadTimestampFile(list, KITTI_CAM_TIMESTAMPS(bdir, cam))) tss = false;
 
+    // decode in parallel, then collect in order
+    ImageLoader & loader = ImageLoader::instance();
+    ImageLoader::Frame frame;
+    for (int j = 0; j < indexes.size(); j++) loader.request(KITTI_IMAGE_NAME(bdir, cam, indexes[j], fnw), true);
+
     for (int j = 0; j < indexes.size(); j++)
     {
         img[j].cam = cam;
-        if (!img[j].img.load(KITTI_IMAGE_NAME(bdir, cam, indexes[j], fnw))) success = false;
+        if (!loader.take(KITTI_IMAGE_NAME(bdir, cam, indexes[j], fnw), frame)) success = false;
+        img[j].img = frame.image;
         if (tss) img[j].tstamp = string2seconds(list.at(indexes[j]));
     }
 
@@ -155,9 +164,14 @@ bool KITTIReader::ReadImages(QVector<QImage> & img, const QVector<int> & indexes
     img.resize(indexes.size());
     bool success = true;
 
+    ImageLoader & loader = ImageLoader::instance();
+    ImageLoader::Frame frame;
+    for (int j = 0; j < indexes.size(); j++) loader.request(KITTI_IMAGE_NAME(bdir, cam, indexes[j], fnw), true);
+
     for (int j = 0; j < indexes.size(); j++)
     {
-        if (!img[j].load(KITTI_IMAGE_NAME(bdir, cam, indexes[j], fnw))) success = false;
+        if (!loader.take(KITTI_IMAGE_NAME(bdir, cam, indexes[j], fnw), frame)) success = false;
+        img[j] = frame.image;
     }
 
     return success;
@@ -234,7 +248,7 @@ bool KITTIReader::ReadRT(Transformation3D & T, const QString & fname)
     // try opening file
     QFile file(fname);
     if(!file.open(QIODevice::ReadOnly)) {
-        QMessageBox::information(0, "Error reading KITTI calibration file", QString("%1: %2").arg(fname).arg(file.errorString()));
+        Reader::reportError("Error reading KITTI calibration file", QString("%1: %2").arg(fname).arg(file.errorString()));
         return false;
     }
 
@@ -271,7 +285,7 @@ bool KITTIReader::ReadTimestampFile(QStringList &ts, const QString &fname)
 {
     QFile file(fname);
     if(!file.open(QIODevice::ReadOnly)) {
-        QMessageBox::information(0, "Error reading KITTI timestamp file", QString("%1: %2").arg(fname).arg(file.errorString()));
+        Reader::reportError("Error reading KITTI timestamp file", QString("%1: %2").arg(fname).arg(file.errorString()));
         return false;
     }
 
@@ -306,7 +320,7 @@ bool KITTIReader::ReadOxTSFile(OxTS &data, const QString &fname)
 {
     QFile file(fname);
     if(!file.open(QIODevice::ReadOnly)) {
-        QMessageBox::information(0, "Error reading KITTI OxTS file", QString("%1: %2").arg(fname).arg(file.errorString()));
+        Reader::reportError("Error reading KITTI OxTS file", QString("%1: %2").arg(fname).arg(file.errorString()));
         return false;
     }
 
@@ -349,29 +363,67 @@ bool KITTIReader::ReadOxTSFile(OxTS &data, const QString &fname)
 }
 
 bool KITTIReader::ReadVeloFile(QVector<VeloPoint> &points, const QString &fname)
+{
+    VeloScan scan;
+    if (!scan.open(fname)) return false;
+
+    points.resize(scan.size());
+    for (int i = 0; i < points.size(); i++) points[i] = VeloPoint(scan[i]);
+
+    return true;
+}
+
+void KITTIReader::PrefetchVeloFile(const QString & fname)
 {
     QFile file(fname);
+    if (!file.open(QIODevice::ReadOnly)) return;
+    posix_fadvise(file.handle(), 0, 0, POSIX_FADV_WILLNEED);
+    file.close();
+}
+
+void KITTIReader::PrefetchVelodyneData(const QVector<int> & indexes) const
+{
+    for (int j = 0; j < indexes.size(); j++) PrefetchVeloFile(KITTI_VELO_NAME(bdir, indexes[j], fnw));
+}
+
+bool VeloScan::open(const QString & fname)
+{
+    close();
+    file.setFileName(fname);
     if(!file.open(QIODevice::ReadOnly)) {
-        QMessageBox::information(0, "Error reading KITTI Velodyne file", QString("%1: %2").arg(fname).arg(file.errorString()));
+        Reader::reportError("Error reading KITTI Velodyne file", QString("%1: %2").arg(fname).arg(file.errorString()));
         return false;
     }
 
-    QByteArray data = file.readAll();
-    float *px = (float *)data.data()+0;
-    float *py = (float *)data.data()+1;
-    float *pz = (float *)data.data()+2;
-    float *pr = (float *)data.data()+3;
-    points.resize(data.size() / 4 / 4);
-    for (int i = 0; i < points.size(); i++)
-    {
-        points[i] = VeloPoint(*px, *py, *pz, *pr);
-        px+=4; py+=4; pz+=4; pr+=4;
+    // Records are 4 floats, mapping is page aligned so they can be read as float4
+    n = file.size() / sizeof(float4);
+    if (n == 0) {
+        file.close();
+        return true;
+    }
+    pts = (const float4 *)file.map(0, n * sizeof(float4));
+    if (!pts) {
+        Reader::reportError("Error mapping KITTI Velodyne file", QString("%1: %2").arg(fname).arg(file.errorString()));
+        close();
+        return false;
     }
-
-    file.close();
     return true;
 }
 
+void VeloScan::close()
+{
+    if (pts) file.unmap((uchar *)pts);
+    if (file.isOpen()) file.close();
+    pts = 0;
+    n = 0;
+}
+
+void VeloScan::upload(float4 * d_points, cudaStream_t stream) const
+{
+    if (n == 0) return;
+    CHECK_CUDA_ERRORS_AUTO(cudaMemcpyAsync(d_points, pts, sizeBytes(), cudaMemcpyHostToDevice, stream));
+}
+
 bool KITTIReader::setCalibrationDir(const QString & calib_dir)
 {
     if (!QDir(calib_dir).exists()) return false;
@@ -0,0 +1,164 @@
+#include "launch_tuner.h"
+#include "cuda_exception.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+
+LaunchTuner & LaunchTuner::instance()
+{
+    static LaunchTuner tuner;
+    return tuner;
+}
+
+LaunchTuner::LaunchTuner(const std::string & fname) : fname_(fname)
+{
+    load();
+}
+
+void LaunchTuner::setCacheFile(const std::string & fname)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    fname_ = fname;
+    configs_.clear();
+    load();
+}
+
+bool LaunchTuner::find(const std::string & family, int width, int height, int depth, dim3 & threads)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = configs_.find(key(family, width, height, depth));
+    if (it == configs_.end()) return false;
+    threads = it->second;
+    return true;
+}
+
+dim3 LaunchTuner::tune(const std::string & family, int width, int height, int depth, int suggested, int maxthreads,
+                       const trial_type & trial)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const std::string k = key(family, width, height, depth);
+    auto it = configs_.find(k);
+    if (it != configs_.end()) return it->second;
+
+    std::vector<dim3> c = candidates(depth, suggested, maxthreads);
+    dim3 best = c.front();
+    float besttime = -1;
+    for (size_t i = 0; i < c.size(); i++) {
+        float t = time(trial, c[i]);
+        if ((t >= 0) && ((besttime < 0) || (t < besttime))) {
+            besttime = t;
+            best = c[i];
+        }
+    }
+
+    // Nothing launched, keep first candidate but do not remember it
+    if (besttime < 0) return best;
+    configs_[k] = best;
+    save();
+    return best;
+}
+
+void LaunchTuner::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    configs_.clear();
+}
+
+std::string LaunchTuner::key(const std::string & family, int width, int height, int depth)
+{
+    std::ostringstream s;
+    s << deviceName() << '\t' << family << '\t' << width << '\t' << height << '\t' << depth;
+    return s.str();
+}
+
+std::string LaunchTuner::deviceName()
+{
+    int dev = 0;
+    CHECK_CUDA_ERRORS_AUTO(cudaGetDevice(&dev));
+    auto it = devices_.find(dev);
+    if (it != devices_.end()) return it->second;
+
+    cudaDeviceProp prop;
+    CHECK_CUDA_ERRORS_AUTO(cudaGetDeviceProperties(&prop, dev));
+    return devices_[dev] = prop.name;
+}
+
+std::vector<dim3> LaunchTuner::candidates(int depth, int suggested, int maxthreads) const
+{
+    std::vector<dim3> c;
+    auto add = [&](dim3 t){
+        const int n = t.x * t.y * t.z;
+        if ((n < MIN_LAUNCH_TUNER_THREADS) || (n > maxthreads) || (n % 32)) return;
+        for (size_t i = 0; i < c.size(); i++)
+            if ((c[i].x == t.x) && (c[i].y == t.y) && (c[i].z == t.z)) return;
+        c.push_back(t);
+    };
+
+    // Occupancy suggestion goes first in the shape of the default configuration
+    suggested = std::min(suggested, maxthreads);
+    if (depth <= 1) {
+        if (suggested > 0) add(dim3(DEFAULT_BLOCK_XDIM, std::max(suggested / DEFAULT_BLOCK_XDIM, 1)));
+        for (int x = 8; x <= 128; x *= 2)
+            for (int y = 1; y <= 32; y *= 2) add(dim3(x, y));
+        if (c.empty()) c.push_back(dim3(DEFAULT_BLOCK_XDIM, std::max(maxthreads / DEFAULT_BLOCK_XDIM, 1)));
+    }
+    else {
+        const int xy = DEFAULT_FUSION_THREADS_X * DEFAULT_FUSION_THREADS_Y;
+        if (suggested > 0) add(dim3(DEFAULT_FUSION_THREADS_X, DEFAULT_FUSION_THREADS_Y, std::max(suggested / xy, 1)));
+        for (int x = 8; x <= 32; x *= 2)
+            for (int y = 2; y <= 16; y *= 2)
+                for (int z = 1; z <= 8; z *= 2) add(dim3(x, y, z));
+        if (c.empty()) c.push_back(dim3(DEFAULT_FUSION_THREADS_X, DEFAULT_FUSION_THREADS_Y, std::max(maxthreads / xy, 1)));
+    }
+    return c;
+}
+
+float LaunchTuner::time(const trial_type & trial, dim3 threads) const
+{
+    // Candidates exceeding register or shared memory limits fail to launch, the error is cleared
+    trial(threads);
+    if (cudaGetLastError() != cudaSuccess) return -1;
+
+    // Events are destroyed on every return and when a check throws
+    struct Event {
+        cudaEvent_t e = 0;
+        ~Event() { if (e) cudaEventDestroy(e); }
+    } start, stop;
+    CHECK_CUDA_ERRORS_AUTO(cudaEventCreate(&start.e));
+    CHECK_CUDA_ERRORS_AUTO(cudaEventCreate(&stop.e));
+    CHECK_CUDA_ERRORS_AUTO(cudaEventRecord(start.e));
+    for (int i = 0; i < DEFAULT_LAUNCH_TUNER_TRIALS; i++) trial(threads);
+    CHECK_CUDA_ERRORS_AUTO(cudaEventRecord(stop.e));
+    CHECK_CUDA_ERRORS_AUTO(cudaEventSynchronize(stop.e));
+
+    float ms = -1;
+    if (cudaGetLastError() == cudaSuccess) CHECK_CUDA_ERRORS_AUTO(cudaEventElapsedTime(&ms, start.e, stop.e));
+    return ms;
+}
+
+void LaunchTuner::load()
+{
+    if (fname_.empty()) return;
+    std::ifstream in(fname_.c_str());
+    std::string line;
+    while (std::getline(in, line)) {
+        std::vector<std::string> f;
+        std::istringstream s(line);
+        std::string field;
+        while (std::getline(s, field, '\t')) f.push_back(field);
+        if (f.size() != 8) continue;
+
+        const int x = std::atoi(f[5].c_str()), y = std::atoi(f[6].c_str()), z = std::atoi(f[7].c_str());
+        if ((x <= 0) || (y <= 0) || (z <= 0)) continue;
+        configs_[f[0] + '\t' + f[1] + '\t' + f[2] + '\t' + f[3] + '\t' + f[4]] = dim3(x, y, z);
+    }
+}
+
+void LaunchTuner::save()
+{
+    if (fname_.empty()) return;
+    std::ofstream out(fname_.c_str(), std::ios::trunc);
+    for (auto it = configs_.begin(); it != configs_.end(); ++it)
+        out << it->first << '\t' << it->second.x << '\t' << it->second.y << '\t' << it->second.z << '\n';
+}
@@ -0,0 +1,134 @@
+#include "memory_planner.h"
+#include "structs.h"
+#include "memory.h"
+#include "cuda_exception.h"
+#include <algorithm>
+#include <string>
+
+// Sum of level sizes of a pyramid relative to its finest level
+static double pyramidFactor(int levels)
+{
+    double f = 0, s = 1;
+    for (int l = 0; l < std::max(levels, 1); l++, s *= 0.25) f += s;
+    return f;
+}
+
+MemoryEstimate MemoryPlanner::planesweep(int width, int height, int images, int planes, bool fused, bool multiview,
+                                         bool census, bool tiled, bool volume, bool subplane)
+{
+    const size_t frame = size_t(width) * height * sizeof(float), row = size_t(width) * sizeof(float);
+    MemoryEstimate e;
+    e.fixed = size_t(images) * planes * sizeof(Matrix3D);
+
+    if (tiled) {
+        // Full reference, normalized reference, averaged depthmap and one source view, strips sweep the separable way
+        e.fixed += 4 * frame;
+        e.perRow = (subplane ? 15 : 12) * row;
+        return e;
+    }
+
+    // Reference, normalized reference, statistics, intermediate image, depthmap sums and counts, validity, confidence
+    // and mask
+    double frames = 10;
+
+    // Best NCC, depth and source view of each swept view
+    frames += multiview ? 3 * images : 3;
+    if (!fused) frames += 5;
+    if (census) frames += 4;
+    if (volume) frames += images + 1;
+
+    // Scores of the planes around the best one for sub-plane fits
+    if (subplane) frames += multiview ? 3 * images : 3;
+    e.perRow = size_t(frames * row);
+    if (volume) e.perRow += size_t(planes) * width * (sizeof(unsigned char) + sizeof(unsigned short));
+    return e;
+}
+
+size_t MemoryPlanner::batch(int width, int height, int refs, int sources, int planes, bool subplane)
+{
+    const size_t frame = size_t(width) * height * sizeof(float);
+
+    // Pool, intermediate image and per reference view the reference, statistics, depthmap sums and counts, best NCC
+    // and depth of the current source slot
+    double frames = sources + 1 + 7.0 * refs;
+    if (subplane) frames += 3 * refs;
+    return size_t(frames * frame) + size_t(refs) * sources * planes * sizeof(Matrix3D);
+}
+
+MemoryEstimate MemoryPlanner::tvl1(int width, int height, bool check, bool tiled, bool fused)
+{
+    const size_t frame = size_t(width) * height * sizeof(float), row = size_t(width) * sizeof(float);
+    MemoryEstimate e;
+
+    // Solution, dual variables, scaled input and diffusion tensor, fused launches alternate with a second state
+    const int frames = 9 + (check ? 1 : 0) + (fused ? 4 : 0);
+    if (tiled) e.fixed = frame;
+    e.perRow = frames * row;
+    return e;
+}
+
+MemoryEstimate MemoryPlanner::tgv(int width, int height, int images, int levels, bool texture, bool tiled)
+{
+    const size_t frame = size_t(width) * height * sizeof(float), row = size_t(width) * sizeof(float);
+    const double f = pyramidFactor(levels);
+    MemoryEstimate e;
+
+    // Solver state of each level: u, u0, ubar and prodsum, packed p, q, u1 and tensor, previous solution and It, Iu, r
+    // per view
+    const double state = 19 + 3 * images;
+    const double textures = texture ? images : 0;
+    if (tiled) {
+        // Full reference, source pyramids and textures of a level stay on the device, reference and seed pyramids
+        // are built per strip
+        e.fixed = size_t((1 + f * images + textures) * frame);
+        e.perRow = size_t(f * (state + 2) * row);
+        return e;
+    }
+    e.perRow = size_t((f * (state + 2 + images) + textures) * row);
+    return e;
+}
+
+size_t MemoryPlanner::fusion(size_t voxels, size_t voxelbytes, bool scratch)
+{
+    return voxels * (voxelbytes + (scratch ? sizeof(float) + sizeof(float3) : 0));
+}
+
+size_t MemoryPlanner::available(size_t limit)
+{
+    size_t free = 0, total = 0;
+    CHECK_CUDA_ERRORS_AUTO(cudaMemGetInfo(&free, &total));
+    free += MemoryPool::instance().stats().bytesCached;
+    return limit ? std::min(free, limit) : free;
+}
+
+bool MemoryPlanner::fits(size_t bytes, size_t available)
+{
+    return bytes <= size_t(DEFAULT_MEMORY_HEADROOM * available);
+}
+
+std::vector<Strip> MemoryPlanner::strips(const MemoryEstimate & e, int height, int halo, size_t available)
+{
+    const size_t budget = size_t(DEFAULT_MEMORY_HEADROOM * available);
+
+    // Largest computed strip height that fits, kept rows are what remains after both halos
+    const long long computed = (budget > e.fixed) && e.perRow ? (long long)((budget - e.fixed) / e.perRow) : 0;
+    const long long rows = computed - 2 * halo;
+    if (rows < MIN_STRIP_ROWS)
+        THROW_EXCEP("Working set of " + std::to_string(e.bytes(height) >> 20) + " MB does not fit into " +
+                    std::to_string(budget >> 20) + " MB of device memory, not even in strips of " +
+                    std::to_string(MIN_STRIP_ROWS) + " rows");
+    if (computed >= height) return frame(height);
+
+    // Strips at the borders move their computed rows inwards, so all strips have the same size and workspace
+    // images are allocated once
+    std::vector<Strip> s;
+    for (int y0 = 0; y0 < height; y0 += rows) {
+        Strip st;
+        st.y0 = y0;
+        st.rows = std::min((int)rows, height - y0);
+        st.h = (int)computed;
+        st.r0 = std::min(std::max(y0 - halo, 0), height - st.h);
+        s.push_back(st);
+    }
+    return s;
+}
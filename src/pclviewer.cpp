@@ -3,6 +3,8 @@
 
 #include "pclviewer.h"
 #include "ui_pclviewer.h"
+#include "nvtx_range.h"
+#include "launch_tuner.h"
 #include <iostream>
 #include <QPixmap>
 #include <QColor>
@@ -11,10 +13,14 @@
 #include <QTextStream>
 #include <QStringList>
 #include <QMessageBox>
+#include <QThread>
+#include <QApplication>
 #include <cmath>
 #include <pcl/io/pcd_io.h>
 #include <pcl/io/ply_io.h>
-#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
 #include <QVector>
 #include <QRgb>
 #include <dev_functions.h>
@@ -69,6 +75,15 @@ PCLViewer::PCLViewer (int argc, char **argv, QWidget *parent) :
     connect(ui->cbar, SIGNAL(selected(double)), this, SLOT(colorbar_selected(double)));
     connect(ui->cbardenoised, SIGNAL(selected(double)), this, SLOT(colorbar_selected(double)));
     connect(ui->cbarTGV, SIGNAL(selected(double)), this, SLOT(colorbar_selected(double)));
+
+    // file errors of readers are shown in a message box, errors of loader threads can only be printed
+    Reader::setErrorHandler([](const QString & title, const QString & message){
+        if (QThread::currentThread() == qApp->thread()) QMessageBox::information(0, title, message);
+        else std::cerr << title.toStdString() << ": " << message.toStdString() << std::endl;
+    });
+
+    // results of compute jobs are shown in the GUI thread
+    connect(&worker, SIGNAL(finished(unsigned int,int,bool)), this, SLOT(computeFinished(unsigned int,int,bool)));
 }
 
 void PCLViewer::colorbar_selected(double value)
@@ -79,6 +94,9 @@ void PCLViewer::colorbar_selected(double value)
 
 void PCLViewer::setupPlanesweep()
 {
+    // Stage timings of every planesweep, denoising and TGV call go to the console
+    ps.setVerbose(true);
+
     // Setup the raw planesweep cloud pointer
     cloud.reset (new PointCloudT);
 
@@ -328,6 +346,9 @@ PCLViewer::pSliderValueChanged (int value)
 
 void PCLViewer::LoadImages()
 {
+    // host images are only written while no job uses them
+    worker.wait();
+
     // Load 0th image from source directory
     QString loc = "/PlaneSweep/im";
     QString ref = SOURCE_DIR;
@@ -409,10 +430,15 @@ void PCLViewer::LoadImages()
     rgb2gray<float>(ps.HostRef.data(), refim);
     ps.HostRef.R = Rref; ps.HostRef.t = tref;
 
-    // setup source images
+    // color of the reference view is kept for the clouds, views of a previously loaded directory are replaced
+    rgb2rgba(ps.HostRefRGBA, refim);
+
+    // setup source images, color views are allocated up front since CamImage copies do not own memory
     QString src;
     QImage sources;
     ps.HostSrc.resize(9);
+    ps.HostSrcRGBA.clear();
+    ps.HostSrcRGBA.resize(9);
     for (int i = 0; i < 9; i++){
         src = SOURCE_DIR;
         src += loc;
@@ -421,6 +447,7 @@ void PCLViewer::LoadImages()
         sources.load(src);
         ps.HostSrc[i].reset(w,h);
         rgb2gray<float>(ps.HostSrc[i].data(), sources);
+        rgb2rgba(ps.HostSrcRGBA[i], sources);
         ps.HostSrc[i].R = Rsrc[i]; ps.HostSrc[i].t = tsrc[i];
     }
 
@@ -429,115 +456,95 @@ void PCLViewer::LoadImages()
 
 PCLViewer::~PCLViewer ()
 {
+    // running job still uses argv
+    worker.cancel();
+    worker.wait();
+
     // free resources
     delete[] argv;
     delete ui;
 }
 
-void PCLViewer::on_pushButton_pressed()
+PCLViewer::SweepSettings PCLViewer::sweepSettings() const
 {
-    if (ps.RunAlgorithm(argc, argv)){
-        // get depthmaps
-        ui->maxthreads->setValue(ps.getMaxThreadsPerBlock());
-        depth = ps.getDepthmap();
-        depth8u = ps.getDepthmap8u();
-
-        // resize cloud if reference image has changed
-        if (refchanged) {
-            if ((cloud->height != depth8u->height()) || (cloud->width != depth8u->width()))
-            {
-                // The number of points in the cloud
-                cloud->points.resize(depth8u->width() * depth8u->height());
-                cloud->width = depth8u->width();
-                cloud->height = depth8u->height();
-            }
-        }
-
-        QColor c;
-        int  i;
-        Matrix3D k = ps.getInverseK();
-        double z;
-
-        // update colorbar range
-        ui->cbar->setRangeMin(ui->zNear->value());
-        ui->cbar->setRangeMax(ui->zFar->value());
-
-        // Fill the cloud with points
-        for (size_t x = 0; x < depth8u->width(); ++x)
-            for (size_t y = 0; y < depth8u->height(); ++y)
-            {
-
-                i = x + y * depth8u->width();
-                z = depth->data()[i];
-
-                cloud->points[i].z = sign(k(1,1)) * z;
-                cloud->points[i].x = z * (k(0,0) * x + k(0,1) * y + k(0,2));
-                cloud->points[i].y = z * (k(1,0) * x + k(1,1) * y + k(1,2));
-
-                // Only update colors if reference image has changed
-                if (refchanged)
-                {
-                    c = refim.pixel(x, y);
-                    cloud->points[i].r = c.red();
-                    cloud->points[i].g = c.green();
-                    cloud->points[i].b = c.blue();
-                }
-                //depth8u->data[i] = (uchar)d;
-            }
-
-        // Show grayscale depthmap
-        QImage img(depth8u->data(), depth8u->width(), depth8u->height(), QImage::Format_Indexed8);
-        img.setColorTable(ctable);
-
-        depthim = QPixmap::fromImage(img);
-        depthscene->addPixmap(depthim);
-        depthscene->setSceneRect(depthim.rect());
-        ui->depthview->setScene(depthscene);
-
-        // show point cloud
-        viewer->updatePointCloud(cloud, "cloud");
-        if (refchanged) viewer->resetCamera();
-        ui->qvtkWidget->update();
-        refchanged = false;
-    }
+    SweepSettings s;
+    s.images = ui->imNumber->value();
+    s.winsize = 2 * (ui->winSize->value() / 2) + 1;
+    s.planes = ui->numberPlanes->value();
+    s.threadsx = ui->threadsx->value();
+    s.threadsy = ui->threadsy->value();
+    s.znear = ui->zNear->value();
+    s.zfar = ui->zFar->value();
+    s.stdthresh = ui->stdThresh->value();
+    s.nccthresh = ui->nccThresh->value();
+    s.altmethod = ui->altmethod->isChecked();
+    return s;
 }
 
-void PCLViewer::on_imNumber_valueChanged(int arg1)
+void PCLViewer::applySettings(const SweepSettings & s)
 {
-    ps.setNumberofImages(arg1);
+    ps.setNumberofImages(s.images);
+    ps.setWindowSize(s.winsize);
+    ps.setNumberofPlanes(s.planes);
+    ps.setBlockXdim(s.threadsx);
+    ps.setBlockYdim(s.threadsy);
+    ps.setZnear(s.znear);
+    ps.setZfar(s.zfar);
+    ps.setSTDthreshold(s.stdthresh);
+    ps.setNCCthreshold(s.nccthresh);
+    ps.setAlternativeRelativeMatrixMethod(s.altmethod);
 }
 
-void PCLViewer::on_winSize_valueChanged(int arg1)
+void PCLViewer::on_pushButton_pressed()
 {
-    // Make sure arg1 is odd
-    arg1 = 2 * (arg1 / 2) + 1;
-    ui->winSize->setValue(arg1);
-    ps.setWindowSize(arg1);
+    std::shared_ptr<JobResult> res(new JobResult);
+    const SweepSettings settings = sweepSettings();
+    const unsigned int id = worker.submit(ComputeWorker::JobSweep, [this, res, settings]() {
+        applySettings(settings);
+        if (!ps.RunAlgorithm(argc, argv)) return false;
+
+        // get depthmaps, copied since the next job may overwrite them while they are shown
+        CamImage<float> * depth = ps.getDepthmap();
+        CamImage<uchar> * depth8u = ps.getDepthmap8u();
+        res->depth8u = QImage(depth8u->data(), depth8u->width(), depth8u->height(), QImage::Format_Indexed8).copy();
+        res->cloud.reset(new PointCloudT(depth8u->width(), depth8u->height()));
+
+        // Fill the cloud with points back-projected on the device
+        return ps.getPoints(res->cloud->points.data(), sizeof(PointT), offsetof(PointT, rgba), *depth, ps.getDepthmapPtr());
+    });
+    results[id] = res;
 }
 
-void PCLViewer::on_numberPlanes_valueChanged(int arg1)
+void PCLViewer::showDepthmap(const JobResult & res)
 {
-    ps.setNumberofPlanes(arg1);
-}
+    ui->maxthreads->setValue(ps.getMaxThreadsPerBlock());
 
-void PCLViewer::on_zNear_valueChanged(double arg1)
-{
-    ps.setZnear(arg1);
-}
+    // update colorbar range
+    ui->cbar->setRangeMin(ui->zNear->value());
+    ui->cbar->setRangeMax(ui->zFar->value());
 
-void PCLViewer::on_zFar_valueChanged(double arg1)
-{
-    ps.setZfar(arg1);
-}
+    // Show grayscale depthmap
+    QImage img = res.depth8u;
+    img.setColorTable(ctable);
 
-void PCLViewer::on_stdThresh_valueChanged(double arg1)
-{
-    ps.setSTDthreshold(arg1);
+    depthim = QPixmap::fromImage(img);
+    depthscene->addPixmap(depthim);
+    depthscene->setSceneRect(depthim.rect());
+    ui->depthview->setScene(depthscene);
+
+    // show point cloud
+    cloud = res.cloud;
+    viewer->updatePointCloud(cloud, "cloud");
+    if (refchanged) viewer->resetCamera();
+    ui->qvtkWidget->update();
+    refchanged = false;
 }
 
-void PCLViewer::on_nccThresh_valueChanged(double arg1)
+void PCLViewer::on_winSize_valueChanged(int arg1)
 {
-    ps.setNCCthreshold(arg1);
+    // Make sure arg1 is odd
+    arg1 = 2 * (arg1 / 2) + 1;
+    ui->winSize->setValue(arg1);
 }
 
 void PCLViewer::on_pSlider2_valueChanged(int value)
@@ -549,157 +556,133 @@ void PCLViewer::on_pSlider2_valueChanged(int value)
 
 void PCLViewer::on_denoiseBtn_clicked()
 {
-    if (ps.CudaDenoise(argc, argv, ui->nIters->value(), ui->lambda->value(), ui->tvl1_tau->value(),
-                       ui->tvl1_sigma->value(), ui->tvl1_theta->value(), ui->tvl1_beta->value(), ui->tvl1_gamma->value())){
-
-        // get depthmaps
-        ui->maxthreads->setValue(ps.getMaxThreadsPerBlock());
-        dendepth = ps.getDepthmapDenoised();
-        dendepth8u = ps.getDepthmap8uDenoised();
-
-        // resize cloud if reference image has changed
-        if (refchangedtvl1)
-        {
-            if ((clouddenoised->height != dendepth8u->height()) || (clouddenoised->width != dendepth8u->width()))
-            {
-                // The number of points in the cloud
-                clouddenoised->points.resize(dendepth8u->width() * dendepth8u->height());
-                clouddenoised->width = dendepth8u->width();
-                clouddenoised->height = dendepth8u->height();
-            }
-        }
-
-        QColor c;
-        int  i;
-
-        Matrix3D k = ps.getInverseK();
-        double z;
-
-        // update colorbar range
-        ui->cbardenoised->setRangeMin(ui->zNear->value());
-        ui->cbardenoised->setRangeMax(ui->zFar->value());
-
-        // Fill the cloud
-        for (size_t x = 0; x < dendepth8u->width(); ++x)
-            for (size_t y = 0; y < dendepth8u->height(); ++y)
-            {
-
-                i = x + y * dendepth8u->width();
-
-                z = dendepth->data()[i];
-                clouddenoised->points[i].z = sign(k(1,1)) * z;
-                clouddenoised->points[i].x = z * (k(0,0) * x + k(0,1) * y + k(0,2));
-                clouddenoised->points[i].y = z * (k(1,0) * x + k(1,1) * y + k(1,2));
-
-                // only update colors if reference image has changed
-                if (refchangedtvl1)
-                {
-                    c = refim.pixel(x, y);
-                    clouddenoised->points[i].r = c.red();
-                    clouddenoised->points[i].g = c.green();
-                    clouddenoised->points[i].b = c.blue();
-                }
-            }
-
-        // show grayscale depthmap
-        QImage img(dendepth8u->data(), dendepth8u->width(), dendepth8u->height(), QImage::Format_Indexed8);
-        img.setColorTable(ctable);
-
-        dendepthim = QPixmap::fromImage(img);
-        dendepthsc->addPixmap(dendepthim);
-        dendepthsc->setSceneRect(dendepthim.rect());
-        ui->denview->setScene(dendepthsc);
-
-        // show point cloud
-        viewerdenoised->updatePointCloud(clouddenoised, "cloud");
-        if (refchangedtvl1) viewerdenoised->resetCamera();
-        ui->qvtkDenoised->update();
-        refchangedtvl1 = false;
-    }
+    const int niters = ui->nIters->value();
+    const double lambda = ui->lambda->value(), tau = ui->tvl1_tau->value(), sigma = ui->tvl1_sigma->value(),
+                 theta = ui->tvl1_theta->value(), beta = ui->tvl1_beta->value(), gamma = ui->tvl1_gamma->value();
+
+    // Realtime parameter updates replace denoising that has not started yet
+    std::shared_ptr<JobResult> res(new JobResult);
+    const SweepSettings settings = sweepSettings();
+    const unsigned int id = worker.submit(ComputeWorker::JobDenoise, [this, res, settings, niters, lambda, tau, sigma, theta,
+                                          beta, gamma]() {
+        applySettings(settings);
+        if (!ps.CudaDenoise(argc, argv, niters, lambda, tau, sigma, theta, beta, gamma)) return false;
+
+        // get depthmaps, copied since the next job may overwrite them while they are shown
+        CamImage<float> * dendepth = ps.getDepthmapDenoised();
+        CamImage<uchar> * dendepth8u = ps.getDepthmap8uDenoised();
+        res->depth8u = QImage(dendepth8u->data(), dendepth8u->width(), dendepth8u->height(), QImage::Format_Indexed8).copy();
+        res->cloud.reset(new PointCloudT(dendepth8u->width(), dendepth8u->height()));
+
+        // Fill the cloud on the device
+        return ps.getPoints(res->cloud->points.data(), sizeof(PointT), offsetof(PointT, rgba), *dendepth,
+                            ps.getDepthmapDenoisedPtr());
+    }, true);
+    results[id] = res;
 }
 
-void PCLViewer::on_threadsx_valueChanged(int arg1)
+void PCLViewer::showDepthmapDenoised(const JobResult & res)
 {
-    ps.setBlockXdim(arg1);
-    ui->threadsx->setValue(arg1);
-}
+    ui->maxthreads->setValue(ps.getMaxThreadsPerBlock());
 
-void PCLViewer::on_threadsy_valueChanged(int arg1)
-{
-    ps.setBlockYdim(arg1);
-    ui->threadsy->setValue(arg1);
+    // update colorbar range
+    ui->cbardenoised->setRangeMin(ui->zNear->value());
+    ui->cbardenoised->setRangeMax(ui->zFar->value());
+
+    // show grayscale depthmap
+    QImage img = res.depth8u;
+    img.setColorTable(ctable);
+
+    dendepthim = QPixmap::fromImage(img);
+    dendepthsc->addPixmap(dendepthim);
+    dendepthsc->setSceneRect(dendepthim.rect());
+    ui->denview->setScene(dendepthsc);
+
+    // show point cloud
+    clouddenoised = res.cloud;
+    viewerdenoised->updatePointCloud(clouddenoised, "cloud");
+    if (refchangedtvl1) viewerdenoised->resetCamera();
+    ui->qvtkDenoised->update();
+    refchangedtvl1 = false;
 }
 
 void PCLViewer::on_tgv_button_pressed()
 {
-    if (ps.TGV(argc, argv, ui->tgv_niters->value(), ui->tgv_warps->value(), ui->tgv_lambda->value(),
-               ui->tgv_alpha0->value(), ui->tgv_alpha1->value(), ui->tgv_tau->value(), ui->tgv_sigma->value(),
-               ui->tgv_beta->value(), ui->tgv_gamma->value())){
+    const int niters = ui->tgv_niters->value(), warps = ui->tgv_warps->value();
+    const double lambda = ui->tgv_lambda->value(), alpha0 = ui->tgv_alpha0->value(), alpha1 = ui->tgv_alpha1->value(),
+                 tau = ui->tgv_tau->value(), sigma = ui->tgv_sigma->value(), beta = ui->tgv_beta->value(),
+                 gamma = ui->tgv_gamma->value();
+
+    std::shared_ptr<JobResult> res(new JobResult);
+    const SweepSettings settings = sweepSettings();
+    const unsigned int id = worker.submit(ComputeWorker::JobTGV, [=]() {
+        applySettings(settings);
+        if (!ps.TGV(argc, argv, niters, warps, lambda, alpha0, alpha1, tau, sigma, beta, gamma)) return false;
 //    if (ps.TGVdenoiseFromSparse(argc, argv, sparsedepth, ui->tgv_niters->value(), ui->tgv_alpha0->value(),
 //                                ui->tgv_alpha1->value(), ui->tgv_tau->value(), ui->tgv_sigma->value(), ui->tgv_lambda->value(),
 //                                ui->tgv_beta->value(), ui->tgv_gamma->value())){
-        // get depthmaps
-        ui->maxthreads->setValue(ps.getMaxThreadsPerBlock());
-        tgvdepth = ps.getDepthmapTGV();
-        tgvdepth8u = ps.getDepthmap8uTGV();
-
-        // resize cloud if reference image has changed
-        if (refchangedtgv)
-        {
-            // The number of points in the cloud
-            if ((cloudtgv->height != tgvdepth8u->height()) || (cloudtgv->width != tgvdepth8u->width()))
-            {
-                cloudtgv->points.resize(tgvdepth8u->width() * tgvdepth8u->height());
-                cloudtgv->width = tgvdepth8u->width();
-                cloudtgv->height = tgvdepth8u->height();
-            }
-        }
+        // get depthmaps, copied since the next job may overwrite them while they are shown
+        CamImage<float> * tgvdepth = ps.getDepthmapTGV();
+        CamImage<uchar> * tgvdepth8u = ps.getDepthmap8uTGV();
+        res->depth8u = QImage(tgvdepth8u->data(), tgvdepth8u->width(), tgvdepth8u->height(), QImage::Format_Indexed8).copy();
+        res->cloud.reset(new PointCloudT(tgvdepth8u->width(), tgvdepth8u->height()));
+
+        // Fill the cloud with points back-projected on the device, TGV depthmap is uploaded from the host
+        return ps.getPoints(res->cloud->points.data(), sizeof(PointT), offsetof(PointT, rgba), *tgvdepth);
+    });
+    results[id] = res;
+}
 
-        QColor c;
-        int  i;
-
-        Matrix3D k = ps.getInverseK();
-        float z;
-
-        // update colorbar range
-        ui->cbarTGV->setRangeMin(ui->zNear->value());
-        ui->cbarTGV->setRangeMax(ui->zFar->value());
-
-        // Fill the cloud with points
-        for (size_t x = 0; x < tgvdepth8u->width(); ++x)
-            for (size_t y = 0; y < tgvdepth8u->height(); ++y)
-            {
-                i = x + y * tgvdepth8u->width();
-
-                z = tgvdepth->data()[i];
-                cloudtgv->points[i].z = sign(k(1,1)) * z;
-                cloudtgv->points[i].x = z * (k(0,0) * x + k(0,1) * y + k(0,2));
-                cloudtgv->points[i].y = z * (k(1,0) * x + k(1,1) * y + k(1,2));
-
-                // only update colors if reference image has changed
-                if (refchangedtgv)
-                {
-                    c = refim.pixel(x, y);
-                    cloudtgv->points[i].r = c.red();
-                    cloudtgv->points[i].g = c.green();
-                    cloudtgv->points[i].b = c.blue();
-                }
-            }
+void PCLViewer::showDepthmapTGV(const JobResult & res)
+{
+    ui->maxthreads->setValue(ps.getMaxThreadsPerBlock());
 
-        // show grayscale depthmap
-        QImage img(tgvdepth8u->data(), tgvdepth8u->width(), tgvdepth8u->height(), QImage::Format_Indexed8);
-        img.setColorTable(ctable);
+    // update colorbar range
+    ui->cbarTGV->setRangeMin(ui->zNear->value());
+    ui->cbarTGV->setRangeMax(ui->zFar->value());
+
+    // show grayscale depthmap
+    QImage img = res.depth8u;
+    img.setColorTable(ctable);
+
+    tgvdepthim = QPixmap::fromImage(img);
+    tgvscene->addPixmap(tgvdepthim);
+    tgvscene->setSceneRect(tgvdepthim.rect());
+    ui->tgvview->setScene(tgvscene);
+
+    // show cloud
+    cloudtgv = res.cloud;
+    viewertgv->updatePointCloud(cloudtgv, "cloud");
+    if (refchangedtgv) viewertgv->resetCamera();
+    ui->qvtktgv->update();
+    refchangedtgv = false;
+}
 
-        tgvdepthim = QPixmap::fromImage(img);
-        tgvscene->addPixmap(tgvdepthim);
-        tgvscene->setSceneRect(tgvdepthim.rect());
-        ui->tgvview->setScene(tgvscene);
+void PCLViewer::computeFinished(unsigned int id, int type, bool success)
+{
+    // Results of failed and dropped jobs are discarded too
+    std::shared_ptr<JobResult> res;
+    std::map<unsigned int, std::shared_ptr<JobResult> >::iterator it = results.find(id);
+    if (it != results.end()) {
+        res = it->second;
+        results.erase(it);
+    }
 
-        // show cloud
-        viewertgv->updatePointCloud(cloudtgv, "cloud");
-        if (refchangedtgv) viewertgv->resetCamera();
-        ui->qvtktgv->update();
-        refchangedtgv = false;
+    switch (type) {
+    case ComputeWorker::JobSweep:
+        if (success && res) showDepthmap(*res);
+        break;
+    case ComputeWorker::JobDenoise:
+        if (success && res) showDepthmapDenoised(*res);
+        break;
+    case ComputeWorker::JobTGV:
+        if (success && res) showDepthmapTGV(*res);
+        break;
+    case ComputeWorker::JobFusion:
+        reconstructStepDone(success);
+        break;
+    default:
+        break;
     }
 }
 
@@ -768,13 +751,9 @@ void PCLViewer::on_imageNameButton_clicked()
     ui->fusion_simage->setValue(ref);
 }
 
-void PCLViewer::on_altmethod_toggled(bool checked)
-{
-    ps.setAlternativeRelativeMatrixMethod(checked);
-}
-
 void PCLViewer::on_loadfromsrc_clicked()
 {
+    worker.wait();
     refchanged = true;
     refchangedtvl1 = true;
     refchangedtgv = true;
@@ -783,28 +762,34 @@ void PCLViewer::on_loadfromsrc_clicked()
 
 void PCLViewer::on_loadfromdir_clicked()
 {
+    worker.wait();
     refchanged = true;
     refchangedtvl1 = true;
     refchangedtgv = true;
 
-    // get image name strings
-    QString impos;
-    QString imname = ImageName(ui->refNumber->value(), impos);
-
-    // initialize variables for camera parameters
-    Vector3D cam_pos, cam_dir, cam_up, cam_lookat,cam_sky, cam_right, cam_fpoint, t;
-    Matrix3D K, R;
-    double cam_angle;
-
-    // get camera parameters
-    if (!reader.getcamParameters(impos, cam_pos, cam_dir, cam_up, cam_lookat,cam_sky, cam_right, cam_fpoint, cam_angle)) return;
-    reader.getcamK(K, cam_dir, cam_up, cam_right);
+    // image numbers of the sweep window, reference first
+    int refn = ui->refNumber->value();
+    NVTX_FRAME(refn);
+    int nsrc = ui->imNumber->value() - 1;
+    int half = (nsrc + 1) / 2;
+    QVector<int> window;
+    window << refn;
+    for (int i = 0; i < nsrc; i++) window << refn + ((i < half) ? i + 1 : half - i - 1);
+
+    // Frames of this window missing from the cache and of the next reconstruction step are decoded in parallel.
+    // Consecutive windows overlap, so only frames entering the window are loaded.
+    frames.setCapacity(std::max<size_t>(DEFAULT_FRAME_CACHE_SIZE, 2 * window.size()));
+    int step = ui->fusion_imstep->value();
+    // Views of this window are pinned, so the look-ahead of the next one cannot evict them before they are taken
+    for (int i = 0; i < window.size(); i++) requestFrame(window[i], true);
+    for (int i = 0; i < window.size(); i++) requestFrame(window[i] + step);
 
     // set reference view parameters
-    ps.setK(K);
-    reader.computeRT(R, t, cam_dir, cam_pos, cam_up);
+    FrameCache::value_ptr frame = loadFrame(refn);
+    if (!frame) return;
+    ps.setK(frame->K);
 
-    refim.load(imname);
+    refim = frame->image;
     int w = refim.width(), h = refim.height();
     ps.HostRef.reset(w, h);
 
@@ -814,34 +799,29 @@ void PCLViewer::on_loadfromdir_clicked()
     scene->setSceneRect(image.rect());
     ui->refView->setScene(scene);
 
-    ps.HostRef.R = R;
-    ps.HostRef.t = t;
-    rgb2gray<float>(ps.HostRef.data(), refim);
-
-    int nsrc = ui->imNumber->value() - 1;
+    ps.HostRef.R = frame->R;
+    ps.HostRef.t = frame->t;
+    std::copy(frame->gray.begin(), frame->gray.end(), ps.HostRef.data());
+    rgb2rgba(ps.HostRefRGBA, refim);
 
-    // load and setup source views
+    // setup source views, color views are allocated up front since CamImage copies do not own memory
     ps.HostSrc.resize(0);
-    QImage src;
-    int half = (nsrc + 1) / 2;
-    int offset;
-
-    for (int i = 0; i < nsrc; i++){
-        if (i < half) offset = i + 1;
-        else offset = half - i - 1;
-        imname = ImageName(ui->refNumber->value() + offset, impos);
-        if (reader.getcamParameters(impos, cam_pos, cam_dir, cam_up, cam_lookat,cam_sky, cam_right, cam_fpoint, cam_angle)){
-            ps.HostSrc.resize(ps.HostSrc.size() + 1);
-            reader.computeRT(R, t, cam_dir, cam_pos, cam_up);
-            src.load(imname);
-            ps.HostSrc.back().reset(w,h);
-            ps.HostSrc.back().R = R;
-            ps.HostSrc.back().t = t;
-            rgb2gray<float>(ps.HostSrc.back().data(), src);
-        }
+    ps.HostSrcRGBA.clear();
+    ps.HostSrcRGBA.resize(window.size());
+    for (int i = 1; i < window.size(); i++){
+        FrameCache::value_ptr src = loadFrame(window[i]);
+        if (!src || (src->image.size() != refim.size())) continue;
+        rgb2rgba(ps.HostSrcRGBA[ps.HostSrc.size()], src->image);
+        ps.HostSrc.resize(ps.HostSrc.size() + 1);
+        ps.HostSrc.back().reset(w,h);
+        ps.HostSrc.back().R = src->R;
+        ps.HostSrc.back().t = src->t;
+        std::copy(src->gray.begin(), src->gray.end(), ps.HostSrc.back().data());
     }
 
     // load sparse groundtruth depthmap the same size as reference image
+    QString impos;
+    ImageName(refn, impos);
     QString depth = impos;
     int dot = depth.lastIndexOf('.');
     if (dot != -1) depth.truncate(dot);
@@ -849,6 +829,57 @@ void PCLViewer::on_loadfromdir_clicked()
     loadSparseDepthmap(depth);
 }
 
+FrameCache::value_ptr PCLViewer::loadFrame(int number)
+{
+    QString impos;
+    QString imname = ImageName(number, impos);
+
+    // cached frames of another dataset are stale
+    FrameCache::value_ptr cached = frames.find(number);
+    if (cached && (cached->name == imname)) return cached;
+
+    // initialize variables for camera parameters
+    Vector3D cam_pos, cam_dir, cam_up, cam_lookat,cam_sky, cam_right, cam_fpoint;
+    double cam_angle;
+
+    std::shared_ptr<CachedFrame> frame = std::make_shared<CachedFrame>();
+    frame->name = imname;
+
+    // camera of the frame comes from the pose index, camera files are only parsed if it is not available
+    QString dir = ui->imagePath->text(), name = ui->imageName->text();
+    int digits = ui->imageDigits->value();
+    poses.openOrBuild(dir + '/' + name + POSE_INDEX_EXTENSION, dir,
+                      [&](const QString & fname){ return PoseIndex::buildICLNUIM(fname, dir, name, digits); });
+    if (!poses.pose(number, frame->K, frame->R, frame->t)){
+        if (!reader.getcamParameters(impos, cam_pos, cam_dir, cam_up, cam_lookat,cam_sky, cam_right, cam_fpoint, cam_angle)){
+            frames.erase(number);
+            return FrameCache::value_ptr();
+        }
+        reader.getcamK(frame->K, cam_dir, cam_up, cam_right);
+        reader.computeRT(frame->R, frame->t, cam_dir, cam_pos, cam_up);
+    }
+
+    // failed decodes are not cached, so the frame is tried again once the file is readable
+    ImageLoader::Frame decoded;
+    if (!ImageLoader::instance().take(imname, decoded)){
+        frames.erase(number);
+        return FrameCache::value_ptr();
+    }
+    frame->image = decoded.image;
+    frame->gray.swap(decoded.gray);
+
+    frames.insert(number, frame);
+    return frame;
+}
+
+void PCLViewer::requestFrame(int number, bool pin)
+{
+    QString impos;
+    QString imname = ImageName(number, impos);
+    FrameCache::value_ptr cached = frames.find(number);
+    if (!cached || (cached->name != imname)) ImageLoader::instance().request(imname, pin);
+}
+
 QString PCLViewer::ImageName(int number, QString &imagePos)
 {
     QString name = ui->imagePath->text();
@@ -884,8 +915,22 @@ void PCLViewer::rgb2gray(T * data, const QImage & img)
     }
 }
 
+void PCLViewer::rgb2rgba(CamImage<uchar4> & dst, const QImage & img)
+{
+    QImage rgb = img.convertToFormat(QImage::Format_RGB32);
+    int w = rgb.width(), h = rgb.height();
+    dst.reset(w, h);
+
+    // scanlines are 32 bit aligned, so row size equals width of the unpadded host image
+    for (int y = 0; y < h; y++)
+        memcpy(dst.data() + y*w, rgb.constScanLine(y), w * sizeof(uchar4));
+}
+
 void PCLViewer::on_save_clicked()
 {
+    // volume is in use until reconstruction is finished, meshing it would race with the running steps
+    if (fusionrun.active) return;
+    worker.wait();
     QFile file;
 
     // only save images if they contain data
@@ -921,12 +966,40 @@ void PCLViewer::on_save_clicked()
         file.close();
     }
 
-    // only save cloud if they contain points
+    // metric depthmaps are kept losslessly next to the 8 bit visualizations, written in the background
+    if (!depthim.isNull()) writer.writeDepth("planesweep" DEPTH_FILE_EXTENSION, *ps.getDepthmap());
+    if (!dendepthim.isNull()) writer.writeDepth("planesweep_tvl1" DEPTH_FILE_EXTENSION, *ps.getDepthmapDenoised());
+    if (!tgvdepthim.isNull()) writer.writeDepth("tgv" DEPTH_FILE_EXTENSION, *ps.getDepthmapTGV());
+
+    // only save cloud if they contain points, copies are written in the background
+    auto savePLY = [this](const std::string & fname, const PointCloudT::Ptr & c){
+        if (c->points.size() == 0) return;
+        PointCloudT::Ptr copy(new PointCloudT(*c));
+        writer.enqueue([fname, copy](){
+            try { pcl::io::savePLYFileASCII(fname, *copy); }
+            catch (pcl::IOException & excep){
+                std::cerr << "Error occured while saving PCD:\n" << excep.detailedMessage() << std::endl;
+            }
+        });
+    };
+    savePLY("planesweep.ply", cloud);
+    savePLY("planesweep_tvl1.ply", clouddenoised);
+    savePLY("tgv.ply", cloudtgv);
+    savePLY("reconstructed.ply", cloudfusion);
+
     try {
-        if (cloud->points.size() > 0) pcl::io::savePLYFileASCII("planesweep.ply", *cloud);
-        if (clouddenoised->points.size() > 0) pcl::io::savePLYFileASCII("planesweep_tvl1.ply", *clouddenoised);
-        if (cloudtgv->points.size() > 0) pcl::io::savePLYFileASCII("tgv.ply", *cloudtgv);
-        if (cloudfusion->points.size() > 0) pcl::io::savePLYFileASCII("reconstructed.ply", *cloudfusion);
+        if (cloudfusion->points.size() > 0) {
+            // Mesh the fused volume directly on the device
+            fusionMesh mesh;
+            dim3 threads(ui->fusion_threadsw->value(), ui->fusion_threadsh->value(), ui->fusion_threadsd->value());
+            dim3 blocks((fd.width() + threads.x - 1) / threads.x, (fd.height() + threads.y - 1) / threads.y,
+                        (fd.depth() + threads.z - 1) / threads.z);
+            FusionExtractMesh<8>(fd, mesh, blocks, threads);
+            if (mesh.triangleCount() > 0) mesh.savePLY("reconstructed_mesh.ply");
+
+            // Checkpoint of the whole volume, can be restored with fusionFile::upload(), only written on request
+            if (ui->save_fusion_checkpoint->isChecked()) saveFusionData("reconstructed.fusion", fd);
+        }
     }
     catch (pcl::IOException & excep){
         std::cerr << "Error occured while saving PCD:\n" << excep.detailedMessage() << std::endl;
@@ -971,6 +1044,19 @@ void PCLViewer::on_tvl1_gamma_valueChanged(double arg1)
 
 void PCLViewer::on_reconstruct_button_clicked()
 {
+    // Clicking again while reconstructing stops after the running step
+    if (fusionrun.active) {
+        fusionrun.cancelled = true;
+        worker.cancel();
+        return;
+    }
+
+    // Volume and planesweep are only set up while no job uses them, blocks shown for a previous reconstruction are
+    // dropped even if the volume size stayed the same
+    worker.wait();
+    resetFusionView();
+    fusionlod.setColormap(ctable.constData());
+
     // Set 3D volume for the voxels
     Rectangle3D volm(make_float3(ui->fusion_volx1->value(),
                                  ui->fusion_voly1->value(),
@@ -981,104 +1067,272 @@ void PCLViewer::on_reconstruct_button_clicked()
     fd.setVolume(volm);
 
     // Initialize variables
-    float * ptr = 0; // null pointer
-    double  threshold = ui->fusion_threshold->value(),
-            tau = ui->fusion_tau->value(),
-            lambda = ui->fusion_lambda->value(),
-            sigma = ui->fusion_sigma->value();
-
-    // Create matrices and translation vector
-    Matrix3D K;
-    Matrix3D R;
-    Vector3D T;
-
-    // Create world coordinate matrices:
-    Matrix3D I; I.makeIdentity();
-    Vector3D tm(0,0,0);  // 0 translation vector
+    FusionRun & r = fusionrun;
+    r.threshold = ui->fusion_threshold->value();
+    r.tau = ui->fusion_tau->value();
+    r.lambda = ui->fusion_lambda->value();
+    r.sigma = ui->fusion_sigma->value();
+
+    // Tuned fusion block dimensions replace the ones set in the UI, trials only read the volume
+    if (ps.getAutotune()) {
+        auto grid = [](dim3 t, int w, int h, int d){ return dim3((w + t.x - 1) / t.x, (h + t.y - 1) / t.y, (d + t.z - 1) / t.z); };
+        float * d_sums;
+        checkCudaErrors(cudaMalloc((void **)&d_sums, 2 * sizeof(float)));
+        checkCudaErrors(cudaMemset(d_sums, 0, 2 * sizeof(float)));
+        dim3 t = LaunchTuner::instance().tune("fusion", fd.width(), fd.height(), fd.depth(), FusionResidualBlockSize<8>(),
+                                              ui->maxthreads->value(), [&](dim3 threads){
+            FusionResidual<8>(fd, d_sums, grid(threads, fd.width(), fd.height(), fd.depth()), threads);
+        });
+        checkCudaErrors(cudaFree(d_sums));
+        ui->fusion_threadsd->setValue(1);
+        ui->fusion_threadsw->setValue(t.x);
+        ui->fusion_threadsh->setValue(t.y);
+        ui->fusion_threadsd->setValue(t.z);
+    }
 
     // Calculate 3D threads per blocks and blocks per grid
-    dim3 threads(ui->fusion_threadsw->value(),
-                 ui->fusion_threadsh->value(),
-                 ui->fusion_threadsd->value());
-    int3 th = make_int3(threads.x, threads.y, threads.z);
+    r.threads = dim3(ui->fusion_threadsw->value(),
+                     ui->fusion_threadsh->value(),
+                     ui->fusion_threadsd->value());
+    int3 th = make_int3(r.threads.x, r.threads.y, r.threads.z);
     int3 b = make_int3(fd.width(), fd.height(), fd.depth());
     b = (b + th - 1);
     b = make_int3(b.x / th.x, b.y / th.y, b.z / th.z);
-    dim3 blocks(b.x, b.y, b.z);
-    std::cerr << blocks.x << '\t' << blocks.y << '\t' << blocks.z << std::endl;
-
-    // Run iterations
-    int iterations = ui->fusion_iters->value();
-//    size_t pitch;
-//    checkCudaErrors(cudaMallocPitch(&ptr, &pitch, 640 * sizeof(float), 480));
-
-    for (int i = 0; i < iterations; i++){
-        printf("Reconstruction iteration: %d/%d\n", i+1, iterations);
-        auto t1 = std::chrono::high_resolution_clock::now();
+    r.blocks = dim3(b.x, b.y, b.z);
+    std::cerr << r.blocks.x << '\t' << r.blocks.y << '\t' << r.blocks.z << std::endl;
+
+    // Fusion runs on its own stream, so loading and planesweep of the next frame overlap with fusion of the current one.
+    // Denoised depthmaps are double buffered, ready events order copies before fusion, fused events order fusion before
+    // the buffer is overwritten two frames later.
+    checkCudaErrors(cudaStreamCreateWithFlags(&r.stream, cudaStreamNonBlocking));
+
+    // Migrate managed volume to the device before fusion kernels touch it (no-op for device memory)
+    int device;
+    checkCudaErrors(cudaGetDevice(&device));
+    fd.prefetch(device, r.stream);
+
+    // Histograms are only updated in bricks of the camera frustum
+    checkCudaErrors(cudaMalloc((void **)&r.culllist, FusionCullListSize(fd) * sizeof(int)));
+    for (int k = 0; k < 2; k++){
+        checkCudaErrors(cudaEventCreateWithFlags(&r.ready[k], cudaEventDisableTiming));
+        checkCudaErrors(cudaEventCreateWithFlags(&r.fused[k], cudaEventDisableTiming));
+        checkCudaErrors(cudaEventRecord(r.fused[k], r.stream));
+    }
+    r.timer.start("Fusion", r.stream);
+
+    // Run iterations, each one is a job started when the previous one is done so the GUI stays responsive
+    r.iteration = 0;
+    r.iterations = ui->fusion_iters->value();
+    r.cancelled = false;
+    r.active = true;
+    ui->reconstruct_button->setText("Cancel");
+    if (r.iterations > 0) reconstructStep();
+    else finishReconstruction();
+}
 
-        // Load images and set K
-        ui->refNumber->setValue(ui->fusion_simage->value() + i * ui->fusion_imstep->value());
-        on_loadfromdir_clicked();
-        K = ps.getK();
-//        MemoryManagement<float>::Host2DeviceCopy(ptr, pitch, sparsedepth.data, sparsedepth.pitch, 640, 480);
+void PCLViewer::reconstructStep()
+{
+    FusionRun & r = fusionrun;
+    const int i = r.iteration;
+    if (ps.getVerbose()) printf("Reconstruction iteration: %d/%d\n", i+1, r.iterations);
+
+    // Load images and set K, worker is idle between steps. Frames of this step were decoded ahead while the previous
+    // one was computed.
+    ui->refNumber->setValue(ui->fusion_simage->value() + i * ui->fusion_imstep->value());
+    on_loadfromdir_clicked();
+
+    // Widgets are only read in the GUI thread
+    const int niters = ui->nIters->value();
+    const double lambda = ui->lambda->value(), tau = ui->tvl1_tau->value(), sigma = ui->tvl1_sigma->value(),
+                 theta = ui->tvl1_theta->value(), beta = ui->tvl1_beta->value(), gamma = ui->tvl1_gamma->value();
+
+    const SweepSettings settings = sweepSettings();
+    worker.submit(ComputeWorker::JobFusion, [this, i, settings, niters, lambda, tau, sigma, theta, beta, gamma]() {
+        FusionRun & r = fusionrun;
+        NVTX_RANGE_INDEX("fusion step", NvtxFusion, i);
+        applySettings(settings);
 
         // Calculate and set R and T
+        Matrix3D K = ps.getK(), R, I;
+        Vector3D T, tm(0,0,0);
+        I.makeIdentity();
         ps.RelativeMatrices(R, T, I, tm, ps.HostRef.R, ps.HostRef.t); // from world to ref
 
         // Get planesweep depthmap
         ps.RunAlgorithm(argc, argv);
 
         // Get TVL1 denoised planesweep depthmap
-        ps.CudaDenoise(argc, argv, ui->nIters->value(), ui->lambda->value(), ui->tvl1_tau->value(),
-                       ui->tvl1_sigma->value(), ui->tvl1_theta->value(), ui->tvl1_beta->value(), ui->tvl1_gamma->value());
-//        ps.TGVdenoiseFromSparse(argc, argv, sparsedepth, ui->tgv_niters->value(), ui->tgv_alpha0->value(),
-//                                ui->tgv_alpha1->value(), ui->tgv_tau->value(), ui->tgv_sigma->value(), ui->tgv_lambda->value(),
-//                                ui->tgv_beta->value(), ui->tgv_gamma->value());
-        ptr = ps.getDepthmapDenoisedPtr();
+        ps.CudaDenoise(argc, argv, niters, lambda, tau, sigma, theta, beta, gamma);
+        float * ptr = ps.getDepthmapDenoisedPtr();
+
+        // Hand depthmap over to fusion buffer once fusion two frames back is done with it
+        int w = ps.HostRef.width(), h = ps.HostRef.height();
+        Image<float> & depth = r.depth[i % 2];
+        if ((depth.width() != w) || (depth.height() != h)) {
+            checkCudaErrors(cudaStreamSynchronize(r.stream));
+            depth.reset(w, h);
+        }
+        checkCudaErrors(cudaStreamWaitEvent(0, r.fused[i % 2], 0));
+        checkCudaErrors(cudaMemcpyAsync(depth.data(), ptr, w * h * sizeof(float), cudaMemcpyDeviceToDevice, 0));
+
+        // Masked pixels and pixels matched by few views are skipped by fusion instead of carving up to zfar
+        ps.MaskDepthmap(depth.data(), DEFAULT_FUSION_MIN_CONFIDENCE);
+        checkCudaErrors(cudaEventRecord(r.ready[i % 2], 0));
+
+#if SAVE_FUSION_DEPTHMAPS
+        // Download into a pinned buffer, written once the copy is done without waiting for it here
+        ResultWriter::buffer_ptr saved = writer.acquire(w, h);
+        saved->R = ps.HostRef.R;
+        saved->t = ps.HostRef.t;
+        ResultWriter::download(saved, ptr, 0);
+        writer.writeDepth(QString("fusion_%1" DEPTH_FILE_EXTENSION).arg(i, 4, 10, QChar('0')).toStdString(), saved);
+#endif
 
         // Fuse the depthmap
-        FusionUpdateIteration<8>(fd, ptr, K, R, T, threshold, tau, lambda, sigma, ps.HostRef.width(), ps.HostRef.height(), blocks, threads);
+        checkCudaErrors(cudaStreamWaitEvent(r.stream, r.ready[i % 2], 0));
+        r.timer.begin("update", r.stream);
+        FusionUpdateIterationCulled<8>(fd, depth.data(), K, R, T, r.threshold, r.tau, r.lambda, r.sigma,
+                                       ps.getZnear(), ps.getZfar(), w, h, r.culllist, r.blocks, r.threads, r.stream);
+        r.timer.count(3, 0, 1);
+        checkCudaErrors(cudaEventRecord(r.fused[i % 2], r.stream));
+
+        // Decimate surface for a throttled view refresh, blocks are shown by the GUI thread
+        r.timer.begin("surface", r.stream);
+        fusionlod.update(fd, r.changed, false, r.stream);
+        r.timer.end();
+        return true;
+    });
+}
+
+void PCLViewer::reconstructStepDone(bool success)
+{
+    FusionRun & r = fusionrun;
 
-        auto t2 = std::chrono::high_resolution_clock::now();
-        std::cerr << "Time of 1 fusion iteration: " <<
-                     std::chrono::duration_cast<std::chrono::milliseconds>(t2-t1).count() << "ms\n\n";
+    // Running step of a cancelled reconstruction finishes after its dropped successor was reported
+    if (!r.active) return;
+
+    std::vector<FusionLOD::Block> changed;
+    changed.swap(r.changed);
+    r.iteration++;
+    if (!success || r.cancelled || (r.iteration >= r.iterations)) {
+        if (!changed.empty()) showFusionView(changed);
+        finishReconstruction();
+        return;
     }
 
-    // Resize point cloud to fit all voxels in the worst case scenario
-    cloudfusion->points.resize(fd.elements());
-    size_t voxels = 0;
-    float3 c;
-    uchar gray;
-    uchar3 color;
-
-    // Copy data to host
-    fd.copyTo(f.voxelPtr(), f.pitch());
-
-    // Only show voxels which are occluded but not too far from the surface
-    for (int z = 0; z < fd.depth(); z++)
-        for (int y = 0; y < fd.height(); y++)
-            for (int x = 0; x < fd.width(); x++)
-            {
-                if ((f.u(x,y,z) < 0) && (f.u(x,y,z) > -1)){
-                    c = fd.worldCoords(x,y,z);
-                    cloudfusion->points[voxels].x = -c.x;
-                    cloudfusion->points[voxels].y = c.y;
-                    cloudfusion->points[voxels].z = c.z;
-                    gray = 255 * (c.x - fd.volume().a.x) / fd.volume().size().x;
-                    color = RGBdepthmapColor(gray);
-                    cloudfusion->points[voxels].r = color.x;
-                    cloudfusion->points[voxels].g = color.y;
-                    cloudfusion->points[voxels].b = color.z;
-                    voxels++;
-                }
-            }
-//    cudaFree(ptr);
-    // update point cloud and qvtkwidget
+    // Next step is queued first, so uploading changed blocks to the viewer overlaps with its planesweep
+    reconstructStep();
+    if (!changed.empty()) showFusionView(changed);
+}
+
+void PCLViewer::finishReconstruction()
+{
+    FusionRun & r = fusionrun;
+    worker.wait();
+
+    r.timer.stop();
+    if (ps.getVerbose()) r.timer.timings().print(std::cerr);
+
+    checkCudaErrors(cudaStreamSynchronize(r.stream));
+    for (int k = 0; k < 2; k++){
+        checkCudaErrors(cudaEventDestroy(r.ready[k]));
+        checkCudaErrors(cudaEventDestroy(r.fused[k]));
+    }
+    checkCudaErrors(cudaStreamDestroy(r.stream));
+    checkCudaErrors(cudaFree(r.culllist));
+    r.stream = 0;
+    r.culllist = 0;
+    r.active = false;
+    ui->reconstruct_button->setText("3D");
+    if (r.cancelled) std::cerr << "Reconstruction cancelled after " << r.iteration << " iterations\n\n";
+
+    // Extract surface voxels on the device, only compacted points come to the host
+    unsigned int * d_colormap, * d_count;
+    fusionPoint * d_points;
+    unsigned int capacity = DEFAULT_FUSION_SURFACE_POINTS;
+    checkCudaErrors(cudaMalloc((void **)&d_colormap, ctable.size() * sizeof(unsigned int)));
+    checkCudaErrors(cudaMemcpy(d_colormap, ctable.constData(), ctable.size() * sizeof(unsigned int), cudaMemcpyHostToDevice));
+    checkCudaErrors(cudaMalloc((void **)&d_count, sizeof(unsigned int)));
+    checkCudaErrors(cudaMalloc((void **)&d_points, capacity * sizeof(fusionPoint)));
+
+    size_t voxels = FusionExtractSurface<8>(fd, d_points, capacity, d_count, d_colormap, r.blocks, r.threads);
+    if (voxels > capacity) {
+        capacity = voxels;
+        checkCudaErrors(cudaFree(d_points));
+        checkCudaErrors(cudaMalloc((void **)&d_points, capacity * sizeof(fusionPoint)));
+        voxels = FusionExtractSurface<8>(fd, d_points, capacity, d_count, d_colormap, r.blocks, r.threads);
+    }
+
+    std::vector<fusionPoint> points(voxels);
+    if (voxels > 0)
+        checkCudaErrors(cudaMemcpy(points.data(), d_points, voxels * sizeof(fusionPoint), cudaMemcpyDeviceToHost));
+    checkCudaErrors(cudaFree(d_points));
+    checkCudaErrors(cudaFree(d_count));
+    checkCudaErrors(cudaFree(d_colormap));
+
     cloudfusion->points.resize(voxels);
+    for (size_t i = 0; i < voxels; i++) {
+        cloudfusion->points[i].x = -points[i].x;
+        cloudfusion->points[i].y = points[i].y;
+        cloudfusion->points[i].z = points[i].z;
+        cloudfusion->points[i].rgba = points[i].rgba;
+    }
+    // update point cloud and qvtkwidget
     cloudfusion->width = 1;
     cloudfusion->height = voxels;
-    viewerfusion->updatePointCloud(cloudfusion, "cloud");
-    viewerfusion->resetCamera();
+
+    // Full cloud is kept for saving, viewer shows the decimated surface
+    updateFusionView(true);
+}
+
+void PCLViewer::updateFusionView(bool force, cudaStream_t stream)
+{
+    std::vector<FusionLOD::Block> changed;
+    if (fusionlod.update(fd, changed, force, stream)) showFusionView(changed);
+}
+
+void PCLViewer::showFusionView(const std::vector<FusionLOD::Block> & changed)
+{
+    bool empty = true;
+    for (size_t i = 0; i < lodclouds.size(); i++) empty &= !lodclouds[i];
+
+    for (size_t i = 0; i < changed.size(); i++) {
+        const FusionLOD::Block & b = changed[i];
+        const std::string id = QString("lod%1").arg(b.index).toStdString();
+        if (b.index >= (int)lodclouds.size()) lodclouds.resize(b.index + 1);
+        PointCloudT::Ptr & c = lodclouds[b.index];
+
+        if (b.points.empty()) {
+            if (c) viewerfusion->removePointCloud(id);
+            c.reset();
+            continue;
+        }
+
+        const bool shown = (bool)c;
+        if (!shown) c.reset(new PointCloudT);
+        c->points.resize(b.points.size());
+        for (size_t k = 0; k < b.points.size(); k++) {
+            c->points[k].x = -b.points[k].x;
+            c->points[k].y = b.points[k].y;
+            c->points[k].z = b.points[k].z;
+            c->points[k].rgba = b.points[k].rgba;
+        }
+        c->width = 1;
+        c->height = b.points.size();
+
+        if (shown) viewerfusion->updatePointCloud(c, id);
+        else {
+            viewerfusion->addPointCloud(c, id);
+            viewerfusion->setPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE,
+                                                           ui->fusion_psizebox->value(), id);
+        }
+    }
+
+    // Camera is only reset when the first surface appears, not on every refresh
+    bool nonempty = false;
+    for (size_t i = 0; i < lodclouds.size(); i++) nonempty |= (bool)lodclouds[i];
+    if (empty && nonempty) viewerfusion->resetCamera();
+    ui->qvtkfusion->GetRenderWindow()->Render(); // event loop does not run during reconstruction
     ui->qvtkfusion->update();
 }
 
@@ -1118,16 +1372,46 @@ void PCLViewer::on_fusion_psize_valueChanged(int value)
 {
     ui->fusion_psizebox->setValue(value);
     viewerfusion->setPointCloudRenderingProperties (pcl::visualization::PCL_VISUALIZER_POINT_SIZE, value, "cloud");
+    for (size_t i = 0; i < lodclouds.size(); i++)
+        if (lodclouds[i])
+            viewerfusion->setPointCloudRenderingProperties (pcl::visualization::PCL_VISUALIZER_POINT_SIZE, value,
+                                                            QString("lod%1").arg(i).toStdString());
     ui->qvtkfusion->update ();
 }
 
+void PCLViewer::resetFusionView()
+{
+    for (size_t i = 0; i < lodclouds.size(); i++)
+        if (lodclouds[i]) viewerfusion->removePointCloud(QString("lod%1").arg(i).toStdString());
+    lodclouds.clear();
+    fusionlod.reset();
+}
+
 void PCLViewer::on_fusion_resize_clicked()
 {
+    // volume is in use until reconstruction is finished
+    if (fusionrun.active) return;
+    worker.wait();
+
     if ((ui->fusion_d->value() != fd.depth()) || (ui->fusion_h->value() != fd.height()) || (ui->fusion_w->value() != fd.width()))
     {
+        // Fusion volume is not tiled, so a volume exceeding device memory is refused and the old one is kept
+        const size_t voxels = size_t(ui->fusion_w->value()) * ui->fusion_h->value() * ui->fusion_d->value();
+        const size_t bytes = MemoryPlanner::fusion(voxels, sizeof(fusionvoxel<8>));
+        const size_t available = MemoryPlanner::available() + size_t(fd.sizeMBytes() * (1 << 20));
+        if (!MemoryPlanner::fits(bytes, available)) {
+            QMessageBox::information(0, "Fusion volume too large",
+                                     QString("Volume needs %1 MB, only %2 MB of device memory are available")
+                                     .arg(bytes >> 20).arg(available >> 20));
+            return;
+        }
+
         fd.Resize(ui->fusion_w->value(), ui->fusion_h->value(), ui->fusion_d->value());
         f.Resize(ui->fusion_w->value(), ui->fusion_h->value(), ui->fusion_d->value());
 
+        // View blocks of the old volume do not match the new one
+        resetFusionView();
+
         std::cerr << "New size of fusion data is " << fd.sizeMBytes() << "MB\n\n";
     }
 }
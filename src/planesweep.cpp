@@ -1,5 +1,16 @@
 #include "planesweep.h"
+#include "nvtx_range.h"
+#include "launch_tuner.h"
+#include "cpu_engine.h"
+#include "kernel_jit.h"
+#include "result_writer.h"
+#include "fusion.cu.h"
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <cmath>
 #include <chrono>
+#include <utility>
 
 // OpenCV:
 #ifdef OpenCV_FOUND
@@ -19,6 +30,8 @@
 #include <kernels.cu.h>
 #include <helper_structs.h>
 #include "inc/image.h"
+#include "inc/texture.h"
+#include "kitti_reader.h"
 
 template <typename T> // T models Any
 struct static_cast_func
@@ -27,14 +40,31 @@ struct static_cast_func
     T operator()(const T1& x) const { return static_cast<T>(x); }
 };
 
+// Check if a workspace key of device dev starts with one of the name prefixes, keys are "<dev>.<name>"
+static bool workspaceMatch(const std::string & key, int dev, const std::vector<std::string> & prefixes)
+{
+    const std::string device = std::to_string(dev) + ".";
+    for (size_t i = 0; i < prefixes.size(); i++)
+        if (key.compare(0, device.size() + prefixes[i].size(), device + prefixes[i]) == 0) return true;
+    return false;
+}
+
 int PlaneSweep::cudaDevInit(int argc, const char **argv)
 {
-    int Count;
-    CHECK_CUDA_ERRORS_AUTO(cudaGetDeviceCount(&Count));
+    // device is initialized once and kept until cudaReset()
+    if (cudadevice != NO_CUDA_DEVICE) return cudadevice;
+
+    // Hosts without NVIDIA driver report an error instead of 0 devices
+    int Count = 0;
+    if (cudaGetDeviceCount(&Count) != cudaSuccess) {
+        cudaGetLastError();
+        Count = 0;
+    }
 
+    nodevice = Count == 0;
     if (Count == 0)
     {
-        std::cerr << "CUDA error: no devices supporting CUDA." << std::endl;
+        if (!cpufallback) std::cerr << "CUDA error: no devices supporting CUDA." << std::endl;
         return NO_CUDA_DEVICE;
     }
 
@@ -47,6 +77,7 @@ int PlaneSweep::cudaDevInit(int argc, const char **argv)
     checkCudaErrors(cudaSetDevice(dev));
 
     maxThreadsPerBlock = deviceProps.maxThreadsPerBlock;
+    cudadevice = dev;
     //    std::cerr << "Max pitch allowed = " << deviceProps.memPitch << std::endl;
     //    std::cerr << "Max grid dimensions: x = " << deviceProps.maxGridSize[0] << ", y = " << deviceProps.maxGridSize[1] << ", z = " <<
     //                 deviceProps.maxGridSize[2] << std::endl;
@@ -73,77 +104,225 @@ PlaneSweep::PlaneSweep(int argc, char **argv) :
 
 bool PlaneSweep::RunAlgorithm(int argc, char **argv)
 {
-    auto t1 = std::chrono::high_resolution_clock::now();
-
     // Reset depthmap
 
     depthmap.reset(HostRef.width(), HostRef.height());
 
-    printf("Starting plane sweep algorithm...\n\n");
+    if (verbose) printf("Starting plane sweep algorithm...\n\n");
 
     try
     {
         if (cudaDevInit(argc, (const char **)argv) == NO_CUDA_DEVICE)
         {
             cudaReset();
-            return false;
+            return cpufallback && RunAlgorithmCpu();
         }
+        cpuactive = false;
 
         // Algorithm here:-------------------------------------
 
+        NVTX_RANGE("RunAlgorithm", NvtxSweep);
+        timer.start("RunAlgorithm");
+
         // Move reference image to device memory
         int w = HostRef.width();
         int h = HostRef.height();
-        Image<float> deviceRef(w, h);
-        deviceRef.copyFrom(HostRef);
-
         if (threads.x * threads.y == 0) threads = dim3(DEFAULT_BLOCK_XDIM, maxThreadsPerBlock/DEFAULT_BLOCK_XDIM);
+        if (autotune) threads = tunedThreads("sweep", w, h);
         blocks = dim3(ceil(w/(float)threads.x), ceil(h/(float)threads.y));
 
-        // Create images on the device to hold windowed mean and std for reference image + intermediate images
-        // and calculate the images
-        Image<float> deviceRefmean(w, h);
-        Image<float> deviceRefstd(w, h);
-        Image<float> devInter1(w, h); // intermediate image, will hold square of means in this computation
-        windowed_mean_column(devInter1.data(), deviceRef.data(), winsize, false, w, h,
-                             blocks, threads);
-        windowed_mean_row(deviceRefmean.data(), devInter1.data(), winsize, false, w, h,
-                          blocks, threads);
+        // Reference rows are swept in strips if the working set does not fit into device memory
+        int nimgs = std::min(std::max((int)numberimages, 1), (int)HostSrc.size());
+        const bool census = costmetric == CostCensus;
+        std::vector<Strip> strips;
+        const bool tiled = planStrips("RunAlgorithm",
+                                      MemoryPlanner::planesweep(w, h, nimgs, numberplanes, fusedsweep, multiviewsweep, census, false,
+                                                                semiglobal && (costmetric == CostNCC), subplanerefine),
+                                      MemoryPlanner::planesweep(w, h, nimgs, numberplanes, fusedsweep, multiviewsweep, census, true,
+                                                                false, subplanerefine),
+                                      h, winsize / 2, {"sweep.", "thread.", "multiview.", "multidevice.", "rectified.", "sgm.", "mask.",
+                                                         "upload."}, strips);
+
+        // Normalized reference image is kept on the device for CudaDenoise
+        Image<float> &deviceRef = scratch("sweep.deviceRef", w, h);
+        Image<float> &deviceRefnorm = scratch("sweep.deviceRefNormalized", w, h);
+        timer.begin("upload");
+        UploadGray(deviceRef, &deviceRefnorm, -1, 1.f);
+        d_refnormalized = deviceRefnorm.data();
+
+        // Calculate homographies of all source views and planes
+        std::vector<Matrix3D> H;
+        std::vector<float> depths;
+        HomographyTable(H, depths, nimgs);
+
+        // Depthmap of the previous frame warped into this reference view limits the sweep to bands around it
+        temporalinit = false;
+        const bool sgm = semiglobal && !tiled && (costmetric == CostNCC) && (numberplanes <= SGM_MAX_PLANES);
+        if (temporal && temporalprior && !tiled && !sgm && (costmetric == CostNCC) && (temporalwidth == w) &&
+            (temporalheight == h)) {
+            timer.begin("predict");
+            Matrix3D Rrel;
+            Vector3D trel;
+            RelativeMatrices(Rrel, trel, temporalR, temporalt, HostRef.R, HostRef.t);
+            depthmap_forward_warp(scratch("temporal.predicted", w, h).data(), scratch("temporal.prior", w, h).data(),
+                                  Rrel, trel, K, znear, zfar, w, h, blocks, threads);
+            timer.count(3);
+            temporalinit = true;
+        }
 
-        windowed_mean_column(devInter1.data(), deviceRef.data(), winsize, true, w, h,
-                             blocks, threads);
-        windowed_mean_row(deviceRefstd.data(), devInter1.data(), winsize, false, w, h,
-                          blocks, threads);
+        // Views rectified to the reference are swept by row shifts, integer disparities replace the plane depths
+        std::vector<float> shifts(nimgs);
+        bool rectified = !tiled && !sgm && !temporalinit && (rectifiedmode != RectifiedOff) && (costmetric == CostNCC) && (nimgs > 0);
+        for (int i = 0; rectified && (i < nimgs); i++)
+            rectified = isRectified(i, shifts[i]) || (rectifiedmode == RectifiedOn);
+        inversesweep = inversedepth && (znear > 0) && (numberplanes > 1);
+        if (rectified && rectifiedinteger && (znear > 0)) {
+            const float b = std::fabs(shifts[0]);
+            std::vector<float> integer;
+            for (int d = (int)std::floor(b / znear); d >= std::max((int)std::ceil(b / zfar), 1); d--) integer.push_back(b / d);
+            if (!integer.empty()) depths.swap(integer);
+
+            // Integer disparities are uniform in inverse depth
+            if (depths.size() > 1) inversesweep = true;
+        }
 
-        calculate_STD(deviceRefstd.data(), deviceRefmean.data(),
-                      deviceRefstd.data(), w, h, blocks, threads);
+        // Only the per view sweep of PlaneSweepThread stores sources in reduced precision, options are checked rather
+        // than the sweep they select so that a configuration is either accepted or rejected for every frame. Strips
+        // depend on free memory rather than options, they sweep float sources instead.
+        if (tiled && verbose && (sourceprecision != SourceFloat))
+            printf("RunAlgorithm: strips sweep sources in full precision\n\n");
+        if (!sourcePrecisionSupported("RunAlgorithm", !semiglobal && !temporal && (rectifiedmode == RectifiedOff) &&
+                                      (pyramidlevels <= 1) && !multiviewsweep && ((devicecount == 1) || (nimgs <= 1)) &&
+                                      (costmetric == CostNCC) && !texturesampling)) {
+            timer.stop();
+            return false;
+        }
 
-        // Create images to hold depthmap values and number of times it exceeded NCC threshold
-        Image<float> devDepthmap(w, h);
-        Image<float> devN(w, h);
+        // Create image to hold depthmap values
+        Image<float> &devDepthmap = scratch("sweep.devDepthmap", w, h);
+        d_validmask = d_confidence = 0;
+        const bool masked = !tiled && prepareMask(w, h);
 
-        int nimgs = std::min(std::max((int)numberimages, 1), (int)HostSrc.size());
-        for (int i = 0; i < nimgs; i++)
-            PlaneSweep::PlaneSweepThread(devDepthmap.data(), devN.data(), deviceRef.data(), deviceRefmean.data(), deviceRefstd.data(), i);
+        if (tiled) {
+            timer.begin("sweep");
+            PlaneSweepStrips(devDepthmap, deviceRef, strips, H, depths, nimgs);
+        }
+        else {
+            timer.begin("statistics");
+
+            // Select windowed mean method
+            auto windowed_mean_column = slidingmean ? ::windowed_mean_column_sliding : ::windowed_mean_column;
+            auto windowed_mean_row = slidingmean ? ::windowed_mean_row_sliding : ::windowed_mean_row;
+
+            // Create images on the device to hold windowed mean and std for reference image + intermediate images
+            // and calculate the images
+            Image<float> &deviceRefmean = scratch("sweep.deviceRefmean", w, h);
+            Image<float> &deviceRefstd = scratch("sweep.deviceRefstd", w, h);
+            Image<float> &devInter1 = scratch("sweep.devInter1", w, h); // intermediate image, will hold square of means in this computation
+            if (costmetric == CostNCC) {
+                windowed_mean_column(devInter1.data(), deviceRef.data(), winsize, false, w, h,
+                                     blocks, threads);
+                windowed_mean_row(deviceRefmean.data(), devInter1.data(), winsize, false, w, h,
+                                  blocks, threads);
+
+                windowed_mean_column(devInter1.data(), deviceRef.data(), winsize, true, w, h,
+                                     blocks, threads);
+                windowed_mean_row(deviceRefstd.data(), devInter1.data(), winsize, false, w, h,
+                                  blocks, threads);
+
+                calculate_STD(deviceRefstd.data(), deviceRefmean.data(),
+                              deviceRefstd.data(), w, h, blocks, threads);
+                timer.count(5);
+            }
 
-        // Calculate averaged depthmap
-        element_rdivide(devDepthmap.data(), devDepthmap.data(), devN.data(), w, h, blocks, threads);
-        set_QNAN_value(devDepthmap.data(), zfar, w, h, blocks, threads);
+            // Reference census descriptors are computed once for all source views
+            d_refcensus = 0;
+            if (costmetric == CostCensus) {
+                d_refcensus = scratchPacked<unsigned long long>("sweep.refCensus", w, h);
+                census_transform(d_refcensus, deviceRef.data(), w, h, blocks, threads);
+                timer.count(1);
+            }
+
+            // Create images to hold depthmap values and number of times it exceeded NCC threshold
+            Image<float> &devN = scratch("sweep.devN", w, h);
+            set_value(devDepthmap.data(), 0.f, w, h, blocks, threads);
+            set_value(devN.data(), 0.f, w, h, blocks, threads);
+            timer.count(2);
+
+            // Move homographies of all source views and planes to device memory in one block
+            timer.begin("upload");
+            Image<Matrix3D> devH(H.size(), 1);
+            devH.copyFrom(Image<Matrix3D, Standard>(H.data(), H.size(), 1));
+            timer.count(0, H.size() * sizeof(Matrix3D));
+
+            timer.begin("sweep");
+            if (costmetric != CostNCC) for (int i = 0; i < nimgs; i++)
+                PlaneSweep::PlaneSweepThread(devDepthmap.data(), devN.data(), deviceRef.data(), deviceRefmean.data(), deviceRefstd.data(),
+                                             devH.data() + i * depths.size(), depths, i);
+            else if (sgm)
+                PlaneSweep::PlaneSweepSemiGlobal(devDepthmap.data(), devN.data(), deviceRef.data(), deviceRefmean.data(),
+                                                 deviceRefstd.data(), devH.data(), depths, nimgs);
+            else if (temporalinit)
+                PlaneSweep::PlaneSweepTemporal(devDepthmap.data(), devN.data(), deviceRef.data(), deviceRefmean.data(), deviceRefstd.data(),
+                                               devH.data(), scratch("temporal.predicted", w, h).data(), depths, nimgs);
+            else if (rectified)
+                PlaneSweep::PlaneSweepRectified(devDepthmap.data(), devN.data(), deviceRef.data(), deviceRefmean.data(), deviceRefstd.data(),
+                                                depths, shifts, nimgs);
+            else if (pyramidlevels > 1)
+                PlaneSweep::PlaneSweepPyramid(devDepthmap.data(), devN.data(), deviceRef, deviceRefmean.data(), deviceRefstd.data(),
+                                              devH.data(), depths, nimgs);
+            else if (multiviewsweep)
+                PlaneSweep::PlaneSweepMultiview(devDepthmap.data(), devN.data(), deviceRef.data(), deviceRefmean.data(), deviceRefstd.data(),
+                                                devH.data(), depths, nimgs);
+            // Mask and tile list live on the selected device only, masked sweeps stay on it
+            else if ((devicecount != 1) && (nimgs > 1) && !masked)
+                PlaneSweep::PlaneSweepMultiDevice(devDepthmap.data(), devN.data(), deviceRef.data(), deviceRefmean.data(), deviceRefstd.data(),
+                                                  H, depths, nimgs);
+            else {
+                // Float sources in linear memory are uploaded on their own stream one view ahead of the sweep
+                const bool staged = (sourceprecision == SourceFloat) && !texturesampling;
+                if (staged) stageSource(0);
+                for (int i = 0; i < nimgs; i++) {
+                    if (staged && (i + 1 < nimgs)) stageSource(i + 1);
+                    PlaneSweep::PlaneSweepThread(devDepthmap.data(), devN.data(), deviceRef.data(), deviceRefmean.data(),
+                                                 deviceRefstd.data(), devH.data() + i * depths.size(), depths, i);
+                }
+            }
+
+            // Calculate averaged depthmap, masked pixels count no views
+            timer.begin("average");
+            if (masked) element_multiply(devN.data(), devN.data(), d_maskinput, w, h, blocks, threads);
+            element_rdivide(devDepthmap.data(), devDepthmap.data(), devN.data(), w, h, blocks, threads);
+            set_QNAN_value(devDepthmap.data(), zfar, w, h, blocks, threads);
+            d_validmask = scratch("mask.valid", w, h).data();
+            valid_mask(d_validmask, devN.data(), 0, w, h, blocks, threads);
+
+            // Fraction of source views voting for each pixel, semi-global selection votes once
+            d_confidence = scratch("sweep.confidence", w, h).data();
+            depth_confidence(d_confidence, devN.data(), sgm ? 1.f : 1.f / std::max(nimgs, 1), w, h, blocks, threads);
+            timer.count(masked ? 5 : 4);
+
+            // Prediction completed with the new depthmap initializes CudaDenoise and TGV
+            if (temporalinit) {
+                replace_QNAN(scratch("temporal.predicted", w, h).data(), devDepthmap.data(), w, h, blocks, threads);
+                timer.count(1);
+            }
+        }
+        storeTemporalPrior(devDepthmap.data());
+        timer.stop();
 
         // Check for kernel errors
         CHECK_CUDA_ERRORS_AUTO(cudaPeekAtLastError());
 
-        // Copy depthmap to host
-        devDepthmap.copyTo(depthmap);
-        ConvertDepthtoUChar(depthmap, depthmap8u);
+        // Depthmap stays on the device, host copies are made by getters on demand
+        d_rawdepthmap = devDepthmap.data();
+        depthmappending = true;
+        depthmap8upending = true;
         depthavailable = true;
 
         //-----------------------------------------------------
 
-        auto t2 = std::chrono::high_resolution_clock::now();
-        std::cout << "Time taken for the algorithm to complete is " <<
-                     std::chrono::duration_cast<std::chrono::milliseconds>(t2-t1).count() << "ms\n\n";
-        std::cout.flush();
+        if (verbose) timer.timings().print(std::cout);
 
         return true;
 
@@ -160,57 +339,614 @@ bool PlaneSweep::RunAlgorithm(int argc, char **argv)
     return false;
 }
 
-void PlaneSweep::PlaneSweepThread(float *globDepth, float *globN, const float *Ref, const float *Refmean, const float *Refstd,
-                                  const unsigned int &index)
+bool PlaneSweep::RunPatchMatch(int argc, char **argv)
 {
-    int w = HostRef.width(), h = HostRef.height();
+    depthmap.reset(HostRef.width(), HostRef.height());
 
-    // calculate depth step size:
-    float dstep = (zfar - znear) / (numberplanes - 1);
+    if (verbose) printf("Starting PatchMatch algorithm...\n\n");
 
-    // Create image to store current source view
-    Image<float> devSrc(w, h);
+    try
+    {
+        if (cudaDevInit(argc, (const char **)argv) == NO_CUDA_DEVICE)
+        {
+            cudaReset();
+            return false;
+        }
 
-    // Create matrices to hold homography and relative rotation and transformation
-    Matrix3D H, Rrel, tr;
-    Vector3D trel;
+        // PatchMatch samples all source views from one float image
+        if (!sourcePrecisionSupported("RunPatchMatch", false)) return false;
 
-    // Create intermediate images to store current NCC, best NCC and current depthmap
-    Image<float> devNCC(w, h);
-    Image<float> devbestNCC(w, h);
-    Image<float> devDepth(w, h);
-    Image<float> devInter1(w, h);
+        NVTX_RANGE("RunPatchMatch", NvtxSweep);
+        timer.start("RunPatchMatch");
 
-    // Create images to store x and y indexes after transformation
-    Image<float> devx(w, h);
-    Image<float> devy(w, h);
+        int w = HostRef.width();
+        int h = HostRef.height();
+        if (threads.x * threads.y == 0) threads = dim3(DEFAULT_BLOCK_XDIM, maxThreadsPerBlock/DEFAULT_BLOCK_XDIM);
+        if (autotune) threads = tunedThreads("sweep", w, h);
+        blocks = dim3(ceil(w/(float)threads.x), ceil(h/(float)threads.y));
+        const int nimgs = std::min(std::min(std::max((int)numberimages, 1), (int)HostSrc.size()), PATCHMATCH_MAX_VIEWS);
+        const int area = w * h;
+
+        // Reference and all source views stay on the device for all iterations
+        Image<float> &deviceRef = scratch("patchmatch.deviceRef", w, h);
+        Image<float> &deviceRefnorm = scratch("patchmatch.deviceRefNormalized", w, h);
+        Image<float> &devSrc = scratch("patchmatch.devSrc", w, h * nimgs);
+        timer.begin("upload");
+        UploadGray(deviceRef, &deviceRefnorm, -1, 1.f);
+        d_refnormalized = deviceRefnorm.data();
+        for (int i = 0; i < nimgs; i++){
+            Image<float> view(devSrc.data() + i * area, w, h);
+            UploadGray(view, 0, i, 1.f);
+        }
 
-    // Create image to hold pixel values after transformation
-    Image<float> devWarped(w, h);
+        // Plane independent parts of the plane induced homographies of all source views
+        const Matrix3D invK = K.inv();
+        std::vector<Matrix3D> KRK(nimgs);
+        std::vector<float3> Kt(nimgs);
+        for (int i = 0; i < nimgs; i++){
+            Matrix3D Rrel;
+            Vector3D trel;
+            RelativeMatrices(Rrel, trel, HostRef.R, HostRef.t, HostSrc[i].R, HostSrc[i].t);
+            KRK[i] = K * Rrel * invK;
+            Kt[i] = K * (float3)trel;
+        }
+        Image<Matrix3D> devKRK(nimgs, 1);
+        Image<float3> devKt(nimgs, 1);
+        devKRK.copyFrom(Image<Matrix3D, Standard>(KRK.data(), nimgs, 1));
+        devKt.copyFrom(Image<float3, Standard>(Kt.data(), nimgs, 1));
+        timer.count(0, nimgs * (sizeof(Matrix3D) + sizeof(float3)));
+
+        timer.begin("statistics");
+        auto windowed_mean_column = slidingmean ? ::windowed_mean_column_sliding : ::windowed_mean_column;
+        auto windowed_mean_row = slidingmean ? ::windowed_mean_row_sliding : ::windowed_mean_row;
+        Image<float> &deviceRefmean = scratch("patchmatch.deviceRefmean", w, h);
+        Image<float> &deviceRefstd = scratch("patchmatch.deviceRefstd", w, h);
+        Image<float> &devInter1 = scratch("patchmatch.devInter1", w, h);
+        windowed_mean_column(devInter1.data(), deviceRef.data(), winsize, false, w, h, blocks, threads);
+        windowed_mean_row(deviceRefmean.data(), devInter1.data(), winsize, false, w, h, blocks, threads);
+        windowed_mean_column(devInter1.data(), deviceRef.data(), winsize, true, w, h, blocks, threads);
+        windowed_mean_row(deviceRefstd.data(), devInter1.data(), winsize, false, w, h, blocks, threads);
+        calculate_STD(deviceRefstd.data(), deviceRefmean.data(), deviceRefstd.data(), w, h, blocks, threads);
+        timer.count(5);
+
+        // Random planes, then red and black passes of propagation and refinement with halving range
+        timer.begin("patchmatch");
+        float4 *planes = scratchPacked<float4>("patchmatch.planes", w, h);
+        Image<float> &score = scratch("patchmatch.score", w, h);
+        patchmatch_init(planes, score.data(), devSrc.data(), deviceRef.data(), deviceRefmean.data(), deviceRefstd.data(),
+                        devKRK.data(), devKt.data(), invK, nimgs, patchmatchviews, znear, zfar, 0,
+                        winsize, stdthresh, w, h, blocks, threads);
+        float range = 0.5f;
+        for (unsigned int it = 0; it < patchmatchiterations; it++, range *= 0.5f){
+            NVTX_RANGE_INDEX("patchmatch iteration", NvtxSweep, it);
+            for (int parity = 0; parity < 2; parity++)
+                patchmatch_propagate(planes, score.data(), devSrc.data(), deviceRef.data(), deviceRefmean.data(),
+                                     deviceRefstd.data(), devKRK.data(), devKt.data(), invK, nimgs, patchmatchviews,
+                                     znear, zfar, parity, range, 16 * (2 * it + parity + 1), winsize, stdthresh,
+                                     w, h, blocks, threads);
+        }
+        timer.count(1 + 2 * patchmatchiterations, 0, 1 + patchmatchiterations);
+
+        // Depthmap as RunAlgorithm leaves it, pixels without a good plane are set to zfar
+        timer.begin("average");
+        Image<float> &devDepthmap = scratch("patchmatch.devDepthmap", w, h);
+        patchmatch_depthmap(devDepthmap.data(), planes, score.data(), nccthresh, w, h, blocks, threads);
+
+        // Rejected pixels are QNAN until filled, so positive depths are the valid ones. A pixel passes the threshold
+        // with the average of its best views or not at all, confidence is its validity.
+        d_validmask = d_confidence = scratch("mask.valid", w, h).data();
+        valid_mask(d_validmask, devDepthmap.data(), 0, w, h, blocks, threads);
+        set_QNAN_value(devDepthmap.data(), zfar, w, h, blocks, threads);
+        timer.count(3);
+        timer.stop();
+
+        CHECK_CUDA_ERRORS_AUTO(cudaPeekAtLastError());
+
+        d_rawdepthmap = devDepthmap.data();
+        depthmappending = true;
+        depthmap8upending = true;
+        depthavailable = true;
+
+        if (verbose) timer.timings().print(std::cout);
+
+        return true;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "Exception caught: \n";
+        std::cerr << e.what() << std::endl;
+
+        cudaReset();
+        return false;
+    }
+
+    return false;
+}
+
+bool PlaneSweep::RunAlgorithmBatch(int argc, char **argv, const std::vector<CamImage<float>> &refs,
+                                   const std::vector<CamImage<float>> &pool, const std::vector<std::vector<int>> &adjacency,
+                                   std::vector<CamImage<float>> &depthmaps)
+{
+    depthmaps.clear();
+    if (refs.empty()) return true;
+
+    if (verbose) printf("Starting batched plane sweep of %zu reference views...\n\n", refs.size());
+
+    try
+    {
+        if (cudaDevInit(argc, (const char **)argv) == NO_CUDA_DEVICE)
+        {
+            cudaReset();
+            return false;
+        }
+
+        // Device resident source frames of a batch are float
+        if (!sourcePrecisionSupported("RunAlgorithmBatch", false)) return false;
+
+        NVTX_RANGE("RunAlgorithmBatch", NvtxSweep);
+        timer.start("RunAlgorithmBatch");
+
+        const int w = refs[0].width(), h = refs[0].height(), area = w * h;
+        const int nrefs = refs.size(), npool = pool.size();
+        if (adjacency.size() != refs.size()) THROW_EXCEP("Batch needs an adjacency list for each reference view");
+        for (size_t i = 0; i < refs.size() + pool.size(); i++) {
+            const CamImage<float> &view = i < refs.size() ? refs[i] : pool[i - refs.size()];
+            if ((int)view.width() != w || (int)view.height() != h) THROW_EXCEP("All views of a batch need the same size");
+        }
+
+        // Source slots of all references, references with fewer sources are skipped in later slots
+        int maxadj = 0;
+        for (int r = 0; r < nrefs; r++) maxadj = std::max(maxadj, (int)adjacency[r].size());
+        std::vector<int> adj(nrefs * maxadj, -1);
+        for (int r = 0; r < nrefs; r++)
+            for (size_t k = 0; k < adjacency[r].size(); k++) {
+                if ((adjacency[r][k] < 0) || (adjacency[r][k] >= npool)) THROW_EXCEP("Batch adjacency index out of pool");
+                adj[r * maxadj + k] = adjacency[r][k];
+            }
+
+        const std::vector<std::string> prefixes = {"batch."};
+        const size_t available = MemoryPlanner::available(memorylimit) + (memorylimit ? 0 : workspaceBytes(prefixes));
+        const size_t bytes = MemoryPlanner::batch(w, h, nrefs, npool, numberplanes, subplanerefine);
+        if (!MemoryPlanner::fits(bytes, available))
+            THROW_EXCEP("Batch of " + std::to_string(nrefs) + " reference and " + std::to_string(npool) +
+                        " source views needs " + std::to_string(bytes >> 20) + " MB of device memory, " +
+                        std::to_string(available >> 20) + " MB available, split it into smaller batches");
+
+        if (threads.x * threads.y == 0) threads = dim3(DEFAULT_BLOCK_XDIM, maxThreadsPerBlock/DEFAULT_BLOCK_XDIM);
+        if (autotune) threads = tunedThreads("sweep", w, h);
+        blocks = dim3(ceil(w/(float)threads.x), ceil(h/(float)threads.y));
+        dim3 stackblocks(blocks.x, ceil(h * nrefs / (float)threads.y));
+
+        // Pool and references are uploaded once into stacks, kernels expect unpadded rows
+        timer.begin("upload");
+        Image<float> &devPool = scratch("batch.pool", w, h * std::max(npool, 1));
+        Image<float> &devRef = scratch("batch.ref", w, h * nrefs);
+        for (int i = 0; i < npool; i++) Image<float>(devPool.data() + i * area, w, h).copyFromAsync(pool[i], 0);
+        for (int r = 0; r < nrefs; r++) Image<float>(devRef.data() + r * area, w, h).copyFromAsync(refs[r], 0);
+        timer.count(0, size_t(npool + nrefs) * area * sizeof(float));
+
+        // Homographies of all slots and planes, entry (r * maxadj + k) * nplanes + p, empty slots are never read
+        std::vector<float> depths;
+        PlaneDepths(depths);
+        inversesweep = inversedepth && (znear > 0) && (numberplanes > 1);
+        const int nplanes = depths.size();
+        std::vector<Matrix3D> H(nrefs * maxadj * nplanes);
+        for (int r = 0; r < nrefs; r++)
+            for (size_t k = 0; k < adjacency[r].size(); k++)
+                PairHomographies(H.data() + (r * maxadj + k) * nplanes, depths, refs[r], pool[adjacency[r][k]], K);
+
+        Image<Matrix3D> devH(std::max(H.size(), size_t(1)), 1);
+        Image<int> devAdj(std::max(adj.size(), size_t(1)), 1);
+        if (!H.empty()) devH.copyFrom(Image<Matrix3D, Standard>(H.data(), H.size(), 1));
+        if (!adj.empty()) devAdj.copyFrom(Image<int, Standard>(adj.data(), adj.size(), 1));
+        timer.count(0, H.size() * sizeof(Matrix3D) + adj.size() * sizeof(int));
+
+        // Windowed mean and STD of each reference, windows must not cross into neighbouring views of the stack
+        timer.begin("statistics");
+        auto windowed_mean_column = slidingmean ? ::windowed_mean_column_sliding : ::windowed_mean_column;
+        auto windowed_mean_row = slidingmean ? ::windowed_mean_row_sliding : ::windowed_mean_row;
+        Image<float> &devRefmean = scratch("batch.refmean", w, h * nrefs);
+        Image<float> &devRefstd = scratch("batch.refstd", w, h * nrefs);
+        Image<float> &devInter = scratch("batch.devInter", w, h);
+        for (int r = 0; r < nrefs; r++) {
+            const float *ref = devRef.data() + r * area;
+            float *mean = devRefmean.data() + r * area, *stdev = devRefstd.data() + r * area;
+            windowed_mean_column(devInter.data(), ref, winsize, false, w, h, blocks, threads);
+            windowed_mean_row(mean, devInter.data(), winsize, false, w, h, blocks, threads);
+            windowed_mean_column(devInter.data(), ref, winsize, true, w, h, blocks, threads);
+            windowed_mean_row(stdev, devInter.data(), winsize, false, w, h, blocks, threads);
+            calculate_STD(stdev, mean, stdev, w, h, blocks, threads);
+        }
+        timer.count(5 * nrefs);
+
+        Image<float> &devDepthmap = scratch("batch.devDepthmap", w, h * nrefs);
+        Image<float> &devN = scratch("batch.devN", w, h * nrefs);
+        Image<float> &devbestNCC = scratch("batch.devbestNCC", w, h * nrefs);
+        Image<float> &devDepth = scratch("batch.devDepth", w, h * nrefs);
+        set_value(devDepthmap.data(), 0.f, w, h * nrefs, stackblocks, threads);
+        set_value(devN.data(), 0.f, w, h * nrefs, stackblocks, threads);
+        timer.count(2);
+
+        // For each source slot evaluate all references with a single launch per plane
+        timer.begin("sweep");
+        const float substep = subplaneStep(depths);
+        for (int k = 0; k < maxadj; k++) {
+            NVTX_RANGE_INDEX("sweep batch slot", NvtxSweep, k);
+            set_value(devbestNCC.data(), 0.f, w, h * nrefs, stackblocks, threads);
+            set_value(devDepth.data(), 0.f, w, h * nrefs, stackblocks, threads);
+            float *subplane = subplaneState("batch.devSubplane", w, h, nrefs);
+
+            for (int p = 0; p < nplanes; p++)
+                planesweep_fused_NCC_batch(devDepth.data(), devbestNCC.data(),
+                                           devPool.data(), devAdj.data() + k, maxadj,
+                                           devRef.data(), devRefmean.data(), devRefstd.data(),
+                                           devH.data() + k * nplanes + p, maxadj * nplanes, nrefs, depths[p],
+                                           winsize, stdthresh, w, h, blocks, threads, subplane);
+
+            // References without a source in this slot keep zero scores, so they add nothing
+            for (int r = 0; r < nrefs; r++)
+                sum_depthmap_NCC(devDepthmap.data() + r * area, devN.data() + r * area,
+                                 devDepth.data() + r * area, devbestNCC.data() + r * area,
+                                 nccthresh, w, h,
+                                 blocks, threads, subplane ? subplane + 3 * r * area : 0, substep, inversesweep);
+            timer.count(2 + nplanes + nrefs, 0, nplanes * nrefs);
+        }
+
+        // Depthmaps of a batch are returned on the host, masks of the last RunAlgorithm would not match them
+        d_validmask = d_confidence = 0;
+
+        // Calculate averaged depthmaps of the whole stack
+        timer.begin("average");
+        element_rdivide(devDepthmap.data(), devDepthmap.data(), devN.data(), w, h * nrefs, stackblocks, threads);
+        set_QNAN_value(devDepthmap.data(), zfar, w, h * nrefs, stackblocks, threads);
+        timer.count(2);
+
+        timer.begin("download");
+        depthmaps.resize(nrefs);
+        for (int r = 0; r < nrefs; r++) {
+            depthmaps[r].reset(w, h);
+            depthmaps[r].R = refs[r].R;
+            depthmaps[r].t = refs[r].t;
+            Image<float>(devDepthmap.data() + r * area, w, h).copyTo(depthmaps[r]);
+        }
+        timer.count(0, size_t(nrefs) * area * sizeof(float));
+        timer.stop();
+
+        // Check for kernel errors
+        CHECK_CUDA_ERRORS_AUTO(cudaPeekAtLastError());
+
+        if (verbose) timer.timings().print(std::cout);
+
+        return true;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "Exception caught: \n";
+        std::cerr << e.what() << std::endl;
+
+        depthmaps.clear();
+        cudaReset();
+        return false;
+    }
+
+    return false;
+}
+
+bool PlaneSweep::prepareMask(int w, int h)
+{
+    d_maskinput = 0;
+    d_masktiles = 0;
+    nmasktiles = 0;
+    const bool usemask = !maskdata.empty() && (maskwidth == (size_t)w) && (maskheight == (size_t)h);
+    if (!usemask && (roi.w <= 0)) return false;
+
+    // Mask and tiles stay on the device until setMask(), setROI(), the block size or the workspace change
+    int dev = 0;
+    CHECK_CUDA_ERRORS_AUTO(cudaGetDevice(&dev));
+    if (maskcache.valid && (maskcache.device == dev) && (maskcache.w == w) && (maskcache.h == h) &&
+        (maskcache.threads.x == threads.x) && (maskcache.threads.y == threads.y)) {
+        d_maskinput = maskcache.input;
+        d_masktiles = maskcache.tiles;
+        nmasktiles = maskcache.ntiles;
+        return true;
+    }
+
+    // Validity of each pixel and block sized tiles holding at least one valid pixel
+    std::vector<float> valid(w * h);
+    const int bx = ceil(w / (float)threads.x), by = ceil(h / (float)threads.y);
+    std::vector<char> active(bx * by, 0);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            const bool inroi = (roi.w <= 0) || ((x >= roi.x) && (x < roi.x + roi.w) && (y >= roi.y) && (y < roi.y + roi.h));
+            const bool v = inroi && (!usemask || maskdata[y * w + x]);
+            valid[y * w + x] = v ? 1.f : 0.f;
+            if (v) active[(y / threads.y) * bx + x / threads.x] = 1;
+        }
+    std::vector<int2> tiles;
+    for (int j = 0; j < by; j++)
+        for (int i = 0; i < bx; i++)
+            if (active[j * bx + i]) tiles.push_back(make_int2(i, j));
+
+    timer.begin("mask");
+    Image<float> &devMask = scratch("mask.input", w, h);
+    devMask.copyFrom(Image<float, Standard>(valid.data(), w, h));
+    d_maskinput = devMask.data();
+    nmasktiles = tiles.size();
+    d_masktiles = scratchPacked<int2>("mask.tiles", std::max(nmasktiles, 1), 1);
+    if (nmasktiles) Image<int2>(d_masktiles, nmasktiles, 1).copyFrom(Image<int2, Standard>(tiles.data(), nmasktiles, 1));
+    timer.count(0, valid.size() * sizeof(float) + tiles.size() * sizeof(int2));
+    maskcache = MaskCache{true, dev, w, h, threads, d_maskinput, d_masktiles, nmasktiles};
+
+    if (verbose) printf("Mask keeps %d of %d tiles\n\n", nmasktiles, bx * by);
+    return true;
+}
+
+void PlaneSweep::MaskDepthmap(float *d_depth, float minconfidence)
+{
+    if (!d_depth || !d_validmask) return;
+    const int w = depthmap.width(), h = depthmap.height();
+    const dim3 blocks(ceil(w / (float)threads.x), ceil(h / (float)threads.y));
+
+    // Confidence is 0 wherever the validity mask is, so it replaces the mask
+    if ((minconfidence > 0) && d_confidence) set_QNAN_masked(d_depth, d_confidence, w, h, blocks, threads, minconfidence);
+    else set_QNAN_masked(d_depth, d_validmask, w, h, blocks, threads);
+}
+
+float *PlaneSweep::subplaneState(const std::string &name, int w, int h, int views)
+{
+    if (!subplanerefine) return 0;
+    Image<float> &state = scratch(name, w, 3 * h * views);
+    dim3 b(ceil(w / (float)threads.x), ceil(3 * h * views / (float)threads.y));
+    set_value(state.data(), SUBPLANE_NONE, w, 3 * h * views, b, threads);
+    timer.count(1);
+    return state.data();
+}
+
+float PlaneSweep::subplaneStep(const std::vector<float> &depths) const
+{
+    if (depths.size() < 2) return 0.f;
+    return inversesweep ? 1.f / depths[1] - 1.f / depths[0] : depths[1] - depths[0];
+}
+
+bool PlaneSweep::RunAlgorithmCpu()
+{
+    auto t0 = std::chrono::high_resolution_clock::now();
+    if (!cpuengine) cpuengine = std::make_shared<CpuEngine>(cputhreads);
+
+    const int w = HostRef.width(), h = HostRef.height();
+    const int nimgs = std::min(std::max((int)numberimages, 1), (int)HostSrc.size());
+
+    std::vector<Matrix3D> H;
+    std::vector<float> depths;
+    HomographyTable(H, depths, nimgs);
+
+    std::vector<float> ref;
+    std::vector<std::vector<float>> src(nimgs);
+    std::vector<const float *> views(nimgs);
+    HostGray(ref, -1);
+    for (int i = 0; i < nimgs; i++){
+        HostGray(src[i], i);
+        views[i] = src[i].data();
+    }
+
+    cpuengine->planesweep(depthmap.data(), ref.data(), views, H, depths, w, h, winsize, stdthresh, nccthresh, zfar);
+    ConvertDepthtoUChar(depthmap, depthmap8u);
+
+    // Normalized reference guides CPU denoising
+    cpuguide.resize(ref.size());
+    for (size_t i = 0; i < ref.size(); i++) cpuguide[i] = ref[i] * (1.f / 255.f);
+
+    depthmappending = depthmap8upending = false;
+    depthavailable = true;
+    cpuactive = true;
+
+    if (verbose)
+        printf("CPU planesweep on %u threads: %.1f ms\n\n", cpuengine->threads(),
+               std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count());
+    return true;
+}
+
+bool PlaneSweep::CudaDenoiseCpu(const unsigned int niters, const double lambda, const double tau, const double sigma,
+                                const double theta, const double beta, const double gamma)
+{
+    auto t0 = std::chrono::high_resolution_clock::now();
+    if (!cpuengine) cpuengine = std::make_shared<CpuEngine>(cputhreads);
+
+    const int w = depthmap.width(), h = depthmap.height();
+    depthmapdenoised.reset(w, h);
+    cpuengine->tvl1(depthmapdenoised.data(), depthmap.data(), cpuguide.data(), w, h, niters, lambda, tau, sigma,
+                    theta, beta, gamma, znear, zfar);
+    ConvertDepthtoUChar(depthmapdenoised, depthmap8udenoised);
+    tvl1iterations = niters;
+    denoisedpending = denoised8upending = false;
+
+    if (verbose)
+        printf("CPU TVL1 denoising on %u threads: %.1f ms\n\n", cpuengine->threads(),
+               std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count());
+    return true;
+}
+
+void PlaneSweep::HostGray(std::vector<float> &dst, int view) const
+{
+    const CamImage<float> &gray = view < 0 ? HostRef : HostSrc[view];
+    const CamImage<uchar4> *rgba = view < 0 ? &HostRefRGBA : (view < (int)HostSrcRGBA.size() ? &HostSrcRGBA[view] : 0);
+    const size_t w = gray.width(), h = gray.height();
+    dst.resize(w * h);
+
+    // Same weights and byte order as convert_rgba_to_gray
+    if (rgba && rgba->isValid() && (rgba->width() == w) && (rgba->height() == h)){
+        for (size_t i = 0; i < w * h; i++){
+            const uchar4 c = rgba->data()[i];
+            dst[i] = RGB2GRAY_WEIGHT_RED * c.z + RGB2GRAY_WEIGHT_GREEN * c.y + RGB2GRAY_WEIGHT_BLUE * c.x;
+        }
+        return;
+    }
+    std::copy(gray.data(), gray.data() + w * h, dst.begin());
+}
+
+void PlaneSweep::PlaneSweepThread(float *globDepth, float *globN, const float *Ref, const float *Refmean, const float *Refstd,
+                                  const Matrix3D *d_H, const std::vector<float> &depths, const unsigned int &index)
+{
+    NVTX_RANGE_INDEX("sweep source", NvtxSweep, index);
+    int w = HostRef.width(), h = striprows > 0 ? striprows : HostRef.height();
+    int nplanes = depths.size();
+
+    // Strips of PlaneSweepStrips warp into full float sources in linear memory with separable NCC
+    const bool strip = striprows > 0;
+    const bool texture = texturesampling && !strip, fused = fusedsweep && !strip;
+    const SourcePrecision precision = strip ? SourceFloat : sourceprecision;
+    const CostMetric cost = strip ? CostNCC : costmetric;
+
+    // Create image or texture to store current source view, float sources staged by stageSource() are used in place
+    const float *staged = ((cost == CostNCC) && !texture && (precision == SourceFloat) && !strip) ? stagedSource(index) : 0;
+    Image<float> devSrc(const_cast<float *>(staged), staged ? HostSrc[index].width() : 0, staged ? HostSrc[index].height() : 0);
+    Image<__half> devSrc16f(precision == SourceHalf ? scratchDense<__half>("thread.devSrc16f", w, h) : 0, w, h);
+    Image<uchar> devSrc8u(precision == SourceUChar ? scratchDense<uchar>("thread.devSrc8u", w, h) : 0, w, h);
+    Texture<float> texSrc;
+
+    // Create images to store best NCC and current depthmap
+    Image<float> &devbestNCC = scratch("thread.devbestNCC", w, h);
+    Image<float> &devDepth = scratch("thread.devDepth", w, h);
+    set_value(devbestNCC.data(), 0.f, w, h, blocks, threads);
+    set_value(devDepth.data(), 0.f, w, h, blocks, threads);
+    timer.count(2);
+    float *subplane = subplaneState("thread.devSubplane", w, h, 1);
+    const float substep = subplaneStep(depths);
+
+    // SAD and census costs sweep float sources in linear memory
+    if (cost != CostNCC){
+        devSrc.reset(w, h);
+        UploadGray(devSrc, 0, index, 1.f);
+
+        unsigned long long *srcCensus = 0;
+        if (cost == CostCensus){
+            srcCensus = scratchPacked<unsigned long long>("thread.srcCensus", w, h);
+            census_transform(srcCensus, devSrc.data(), w, h, blocks, threads);
+            timer.count(1);
+        }
+
+        for (int p = 0; p < nplanes; p++){
+            if (cost == CostCensus)
+                planesweep_fused_census(devDepth.data(), devbestNCC.data(), srcCensus, d_refcensus,
+                                        d_H + p, depths[p], winsize, w, h, blocks, threads, subplane);
+            else
+                planesweep_fused_SAD(devDepth.data(), devbestNCC.data(), devSrc.data(), Ref,
+                                     d_H + p, depths[p], winsize, w, h, blocks, threads, subplane);
+        }
+
+        sum_depthmap_NCC(globDepth, globN,
+                         devDepth.data(), devbestNCC.data(),
+                         nccthresh, w, h,
+                         blocks, threads, subplane, substep, inversesweep);
+        timer.count(nplanes + 1, 0, nplanes);
+
+        return;
+    }
 
     // Copy source view to device
-    devSrc.copyFrom(HostSrc[index]);
+    if (texture){
+        texSrc.reset(w, h);
+        texSrc.copyFrom(HostSrc[index]);
+        timer.count(0, w * h * sizeof(float));
+    }
+    // Reduced precision sources are uploaded as they are stored, no float copy is made on the device
+    else if (precision == SourceHalf) UploadGray(devSrc16f, index);
+    else if (precision == SourceUChar) UploadGray(devSrc8u, index);
+    else if (!staged) {
+        devSrc.reset(HostSrc[index].width(), HostSrc[index].height());
+        UploadGray(devSrc, 0, index, 1.f);
+    }
 
-    // Calculate relative rotation and translation:
-    RelativeMatrices(Rrel, trel, HostRef.R, HostRef.t, HostSrc[index].R, HostSrc[index].t);
-    tr.row(2) = trel;
-    tr = tr.trans();
+    if (fused){
+        // Warping, windowed statistics and depthmap update are done by a single kernel per plane
+        for (int p = 0; p < nplanes; p++){
+            if (texture)
+                planesweep_fused_NCC_texture(devDepth.data(), devbestNCC.data(),
+                                             texSrc.texture(), Ref, Refmean, Refstd,
+                                             d_H + p, depths[p], winsize, stdthresh, w, h,
+                                             blocks, threads, subplane);
+            else if (precision == SourceHalf)
+                planesweep_fused_NCC(devDepth.data(), devbestNCC.data(),
+                                     devSrc16f.data(), Ref, Refmean, Refstd,
+                                     d_H + p, depths[p], winsize, stdthresh, w, h,
+                                     blocks, threads, subplane);
+            else if (precision == SourceUChar)
+                planesweep_fused_NCC(devDepth.data(), devbestNCC.data(),
+                                     devSrc8u.data(), Ref, Refmean, Refstd,
+                                     d_H + p, depths[p], winsize, stdthresh, w, h,
+                                     blocks, threads, subplane);
+            else if (d_masktiles && !strip)
+                planesweep_fused_NCC_tiles(devDepth.data(), devbestNCC.data(),
+                                           devSrc.data(), Ref, Refmean, Refstd,
+                                           d_H + p, depths[p], winsize, stdthresh,
+                                           d_masktiles, nmasktiles, d_maskinput, w, h,
+                                           threads, subplane);
+            else if (!KernelJit::instance().planesweepNCC(devDepth.data(), devbestNCC.data(), subplane,
+                                                          devSrc.data(), Ref, Refmean, Refstd,
+                                                          d_H + p, depths[p], winsize, stdthresh, w, h,
+                                                          blocks, threads))
+                planesweep_fused_NCC(devDepth.data(), devbestNCC.data(),
+                                     devSrc.data(), Ref, Refmean, Refstd,
+                                     d_H + p, depths[p], winsize, stdthresh, w, h,
+                                     blocks, threads, subplane);
+        }
+
+        sum_depthmap_NCC(globDepth, globN,
+                         devDepth.data(), devbestNCC.data(),
+                         nccthresh, w, h,
+                         blocks, threads, subplane, substep, inversesweep);
+        timer.count(nplanes + 1, 0, nplanes);
+        if (!strip) releaseSource(index);
+
+        return;
+    }
+
+    // Select windowed mean method
+    auto windowed_mean_column = slidingmean ? ::windowed_mean_column_sliding : ::windowed_mean_column;
+    auto windowed_mean_row = slidingmean ? ::windowed_mean_row_sliding : ::windowed_mean_row;
+
+    // Create intermediate images to store current NCC and intermediate results
+    Image<float> &devNCC = scratch("thread.devNCC", w, h);
+    Image<float> &devInter1 = scratch("thread.devInter1", w, h);
+
+    // Create images to store x and y indexes after transformation
+    Image<float> &devx = scratch("thread.devx", w, h);
+    Image<float> &devy = scratch("thread.devy", w, h);
+
+    // Create image to hold pixel values after transformation
+    Image<float> &devWarped = scratch("thread.devWarped", w, h);
 
     // For each depth calculate NCC and update depthmap as required
-    for (float d = znear; d <= zfar; d += dstep){
-        // Calculate homography:
-        H = K * (Rrel + tr / d) * invK;
-        H = H / H(2,2);
+    for (int p = 0; p < nplanes; p++){
+        const float d = depths[p];
 
         // Calculate transformed pixel coordinates
-        transform_indexes(devx.data(), devy.data(), H, w, h, blocks, threads);
+        transform_indexes(devx.data(), devy.data(), d_H + p, w, h, blocks, threads);
 
         // interpolate pixel values:
-        bilinear_interpolation(devWarped.data(), devSrc.data(),
-                               devx.data(), devy.data(),
-                               devSrc.width(), devSrc.height(),
-                               devx.width(), devx.height(),
-                               blocks, threads);
+        if (texture)
+            bilinear_interpolation_texture(devWarped.data(), texSrc.texture(),
+                                           devx.data(), devy.data(),
+                                           devx.width(), devx.height(),
+                                           blocks, threads);
+        else if (precision == SourceHalf)
+            bilinear_interpolation(devWarped.data(), devSrc16f.data(),
+                                   devx.data(), devy.data(),
+                                   w, h,
+                                   devx.width(), devx.height(),
+                                   blocks, threads);
+        else if (precision == SourceUChar)
+            bilinear_interpolation(devWarped.data(), devSrc8u.data(),
+                                   devx.data(), devy.data(),
+                                   w, h,
+                                   devx.width(), devx.height(),
+                                   blocks, threads);
+        else
+            bilinear_interpolation(devWarped.data(), devSrc.data(),
+                                   devx.data(), devy.data(),
+                                   devSrc.width(), devSrc.height(),
+                                   devx.width(), devx.height(),
+                                   blocks, threads);
 
         // We have no more use for devx and devy, we can use them to store intermediate results now
         // devx - will hold windowed mean of warped image
@@ -246,23 +982,559 @@ void PlaneSweep::PlaneSweepThread(float *globDepth, float *globN, const float *R
         // set other values to current ncc and depth
         update_arrays(devDepth.data(), devbestNCC.data(),
                       devNCC.data(), d, w, h,
-                      blocks, threads);
+                      blocks, threads, subplane);
 
     }
 
     sum_depthmap_NCC(globDepth, globN,
                      devDepth.data(), devbestNCC.data(),
                      nccthresh, w, h,
-                     blocks, threads);
+                     blocks, threads, subplane, substep, inversesweep);
+    timer.count(nplanes * 12 + 1, 0, nplanes);
+    if (!strip) releaseSource(index);
 
     return;
 }
 
+void PlaneSweep::PlaneSweepMultiview(float *globDepth, float *globN, const float *Ref, const float *Refmean, const float *Refstd,
+                                     const Matrix3D *d_H, const std::vector<float> &depths, const unsigned int nimgs)
+{
+    NVTX_RANGE_INDEX("sweep multiview", NvtxSweep, nimgs);
+    int w = HostRef.width(), h = HostRef.height();
+    int area = w * h;
+    int nplanes = depths.size();
+
+    // Create stacked images to store all source views, their best NCC and depthmaps
+    Image<float> &devSrc = scratch("multiview.devSrc", w, h * nimgs);
+    Image<float> &devbestNCC = scratch("multiview.devbestNCC", w, h * nimgs);
+    Image<float> &devDepth = scratch("multiview.devDepth", w, h * nimgs);
+
+    dim3 stackblocks(blocks.x, ceil(h * nimgs / (float)threads.y));
+    set_value(devbestNCC.data(), 0.f, w, h * nimgs, stackblocks, threads);
+    set_value(devDepth.data(), 0.f, w, h * nimgs, stackblocks, threads);
+    timer.count(2);
+    float *subplane = subplaneState("multiview.devSubplane", w, h, nimgs);
+    const float substep = subplaneStep(depths);
+
+    // Copy source views to their place in the stack, kernels expect unpadded rows
+    for (unsigned int i = 0; i < nimgs; i++){
+        Image<float> view(devSrc.data() + i * area, w, h);
+        UploadGray(view, 0, i, 1.f);
+    }
+
+    // For each depth evaluate all source views with a single launch
+    for (int p = 0; p < nplanes; p++)
+        planesweep_fused_NCC_multiview(devDepth.data(), devbestNCC.data(),
+                                       devSrc.data(), Ref, Refmean, Refstd,
+                                       d_H + p, nplanes, nimgs, depths[p], winsize, stdthresh, w, h,
+                                       blocks, threads, subplane);
+
+    for (unsigned int i = 0; i < nimgs; i++)
+        sum_depthmap_NCC(globDepth, globN,
+                         devDepth.data() + i * area, devbestNCC.data() + i * area,
+                         nccthresh, w, h,
+                         blocks, threads, subplane ? subplane + 3 * i * area : 0, substep, inversesweep);
+    timer.count(nplanes + nimgs, 0, nplanes * nimgs);
+}
+
+void PlaneSweep::PlaneSweepRectified(float *globDepth, float *globN, const float *Ref, const float *Refmean, const float *Refstd,
+                                     const std::vector<float> &depths, const std::vector<float> &shifts, const unsigned int nimgs)
+{
+    NVTX_RANGE_INDEX("sweep rectified", NvtxSweep, nimgs);
+    int w = HostRef.width(), h = HostRef.height();
+    int nplanes = depths.size();
+
+    // Plane depths in the first row, disparities of source view i in row i + 1
+    std::vector<float> table((nimgs + 1) * nplanes);
+    std::copy(depths.begin(), depths.end(), table.begin());
+    for (unsigned int i = 0; i < nimgs; i++)
+        for (int p = 0; p < nplanes; p++) table[(i + 1) * nplanes + p] = shifts[i] / depths[p];
+    Image<float> &devTable = scratch("rectified.devTable", nplanes, nimgs + 1);
+    devTable.copyFrom(Image<float, Standard>(table.data(), nplanes, nimgs + 1));
+    timer.count(0, table.size() * sizeof(float));
+
+    Image<float> &devSrc = scratch("rectified.devSrc", w, h);
+    Image<float> &devbestNCC = scratch("rectified.devbestNCC", w, h);
+    Image<float> &devDepth = scratch("rectified.devDepth", w, h);
+    const int span = planesweep_rectified_span(winsize, threads);
+    if (span < 0) THROW_EXCEP("Rectified planesweep tile of " + std::to_string(threads.x) + "x" +
+                              std::to_string(threads.y) + " threads does not fit into shared memory");
+
+    unsigned int launches = 0;
+    const float substep = subplaneStep(depths);
+    for (unsigned int i = 0; i < nimgs; i++){
+        UploadGray(devSrc, 0, i, 1.f);
+        set_value(devbestNCC.data(), 0.f, w, h, blocks, threads);
+        set_value(devDepth.data(), 0.f, w, h, blocks, threads);
+        float *subplane = subplaneState("rectified.devSubplane", w, h, 1);
+
+        // Consecutive planes share a launch while their disparity range fits into shared memory
+        const float *disparity = table.data() + (i + 1) * nplanes;
+        for (int p0 = 0, p1; p0 < nplanes; p0 = p1){
+            int dmin = (int)std::floor(disparity[p0]), dmax = dmin;
+            for (p1 = p0 + 1; p1 < nplanes; p1++){
+                const int d = (int)std::floor(disparity[p1]);
+                if (std::max(dmax, d) - std::min(dmin, d) > span) break;
+                dmin = std::min(dmin, d);
+                dmax = std::max(dmax, d);
+            }
+            planesweep_rectified_NCC(devDepth.data(), devbestNCC.data(), devSrc.data(), Ref, Refmean, Refstd,
+                                     devTable.data() + (i + 1) * nplanes + p0, devTable.data() + p0, p1 - p0,
+                                     dmin, dmax, winsize, stdthresh, w, h, blocks, threads, subplane);
+            launches++;
+        }
+
+        sum_depthmap_NCC(globDepth, globN,
+                         devDepth.data(), devbestNCC.data(),
+                         nccthresh, w, h,
+                         blocks, threads, subplane, substep, inversesweep);
+    }
+    timer.count(launches + 3 * nimgs, 0, nplanes * nimgs);
+}
+
+void PlaneSweep::PlaneSweepSemiGlobal(float *globDepth, float *globN, const float *Ref, const float *Refmean, const float *Refstd,
+                                      const Matrix3D *d_H, const std::vector<float> &depths, const unsigned int nimgs)
+{
+    NVTX_RANGE_INDEX("sweep semiglobal", NvtxSweep, nimgs);
+    int w = HostRef.width(), h = HostRef.height();
+    int area = w * h;
+    int nplanes = depths.size();
+
+    // All source views are stacked, planes are swept in the outer loop
+    Image<float> &devSrc = scratch("sgm.devSrc", w, h * nimgs);
+    Image<float> &devSum = scratch("sgm.devSum", w, h);
+    for (unsigned int i = 0; i < nimgs; i++){
+        Image<float> view(devSrc.data() + i * area, w, h);
+        UploadGray(view, 0, i, 1.f);
+    }
+
+    // Byte costs and 16 bit aggregated costs live in float workspace images, 4 and 2 of them per float
+    unsigned char *volume = reinterpret_cast<unsigned char *>(scratch("sgm.volume", w, (h * nplanes + 3) / 4).data());
+    unsigned short *aggregated = reinterpret_cast<unsigned short *>(scratch("sgm.aggregated", w, (h * nplanes + 1) / 2).data());
+
+    for (int p = 0; p < nplanes; p++)
+        for (unsigned int i = 0; i < nimgs; i++)
+            planesweep_volume_NCC(volume, devSum.data(), devSrc.data() + i * area, Ref, Refmean, Refstd,
+                                  d_H + i * nplanes + p, p, nplanes, i, nimgs, winsize, stdthresh, w, h, blocks, threads);
+    timer.count(nplanes * nimgs, 0, nplanes * nimgs);
+
+    timer.begin("aggregate");
+    Image<float> devDepths(nplanes, 1);
+    devDepths.copyFrom(Image<float, Standard>(const_cast<float *>(depths.data()), nplanes, 1));
+    CHECK_CUDA_ERRORS_AUTO(cudaMemset(aggregated, 0, size_t(area) * nplanes * sizeof(unsigned short)));
+    sgm_aggregate(aggregated, volume, nplanes, sgmpaths, sgmP1, sgmP2, w, h);
+    sgm_select(globDepth, globN, aggregated, volume, devDepths.data(), nplanes, nccthresh, w, h, blocks, threads);
+    timer.count(sgmpaths + 2, nplanes * sizeof(float));
+}
+
+void PlaneSweep::PlaneSweepTemporal(float *globDepth, float *globN, const float *Ref, const float *Refmean, const float *Refstd,
+                                    const Matrix3D *d_H, const float *predicted, const std::vector<float> &depths,
+                                    const unsigned int nimgs)
+{
+    NVTX_RANGE_INDEX("sweep temporal", NvtxSweep, nimgs);
+    int w = HostRef.width(), h = HostRef.height();
+    int nplanes = depths.size();
+    const float substep = subplaneStep(depths);
+    const float first = inversesweep ? 1.f / depths[0] : depths[0];
+
+    // Plane bands around predicted depth, disoccluded pixels are swept over all planes
+    int *pmin = scratchPacked<int>("temporal.planemin", w, h);
+    int *pmax = scratchPacked<int>("temporal.planemax", w, h);
+    int *bmin = scratchPacked<int>("temporal.blockmin", blocks.x * blocks.y, 1);
+    int *bmax = scratchPacked<int>("temporal.blockmax", blocks.x * blocks.y, 1);
+    planesweep_band(pmin, pmax, predicted, w, h, first, substep, temporalband, nplanes, w, h, blocks, threads, inversesweep);
+    planesweep_block_band(bmin, bmax, pmin, pmax, w, h, blocks, threads);
+    timer.count(2);
+
+    Image<float> &devSrc = scratch("temporal.devSrc", w, h);
+    Image<float> &devbestNCC = scratch("temporal.devbestNCC", w, h);
+    Image<float> &devDepth = scratch("temporal.devDepth", w, h);
+    for (unsigned int i = 0; i < nimgs; i++){
+        NVTX_RANGE_INDEX("sweep source", NvtxSweep, i);
+        UploadGray(devSrc, 0, i, 1.f);
+        set_value(devbestNCC.data(), 0.f, w, h, blocks, threads);
+        set_value(devDepth.data(), 0.f, w, h, blocks, threads);
+        float *subplane = subplaneState("temporal.devSubplane", w, h, 1);
+
+        for (int p = 0; p < nplanes; p++)
+            planesweep_fused_NCC_band(devDepth.data(), devbestNCC.data(), devSrc.data(), Ref, Refmean, Refstd,
+                                      d_H + i * nplanes + p, depths[p], p, pmin, pmax, bmin, bmax,
+                                      winsize, stdthresh, w, h, blocks, threads, subplane);
+
+        sum_depthmap_NCC(globDepth, globN, devDepth.data(), devbestNCC.data(), nccthresh, w, h, blocks, threads,
+                         subplane, substep, inversesweep);
+        timer.count(nplanes + 3, 0, nplanes);
+    }
+}
+
+void PlaneSweep::storeTemporalPrior(const float *d_depth, const CamImage<float> *depth)
+{
+    if (!temporal) return;
+    int w = HostRef.width(), h = HostRef.height();
+    Image<float> &prior = scratch("temporal.prior", w, h);
+    if (d_depth) CHECK_CUDA_ERRORS_AUTO(cudaMemcpy(prior.data(), d_depth, w * h * sizeof(float), cudaMemcpyDeviceToDevice));
+    else prior.copyFrom(*depth);
+    temporalR = HostRef.R;
+    temporalt = HostRef.t;
+    temporalwidth = w;
+    temporalheight = h;
+    temporalprior = true;
+}
+
+bool PlaneSweep::isRectified(unsigned int view, float &shift) const
+{
+    Matrix3D Rrel;
+    Vector3D trel;
+    RelativeMatrices(Rrel, trel, HostRef.R, HostRef.t, HostSrc[view].R, HostSrc[view].t);
+    shift = K(0,0) * trel.x;
+
+    const float b = std::sqrt(trel.x * trel.x + trel.y * trel.y + trel.z * trel.z);
+    if (!(b > 0)) return false;
+    for (int r = 0; r < 3; r++)
+        for (int c = 0; c < 3; c++)
+            if (std::fabs(Rrel(r,c) - (r == c ? 1.f : 0.f)) > RECTIFIED_TOLERANCE) return false;
+    return (std::fabs(trel.y) <= RECTIFIED_TOLERANCE * b) && (std::fabs(trel.z) <= RECTIFIED_TOLERANCE * b);
+}
+
+void PlaneSweep::PlaneSweepMultiDevice(float *globDepth, float *globN, const float *Ref, const float *Refmean, const float *Refstd,
+                                       const std::vector<Matrix3D> &H, const std::vector<float> &depths, const unsigned int nimgs)
+{
+    int w = HostRef.width(), h = HostRef.height();
+    size_t bytes = w * h * sizeof(float);
+    int nplanes = depths.size();
+
+    // Selected device goes first, followed by the next available devices
+    int count;
+    CHECK_CUDA_ERRORS_AUTO(cudaGetDeviceCount(&count));
+    int ndevices = devicecount == 0 ? count : std::min((int)devicecount, count);
+    ndevices = std::max(std::min(ndevices, (int)nimgs), 1);
+
+    std::vector<int> devices(ndevices);
+    for (int k = 0; k < ndevices; k++){
+        devices[k] = (cudadevice + k) % count;
+        if (std::find(sweepdevices.begin(), sweepdevices.end(), devices[k]) == sweepdevices.end())
+            sweepdevices.push_back(devices[k]);
+    }
+
+    std::vector<float *> partialDepth(ndevices, globDepth), partialN(ndevices, globN);
+    std::vector<std::exception_ptr> errors(ndevices);
+
+    // Sweep views k, k + ndevices, ... on device k, additional devices get their own copy of reference data
+    auto worker = [&](int k){
+        NVTX_RANGE_INDEX("sweep device", NvtxSweep, devices[k]);
+        try {
+            CHECK_CUDA_ERRORS_AUTO(cudaSetDevice(devices[k]));
+
+            const float *ref = Ref, *refmean = Refmean, *refstd = Refstd;
+            if (k > 0){
+                Image<float> &devRef = scratch("multidevice.devRef", w, h);
+                Image<float> &devRefmean = scratch("multidevice.devRefmean", w, h);
+                Image<float> &devRefstd = scratch("multidevice.devRefstd", w, h);
+                Image<float> &devDepthmap = scratch("multidevice.devDepthmap", w, h);
+                Image<float> &devN = scratch("multidevice.devN", w, h);
+                CHECK_CUDA_ERRORS_AUTO(cudaMemcpyPeer(devRef.data(), devices[k], Ref, cudadevice, bytes));
+                CHECK_CUDA_ERRORS_AUTO(cudaMemcpyPeer(devRefmean.data(), devices[k], Refmean, cudadevice, bytes));
+                CHECK_CUDA_ERRORS_AUTO(cudaMemcpyPeer(devRefstd.data(), devices[k], Refstd, cudadevice, bytes));
+                set_value(devDepthmap.data(), 0.f, w, h, blocks, threads);
+                set_value(devN.data(), 0.f, w, h, blocks, threads);
+                timer.count(2);
+
+                ref = devRef.data();
+                refmean = devRefmean.data();
+                refstd = devRefstd.data();
+                partialDepth[k] = devDepthmap.data();
+                partialN[k] = devN.data();
+            }
+
+            Image<Matrix3D> devH(H.size(), 1);
+            devH.copyFrom(Image<Matrix3D, Standard>(const_cast<Matrix3D *>(H.data()), H.size(), 1));
+            timer.count(0, H.size() * sizeof(Matrix3D));
+
+            for (unsigned int i = k; i < nimgs; i += ndevices)
+                PlaneSweepThread(partialDepth[k], partialN[k], ref, refmean, refstd,
+                                 devH.data() + i * nplanes, depths, i);
+
+            CHECK_CUDA_ERRORS_AUTO(cudaDeviceSynchronize());
+        }
+        catch(...){
+            errors[k] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int k = 1; k < ndevices; k++)
+        workers.emplace_back(worker, k);
+    worker(0);
+    for (auto & t : workers)
+        t.join();
+
+    for (auto & e : errors)
+        if (e) std::rethrow_exception(e);
+
+    // Reduce partial sums on the selected device
+    Image<float> &devRecv = scratch("multidevice.devRecv", w, h);
+    for (int k = 1; k < ndevices; k++){
+        CHECK_CUDA_ERRORS_AUTO(cudaMemcpyPeer(devRecv.data(), cudadevice, partialDepth[k], devices[k], bytes));
+        element_add(globDepth, devRecv.data(), w, h, blocks, threads);
+        CHECK_CUDA_ERRORS_AUTO(cudaMemcpyPeer(devRecv.data(), cudadevice, partialN[k], devices[k], bytes));
+        element_add(globN, devRecv.data(), w, h, blocks, threads);
+        timer.count(2);
+    }
+}
+
+void PlaneSweep::PlaneSweepPyramid(float *globDepth, float *globN, const Image<float> &Ref, const float *Refmean, const float *Refstd,
+                                   const Matrix3D *d_H, const std::vector<float> &depths, const unsigned int nimgs)
+{
+    int levels = pyramidlevels;
+    int nplanes = depths.size();
+    const float substep = subplaneStep(depths);
+    const float first = inversesweep ? 1.f / depths[0] : depths[0];
+
+    // Select windowed mean method
+    auto windowed_mean_column = slidingmean ? ::windowed_mean_column_sliding : ::windowed_mean_column;
+    auto windowed_mean_row = slidingmean ? ::windowed_mean_row_sliding : ::windowed_mean_row;
+
+    // Level sizes, level 0 is full resolution
+    std::vector<int> lw(levels), lh(levels);
+    lw[0] = HostRef.width();
+    lh[0] = HostRef.height();
+    for (int l = 1; l < levels; l++){
+        lw[l] = (lw[l - 1] + 1) / 2;
+        lh[l] = (lh[l - 1] + 1) / 2;
+    }
+
+    // Build reference and source view pyramids on the device
+    std::vector<Image<float>> ref(levels), src(levels * nimgs);
+    for (unsigned int i = 0; i < nimgs; i++){
+        src[i * levels].reset(lw[0], lh[0]);
+        UploadGray(src[i * levels], 0, i, 1.f);
+    }
+    for (int l = 1; l < levels; l++){
+        dim3 lblocks(ceil(lw[l] / (float)threads.x), ceil(lh[l] / (float)threads.y));
+        const float * prev = l == 1 ? Ref.data() : ref[l - 1].data();
+        ref[l].reset(lw[l], lh[l]);
+        downsample_half(ref[l].data(), prev, lw[l - 1], lh[l - 1], lw[l], lh[l], lblocks, threads);
+        for (unsigned int i = 0; i < nimgs; i++){
+            src[i * levels + l].reset(lw[l], lh[l]);
+            downsample_half(src[i * levels + l].data(), src[i * levels + l - 1].data(), lw[l - 1], lh[l - 1], lw[l], lh[l],
+                            lblocks, threads);
+        }
+    }
+    timer.count((levels - 1) * (nimgs + 1));
+
+    // Homographies at lower resolutions use scaled calibration matrix, 1 based pixel coordinates are halved on each level
+    Matrix3D S(0.5f, 0.f,  0.25f,
+               0.f,  0.5f, 0.25f,
+               0.f,  0.f,  1.f);
+
+    // Averaged depthmap of previous (coarser) level
+    Image<float> coarse;
+
+    for (int l = levels - 1; l >= 0; l--){
+        NVTX_RANGE_INDEX("sweep pyramid level", NvtxSweep, l);
+        int w = lw[l], h = lh[l];
+        dim3 lblocks(ceil(w / (float)threads.x), ceil(h / (float)threads.y));
+
+        // Reference statistics and homographies of this level, full resolution ones are already available
+        Image<float> lmean, lstd, lsum, lN;
+        Image<Matrix3D> lH;
+        const float * mean = Refmean, * stdv = Refstd, * refl = Ref.data();
+        const Matrix3D * Hl = d_H;
+        if (l > 0){
+            Image<float> inter(w, h);
+            lmean.reset(w, h);
+            lstd.reset(w, h);
+            windowed_mean_column(inter.data(), ref[l].data(), winsize, false, w, h, lblocks, threads);
+            windowed_mean_row(lmean.data(), inter.data(), winsize, false, w, h, lblocks, threads);
+            windowed_mean_column(inter.data(), ref[l].data(), winsize, true, w, h, lblocks, threads);
+            windowed_mean_row(lstd.data(), inter.data(), winsize, false, w, h, lblocks, threads);
+            calculate_STD(lstd.data(), lmean.data(), lstd.data(), w, h, lblocks, threads);
+            mean = lmean.data();
+            stdv = lstd.data();
+            refl = ref[l].data();
+
+            Matrix3D Kl = K;
+            for (int k = 0; k < l; k++) Kl = S * Kl;
+            std::vector<Matrix3D> H;
+            std::vector<float> ldepths;
+            HomographyTable(H, ldepths, nimgs, Kl);
+            lH.reset(H.size(), 1);
+            lH.copyFrom(Image<Matrix3D, Standard>(H.data(), H.size(), 1));
+            Hl = lH.data();
+            timer.count(5, H.size() * sizeof(Matrix3D));
+
+            // Lower levels accumulate their own depthmap sums
+            lsum.reset(w, h);
+            lN.reset(w, h);
+            set_value(lsum.data(), 0.f, w, h, lblocks, threads);
+            set_value(lN.data(), 0.f, w, h, lblocks, threads);
+            timer.count(2);
+        }
+        float * sum = l > 0 ? lsum.data() : globDepth;
+        float * N = l > 0 ? lN.data() : globN;
+
+        // Plane bands around upsampled estimate of coarser level
+        bool band = l < levels - 1;
+        Image<int> pmin, pmax, bmin, bmax;
+        if (band){
+            pmin.reset(w, h);
+            pmax.reset(w, h);
+            bmin.reset(lblocks.x * lblocks.y, 1);
+            bmax.reset(lblocks.x * lblocks.y, 1);
+            planesweep_band(pmin.data(), pmax.data(), coarse.data(), coarse.width(), coarse.height(),
+                            first, substep, pyramidband, nplanes, w, h, lblocks, threads, inversesweep);
+            planesweep_block_band(bmin.data(), bmax.data(), pmin.data(), pmax.data(), w, h, lblocks, threads);
+            timer.count(2);
+        }
+
+        Image<float> best(w, h), depth(w, h);
+        for (unsigned int i = 0; i < nimgs; i++){
+            NVTX_RANGE_INDEX("sweep source", NvtxSweep, i);
+            set_value(best.data(), 0.f, w, h, lblocks, threads);
+            set_value(depth.data(), 0.f, w, h, lblocks, threads);
+            float * subplane = subplaneState("pyramid.devSubplane", w, h, 1);
+
+            const float * s = src[i * levels + l].data();
+            for (int p = 0; p < nplanes; p++){
+                if (band)
+                    planesweep_fused_NCC_band(depth.data(), best.data(), s, refl, mean, stdv,
+                                              Hl + i * nplanes + p, depths[p], p, pmin.data(), pmax.data(),
+                                              bmin.data(), bmax.data(), winsize, stdthresh, w, h, lblocks, threads, subplane);
+                else
+                    planesweep_fused_NCC(depth.data(), best.data(), s, refl, mean, stdv,
+                                         Hl + i * nplanes + p, depths[p], winsize, stdthresh, w, h, lblocks, threads,
+                                         subplane);
+            }
+
+            sum_depthmap_NCC(sum, N, depth.data(), best.data(), nccthresh, w, h, lblocks, threads,
+                             subplane, substep, inversesweep);
+            timer.count(nplanes + 3, 0, nplanes);
+        }
+
+        // Averaged depthmap of this level guides the next one, QNaN where no view passed NCC threshold
+        if (l > 0){
+            coarse.reset(w, h);
+            element_rdivide(coarse.data(), sum, N, w, h, lblocks, threads);
+            timer.count(1);
+        }
+    }
+}
+
+void PlaneSweep::PlaneSweepStrips(Image<float> &depthmap, const Image<float> &Ref, const std::vector<Strip> &strips,
+                                  const std::vector<Matrix3D> &H, const std::vector<float> &depths, const unsigned int nimgs)
+{
+    NVTX_RANGE("sweep strips", NvtxSweep);
+    const int w = Ref.width(), nplanes = depths.size();
+    const dim3 frameblocks = blocks;
+
+    // Select windowed mean method
+    auto windowed_mean_column = slidingmean ? ::windowed_mean_column_sliding : ::windowed_mean_column;
+    auto windowed_mean_row = slidingmean ? ::windowed_mean_row_sliding : ::windowed_mean_row;
+
+    std::vector<Matrix3D> Hs(H.size());
+    Image<Matrix3D> devH(H.size(), 1);
+
+    for (size_t k = 0; k < strips.size(); k++){
+        NVTX_RANGE_INDEX("strip", NvtxSweep, k);
+        const Strip &s = strips[k];
+        const int h = s.h;
+        blocks = dim3(ceil(w/(float)threads.x), ceil(h/(float)threads.y));
+        striprows = h;
+
+        // Strip pixel coordinates are moved to full reference coordinates before each homography
+        const Matrix3D T(1.f, 0.f, 0.f,
+                         0.f, 1.f, (float)s.r0,
+                         0.f, 0.f, 1.f);
+        for (size_t i = 0; i < H.size(); i++) Hs[i] = H[i] * T;
+        devH.copyFrom(Image<Matrix3D, Standard>(Hs.data(), Hs.size(), 1));
+        timer.count(0, Hs.size() * sizeof(Matrix3D));
+
+        // Reference rows of the strip are read from the full reference image in place
+        const float *ref = Ref.data() + s.r0 * w;
+        Image<float> &refmean = scratch("sweep.strip.refmean", w, h);
+        Image<float> &refstd = scratch("sweep.strip.refstd", w, h);
+        Image<float> &inter = scratch("sweep.strip.inter", w, h);
+        Image<float> &depth = scratch("sweep.strip.depth", w, h);
+        Image<float> &N = scratch("sweep.strip.N", w, h);
+        windowed_mean_column(inter.data(), ref, winsize, false, w, h, blocks, threads);
+        windowed_mean_row(refmean.data(), inter.data(), winsize, false, w, h, blocks, threads);
+        windowed_mean_column(inter.data(), ref, winsize, true, w, h, blocks, threads);
+        windowed_mean_row(refstd.data(), inter.data(), winsize, false, w, h, blocks, threads);
+        calculate_STD(refstd.data(), refmean.data(), refstd.data(), w, h, blocks, threads);
+        set_value(depth.data(), 0.f, w, h, blocks, threads);
+        set_value(N.data(), 0.f, w, h, blocks, threads);
+        timer.count(7);
+
+        for (int i = 0; i < (int)nimgs; i++)
+            PlaneSweepThread(depth.data(), N.data(), ref, refmean.data(), refstd.data(), devH.data() + i * nplanes, depths, i);
+
+        element_rdivide(depth.data(), depth.data(), N.data(), w, h, blocks, threads);
+        set_QNAN_value(depth.data(), zfar, w, h, blocks, threads);
+        timer.count(2);
+
+        // Only kept rows are written, halo rows belong to neighbouring strips
+        CHECK_CUDA_ERRORS_AUTO(cudaMemcpy(depthmap.data() + s.y0 * w, depth.data() + (s.y0 - s.r0) * w,
+                                          s.rows * w * sizeof(float), cudaMemcpyDeviceToDevice));
+    }
+
+    striprows = 0;
+    blocks = frameblocks;
+}
+
+void PlaneSweep::HomographyTable(std::vector<Matrix3D> &H, std::vector<float> &depths, const unsigned int nimgs) const
+{
+    HomographyTable(H, depths, nimgs, K);
+}
+
+void PlaneSweep::HomographyTable(std::vector<Matrix3D> &H, std::vector<float> &depths, const unsigned int nimgs,
+                                 const Matrix3D &Km) const
+{
+    PlaneDepths(depths);
+    H.resize(nimgs * depths.size());
+    for (unsigned int i = 0; i < nimgs; i++) PairHomographies(H.data() + i * depths.size(), depths, HostRef, HostSrc[i], Km);
+}
+
+void PlaneSweep::PlaneDepths(std::vector<float> &depths) const
+{
+    // calculate depth step size:
+    float dstep = (zfar - znear) / (numberplanes - 1);
+
+    // Plane depths are accumulated the same way the sweep always did, inverse depth sampling puts planes where a step
+    // moves warped pixels by the same amount
+    depths.clear();
+    if (inversedepth && (znear > 0) && (numberplanes > 1))
+        for (unsigned int p = 0; p < numberplanes; p++)
+            depths.push_back(1.f / (1.f / znear - p * (1.f / znear - 1.f / zfar) / (numberplanes - 1)));
+    else for (float d = znear; d <= zfar; d += dstep) depths.push_back(d);
+}
+
+void PlaneSweep::PairHomographies(Matrix3D *H, const std::vector<float> &depths, const CamImage<float> &ref,
+                                  const CamImage<float> &src, const Matrix3D &Km) const
+{
+    Matrix3D invKm = Km.inv();
+    Matrix3D Rrel, tr;
+    Vector3D trel;
+
+    // Calculate relative rotation and translation:
+    RelativeMatrices(Rrel, trel, ref.R, ref.t, src.R, src.t);
+    tr = Matrix3D();
+    tr.row(2) = trel;
+    tr = tr.trans();
+
+    // Calculate homographies:
+    for (size_t p = 0; p < depths.size(); p++){
+        H[p] = Km * (Rrel + tr / depths[p]) * invKm;
+        H[p] = H[p] / H[p](2,2);
+    }
+}
+
 bool PlaneSweep::Denoise(unsigned int niter, double lambda)
 {
 #ifdef OpenCV_FOUND
     if (depthavailable){
+        getDepthmap8u();
         depthmap8udenoised.reset(depthmap.width(), depthmap.height());
+        denoisedpending = denoised8upending = false;
         std::vector<cv::Mat> raw(1);
         raw[0] = cv::Mat(depthmap.height(), depthmap.width(), CV_8UC1, depthmap8u.data(), depthmap8u.pitch());
         cv::Mat out(depthmap.height(), depthmap.width(), CV_8UC1, depthmap8udenoised.data(), depthmap8udenoised.pitch());
@@ -279,8 +1551,8 @@ bool PlaneSweep::Denoise(unsigned int niter, double lambda)
 void PlaneSweep::ConvertDepthtoUChar(const CamImage<float>& input, CamImage<uchar>& output)
 {
     output.reset(input.width(), input.height());
-    for (size_t x = 0; x < input.width(); ++x)
-        for (size_t y = 0; y < input.height(); ++y)
+    for (size_t y = 0; y < input.height(); ++y)
+        for (size_t x = 0; x < input.width(); ++x)
         {
             int i = x + y * input.width();
             // Check if QNAN
@@ -289,6 +1561,55 @@ void PlaneSweep::ConvertDepthtoUChar(const CamImage<float>& input, CamImage<ucha
         }
 }
 
+void PlaneSweep::DownloadDepthmap(const float *d_depth, CamImage<float> *depth, CamImage<uchar> *depth8u)
+{
+    if (d_depth == 0) return;
+
+    try {
+        int w = depthmap.width(), h = depthmap.height();
+        dim3 b(ceil(w/(float)threads.x), ceil(h/(float)threads.y));
+
+        if (depth){
+            depth->reset(w, h);
+            Image<float>(const_cast<float *>(d_depth), w, h).copyTo(*depth);
+        }
+
+        if (depth8u){
+            Image<uchar> dev8u(w, h);
+            convert_float_to_uchar(dev8u.data(), d_depth, znear, zfar, w, h, b, threads);
+            depth8u->reset(w, h);
+            dev8u.copyTo(*depth8u);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Exception caught: ";
+        std::cerr << e.what() << std::endl;
+
+        cudaReset();
+    }
+}
+
+float PlaneSweep::RelativeChange(const float *d_u, Image<float> &uprev)
+{
+    int w = uprev.width(), h = uprev.height();
+    dim3 b(ceil(w/(float)threads.x), ceil(h/(float)threads.y));
+
+    Image<float> &d_sums = scratch("convergence.sums", 2, 1);
+    set_value(d_sums.data(), 0.f, 2, 1, dim3(1), dim3(2));
+    relative_change(d_sums.data(), d_u, uprev.data(), w, h, b, threads);
+    timer.count(2, 2 * sizeof(float));
+
+    // Keep current values for next check
+    uprev.copyFrom(Image<float>(const_cast<float *>(d_u), w, h));
+
+    float sums[2];
+    Image<float, Standard> hsums(sums, 2, 1);
+    d_sums.copyTo(hsums);
+
+    return sums[1] > 0 ? sqrt(sums[0] / sums[1]) : 0.f;
+}
+
 PlaneSweep::~PlaneSweep()
 {
     cudaReset();
@@ -297,71 +1618,163 @@ PlaneSweep::~PlaneSweep()
 bool PlaneSweep::CudaDenoise(int argc, char ** argv, const unsigned int niters, const double lambda, const double tau,
                              const double sigma, const double theta, const double beta, const double gamma)
 {
-    auto t1 = std::chrono::high_resolution_clock::now();
-    printf("Starting TVL1 denoising...\n\n");
+    if (verbose) printf("Starting TVL1 denoising...\n\n");
 
     if (depthavailable) try
     {
 
         if (cudaDevInit(argc, (const char **)argv) == NO_CUDA_DEVICE)
         {
+            if (cpufallback && cpuactive) return CudaDenoiseCpu(niters, lambda, tau, sigma, theta, beta, gamma);
             cudaReset();
             return false;
         }
 
-        int h = depthmap.height(), w = depthmap.width();
-        CHECK_CUDA_ERRORS_AUTO(cudaFree(d_depthmap));
+        NVTX_RANGE_INDEX("TVL1 solve", NvtxDenoise, niters);
+        timer.start("CudaDenoise");
 
-        size_t pitch;
-        CHECK_CUDA_ERRORS_AUTO(cudaMallocPitch(&d_depthmap, &pitch, w * sizeof(float), h));
+        int h = depthmap.height(), w = depthmap.width();
 
         if (threads.x * threads.y == 0) threads = dim3(DEFAULT_BLOCK_XDIM, maxThreadsPerBlock/DEFAULT_BLOCK_XDIM);
-        blocks = dim3(ceil(w/(float)threads.x), ceil(h/(float)threads.y));
+        if (autotune) threads = tunedThreads("tvl1", w, h);
+
+        // Rows are denoised in strips if the working set does not fit into device memory
+        std::vector<Strip> strips;
+        const bool tiled = planStrips("CudaDenoise", MemoryPlanner::tvl1(w, h, convergencetol > 0, false, tvl1fused > 0),
+                                      MemoryPlanner::tvl1(w, h, convergencetol > 0, true, tvl1fused > 0), h, DEFAULT_STRIP_HALO,
+                                      {"denoise."}, strips);
+
+        // Denoised depthmap stays in workspace until it is downloaded on demand
+        d_depthmap = scratch("denoise.depthmap", w, h).data();
+        const int frameh = h;
+        tvl1iterations = 0;
+
+        for (size_t n = 0; n < strips.size(); n++){
+            timer.begin("setup");
+            const Strip &s = strips[n];
+            h = s.h;
+            blocks = dim3(ceil(w/(float)threads.x), ceil(h/(float)threads.y));
+
+            // Strips are solved in their own image, raw depthmap and guide rows are read in place
+            float *u = tiled ? scratch("denoise.strip", w, h).data() : d_depthmap;
+            const float *raw = d_rawdepthmap + s.r0 * w, *guide = d_refnormalized + s.r0 * w;
+            const float *init = temporalinit ? scratch("temporal.predicted", w, frameh).data() + s.r0 * w : raw;
+
+            Image<float> &R = scratch("denoise.R", w, h);
+            Image<float> &Px = scratch("denoise.Px", w, h);
+            Image<float> &Py = scratch("denoise.Py", w, h);
+            Image<float> &rawInput = scratch("denoise.rawInput", w, h);
+            Image<float> &T11 = scratch("denoise.T11", w, h);
+            Image<float> &T12 = scratch("denoise.T12", w, h);
+            Image<float> &T21 = scratch("denoise.T21", w, h);
+            Image<float> &T22 = scratch("denoise.T22", w, h);
+
+            // Workspace images keep values of previous calls
+            set_value(R.data(), 0.f, w, h, blocks, threads);
+            set_value(Px.data(), 0.f, w, h, blocks, threads);
+            set_value(Py.data(), 0.f, w, h, blocks, threads);
 
-        depthmapdenoised.reset(w, h);
-        depthmap8udenoised.reset(w, h);
+            // Raw depthmap and normalized reference image are left on the device by RunAlgorithm, kernels expect unpadded rows
+            CHECK_CUDA_ERRORS_AUTO(cudaMemcpy(u, init, w * h * sizeof(float), cudaMemcpyDeviceToDevice));
+            CHECK_CUDA_ERRORS_AUTO(cudaMemcpy(rawInput.data(), raw, w * h * sizeof(float), cudaMemcpyDeviceToDevice));
 
-        Image<float> R(w, h);
-        Image<float> Px(w,h);
-        Image<float> Py(w,h);
-        Image<float> rawInput(w,h);
-        Image<float> T11(w,h), T12(w,h), T21(w,h), T22(w,h), ref(w,h);
+            Anisotropic_diffusion_tensor(T11.data(), T12.data(), T21.data(), T22.data(), guide, beta, gamma, w, h, blocks, threads);
 
-        ref.copyFrom(HostRef);
-        CHECK_CUDA_ERRORS_AUTO(cudaMemcpy2D(d_depthmap, pitch, depthmap.data(), depthmap.pitch(), w * sizeof(float), h, cudaMemcpyHostToDevice));
-        rawInput.copyFrom(depthmap);
+            element_add(u, -znear, w, h, blocks, threads);
+            element_add(rawInput.data(), -znear, w, h, blocks, threads);
 
-        element_scale(ref.data(), 1/255.f, w, h, blocks, threads);
-        Anisotropic_diffusion_tensor(T11.data(), T12.data(), T21.data(), T22.data(), ref.data(), beta, gamma, w, h, blocks, threads);
+            double xscale = 1.f/(zfar - znear);
+            double inputscale = -sigma/(zfar - znear);
 
-        element_add(d_depthmap, -znear, w, h, blocks, threads);
-        element_add(rawInput.data(), -znear, w, h, blocks, threads);
+            element_scale(u, xscale, w, h, blocks, threads);
+            element_scale(rawInput.data(), inputscale, w, h, blocks, threads);
+            timer.count(8);
 
-        double xscale = 1.f/(zfar - znear);
-        double inputscale = -sigma/(zfar - znear);
+            // Previous solution for stopping criterion
+            Image<float> &uprev = scratch("denoise.uprev", w, h);
+            if (convergencetol > 0) uprev.copyFrom(Image<float>(u, w, h));
+            unsigned int sincecheck = 0;
 
-        element_scale(d_depthmap, xscale, w, h, blocks, threads);
-        element_scale(rawInput.data(), inputscale, w, h, blocks, threads);
+            timer.begin("iterations");
 
-        for (unsigned int i = 0; i < niters; i++){
-            double currsigma = i == 0 ? 1 + sigma : sigma;
-            denoising_TVL1_calculateP_tensor_weighed(Px.data(), Py.data(), T11.data(), T12.data(), T21.data(), T22.data(),
-                                                     d_depthmap, currsigma, w, h, blocks, threads);
-            denoising_TVL1_update(d_depthmap, R.data(), Px.data(), Py.data(), rawInput.data(),
-                                  tau, theta, lambda, sigma,
-                                  w, h, blocks, threads);
+            // Halo'd tiles of fused launches have to fit shared memory, 0 uses the unfused kernels
+            unsigned int fused = tvl1fused > 0 ? denoising_TVL1_fused_iterations(tvl1fused, threads) : 0;
+
+            // Fused launches read halos written by other blocks, so state alternates between two sets of arrays
+            float *cu = u, *cR = R.data(), *cPx = Px.data(), *cPy = Py.data();
+            float *nu = 0, *nR = 0, *nPx = 0, *nPy = 0;
+            if (fused > 0){
+                nu = scratch("denoise.u2", w, h).data();
+                nR = scratch("denoise.R2", w, h).data();
+                nPx = scratch("denoise.Px2", w, h).data();
+                nPy = scratch("denoise.Py2", w, h).data();
+            }
+
+            unsigned int iterations = 0;
+            while (iterations < niters){
+                unsigned int i = iterations;
+                unsigned int k = std::min(fused, niters - i);
+                double firstsigma = i == 0 ? 1 + sigma : sigma;
+                if ((k > 0) && (KernelJit::instance().tvl1Fused(nu, nR, nPx, nPy, cu, cR, cPx, cPy, rawInput.data(),
+                                                                T11.data(), T12.data(), T21.data(), T22.data(),
+                                                                tau, theta, lambda, sigma, firstsigma, k,
+                                                                w, h, blocks, threads) ||
+                                denoising_TVL1_fused(nu, nR, nPx, nPy, cu, cR, cPx, cPy, rawInput.data(),
+                                                     T11.data(), T12.data(), T21.data(), T22.data(),
+                                                     tau, theta, lambda, sigma, firstsigma, k,
+                                                     w, h, blocks, threads))){
+                    // Temporal blocking: several iterations per launch on shared memory tiles
+                    std::swap(cu, nu);
+                    std::swap(cR, nR);
+                    std::swap(cPx, nPx);
+                    std::swap(cPy, nPy);
+                    iterations += k;
+                    sincecheck += k;
+                    timer.count(1, 0, k);
+                }
+                else {
+                    // Remaining iterations use the unfused pair once a fused launch failed
+                    fused = 0;
+                    double currsigma = i == 0 ? 1 + sigma : sigma;
+                    denoising_TVL1_calculateP_tensor_weighed(cPx, cPy, T11.data(), T12.data(), T21.data(), T22.data(),
+                                                             cu, currsigma, w, h, blocks, threads);
+                    denoising_TVL1_update(cu, cR, cPx, cPy, rawInput.data(),
+                                          tau, theta, lambda, sigma,
+                                          w, h, blocks, threads);
+                    iterations++;
+                    sincecheck++;
+                    timer.count(2, 0, 1);
+                }
+
+                if ((convergencetol > 0) && (sincecheck >= convergenceinterval)){
+                    sincecheck = 0;
+                    if (RelativeChange(cu, uprev) < convergencetol) break;
+                }
+            }
+            tvl1iterations = std::max(tvl1iterations, iterations);
+            if (cu != u) CHECK_CUDA_ERRORS_AUTO(cudaMemcpy(u, cu, w * h * sizeof(float), cudaMemcpyDeviceToDevice));
+
+            // Only kept rows are written, halo rows belong to neighbouring strips
+            if (tiled) CHECK_CUDA_ERRORS_AUTO(cudaMemcpy(d_depthmap + s.y0 * w, u + (s.y0 - s.r0) * w,
+                                                         s.rows * w * sizeof(float), cudaMemcpyDeviceToDevice));
         }
 
+        h = frameh;
+        blocks = dim3(ceil(w/(float)threads.x), ceil(h/(float)threads.y));
+
+        timer.begin("finish");
         element_scale(d_depthmap, (zfar - znear), w, h, blocks, threads);
         element_add(d_depthmap, znear, w, h, blocks, threads);
+        timer.count(2);
+        storeTemporalPrior(d_depthmap);
+        timer.stop();
 
-        CHECK_CUDA_ERRORS_AUTO(cudaMemcpy2D(depthmapdenoised.data(), depthmapdenoised.pitch(), d_depthmap, pitch, w * sizeof(float), h, cudaMemcpyDeviceToHost));
-        ConvertDepthtoUChar(depthmapdenoised, depthmap8udenoised);
+        // Check for kernel errors, host copies are made by getters on demand
+        CHECK_CUDA_ERRORS_AUTO(cudaPeekAtLastError());
+        denoisedpending = true;
+        denoised8upending = true;
 
-        auto t2 = std::chrono::high_resolution_clock::now();
-        std::cout << "Time taken for the TVL1 denoising to complete is " <<
-                     std::chrono::duration_cast<std::chrono::milliseconds>(t2-t1).count() << "ms\n\n";
-        std::cout.flush();
+        if (verbose) timer.timings().print(std::cout);
 
         return true;
 
@@ -381,8 +1794,7 @@ bool PlaneSweep::CudaDenoise(int argc, char ** argv, const unsigned int niters,
 bool PlaneSweep::TGV(int argc, char **argv, const unsigned int niters, const unsigned int warps, const double lambda,
                      const double alpha0, const double alpha1, const double tau, const double sigma, const double beta, const double gamma)
 {
-    auto t1 = std::chrono::high_resolution_clock::now();
-    printf("\nStarting TGV...\n\n");
+    if (verbose) printf("\nStarting TGV...\n\n");
 
     try
     {
@@ -398,127 +1810,286 @@ bool PlaneSweep::TGV(int argc, char **argv, const unsigned int niters, const uns
         depthmap8uTGV.reset(w,h);
 
         if (threads.x * threads.y == 0) threads = dim3(DEFAULT_BLOCK_XDIM, maxThreadsPerBlock/DEFAULT_BLOCK_XDIM);
+        if (autotune) threads = tunedThreads("tgv", w, h);
         blocks = dim3(ceil(w/(float)threads.x), ceil(h/(float)threads.y));
 
-        // Initialize data images:
-        Image<float> Ref(w,h), Px(w,h), Py(w,h), u(w,h), u0(w,h), u1x(w,h), u1y(w,h), ubar(w,h),
-                u1xbar(w,h), u1ybar(w,h), qx(w,h), qy(w,h), qz(w,h), qw(w,h), prodsum(w,h),
-                x(w,h), y(w,h), X(w,h), Y(w,h), Z(w,h), dX(w,h), dY(w,h), dZ(w,h), dfx(w,h), dfy(w,h),
-                T1(w,h), T2(w,h), T3(w,h), T4(w,h);
-
         int nimages = std::min(std::max((int)numberimages, 1), (int)HostSrc.size());
+        int levels = tgvpyramidlevels;
+
+        // Rows are refined in strips if the working set does not fit into device memory
+        std::vector<Strip> strips;
+        const bool tiled = planStrips("TGV", MemoryPlanner::tgv(w, h, nimages, levels, texturesampling, false),
+                                      MemoryPlanner::tgv(w, h, nimages, levels, texturesampling, true), h,
+                                      DEFAULT_STRIP_HALO, {"tgv."}, strips);
+
+        // Source level sizes, level 0 is full resolution
+        std::vector<int> sw(levels), sh(levels);
+        sw[0] = w;
+        sh[0] = h;
+        for (int l = 1; l < levels; l++){
+            sw[l] = (sw[l - 1] + 1) / 2;
+            sh[l] = (sh[l - 1] + 1) / 2;
+        }
 
-        std::vector<Image<float>> Src(nimages), It(nimages), Iu(nimages), r(nimages);
-
-        // Set initial values for depthmap:
-        set_value(u.data(), 1.f, w, h, blocks, threads);
-        ubar = u;
-
-        // Copy reference image to device memory and normalize
-        Ref.copyFrom(HostRef);
-        element_scale(Ref.data(), 1/255.f, w, h, blocks, threads);
-        Anisotropic_diffusion_tensor(T1.data(), T2.data(), T3.data(), T4.data(), Ref.data(), beta, gamma, w, h, blocks, threads);
-
-        // Matrix storages:
-        std::vector<Matrix3D> Rrel(nimages);
-        std::vector<Vector3D> Trel(nimages);
-
-        double fx = K(0,0), fy = K(1,1);
+        NVTX_RANGE("TGV", NvtxDenoise);
+        timer.start("TGV");
 
+        // Copy reference and source images to device memory, normalize and build pyramids of source images
+        timer.begin("upload");
+        Image<float> Ref0(w, h);
+        std::vector<Image<float>> Src(levels * nimages);
+        UploadGray(Ref0, 0, -1, 1/255.f);
         for (int i = 0; i < nimages; i++){
-            Src[i].reset(w,h);
-            It[i].reset(w,h);
-            r[i].reset(w,h);
-            Iu[i].reset(w,h);
-
-            // Copy source image to device memory and normalize
-            Src[i].copyFrom(HostSrc[i]);
-            element_scale(Src[i].data(), 1/255.f, w, h, blocks, threads);
-
-            // Calculate relative rotation and translation
-            RelativeMatrices(Rrel[i], Trel[i], HostRef.R, HostRef.t, HostSrc[i].R, HostSrc[i].t);
+            Src[i * levels].reset(w, h);
+            UploadGray(Src[i * levels], 0, i, 1/255.f);
         }
-
-        for (int l = 0; l < warps; l++){
-
-            // Set last solution as initialization for new level of iterations, copyFrom is slightly faster than operator= (see image.h)
-            u0.copyFrom(u);
-            ubar.copyFrom(u);
-
-            // Reset variables
-            set_value(Px.data(), 0.f, w, h, blocks, threads);
-            set_value(Py.data(), 0.f, w, h, blocks, threads);
-            set_value(qx.data(), 0.f, w, h, blocks, threads);
-            set_value(qy.data(), 0.f, w, h, blocks, threads);
-            set_value(qz.data(), 0.f, w, h, blocks, threads);
-            set_value(qw.data(), 0.f, w, h, blocks, threads);
-            set_value(u1x.data(), 0.f, w, h, blocks, threads);
-            set_value(u1y.data(), 0.f, w, h, blocks, threads);
-            set_value(u1xbar.data(), 0.f, w, h, blocks, threads);
-            set_value(u1ybar.data(), 0.f, w, h, blocks, threads);
-
+        timer.begin("pyramid");
+        for (int l = 1; l < levels; l++){
+            dim3 lblocks(ceil(sw[l] / (float)threads.x), ceil(sh[l] / (float)threads.y));
             for (int i = 0; i < nimages; i++){
+                Src[i * levels + l].reset(sw[l], sh[l]);
+                downsample_half(Src[i * levels + l].data(), Src[i * levels + l - 1].data(), sw[l - 1], sh[l - 1], sw[l], sh[l],
+                                lblocks, threads);
+            }
+        }
+        timer.count((levels - 1) * nimages);
 
-                // Calculate transformed coordinates at u0
-                TGV2_transform_coordinates(x.data(), y.data(), X.data(), Y.data(), Z.data(), u0.data(), K, Rrel[i], Trel[i], invK, w, h, blocks, threads);
-
-                // Calculate coordinate derivatives
-                TGV2_calculate_coordinate_derivatives(dX.data(), dY.data(), dZ.data(), invK, Rrel[i], w, h, blocks, threads);
-
-                // Calculate f(x,u) derivative wrt u at u0
-                TGV2_calculate_derivativeF(dfx.data(), dfy.data(), X.data(), dX.data(), Y.data(), dY.data(), Z.data(), dZ.data(),
-                                           fx, fy, w, h, blocks, threads);
-
-                // Interpolate source view at calculated coordinates, giving I(f(x,u0))
-                bilinear_interpolation(X.data(), Src[i].data(), x.data(), y.data(), w, h, w, h, blocks, threads);
-
-                // Calculate Iu
-                TGV2_calculate_Iu(Iu[i].data(), X.data(), dfx.data(), dfy.data(), w, h, blocks, threads);
+        // Optional initialization from planesweep depthmap or temporal prediction still kept on the device, halved down
+        // to coarsest level
+        bool seed = (tgvseed || temporalinit) && d_rawdepthmap && (depthmap.width() == w) && (depthmap.height() == h);
+        const float *seedsrc = temporalinit ? scratch("temporal.predicted", w, h).data() : d_rawdepthmap;
 
-                // Subtract reference image from interpolated one giving It
-                subtract(It[i].data(), X.data(), Ref.data(), w, h, blocks, threads);
+        // Relative rotation and translation of each source view
+        std::vector<Matrix3D> Rrel(nimages);
+        std::vector<Vector3D> Trel(nimages);
+        for (int i = 0; i < nimages; i++)
+            RelativeMatrices(Rrel[i], Trel[i], HostRef.R, HostRef.t, HostSrc[i].R, HostSrc[i].t);
 
-                // Reset r
-                set_value(r[i].data(), 0.f, w, h, blocks, threads);
+        // Calibration matrices at lower resolutions, 1 based pixel coordinates are halved on each level (see PlaneSweepPyramid)
+        Matrix3D S(0.5f, 0.f,  0.25f,
+                   0.f,  0.5f, 0.25f,
+                   0.f,  0.f,  1.f);
+
+        // Moves strip pixel coordinates of a level to coordinates of the full level
+        auto rowOffset = [](float rows){ return Matrix3D(1.f, 0.f, 0.f,
+                                                         0.f, 1.f, rows,
+                                                         0.f, 0.f, 1.f); };
+
+        tgviterations = 0;
+
+        for (size_t n = 0; n < strips.size(); n++){
+            NVTX_RANGE_INDEX("TGV strip", NvtxDenoise, tiled ? (long long)n : -1);
+            const Strip &s = strips[n];
+
+            // Strip level sizes, its pyramid is built from its own rows so level rows match the full pyramid geometry
+            std::vector<int> lw(levels), lh(levels);
+            lw[0] = w;
+            lh[0] = s.h;
+            for (int l = 1; l < levels; l++){
+                lw[l] = (lw[l - 1] + 1) / 2;
+                lh[l] = (lh[l - 1] + 1) / 2;
             }
 
-            for (int i = 0; i < niters; i++){
-
-                // Update p values
-                TGV2_updateP_tensor_weighed(Px.data(), Py.data(), T1.data(), T2.data(), T3.data(), T4.data(),
-                                            ubar.data(), u1xbar.data(), u1ybar.data(), alpha1, sigma, w, h, blocks, threads);
+            timer.begin("pyramid");
+            std::vector<Image<float>> Ref(levels);
+            Ref[0].reset(w, s.h);
+            CHECK_CUDA_ERRORS_AUTO(cudaMemcpy(Ref[0].data(), Ref0.data() + s.r0 * w, w * s.h * sizeof(float), cudaMemcpyDeviceToDevice));
+            std::vector<Image<float>> Seed(seed ? levels : 0);
+            if (seed){
+                Seed[0].reset(w, s.h);
+                CHECK_CUDA_ERRORS_AUTO(cudaMemcpy(Seed[0].data(), seedsrc + s.r0 * w, w * s.h * sizeof(float),
+                                                  cudaMemcpyDeviceToDevice));
+            }
+            for (int l = 1; l < levels; l++){
+                dim3 lblocks(ceil(lw[l] / (float)threads.x), ceil(lh[l] / (float)threads.y));
+                Ref[l].reset(lw[l], lh[l]);
+                downsample_half(Ref[l].data(), Ref[l - 1].data(), lw[l - 1], lh[l - 1], lw[l], lh[l], lblocks, threads);
+                if (seed){
+                    Seed[l].reset(lw[l], lh[l]);
+                    downsample_half(Seed[l].data(), Seed[l - 1].data(), lw[l - 1], lh[l - 1], lw[l], lh[l], lblocks, threads);
+                }
+            }
+            timer.count((levels - 1) * (seed ? 2 : 1));
+
+            // Solution of previous (coarser) level
+            const Image<float> * ucoarse = 0;
+
+            for (int lvl = levels - 1; lvl >= 0; lvl--){
+                NVTX_RANGE_INDEX("TGV level", NvtxDenoise, lvl);
+                const int w = lw[lvl], h = lh[lvl];
+                blocks = dim3(ceil(w/(float)threads.x), ceil(h/(float)threads.y));
+
+                // Workspace images of coarser levels are kept under their own names
+                const std::string level = lvl > 0 ? "." + std::to_string(lvl) : "";
+
+                // Initialize data images:
+                Image<float> &u = scratch("tgv.u" + level, w, h);
+                Image<float> &u0 = scratch("tgv.u0" + level, w, h);
+                Image<float> &ubar = scratch("tgv.ubar" + level, w, h);
+                Image<float> &prodsum = scratch("tgv.prodsum" + level, w, h);
+
+                // Packed state: p = (px, py), q = (qx, qy, qz, qw), u1 = (u1x, u1y, u1xbar, u1ybar), T = (T11, T12, T21, T22)
+                float2 *P = scratchPacked<float2>("tgv.P" + level, w, h);
+                float4 *Q = scratchPacked<float4>("tgv.Q" + level, w, h);
+                float4 *U1 = scratchPacked<float4>("tgv.U1" + level, w, h);
+                float4 *T = scratchPacked<float4>("tgv.T" + level, w, h);
+
+                // It, Iu and r of all source views are layered one frame after another
+                Image<float> &It = scratch("tgv.It" + level, w, h * nimages);
+                Image<float> &Iu = scratch("tgv.Iu" + level, w, h * nimages);
+                Image<float> &r = scratch("tgv.r" + level, w, h * nimages);
+                const size_t layer = w * h;
+
+                // Previous solution for stopping criterion
+                Image<float> &uprev = scratch("tgv.uprev" + level, w, h);
+
+                // Set initial values for depthmap: upsampled coarser solution, planesweep depthmap or constant
+                timer.begin("setup");
+                if (ucoarse) upsample_double(u.data(), ucoarse->data(), ucoarse->width(), ucoarse->height(), w, h, blocks, threads);
+                else if (seed) u.copyFrom(Seed[lvl]);
+                else set_value(u.data(), 1.f, w, h, blocks, threads);
+                ubar.copyFrom(u);
+
+                Anisotropic_diffusion_tensor_packed(T, Ref[lvl].data(), beta, gamma, w, h, blocks, threads);
+                timer.count(seed && !ucoarse ? 1 : 2);
+
+                // Keep normalized source images in texture memory if texture sampling is used
+                std::vector<Texture<float>> texSrc(texturesampling ? nimages : 0);
+                for (int i = 0; i < (int)texSrc.size(); i++){
+                    texSrc[i].reset(sw[lvl], sh[lvl]);
+                    texSrc[i].copyFrom(Src[i * levels + lvl]);
+                }
 
-                // Update Q values
-                TGV2_updateQ(qx.data(), qy.data(), qz.data(), qw.data(), u1xbar.data(), u1ybar.data(), alpha0,
-                             sigma, w, h, blocks, threads);
+                Matrix3D Kl = K;
+                for (int k = 0; k < lvl; k++) Kl = S * Kl;
+                Matrix3D invKl = Kl.inv() * rowOffset(s.r0 / float(1 << lvl));
+
+                // Rays and projections of each source view do not depend on u, all warps of this level reuse them
+                std::vector<TGV2ViewCache> views;
+                for (int i = 0; i < nimages; i++) views.push_back(TGV2ViewCache(Kl, invKl, Rrel[i], Trel[i]));
+
+                // Full resolution of a pyramid only refines the upsampled solution
+                const unsigned int lwarps = ((levels > 1) && (lvl == 0)) ? tgvfinewarps : warps;
+
+                // Single inner iteration, buffer pointers stay the same for all warps of this level
+                auto iteration = [&](cudaStream_t stream){
+
+                    // Update p values
+                    TGV2_updateP_packed(P, T, ubar.data(), U1, alpha1, sigma, w, h, blocks, threads, stream);
+
+                    // Update Q values
+                    TGV2_updateQ_packed(Q, U1, alpha0, sigma, w, h, blocks, threads, stream);
+
+                    // Update r values of all source views, prodsum is overwritten
+                    TGV2_updateR_multiview(r.data(), prodsum.data(), u.data(), u0.data(), It.data(), Iu.data(), nimages,
+                                           sigma, lambda, w, h, blocks, threads, stream);
+
+                    // Update all u values
+                    TGV2_updateU_packed(u.data(), ubar.data(), U1, T, P, Q, prodsum.data(),
+                                        alpha0, alpha1, tau, lambda, w, h, blocks, threads, stream);
+                };
+
+                // Capture iteration into a graph, the stream is blocking so replays stay ordered with default stream work.
+                // Graph, executable and stream are released when the level ends or a check throws.
+                struct GraphScope {
+                    cudaStream_t stream = 0;
+                    cudaGraph_t graph = 0;
+                    cudaGraphExec_t exec = 0;
+                    ~GraphScope() {
+#if CUDART_VERSION >= 11040
+                        if (exec) cudaGraphExecDestroy(exec);
+                        if (graph) cudaGraphDestroy(graph);
+                        if (!stream) return;
+                        cudaStreamCaptureStatus status = cudaStreamCaptureStatusNone;
+                        if ((cudaStreamIsCapturing(stream, &status) == cudaSuccess) && (status != cudaStreamCaptureStatusNone)) {
+                            cudaGraph_t aborted = 0;
+                            cudaStreamEndCapture(stream, &aborted);
+                            if (aborted) cudaGraphDestroy(aborted);
+                        }
+                        cudaStreamDestroy(stream);
+#endif
+                    }
+                } tgvscope;
+                cudaStream_t & graphstream = tgvscope.stream;
+                cudaGraphExec_t & graphexec = tgvscope.exec;
+#if CUDART_VERSION >= 11040
+                if (tgvgraph){
+                    CHECK_CUDA_ERRORS_AUTO(cudaStreamCreate(&graphstream));
+                    CHECK_CUDA_ERRORS_AUTO(cudaStreamBeginCapture(graphstream, cudaStreamCaptureModeThreadLocal));
+                    iteration(graphstream);
+                    CHECK_CUDA_ERRORS_AUTO(cudaStreamEndCapture(graphstream, &tgvscope.graph));
+                    CHECK_CUDA_ERRORS_AUTO(cudaGraphInstantiateWithFlags(&graphexec, tgvscope.graph, 0));
+                    CHECK_CUDA_ERRORS_AUTO(cudaGraphDestroy(tgvscope.graph));
+                    tgvscope.graph = 0;
+                }
+#endif
 
-                // Reset prodsum to 0
-                set_value(prodsum.data(), 0.f, w, h, blocks, threads);
+                for (int l = 0; l < lwarps; l++){
+                    NVTX_RANGE_INDEX("TGV warp", NvtxDenoise, l);
+                    timer.begin("warp");
+
+                    // Set last solution as initialization for new level of iterations, copyFrom is slightly faster than operator= (see image.h)
+                    u0.copyFrom(u);
+                    ubar.copyFrom(u);
+
+                    // Reset variables, zero bytes are 0.f so packed buffers are cleared with memset
+                    CHECK_CUDA_ERRORS_AUTO(cudaMemset(P, 0, w * h * sizeof(float2)));
+                    CHECK_CUDA_ERRORS_AUTO(cudaMemset(Q, 0, w * h * sizeof(float4)));
+                    CHECK_CUDA_ERRORS_AUTO(cudaMemset(U1, 0, w * h * sizeof(float4)));
+
+                    // Linearize each source view at u0 giving It and Iu, r is reset
+                    for (int i = 0; i < nimages; i++){
+                        if (texturesampling)
+                            TGV2_linearize_texture(It.data() + i * layer, Iu.data() + i * layer, r.data() + i * layer, u0.data(),
+                                                   Ref[lvl].data(), texSrc[i].texture(), views[i], w, h, blocks, threads);
+                        else
+                            TGV2_linearize(It.data() + i * layer, Iu.data() + i * layer, r.data() + i * layer, u0.data(),
+                                           Ref[lvl].data(), Src[i * levels + lvl].data(), sw[lvl], sh[lvl], views[i],
+                                           w, h, blocks, threads);
+                    }
+                    timer.count(nimages, 0, 1);
+
+                    timer.begin("iterations");
+                    if (convergencetol > 0) uprev.copyFrom(u);
+
+                    for (int i = 0; i < niters; i++){
+
+                        // Stop iterations of this warp if u does not change anymore
+                        if ((convergencetol > 0) && (i > 0) && (i % convergenceinterval == 0))
+                            if (RelativeChange(u.data(), uprev) < convergencetol) break;
+                        tgviterations++;
+
+                        if (graphexec) CHECK_CUDA_ERRORS_AUTO(cudaGraphLaunch(graphexec, graphstream));
+                        else iteration(0);
+                        timer.count(graphexec ? 1 : 4, 0, 1);
+                    }
+                }
 
-                // Iterate over each source view
-                for (int j = 0; j < nimages; j++){
-                    // Update r values
-                    TGV2_updateR(r[j].data(), prodsum.data(), u.data(), u0.data(), It[j].data(), Iu[j].data(), sigma, lambda, w, h, blocks, threads);
+#if CUDART_VERSION >= 11040
+                if (graphexec){
+                    CHECK_CUDA_ERRORS_AUTO(cudaGraphExecDestroy(graphexec));
+                    graphexec = 0;
+                    CHECK_CUDA_ERRORS_AUTO(cudaStreamDestroy(graphstream));
+                    graphstream = 0;
                 }
+#endif
 
-                // Update all u values
-                TGV2_updateU_tensor_weighed(u.data(), u1x.data(), u1y.data(), T1.data(), T2.data(), T3.data(), T4.data(),
-                                            ubar.data(), u1xbar.data(), u1ybar.data(), Px.data(), Py.data(),
-                                            qx.data(), qy.data(), qz.data(), qw.data(), prodsum.data(),
-                                            alpha0, alpha1, tau, lambda, w, h, blocks, threads);
+                ucoarse = &u;
             }
-        }
 
-        // Copy result to host memory
-        u.copyTo(depthmapTGV);
+            // Copy kept rows to host memory, finest level is full resolution
+            timer.begin("download");
+            CHECK_CUDA_ERRORS_AUTO(cudaMemcpy(depthmapTGV.data() + s.y0 * w, ucoarse->data() + (s.y0 - s.r0) * w,
+                                              s.rows * w * sizeof(float), cudaMemcpyDeviceToHost));
+            timer.count(0, s.rows * w * sizeof(float));
+        }
+        timer.stop();
 
         // Convert to uchar so it can be easily displayed as gray image
         ConvertDepthtoUChar(depthmapTGV, depthmap8uTGV);
+        storeTemporalPrior(0, &depthmapTGV);
 
-        auto t2 = std::chrono::high_resolution_clock::now();
-        std::cout << "Time taken for the TGV to complete is " <<
-                     std::chrono::duration_cast<std::chrono::milliseconds>(t2-t1).count() << "ms\n\n";
-        std::cout.flush();
+        if (verbose) timer.timings().print(std::cout);
 
         return true;
 
@@ -558,10 +2129,13 @@ void PlaneSweep::get3Dcoordinates(CamImage<float> *&x, CamImage<float> *&y, CamI
         RelativeMatrices(Rr, t, HostRef.R, HostRef.t, I, T);
 
         int w = HostRef.width(), h = HostRef.height();
-        Image<float> Px(w,h), Py(w,h), X(w,h);
+        Image<float> &Px = scratch("coords.Px", w, h);
+        Image<float> &Py = scratch("coords.Py", w, h);
+        Image<float> &X = scratch("coords.X", w, h);
 
-        // copy depthmap to device
-        X.copyFrom(depthmapdenoised);
+        // denoised depthmap is still on the device if it was not downloaded yet
+        if (denoisedpending) X.copyFrom(Image<float>(d_depthmap, w, h));
+        else X.copyFrom(depthmapdenoised);
 
         // calculate world coordinates
         compute3D(Px.data(), Py.data(), X.data(), Rr, t, invK, w, h, blocks, threads);
@@ -585,20 +2159,353 @@ void PlaneSweep::get3Dcoordinates(CamImage<float> *&x, CamImage<float> *&y, CamI
     }
 }
 
+bool PlaneSweep::getPoints(void *points, size_t stride, size_t coloroffset, const CamImage<float> &depth, const float *d_depth)
+{
+    try {
+        int w = HostRef.width(), h = HostRef.height();
+        ASSERT_AUTO(((depth.width() == w) && (depth.height() == h) && (stride % 16 == 0)));
+        if (threads.x * threads.y == 0) threads = dim3(DEFAULT_BLOCK_XDIM, maxThreadsPerBlock/DEFAULT_BLOCK_XDIM);
+        dim3 b(ceil(w / (float)threads.x), ceil(h / (float)threads.y));
+
+        if (!d_depth){
+            Image<float> &D = scratch("points.depth", w, h);
+            D.copyFrom(depth);
+            d_depth = D.data();
+        }
+
+        // colors are uploaded as 8 bit color if available, only one of them is read
+        const uchar4 *d_color = 0;
+        const float *d_gray = 0;
+        if (HostRefRGBA.isValid() && (HostRefRGBA.width() == w) && (HostRefRGBA.height() == h)){
+            Image<uchar4> C(scratchPacked<uchar4>("points.color", w, h), w, h);
+            C.copyFrom(HostRefRGBA);
+            d_color = C.data();
+        }
+        else {
+            Image<float> &G = scratch("points.gray", w, h);
+            G.copyFrom(HostRef);
+            d_gray = G.data();
+        }
+
+        // interleaved points come back with one copy
+        Image<float> &P = scratch("points.points", w * stride / sizeof(float), h);
+        depth_to_points(P.data(), stride, coloroffset, d_depth, d_color, d_gray, invK, w, h, b, threads);
+        CHECK_CUDA_ERRORS_AUTO(cudaMemcpy(points, P.data(), w * h * stride, cudaMemcpyDeviceToHost));
+        return true;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Exception caught: ";
+        std::cerr << e.what() << std::endl;
+
+        cudaReset();
+        return false;
+    }
+}
+
 void PlaneSweep::cudaReset()
 {
-    CHECK_CUDA_ERRORS_AUTO(cudaDeviceReset());
+    // pending downloads into pinned writer buffers finish before the context is gone
+    ResultWriter::flushAll();
+
+    // device reset frees all memory, workspace only has to forget its pointers
+    for (auto & img : workspace){
+        img.second.setManaged(false);
+        img.second.free();
+    }
+    workspace.clear();
+
+    // reset additional devices used by multi device planesweep
+    for (int dev : sweepdevices){
+        if (dev == cudadevice) continue;
+        CHECK_CUDA_ERRORS_AUTO(cudaSetDevice(dev));
+        CHECK_CUDA_ERRORS_AUTO(cudaDeviceReset());
+    }
+    sweepdevices.clear();
+    if (cudadevice != NO_CUDA_DEVICE) CHECK_CUDA_ERRORS_AUTO(cudaSetDevice(cudadevice));
+
+    if (!nodevice) CHECK_CUDA_ERRORS_AUTO(cudaDeviceReset());
+    MemoryPool::instance().forget();
+    KernelJit::instance().forget();
+    ResultWriter::forgetAll();
+    FusionForgetBindings();
+    timer.forget();
 
     // set pointers to NULL so cudaFree will not try to free wrong memory
     d_depthmap = 0;
+    d_rawdepthmap = 0;
+    d_refnormalized = 0;
+    d_maskinput = d_validmask = d_confidence = 0;
+    d_masktiles = 0;
+    nmasktiles = 0;
+    maskcache.valid = false;
+    uploadstream = 0;
+    for (int k = 0; k < 2; k++) {
+        uploaded[k] = consumed[k] = 0;
+        stagedviews[k] = -1;
+    }
+    depthavailable = false;
+    temporalprior = temporalinit = false;
+    cpuactive = false;
+    depthmappending = depthmap8upending = false;
+    denoisedpending = denoised8upending = false;
+    cudadevice = NO_CUDA_DEVICE;
+}
+
+Image<float> & PlaneSweep::scratch(const std::string & name, size_t w, size_t h)
+{
+    // workspace is kept per device, map lookup is guarded since std::map nodes are stable but insertion is not thread safe
+    static std::mutex mutex;
+    int dev = 0;
+    CHECK_CUDA_ERRORS_AUTO(cudaGetDevice(&dev));
+    std::unique_lock<std::mutex> lock(mutex);
+    Image<float> & img = workspace[std::to_string(dev) + "." + name];
+    lock.unlock();
+
+    // reallocate only when requested size changes
+    if (!img.isValid() || (img.width() != w) || (img.height() != h)) img.reset(w, h);
+    return img;
+}
+
+bool PlaneSweep::planStrips(const std::string & call, const MemoryEstimate & frame, const MemoryEstimate & strip, int h,
+                            int halo, const std::vector<std::string> & prefixes, std::vector<Strip> & strips)
+{
+    // Workspace of the call is reused, so it counts as available
+    const size_t available = MemoryPlanner::available(memorylimit) + (memorylimit ? 0 : workspaceBytes(prefixes));
+    strips = MemoryPlanner::frame(h);
+    if (MemoryPlanner::fits(frame.bytes(h), available)) return false;
+
+    strips = MemoryPlanner::strips(strip, h, halo, available);
+    if (strips.size() == 1) return false;
+
+    // Full frame images of the call are released before strip images are allocated
+    releaseWorkspace(prefixes);
+    MemoryPool::instance().trim();
+    if (verbose) printf("%s: %zu MB working set exceeds %zu MB, processing %zu strips of %d rows\n\n", call.c_str(),
+                        frame.bytes(h) >> 20, available >> 20, strips.size(), strips.front().h);
+    return true;
+}
+
+size_t PlaneSweep::workspaceBytes(const std::vector<std::string> & prefixes)
+{
+    int dev = 0;
+    CHECK_CUDA_ERRORS_AUTO(cudaGetDevice(&dev));
+    size_t bytes = 0;
+    for (auto it = workspace.begin(); it != workspace.end(); ++it)
+        if (it->second.isValid() && workspaceMatch(it->first, dev, prefixes))
+            bytes += it->second.width() * it->second.height() * sizeof(float);
+    return bytes;
+}
+
+void PlaneSweep::releaseWorkspace(const std::vector<std::string> & prefixes)
+{
+    int dev = 0;
+    CHECK_CUDA_ERRORS_AUTO(cudaGetDevice(&dev));
+    for (auto it = workspace.begin(); it != workspace.end(); ++it)
+        if (workspaceMatch(it->first, dev, prefixes)) it->second.free();
+    if (workspaceMatch(std::to_string(dev) + ".mask.", dev, prefixes)) maskcache.valid = false;
+}
+
+dim3 PlaneSweep::tunedThreads(const std::string & family, int w, int h)
+{
+    // Sweep kernels unroll over the window, so choices of other window sizes do not apply
+    LaunchTuner & tuner = LaunchTuner::instance();
+    const std::string name = (family == "sweep") ? family + ".win" + std::to_string(winsize) : family;
+    dim3 tuned;
+    if (tuner.find(name, w, h, 1, tuned)) return tuned;
+
+    // Trials run on zeroed scratch images, so no data of the call is touched
+    dim3 t(DEFAULT_BLOCK_XDIM, maxThreadsPerBlock/DEFAULT_BLOCK_XDIM);
+    dim3 b(ceil(w/(float)t.x), ceil(h/(float)t.y));
+    Image<float> &a = scratch("tune.a", w, h);
+    Image<float> &bb = scratch("tune.b", w, h);
+    Image<float> &c = scratch("tune.c", w, h);
+    Image<float> &d = scratch("tune.d", w, h);
+    set_value(a.data(), 0.f, w, h, b, t);
+    set_value(bb.data(), 0.f, w, h, b, t);
+    set_value(c.data(), 1.f, w, h, b, t);
+    set_value(d.data(), 1.f, w, h, b, t);
+    auto grid = [w, h](dim3 threads){ return dim3(ceil(w/(float)threads.x), ceil(h/(float)threads.y)); };
+
+    LaunchTuner::trial_type trial;
+    int suggested = 0;
+    Image<Matrix3D> devH(1, 1);
+    if (family == "sweep") {
+        Matrix3D I(1.f, 0.f, 0.f,
+                   0.f, 1.f, 0.f,
+                   0.f, 0.f, 1.f);
+        devH.copyFrom(Image<Matrix3D, Standard>(&I, 1, 1));
+        suggested = planesweep_fused_NCC_block_size(winsize);
+        trial = [&](dim3 threads){
+            planesweep_fused_NCC(a.data(), bb.data(), c.data(), c.data(), c.data(), d.data(), devH.data(), 1.f,
+                                 winsize, stdthresh, w, h, grid(threads), threads);
+        };
+    }
+    else if (family == "tvl1") {
+        suggested = denoising_TVL1_update_block_size();
+        trial = [&](dim3 threads){
+            denoising_TVL1_calculateP_tensor_weighed(a.data(), bb.data(), d.data(), c.data(), c.data(), d.data(),
+                                                     c.data(), 0.1f, w, h, grid(threads), threads);
+            denoising_TVL1_update(c.data(), d.data(), a.data(), bb.data(), c.data(), 0.1f, 0.1f, 1.f, 0.1f,
+                                  w, h, grid(threads), threads);
+        };
+    }
+    else if (family == "tgv") {
+        float2 *P = scratchPacked<float2>("tune.P", w, h);
+        float4 *Q = scratchPacked<float4>("tune.Q", w, h);
+        float4 *U1 = scratchPacked<float4>("tune.U1", w, h);
+        float4 *T = scratchPacked<float4>("tune.T", w, h);
+        CHECK_CUDA_ERRORS_AUTO(cudaMemset(P, 0, w * h * sizeof(float2)));
+        CHECK_CUDA_ERRORS_AUTO(cudaMemset(Q, 0, w * h * sizeof(float4)));
+        CHECK_CUDA_ERRORS_AUTO(cudaMemset(U1, 0, w * h * sizeof(float4)));
+        CHECK_CUDA_ERRORS_AUTO(cudaMemset(T, 0, w * h * sizeof(float4)));
+        suggested = TGV2_updateU_packed_block_size();
+        trial = [&, P, Q, U1, T](dim3 threads){
+            TGV2_updateP_packed(P, T, bb.data(), U1, 1.f, 0.1f, w, h, grid(threads), threads);
+            TGV2_updateU_packed(a.data(), bb.data(), U1, T, P, Q, c.data(), 1.f, 1.f, 0.1f, 1.f, w, h,
+                                grid(threads), threads);
+        };
+    }
+    else {
+        releaseWorkspace({"tune."});
+        return t;
+    }
+
+    // Trial images are only needed once per resolution, so they do not stay in the workspace
+    try {
+        tuned = tuner.tune(name, w, h, 1, suggested, maxThreadsPerBlock, trial);
+    }
+    catch (...) {
+        releaseWorkspace({"tune."});
+        throw;
+    }
+    releaseWorkspace({"tune."});
+    return tuned;
+}
+
+void PlaneSweep::UploadGray(Image<float> &dst, Image<float> *normalized, int view, float scale)
+{
+    const CamImage<float> &gray = view < 0 ? HostRef : HostSrc[view];
+    const CamImage<uchar4> *rgba = view < 0 ? &HostRefRGBA : (view < (int)HostSrcRGBA.size() ? &HostSrcRGBA[view] : 0);
+    const size_t w = gray.width(), h = gray.height();
+    dim3 b(ceil(w / (float)threads.x), ceil(h / (float)threads.y));
+
+    // 8 bit color is transferred once and converted, scaled and normalized by a single kernel
+    if (rgba && rgba->isValid() && (rgba->width() == w) && (rgba->height() == h)){
+        Image<uchar4> devRGBA(scratchPacked<uchar4>("upload.rgba", w, h), w, h);
+        devRGBA.copyFromAsync(*rgba, 0);
+        convert_rgba_to_gray(dst.data(), normalized ? normalized->data() : 0, devRGBA.data(), scale, w, h, b, threads);
+        timer.count(1, w * h * sizeof(uchar4));
+        return;
+    }
+
+    dst.copyFromAsync(gray, 0);
+    if (normalized){
+        normalized->copyFrom(dst);
+        element_scale(normalized->data(), 1/255.f, w, h, b, threads);
+    }
+    if (scale != 1.f) element_scale(dst.data(), scale, w, h, b, threads);
+    timer.count((normalized ? 1 : 0) + (scale != 1.f ? 1 : 0), w * h * sizeof(float));
+}
+
+void PlaneSweep::stageSource(int view)
+{
+    if (!uploadstream) {
+        CHECK_CUDA_ERRORS_AUTO(cudaStreamCreateWithFlags(&uploadstream, cudaStreamNonBlocking));
+        for (int k = 0; k < 2; k++) {
+            CHECK_CUDA_ERRORS_AUTO(cudaEventCreateWithFlags(&uploaded[k], cudaEventDisableTiming));
+            CHECK_CUDA_ERRORS_AUTO(cudaEventCreateWithFlags(&consumed[k], cudaEventDisableTiming));
+        }
+    }
+
+    const int k = view % 2;
+    const CamImage<float> &gray = HostSrc[view];
+    const CamImage<uchar4> *rgba = view < (int)HostSrcRGBA.size() ? &HostSrcRGBA[view] : 0;
+    const size_t w = gray.width(), h = gray.height();
+    dim3 b(ceil(w / (float)threads.x), ceil(h / (float)threads.y));
+    Image<float> &dst = scratch(k ? "upload.stage1" : "upload.stage0", w, h);
+
+    // Staging image is reused once the sweep of the view two back released it
+    CHECK_CUDA_ERRORS_AUTO(cudaStreamWaitEvent(uploadstream, consumed[k], 0));
+    if (rgba && rgba->isValid() && (rgba->width() == w) && (rgba->height() == h)){
+        Image<uchar4> devRGBA(scratchPacked<uchar4>(k ? "upload.stage1.rgba" : "upload.stage0.rgba", w, h), w, h);
+        devRGBA.copyFromAsync(*rgba, uploadstream);
+        convert_rgba_to_gray(dst.data(), 0, devRGBA.data(), 1.f, w, h, b, threads, uploadstream);
+        timer.count(1, w * h * sizeof(uchar4));
+    }
+    else {
+        dst.copyFromAsync(gray, uploadstream);
+        timer.count(0, w * h * sizeof(float));
+    }
+    CHECK_CUDA_ERRORS_AUTO(cudaEventRecord(uploaded[k], uploadstream));
+    stagedviews[k] = view;
+}
+
+const float * PlaneSweep::stagedSource(int view)
+{
+    const int k = view % 2;
+    if (!uploadstream || (stagedviews[k] != view)) return 0;
+    CHECK_CUDA_ERRORS_AUTO(cudaStreamWaitEvent(0, uploaded[k], 0));
+    return scratch(k ? "upload.stage1" : "upload.stage0", HostSrc[view].width(), HostSrc[view].height()).data();
+}
+
+void PlaneSweep::releaseSource(int view)
+{
+    const int k = view % 2;
+    if (!uploadstream || (stagedviews[k] != view)) return;
+    CHECK_CUDA_ERRORS_AUTO(cudaEventRecord(consumed[k], 0));
+    stagedviews[k] = -1;
+}
+
+void PlaneSweep::UploadGray(Image<__half> &dst, int view)
+{
+    // Converted on the host, only 2 bytes per pixel cross PCIe
+    std::vector<float> gray;
+    HostGray(gray, view);
+    std::vector<__half> half(gray.size());
+    for (size_t i = 0; i < gray.size(); i++) half[i] = __float2half(gray[i]);
+    dst.copyFrom(half.data(), dst.width() * sizeof(__half));
+    timer.count(0, half.size() * sizeof(__half));
+}
+
+void PlaneSweep::UploadGray(Image<uchar> &dst, int view)
+{
+    // Rounded like quantize_float_to_uchar on the host, only 1 byte per pixel crosses PCIe
+    std::vector<float> gray;
+    HostGray(gray, view);
+    std::vector<uchar> gray8u(gray.size());
+    for (size_t i = 0; i < gray.size(); i++) gray8u[i] = (uchar)std::min(std::max(std::rint(gray[i]), 0.f), 255.f);
+    dst.copyFrom(gray8u.data(), dst.width() * sizeof(uchar));
+    timer.count(0, gray8u.size() * sizeof(uchar));
+}
+
+bool PlaneSweep::sourcePrecisionSupported(const char *call, bool supported) const
+{
+    if (supported || (sourceprecision == SourceFloat)) return true;
+    std::cerr << call << ": reduced source precision is only supported by the per view NCC sweep in linear memory, "
+                         "use SourceFloat for this configuration" << std::endl;
+    return false;
 }
 
 bool PlaneSweep::TGVdenoiseFromSparse(int argc, char **argv, const CamImage<float> &depth, const unsigned int niters,
                                       const double alpha0, const double alpha1, const double tau, const double sigma, const double theta,
                                       const double beta, const double gamma)
 {
-    auto t1 = std::chrono::high_resolution_clock::now();
-    printf("\nStarting TGV denoising...\n\n");
+    return TGVSparse(argc, argv, &depth, 0, Matrix4D(), niters, alpha0, alpha1, tau, sigma, theta, beta, gamma);
+}
+
+bool PlaneSweep::TGVdenoiseFromSparse(int argc, char **argv, const KITTI::VeloScan &scan, const Matrix4D &velo2cam,
+                                      const unsigned int niters, const double alpha0, const double alpha1, const double tau,
+                                      const double sigma, const double theta, const double beta, const double gamma)
+{
+    return TGVSparse(argc, argv, 0, &scan, velo2cam, niters, alpha0, alpha1, tau, sigma, theta, beta, gamma);
+}
+
+bool PlaneSweep::TGVSparse(int argc, char **argv, const CamImage<float> *depth, const KITTI::VeloScan *scan, const Matrix4D &velo2cam,
+                           const unsigned int niters, const double alpha0, const double alpha1, const double tau, const double sigma,
+                           const double theta, const double beta, const double gamma)
+{
+    if (verbose) printf("\nStarting TGV denoising...\n\n");
 
     try
     {
@@ -612,32 +2519,81 @@ bool PlaneSweep::TGVdenoiseFromSparse(int argc, char **argv, const CamImage<floa
         int h = HostRef.height(), w = HostRef.width();
         depthmapTGV.reset(w, h);
 
-        Image<float> px(w,h), py(w,h), qx(w,h), qy(w,h), qz(w,h), qw(w,h), /*u(w,h),*/ ubar(w,h),
-                vx(w,h), vy(w,h), vxbar(w,h), vybar(w,h), weights(w,h), Ds(w,h), ref(w,h), T1(w,h), T2(w,h), T3(w,h), T4(w,h);
-
-        CHECK_CUDA_ERRORS_AUTO(cudaFree(d_depthmap));
-
-        size_t pitch;
-        CHECK_CUDA_ERRORS_AUTO(cudaMallocPitch(&d_depthmap, &pitch, w * sizeof(float), h));
+        Image<float> &px = scratch("sparse.px", w, h);
+        Image<float> &py = scratch("sparse.py", w, h);
+        Image<float> &qx = scratch("sparse.qx", w, h);
+        Image<float> &qy = scratch("sparse.qy", w, h);
+        Image<float> &qz = scratch("sparse.qz", w, h);
+        Image<float> &qw = scratch("sparse.qw", w, h);
+        Image<float> &ubar = scratch("sparse.ubar", w, h);
+        Image<float> &vx = scratch("sparse.vx", w, h);
+        Image<float> &vy = scratch("sparse.vy", w, h);
+        Image<float> &vxbar = scratch("sparse.vxbar", w, h);
+        Image<float> &vybar = scratch("sparse.vybar", w, h);
+        Image<float> &weights = scratch("sparse.weights", w, h);
+        Image<float> &Ds = scratch("sparse.Ds", w, h);
+        Image<float> &ref = scratch("sparse.ref", w, h);
+        Image<float> &T1 = scratch("sparse.T1", w, h);
+        Image<float> &T2 = scratch("sparse.T2", w, h);
+        Image<float> &T3 = scratch("sparse.T3", w, h);
+        Image<float> &T4 = scratch("sparse.T4", w, h);
+
+        // Result replaces denoised depthmap on the device, keep pending host copies of the previous one
+        getDepthmapDenoised();
+        getDepthmap8uDenoised();
+        Image<float> &result = scratch("sparse.depthmap", w, h);
+        d_depthmap = result.data();
+
+        NVTX_RANGE("TGV sparse", NvtxDenoise);
+        timer.start("TGVdenoiseFromSparse");
+        timer.begin("setup");
 
         if (threads.x * threads.y == 0) threads = dim3(DEFAULT_BLOCK_XDIM, maxThreadsPerBlock/DEFAULT_BLOCK_XDIM);
         blocks = dim3(ceil(w/(float)threads.x), ceil(h/(float)threads.y));
 
-        Ds.copyFrom(depth);
-        calculateWeights_sparseDepth(weights.data(), Ds.data(), w, h, blocks, threads);
+        // Workspace images keep values of previous calls
+        set_value(px.data(), 0.f, w, h, blocks, threads);
+        set_value(py.data(), 0.f, w, h, blocks, threads);
+        set_value(qx.data(), 0.f, w, h, blocks, threads);
+        set_value(qy.data(), 0.f, w, h, blocks, threads);
+        set_value(qz.data(), 0.f, w, h, blocks, threads);
+        set_value(qw.data(), 0.f, w, h, blocks, threads);
+        set_value(vxbar.data(), 0.f, w, h, blocks, threads);
+        set_value(vybar.data(), 0.f, w, h, blocks, threads);
+        timer.count(8);
+
+        if (depth){
+            Ds.copyFrom(*depth);
+            calculateWeights_sparseDepth(weights.data(), Ds.data(), w, h, blocks, threads);
+            timer.count(1, w * h * sizeof(float));
+        }
+        else {
+            // scan is projected straight into the sparse depthmap and weights
+            const int npoints = scan->size();
+            float4 *d_points = scratchPacked<float4>("sparse.velo", std::max(npoints, 1), 1);
+            scan->upload(d_points);
+            project_points_depth(Ds.data(), weights.data(), d_points, npoints, velo2cam, K, znear, w, h, blocks, threads);
+            timer.count(1, npoints * sizeof(float4));
+        }
         element_scale(Ds.data(), 1.f / zfar, w, h, blocks, threads);
-        ubar.copyFrom(depthmap);
+        if (d_rawdepthmap) ubar.copyFrom(Image<float>(d_rawdepthmap, w, h));
+        else {
+            ubar.copyFrom(depthmap);
+            timer.count(0, w * h * sizeof(float));
+        }
         element_scale(ubar.data(), 1.f / zfar, w, h, blocks, threads);
+        timer.count(2);
         //        ubar = u;
-        CHECK_CUDA_ERRORS_AUTO(cudaMemcpy2D(d_depthmap, pitch, ubar.data(), ubar.pitch(), w * sizeof(float), h, cudaMemcpyDeviceToDevice));
+        result.copyFrom(ubar);
 
-        ref.copyFrom(HostRef);
-        element_scale(ref.data(), 1.f / 255.f, w, h, blocks, threads);
+        UploadGray(ref, 0, -1, 1.f / 255.f);
 
         Anisotropic_diffusion_tensor(T1.data(), T2.data(), T3.data(), T4.data(), ref.data(), beta, gamma, w, h, blocks, threads);
         //        set_value(T1.data(), 1.f, w, h, blocks, threads);
         //        set_value(T3.data(), 1.f, w, h, blocks, threads);
+        timer.count(1);
 
+        timer.begin("iterations");
         for (int i = 0; i < niters; i++){
             TGV2_updateP_tensor_weighed(px.data(), py.data(), T1.data(), T2.data(), T3.data(), T4.data(),
                                         d_depthmap, vxbar.data(), vybar.data(), alpha1, sigma, w, h, blocks, threads);
@@ -647,16 +2603,17 @@ bool PlaneSweep::TGVdenoiseFromSparse(int argc, char **argv, const CamImage<floa
                                            qx.data(), qy.data(), qz.data(), qw.data(), weights.data(), Ds.data(), alpha0, alpha1, tau, theta, w, h,
                                            blocks, threads);
         }
+        timer.count(3 * niters, 0, niters);
 
+        timer.begin("download");
         element_scale(d_depthmap, zfar, w, h, blocks, threads);
         //ubar.copyTo(depthmapTGV.data, depthmapTGV.pitch);
-        CHECK_CUDA_ERRORS_AUTO(cudaMemcpy2D(depthmapTGV.data(), depthmapTGV.pitch(), d_depthmap, pitch, w * sizeof(float), h, cudaMemcpyDeviceToHost));
+        result.copyTo(depthmapTGV);
+        timer.count(1, w * h * sizeof(float));
+        timer.stop();
         ConvertDepthtoUChar(depthmapTGV, depthmap8uTGV);
 
-        auto t2 = std::chrono::high_resolution_clock::now();
-        std::cout << "Time taken for the TGV to complete is " <<
-                     std::chrono::duration_cast<std::chrono::milliseconds>(t2-t1).count() << "ms\n\n";
-        std::cout.flush();
+        if (verbose) timer.timings().print(std::cout);
 
         return true;
 
@@ -0,0 +1,153 @@
+#include "pose_index.h"
+#include "reader.h"
+#include "kitti_reader.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QStringList>
+#include <cstring>
+#include <algorithm>
+
+bool PoseIndex::open(const QString & fname)
+{
+    close();
+    file.setFileName(fname);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    Header h;
+    if ((file.size() < (qint64)sizeof(Header)) || (file.read((char *)&h, sizeof(Header)) != sizeof(Header)) ||
+        (memcmp(h.magic, POSE_INDEX_MAGIC, sizeof(h.magic)) != 0) || (h.version != POSE_INDEX_VERSION) ||
+        (h.record != sizeof(Record)) || (h.count < 0) ||
+        (file.size() < (qint64)(sizeof(Header) + h.count * sizeof(Record)))) {
+        file.close();
+        return false;
+    }
+
+    // Records follow the header, which keeps them 8 byte aligned in the page aligned mapping
+    uchar * m = file.map(0, sizeof(Header) + h.count * sizeof(Record));
+    if (!m) {
+        file.close();
+        return false;
+    }
+    records = (const Record *)(m + sizeof(Header));
+    first_ = h.first;
+    count_ = h.count;
+    return true;
+}
+
+void PoseIndex::close()
+{
+    if (records) file.unmap((uchar *)records - sizeof(Header));
+    if (file.isOpen()) file.close();
+    records = 0;
+    first_ = 0;
+    count_ = 0;
+}
+
+const PoseIndex::Record * PoseIndex::record(int number) const
+{
+    if (!records || (number < first_) || (number >= first_ + count_)) return 0;
+    const Record * r = records + (number - first_);
+    return r->valid ? r : 0;
+}
+
+bool PoseIndex::pose(int number, Matrix3D & K, Matrix3D & R, Vector3D & t) const
+{
+    const Record * r = record(number);
+    if (!r) return false;
+    K = r->K;
+    R = r->R;
+    t = r->t;
+    return true;
+}
+
+bool PoseIndex::write(const QString & fname, int first, const QVector<Record> & recs)
+{
+    QFile out(fname);
+    if (!out.open(QIODevice::WriteOnly)) return false;
+
+    Header h;
+    memset(&h, 0, sizeof(Header));
+    memcpy(h.magic, POSE_INDEX_MAGIC, sizeof(h.magic));
+    h.version = POSE_INDEX_VERSION;
+    h.record = sizeof(Record);
+    h.first = first;
+    h.count = recs.size();
+
+    bool s = out.write((const char *)&h, sizeof(Header)) == sizeof(Header);
+    if (recs.size() > 0)
+        s &= out.write((const char *)recs.constData(), recs.size() * sizeof(Record)) == (qint64)(recs.size() * sizeof(Record));
+    out.close();
+    return s;
+}
+
+bool PoseIndex::stale(const QString & fname, const QString & source)
+{
+    QFileInfo index(fname), src(source);
+    return !index.exists() || (src.exists() && (src.lastModified() > index.lastModified()));
+}
+
+bool PoseIndex::buildICLNUIM(const QString & fname, const QString & dir, const QString & name, const int digits)
+{
+    // Frame numbers of all camera files in the directory
+    QStringList files = QDir(dir).entryList(QStringList() << QString("%1*.txt").arg(name), QDir::Files);
+    QVector<int> numbers;
+    for (int i = 0; i < files.size(); i++) {
+        bool ok;
+        int n = files.at(i).mid(name.size(), digits).toInt(&ok);
+        if (ok && (files.at(i).size() == name.size() + digits + 4)) numbers.append(n);
+    }
+    if (numbers.isEmpty()) return false;
+    std::sort(numbers.begin(), numbers.end());
+
+    const int first = numbers.front();
+    QVector<Record> recs(numbers.back() - first + 1);
+    for (int i = 0; i < recs.size(); i++) recs[i].valid = 0;
+
+    Vector3D cam_pos, cam_dir, cam_up, cam_lookat, cam_sky, cam_right, cam_fpoint;
+    double cam_angle;
+    QString impos;
+    for (int i = 0; i < numbers.size(); i++) {
+        Record & r = recs[numbers[i] - first];
+        Reader::ImageName(impos, numbers[i], digits, dir, name, "png");
+        if (!Reader::getcamParameters(impos, cam_pos, cam_dir, cam_up, cam_lookat, cam_sky, cam_right, cam_fpoint, cam_angle))
+            continue;
+        Reader::getcamK(r.K, cam_dir, cam_up, cam_right);
+        Reader::computeRT(r.R, r.t, cam_dir, cam_pos, cam_up);
+        r.tstamp = 0;
+        r.valid = 1;
+    }
+
+    return write(fname, first, recs);
+}
+
+bool PoseIndex::buildKITTI(const QString & fname, const KITTI::KITTIReader & reader, const Matrix3D & K)
+{
+    QVector<double> ts;
+    if (!reader.ReadTimestampFile(ts, KITTI::TSOxTS) || ts.isEmpty()) return false;
+
+    QVector<Record> recs(ts.size());
+    double scale = 0;
+    Matrix4D pose0inv;
+    for (int i = 0; i < recs.size(); i++) {
+        Record & r = recs[i];
+        r.valid = 0;
+        r.tstamp = ts[i];
+
+        KITTI::OxTS o;
+        if (!reader.ReadOxTSFile(o, i)) continue;
+
+        // Same normalization as convertOxtsToPose, first pose is the origin
+        if (i == 0) scale = KITTI::latToScale(o.lat);
+        Matrix4D pose(KITTI::convertOxtsToTForm(o, scale), make_float4(0,0,0,1));
+        if (i == 0) pose0inv = pose.inv();
+        pose = pose0inv * pose;
+
+        r.K = K;
+        r.R = Matrix3D(make_float3(pose.r1), make_float3(pose.r2), make_float3(pose.r3));
+        r.t = Vector3D(pose.r1.w, pose.r2.w, pose.r3.w);
+        r.valid = (scale != 0);
+    }
+
+    return write(fname, 0, recs);
+}
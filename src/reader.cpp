@@ -1,16 +1,42 @@
 #include "reader.h"
 #include "helper_structs.h"
 #include "defines.h"
+#include "image_loader.h"
+#include "nvtx_range.h"
 
 #include <QFile>
 #include <QTextStream>
-#include <QMessageBox>
 #include <QStringList>
+#include <QFileInfo>
+#include <QRegExp>
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <iostream>
+
+static Reader::ErrorHandler & errorHandler()
+{
+    static Reader::ErrorHandler handler;
+    return handler;
+}
+
+void Reader::setErrorHandler(ErrorHandler handler)
+{
+    errorHandler() = handler;
+}
+
+void Reader::reportError(const QString & title, const QString & message)
+{
+    if (errorHandler()) errorHandler()(title, message);
+    else std::cerr << title.toStdString() << ": " << message.toStdString() << std::endl;
+}
 
 bool Reader::Read_FromSource(QImage &ref, Matrix3D &Rref, Vector3D &tref,
-                             QVector<QImage> &src, QVector<Matrix3D> &Rsrc, QVector<Vector3D> tsrc,
+                             QVector<QImage> &src, QVector<Matrix3D> &Rsrc, QVector<Vector3D> & tsrc,
                              Matrix3D &K)
 {
+    NVTX_RANGE("Read_FromSource", NvtxIO);
+
     // Load 0th image from source directory
     QString loc = "/PlaneSweep/im";
     QString refr = SOURCE_DIR;
@@ -97,6 +123,7 @@ bool Reader::Read_ICL_NUIM_RGB(QImage & ref, Matrix3D & Rref, Vector3D & tref, c
                                QVector<QImage> & src, QVector<Matrix3D> & Rsrc, QVector<Vector3D> & tsrc, const QVector<int> & srcn,
                                Matrix3D & K, const QString & directory, const QString & fname, const QString & format, const int digits)
 {
+    NVTX_RANGE_INDEX("Read_ICL_NUIM_RGB", NvtxIO, refn);
     // get image name strings
     QString impos;
     QString imname = ImageName(impos, refn, digits, directory, fname, format);
@@ -111,7 +138,8 @@ bool Reader::Read_ICL_NUIM_RGB(QImage & ref, Matrix3D & Rref, Vector3D & tref, c
 
     computeRT(Rref, tref, cam_dir, cam_pos, cam_up);
 
-    if (!ref.load(imname)) return false;
+    ImageLoader & loader = ImageLoader::instance();
+    loader.request(imname, true);
 
     int nsrc = srcn.size();
 
@@ -123,14 +151,27 @@ bool Reader::Read_ICL_NUIM_RGB(QImage & ref, Matrix3D & Rref, Vector3D & tref, c
     Rsrc.resize(nsrc);
     tsrc.resize(nsrc);
 
+    // queue all views for parallel decoding, then collect them in order
+    QString refname = imname;
+    QStringList srcnames;
+    for (int i = 0; i < nsrc; i++){
+        srcnames << ImageName(impos, srcn[i], digits, directory, fname, format);
+        loader.request(srcnames.back(), true);
+    }
+
+    ImageLoader::Frame frame;
+    if (!loader.take(refname, frame)) return false;
+    ref = frame.image;
+
     for (int i = 0; i < nsrc; i++){
         if (i < half) offset = i + 1;
         else offset = half - i - 1;
-        imname = ImageName(impos, srcn[loaded], digits, directory, fname, format);
-        if (getcamParameters(impos, cam_pos, cam_dir, cam_up, cam_lookat,cam_sky, cam_right, cam_fpoint, cam_angle)){
-            computeRT(Rsrc[loaded], tsrc[loaded], cam_dir, cam_pos, cam_up);
-            if (src[loaded].load(imname)) loaded++;
-        }
+        imname = ImageName(impos, srcn[i], digits, directory, fname, format);
+        bool cam = getcamParameters(impos, cam_pos, cam_dir, cam_up, cam_lookat,cam_sky, cam_right, cam_fpoint, cam_angle);
+        if (!loader.take(srcnames.at(i), frame) || !cam) continue;
+        computeRT(Rsrc[loaded], tsrc[loaded], cam_dir, cam_pos, cam_up);
+        src[loaded] = frame.image;
+        loaded++;
     }
 
     src.resize(loaded);
@@ -143,6 +184,7 @@ bool Reader::Read_ICL_NUIM_RGB(QImage & ref, Matrix3D & Rref, Vector3D & tref, c
 bool Reader::Read_ICL_NUIM_depth(QImage & depth, const int number, const QString & directory,
                                  const QString &fname, const QString &format, const int digits)
 {
+    NVTX_RANGE_INDEX("Read_ICL_NUIM_depth", NvtxIO, number);
     QString impos;
     ImageName(impos, number, digits, directory, fname, format);
     QString dp = impos;
@@ -152,11 +194,186 @@ bool Reader::Read_ICL_NUIM_depth(QImage & depth, const int number, const QString
     return depth.load(dp);
 }
 
+bool Reader::Read_ICL_NUIM_depth(std::vector<float> & depth, const int width, const int height, const Matrix3D & K,
+                                 const int number, const QString & directory, const QString & fname,
+                                 const QString & format, const int digits, const float scale)
+{
+    NVTX_RANGE_INDEX("Read_ICL_NUIM_depth", NvtxIO, number);
+    QString impos;
+    ImageName(impos, number, digits, directory, fname, format);
+    QString dp = impos;
+    int dot = dp.lastIndexOf('.');
+    if (dot != -1) dp.truncate(dot);
+    dp += ".depth";
+
+    QFile file(dp);
+    if (!file.open(QIODevice::ReadOnly)) {
+        reportError("Error reading file", file.errorString());
+        return false;
+    }
+
+    // all values are separated by white space, usually in a single line
+    const QStringList n = QString(file.readAll()).split(QRegExp("\\s+"), QString::SkipEmptyParts);
+    if (n.size() < width * height) {
+        reportError("Error reading file", dp + " holds " + QString::number(n.size()) + " of " +
+                    QString::number(width * height) + " depth values");
+        return false;
+    }
+
+    depth.resize(width * height);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++) {
+            const float u = (x + 1 - K(0,2)) / K(0,0), v = (y + 1 - K(1,2)) / K(1,1);
+            depth[x + width * y] = scale * n.at(x + width * y).toFloat() / sqrt(u * u + v * v + 1);
+        }
+    return true;
+}
+
 bool Reader::Read_TUM_RGBD_RGB(QImage & ref, Matrix3D & Rref, Vector3D & tref, const int refindex,
                                QVector<QImage> & src, QVector<Matrix3D> & Rsrc, QVector<Vector3D> & tsrc, const QVector<int> & srcindex,
                                const QString & rgbtextfile, const TUM_RGBD_line &line)
 {
-    return false;
+    NVTX_RANGE_INDEX("Read_TUM_RGBD_RGB", NvtxIO, refindex);
+    // association index is built once per sequence instead of scanning text files for every frame
+    static std::mutex mutex;
+    static QString indexed;
+    static QVector<TUM_RGBD_file> files;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (indexed != rgbtextfile){
+        indexed.clear();
+        QString groundtruth = QFileInfo(rgbtextfile).absolutePath() + '/' + TUM_GROUNDTRUTH_NAME;
+        if (!Associate_TUM_RGBD(files, rgbtextfile, groundtruth, line)) return false;
+        indexed = rgbtextfile;
+    }
+    if ((refindex < 0) || (refindex >= files.size())) return false;
+
+    // queue all views for parallel decoding, then collect them in order
+    ImageLoader & loader = ImageLoader::instance();
+    int nsrc = srcindex.size();
+    loader.request(files[refindex].RGBfname, true);
+    for (int i = 0; i < nsrc; i++)
+        if ((srcindex[i] >= 0) && (srcindex[i] < files.size())) loader.request(files[srcindex[i]].RGBfname, true);
+
+    ImageLoader::Frame frame;
+    if (!loader.take(files[refindex].RGBfname, frame)) return false;
+    ref = frame.image;
+    Rref = quat2R(files[refindex].RGBdata.q);
+    tref = Vector3D(files[refindex].RGBdata.t);
+
+    int loaded = 0;
+    src.resize(nsrc);
+    Rsrc.resize(nsrc);
+    tsrc.resize(nsrc);
+    for (int i = 0; i < nsrc; i++){
+        if ((srcindex[i] < 0) || (srcindex[i] >= files.size())) continue;
+        const TUM_RGBD_file & f = files[srcindex[i]];
+        if (!loader.take(f.RGBfname, frame)) continue;
+        src[loaded] = frame.image;
+        Rsrc[loaded] = quat2R(f.RGBdata.q);
+        tsrc[loaded] = Vector3D(f.RGBdata.t);
+        loaded++;
+    }
+
+    src.resize(loaded);
+    Rsrc.resize(loaded);
+    tsrc.resize(loaded);
+
+    // decode views of the next reference frame while this one is processed
+    if (refindex + 1 < files.size()) loader.request(files[refindex + 1].RGBfname);
+    for (int i = 0; i < nsrc; i++)
+        if ((srcindex[i] + 1 >= 0) && (srcindex[i] + 1 < files.size())) loader.request(files[srcindex[i] + 1].RGBfname);
+
+    return true;
+}
+
+bool Reader::Associate_TUM_RGBD(QVector<TUM_RGBD_file> & files, const QString & rgbtextfile, const QString & groundtruthfile,
+                                const TUM_RGBD_line & line, const double maxdiff)
+{
+    // fields of image lines
+    int tfield = -1, rgbfield = -1, depthfield = -1;
+    for (int i = 0; (i < line.nfields) && (i < 3); i++){
+        if (line.prop[i] == timestamp) tfield = i;
+        if (line.prop[i] == RGB) rgbfield = i;
+        if (line.prop[i] == depth) depthfield = i;
+    }
+    if ((tfield == -1) || (rgbfield == -1)) return false;
+
+    // read groundtruth and sort it once by timestamp
+    QFile gt(groundtruthfile);
+    if (!gt.open(QIODevice::ReadOnly)) {
+        reportError("Error reading file", gt.errorString());
+        return false;
+    }
+
+    QVector<TUM_RGBD_data> poses;
+    QTextStream gtin(&gt);
+    while (!gtin.atEnd()) {
+        QString l = gtin.readLine().trimmed();
+        if (l.isEmpty() || l.startsWith('#')) continue;
+        if (l.split(QRegExp("[\\s,]+"), QString::SkipEmptyParts).size() < 8) continue;
+        poses.append(Line2data(l));
+    }
+    gt.close();
+    if (poses.isEmpty()) return false;
+    std::sort(poses.begin(), poses.end(), [](const TUM_RGBD_data & a, const TUM_RGBD_data & b){ return a.timestamp < b.timestamp; });
+
+    QFile rgb(rgbtextfile);
+    if (!rgb.open(QIODevice::ReadOnly)) {
+        reportError("Error reading file", rgb.errorString());
+        return false;
+    }
+
+    // image paths are relative to the sequence directory
+    QString dir = QFileInfo(rgbtextfile).absolutePath() + '/';
+    files.clear();
+    QTextStream in(&rgb);
+    while (!in.atEnd()) {
+        QString l = in.readLine().trimmed();
+        if (l.isEmpty() || l.startsWith('#')) continue;
+        QStringList n = l.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+        if (n.size() < line.nfields) continue;
+
+        // first groundtruth pose not before the image
+        double ts = n.at(tfield).toDouble();
+        auto it = std::lower_bound(poses.begin(), poses.end(), ts,
+                                   [](const TUM_RGBD_data & d, double t){ return d.timestamp < t; });
+        TUM_RGBD_file f;
+        if (it == poses.begin()) {
+            if (it->timestamp - ts > maxdiff) continue;
+            f.RGBdata = *it;
+        }
+        else if (it == poses.end()) {
+            if (ts - poses.back().timestamp > maxdiff) continue;
+            f.RGBdata = poses.back();
+        }
+        else {
+            if (std::min(ts - (it - 1)->timestamp, it->timestamp - ts) > maxdiff) continue;
+            f.RGBdata = interpData(ts, *(it - 1), *it);
+        }
+        f.RGBdata.timestamp = ts;
+        f.RGBfname = dir + n.at(rgbfield);
+        if (depthfield != -1) {
+            f.depthfname = dir + n.at(depthfield);
+            f.depthdata = f.RGBdata;
+        }
+        files.append(f);
+    }
+    rgb.close();
+
+    return !files.isEmpty();
+}
+
+Matrix3D Reader::quat2R(const float4 & q)
+{
+    float4 n = normalize(q);
+    float x = n.x, y = n.y, z = n.z, w = n.w;
+
+    // camera to world rotation, transposed to world to camera as in computeRT()
+    Matrix3D R(1 - 2*(y*y + z*z),   2*(x*y - z*w),      2*(x*z + y*w),
+               2*(x*y + z*w),       1 - 2*(x*x + z*z),  2*(y*z - x*w),
+               2*(x*z - y*w),       2*(y*z + x*w),      1 - 2*(x*x + y*y));
+    return R.trans();
 }
 
 QString Reader::ImageName(QString & imagetxt, const int number, const int digits, const QString & dir, const QString & name,
@@ -232,7 +449,7 @@ bool Reader::getcamParameters(QString filename, Vector3D & cam_pos, Vector3D & c
     // try opening file
     QFile file(filename);
     if(!file.open(QIODevice::ReadOnly)) {
-        QMessageBox::information(0, "Error reading file", file.errorString());
+        reportError("Error reading file", file.errorString());
         return false;
     }
 
@@ -300,7 +517,7 @@ bool Reader::getcamParameters(QString filename, Vector3D & cam_pos, Vector3D & c
 Reader::TUM_RGBD_data Reader::Line2data(const QString & line)
 {
     QStringList n;
-    n = line.split(',', QString::SkipEmptyParts);
+    n = line.split(QRegExp("[\\s,]+"), QString::SkipEmptyParts);
     TUM_RGBD_data d;
     d.timestamp = string2seconds(n.at(0).trimmed());
     d.t = make_float3(n.at(1).trimmed().toFloat(), n.at(2).trimmed().toFloat(), n.at(3).trimmed().toFloat());
@@ -314,6 +531,9 @@ Reader::TUM_RGBD_data Reader::interpData(const double timestamp, const TUM_RGBD_
     TUM_RGBD_data r;
     r.timestamp = timestamp;
     r.t = lerp(data1.t, data2.t, frac);
-    r.q = lerp(data1.q, data2.q, frac);
+    // q and -q are the same rotation, interpolate along the shorter arc
+    float4 q2 = data2.q;
+    if (dot(data1.q, q2) < 0) q2 = make_float4(-q2.x, -q2.y, -q2.z, -q2.w);
+    r.q = lerp(data1.q, q2, frac);
     return r;
 }
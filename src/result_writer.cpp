@@ -0,0 +1,354 @@
+#include "result_writer.h"
+#include "exception.h"
+#include "cuda_exception.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#ifdef LZ4_FOUND
+#include <lz4.h>
+#endif
+#ifdef ZSTD_FOUND
+#include <zstd.h>
+#endif
+
+// IEEE 754 half precision conversion with round to nearest even, host side counterpart of __float2half_rn
+static unsigned short floatToHalf(float f)
+{
+    unsigned int x;
+    memcpy(&x, &f, sizeof(x));
+    const unsigned int sign = (x >> 16) & 0x8000u;
+    const int exp = (int)((x >> 23) & 0xffu) - 127 + 15;
+    unsigned int mant = x & 0x7fffffu;
+
+    if (((x >> 23) & 0xffu) == 0xffu) return sign | 0x7c00u | (mant ? 0x200u : 0); // inf, nan
+    if (exp >= 31) return sign | 0x7c00u;                                           // overflow to inf
+    if (exp <= 0) {
+        if (exp < -10) return sign;                                                 // underflow to zero
+        mant |= 0x800000u;
+        const int shift = 14 - exp;
+        unsigned int h = mant >> shift;
+        const unsigned int rest = mant & ((1u << shift) - 1), half = 1u << (shift - 1);
+        if ((rest > half) || ((rest == half) && (h & 1u))) h++;
+        return sign | h;
+    }
+
+    unsigned int h = ((unsigned int)exp << 10) | (mant >> 13);
+    const unsigned int rest = mant & 0x1fffu;
+    if ((rest > 0x1000u) || ((rest == 0x1000u) && (h & 1u))) h++; // carries into exponent correctly
+    return sign | h;
+}
+
+static float halfToFloat(unsigned short h)
+{
+    const unsigned int sign = (h & 0x8000u) << 16;
+    int exp = (h >> 10) & 0x1f;
+    unsigned int mant = h & 0x3ffu;
+    unsigned int x;
+
+    if (exp == 31) x = sign | 0x7f800000u | (mant << 13);
+    else if (exp == 0) {
+        if (mant == 0) x = sign;
+        else {
+            // normalize subnormal
+            exp = 1;
+            while (!(mant & 0x400u)) { mant <<= 1; exp--; }
+            x = sign | ((unsigned int)(exp - 15 + 127) << 23) | ((mant & 0x3ffu) << 13);
+        }
+    }
+    else x = sign | ((unsigned int)(exp - 15 + 127) << 23) | (mant << 13);
+
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+std::mutex ResultWriter::instancesMutex_;
+std::vector<ResultWriter *> ResultWriter::instances_;
+
+ResultWriter::ResultWriter(unsigned int queue)
+    : queue_(std::max(queue, 1u)), running_(0), stop_(false)
+{
+    worker_ = std::thread(&ResultWriter::work, this);
+    std::lock_guard<std::mutex> lock(instancesMutex_);
+    instances_.push_back(this);
+}
+
+ResultWriter::~ResultWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(instancesMutex_);
+        instances_.erase(std::remove(instances_.begin(), instances_.end(), this), instances_.end());
+    }
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    queued_.notify_all();
+    worker_.join();
+}
+
+ResultWriter::buffer_ptr ResultWriter::acquire(size_t w, size_t h)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // only the pool holds buffers that are not used by pending writes or the caller
+    for (size_t i = 0; i < buffers_.size(); i++)
+        if ((buffers_[i].use_count() == 1) && (buffers_[i]->width() == w) && (buffers_[i]->height() == h))
+            return buffers_[i];
+
+    buffer_ptr b = std::make_shared<Buffer>();
+    b->reset(w, h);
+    buffers_.push_back(b);
+    return b;
+}
+
+void ResultWriter::download(const buffer_ptr & buffer, const float * d_src, cudaStream_t stream)
+{
+    CHECK_CUDA_ERRORS_AUTO(cudaMemcpyAsync(buffer->data(), d_src, buffer->width() * buffer->height() * sizeof(float),
+                                           cudaMemcpyDeviceToHost, stream));
+}
+
+void ResultWriter::writeDepth(const std::string & fname, const buffer_ptr & depth, const buffer_ptr & confidence,
+                              DepthFormat format, DepthCompression compression, cudaStream_t stream)
+{
+    ASSERT_AUTO((depth && (!confidence || ((confidence->width() == depth->width()) &&
+                                           (confidence->height() == depth->height())))));
+
+    // writer thread waits for the downloads instead of the caller, the event is destroyed here until it is queued
+    struct Event {
+        cudaEvent_t e = 0;
+        ~Event() { if (e) cudaEventDestroy(e); }
+    } event;
+    CHECK_CUDA_ERRORS_AUTO(cudaEventCreateWithFlags(&event.e, cudaEventDisableTiming));
+    CHECK_CUDA_ERRORS_AUTO(cudaEventRecord(event.e, stream));
+
+    buffer_ptr d = depth, c = confidence;
+    push([fname, d, c, format, compression](){
+        if (!writeDepthFile(fname, *d, c.get(), format, compression))
+            std::cerr << "Error occured while writing depthmap " << fname << std::endl;
+    }, event.e);
+    event.e = 0;
+}
+
+void ResultWriter::writeDepth(const std::string & fname, const CamImage<float> & depth,
+                              DepthFormat format, DepthCompression compression)
+{
+    buffer_ptr d = acquire(depth.width(), depth.height());
+    d->copyFrom(depth);
+    d->R = depth.R;
+    d->t = depth.t;
+    push([fname, d, format, compression](){
+        if (!writeDepthFile(fname, *d, 0, format, compression))
+            std::cerr << "Error occured while writing depthmap " << fname << std::endl;
+    }, 0);
+}
+
+void ResultWriter::enqueue(std::function<void()> job)
+{
+    push(job, 0);
+}
+
+void ResultWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]{ return jobs_.empty() && (running_ == 0); });
+}
+
+void ResultWriter::forget()
+{
+    flush();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < buffers_.size(); i++) buffers_[i]->setManaged(false);
+    buffers_.clear();
+}
+
+void ResultWriter::flushAll()
+{
+    std::lock_guard<std::mutex> lock(instancesMutex_);
+    for (size_t i = 0; i < instances_.size(); i++) instances_[i]->flush();
+}
+
+void ResultWriter::forgetAll()
+{
+    std::lock_guard<std::mutex> lock(instancesMutex_);
+    for (size_t i = 0; i < instances_.size(); i++) instances_[i]->forget();
+}
+
+void ResultWriter::push(std::function<void()> run, cudaEvent_t event)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this]{ return jobs_.size() < queue_; }); // back pressure instead of unbounded memory
+        Job j;
+        j.run = run;
+        j.event = event;
+        jobs_.push_back(j);
+    }
+    queued_.notify_one();
+}
+
+void ResultWriter::work()
+{
+    for (;;) {
+        Job j;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            queued_.wait(lock, [this]{ return stop_ || !jobs_.empty(); });
+            if (jobs_.empty()) return;
+            j = jobs_.front();
+            jobs_.pop_front();
+            running_++;
+        }
+
+        // a failed write must not end the thread, pending and later writes still have to drain
+        try {
+            if (j.event) {
+                CHECK_CUDA_ERRORS_AUTO(cudaEventSynchronize(j.event));
+                CHECK_CUDA_ERRORS_AUTO(cudaEventDestroy(j.event));
+            }
+            j.run();
+        }
+        catch (const std::exception & e) {
+            std::cerr << "Error occured while writing results:\n" << e.what() << std::endl;
+        }
+        catch (...) {
+            std::cerr << "Error occured while writing results" << std::endl;
+        }
+        j.run = std::function<void()>(); // release buffers before the slot is freed
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_--;
+        }
+        done_.notify_all();
+    }
+}
+
+bool ResultWriter::compressionSupported(DepthCompression compression)
+{
+#ifdef LZ4_FOUND
+    if (compression == CompressLZ4) return true;
+#endif
+#ifdef ZSTD_FOUND
+    if (compression == CompressZstd) return true;
+#endif
+    return compression == CompressNone;
+}
+
+bool ResultWriter::writeDepthFile(const std::string & fname, const Buffer & depth, const Buffer * confidence,
+                                  DepthFormat format, DepthCompression compression)
+{
+    const size_t n = depth.width() * depth.height();
+    const unsigned int channels = confidence ? 2 : 1;
+    const size_t sample = (format == DepthHalf) ? sizeof(unsigned short) : sizeof(float);
+
+    depthFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, DEPTH_FILE_MAGIC, sizeof(h.magic));
+    h.version = DEPTH_FILE_VERSION;
+    h.format = format;
+    h.compression = compressionSupported(compression) ? compression : CompressNone;
+    h.channels = channels;
+    h.width = depth.width();
+    h.height = depth.height();
+    for (int r = 0; r < 3; r++) {
+        h.R[3 * r] = depth.R.r[r].x;
+        h.R[3 * r + 1] = depth.R.r[r].y;
+        h.R[3 * r + 2] = depth.R.r[r].z;
+    }
+    h.t[0] = depth.t.x; h.t[1] = depth.t.y; h.t[2] = depth.t.z;
+    h.rawbytes = channels * n * sample;
+
+    // float payload is written straight from the pinned buffers if nothing has to be converted
+    std::vector<char> raw;
+    const void * chunks[2] = { depth.data(), confidence ? confidence->data() : 0 };
+    if ((format == DepthHalf) || (h.compression != CompressNone)) {
+        raw.resize(h.rawbytes);
+        for (unsigned int c = 0; c < channels; c++) {
+            const float * src = (const float *)chunks[c];
+            char * dst = raw.data() + c * n * sample;
+            if (format == DepthHalf) {
+                unsigned short * d = (unsigned short *)dst;
+                for (size_t i = 0; i < n; i++) d[i] = floatToHalf(src[i]);
+            }
+            else memcpy(dst, src, n * sample);
+        }
+    }
+
+    std::vector<char> packed;
+    const char * payload = raw.data();
+    h.bytes = h.rawbytes;
+#ifdef LZ4_FOUND
+    if (h.compression == CompressLZ4) {
+        packed.resize(LZ4_compressBound((int)h.rawbytes));
+        const int bytes = LZ4_compress_default(raw.data(), packed.data(), (int)h.rawbytes, (int)packed.size());
+        // 0 on failure, payload is stored uncompressed instead
+        if (bytes > 0) {
+            h.bytes = bytes;
+            payload = packed.data();
+        }
+        else h.compression = CompressNone;
+    }
+#endif
+#ifdef ZSTD_FOUND
+    if (h.compression == CompressZstd) {
+        packed.resize(ZSTD_compressBound(h.rawbytes));
+        h.bytes = ZSTD_compress(packed.data(), packed.size(), raw.data(), h.rawbytes, DEFAULT_ZSTD_LEVEL);
+        if (ZSTD_isError(h.bytes)) return false;
+        payload = packed.data();
+    }
+#endif
+
+    std::ofstream out(fname.c_str(), std::ios::binary);
+    if (!out.is_open()) return false;
+    out.write((const char *)&h, sizeof(h));
+    if (raw.empty())
+        for (unsigned int c = 0; c < channels; c++) out.write((const char *)chunks[c], n * sample);
+    else out.write(payload, h.bytes);
+    return out.good();
+}
+
+bool ResultWriter::readDepth(const std::string & fname, depthFileHeader & h, std::vector<float> & depth,
+                             std::vector<float> & confidence)
+{
+    std::ifstream in(fname.c_str(), std::ios::binary);
+    if (!in.is_open()) return false;
+    in.read((char *)&h, sizeof(h));
+    if (!in.good() || (memcmp(h.magic, DEPTH_FILE_MAGIC, sizeof(h.magic)) != 0) || (h.version != DEPTH_FILE_VERSION) ||
+        (h.channels < 1) || (h.channels > 2) || !compressionSupported((DepthCompression)h.compression))
+        return false;
+
+    const size_t n = (size_t)h.width * h.height;
+    const size_t sample = (h.format == DepthHalf) ? sizeof(unsigned short) : sizeof(float);
+    if (h.rawbytes != h.channels * n * sample) return false;
+
+    std::vector<char> payload(h.bytes), raw;
+    in.read(payload.data(), h.bytes);
+    if (!in.good()) return false;
+
+    if (h.compression == CompressNone) raw.swap(payload);
+    else raw.resize(h.rawbytes);
+#ifdef LZ4_FOUND
+    if ((h.compression == CompressLZ4) &&
+        (LZ4_decompress_safe(payload.data(), raw.data(), (int)h.bytes, (int)h.rawbytes) != (int)h.rawbytes))
+        return false;
+#endif
+#ifdef ZSTD_FOUND
+    if ((h.compression == CompressZstd) && (ZSTD_decompress(raw.data(), h.rawbytes, payload.data(), h.bytes) != h.rawbytes))
+        return false;
+#endif
+
+    std::vector<float> * planes[2] = { &depth, &confidence };
+    confidence.clear();
+    for (unsigned int c = 0; c < h.channels; c++) {
+        std::vector<float> & p = *planes[c];
+        p.resize(n);
+        const char * src = raw.data() + c * n * sample;
+        if (h.format == DepthHalf)
+            for (size_t i = 0; i < n; i++) p[i] = halfToFloat(((const unsigned short *)src)[i]);
+        else memcpy(p.data(), src, n * sizeof(float));
+    }
+    return true;
+}
@@ -0,0 +1,157 @@
+#include "stage_timer.h"
+#include "cuda_exception.h"
+#include <iomanip>
+
+const StageTiming * StageTimings::stage(const std::string & name) const
+{
+    for (size_t i = 0; i < stages.size(); i++)
+        if (stages[i].name == name) return &stages[i];
+    return 0;
+}
+
+void StageTimings::writeCSVHeader(std::ostream & out)
+{
+    out << "label,call,stage,ms,bytes,launches,iterations\n";
+}
+
+void StageTimings::writeCSV(std::ostream & out, const std::string & label) const
+{
+    size_t bytes = 0;
+    unsigned int launches = 0;
+    for (size_t i = 0; i < stages.size(); i++) {
+        const StageTiming & s = stages[i];
+        out << label << ',' << call << ',' << s.name << ',' << s.ms << ',' << s.bytes << ',' << s.launches << ','
+            << s.iterations << '\n';
+        bytes += s.bytes;
+        launches += s.launches;
+    }
+    out << label << ',' << call << ",total," << ms << ',' << bytes << ',' << launches << ",0\n";
+}
+
+void StageTimings::print(std::ostream & out) const
+{
+    out << call << ": " << ms << "ms\n";
+    for (size_t i = 0; i < stages.size(); i++) {
+        const StageTiming & s = stages[i];
+        out << "  " << std::left << std::setw(16) << s.name << std::right << std::setw(10) << s.ms << "ms "
+            << std::setw(8) << s.launches << " launches " << std::setw(12) << s.bytes << " bytes";
+        if (s.iterations) out << ' ' << s.iterations << " iterations";
+        out << '\n';
+    }
+    out << std::endl;
+}
+
+StageTimer::~StageTimer()
+{
+    // Errors are ignored, context may already be gone at exit
+    for (size_t i = 0; i < events_.size(); i++) cudaEventDestroy(events_[i]);
+}
+
+cudaEvent_t StageTimer::event()
+{
+    if (used_ == events_.size()) {
+        cudaEvent_t e;
+        CHECK_CUDA_ERRORS_AUTO(cudaEventCreate(&e));
+        events_.push_back(e);
+    }
+    return events_[used_++];
+}
+
+void StageTimer::start(const std::string & call, cudaStream_t stream)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    used_ = 0;
+    intervals_.clear();
+    result_ = StageTimings();
+    result_.call = call;
+    open_ = current_ = -1;
+    stream_ = callstream_ = stream;
+    pending_ = false;
+    started_ = true;
+    first_ = event();
+    CHECK_CUDA_ERRORS_AUTO(cudaEventRecord(first_, callstream_));
+}
+
+void StageTimer::begin(const std::string & name, cudaStream_t stream)
+{
+    end();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!started_) return;
+
+    int s = 0;
+    while ((s < (int)result_.stages.size()) && (result_.stages[s].name != name)) s++;
+    if (s == (int)result_.stages.size()) {
+        result_.stages.push_back(StageTiming());
+        result_.stages.back().name = name;
+    }
+
+    Interval i;
+    i.stage = s;
+    i.start = event();
+    i.stop = event();
+    CHECK_CUDA_ERRORS_AUTO(cudaEventRecord(i.start, stream));
+    intervals_.push_back(i);
+    open_ = intervals_.size() - 1;
+    current_ = s;
+    stream_ = stream;
+}
+
+void StageTimer::end()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (open_ < 0) return;
+    CHECK_CUDA_ERRORS_AUTO(cudaEventRecord(intervals_[open_].stop, stream_));
+    open_ = -1;
+}
+
+void StageTimer::count(unsigned int launches, size_t bytes, unsigned int iterations)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (current_ < 0) return;
+    StageTiming & s = result_.stages[current_];
+    s.launches += launches;
+    s.bytes += bytes;
+    s.iterations += iterations;
+}
+
+void StageTimer::stop()
+{
+    end();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!started_) return;
+    last_ = event();
+    CHECK_CUDA_ERRORS_AUTO(cudaEventRecord(last_, callstream_));
+    started_ = false;
+    pending_ = true;
+    current_ = -1;
+}
+
+const StageTimings & StageTimer::timings()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_) resolve();
+    return result_;
+}
+
+void StageTimer::resolve()
+{
+    CHECK_CUDA_ERRORS_AUTO(cudaEventSynchronize(last_));
+    for (size_t s = 0; s < result_.stages.size(); s++) result_.stages[s].ms = 0;
+    for (size_t i = 0; i < intervals_.size(); i++) {
+        float ms = 0;
+        CHECK_CUDA_ERRORS_AUTO(cudaEventElapsedTime(&ms, intervals_[i].start, intervals_[i].stop));
+        result_.stages[intervals_[i].stage].ms += ms;
+    }
+    CHECK_CUDA_ERRORS_AUTO(cudaEventElapsedTime(&result_.ms, first_, last_));
+    pending_ = false;
+}
+
+void StageTimer::forget()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.clear();
+    intervals_.clear();
+    used_ = 0;
+    open_ = current_ = -1;
+    pending_ = started_ = false;
+}